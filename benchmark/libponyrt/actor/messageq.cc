@@ -0,0 +1,65 @@
+#include <platform.h>
+
+#include <actor/messageq.h>
+#include <mem/pool.h>
+
+#include "../bench.h"
+
+static pony_msg_t* alloc_msg(uint32_t id)
+{
+  return pony_alloc_msg(POOL_INDEX(sizeof(pony_msg_t)), id);
+}
+
+/// Pushes and pops on one thread. The queue frees each message as the next
+/// one is popped, so this includes a pool allocation and free per message.
+BENCHMARK(MessageQPushPop)
+{
+  messageq_t q;
+  messageq_init(&q);
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    messageq_push(&q, alloc_msg(1));
+    bench_keep(messageq_pop(&q));
+  }
+
+  state.stop();
+  messageq_destroy(&q);
+}
+
+BENCHMARK_RUN(MessageQPushPop, 0, 1);
+
+/// Every thread but the first pushes, and the first pops everything, as
+/// when many actors send to one.
+BENCHMARK(MessageQManyToOne)
+{
+  messageq_t* q = (messageq_t*)state.shared();
+
+  if(state.thread_index() == 0)
+    messageq_init(q);
+
+  state.start();
+
+  if(state.thread_index() == 0)
+  {
+    size_t count = state.iterations() * (state.threads() - 1);
+
+    while(count > 0)
+    {
+      if(messageq_pop(q) != NULL)
+        count--;
+    }
+  } else {
+    for(size_t i = 0; i < state.iterations(); i++)
+      messageq_push(q, alloc_msg(1));
+  }
+
+  state.stop();
+
+  if(state.thread_index() == 0)
+    messageq_destroy(q);
+}
+
+BENCHMARK_RUN(MessageQManyToOne, 0, 2);
+BENCHMARK_RUN(MessageQManyToOne, 0, 4);
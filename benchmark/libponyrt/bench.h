@@ -0,0 +1,79 @@
+#ifndef BENCHMARK_BENCH_H
+#define BENCHMARK_BENCH_H
+
+#include <platform.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** The state of one run of a benchmark.
+ *
+ * A benchmark body runs on each of its threads with the same state values.
+ * It does its setup, calls start(), does the operation iterations() times,
+ * calls stop() and then tears down. Only the time between start() and stop()
+ * is measured, and on several threads it runs from when every thread has
+ * started until every thread has stopped.
+ */
+class BenchState
+{
+  public:
+    BenchState(size_t iterations, size_t arg, size_t threads,
+      size_t thread_index, void* shared);
+
+    size_t iterations() const { return _iterations; }
+    size_t arg() const { return _arg; }
+    size_t threads() const { return _threads; }
+    size_t thread_index() const { return _thread_index; }
+
+    /// Memory that every thread of this run can see, zeroed before the run.
+    void* shared() const { return _shared; }
+
+    void start();
+    void stop();
+
+    /// Counts what one iteration processes, reported as items per second.
+    void set_items(size_t items) { _items = items; }
+    size_t items() const { return _items; }
+
+  private:
+    size_t _iterations;
+    size_t _arg;
+    size_t _threads;
+    size_t _thread_index;
+    void* _shared;
+    size_t _items;
+};
+
+typedef void (*bench_fn)(BenchState& state);
+
+/// Registers a benchmark to run with an argument on a number of threads.
+class BenchRegistrar
+{
+  public:
+    BenchRegistrar(const char* name, bench_fn fn, size_t arg, size_t threads);
+};
+
+/// The most shared memory a benchmark can ask for.
+#define BENCH_SHARED_SIZE 4096
+
+#define BENCH_CAT2(A, B) A##B
+#define BENCH_CAT(A, B) BENCH_CAT2(A, B)
+
+#define BENCHMARK(NAME) static void NAME(BenchState& state)
+
+#define BENCHMARK_RUN(NAME, ARG, THREADS) \
+  static BenchRegistrar BENCH_CAT(NAME##_reg_, __LINE__)( \
+    #NAME, NAME, ARG, THREADS)
+
+/// Stops the compiler optimising away a value that is never used.
+template <typename T> inline void bench_keep(T const& value)
+{
+#if defined(PLATFORM_IS_VISUAL_STUDIO)
+  (void)value;
+  _ReadWriteBarrier();
+#else
+  __asm__ __volatile__("" : : "r,m"(value) : "memory");
+#endif
+}
+
+#endif
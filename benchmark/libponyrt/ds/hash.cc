@@ -0,0 +1,138 @@
+#include <platform.h>
+
+#include <ds/fun.h>
+#include <ds/hash.h>
+#include <mem/pool.h>
+
+#include "../bench.h"
+
+#include <stdlib.h>
+
+typedef struct elem_t
+{
+  size_t key;
+  size_t val;
+} elem_t;
+
+static size_t elem_hash(elem_t* p)
+{
+  return (size_t)hash_int64(p->key);
+}
+
+static bool elem_cmp(elem_t* a, elem_t* b)
+{
+  return a->key == b->key;
+}
+
+static void elem_free(elem_t* p)
+{
+  (void)p;
+}
+
+DECLARE_HASHMAP(benchmap, elem_t);
+DEFINE_HASHMAP(benchmap, elem_t, elem_hash, elem_cmp, pool_alloc_size,
+  pool_free_size, elem_free);
+
+/// Looks up every key in a map of arg entries, as the GC does in its object
+/// and actor maps.
+BENCHMARK(HashMapGet)
+{
+  size_t count = state.arg();
+  elem_t* elems = (elem_t*)malloc(count * sizeof(elem_t));
+
+  benchmap_t map;
+  benchmap_init(&map, 1);
+
+  for(size_t i = 0; i < count; i++)
+  {
+    elems[i].key = i * 64;
+    elems[i].val = i;
+    benchmap_put(&map, &elems[i]);
+  }
+
+  state.set_items(count);
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    for(size_t j = 0; j < count; j++)
+    {
+      elem_t k = {j * 64, 0};
+      bench_keep(benchmap_get(&map, &k));
+    }
+  }
+
+  state.stop();
+  benchmap_destroy(&map);
+  free(elems);
+}
+
+BENCHMARK_RUN(HashMapGet, 64, 1);
+BENCHMARK_RUN(HashMapGet, 4096, 1);
+
+/// Looks up keys that aren't in the map.
+BENCHMARK(HashMapGetMiss)
+{
+  size_t count = state.arg();
+  elem_t* elems = (elem_t*)malloc(count * sizeof(elem_t));
+
+  benchmap_t map;
+  benchmap_init(&map, 1);
+
+  for(size_t i = 0; i < count; i++)
+  {
+    elems[i].key = i * 64;
+    benchmap_put(&map, &elems[i]);
+  }
+
+  state.set_items(count);
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    for(size_t j = 0; j < count; j++)
+    {
+      elem_t k = {(j * 64) + 1, 0};
+      bench_keep(benchmap_get(&map, &k));
+    }
+  }
+
+  state.stop();
+  benchmap_destroy(&map);
+  free(elems);
+}
+
+BENCHMARK_RUN(HashMapGetMiss, 4096, 1);
+
+/// Fills an empty map with arg entries, growing it as it goes, then removes
+/// them all.
+BENCHMARK(HashMapPutRemove)
+{
+  size_t count = state.arg();
+  elem_t* elems = (elem_t*)malloc(count * sizeof(elem_t));
+
+  for(size_t i = 0; i < count; i++)
+    elems[i].key = i * 64;
+
+  state.set_items(count);
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    benchmap_t map;
+    benchmap_init(&map, 1);
+
+    for(size_t j = 0; j < count; j++)
+      benchmap_put(&map, &elems[j]);
+
+    for(size_t j = 0; j < count; j++)
+      benchmap_remove(&map, &elems[j]);
+
+    benchmap_destroy(&map);
+  }
+
+  state.stop();
+  free(elems);
+}
+
+BENCHMARK_RUN(HashMapPutRemove, 4096, 1);
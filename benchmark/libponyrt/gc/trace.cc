@@ -0,0 +1,134 @@
+#include <platform.h>
+
+#include <pony.h>
+
+#include "../bench.h"
+
+#include <string.h>
+
+/// The shapes of object graph the trace benchmarks send.
+enum
+{
+  SHAPE_LIST,
+  SHAPE_TREE,
+  SHAPE_WIDE
+};
+
+#define NODES 1023
+#define WIDE 8
+
+typedef struct node_t
+{
+  pony_type_t* type;
+  struct node_t* child[WIDE];
+} node_t;
+
+static void node_trace(pony_ctx_t* ctx, void* p);
+
+static pony_type_t node_type =
+{
+  1, sizeof(node_t), 0, 0, 0, node_trace, NULL, NULL, NULL, NULL, 0, 0, NULL,
+  NULL, NULL, NULL, 0, NULL
+};
+
+static pony_type_t actor_type =
+{
+  2, sizeof(pony_actor_pad_t), 0, 0, 0, NULL, NULL, NULL, NULL, NULL, 0, 0,
+  NULL, NULL, NULL, NULL, 0, NULL
+};
+
+static void node_trace(pony_ctx_t* ctx, void* p)
+{
+  node_t* node = (node_t*)p;
+
+  for(size_t i = 0; i < WIDE; i++)
+  {
+    if(node->child[i] != NULL)
+      pony_traceobject(ctx, node->child[i], node_trace);
+  }
+}
+
+static node_t* alloc_node(pony_ctx_t* ctx)
+{
+  node_t* node = (node_t*)pony_alloc(ctx, sizeof(node_t));
+  memset(node, 0, sizeof(node_t));
+  node->type = &node_type;
+  return node;
+}
+
+// Builds NODES objects as a linked list, a binary tree, or a root with
+// WIDE-way fan out below it.
+static node_t* build(pony_ctx_t* ctx, size_t shape)
+{
+  node_t* nodes[NODES];
+
+  for(size_t i = 0; i < NODES; i++)
+    nodes[i] = alloc_node(ctx);
+
+  for(size_t i = 1; i < NODES; i++)
+  {
+    switch(shape)
+    {
+      case SHAPE_LIST:
+        nodes[i - 1]->child[0] = nodes[i];
+        break;
+
+      case SHAPE_TREE:
+        nodes[(i - 1) / 2]->child[(i - 1) % 2] = nodes[i];
+        break;
+
+      case SHAPE_WIDE:
+        nodes[(i - 1) / WIDE]->child[(i - 1) % WIDE] = nodes[i];
+        break;
+    }
+  }
+
+  return nodes[0];
+}
+
+// The runtime can only be initialised once, so every run shares one actor.
+// The schedulers are never started, and the benchmark thread acts as one.
+static pony_ctx_t* become_actor()
+{
+  static pony_actor_t* actor = NULL;
+
+  if(actor == NULL)
+  {
+    static char* argv[] = {(char*)"libponyrt.benchmarks", NULL};
+    pony_init(1, argv);
+    actor = pony_create(pony_ctx(), &actor_type);
+  }
+
+  pony_ctx_t* ctx = pony_ctx();
+  pony_become(ctx, actor);
+  return ctx;
+}
+
+/// Traces a graph as a message argument, then traces it back in as though
+/// the message had been received, so the reference counts balance.
+BENCHMARK(TraceSend)
+{
+  pony_ctx_t* ctx = become_actor();
+
+  node_t* root = build(ctx, state.arg());
+  state.set_items(NODES);
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    pony_gc_send(ctx);
+    pony_traceobject(ctx, root, node_trace);
+    pony_send_done(ctx);
+
+    pony_gc_recv(ctx);
+    pony_traceobject(ctx, root, node_trace);
+    pony_recv_done(ctx);
+  }
+
+  state.stop();
+  pony_become(ctx, NULL);
+}
+
+BENCHMARK_RUN(TraceSend, SHAPE_LIST, 1);
+BENCHMARK_RUN(TraceSend, SHAPE_TREE, 1);
+BENCHMARK_RUN(TraceSend, SHAPE_WIDE, 1);
@@ -0,0 +1,328 @@
+#include <platform.h>
+
+#include "bench.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+struct bench_t
+{
+  std::string name;
+  bench_fn fn;
+  size_t arg;
+  size_t threads;
+};
+
+struct result_t
+{
+  std::string name;
+  size_t iterations;
+  size_t threads;
+  double real_ns;
+  double cpu_ns;
+  double items_per_second;
+};
+
+static std::vector<bench_t>& registry()
+{
+  static std::vector<bench_t> benchmarks;
+  return benchmarks;
+}
+
+BenchRegistrar::BenchRegistrar(const char* name, bench_fn fn, size_t arg,
+  size_t threads)
+{
+  bench_t b;
+  b.name = std::string(name) + "/" + std::to_string(arg);
+
+  if(threads > 1)
+    b.name += "/threads:" + std::to_string(threads);
+
+  b.fn = fn;
+  b.arg = arg;
+  b.threads = threads;
+  registry().push_back(b);
+}
+
+// Every thread of a run waits here in start() and stop(), and the last one
+// to arrive takes the time.
+class Barrier
+{
+  public:
+    Barrier(size_t threads)
+      : _threads(threads), _waiting(0), _generation(0)
+    {}
+
+    bool wait()
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      size_t generation = _generation;
+
+      if(++_waiting == _threads)
+      {
+        _waiting = 0;
+        _generation++;
+        _cond.notify_all();
+        return true;
+      }
+
+      _cond.wait(lock, [&]{ return _generation != generation; });
+      return false;
+    }
+
+  private:
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    size_t _threads;
+    size_t _waiting;
+    size_t _generation;
+};
+
+struct run_t
+{
+  Barrier barrier;
+  bench_clock_t::time_point real_start;
+  bench_clock_t::time_point real_stop;
+  std::clock_t cpu_start;
+  std::clock_t cpu_stop;
+
+  run_t(size_t threads)
+    : barrier(threads)
+  {}
+};
+
+static thread_local run_t* this_run;
+
+BenchState::BenchState(size_t iterations, size_t arg, size_t threads,
+  size_t thread_index, void* shared)
+  : _iterations(iterations), _arg(arg), _threads(threads),
+    _thread_index(thread_index), _shared(shared), _items(0)
+{}
+
+void BenchState::start()
+{
+  if(this_run->barrier.wait())
+  {
+    this_run->cpu_start = std::clock();
+    this_run->real_start = bench_clock_t::now();
+  }
+
+  // Nobody starts before the time has been taken.
+  this_run->barrier.wait();
+}
+
+void BenchState::stop()
+{
+  if(this_run->barrier.wait())
+  {
+    this_run->real_stop = bench_clock_t::now();
+    this_run->cpu_stop = std::clock();
+  }
+}
+
+static double run_once(bench_t& b, size_t iterations, double* cpu_ns,
+  size_t* items)
+{
+  run_t run(b.threads);
+  void* shared = calloc(1, BENCH_SHARED_SIZE);
+  std::vector<std::thread> threads;
+  size_t thread_items = 0;
+
+  for(size_t i = 1; i < b.threads; i++)
+  {
+    threads.push_back(std::thread([&, i]{
+      this_run = &run;
+      BenchState state(iterations, b.arg, b.threads, i, shared);
+      b.fn(state);
+    }));
+  }
+
+  this_run = &run;
+  BenchState state(iterations, b.arg, b.threads, 0, shared);
+  b.fn(state);
+  thread_items = state.items();
+
+  for(auto& t : threads)
+    t.join();
+
+  free(shared);
+
+  *cpu_ns = (double)(run.cpu_stop - run.cpu_start) * 1e9 / CLOCKS_PER_SEC;
+  *items = thread_items;
+
+  return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    run.real_stop - run.real_start).count();
+}
+
+static result_t run_bench(bench_t& b, double min_time)
+{
+  size_t iterations = 1;
+  double real_ns;
+  double cpu_ns;
+  size_t items;
+
+  // Grow the iteration count until a run takes long enough to measure.
+  for(;;)
+  {
+    real_ns = run_once(b, iterations, &cpu_ns, &items);
+
+    if((real_ns >= (min_time * 1e9)) || (iterations >= 1000000000))
+      break;
+
+    double scale = (min_time * 1e9 * 1.4) / (real_ns > 1 ? real_ns : 1);
+
+    if(scale > 10)
+      scale = 10;
+    else if(scale < 1.5)
+      scale = 1.5;
+
+    iterations = (size_t)((double)iterations * scale);
+  }
+
+  result_t r;
+  r.name = b.name;
+  r.iterations = iterations;
+  r.threads = b.threads;
+  r.real_ns = real_ns / (double)iterations;
+  r.cpu_ns = cpu_ns / (double)iterations;
+  r.items_per_second = 0;
+
+  if((items > 0) && (real_ns > 0))
+    r.items_per_second = (double)(items * iterations * b.threads) * 1e9 /
+      real_ns;
+
+  return r;
+}
+
+static void write_json(FILE* f, std::vector<result_t>& results)
+{
+  char date[64];
+  time_t now = time(NULL);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+  fprintf(f, "{\n");
+  fprintf(f, "  \"context\": {\n");
+  fprintf(f, "    \"date\": \"%s\",\n", date);
+  fprintf(f, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef NDEBUG
+  fprintf(f, "    \"library_build_type\": \"release\"\n");
+#else
+  fprintf(f, "    \"library_build_type\": \"debug\"\n");
+#endif
+  fprintf(f, "  },\n");
+  fprintf(f, "  \"benchmarks\": [");
+
+  for(size_t i = 0; i < results.size(); i++)
+  {
+    result_t& r = results[i];
+    fprintf(f, "%s\n    {\n", (i > 0) ? "," : "");
+    fprintf(f, "      \"name\": \"%s\",\n", r.name.c_str());
+    fprintf(f, "      \"iterations\": %zu,\n", r.iterations);
+    fprintf(f, "      \"threads\": %zu,\n", r.threads);
+    fprintf(f, "      \"real_time\": %.3f,\n", r.real_ns);
+    fprintf(f, "      \"cpu_time\": %.3f,\n", r.cpu_ns);
+
+    if(r.items_per_second > 0)
+      fprintf(f, "      \"items_per_second\": %.0f,\n", r.items_per_second);
+
+    fprintf(f, "      \"time_unit\": \"ns\"\n");
+    fprintf(f, "    }");
+  }
+
+  fprintf(f, "\n  ]\n}\n");
+}
+
+static void usage()
+{
+  printf(
+    "libponyrt.benchmarks [options]\n"
+    "  --filter=TEXT     Only run benchmarks whose name contains TEXT.\n"
+    "  --min-time=SECS   Run each benchmark for at least SECS seconds.\n"
+    "                    Defaults to 0.5.\n"
+    "  --json=FILE       Also write the results to FILE as JSON, in the\n"
+    "                    format Google Benchmark uses.\n"
+    "  --list            List the benchmarks without running them.\n"
+    );
+}
+
+int main(int argc, char** argv)
+{
+  const char* filter = NULL;
+  const char* json = NULL;
+  double min_time = 0.5;
+  bool list = false;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if(!strncmp(argv[i], "--filter=", 9))
+      filter = argv[i] + 9;
+    else if(!strncmp(argv[i], "--json=", 7))
+      json = argv[i] + 7;
+    else if(!strncmp(argv[i], "--min-time=", 11))
+      min_time = atof(argv[i] + 11);
+    else if(!strcmp(argv[i], "--list"))
+      list = true;
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+
+  std::vector<result_t> results;
+
+  if(!list)
+    printf("%-40s %14s %14s %12s %14s\n", "Benchmark", "Time (ns)",
+      "CPU (ns)", "Iterations", "Items/s");
+
+  for(auto& b : registry())
+  {
+    if((filter != NULL) && (b.name.find(filter) == std::string::npos))
+      continue;
+
+    if(list)
+    {
+      printf("%s\n", b.name.c_str());
+      continue;
+    }
+
+    result_t r = run_bench(b, min_time);
+    results.push_back(r);
+
+    printf("%-40s %14.1f %14.1f %12zu", r.name.c_str(), r.real_ns, r.cpu_ns,
+      r.iterations);
+
+    if(r.items_per_second > 0)
+      printf(" %14.0f", r.items_per_second);
+
+    printf("\n");
+    fflush(stdout);
+  }
+
+  if(json != NULL)
+  {
+    FILE* f = fopen(json, "w");
+
+    if(f == NULL)
+    {
+      fprintf(stderr, "Can't write %s\n", json);
+      return 1;
+    }
+
+    write_json(f, results);
+    fclose(f);
+  }
+
+  return 0;
+}
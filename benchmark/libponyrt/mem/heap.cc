@@ -0,0 +1,61 @@
+#include <platform.h>
+
+#include <mem/heap.h>
+
+#include "../bench.h"
+
+#define BATCH 1024
+
+/// Allocates a batch of small objects, then collects them all, so the cost
+/// includes the sweep that makes their slots free again.
+BENCHMARK(HeapAllocSmall)
+{
+  pony_actor_t* actor = (pony_actor_t*)0xDEADBEEF;
+  uint32_t sizeclass = heap_index(state.arg());
+
+  heap_t heap;
+  heap_init(&heap);
+  state.set_items(BATCH);
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    for(size_t j = 0; j < BATCH; j++)
+      bench_keep(heap_alloc_small(actor, &heap, sizeclass));
+
+    heap.next_gc = 0;
+    heap_startgc(&heap, false);
+    heap_endgc(&heap);
+  }
+
+  state.stop();
+  heap_destroy(&heap);
+}
+
+BENCHMARK_RUN(HeapAllocSmall, 32, 1);
+BENCHMARK_RUN(HeapAllocSmall, 128, 1);
+BENCHMARK_RUN(HeapAllocSmall, 512, 1);
+
+/// Large allocations each get a chunk of their own.
+BENCHMARK(HeapAllocLarge)
+{
+  pony_actor_t* actor = (pony_actor_t*)0xDEADBEEF;
+
+  heap_t heap;
+  heap_init(&heap);
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    bench_keep(heap_alloc_large(actor, &heap, state.arg()));
+
+    heap.next_gc = 0;
+    heap_startgc(&heap, false);
+    heap_endgc(&heap);
+  }
+
+  state.stop();
+  heap_destroy(&heap);
+}
+
+BENCHMARK_RUN(HeapAllocLarge, 4096, 1);
@@ -0,0 +1,51 @@
+#include <platform.h>
+
+#include <mem/pagemap.h>
+
+#include "../bench.h"
+
+#define PAGES 1024
+
+/// Looks up addresses spread over many mapped pages, as the GC does for
+/// every pointer it traces.
+BENCHMARK(PagemapGet)
+{
+  char* base = (char*)((uintptr_t)state.arg() << 30);
+
+  for(size_t i = 0; i < PAGES; i++)
+    pagemap_set(base + (i << 12), base);
+
+  state.set_items(PAGES);
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    for(size_t j = 0; j < PAGES; j++)
+      bench_keep(pagemap_get(base + (j << 12) + 64));
+  }
+
+  state.stop();
+
+  for(size_t i = 0; i < PAGES; i++)
+    pagemap_set(base + (i << 12), NULL);
+}
+
+BENCHMARK_RUN(PagemapGet, 3, 1);
+
+/// Looks up addresses that were never mapped.
+BENCHMARK(PagemapGetMiss)
+{
+  char* base = (char*)((uintptr_t)state.arg() << 30);
+  state.set_items(PAGES);
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    for(size_t j = 0; j < PAGES; j++)
+      bench_keep(pagemap_get(base + (j << 12)));
+  }
+
+  state.stop();
+}
+
+BENCHMARK_RUN(PagemapGetMiss, 5, 1);
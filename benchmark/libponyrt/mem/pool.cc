@@ -0,0 +1,70 @@
+#include <platform.h>
+
+#include <mem/pool.h>
+
+#include "../bench.h"
+
+#define BATCH 1024
+
+/// Allocates and frees straight away, which stays in the thread's free list.
+BENCHMARK(PoolAllocFree)
+{
+  size_t index = pool_index(state.arg());
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    void* p = pool_alloc(index);
+    bench_keep(p);
+    pool_free(index, p);
+  }
+
+  state.stop();
+}
+
+BENCHMARK_RUN(PoolAllocFree, 32, 1);
+BENCHMARK_RUN(PoolAllocFree, 1024, 1);
+BENCHMARK_RUN(PoolAllocFree, 32, 4);
+
+/// Allocates a batch then frees it, which moves blocks between the thread's
+/// free list and the global one, so threads contend on the global list.
+BENCHMARK(PoolAllocFreeBatch)
+{
+  size_t index = pool_index(state.arg());
+  void* batch[BATCH];
+  state.set_items(BATCH);
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    for(size_t j = 0; j < BATCH; j++)
+      batch[j] = pool_alloc(index);
+
+    for(size_t j = 0; j < BATCH; j++)
+      pool_free(index, batch[j]);
+  }
+
+  state.stop();
+}
+
+BENCHMARK_RUN(PoolAllocFreeBatch, 64, 1);
+BENCHMARK_RUN(PoolAllocFreeBatch, 64, 2);
+BENCHMARK_RUN(PoolAllocFreeBatch, 64, 4);
+
+/// Sizes above the largest pool come from the thread's block list.
+BENCHMARK(PoolAllocFreeSize)
+{
+  size_t size = state.arg();
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    void* p = pool_alloc_size(size);
+    bench_keep(p);
+    pool_free_size(size, p);
+  }
+
+  state.stop();
+}
+
+BENCHMARK_RUN(PoolAllocFreeSize, 1 << 20, 1);
@@ -0,0 +1,52 @@
+#include <platform.h>
+
+#include <sched/mpmcq.h>
+
+#include "../bench.h"
+
+/// Each thread pushes then pops, so on several threads they all contend on
+/// both ends of the queue, as the schedulers do on the inject queue.
+BENCHMARK(MPMCQPushPop)
+{
+  mpmcq_t* q = (mpmcq_t*)state.shared();
+
+  if(state.thread_index() == 0)
+    mpmcq_init(q);
+
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    mpmcq_push(q, q);
+
+    while(mpmcq_pop(q) == NULL);
+  }
+
+  state.stop();
+
+  if(state.thread_index() == 0)
+    mpmcq_destroy(q);
+}
+
+BENCHMARK_RUN(MPMCQPushPop, 0, 1);
+BENCHMARK_RUN(MPMCQPushPop, 0, 2);
+BENCHMARK_RUN(MPMCQPushPop, 0, 4);
+
+/// The push for a queue that only one thread ever pushes to.
+BENCHMARK(MPMCQPushSingle)
+{
+  mpmcq_t q;
+  mpmcq_init(&q);
+  state.start();
+
+  for(size_t i = 0; i < state.iterations(); i++)
+  {
+    mpmcq_push_single(&q, &q);
+    bench_keep(mpmcq_pop(&q));
+  }
+
+  state.stop();
+  mpmcq_destroy(&q);
+}
+
+BENCHMARK_RUN(MPMCQPushSingle, 0, 1);
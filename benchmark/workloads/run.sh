@@ -0,0 +1,117 @@
+#!/bin/sh
+# Builds and runs the workload benchmarks, and the examples that double as
+# benchmarks, with a fixed set of --ponythreads counts. Writes one line of
+# JSON per workload and thread count. With a baseline from an earlier run, a
+# workload whose throughput fell by more than the threshold is a regression,
+# and the script exits non-zero.
+
+set -e
+
+PONYC=build/release/ponyc
+OUT=build/release/workloads.json
+BASELINE=
+THRESHOLD=10
+THREADS="1 2 4"
+
+usage() {
+  echo "usage: $0 [options]"
+  echo "  --ponyc=PATH        The compiler to build with. Defaults to $PONYC."
+  echo "  --out=FILE          Where to write the results. Defaults to $OUT."
+  echo "  --baseline=FILE     Results of an earlier run to compare with."
+  echo "  --threshold=PCT     The throughput drop that is a regression."
+  echo "                      Defaults to $THRESHOLD."
+  echo "  --threads=\"N ...\"   The --ponythreads counts. Defaults to \"$THREADS\"."
+  exit 1
+}
+
+for arg in "$@"; do
+  case $arg in
+    --ponyc=*) PONYC=${arg#*=} ;;
+    --out=*) OUT=${arg#*=} ;;
+    --baseline=*) BASELINE=${arg#*=} ;;
+    --threshold=*) THRESHOLD=${arg#*=} ;;
+    --threads=*) THREADS=${arg#*=} ;;
+    *) usage ;;
+  esac
+done
+
+DIR=$(dirname "$0")
+BIN=$(dirname "$OUT")/workloads
+mkdir -p "$BIN"
+: > "$OUT"
+
+# Workloads that report for themselves, and the examples with the arguments
+# they are timed with.
+WORKLOADS="pingpong fanout httpserver gcheavy cycles"
+EXAMPLES="
+ring:--size 1000 --count 100 --pass 10000
+mailbox:100 100000
+spreader:20
+gups_basic:
+gups_opt:
+mandelbrot:--width 4000
+n-body:5000000
+"
+
+now() {
+  date +%s%N
+}
+
+for w in $WORKLOADS; do
+  "$PONYC" --path "$DIR" -o "$BIN" "$DIR/$w" > /dev/null
+done
+
+echo "$EXAMPLES" | while IFS=: read -r e args; do
+  [ -z "$e" ] && continue
+  "$PONYC" -o "$BIN" "$DIR/../../examples/$e" > /dev/null
+done
+
+for t in $THREADS; do
+  for w in $WORKLOADS; do
+    line=$("$BIN/$w" --ponythreads "$t" | tail -n 1)
+    echo "{\"workload\":\"$w\",\"threads\":$t,${line#\{}" >> "$OUT"
+  done
+
+  # The examples only print ad hoc output, so they are timed from outside.
+  echo "$EXAMPLES" | while IFS=: read -r e args; do
+    [ -z "$e" ] && continue
+    start=$(now)
+    # shellcheck disable=SC2086
+    "$BIN/$e" $args --ponythreads "$t" > /dev/null
+    nanos=$(($(now) - start))
+    awk -v e="$e" -v t="$t" -v n="$nanos" 'BEGIN {
+      printf "{\"workload\":\"%s\",\"threads\":%d,\"ops\":1,", e, t
+      printf "\"seconds\":%f,\"ops_per_second\":%f}\n", n / 1e9, 1e9 / n
+    }' >> "$OUT"
+  done
+done
+
+cat "$OUT"
+
+[ -z "$BASELINE" ] && exit 0
+
+# Compare ops_per_second for each workload and thread count in both files.
+awk -v threshold="$THRESHOLD" '
+  function field(line, name,    s) {
+    s = line
+    sub(".*\"" name "\":\"?", "", s)
+    sub("[\",}].*", "", s)
+    return s
+  }
+  {
+    key = field($0, "workload") "/threads:" field($0, "threads")
+    rate = field($0, "ops_per_second") + 0
+  }
+  FNR == NR { base[key] = rate; next }
+  (key in base) && (base[key] > 0) {
+    change = (rate - base[key]) * 100 / base[key]
+    printf "%-30s %+7.1f%%\n", key, change
+    if(change < -threshold) regressions++
+  }
+  END {
+    if(regressions > 0) {
+      printf "%d regression(s) of more than %s%%\n", regressions, threshold
+      exit 1
+    }
+  }
+' "$BASELINE" "$OUT"
@@ -221,6 +221,22 @@
     configuration "*"
       link_libponyc()
 
+  project "ponytrace"
+    kind "ConsoleApp"
+    language "C++"
+    includedirs {
+      "src/common/",
+      "src/libponyrt/"
+    }
+    files {
+      "src/ponytrace/**.c"
+    }
+    configuration "gmake"
+      buildoptions "-std=gnu11"
+    configuration "vs*"
+      cppforce { "src/ponytrace/**.c" }
+    configuration "*"
+
 if ( _OPTIONS["with-tests"] or _OPTIONS["run-tests"] ) then
   project "gtest"
     targetname "gtest"
@@ -270,6 +286,25 @@ if ( _OPTIONS["with-tests"] or _OPTIONS["run-tests"] ) then
     files { "test/libponyrt/**.cc" }
 end
 
+if _OPTIONS["with-benchmarks"] then
+  project "benchrt"
+    targetname "benchrt"
+    kind "ConsoleApp"
+    language "C++"
+    links "libponyrt"
+    configuration "gmake"
+      buildoptions { "-std=gnu++11" }
+    configuration "*"
+    includedirs {
+      "src/common",
+      "src/libponyrt"
+    }
+    files {
+      "benchmark/libponyrt/**.h",
+      "benchmark/libponyrt/**.cc"
+    }
+end
+
   if _ACTION == "clean" then
     os.rmdir("build")
   end
@@ -290,3 +325,8 @@ end
     trigger = "run-tests",
     description = "Run the test suite on every successful build."
   }
+
+  newoption {
+    trigger = "with-benchmarks",
+    description = "Compile the runtime benchmark suite."
+  }
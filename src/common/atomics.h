@@ -56,6 +56,9 @@
 #define _atomic_add(PTR, VAL) \
   (__c11_atomic_fetch_add(PTR, VAL, __ATOMIC_RELEASE))
 
+#define _atomic_fence() \
+  __c11_atomic_thread_fence(__ATOMIC_SEQ_CST)
+
 #endif
 
 #ifdef __GNUC_ATOMICS
@@ -80,6 +83,9 @@
 #define _atomic_add(PTR, VAL) \
   (__atomic_fetch_add(PTR, VAL, __ATOMIC_RELEASE))
 
+#define _atomic_fence() \
+  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
 #endif
 
 #ifdef __SYNC_ATOMICS
@@ -104,6 +110,9 @@
 #define _atomic_add(PTR, VAL) \
   (__sync_fetch_and_add(PTR, VAL))
 
+#define _atomic_fence() \
+  __sync_synchronize()
+
 #endif
 
 #ifdef __MSVC_ATOMICS
@@ -134,6 +143,9 @@
 #define _atomic_add(PTR, VAL) \
   (InterlockedAdd64((LONGLONG volatile*)PTR, VAL) - VAL)
 
+#define _atomic_fence() \
+  MemoryBarrier()
+
 #endif
 
 #endif
@@ -0,0 +1,32 @@
+#ifndef PLATFORM_DTRACE_H
+#define PLATFORM_DTRACE_H
+
+/** Statically defined tracing probes.
+ *
+ * Built with use=dtrace, the runtime has the probes in dtrace_probes.d, for
+ * DTrace, SystemTap, perf and bpftrace to attach to. Each unattached probe is
+ * a single NOP. Otherwise, they compile to nothing.
+ */
+#ifdef USE_DYNAMIC_TRACE
+
+#include "dtrace_probes.h"
+
+#define DTRACE_ENABLED(name) PONY_##name##_ENABLED()
+#define DTRACE0(name) PONY_##name()
+#define DTRACE1(name, a0) PONY_##name(a0)
+#define DTRACE2(name, a0, a1) PONY_##name(a0, a1)
+#define DTRACE3(name, a0, a1, a2) PONY_##name(a0, a1, a2)
+#define DTRACE4(name, a0, a1, a2, a3) PONY_##name(a0, a1, a2, a3)
+
+#else
+
+#define DTRACE_ENABLED(name) 0
+#define DTRACE0(name)
+#define DTRACE1(name, a0)
+#define DTRACE2(name, a0, a1)
+#define DTRACE3(name, a0, a1, a2)
+#define DTRACE4(name, a0, a1, a2, a3)
+
+#endif
+
+#endif
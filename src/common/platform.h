@@ -190,6 +190,7 @@
 // remains clear and no wrapper needs to be used.
 #  define __attribute__(X)
 #  define __zu "%Iu"
+#  define __zx "%Ix"
 #  define strdup _strdup
 
 #  if _MSC_VER < 1900
@@ -207,6 +208,7 @@ inline int snprintf(char* str, size_t size, const char* format, ...)
 #  endif
 #else
 #  define __zu "%zu"
+#  define __zx "%zx"
 #endif
 
 /** Standard builtins.
@@ -255,6 +257,17 @@ inline uint64_t __pony_ffsl(uint64_t x)
             FUNC __attribute__((malloc))
 #endif
 
+/** Hint that memory is about to be read.
+ *
+ */
+#ifdef PLATFORM_IS_VISUAL_STUDIO
+#  define __pony_prefetch(ADDR) \
+            _mm_prefetch((const char*)(ADDR), _MM_HINT_T0)
+#elif defined(PLATFORM_IS_CLANG_OR_GCC)
+#  define __pony_prefetch(ADDR) \
+            __builtin_prefetch(ADDR)
+#endif
+
 /** Compile time choose expression.
  *
  *  (void)0 will cause a compile-time error in non-cpp environments, as
@@ -270,6 +283,15 @@ inline uint64_t __pony_ffsl(uint64_t x)
             __builtin_choose_expr(COND, THEN, ELSE)
 #endif
 
+/** Compile time assertion.
+ *
+ */
+#if defined(PLATFORM_IS_VISUAL_STUDIO) || defined(__cplusplus)
+#  define pony_static_assert(COND, MSG) static_assert(COND, MSG)
+#else
+#  define pony_static_assert(COND, MSG) _Static_assert(COND, MSG)
+#endif
+
 #if defined(PLATFORM_IS_ILP32)
 typedef int64_t dw_t;
 #elif defined(PLATFORM_IS_VISUAL_STUDIO)
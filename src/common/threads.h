@@ -13,6 +13,12 @@
 typedef void* (*thread_fn) (void* arg);
 
 #  define DECLARE_THREAD_FN(NAME) void* NAME (void* arg)
+
+typedef struct pony_park_t
+{
+  pthread_mutex_t mut;
+  pthread_cond_t cond;
+} pony_park_t;
 #elif defined(PLATFORM_IS_WINDOWS)
 #  include <process.h>
 #  define pony_thread_id_t HANDLE
@@ -20,6 +26,12 @@ typedef void* (*thread_fn) (void* arg);
 typedef uint32_t(__stdcall *thread_fn) (void* arg);
 
 #  define DECLARE_THREAD_FN(NAME) uint32_t __stdcall NAME (void* arg)
+
+typedef struct pony_park_t
+{
+  CRITICAL_SECTION mut;
+  CONDITION_VARIABLE cond;
+} pony_park_t;
 #endif
 
 #if defined(PLATFORM_IS_VISUAL_STUDIO)
@@ -47,4 +59,29 @@ void pony_thread_detach(pony_thread_id_t thread);
 
 pony_thread_id_t pony_thread_self();
 
+/** Parking lots.
+ *
+ * A parked thread waits on the lot until another thread signals it. Waits may
+ * return spuriously, so the caller checks its own wake condition while holding
+ * the lock.
+ */
+void pony_park_init(pony_park_t* park);
+
+void pony_park_destroy(pony_park_t* park);
+
+void pony_park_lock(pony_park_t* park);
+
+void pony_park_unlock(pony_park_t* park);
+
+void pony_park_wait(pony_park_t* park);
+
+/** Waits for a signal, or for about nsec nanoseconds, whichever comes first.
+ *
+ * The wait is measured against the wall clock where the platform only offers
+ * that, so callers that must not oversleep should keep nsec short.
+ */
+void pony_park_wait_timed(pony_park_t* park, uint64_t nsec);
+
+void pony_park_signal(pony_park_t* park);
+
 #endif
@@ -40,7 +40,8 @@ enum
   AST_ORPHAN = 0x10,
   AST_INHERIT_FLAGS = (AST_FLAG_CAN_ERROR | AST_FLAG_CAN_SEND |
     AST_FLAG_MIGHT_SEND | AST_FLAG_RECURSE_1 | AST_FLAG_RECURSE_2),
-  AST_ALL_FLAGS = 0x7FFFF
+  AST_ALL_FLAGS = 0x7FFFF,
+  AST_POOLED = 0x80000
 };
 
 
@@ -56,6 +57,104 @@ struct ast_t
   uint32_t flags;
 };
 
+// AST nodes are carved out of large blocks in the order they are made, so a
+// pass over a tree mostly walks forward through memory. A freed node goes on
+// a free list to be reused, and the blocks are all given back at once when
+// the last live node is freed, such as when a program is freed.
+#define AST_BLOCK_SIZE (64 * 1024)
+
+typedef struct ast_block_t
+{
+  struct ast_block_t* next;
+} ast_block_t;
+
+static __pony_thread_local ast_block_t* ast_blocks;
+static __pony_thread_local char* ast_next;
+static __pony_thread_local char* ast_end;
+static __pony_thread_local ast_t* ast_reuse;
+static __pony_thread_local size_t ast_live;
+static __pony_thread_local bool ast_pooled;
+
+static ast_t* ast_alloc()
+{
+  ast_t* ast;
+
+  // A node made on a thread that hands its trees to another thread is freed
+  // on that other thread, so it comes from the pool.
+  if(ast_pooled)
+  {
+    ast = POOL_ALLOC(ast_t);
+    memset(ast, 0, sizeof(ast_t));
+    ast->flags = AST_POOLED;
+    return ast;
+  }
+
+  ast_live++;
+
+  if(ast_reuse != NULL)
+  {
+    ast = ast_reuse;
+    ast_reuse = ast->sibling;
+    memset(ast, 0, sizeof(ast_t));
+    return ast;
+  }
+
+  if((size_t)(ast_end - ast_next) < sizeof(ast_t))
+  {
+    ast_block_t* block = (ast_block_t*)pool_alloc_size(AST_BLOCK_SIZE);
+    block->next = ast_blocks;
+    ast_blocks = block;
+
+    // The header takes the first node's space, which keeps nodes aligned.
+    ast_next = (char*)block + sizeof(ast_t);
+    ast_end = (char*)block + AST_BLOCK_SIZE;
+  }
+
+  ast = (ast_t*)ast_next;
+  ast_next += sizeof(ast_t);
+  memset(ast, 0, sizeof(ast_t));
+  return ast;
+}
+
+static void ast_dealloc(ast_t* ast)
+{
+  if((ast->flags & AST_POOLED) != 0)
+  {
+    POOL_FREE(ast_t, ast);
+    return;
+  }
+
+  assert(ast_live > 0);
+
+  if(--ast_live > 0)
+  {
+    ast->sibling = ast_reuse;
+    ast_reuse = ast;
+    return;
+  }
+
+  while(ast_blocks != NULL)
+  {
+    ast_block_t* next = ast_blocks->next;
+    pool_free_size(AST_BLOCK_SIZE, ast_blocks);
+    ast_blocks = next;
+  }
+
+  ast_next = NULL;
+  ast_end = NULL;
+  ast_reuse = NULL;
+}
+
+void ast_use_pool(bool use_pool)
+{
+  ast_pooled = use_pool;
+}
+
+size_t ast_count()
+{
+  return ast_live;
+}
+
 static const char in[] = "  ";
 static const size_t in_len = 2;
 static size_t width = 80;
@@ -282,7 +381,7 @@ static ast_t* duplicate(ast_t* parent, ast_t* ast)
 
   ast_t* n = ast_token(token_dup(ast->t));
   n->data = ast->data;
-  n->flags = ast->flags & AST_ALL_FLAGS;
+  n->flags = (n->flags & AST_POOLED) | (ast->flags & AST_ALL_FLAGS);
   // We don't actually want to copy the orphan flag, but the following if
   // always explicitly sets or clears it.
 
@@ -315,8 +414,7 @@ ast_t* ast_blank(token_id id)
 
 ast_t* ast_token(token_t* t)
 {
-  ast_t* ast = POOL_ALLOC(ast_t);
-  memset(ast, 0, sizeof(ast_t));
+  ast_t* ast = ast_alloc();
   ast->t = t;
 
   switch(token_get_id(t))
@@ -1191,7 +1289,7 @@ void ast_free(ast_t* ast)
 
   token_free(ast->t);
   symtab_free(ast->symtab);
-  POOL_FREE(ast_t, ast);
+  ast_dealloc(ast);
 }
 
 void ast_free_unattached(ast_t* ast)
@@ -47,6 +47,8 @@ enum
 
 ast_t* ast_new(token_t* t, token_id id);
 ast_t* ast_blank(token_id id);
+void ast_use_pool(bool use_pool);
+size_t ast_count();
 ast_t* ast_token(token_t* t);
 ast_t* ast_from(ast_t* ast, token_id id);
 ast_t* ast_from_string(ast_t* ast, const char* name);
@@ -12,6 +12,8 @@ static errormsg_t* head = NULL;
 static errormsg_t* tail = NULL;
 static size_t count = 0;
 static bool immediate_report = false;
+static bool shared = false;
+static pony_park_t lock;
 
 
 static void print_errormsg(errormsg_t* e, const char* indent)
@@ -64,6 +66,9 @@ static void print_error(errormsg_t* e)
 
 static void add_error(errormsg_t* e)
 {
+  if(shared)
+    pony_park_lock(&lock);
+
   if(immediate_report)
     print_error(e);
 
@@ -78,6 +83,9 @@ static void add_error(errormsg_t* e)
 
   e->next = NULL;
   count++;
+
+  if(shared)
+    pony_park_unlock(&lock);
 }
 
 static void append_to_frame(errorframe_t* frame, errormsg_t* e)
@@ -179,7 +187,7 @@ static errormsg_t* make_errorv(source_t* source, size_t line, size_t pos,
 
     size_t start = tpos;
 
-    while((source->m[tpos] != '\n') && (tpos < source->len))
+    while((tpos < source->len) && (source->m[tpos] != '\n'))
       tpos++;
 
     size_t len = tpos - start;
@@ -303,6 +311,19 @@ void errorframe_discard(errorframe_t* frame)
   *frame = NULL;
 }
 
+void error_share(bool share)
+{
+  if(share == shared)
+    return;
+
+  if(share)
+    pony_park_init(&lock);
+  else
+    pony_park_destroy(&lock);
+
+  shared = share;
+}
+
 void error_set_immediate(bool immediate)
 {
   immediate_report = immediate;
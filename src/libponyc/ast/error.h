@@ -88,6 +88,10 @@ void errorframe_report(errorframe_t* frame);
 /// The frame is left empty.
 void errorframe_discard(errorframe_t* frame);
 
+/// Lock the error list on every error while other threads may be reporting
+/// errors. Only switch this on or off while no other thread is reporting.
+void error_share(bool share);
+
 /// Configure whether errors should be printed immediately as well as deferred
 void error_set_immediate(bool immediate);
 
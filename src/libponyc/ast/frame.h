@@ -39,6 +39,14 @@ typedef struct typecheck_stats_t
   size_t default_caps_count;
   size_t heap_alloc;
   size_t stack_alloc;
+  size_t region_alloc;
+  size_t local_error;
+  size_t subtype_hits;
+  size_t subtype_misses;
+  size_t subtype_checks;
+  size_t ast_peak;
+  size_t reach_types;
+  size_t reach_methods;
 } typecheck_stats_t;
 
 typedef struct typecheck_t
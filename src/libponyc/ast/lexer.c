@@ -5,7 +5,6 @@
 #include "../../libponyrt/mem/pool.h"
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <math.h>
 #include <assert.h>
 
@@ -193,6 +192,64 @@ static const lextoken_t keywords[] =
   { NULL, (token_id)0 }
 };
 
+// A perfect hash of the keywords above, from the top 8 bits of a seeded
+// 32 bit FNV-1a hash of the keyword text to 1 + the keyword's index. The
+// table must be regenerated, by searching for a seed that gives no
+// collisions, whenever a keyword is added, removed or moved. Debug builds
+// check every identifier against the list to catch a stale table.
+#define KEYWORD_HASH_SEED 109658
+
+static const uint8_t keyword_slots[256] =
+{
+   0,  0,  0,  4,  0, 51,  0,  1, 27, 32,  0,  0, 52,  0,  0,  0,
+   0,  0,  0, 34,  0,  0, 40,  0,  8,  0,  0,  0, 36,  0, 25,  0,
+  71,  0, 16, 18,  0,  0, 70,  0,  0,  0,  3,  0, 65,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0, 75, 57,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0, 10,  0,  0,  0,  0, 73,  0,  0,  0,  0,  0, 39,
+   0,  0,  0,  0, 33,  0, 19,  0, 53, 20,  0,  0,  0,  0, 67,  0,
+   0, 47, 54,  0,  0,  0,  0,  0,  0,  0, 64,  0, 46,  0,  0, 30,
+   0,  0,  0,  0,  0,  0,  0,  0,  9,  0,  0,  0,  0, 50, 12,  0,
+  62, 61,  0, 72,  0,  0,  0,  0,  2,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0, 74, 42,  0,  0, 14,  0, 22,  0, 45, 35,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0, 15,  0,  0,  0, 41,  0,  0, 56,
+  38, 55, 24,  0, 44, 69,  0,  0,  0,  0,  0, 29,  0, 49, 48, 37,
+   0, 76, 59,  0, 11,  0, 66,  0, 21,  5,  0, 28,  0, 63,  0,  0,
+   0, 13,  0,  0, 23,  0,  0, 43,  0,  0,  0,  0,  0,  0,  0,  7,
+   0,  0, 58,  0, 68,  0,  0,  0,  6,  0,  0,  0,  0,  0,  0, 31,
+   0,  0,  0,  0, 60,  0,  0, 17,  0,  0,  0,  0,  0, 26,  0,  0
+};
+
+// Character classes for the scanner, indexed by the character as unsigned.
+enum
+{
+  C_SPACE = 1,  // Whitespace other than newline
+  C_DIGIT = 2,  // Decimal digit, starts a number
+  C_ALPHA = 4,  // Letter or underscore, starts an identifier
+  C_ID = 8      // Letter, digit, underscore or prime, continues an identifier
+};
+
+#define S C_SPACE
+#define D (C_DIGIT | C_ID)
+#define A (C_ALPHA | C_ID)
+#define P C_ID
+
+static const uint8_t char_class[256] =
+{
+  0, 0, 0, 0, 0, 0, 0, 0, 0, S, 0, 0, 0, S, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  S, 0, 0, 0, 0, 0, 0, P, 0, 0, 0, 0, 0, 0, 0, 0,
+  D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0,
+  0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+  A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, A,
+  0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+  A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0
+};
+
+#undef S
+#undef D
+#undef A
+#undef P
+
 static const lextoken_t abstract[] =
 {
   { "x", TK_NONE }, // Needed for AST printing
@@ -314,21 +371,34 @@ static bool is_eof(lexer_t* lexer)
 }
 
 
+// Make sure the current token text has space for the given number of extra
+// characters
+static void reserve_token(lexer_t* lexer, size_t count)
+{
+  if((lexer->buflen + count) <= lexer->alloc)
+    return;
+
+  size_t new_len = (lexer->alloc > 0) ? lexer->alloc : 64;
+
+  while(new_len < (lexer->buflen + count))
+    new_len <<= 1;
+
+  char* new_buf = (char*)pool_alloc_size(new_len);
+  memcpy(new_buf, lexer->buffer, lexer->buflen);
+
+  if(lexer->alloc > 0)
+    pool_free_size(lexer->alloc, lexer->buffer);
+
+  lexer->buffer = new_buf;
+  lexer->alloc = new_len;
+}
+
+
 // Append the given character to the current token text
 static void append_to_token(lexer_t* lexer, char c)
 {
   if(lexer->buflen >= lexer->alloc)
-  {
-    size_t new_len = (lexer->alloc > 0) ? lexer->alloc << 1 : 64;
-    char* new_buf = (char*)pool_alloc_size(new_len);
-    memcpy(new_buf, lexer->buffer, lexer->alloc);
-
-    if(lexer->alloc > 0)
-      pool_free_size(lexer->alloc, lexer->buffer);
-
-    lexer->buffer = new_buf;
-    lexer->alloc = new_len;
-  }
+    reserve_token(lexer, 1);
 
   lexer->buffer[lexer->buflen] = c;
   lexer->buflen++;
@@ -457,9 +527,10 @@ static token_t* line_comment(lexer_t* lexer)
 
   // We don't consume the terminating newline here, but it will be handled next
   // as whitespace
-  while(!is_eof(lexer) && (look(lexer) != '\n'))
-    consume_chars(lexer, 1);
+  const char* start = &lexer->source->m[lexer->ptr];
+  const char* end = (const char*)memchr(start, '\n', lexer->len);
 
+  consume_chars(lexer, (end == NULL) ? lexer->len : (size_t)(end - start));
   return NULL;
 }
 
@@ -1019,29 +1090,45 @@ static token_t* number(lexer_t* lexer)
 // Return value is the length of the read id.
 static size_t read_id(lexer_t* lexer)
 {
+  const char* start = &lexer->source->m[lexer->ptr];
   size_t len = 0;
-  char c;
-
-  while(true)
-  {
-    c = lookn(lexer, len + 1);
 
-    if((c != '_') && (c != '\'') && !isalnum(c))
-      break;
-
-    append_to_token(lexer, c);
+  while((len < lexer->len) && ((char_class[(uint8_t)start[len]] & C_ID) != 0))
     len++;
-  }
 
   // Add a nul terminator to our name so we can use strcmp(), but don't count
   // it in the text length
-  append_to_token(lexer, '\0');
-  lexer->buflen--;
+  reserve_token(lexer, len + 1);
+  memcpy(&lexer->buffer[lexer->buflen], start, len);
+  lexer->buflen += len;
+  lexer->buffer[lexer->buflen] = '\0';
 
   return len;
 }
 
 
+// Find the keyword that matches the current token text, if any.
+static const lextoken_t* find_keyword(lexer_t* lexer)
+{
+  uint32_t hash = KEYWORD_HASH_SEED;
+
+  for(size_t i = 0; i < lexer->buflen; i++)
+    hash = (hash ^ (uint8_t)lexer->buffer[i]) * 16777619;
+
+  uint8_t slot = keyword_slots[hash >> 24];
+
+  if((slot != 0) && !strcmp(lexer->buffer, keywords[slot - 1].text))
+    return &keywords[slot - 1];
+
+#ifndef NDEBUG
+  for(const lextoken_t* p = keywords; p->text != NULL; p++)
+    assert(strcmp(lexer->buffer, p->text) != 0);
+#endif
+
+  return NULL;
+}
+
+
 // Process a keyword or identifier, possibly with a special prefix (eg '#').
 // Any prefix must have been consumed.
 // If no keyword is found the allow_identifiers parameter specifies whether an
@@ -1052,14 +1139,12 @@ static size_t read_id(lexer_t* lexer)
 static token_t* keyword(lexer_t* lexer, bool allow_identifiers)
 {
   size_t len = read_id(lexer);
+  const lextoken_t* p = find_keyword(lexer);
 
-  for(const lextoken_t* p = keywords; p->text != NULL; p++)
+  if(p != NULL)
   {
-    if(!strcmp(lexer->buffer, p->text))
-    {
-      consume_chars(lexer, len);
-      return make_token(lexer, p->id);
-    }
+    consume_chars(lexer, len);
+    return make_token(lexer, p->id);
   }
 
   if(allow_identifiers && len > 0)
@@ -1215,8 +1300,18 @@ token_t* lexer_next(lexer_t* lexer)
       case '\r':
       case '\t':
       case ' ':
-        consume_chars(lexer, 1);
+      {
+        // Skip a run of whitespace at once, since none of it is a newline.
+        size_t len = 1;
+
+        while((len < lexer->len) &&
+          ((char_class[(uint8_t)lexer->source->m[lexer->ptr + len]] &
+            C_SPACE) != 0))
+          len++;
+
+        consume_chars(lexer, len);
         break;
+      }
 
       case '/':
         t = slash(lexer);
@@ -1239,11 +1334,11 @@ token_t* lexer_next(lexer_t* lexer)
         break;
 
       default:
-        if(isdigit(c))
+        if((char_class[(uint8_t)c] & C_DIGIT) != 0)
         {
           t = number(lexer);
         }
-        else if(isalpha(c) || (c == '_'))
+        else if((char_class[(uint8_t)c] & C_ALPHA) != 0)
         {
           t = keyword(lexer, true);
           assert(t != NULL);
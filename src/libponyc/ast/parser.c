@@ -953,7 +953,7 @@ DEF(seq);
   DONE();
 
 // (FUN | BE | NEW) [CAP] ID [typeparams] (LPAREN | LPAREN_NEW) [params]
-// RPAREN [COLON type] [QUESTION] [ARROW rawseq]
+// RPAREN [COLON type] [QUESTION] [ID] [STRING] [IF rawseq] [DBLARROW rawseq]
 DEF(method);
   TOKEN(NULL, TK_FUN, TK_BE, TK_NEW);
   SCOPE();
@@ -965,12 +965,14 @@ DEF(method);
   SKIP(NULL, TK_RPAREN);
   IF(TK_COLON, RULE("return type", type));
   OPT TOKEN(NULL, TK_QUESTION);
+  OPT TOKEN("method annotation", TK_ID);
   OPT TOKEN(NULL, TK_STRING);
   IF(TK_IF, RULE("guard expression", rawseq));
   IF(TK_DBLARROW, RULE("method body", rawseq));
   // Order should be:
   // cap id type_params params return_type error body docstring guard
-  REORDER(0, 1, 2, 3, 4, 5, 8, 6, 7);
+  // annotation
+  REORDER(0, 1, 2, 3, 4, 5, 9, 7, 8, 6);
   DONE();
 
 // (VAR | LET | EMBED) ID [COLON type] [ASSIGN infix]
@@ -1022,6 +1024,7 @@ DEF(use_uri);
   DONE();
 
 // AT (ID | STRING) typeparams (LPAREN | LPAREN_NEW) [params] RPAREN [QUESTION]
+// [ID]
 DEF(use_ffi);
   TOKEN(NULL, TK_AT);
   MAP_ID(TK_AT, TK_FFIDECL);
@@ -1033,6 +1036,7 @@ DEF(use_ffi);
   AST_NODE(TK_NONE);  // Named parameters
   SKIP(NULL, TK_RPAREN);
   OPT TOKEN(NULL, TK_QUESTION);
+  OPT_NO_DFLT TOKEN("ffi annotation", TK_ID);
   DONE();
 
 // ID ASSIGN
@@ -6,8 +6,53 @@
 #include <string.h>
 #include <stdio.h>
 
+#ifdef PLATFORM_IS_POSIX_BASED
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+#ifdef PLATFORM_IS_POSIX_BASED
+// Map the file into memory, so that it is read as the lexer reaches it
+// rather than copied first. Returns NULL if the file can't be mapped, for
+// example because it is empty, and it should be read instead.
+static source_t* source_map(const char* file)
+{
+  int fd = open(file, O_RDONLY);
+
+  if(fd == -1)
+    return NULL;
+
+  struct stat st;
+  void* m = MAP_FAILED;
+
+  if((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0))
+    m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  close(fd);
+
+  if(m == MAP_FAILED)
+    return NULL;
+
+  source_t* source = POOL_ALLOC(source_t);
+  source->file = stringtab(file);
+  source->m = (char*)m;
+  source->len = (size_t)st.st_size;
+  source->mapped = true;
+  return source;
+}
+#endif
+
 source_t* source_open(const char* file)
 {
+#ifdef PLATFORM_IS_POSIX_BASED
+  source_t* mapped = source_map(file);
+
+  if(mapped != NULL)
+    return mapped;
+#endif
+
   FILE* fp = fopen(file, "rb");
 
   if(fp == NULL)
@@ -32,6 +77,7 @@ source_t* source_open(const char* file)
   source->file = stringtab(file);
   source->m = (char*)pool_alloc_size(size);
   source->len = size;
+  source->mapped = false;
 
   ssize_t read = fread(source->m, sizeof(char), size, fp);
 
@@ -55,6 +101,7 @@ source_t* source_open_string(const char* source_code)
   source->file = NULL;
   source->len = strlen(source_code);
   source->m = (char*)pool_alloc_size(source->len);
+  source->mapped = false;
 
   memcpy(source->m, source_code, source->len);
 
@@ -67,8 +114,16 @@ void source_close(source_t* source)
   if(source == NULL)
     return;
 
-  if(source->m != NULL)
+  if(source->mapped)
+  {
+#ifdef PLATFORM_IS_POSIX_BASED
+    munmap(source->m, source->len);
+#endif
+  }
+  else if(source->m != NULL)
+  {
     pool_free_size(source->len, source->m);
+  }
 
   POOL_FREE(source_t, source);
 }
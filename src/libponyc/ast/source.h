@@ -2,6 +2,7 @@
 #define SOURCE_H
 
 #include <stddef.h>
+#include <stdbool.h>
 #include <platform.h>
 
 PONY_EXTERN_C_BEGIN
@@ -11,9 +12,11 @@ typedef struct source_t
   const char* file;  // NULL => from string, not file
   char* m;
   size_t len;
+  bool mapped;       // m is a read only mapping of the file, not a copy
 } source_t;
 
-/** Open the file with the given path.
+/** Open the file with the given path. Where possible the file is mapped into
+ * memory rather than copied, and the source must not be written to.
  * Returns the opened source which must be closed later,
  * NULL on failure.
  */
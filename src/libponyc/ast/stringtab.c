@@ -23,7 +23,7 @@ typedef struct stringtab_entry_t
 
 static size_t stringtab_hash(stringtab_entry_t* a)
 {
-  return (size_t)hash_block(a->str, a->len);
+  return (size_t)hash_block_fast(a->str, a->len);
 }
 
 static bool stringtab_cmp(stringtab_entry_t* a, stringtab_entry_t* b)
@@ -42,6 +42,8 @@ DEFINE_HASHMAP(strtable, stringtab_entry_t, stringtab_hash, stringtab_cmp,
   pool_alloc_size, pool_free_size, stringtab_free);
 
 static strtable_t table;
+static bool shared;
+static pony_park_t lock;
 
 void stringtab_init()
 {
@@ -56,11 +58,8 @@ const char* stringtab(const char* string)
   return stringtab_len(string, strlen(string));
 }
 
-const char* stringtab_len(const char* string, size_t len)
+static const char* intern_len(const char* string, size_t len)
 {
-  if(string == NULL)
-    return NULL;
-
   stringtab_entry_t key = {string, len, 0};
   stringtab_entry_t* n = strtable_get(&table, &key);
 
@@ -80,11 +79,22 @@ const char* stringtab_len(const char* string, size_t len)
   return n->str;
 }
 
-const char* stringtab_consume(const char* string, size_t buf_size)
+const char* stringtab_len(const char* string, size_t len)
 {
   if(string == NULL)
     return NULL;
 
+  if(!shared)
+    return intern_len(string, len);
+
+  pony_park_lock(&lock);
+  const char* r = intern_len(string, len);
+  pony_park_unlock(&lock);
+  return r;
+}
+
+static const char* intern_consume(const char* string, size_t buf_size)
+{
   size_t len = strlen(string);
   stringtab_entry_t key = {string, len, 0};
   stringtab_entry_t* n = strtable_get(&table, &key);
@@ -104,6 +114,33 @@ const char* stringtab_consume(const char* string, size_t buf_size)
   return n->str;
 }
 
+const char* stringtab_consume(const char* string, size_t buf_size)
+{
+  if(string == NULL)
+    return NULL;
+
+  if(!shared)
+    return intern_consume(string, buf_size);
+
+  pony_park_lock(&lock);
+  const char* r = intern_consume(string, buf_size);
+  pony_park_unlock(&lock);
+  return r;
+}
+
+void stringtab_share(bool share)
+{
+  if(share == shared)
+    return;
+
+  if(share)
+    pony_park_init(&lock);
+  else
+    pony_park_destroy(&lock);
+
+  shared = share;
+}
+
 void stringtab_done()
 {
   strtable_destroy(&table);
@@ -17,6 +17,11 @@ const char* stringtab_len(const char* string, size_t len);
 // string and it must not be accessed again after the call returns.
 const char* stringtab_consume(const char* string, size_t buf_size);
 
+// Lock the table on every lookup while other threads may be interning
+// strings. Only switch this on or off while no other thread is using the
+// table.
+void stringtab_share(bool share);
+
 void stringtab_done();
 
 PONY_EXTERN_C_END
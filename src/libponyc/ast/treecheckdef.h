@@ -40,7 +40,8 @@ RULE(ffidecl,
   CHILD(type_args)  // Return type
   CHILD(params, none)
   CHILD(none) // Named params
-  CHILD(question, none),
+  CHILD(question, none)
+  OPTIONAL(id), // Annotation
   TK_FFIDECL);
 
 RULE(class_def,
@@ -82,7 +83,8 @@ RULE(method,
   CHILD(question, none)
   CHILD(rawseq, none)  // Body
   CHILD(string, none)
-  CHILD(rawseq, none), // Guard (case methods only)
+  CHILD(rawseq, none) // Guard (case methods only)
+  OPTIONAL(id, none), // Annotation
   TK_FUN, TK_NEW, TK_BE);
 
 RULE(type_params, ONE_OR_MORE(type_param), TK_TYPEPARAMS);
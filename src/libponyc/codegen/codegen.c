@@ -37,6 +37,30 @@ static void compile_local_free(compile_local_t* p)
 DEFINE_HASHMAP(compile_locals, compile_local_t, compile_local_hash,
   compile_local_cmp, pool_alloc_size, pool_free_size, compile_local_free);
 
+struct compile_string_t
+{
+  const char* name;
+  LLVMValueRef value;
+};
+
+static size_t compile_string_hash(compile_string_t* p)
+{
+  return hash_ptr(p->name);
+}
+
+static bool compile_string_cmp(compile_string_t* a, compile_string_t* b)
+{
+  return a->name == b->name;
+}
+
+static void compile_string_free(compile_string_t* p)
+{
+  POOL_FREE(compile_string_t, p);
+}
+
+DEFINE_HASHMAP(compile_strings, compile_string_t, compile_string_hash,
+  compile_string_cmp, pool_alloc_size, pool_free_size, compile_string_free);
+
 static void fatal_error(const char* reason)
 {
   printf("%s\n", reason);
@@ -127,6 +151,7 @@ static void init_runtime(compile_t* c)
   c->str_Maybe = stringtab("Maybe");
   c->str_Array = stringtab("Array");
   c->str_Platform = stringtab("Platform");
+  c->str_String = stringtab("String");
 
   c->str_add = stringtab("add");
   c->str_sub = stringtab("sub");
@@ -146,6 +171,7 @@ static void init_runtime(compile_t* c)
   c->str_le = stringtab("le");
   c->str_ge = stringtab("ge");
   c->str_gt = stringtab("gt");
+  c->str_size = stringtab("size");
 
   LLVMTypeRef type;
   LLVMTypeRef params[4];
@@ -186,6 +212,14 @@ static void init_runtime(compile_t* c)
   c->trace_type = LLVMFunctionType(c->void_type, params, 2, false);
   c->trace_fn = LLVMPointerType(c->trace_type, 0);
 
+  // serialise
+  // void (*)(i8*, $object*, intptr)
+  params[0] = c->void_ptr;
+  params[1] = c->object_ptr;
+  params[2] = c->intptr;
+  c->serialise_type = LLVMFunctionType(c->void_type, params, 3, false);
+  c->serialise_fn = LLVMPointerType(c->serialise_type, 0);
+
   // dispatch
   // void (*)(i8*, $object*, $message*)
   params[0] = c->void_ptr;
@@ -270,6 +304,14 @@ static void init_runtime(compile_t* c)
   LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
   LLVMSetReturnNoAlias(value);
 
+  // i8* pony_alloc_region(i8*, intptr)
+  params[0] = c->void_ptr;
+  params[1] = c->intptr;
+  type = LLVMFunctionType(c->void_ptr, params, 2, false);
+  value = LLVMAddFunction(c->module, "pony_alloc_region", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+  LLVMSetReturnNoAlias(value);
+
   // i8* pony_realloc(i8*, i8*, intptr)
   params[0] = c->void_ptr;
   params[1] = c->void_ptr;
@@ -288,6 +330,15 @@ static void init_runtime(compile_t* c)
   LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
   LLVMSetReturnNoAlias(value);
 
+  // i8* pony_alloc_final_deferred(i8*, intptr, c->final_fn)
+  params[0] = c->void_ptr;
+  params[1] = c->intptr;
+  params[2] = c->final_fn;
+  type = LLVMFunctionType(c->void_ptr, params, 3, false);
+  value = LLVMAddFunction(c->module, "pony_alloc_final_deferred", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+  LLVMSetReturnNoAlias(value);
+
   // $message* pony_alloc_msg(i32, i32)
   params[0] = c->i32;
   params[1] = c->i32;
@@ -318,6 +369,17 @@ static void init_runtime(compile_t* c)
   value = LLVMAddFunction(c->module, "pony_traceobject", type);
   LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
 
+  // i8* pony_traceimmutable(i8*, $object*, trace_fn)
+  value = LLVMAddFunction(c->module, "pony_traceimmutable", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // void pony_trace_leaf_array(i8*, $object*)
+  params[0] = c->void_ptr;
+  params[1] = c->object_ptr;
+  type = LLVMFunctionType(c->void_type, params, 2, false);
+  value = LLVMAddFunction(c->module, "pony_trace_leaf_array", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
   // i8* pony_traceunknown(i8*, $object*)
   params[0] = c->void_ptr;
   params[1] = c->object_ptr;
@@ -325,6 +387,10 @@ static void init_runtime(compile_t* c)
   value = LLVMAddFunction(c->module, "pony_traceunknown", type);
   LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
 
+  // i8* pony_traceunknownimmutable(i8*, $object*)
+  value = LLVMAddFunction(c->module, "pony_traceunknownimmutable", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
   // void pony_trace_tag_or_actor(i8*, $object*)
   params[0] = c->void_ptr;
   params[1] = c->object_ptr;
@@ -332,6 +398,100 @@ static void init_runtime(compile_t* c)
   value = LLVMAddFunction(c->module, "pony_trace_tag_or_actor", type);
   LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
 
+  // void pony_writebarrier(i8*, $object*, trace_fn)
+  params[0] = c->void_ptr;
+  params[1] = c->object_ptr;
+  params[2] = c->trace_fn;
+  type = LLVMFunctionType(c->void_type, params, 3, false);
+  value = LLVMAddFunction(c->module, "pony_writebarrier", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // void pony_writebarrier_value(i8*, i8*, i8*, trace_fn)
+  params[0] = c->void_ptr;
+  params[1] = c->void_ptr;
+  params[2] = c->void_ptr;
+  params[3] = c->trace_fn;
+  type = LLVMFunctionType(c->void_type, params, 4, false);
+  value = LLVMAddFunction(c->module, "pony_writebarrier_value", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // void pony_writebarrier_unknown(i8*, i8*, i8*)
+  type = LLVMFunctionType(c->void_type, params, 3, false);
+  value = LLVMAddFunction(c->module, "pony_writebarrier_unknown", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // void pony_serialise_types($desc**, $object**, i32)
+  params[0] = LLVMPointerType(c->descriptor_ptr, 0);
+  params[1] = LLVMPointerType(c->object_ptr, 0);
+  params[2] = c->i32;
+  type = LLVMFunctionType(c->void_type, params, 3, false);
+  value = LLVMAddFunction(c->module, "pony_serialise_types", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // intptr pony_serialise_offset(i8*, i8*)
+  params[0] = c->void_ptr;
+  params[1] = c->void_ptr;
+  type = LLVMFunctionType(c->intptr, params, 2, false);
+  value = LLVMAddFunction(c->module, "pony_serialise_offset", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // i8* pony_serialise_addr(i8*, intptr)
+  params[0] = c->void_ptr;
+  params[1] = c->intptr;
+  type = LLVMFunctionType(c->void_ptr, params, 2, false);
+  value = LLVMAddFunction(c->module, "pony_serialise_addr", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // void pony_serialise_embed(i8*, i8*, intptr)
+  params[0] = c->void_ptr;
+  params[1] = c->void_ptr;
+  params[2] = c->intptr;
+  type = LLVMFunctionType(c->void_type, params, 3, false);
+  value = LLVMAddFunction(c->module, "pony_serialise_embed", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // void pony_serialise_string(i8*, i8*, intptr)
+  value = LLVMAddFunction(c->module, "pony_serialise_string", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // intptr pony_serialise_array(i8*, i8*, intptr, intptr)
+  params[3] = c->intptr;
+  type = LLVMFunctionType(c->intptr, params, 4, false);
+  value = LLVMAddFunction(c->module, "pony_serialise_array", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // void pony_serialise_fail(i8*)
+  params[0] = c->void_ptr;
+  type = LLVMFunctionType(c->void_type, params, 1, false);
+  value = LLVMAddFunction(c->module, "pony_serialise_fail", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // i8* pony_deserialise_offset(i8*, intptr)
+  params[0] = c->void_ptr;
+  params[1] = c->intptr;
+  type = LLVMFunctionType(c->void_ptr, params, 2, false);
+  value = LLVMAddFunction(c->module, "pony_deserialise_offset", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // void pony_deserialise_embed(i8*, i8*, $desc*)
+  params[0] = c->void_ptr;
+  params[1] = c->void_ptr;
+  params[2] = c->descriptor_ptr;
+  type = LLVMFunctionType(c->void_type, params, 3, false);
+  value = LLVMAddFunction(c->module, "pony_deserialise_embed", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // i8* pony_deserialise_array(i8*, i8*, intptr)
+  params[2] = c->intptr;
+  type = LLVMFunctionType(c->void_ptr, params, 3, false);
+  value = LLVMAddFunction(c->module, "pony_deserialise_array", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // void pony_deserialise_string(i8*, i8*)
+  type = LLVMFunctionType(c->void_type, params, 2, false);
+  value = LLVMAddFunction(c->module, "pony_deserialise_string", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
   // void pony_gc_send(i8*)
   params[0] = c->void_ptr;
   type = LLVMFunctionType(c->void_type, params, 1, false);
@@ -378,7 +538,18 @@ static void init_runtime(compile_t* c)
 
   // void pony_throw()
   type = LLVMFunctionType(c->void_type, NULL, 0, false);
-  LLVMAddFunction(c->module, "pony_throw", type);
+  value = LLVMAddFunction(c->module, "pony_throw", type);
+  LLVMAddFunctionAttr(value, LLVMNoReturnAttribute);
+
+  // void pony_blocking_enter()
+  type = LLVMFunctionType(c->void_type, NULL, 0, false);
+  value = LLVMAddFunction(c->module, "pony_blocking_enter", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
+
+  // void pony_blocking_exit()
+  type = LLVMFunctionType(c->void_type, NULL, 0, false);
+  value = LLVMAddFunction(c->module, "pony_blocking_exit", type);
+  LLVMAddFunctionAttr(value, LLVMNoUnwindAttribute);
 
   // i32 pony_personality_v0(...)
   type = LLVMFunctionType(c->i32, NULL, 0, true);
@@ -431,20 +602,42 @@ static void init_module(compile_t* c, ast_t* program, pass_opt_t* opt)
   // IR builder.
   c->builder = LLVMCreateBuilderInContext(c->context);
 
+  // No string literals yet.
+  compile_strings_init(&c->strings, 0);
+
   // Empty frame stack.
   c->frame = NULL;
 }
 
-static void codegen_cleanup(compile_t* c)
+void codegen_release(compile_t* c)
 {
+  if(c->context == NULL)
+    return;
+
   while(c->frame != NULL)
     pop_frame(c);
 
+  compile_strings_destroy(&c->strings);
+
   LLVMDisposeBuilder(c->builder);
   LLVMDisposeModule(c->module);
   LLVMContextDispose(c->context);
   LLVMDisposeTargetMachine(c->machine);
   reach_free(c->reachable);
+
+  c->builder = NULL;
+  c->module = NULL;
+  c->context = NULL;
+  c->machine = NULL;
+  c->reachable = NULL;
+}
+
+static void codegen_cleanup(compile_t* c)
+{
+  codegen_release(c);
+
+  if(c->symbols != NULL)
+    printbuf_free(c->symbols);
 }
 
 bool codegen_init(pass_opt_t* opt)
@@ -511,13 +704,28 @@ bool codegen(ast_t* program, pass_opt_t* opt)
   printf("Generating\n");
   pony_mkdir(opt->output);
 
+  int prev = stats_phase(opt, PASS_LLVM_IR);
+
   compile_t c;
   memset(&c, 0, sizeof(compile_t));
 
   init_module(&c, program, opt);
+
+  // The program hasn't been type checked, but its object file is cached.
+  if(opt->cache_hit)
+  {
+    bool ok = genexe_cached(&c, program);
+    codegen_cleanup(&c);
+    stats_phase(opt, prev);
+    return ok;
+  }
+
   init_runtime(&c);
   genprim_builtins(&c);
 
+  if(c.opt->symbol_map)
+    c.symbols = printbuf_new();
+
   // Emit debug info for this compile unit.
   dwarf_init(&c.dwarf, c.opt, c.builder, c.target_data, c.module);
   dwarf_compileunit(&c.dwarf, program);
@@ -530,6 +738,7 @@ bool codegen(ast_t* program, pass_opt_t* opt)
     ok = genexe(&c, program);
 
   codegen_cleanup(&c);
+  stats_phase(opt, prev);
   return ok;
 }
 
@@ -678,6 +887,28 @@ void codegen_setlocal(compile_t* c, const char* name, LLVMValueRef alloca)
   compile_locals_put(&c->frame->locals, p);
 }
 
+LLVMValueRef codegen_getstring(compile_t* c, const char* name)
+{
+  compile_string_t k;
+  k.name = name;
+
+  compile_string_t* p = compile_strings_get(&c->strings, &k);
+
+  if(p != NULL)
+    return p->value;
+
+  return NULL;
+}
+
+void codegen_setstring(compile_t* c, const char* name, LLVMValueRef value)
+{
+  compile_string_t* p = POOL_ALLOC(compile_string_t);
+  p->name = name;
+  p->value = value;
+
+  compile_strings_put(&c->strings, p);
+}
+
 LLVMValueRef codegen_ctx(compile_t* c)
 {
   compile_frame_t* frame = c->frame;
@@ -39,6 +39,9 @@ void LLVMSetDereferenceable(LLVMValueRef fun, uint32_t i, size_t size);
 typedef struct compile_local_t compile_local_t;
 DECLARE_HASHMAP(compile_locals, compile_local_t);
 
+typedef struct compile_string_t compile_string_t;
+DECLARE_HASHMAP(compile_strings, compile_string_t);
+
 typedef struct compile_frame_t
 {
   LLVMValueRef fun;
@@ -62,6 +65,7 @@ typedef struct compile_t
   reachable_types_t* reachable;
   const char* filename;
   uint32_t next_type_id;
+  bool serialise;
 
   const char* str_builtin;
   const char* str_Bool;
@@ -85,6 +89,7 @@ typedef struct compile_t
   const char* str_Maybe;
   const char* str_Array;
   const char* str_Platform;
+  const char* str_String;
 
   const char* str_add;
   const char* str_sub;
@@ -104,6 +109,7 @@ typedef struct compile_t
   const char* str_le;
   const char* str_ge;
   const char* str_gt;
+  const char* str_size;
 
   dwarf_t dwarf;
 
@@ -135,13 +141,17 @@ typedef struct compile_t
   LLVMTypeRef actor_pad;
   LLVMTypeRef trace_type;
   LLVMTypeRef trace_fn;
+  LLVMTypeRef serialise_type;
+  LLVMTypeRef serialise_fn;
   LLVMTypeRef dispatch_type;
   LLVMTypeRef dispatch_fn;
   LLVMTypeRef final_fn;
 
   LLVMValueRef personality;
 
+  compile_strings_t strings;
   compile_frame_t* frame;
+  printbuf_t* symbols;
 } compile_t;
 
 bool codegen_init(pass_opt_t* opt);
@@ -150,6 +160,12 @@ void codegen_shutdown(pass_opt_t* opt);
 
 bool codegen(ast_t* program, pass_opt_t* opt);
 
+/** Free the module, the LLVM context and the reachability information, once
+ * the object file has been written. Linking only needs the options and the
+ * program's libraries.
+ */
+void codegen_release(compile_t* c);
+
 LLVMValueRef codegen_addfun(compile_t* c, const char* name, LLVMTypeRef type);
 
 void codegen_startfun(compile_t* c, LLVMValueRef fun, bool has_source);
@@ -173,6 +189,10 @@ LLVMValueRef codegen_getlocal(compile_t* c, const char* name);
 
 void codegen_setlocal(compile_t* c, const char* name, LLVMValueRef alloca);
 
+LLVMValueRef codegen_getstring(compile_t* c, const char* name);
+
+void codegen_setstring(compile_t* c, const char* name, LLVMValueRef value);
+
 LLVMValueRef codegen_ctx(compile_t* c);
 
 void codegen_setctx(compile_t* c, LLVMValueRef ctx);
@@ -1,5 +1,117 @@
 #include "genbox.h"
 #include "gencall.h"
+#include "genname.h"
+#include "../../libponyrt/mem/pool.h"
+
+// Integers below this are boxed from a table of constant boxes. Bool and 8 bit
+// integers have a box for every value.
+#define BOX_CACHE 256
+
+static LLVMValueRef const_box(gentype_t* g, LLVMValueRef value)
+{
+  unsigned count = LLVMCountStructElementTypes(g->structure);
+  size_t buf_size = count * sizeof(void*);
+  LLVMTypeRef* elems = (LLVMTypeRef*)pool_alloc_size(buf_size);
+  LLVMValueRef* fields = (LLVMValueRef*)pool_alloc_size(buf_size);
+  LLVMGetStructElementTypes(g->structure, elems);
+
+  fields[0] = g->desc;
+  fields[1] = value;
+
+  for(unsigned i = 2; i < count; i++)
+    fields[i] = LLVMConstNull(elems[i]);
+
+  LLVMValueRef box = LLVMConstNamedStruct(g->structure, fields, count);
+  pool_free_size(buf_size, elems);
+  pool_free_size(buf_size, fields);
+  return box;
+}
+
+static LLVMValueRef const_global(compile_t* c, LLVMTypeRef type,
+  LLVMValueRef value, const char* name)
+{
+  LLVMValueRef global = LLVMAddGlobal(c->module, type, name);
+  LLVMSetInitializer(global, value);
+  LLVMSetGlobalConstant(global, true);
+  LLVMSetLinkage(global, LLVMInternalLinkage);
+  return global;
+}
+
+/**
+ * The table of constant boxes for the first count values of an integer type,
+ * made once per module the first time one of them is boxed.
+ */
+static LLVMValueRef box_table(compile_t* c, gentype_t* g, unsigned count)
+{
+  const char* name = genname_boxes(g->type_name);
+  LLVMValueRef table = LLVMGetNamedGlobal(c->module, name);
+
+  if(table != NULL)
+    return table;
+
+  LLVMValueRef boxes[BOX_CACHE];
+
+  for(unsigned i = 0; i < count; i++)
+    boxes[i] = const_box(g, LLVMConstInt(g->primitive, i, false));
+
+  LLVMValueRef value = LLVMConstArray(g->structure, boxes, count);
+  return const_global(c, LLVMTypeOf(value), value, name);
+}
+
+/**
+ * Looks up the constant box for a value that is known to be in the table.
+ * GEP indices are signed, so a value of fewer than 32 bits is zero extended.
+ */
+static LLVMValueRef box_lookup(compile_t* c, LLVMValueRef table,
+  LLVMValueRef value)
+{
+  if(LLVMGetIntTypeWidth(LLVMTypeOf(value)) < 32)
+    value = LLVMBuildZExt(c->builder, value, c->i32, "");
+
+  LLVMValueRef index[2];
+  index[0] = LLVMConstInt(c->i32, 0, false);
+  index[1] = value;
+  return LLVMBuildInBoundsGEP(c->builder, table, index, 2, "");
+}
+
+/**
+ * Boxes an integer that isn't known at compile time, or any Bool. Small values
+ * share constant boxes, and only larger ones are allocated.
+ */
+static LLVMValueRef box_int(compile_t* c, gentype_t* g, LLVMValueRef value)
+{
+  // Every 8 bit value is in the table.
+  unsigned width = LLVMGetIntTypeWidth(g->primitive);
+
+  if(width <= 8)
+    return box_lookup(c, box_table(c, g, 1 << width), value);
+
+  LLVMValueRef table = box_table(c, g, BOX_CACHE);
+
+  LLVMBasicBlockRef small_block = codegen_block(c, "box_small");
+  LLVMBasicBlockRef alloc_block = codegen_block(c, "box_alloc");
+  LLVMBasicBlockRef post_block = codegen_block(c, "box_post");
+
+  LLVMValueRef limit = LLVMConstInt(g->primitive, BOX_CACHE, false);
+  LLVMValueRef test = LLVMBuildICmp(c->builder, LLVMIntULT, value, limit, "");
+  LLVMBuildCondBr(c->builder, test, small_block, alloc_block);
+
+  LLVMPositionBuilderAtEnd(c->builder, small_block);
+  LLVMValueRef small = box_lookup(c, table, value);
+  LLVMBuildBr(c->builder, post_block);
+
+  LLVMPositionBuilderAtEnd(c->builder, alloc_block);
+  LLVMValueRef this_ptr = gencall_allocstruct(c, g);
+  LLVMValueRef value_ptr = LLVMBuildStructGEP(c->builder, this_ptr, 1, "");
+  LLVMBuildStore(c->builder, value, value_ptr);
+  LLVMBuildBr(c->builder, post_block);
+
+  LLVMPositionBuilderAtEnd(c->builder, post_block);
+  LLVMValueRef phi = LLVMBuildPhi(c->builder, g->structure_ptr, "");
+  LLVMAddIncoming(phi, &small, &small_block, 1);
+  LLVMAddIncoming(phi, &this_ptr, &alloc_block, 1);
+  return phi;
+}
 
 LLVMValueRef gen_box(compile_t* c, ast_t* type, LLVMValueRef value)
 {
@@ -16,6 +128,19 @@ LLVMValueRef gen_box(compile_t* c, ast_t* type, LLVMValueRef value)
   if(l_type != g.primitive)
     return NULL;
 
+  // Both Bool values share the boxes in its table, whether or not the value
+  // is known at compile time.
+  if(l_type == c->i1)
+    return box_int(c, &g, value);
+
+  // A value known at compile time gets a constant box that is never
+  // allocated or collected, like a string literal.
+  if(LLVMIsConstant(value))
+    return const_global(c, g.structure, const_box(&g, value), "$box");
+
+  if(LLVMGetTypeKind(l_type) == LLVMIntegerTypeKind)
+    return box_int(c, &g, value);
+
   // Allocate the object.
   LLVMValueRef this_ptr = gencall_allocstruct(c, &g);
 
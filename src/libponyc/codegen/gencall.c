@@ -5,6 +5,7 @@
 #include "gendesc.h"
 #include "genfun.h"
 #include "genname.h"
+#include "genprim.h"
 #include "../pkg/platformfuns.h"
 #include "../type/subtype.h"
 #include "../ast/stringtab.h"
@@ -116,6 +117,29 @@ static LLVMValueRef special_case_platform(compile_t* c, ast_t* ast)
   return NULL;
 }
 
+static bool special_case_conversion(compile_t* c, ast_t* ast,
+  const char* type_name, LLVMValueRef* value)
+{
+  AST_GET_CHILDREN(ast, positional, named, postfix);
+  AST_GET_CHILDREN(postfix, receiver, method);
+
+  // A numeric conversion is a single instruction, so build it here rather
+  // than calling a function. The builder folds it if the receiver is a
+  // constant, even when nothing is optimised.
+  if((ast_id(positional) != TK_NONE) ||
+    !genprim_is_conversion(c, type_name, ast_name(method)))
+    return false;
+
+  LLVMValueRef r_value = gen_expr(c, receiver);
+
+  if(r_value == NULL)
+    *value = NULL;
+  else
+    *value = genprim_convert(c, type_name, ast_name(method), r_value);
+
+  return true;
+}
+
 static bool special_case_call(compile_t* c, ast_t* ast, LLVMValueRef* value)
 {
   AST_GET_CHILDREN(ast, positional, named, postfix);
@@ -155,14 +179,24 @@ static bool special_case_call(compile_t* c, ast_t* ast, LLVMValueRef* value)
     (name == c->str_F64)
     )
   {
-    return special_case_operator(c, ast, value, false, true);
+    return special_case_operator(c, ast, value, false, true) ||
+      special_case_conversion(c, ast, name, value);
   }
 
   if((name == c->str_I128) || (name == c->str_U128))
   {
     bool native128;
     os_is_target(OS_NATIVE128_NAME, c->opt->release, &native128);
-    return special_case_operator(c, ast, value, false, native128);
+    return special_case_operator(c, ast, value, false, native128) ||
+      special_case_conversion(c, ast, name, value);
+  }
+
+  // The size of a string literal is known.
+  if((name == c->str_String) && (ast_id(receiver) == TK_STRING) &&
+    (ast_name(method) == c->str_size) && (ast_id(positional) == TK_NONE))
+  {
+    *value = LLVMConstInt(c->intptr, ast_name_len(receiver), false);
+    return true;
   }
 
   if(name == c->str_Platform)
@@ -174,6 +208,47 @@ static bool special_case_call(compile_t* c, ast_t* ast, LLVMValueRef* value)
   return false;
 }
 
+static LLVMValueRef devirtualise(compile_t* c, gentype_t* g,
+  const char* method_name, ast_t* typeargs)
+{
+  switch(g->underlying)
+  {
+    case TK_TRAIT:
+    case TK_INTERFACE:
+      break;
+
+    default:
+      return NULL;
+  }
+
+  // If only one concrete type in the program provides the trait or interface,
+  // every receiver is of that type, and its vtable would hold this function.
+  reachable_type_t* sub = reach_sole_subtype(c->reachable, g->type_name);
+
+  if(sub == NULL)
+    return NULL;
+
+  ast_t* def = (ast_t*)ast_data(sub->type);
+
+  // Primitives go through an unbox function in the vtable.
+  switch(ast_id(def))
+  {
+    case TK_CLASS:
+    case TK_ACTOR:
+      break;
+
+    default:
+      return NULL;
+  }
+
+  gentype_t sub_g;
+
+  if(!gentype(c, sub->type, &sub_g))
+    return NULL;
+
+  return genfun_proto(c, &sub_g, method_name, typeargs);
+}
+
 static LLVMValueRef dispatch_function(compile_t* c, ast_t* from, gentype_t* g,
   LLVMValueRef l_value, const char* method_name, ast_t* typeargs)
 {
@@ -181,6 +256,23 @@ static LLVMValueRef dispatch_function(compile_t* c, ast_t* from, gentype_t* g,
 
   if(g->use_type == c->object_ptr)
   {
+    // Virtual, unless there is only one possible receiver type.
+    func = devirtualise(c, g, method_name, typeargs);
+
+    if(func != NULL)
+    {
+      LLVMTypeRef f_type = genfun_sig(c, g, method_name, typeargs);
+
+      if(f_type == NULL)
+      {
+        ast_error(from, "couldn't create a signature for '%s'", method_name);
+        return NULL;
+      }
+
+      f_type = LLVMPointerType(f_type, 0);
+      return LLVMBuildBitCast(c->builder, func, f_type, "method");
+    }
+
     // Virtual, get the function by selector colour.
     uint32_t index = genfun_vtable_index(c, g, method_name, typeargs);
     assert(index != (uint32_t)-1);
@@ -544,6 +636,10 @@ LLVMValueRef gen_ffi(compile_t* c, ast_t* ast)
   ast_t* type = ast_type(ast);
   gentype_t g;
 
+  // A call declared as blocking tells the scheduler before and after.
+  ast_t* decl = (ast_t*)ast_data(ast);
+  bool blocking = (decl != NULL) && (ast_childidx(decl, 5) != NULL);
+
   // Emit dwarf location of ffi call
   dwarf_location(&c->dwarf, ast);
 
@@ -556,8 +652,6 @@ LLVMValueRef gen_ffi(compile_t* c, ast_t* ast)
   if(func == NULL)
   {
     // If we have no prototype, declare one.
-    ast_t* decl = (ast_t*)ast_data(ast);
-
     if(decl != NULL)
     {
       // Define using the declared types.
@@ -615,11 +709,22 @@ LLVMValueRef gen_ffi(compile_t* c, ast_t* ast)
   // instead of a call.
   LLVMValueRef result;
 
+  if(blocking)
+  {
+    gencall_runtime(c, "pony_blocking_enter", NULL, 0, "");
+    dwarf_location(&c->dwarf, ast);
+  }
+
   if(err && (c->frame->invoke_target != NULL))
     result = invoke_fun(c, func, f_args, count, "", false);
   else
     result = LLVMBuildCall(c->builder, func, f_args, count, "");
 
+  // If the call raises an error, the scheduler catches up when the behaviour
+  // returns.
+  if(blocking)
+    gencall_runtime(c, "pony_blocking_exit", NULL, 0, "");
+
   pool_free_size(buf_size, f_args);
 
   if(!vararg)
@@ -700,7 +805,7 @@ LLVMValueRef gencall_allocstruct(compile_t* c, gentype_t* g)
 
   if(final_fun == NULL)
   {
-    if(size <= HEAP_MAX)
+    if(size <= HEAP_MEDIUMMAX)
     {
       uint32_t index = heap_index(size);
       args[1] = LLVMConstInt(c->i32, index, false);
@@ -712,7 +817,13 @@ LLVMValueRef gencall_allocstruct(compile_t* c, gentype_t* g)
   } else {
     args[1] = LLVMConstInt(c->intptr, size, false);
     args[2] = LLVMConstBitCast(final_fun, c->final_fn);
-    result = gencall_runtime(c, "pony_alloc_final", args, 3, "");
+
+    // Finalisers that only release handles are queued and run off the
+    // actor's thread, rather than during its gc sweep.
+    if(genfun_final_deferred(g))
+      result = gencall_runtime(c, "pony_alloc_final_deferred", args, 3, "");
+    else
+      result = gencall_runtime(c, "pony_alloc_final", args, 3, "");
   }
 
   result = LLVMBuildBitCast(c->builder, result, g->structure_ptr, "");
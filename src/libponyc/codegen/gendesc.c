@@ -2,9 +2,12 @@
 #include "genname.h"
 #include "gentype.h"
 #include "genfun.h"
+#include "gentrace.h"
+#include "gensymbols.h"
 #include "../type/reify.h"
 #include "../ast/stringtab.h"
 #include "../../libponyrt/mem/pool.h"
+#include "../../libponyrt/pony.h"
 #include <string.h>
 #include <assert.h>
 
@@ -19,11 +22,15 @@
 #define DESC_DISPATCH 8
 #define DESC_FINALISE 9
 #define DESC_EVENT_NOTIFY 10
-#define DESC_TRAITS 11
-#define DESC_FIELDS 12
-#define DESC_VTABLE 13
+#define DESC_FLAGS 11
+#define DESC_TRAITS 12
+#define DESC_FIELDS 13
+#define DESC_NAME 14
+#define DESC_MSG_NAMES 15
+#define DESC_MSG_COUNT 16
+#define DESC_VTABLE 17
 
-#define DESC_LENGTH 14
+#define DESC_LENGTH 18
 
 static LLVMValueRef make_unbox_function(compile_t* c, gentype_t* g,
   const char* name, token_id t)
@@ -103,35 +110,6 @@ static LLVMValueRef make_function_ptr(compile_t* c, const char* name,
   return LLVMConstBitCast(fun, type);
 }
 
-static int cmp_uint32(const void* elem1, const void* elem2)
-{
-  uint32_t a = *((uint32_t*)elem1);
-  uint32_t b = *((uint32_t*)elem2);
-
-  if(a < b)
-    return -1;
-
-  if(a > b)
-    return 1;
-
-  return 0;
-}
-
-static size_t unique_uint32(uint32_t* list, size_t len)
-{
-  uint32_t* first = list;
-  uint32_t* last = list + len;
-  uint32_t* r = list;
-
-  while(++first != last)
-  {
-    if(!(*r == *first))
-      *(++r) = *first;
-  }
-
-  return (++r) - list;
-}
-
 static uint32_t trait_count(compile_t* c, gentype_t* g,
   uint32_t** list, size_t* list_size)
 {
@@ -143,33 +121,38 @@ static uint32_t trait_count(compile_t* c, gentype_t* g,
     {
       reachable_type_t* t = reach_type(c->reachable, g->type_name);
       assert(t != NULL);
-      uint32_t count = (uint32_t)reachable_type_cache_size(&t->subtypes);
-
-      if(count == 0)
-        return 0;
-
-      // Sort the trait identifiers.
-      size_t tid_size = count * sizeof(uint32_t);
-      uint32_t* tid = (uint32_t*)pool_alloc_size(tid_size);
 
+      // The traits are a set of bits, indexed by trait_index. Only the words
+      // up to the highest bit that is set are kept.
       size_t i = HASHMAP_BEGIN;
-      size_t index = 0;
+      uint32_t count = 0;
       reachable_type_t* provide;
 
       while((provide = reachable_type_cache_next(&t->subtypes, &i)) != NULL)
-        tid[index++] = provide->type_id;
+      {
+        uint32_t words = (provide->trait_index / 32) + 1;
+
+        if(words > count)
+          count = words;
+      }
 
-      qsort(tid, index, sizeof(uint32_t), cmp_uint32);
-      count = (uint32_t)unique_uint32(tid, index);
+      if((count == 0) || (list == NULL))
+        return count;
 
-      if(list != NULL)
+      size_t tid_size = count * sizeof(uint32_t);
+      uint32_t* tid = (uint32_t*)pool_alloc_size(tid_size);
+      memset(tid, 0, tid_size);
+
+      i = HASHMAP_BEGIN;
+
+      while((provide = reachable_type_cache_next(&t->subtypes, &i)) != NULL)
       {
-        *list = tid;
-        *list_size = tid_size;
-      } else {
-        pool_free_size(tid_size, tid);
+        uint32_t index = provide->trait_index;
+        tid[index / 32] |= (uint32_t)1 << (index % 32);
       }
 
+      *list = tid;
+      *list_size = tid_size;
       return count;
     }
 
@@ -182,7 +165,7 @@ static uint32_t trait_count(compile_t* c, gentype_t* g,
 static LLVMValueRef make_trait_list(compile_t* c, gentype_t* g,
   uint32_t* final_count)
 {
-  // The list is an array of integers.
+  // The list is an array of words of trait bits.
   uint32_t* tid;
   size_t tid_size;
   uint32_t count = trait_count(c, g, &tid, &tid_size);
@@ -191,7 +174,7 @@ static LLVMValueRef make_trait_list(compile_t* c, gentype_t* g,
   if(count == 0)
     return LLVMConstNull(LLVMPointerType(LLVMArrayType(c->i32, 0), 0));
 
-  // Create a constant array of trait identifiers.
+  // Create a constant array of trait bits.
   size_t list_size = count * sizeof(LLVMValueRef);
   LLVMValueRef* list = (LLVMValueRef*)pool_alloc_size(list_size);
 
@@ -293,6 +276,86 @@ static LLVMValueRef make_field_list(compile_t* c, gentype_t* g)
   return global;
 }
 
+static LLVMValueRef make_string(compile_t* c, const char* str)
+{
+  LLVMValueRef s = LLVMConstStringInContext(c->context, str,
+    (unsigned)strlen(str), false);
+  LLVMValueRef global = LLVMAddGlobal(c->module, LLVMTypeOf(s), "$strval");
+  LLVMSetGlobalConstant(global, true);
+  LLVMSetLinkage(global, LLVMInternalLinkage);
+  LLVMSetInitializer(global, s);
+  return LLVMConstBitCast(global, c->void_ptr);
+}
+
+static LLVMValueRef make_name(compile_t* c, gentype_t* g)
+{
+  // Only actors are named, for the runtime's behaviour profile.
+  if(g->underlying != TK_ACTOR)
+    return LLVMConstNull(c->void_ptr);
+
+  return make_string(c, gensymbols_name(g, NULL, NULL));
+}
+
+static uint32_t msg_count(compile_t* c, gentype_t* g)
+{
+  if(g->underlying != TK_ACTOR)
+    return 0;
+
+  reachable_type_t* t = reach_type(c->reachable, g->type_name);
+  return (t != NULL) ? t->msg_count : 0;
+}
+
+static LLVMValueRef make_msg_names(compile_t* c, gentype_t* g)
+{
+  // The list is an array of behaviour names, indexed by message ID.
+  uint32_t count = msg_count(c, g);
+  LLVMTypeRef names_ptr = LLVMPointerType(c->void_ptr, 0);
+
+  if(count == 0)
+    return LLVMConstNull(names_ptr);
+
+  size_t buf_size = count * sizeof(LLVMValueRef);
+  LLVMValueRef* list = (LLVMValueRef*)pool_alloc_size(buf_size);
+  memset(list, 0, buf_size);
+
+  reachable_type_t* t = reach_type(c->reachable, g->type_name);
+
+  size_t i = HASHMAP_BEGIN;
+  reachable_method_name_t* n;
+
+  while((n = reachable_method_names_next(&t->methods, &i)) != NULL)
+  {
+    size_t j = HASHMAP_BEGIN;
+    reachable_method_t* m;
+
+    while((m = reachable_methods_next(&n->r_methods, &j)) != NULL)
+    {
+      if(m->msg_id == (uint32_t)-1)
+        continue;
+
+      assert(m->msg_id < count);
+      list[m->msg_id] = make_string(c,
+        gensymbols_name(g, n->name, m->typeargs));
+    }
+  }
+
+  for(uint32_t i = 0; i < count; i++)
+  {
+    if(list[i] == NULL)
+      list[i] = LLVMConstNull(c->void_ptr);
+  }
+
+  LLVMValueRef names = LLVMConstArray(c->void_ptr, list, count);
+  LLVMValueRef global = LLVMAddGlobal(c->module, LLVMTypeOf(names),
+    genname_msgnames(g->type_name));
+  LLVMSetGlobalConstant(global, true);
+  LLVMSetLinkage(global, LLVMInternalLinkage);
+  LLVMSetInitializer(global, names);
+
+  pool_free_size(buf_size, list);
+  return LLVMConstBitCast(global, names_ptr);
+}
+
 static LLVMValueRef make_vtable(compile_t* c, gentype_t* g)
 {
   uint32_t vtable_size = genfun_vtable_size(c, g);
@@ -392,14 +455,18 @@ LLVMTypeRef gendesc_type(compile_t* c, gentype_t* g)
   params[DESC_FIELD_COUNT] = c->i32;
   params[DESC_FIELD_OFFSET] = c->i32;
   params[DESC_TRACE] = c->trace_fn;
-  params[DESC_SERIALISE] = c->trace_fn;
+  params[DESC_SERIALISE] = c->serialise_fn;
   params[DESC_DESERIALISE] = c->trace_fn;
   params[DESC_DISPATCH] = c->dispatch_fn;
   params[DESC_FINALISE] = c->final_fn;
   params[DESC_EVENT_NOTIFY] = c->i32;
+  params[DESC_FLAGS] = c->i32;
   params[DESC_TRAITS] = LLVMPointerType(LLVMArrayType(c->i32, traits), 0);
   params[DESC_FIELDS] = LLVMPointerType(
     LLVMArrayType(c->field_descriptor, fields), 0);
+  params[DESC_NAME] = c->void_ptr;
+  params[DESC_MSG_NAMES] = LLVMPointerType(c->void_ptr, 0);
+  params[DESC_MSG_COUNT] = c->i32;
   params[DESC_VTABLE] = LLVMArrayType(c->void_ptr, vtable_size);
 
   LLVMStructSetBody(type, params, DESC_LENGTH, false);
@@ -425,7 +492,7 @@ void gendesc_init(compile_t* c, gentype_t* g)
   args[DESC_TRACE] = make_function_ptr(c, genname_trace(g->type_name),
     c->trace_fn);
   args[DESC_SERIALISE] = make_function_ptr(c, genname_serialise(g->type_name),
-    c->trace_fn);
+    c->serialise_fn);
   args[DESC_DESERIALISE] = make_function_ptr(c,
     genname_deserialise(g->type_name), c->trace_fn);
   args[DESC_DISPATCH] = make_function_ptr(c, genname_dispatch(g->type_name),
@@ -433,9 +500,14 @@ void gendesc_init(compile_t* c, gentype_t* g)
   args[DESC_FINALISE] = make_function_ptr(c, genname_finalise(g->type_name),
     c->final_fn);
   args[DESC_EVENT_NOTIFY] = LLVMConstInt(c->i32,
-    genfun_vtable_index(c, g, stringtab("_event_notify"), NULL), false);
+    genfun_msg_id(c, g, stringtab("_event_notify"), NULL), false);
+  args[DESC_FLAGS] = LLVMConstInt(c->i32,
+    gentrace_leaf_array(c, g) ? PONY_TYPE_LEAF_ARRAY : 0, false);
   args[DESC_TRAITS] = trait_list;
   args[DESC_FIELDS] = make_field_list(c, g);
+  args[DESC_NAME] = make_name(c, g);
+  args[DESC_MSG_NAMES] = make_msg_names(c, g);
+  args[DESC_MSG_COUNT] = LLVMConstInt(c->i32, msg_count(c, g), false);
   args[DESC_VTABLE] = make_vtable(c, g);
 
   LLVMValueRef desc = LLVMConstNamedStruct(g->desc_type, args, DESC_LENGTH);
@@ -555,54 +627,42 @@ LLVMValueRef gendesc_isnominal(compile_t* c, LLVMValueRef desc, ast_t* type)
 
 LLVMValueRef gendesc_istrait(compile_t* c, LLVMValueRef desc, ast_t* type)
 {
-  // Get the trait identifier.
+  // Get the trait's bit.
   reachable_type_t* t = reach_type(c->reachable, genname_type(type));
   assert(t != NULL);
-  LLVMValueRef trait_id = LLVMConstInt(c->i32, t->type_id, false);
+  LLVMValueRef word = LLVMConstInt(c->i32, t->trait_index / 32, false);
+  LLVMValueRef mask = LLVMConstInt(c->i32,
+    (uint32_t)1 << (t->trait_index % 32), false);
 
-  // Read the count and the trait list from the descriptor.
+  // Read the count from the descriptor. The list only holds the words up to
+  // the type's highest trait bit, so check the word is there first.
   LLVMValueRef count = desc_field(c, desc, DESC_TRAIT_COUNT);
-  LLVMValueRef list = desc_field(c, desc, DESC_TRAITS);
+  LLVMValueRef test = LLVMBuildICmp(c->builder, LLVMIntULT, word, count, "");
 
   LLVMBasicBlockRef entry_block = LLVMGetInsertBlock(c->builder);
-  LLVMBasicBlockRef cond_block = codegen_block(c, "cond");
   LLVMBasicBlockRef body_block = codegen_block(c, "body");
   LLVMBasicBlockRef post_block = codegen_block(c, "post");
-  LLVMBuildBr(c->builder, cond_block);
-
-  // While the index is less than the count, check an ID.
-  LLVMPositionBuilderAtEnd(c->builder, cond_block);
-  LLVMValueRef phi = LLVMBuildPhi(c->builder, c->i32, "");
-  LLVMValueRef zero = LLVMConstInt(c->i32, 0, false);
-  LLVMAddIncoming(phi, &zero, &entry_block, 1);
-
-  LLVMValueRef test = LLVMBuildICmp(c->builder, LLVMIntULT, phi, count, "");
   LLVMBuildCondBr(c->builder, test, body_block, post_block);
 
-  // The phi node is the index. Get ID and compare it.
+  // Test the trait's bit.
   LLVMPositionBuilderAtEnd(c->builder, body_block);
+  LLVMValueRef list = desc_field(c, desc, DESC_TRAITS);
 
   LLVMValueRef gep[2];
   gep[0] = LLVMConstInt(c->i32, 0, false);
-  gep[1] = phi;
-
-  LLVMValueRef id_ptr = LLVMBuildGEP(c->builder, list, gep, 2, "");
-  LLVMValueRef id = LLVMBuildLoad(c->builder, id_ptr, "");
-  LLVMValueRef test_id = LLVMBuildICmp(c->builder, LLVMIntEQ, id, trait_id,
-    "");
-
-  // Add one to the phi node.
-  LLVMValueRef one = LLVMConstInt(c->i32, 1, false);
-  LLVMValueRef inc = LLVMBuildAdd(c->builder, phi, one, "");
-  LLVMAddIncoming(phi, &inc, &body_block, 1);
+  gep[1] = word;
 
-  // Either to the post block or back to the condition.
-  LLVMBuildCondBr(c->builder, test_id, post_block, cond_block);
+  LLVMValueRef bits_ptr = LLVMBuildGEP(c->builder, list, gep, 2, "");
+  LLVMValueRef bits = LLVMBuildLoad(c->builder, bits_ptr, "");
+  bits = LLVMBuildAnd(c->builder, bits, mask, "");
+  LLVMValueRef test_bit = LLVMBuildICmp(c->builder, LLVMIntNE, bits,
+    LLVMConstInt(c->i32, 0, false), "");
+  LLVMBuildBr(c->builder, post_block);
 
   LLVMPositionBuilderAtEnd(c->builder, post_block);
   LLVMValueRef result = LLVMBuildPhi(c->builder, c->i1, "");
-  LLVMAddIncoming(result, &test, &cond_block, 1);
-  LLVMAddIncoming(result, &test_id, &body_block, 1);
+  LLVMAddIncoming(result, &test, &entry_block, 1);
+  LLVMAddIncoming(result, &test_bit, &body_block, 1);
 
   return result;
 }
@@ -614,7 +674,13 @@ LLVMValueRef gendesc_isentity(compile_t* c, LLVMValueRef desc, ast_t* type)
   if(!gentype(c, type, &g))
     return GEN_NOVALUE;
 
-  LLVMValueRef left = LLVMBuildPtrToInt(c->builder, desc, c->intptr, "");
-  LLVMValueRef right = LLVMConstPtrToInt(g.desc, c->intptr);
+  // Compare type IDs rather than descriptor addresses. A match with many
+  // cases then tests the same loaded ID against constants, which LLVM turns
+  // into a switch.
+  reachable_type_t* t = reach_type(c->reachable, g.type_name);
+  assert(t != NULL);
+
+  LLVMValueRef left = desc_field(c, desc, DESC_ID);
+  LLVMValueRef right = LLVMConstInt(c->i32, t->type_id, false);
   return LLVMBuildICmp(c->builder, LLVMIntEQ, left, right, "");
 }
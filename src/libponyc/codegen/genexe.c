@@ -6,12 +6,17 @@
 #include "gencall.h"
 #include "genname.h"
 #include "genprim.h"
+#include "genserialise.h"
+#include "gensymbols.h"
 #include "../reach/paint.h"
+#include "../pkg/cache.h"
 #include "../pkg/package.h"
 #include "../pkg/program.h"
 #include "../type/assemble.h"
 #include "../type/lookup.h"
 #include "../../libponyrt/mem/pool.h"
+#include <llvm-c/BitReader.h>
+#include <llvm-c/Linker.h>
 #include <string.h>
 #include <assert.h>
 
@@ -129,6 +134,9 @@ static void gen_main(compile_t* c, gentype_t* main_g, gentype_t* env_g)
   // Initialise the pony runtime with argc and argv, getting a new argc.
   args[0] = gencall_runtime(c, "pony_init", args, 2, "argc");
 
+  // Tell the runtime which descriptor goes with each serialised type ID.
+  genserialise_types(c);
+
   // Create the main actor and become it.
   LLVMValueRef ctx = gencall_runtime(c, "pony_ctx", NULL, 0, "");
   codegen_setctx(c, ctx);
@@ -161,7 +169,7 @@ static void gen_main(compile_t* c, gentype_t* main_g, gentype_t* env_g)
   LLVMTypeRef msg_type_ptr = LLVMPointerType(msg_type, 0);
 
   // Allocate the message, setting its size and ID.
-  uint32_t index = genfun_vtable_index(c, main_g, stringtab("create"), NULL);
+  uint32_t index = genfun_msg_id(c, main_g, stringtab("create"), NULL);
 
   size_t msg_size = (size_t)LLVMABISizeOfType(c->target_data, msg_type);
   args[0] = LLVMConstInt(c->i32, pool_index(msg_size), false);
@@ -215,6 +223,77 @@ static void gen_main(compile_t* c, gentype_t* main_g, gentype_t* env_g)
   LLVMSetLinkage(func, LLVMExternalLinkage);
 }
 
+static bool link_runtime(compile_t* c)
+{
+  // Find libponyrt.bc wherever the search paths would find libponyrt.
+  char path[FILENAME_MAX];
+  bool found = false;
+
+  for(strlist_t* p = package_paths(); p != NULL; p = strlist_next(p))
+  {
+    snprintf(path, FILENAME_MAX, "%s/libponyrt.bc", strlist_data(p));
+    FILE* file = fopen(path, "rb");
+
+    if(file != NULL)
+    {
+      fclose(file);
+      found = true;
+      break;
+    }
+  }
+
+  if(!found)
+  {
+    errorf(NULL, "couldn't find libponyrt.bc");
+    return false;
+  }
+
+  LLVMMemoryBufferRef buf;
+  LLVMModuleRef runtime;
+  char* msg;
+
+  if(LLVMCreateMemoryBufferWithContentsOfFile(path, &buf, &msg))
+  {
+    errorf(NULL, "couldn't read %s: %s", path, msg);
+    LLVMDisposeMessage(msg);
+    return false;
+  }
+
+  bool failed = LLVMParseBitcodeInContext(c->context, buf, &runtime, &msg);
+  LLVMDisposeMemoryBuffer(buf);
+
+  if(failed)
+  {
+    errorf(NULL, "couldn't parse %s: %s", path, msg);
+    LLVMDisposeMessage(msg);
+    return false;
+  }
+
+  // Every runtime symbol is now defined in the program, so the linker pulls
+  // nothing from libponyrt.a.
+  if(LLVMLinkModules(c->module, runtime, LLVMLinkerDestroySource, &msg))
+  {
+    errorf(NULL, "couldn't link %s: %s", path, msg);
+    LLVMDisposeMessage(msg);
+    return false;
+  }
+
+  // HeapToStack looks for calls to the allocation functions, so they must
+  // not be inlined before it runs.
+  static const char* allocs[] = {"pony_alloc", "pony_alloc_small",
+    "pony_alloc_large", "pony_alloc_region", NULL};
+
+  for(size_t i = 0; allocs[i] != NULL; i++)
+  {
+    LLVMValueRef fun = LLVMGetNamedFunction(c->module, allocs[i]);
+
+    if(fun != NULL)
+      LLVMAddFunctionAttr(fun, LLVMNoInlineAttribute);
+  }
+
+  return true;
+}
+
 static bool link_exe(compile_t* c, ast_t* program,
   const char* file_o)
 {
@@ -297,6 +376,9 @@ static bool link_exe(compile_t* c, ast_t* program,
     "%s %s -lponyrt -lpthread "
 #ifdef PLATFORM_IS_LINUX
     "-ldl "
+#endif
+#ifdef PLATFORM_IS_FREEBSD
+    "-lexecinfo "
 #endif
     "-lm",
     file_exe, file_o, lib_args
@@ -377,10 +459,20 @@ bool genexe(compile_t* c, ast_t* program)
   if(lookup(NULL, main_ast, main_ast, create) == NULL)
     return false;
 
+  stats_phase(c->opt, STATS_REACH);
   genprim_reachable_init(c, program);
   reach(c->reachable, &c->next_type_id, main_ast, create, NULL);
   reach(c->reachable, &c->next_type_id, env_ast, stringtab("_create"), NULL);
+
+  if(c->opt->print_stats)
+    reach_stats(c->reachable, &c->opt->check.stats);
+
+  stats_phase(c->opt, STATS_PAINT);
+  reach_number_traits(c->reachable);
   paint(c->reachable);
+  reach_prune(c->reachable, program);
+  stats_phase(c->opt, PASS_LLVM_IR);
+  genserialise_init(c);
 
   gentype_t main_g;
   gentype_t env_g;
@@ -396,9 +488,18 @@ bool genexe(compile_t* c, ast_t* program)
   if(!ok)
     return false;
 
+  if(c->opt->runtime_bc && !link_runtime(c))
+    return false;
+
+  stats_phase(c->opt, STATS_OPT);
+
   if(!genopt(c))
     return false;
 
+  if(!gensymbols_write(c))
+    return false;
+
+  stats_phase(c->opt, PASS_OBJ);
   const char* file_o = genobj(c);
 
   if(file_o == NULL)
@@ -407,14 +508,26 @@ bool genexe(compile_t* c, ast_t* program)
   if(c->opt->limit < PASS_ALL)
     return true;
 
+  // Split objects aren't cached, since the cache keeps one file per program.
+  if((c->opt->cache_file != NULL) && (strchr(file_o, ' ') == NULL))
+    cache_store(c->opt, file_o);
+
+  // The linker may need as much memory as we have used, so free the module
+  // before running it.
+  codegen_release(c);
+  stats_phase(c->opt, STATS_LINK);
+
   if(!link_exe(c, program, file_o))
     return false;
 
-#ifdef PLATFORM_IS_WINDOWS
-  _unlink(file_o);
-#else
-  unlink(file_o);
-#endif
+  genobj_unlink(file_o);
 
   return true;
 }
+
+bool genexe_cached(compile_t* c, ast_t* program)
+{
+  codegen_release(c);
+  stats_phase(c->opt, STATS_LINK);
+  return link_exe(c, program, c->opt->cache_file);
+}
@@ -8,6 +8,8 @@ PONY_EXTERN_C_BEGIN
 
 bool genexe(compile_t* c, ast_t* program);
 
+bool genexe_cached(compile_t* c, ast_t* program);
+
 PONY_EXTERN_C_END
 
 #endif
@@ -243,6 +243,7 @@ LLVMValueRef gen_assign_cast(compile_t* c, LLVMTypeRef l_type,
     case LLVMHalfTypeKind:
     case LLVMFloatTypeKind:
     case LLVMDoubleTypeKind:
+    case LLVMVectorTypeKind:
       return gen_unbox(c, type, r_value);
 
     case LLVMPointerTypeKind:
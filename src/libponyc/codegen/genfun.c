@@ -5,12 +5,14 @@
 #include "gentrace.h"
 #include "gencontrol.h"
 #include "genexpr.h"
+#include "gensymbols.h"
 #include "../pass/names.h"
 #include "../type/assemble.h"
 #include "../type/subtype.h"
 #include "../type/reify.h"
 #include "../type/lookup.h"
 #include "../../libponyrt/ds/fun.h"
+#include "../../libponyrt/pony.h"
 #include "../../libponyrt/mem/pool.h"
 #include <string.h>
 #include <assert.h>
@@ -164,6 +166,7 @@ static LLVMValueRef get_prototype(compile_t* c, gentype_t* g, const char *name,
     // Generate the sender prototype.
     const char* be_name = genname_be(funname);
     func = codegen_addfun(c, be_name, ftype);
+    gensymbols_fun(c, be_name, g, name, typeargs, "(send)");
 
     // Change the return type to void for the handler.
     size_t count = LLVMCountParamTypes(ftype);
@@ -176,6 +179,7 @@ static LLVMValueRef get_prototype(compile_t* c, gentype_t* g, const char *name,
   }
 
   // Generate the function prototype.
+  gensymbols_fun(c, funname, g, name, typeargs, NULL);
   return codegen_addfun(c, funname, ftype);
 }
 
@@ -493,7 +497,7 @@ static LLVMValueRef genfun_be(compile_t* c, gentype_t* g, const char *name,
   LLVMValueRef this_ptr = LLVMGetParam(sender, 0);
 
   // Send the arguments in a message to 'this'.
-  uint32_t index = genfun_vtable_index(c, g, name, typeargs);
+  uint32_t index = genfun_msg_id(c, g, name, typeargs);
   LLVMTypeRef msg_type_ptr = send_message(c, fun, this_ptr, sender, index);
 
   // Return 'this'.
@@ -585,7 +589,7 @@ static LLVMValueRef genfun_newbe(compile_t* c, gentype_t* g, const char *name,
   LLVMValueRef this_ptr = LLVMGetParam(sender, 0);
 
   // Send the arguments in a message to 'this'.
-  uint32_t index = genfun_vtable_index(c, g, name, typeargs);
+  uint32_t index = genfun_msg_id(c, g, name, typeargs);
   LLVMTypeRef msg_type_ptr = send_message(c, fun, this_ptr, sender, index);
 
   genfun_dwarf_return(c, body);
@@ -638,6 +642,44 @@ static bool genfun_allocator(compile_t* c, gentype_t* g)
   return true;
 }
 
+static void free_bodies(gentype_t* g)
+{
+  // Each method is copied from the program when it is generated. A type with
+  // no type parameters isn't generated again, so the bodies can be freed,
+  // apart from a finaliser's, which is checked wherever the type is
+  // allocated.
+  ast_t* def = (ast_t*)ast_data(g->ast);
+
+  if(ast_id(ast_childidx(def, 1)) != TK_NONE)
+    return;
+
+  const char* final = stringtab("_final");
+  ast_t* member = ast_child(ast_childidx(def, 4));
+
+  while(member != NULL)
+  {
+    switch(ast_id(member))
+    {
+      case TK_NEW:
+      case TK_BE:
+      case TK_FUN:
+      {
+        AST_GET_CHILDREN(member, cap, id, typeparams, params, result,
+          can_error, body);
+
+        if((ast_id(body) != TK_NONE) && (ast_name(id) != final))
+          ast_replace(&body, ast_from(body, TK_NONE));
+
+        break;
+      }
+
+      default: {}
+    }
+
+    member = ast_sibling(member);
+  }
+}
+
 bool genfun_methods(compile_t* c, gentype_t* g)
 {
   reachable_type_t* t = reach_type(c->reachable, g->type_name);
@@ -683,6 +725,7 @@ bool genfun_methods(compile_t* c, gentype_t* g)
   if(!genfun_allocator(c, g))
     return false;
 
+  free_bodies(g);
   return true;
 }
 
@@ -696,23 +739,29 @@ uint32_t genfun_vtable_size(compile_t* c, gentype_t* g)
   return t->vtable_size;
 }
 
-static uint32_t vtable_index(compile_t* c, const char* type_name,
+static reachable_method_t* find_method(compile_t* c, const char* type_name,
   const char* name, ast_t* typeargs)
 {
   reachable_type_t* t = reach_type(c->reachable, type_name);
 
   if(t == NULL)
-    return -1;
+    return NULL;
 
   reachable_method_name_t* n = reach_method_name(t, name);
 
   if(n == NULL)
-    return -1;
+    return NULL;
 
   if(typeargs != NULL)
     name = genname_fun(NULL, name, typeargs);
 
-  reachable_method_t* m = reach_method(n, name);
+  return reach_method(n, name);
+}
+
+static uint32_t vtable_index(compile_t* c, const char* type_name,
+  const char* name, ast_t* typeargs)
+{
+  reachable_method_t* m = find_method(c, type_name, name, typeargs);
 
   if(m == NULL)
     return -1;
@@ -753,3 +802,70 @@ uint32_t genfun_vtable_index(compile_t* c, gentype_t* g, const char* name,
 
   return -1;
 }
+
+uint32_t genfun_msg_id(compile_t* c, gentype_t* g, const char* name,
+  ast_t* typeargs)
+{
+  if(ast_id(g->ast) != TK_NOMINAL)
+    return -1;
+
+  reachable_method_t* m = find_method(c, g->type_name, name, typeargs);
+
+  if(m == NULL)
+    return -1;
+
+  // The runtime only coalesces IDs below 32, each with its own pending bit.
+  ast_t* annotation = ast_childidx(m->r_fun, 9);
+
+  if((annotation != NULL) && (ast_id(annotation) == TK_ID) &&
+    (m->msg_id < 32))
+    return m->msg_id | PONY_MSG_COALESCE;
+
+  return m->msg_id;
+}
+
+static bool final_uses_copy(ast_t* ast)
+{
+  if(ast_id(ast) == TK_THIS)
+  {
+    // Only fields whose whole value is held in the object can be read.
+    ast_t* parent = ast_parent(ast);
+
+    switch(ast_id(parent))
+    {
+      case TK_FVARREF:
+      case TK_FLETREF:
+      {
+        ast_t* type = ast_type(parent);
+        return is_machine_word(type) || is_pointer(type);
+      }
+
+      default: {}
+    }
+
+    return false;
+  }
+
+  ast_t* child = ast_child(ast);
+
+  while(child != NULL)
+  {
+    if(!final_uses_copy(child))
+      return false;
+
+    child = ast_sibling(child);
+  }
+
+  return true;
+}
+
+bool genfun_final_deferred(gentype_t* g)
+{
+  // A deferred finaliser runs later on a copy of the object, so it may only
+  // read numbers and pointers out of it. It can't call methods on this, pass
+  // it on, or follow fields that point to other objects.
+  ast_t* fun = get_fun(g, stringtab("_final"), NULL);
+  bool deferred = final_uses_copy(ast_childidx(fun, 6));
+  ast_free_unattached(fun);
+  return deferred;
+}
@@ -20,6 +20,20 @@ uint32_t genfun_vtable_size(compile_t* c, gentype_t* g);
 uint32_t genfun_vtable_index(compile_t* c, gentype_t* g, const char* name,
   ast_t* typeargs);
 
+/**
+ * The ID of the message that the given behaviour or actor constructor sends.
+ * Message IDs are dense for each actor, so the dispatch switch becomes a jump
+ * table. Returns -1 if the method doesn't send a message.
+ */
+uint32_t genfun_msg_id(compile_t* c, gentype_t* g, const char* name,
+  ast_t* typeargs);
+
+/**
+ * Returns true if the type's finaliser only reads numbers and pointers from
+ * its fields, so that it can be run later on a copy of the object.
+ */
+bool genfun_final_deferred(gentype_t* g);
+
 PONY_EXTERN_C_END
 
 #endif
@@ -88,6 +88,19 @@ LLVMValueRef gen_is_value(compile_t* c, ast_t* left_type, ast_t* right_type,
       return LLVMConstInt(c->i1, 0, false);
     }
 
+    case LLVMVectorTypeKind:
+    {
+      // If it's the same type, compare every lane's bits.
+      if(l_type != r_type)
+        return LLVMConstInt(c->i1, 0, false);
+
+      LLVMTypeRef bits = LLVMIntTypeInContext(c->context,
+        (unsigned)LLVMABISizeOfType(c->target_data, l_type) * 8);
+      l_value = LLVMBuildBitCast(c->builder, l_value, bits, "");
+      r_value = LLVMBuildBitCast(c->builder, r_value, bits, "");
+      return LLVMBuildICmp(c->builder, LLVMIntEQ, l_value, r_value, "");
+    }
+
     case LLVMStructTypeKind:
     {
       // Pairwise comparison.
@@ -92,7 +92,14 @@ static bool reachable_actors(compile_t* c, ast_t* program)
     return false;
   }
 
+  if(c->opt->print_stats)
+    reach_stats(c->reachable, &c->opt->check.stats);
+
+  stats_phase(c->opt, STATS_PAINT);
+  reach_number_traits(c->reachable);
   paint(c->reachable);
+  reach_prune(c->reachable, program);
+  stats_phase(c->opt, PASS_LLVM_IR);
   return true;
 }
 
@@ -208,6 +215,7 @@ static bool link_lib(compile_t* c, const char* file_o)
 
 bool genlib(compile_t* c, ast_t* program)
 {
+  stats_phase(c->opt, STATS_REACH);
   genprim_reachable_init(c, program);
 
   if(!reachable_actors(c, program) ||
@@ -216,9 +224,12 @@ bool genlib(compile_t* c, ast_t* program)
     )
     return false;
 
+  stats_phase(c->opt, STATS_OPT);
+
   if(!genopt(c))
     return false;
 
+  stats_phase(c->opt, PASS_OBJ);
   const char* file_o = genobj(c);
 
   if(file_o == NULL)
@@ -227,14 +238,12 @@ bool genlib(compile_t* c, ast_t* program)
   if(c->opt->limit < PASS_ALL)
     return true;
 
+  stats_phase(c->opt, STATS_LINK);
+
   if(!link_lib(c, file_o))
     return false;
 
-#ifdef PLATFORM_IS_WINDOWS
-  _unlink(file_o);
-#else
-  unlink(file_o);
-#endif
+  genobj_unlink(file_o);
 
   return true;
 }
@@ -165,6 +165,11 @@ const char* genname_fieldlist(const char* type)
   return build_name(type, "$fields", NULL, NULL, false, false);
 }
 
+const char* genname_msgnames(const char* type)
+{
+  return build_name(type, "$msgnames", NULL, NULL, false, false);
+}
+
 const char* genname_trace(const char* type)
 {
   return build_name(type, "$trace", NULL, NULL, false, false);
@@ -200,6 +205,11 @@ const char* genname_instance(const char* type)
   return build_name(type, "$inst", NULL, NULL, false, false);
 }
 
+const char* genname_boxes(const char* type)
+{
+  return build_name(type, "$boxes", NULL, NULL, false, false);
+}
+
 const char* genname_fun(const char* type, const char* name, ast_t* typeargs)
 {
   return build_name(type, name, typeargs, NULL, false, true);
@@ -14,6 +14,8 @@ const char* genname_traitlist(const char* type);
 
 const char* genname_fieldlist(const char* type);
 
+const char* genname_msgnames(const char* type);
+
 const char* genname_trace(const char* type);
 
 const char* genname_serialise(const char* type);
@@ -28,6 +30,8 @@ const char* genname_descriptor(const char* type);
 
 const char* genname_instance(const char* type);
 
+const char* genname_boxes(const char* type);
+
 const char* genname_fun(const char* type, const char* name, ast_t* typeargs);
 
 const char* genname_be(const char* name);
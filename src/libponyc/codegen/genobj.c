@@ -1,6 +1,59 @@
 #include "genobj.h"
+#include "genopt.h"
 #include "../debug/dwarf.h"
+#include "../../libponyrt/mem/pool.h"
 #include <llvm-c/BitWriter.h>
+#include <string.h>
+
+#ifdef PLATFORM_IS_POSIX_BASED
+#  include <unistd.h>
+#endif
+
+#if PONY_LLVM >= 308
+static const char* genobj_split(compile_t* c, LLVMCodeGenFileType fmt,
+  const char* ext)
+{
+  // The first part keeps the usual name, and the rest are numbered after it.
+  size_t count = (size_t)c->opt->jobs;
+  const char** files = (const char**)pool_alloc_size(
+    count * sizeof(const char*));
+  size_t len = 0;
+
+  for(size_t i = 0; i < count; i++)
+  {
+    char part[32];
+
+    if(i == 0)
+      snprintf(part, sizeof(part), "%s", ext);
+    else
+      snprintf(part, sizeof(part), ".%d%s", (int)i, ext);
+
+    files[i] = suffix_filename(c->opt->output, "", c->filename, part);
+    len += strlen(files[i]) + 1;
+    printf("Writing %s\n", files[i]);
+  }
+
+  // The linker is handed every part, separated by spaces.
+  char* list = (char*)pool_alloc_size(len);
+  list[0] = '\0';
+
+  for(size_t i = 0; i < count; i++)
+  {
+    if(i > 0)
+      strcat(list, " ");
+
+    strcat(list, files[i]);
+  }
+
+  bool ok = gensplit(c, files, count, fmt);
+  pool_free_size(count * sizeof(const char*), files);
+
+  if(!ok)
+    return NULL;
+
+  return list;
+}
+#endif
 
 const char* genobj(compile_t* c)
 {
@@ -50,16 +103,25 @@ const char* genobj(compile_t* c)
   if(c->opt->limit == PASS_ASM)
   {
     fmt = LLVMAssemblyFile;
-    file_o = suffix_filename(c->opt->output, "", c->filename, ".s");
+    file_o = ".s";
   } else {
     fmt = LLVMObjectFile;
 #ifdef PLATFORM_IS_WINDOWS
-    file_o = suffix_filename(c->opt->output, "", c->filename, ".obj");
+    file_o = ".obj";
 #else
-    file_o = suffix_filename(c->opt->output, "", c->filename, ".o");
+    file_o = ".o";
 #endif
   }
 
+#if PONY_LLVM >= 308
+  // With more than one job, machine code for each part of the module is
+  // generated on a thread of its own.
+  if(c->opt->jobs > 1)
+    return genobj_split(c, fmt, file_o);
+#endif
+
+  file_o = suffix_filename(c->opt->output, "", c->filename, file_o);
+
   printf("Writing %s\n", file_o);
   char* err;
 
@@ -74,3 +136,30 @@ const char* genobj(compile_t* c)
 
   return file_o;
 }
+
+void genobj_unlink(const char* file_o)
+{
+  // An object split into parts is a list of names separated by spaces.
+  size_t len = strlen(file_o) + 1;
+  char* files = (char*)pool_alloc_size(len);
+  memcpy(files, file_o, len);
+
+  char* p = files;
+
+  while(p != NULL)
+  {
+    char* next = strchr(p, ' ');
+
+    if(next != NULL)
+      *next++ = '\0';
+
+#ifdef PLATFORM_IS_WINDOWS
+    _unlink(p);
+#else
+    unlink(p);
+#endif
+    p = next;
+  }
+
+  pool_free_size(len, files);
+}
@@ -8,6 +8,8 @@ PONY_EXTERN_C_BEGIN
 
 const char* genobj(compile_t* c);
 
+void genobj_unlink(const char* file_o);
+
 PONY_EXTERN_C_END
 
 #endif
@@ -2,6 +2,7 @@
 #include "genexpr.h"
 #include "genreference.h"
 #include "genname.h"
+#include "gentrace.h"
 #include "../pkg/platformfuns.h"
 #include "../type/subtype.h"
 #include <assert.h>
@@ -366,8 +367,22 @@ static LLVMValueRef assign_rvalue(compile_t* c, ast_t* left, ast_t* r_type,
     case TK_FLETREF:
     {
       // The result is the previous value of the field.
-      LLVMValueRef l_value = gen_fieldptr(c, left);
-      return assign_one(c, l_value, r_value, r_type);
+      AST_GET_CHILDREN(left, receiver, field);
+      LLVMValueRef object = gen_expr(c, receiver);
+
+      if(object == NULL)
+        return NULL;
+
+      ast_t* l_type = ast_type(receiver);
+      LLVMValueRef l_value = gen_fieldptr_of(c, object, l_type, field);
+      LLVMValueRef result = assign_one(c, l_value, r_value, r_type);
+
+      // An older object that now points to a young one must be remembered
+      // for the next minor gc pass.
+      if((result != NULL) && gentrace_needed(ast_type(left)))
+        gentrace_writebarrier(c, codegen_ctx(c), object, l_type);
+
+      return result;
     }
 
     case TK_EMBEDREF:
@@ -27,12 +27,22 @@
 
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#if PONY_LLVM >= 308
+#include <llvm/CodeGen/ParallelCG.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#endif
+
 #include <llvm/ADT/Triple.h>
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/ADT/SmallSet.h>
 #include <llvm/ADT/SmallVector.h>
 
 #include "../../libponyrt/mem/heap.h"
+#include "../../libponyrt/pony.h"
 
 #ifdef _MSC_VER
 #  pragma warning(pop)
@@ -46,6 +56,10 @@ using namespace llvm::legacy;
 
 static __pony_thread_local compile_t* the_compiler;
 
+// Bytes of allocations over 1024 bytes that may be moved to the stack in one
+// function. Smaller allocations are always moved if they don't escape.
+#define HEAP_TO_STACK_BUDGET 4096
+
 static void print_transform(compile_t* c, Instruction* inst, const char* s)
 {
   if((c == NULL) || !c->opt->print_stats)
@@ -98,11 +112,13 @@ public:
   static char ID;
   compile_t* c;
   Module* module;
+  uint64_t stack_used;
 
   HeapToStack() : FunctionPass(ID)
   {
     c = the_compiler;
     module = NULL;
+    stack_used = 0;
   }
 
   bool doInitialization(Module& m)
@@ -118,6 +134,7 @@ public:
     IRBuilder<> builder(&entry, entry.begin());
 
     bool changed = false;
+    stack_used = 0;
 
     for(auto block = f.begin(), end = f.end(); block != end; ++block)
     {
@@ -154,6 +171,8 @@ public:
       // Nothing.
     } else if(fun->getName().compare("pony_alloc_small") == 0) {
       small = true;
+    } else if(fun->getName().compare("pony_alloc_large") == 0) {
+      // Nothing.
     } else {
       return false;
     }
@@ -162,42 +181,67 @@ public:
     c->opt->check.stats.heap_alloc++;
     ConstantInt* int_size = dyn_cast_or_null<ConstantInt>(size);
 
-    if(int_size == NULL)
-    {
-      print_transform(c, inst, "variable size allocation");
-      return false;
-    }
-
-    uint64_t alloc_size = int_size->getZExtValue();
+    // An allocation that can't go on the stack can still go in the behaviour's
+    // region if it doesn't escape.
+    const char* region = NULL;
 
-    if(small)
+    if(int_size == NULL)
     {
-      // Convert a heap index to a size.
-      int_size = ConstantInt::get(builder.getInt64Ty(),
-        1 << (alloc_size + HEAP_MINBITS));
+      region = "variable size allocation";
     } else {
-      if(alloc_size > 1024)
+      uint64_t alloc_size = int_size->getZExtValue();
+
+      if(small)
       {
-        print_transform(c, inst, "large allocation");
-        return false;
+        // Convert a heap index to a size.
+        alloc_size = 1 << (alloc_size + HEAP_MINBITS);
+        int_size = ConstantInt::get(builder.getInt64Ty(), alloc_size);
+      } else if((alloc_size > 1024) &&
+        ((stack_used + alloc_size) > HEAP_TO_STACK_BUDGET)) {
+        // A few larger allocations can go on the stack, but not so many that
+        // a deep call chain could run out of stack.
+        region = "large allocation";
       }
     }
 
     SmallVector<CallInst*, 4> tail;
 
     if(!canStackAlloc(inst, dt, tail))
+    {
+      if(region != NULL)
+        print_transform(c, inst, region);
+
       return false;
+    }
+
+    if(region != NULL)
+    {
+      // The region outlives the function, so tail calls are still fine.
+      call.setCalledFunction(module->getFunction("pony_alloc_region"));
+
+      print_transform(c, inst, "region allocation");
+      c->opt->check.stats.heap_alloc--;
+      c->opt->check.stats.region_alloc++;
+
+      return true;
+    }
 
     for(auto iter = tail.begin(), end = tail.end(); iter != end; ++iter)
       (*iter)->setTailCall(false);
 
     // TODO: for variable size alloca, don't insert at the beginning.
     Instruction* begin = call.getCaller()->getEntryBlock().begin();
-    AllocaInst* replace = new AllocaInst(builder.getInt8Ty(), int_size, "",
-      begin);
-
+    // Allocate a fixed size array rather than a count of bytes, as SROA leaves
+    // array allocations alone. Align it as the heap would.
+    uint64_t bytes = int_size->getZExtValue();
+    AllocaInst* replace = new AllocaInst(
+      ArrayType::get(builder.getInt8Ty(), bytes), "", begin);
+    replace->setAlignment(16);
     replace->setDebugLoc(call->getDebugLoc());
-    inst->replaceAllUsesWith(replace);
+
+    Instruction* cast = new BitCastInst(replace, inst->getType(), "", begin);
+    inst->replaceAllUsesWith(cast);
+    stack_used += bytes;
 
     print_transform(c, replace, "stack allocation");
     c->opt->check.stats.heap_alloc--;
@@ -277,6 +321,8 @@ public:
         }
 
         case Instruction::Load:
+        case Instruction::ICmp:
+          // Reading through the pointer or comparing it doesn't capture it.
           break;
 
         case Instruction::Store:
@@ -452,14 +498,362 @@ static void addHeapToStackPass(const PassManagerBuilder& pmb,
   PassManagerBase& pm)
 {
   if(pmb.OptLevel >= 2)
+  {
     pm.add(new HeapToStack());
+
+    // SROA has already run by this point, so run it again to break the new
+    // stack objects into their fields, which lets a small object that never
+    // escapes live in registers.
+    pm.add(createSROAPass());
+  }
 }
 
-static void optimise(compile_t* c)
+class LocalError : public FunctionPass
+{
+public:
+  static char ID;
+  compile_t* c;
+
+  LocalError() : FunctionPass(ID)
+  {
+    c = the_compiler;
+  }
+
+  bool runOnFunction(Function& f)
+  {
+    SmallVector<InvokeInst*, 16> throws;
+
+    for(auto block = f.begin(), end = f.end(); block != end; ++block)
+    {
+      InvokeInst* invoke = dyn_cast<InvokeInst>(block->getTerminator());
+
+      if(invoke == NULL)
+        continue;
+
+      Function* fun = invoke->getCalledFunction();
+
+      if((fun != NULL) && (fun->getName().compare("pony_throw") == 0))
+        throws.push_back(invoke);
+    }
+
+    bool changed = false;
+
+    for(auto iter = throws.begin(), end = throws.end(); iter != end; ++iter)
+    {
+      if(runOnThrow(*iter))
+        changed = true;
+    }
+
+    return changed;
+  }
+
+  /**
+   * An error raised inside a try in the same function, either directly or by
+   * a partial function that has been inlined, is an invoke of pony_throw that
+   * unwinds to the try's landing pad. Nothing but the try can catch it, so
+   * branch to the else clause instead of unwinding.
+   */
+  bool runOnThrow(InvokeInst* invoke)
+  {
+    BasicBlock* pad_block = invoke->getUnwindDest();
+    LandingPadInst* pad = dyn_cast<LandingPadInst>(&*pad_block->begin());
+
+    // A PHI before the landing pad, or a use of the exception, means this
+    // isn't a plain Pony try.
+    if((pad == NULL) || !pad->use_empty())
+      return false;
+
+    // Split the else clause from its landing pad, unless that has already
+    // been done for another error.
+    BasicBlock::iterator next = pad;
+    ++next;
+    BranchInst* br = dyn_cast<BranchInst>(&*next);
+    BasicBlock* else_block;
+
+    if((br != NULL) && br->isUnconditional() &&
+      (br->getSuccessor(0)->getSinglePredecessor() == pad_block))
+    {
+      else_block = br->getSuccessor(0);
+    } else {
+      else_block = pad_block->splitBasicBlock(next, "try_else");
+    }
+
+    print_transform(c, invoke, "local error");
+    c->opt->check.stats.local_error++;
+
+    BasicBlock* block = invoke->getParent();
+    invoke->getNormalDest()->removePredecessor(block);
+    BranchInst::Create(else_block, invoke);
+    invoke->eraseFromParent();
+    return true;
+  }
+};
+
+char LocalError::ID = 0;
+
+static RegisterPass<LocalError>
+  LE("localerror", "Branch to the else clause for errors raised in a try");
+
+static void addLocalErrorPass(const PassManagerBuilder& pmb,
+  PassManagerBase& pm)
+{
+  if(pmb.OptLevel >= 2)
+  {
+    pm.add(new LocalError());
+
+    // Landing pads that nothing unwinds to any more are removed, and the
+    // error paths merged into the code around them.
+    pm.add(createCFGSimplificationPass());
+  }
+}
+
+static void addRangeCheckPass(const PassManagerBuilder& pmb,
+  PassManagerBase& pm)
+{
+#if PONY_LLVM >= 307
+  // A bounds check in a loop over an induction variable, such as in
+  // Array.apply once it is inlined, is split into a preloop, a main loop
+  // with no checks, and a postloop. The main loop can then be vectorised.
+  if(pmb.OptLevel >= 2)
+    pm.add(createInductiveRangeCheckEliminationPass());
+#else
+  (void)pmb;
+  (void)pm;
+#endif
+}
+
+#define CPU_AVX (PONY_CPU_SSE42 | PONY_CPU_AVX)
+#define CPU_AVX2 (CPU_AVX | PONY_CPU_AVX2 | PONY_CPU_FMA | PONY_CPU_BMI2)
+
+// The CPUs that --dispatch can version functions for, and the features a CPU
+// must report before the version for one is used. A Zen CPU has everything
+// haswell needs, so it runs the haswell version.
+static const struct
+{
+  const char* name;
+  uint32_t features;
+} dispatch_cpus[] =
+{
+  {"nehalem", PONY_CPU_SSE42},
+  {"westmere", PONY_CPU_SSE42},
+  {"btver2", CPU_AVX},
+  {"sandybridge", CPU_AVX},
+  {"ivybridge", CPU_AVX},
+  {"haswell", CPU_AVX2},
+  {"broadwell", CPU_AVX2},
+  {"skylake", CPU_AVX2},
+  {"skx", CPU_AVX2 | PONY_CPU_AVX512F},
+};
+
+static bool dispatch_targets(compile_t* c, SmallVectorImpl<size_t>& targets)
+{
+  if(c->opt->dispatch == NULL)
+    return true;
+
+  SmallVector<StringRef, 4> names;
+  StringRef(c->opt->dispatch).split(names, ",", -1, false);
+
+  for(size_t i = 0; i < names.size(); i++)
+  {
+    size_t count = sizeof(dispatch_cpus) / sizeof(dispatch_cpus[0]);
+    size_t j = 0;
+
+    while((j < count) && (names[i] != dispatch_cpus[j].name))
+      j++;
+
+    if(j == count)
+    {
+      errorf(NULL, "can't dispatch to unknown CPU %s", names[i].str().c_str());
+      return false;
+    }
+
+    targets.push_back(j);
+  }
+
+  return true;
+}
+
+static bool dispatch_candidate(compile_t* c, Function* f)
+{
+  if(f->isDeclaration() || f->isVarArg())
+    return false;
+
+#if PONY_LLVM >= 308
+  // With a profile, only a function that was seen running is versioned.
+  if(c->opt->pgo_use != NULL)
+  {
+    Optional<uint64_t> count = f->getEntryCount();
+
+    if(!count.hasValue() || (*count == 0))
+      return false;
+  }
+#else
+  (void)c;
+#endif
+
+  // Only a loop gains much from a newer CPU's wider vectors, so nothing else
+  // is worth an indirect call. A branch back to an earlier block is a loop.
+  SmallPtrSet<BasicBlock*, 16> seen;
+
+  for(Function::iterator bb = f->begin(), end = f->end(); bb != end; ++bb)
+  {
+    seen.insert(&*bb);
+    TerminatorInst* term = bb->getTerminator();
+
+    for(unsigned i = 0; i < term->getNumSuccessors(); i++)
+    {
+      if(seen.count(term->getSuccessor(i)) > 0)
+        return true;
+    }
+  }
+
+  return false;
+}
+
+static Function* dispatch_version(Module* m, Function* f, const char* cpu)
+{
+  ValueToValueMapTy vmap;
+  Function* clone = CloneFunction(f, vmap, false);
+  clone->setName(f->getName() + "$" + ((cpu != NULL) ? cpu : "base"));
+  clone->setLinkage(GlobalValue::InternalLinkage);
+  m->getFunctionList().push_back(clone);
+
+  if(cpu != NULL)
+    clone->addFnAttr("target-cpu", cpu);
+
+  return clone;
+}
+
+static void dispatch_call(IRBuilder<>& b, Function* from, Value* to)
+{
+  SmallVector<Value*, 8> args;
+
+  for(Function::arg_iterator arg = from->arg_begin(), end = from->arg_end();
+    arg != end; ++arg)
+    args.push_back(&*arg);
+
+  CallInst* call = b.CreateCall(to, args);
+  call->setCallingConv(from->getCallingConv());
+  call->setTailCall();
+
+  if(from->getReturnType()->isVoidTy())
+    b.CreateRetVoid();
+  else
+    b.CreateRet(call);
+}
+
+static void dispatch_function(Module* m, Function* f, Function* cpu_fn,
+  const SmallVectorImpl<size_t>& targets)
+{
+  SmallVector<Function*, 4> versions;
+  versions.push_back(dispatch_version(m, f, NULL));
+
+  for(size_t i = 0; i < targets.size(); i++)
+    versions.push_back(dispatch_version(m, f, dispatch_cpus[targets[i]].name));
+
+  // Calls go through a pointer that starts out at a resolver. The first call
+  // picks a version, stores it in the pointer and calls it. Every thread that
+  // races to do this picks the same version, so the race is harmless.
+  Function* resolve = Function::Create(f->getFunctionType(),
+    GlobalValue::InternalLinkage, f->getName() + "$resolve", m);
+  resolve->setCallingConv(f->getCallingConv());
+  resolve->addFnAttr(Attribute::Cold);
+  resolve->addFnAttr(Attribute::NoInline);
+
+  GlobalVariable* ptr = new GlobalVariable(*m, f->getType(), false,
+    GlobalValue::InternalLinkage, resolve, f->getName() + "$dispatch");
+
+  IRBuilder<> b(BasicBlock::Create(m->getContext(), "", resolve));
+  Value* features = b.CreateCall(cpu_fn);
+  Value* chosen = versions[0];
+
+  // The first CPU listed that this CPU has the features for wins.
+  for(size_t i = targets.size(); i > 0; i--)
+  {
+    Value* need = b.getInt32(dispatch_cpus[targets[i - 1]].features);
+    Value* has = b.CreateICmpEQ(b.CreateAnd(features, need), need);
+    chosen = b.CreateSelect(has, versions[i], chosen);
+  }
+
+  b.CreateStore(chosen, ptr);
+  dispatch_call(b, resolve, chosen);
+
+  // The original function keeps its name and linkage, so everything that
+  // refers to it, such as a vtable, now calls through the pointer. Once it is
+  // inlined, that is a load and an indirect call.
+  GlobalValue::LinkageTypes linkage = f->getLinkage();
+  f->deleteBody();
+  f->setLinkage(linkage);
+
+  b.SetInsertPoint(BasicBlock::Create(m->getContext(), "", f));
+  dispatch_call(b, f, b.CreateLoad(ptr));
+}
+
+static bool dispatch(compile_t* c, Module* m)
+{
+  SmallVector<size_t, 4> targets;
+
+  if(!dispatch_targets(c, targets))
+    return false;
+
+  if(targets.empty() || !c->opt->release)
+    return true;
+
+#if PONY_LLVM < 307
+  // Older code generators use one CPU for the whole module.
+  errorf(NULL, "--dispatch needs LLVM 3.7 or later");
+  return false;
+#endif
+
+  Function* cpu_fn = m->getFunction("pony_cpu_features");
+
+  if(cpu_fn == NULL)
+  {
+    cpu_fn = Function::Create(
+      FunctionType::get(Type::getInt32Ty(m->getContext()), false),
+      GlobalValue::ExternalLinkage, "pony_cpu_features", m);
+  }
+
+  // Collect the functions first, as versioning adds more.
+  SmallVector<Function*, 64> funcs;
+
+  for(Module::iterator f = m->begin(), end = m->end(); f != end; ++f)
+  {
+    if((&*f != cpu_fn) && dispatch_candidate(c, &*f))
+      funcs.push_back(&*f);
+  }
+
+  for(size_t i = 0; i < funcs.size(); i++)
+    dispatch_function(m, funcs[i], cpu_fn, targets);
+
+  return true;
+}
+
+static bool optimise(compile_t* c)
 {
   the_compiler = c;
 
   Module* m = unwrap(c->module);
+
+  // Raising an error is rare, so a branch to one is unlikely. This lets the
+  // range check pass recognise a bounds check that raises an error.
+  Function* throw_fn = m->getFunction("pony_throw");
+
+  if(throw_fn != NULL)
+    throw_fn->addFnAttr(Attribute::Cold);
+
+  // Keeping the frame pointer in every function, including the runtime when
+  // it is linked in as bitcode, lets a profiler walk the stack without debug
+  // info.
+  if(c->opt->frame_pointers)
+  {
+    for(Module::iterator f = m->begin(), end = m->end(); f != end; ++f)
+    {
+      if(!f->isDeclaration())
+        f->addFnAttr("no-frame-pointer-elim", "true");
+    }
+  }
+
   TargetMachine* machine = reinterpret_cast<TargetMachine*>(c->machine);
 
   PassManager lpm;
@@ -511,6 +905,10 @@ static void optimise(compile_t* c)
 
   pmb.addExtension(PassManagerBuilder::EP_LoopOptimizerEnd,
     addHeapToStackPass);
+  pmb.addExtension(PassManagerBuilder::EP_LoopOptimizerEnd,
+    addRangeCheckPass);
+  pmb.addExtension(PassManagerBuilder::EP_ScalarOptimizerLate,
+    addLocalErrorPass);
 
   pmb.populateFunctionPassManager(fpm);
 
@@ -537,6 +935,22 @@ static void optimise(compile_t* c)
   if(c->opt->strip_debug)
     lpm.add(createStripSymbolsPass());
 
+  // A sample profile gives branch weights and hot call sites to the rest of
+  // the pipeline, and picks the functions to version for --dispatch, so it is
+  // read before anything else. It is matched to the code by debug line, so it
+  // must come from an unstripped build.
+  if(c->opt->release && (c->opt->pgo_use != NULL))
+  {
+    PassManager ppm;
+    ppm.add(createSampleProfileLoaderPass(c->opt->pgo_use));
+    ppm.run(*m);
+  }
+
+  // Versions for each CPU are made before optimising, so each is optimised
+  // for its own CPU.
+  if(!dispatch(c, m))
+    return false;
+
   fpm.doInitialization();
 
   for(Module::iterator f = m->begin(), end = m->end(); f != end; ++f)
@@ -547,13 +961,17 @@ static void optimise(compile_t* c)
 
   if(!c->opt->library)
     lpm.run(*m);
+
+  return true;
 }
 
 bool genopt(compile_t* c)
 {
   // Finalise the DWARF info.
   dwarf_finalise(&c->dwarf);
-  optimise(c);
+
+  if(!optimise(c))
+    return false;
 
   if(c->opt->verify)
   {
@@ -573,3 +991,44 @@ bool genopt(compile_t* c)
 
   return true;
 }
+
+#if PONY_LLVM >= 308
+bool gensplit(compile_t* c, const char** files, size_t count,
+  LLVMCodeGenFileType fmt)
+{
+  TargetMachine* machine = reinterpret_cast<TargetMachine*>(c->machine);
+  std::vector<std::unique_ptr<raw_fd_ostream> > streams;
+  std::vector<raw_pwrite_stream*> outs;
+
+  for(size_t i = 0; i < count; i++)
+  {
+    std::error_code ec;
+    streams.emplace_back(new raw_fd_ostream(files[i], ec, sys::fs::F_None));
+
+    if(ec)
+    {
+      errorf(NULL, "couldn't create file %s: %s", files[i],
+        ec.message().c_str());
+      return false;
+    }
+
+    outs.push_back(streams.back().get());
+  }
+
+  TargetMachine::CodeGenFileType type = (fmt == LLVMAssemblyFile) ?
+    TargetMachine::CGFT_AssemblyFile : TargetMachine::CGFT_ObjectFile;
+
+  // The module is split by function, and each part is serialised into a
+  // context of its own and compiled on a thread of its own. The module is
+  // consumed, so nothing may use it afterwards.
+  std::unique_ptr<Module> m(unwrap(c->module));
+  c->module = NULL;
+
+  splitCodeGen(std::move(m), outs, machine->getTargetCPU(),
+    machine->getTargetFeatureString(), machine->Options,
+    machine->getRelocationModel(), machine->getCodeModel(),
+    machine->getOptLevel(), type);
+
+  return true;
+}
+#endif
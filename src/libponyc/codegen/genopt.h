@@ -8,6 +8,11 @@ PONY_EXTERN_C_BEGIN
 
 bool genopt(compile_t* c);
 
+#if PONY_LLVM >= 308
+bool gensplit(compile_t* c, const char** files, size_t count,
+  LLVMCodeGenFileType fmt);
+#endif
+
 PONY_EXTERN_C_END
 
 #endif
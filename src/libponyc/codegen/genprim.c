@@ -8,6 +8,8 @@
 #include "../pass/names.h"
 #include "../debug/dwarf.h"
 #include "../type/assemble.h"
+#include <string.h>
+#include <assert.h>
 
 static void pointer_create(compile_t* c, gentype_t* g)
 {
@@ -126,6 +128,10 @@ static void pointer_update(compile_t* c, gentype_t* g, gentype_t* elem_g)
   result = LLVMBuildBitCast(c->builder, result, elem_g->use_type, "");
   LLVMBuildStore(c->builder, LLVMGetParam(fun, 2), loc);
 
+  if(gentrace_needed(elem_g->ast))
+    gentrace_valuebarrier(c, codegen_ctx(c), ptr, LLVMGetParam(fun, 2),
+      elem_g->ast);
+
   LLVMBuildRet(c->builder, result);
   codegen_finishfun(c);
 }
@@ -160,6 +166,16 @@ static void pointer_offset(compile_t* c, gentype_t* g, gentype_t* elem_g,
   codegen_finishfun(c);
 }
 
+static void mem_nocapture(LLVMValueRef call)
+{
+  // memcpy and memmove are declared as varargs, so that FFI declarations of
+  // them with other argument types still link. Mark the pointers as not
+  // captured at each call instead, which lets an allocation whose contents are
+  // only copied around still be moved to the stack.
+  LLVMAddInstrAttribute(call, 1, LLVMNoCaptureAttribute);
+  LLVMAddInstrAttribute(call, 2, LLVMNoCaptureAttribute);
+}
+
 static void pointer_insert(compile_t* c, gentype_t* g, gentype_t* elem_g)
 {
   // Set up a constant integer for the allocation size.
@@ -181,18 +197,19 @@ static void pointer_insert(compile_t* c, gentype_t* g, gentype_t* elem_g)
   LLVMValueRef n = LLVMGetParam(fun, 1);
   LLVMValueRef len = LLVMGetParam(fun, 2);
 
-  LLVMValueRef src = LLVMBuildPtrToInt(c->builder, ptr, c->intptr, "");
+  LLVMValueRef src = LLVMBuildBitCast(c->builder, ptr, c->void_ptr, "");
   LLVMValueRef offset = LLVMBuildMul(c->builder, n, l_size, "");
-  LLVMValueRef dst = LLVMBuildAdd(c->builder, src, offset, "");
+  LLVMValueRef dst = LLVMBuildInBoundsGEP(c->builder, src, &offset, 1, "");
   LLVMValueRef elen = LLVMBuildMul(c->builder, len, l_size, "");
 
   LLVMValueRef args[3];
-  args[0] = LLVMBuildIntToPtr(c->builder, dst, c->void_ptr, "");
-  args[1] = LLVMBuildIntToPtr(c->builder, src, c->void_ptr, "");
+  args[0] = dst;
+  args[1] = src;
   args[2] = elen;
 
   // memmove(ptr + (n * sizeof(elem)), ptr, len * sizeof(elem))
-  gencall_runtime(c, "memmove", args, 3, "");
+  LLVMValueRef call = gencall_runtime(c, "memmove", args, 3, "");
+  mem_nocapture(call);
 
   // Return ptr.
   LLVMBuildRet(c->builder, ptr);
@@ -223,18 +240,19 @@ static void pointer_delete(compile_t* c, gentype_t* g, gentype_t* elem_g)
   LLVMValueRef result = LLVMBuildLoad(c->builder, ptr, "");
   result = LLVMBuildBitCast(c->builder, result, elem_g->use_type, "");
 
-  LLVMValueRef dst = LLVMBuildPtrToInt(c->builder, ptr, c->intptr, "");
+  LLVMValueRef dst = LLVMBuildBitCast(c->builder, ptr, c->void_ptr, "");
   LLVMValueRef offset = LLVMBuildMul(c->builder, n, l_size, "");
-  LLVMValueRef src = LLVMBuildAdd(c->builder, dst, offset, "");
+  LLVMValueRef src = LLVMBuildInBoundsGEP(c->builder, dst, &offset, 1, "");
   LLVMValueRef elen = LLVMBuildMul(c->builder, len, l_size, "");
 
   LLVMValueRef args[3];
-  args[0] = LLVMBuildIntToPtr(c->builder, dst, c->void_ptr, "");
-  args[1] = LLVMBuildIntToPtr(c->builder, src, c->void_ptr, "");
+  args[0] = dst;
+  args[1] = src;
   args[2] = elen;
 
   // memmove(ptr, ptr + (n * sizeof(elem)), len * sizeof(elem))
-  gencall_runtime(c, "memmove", args, 3, "");
+  LLVMValueRef call = gencall_runtime(c, "memmove", args, 3, "");
+  mem_nocapture(call);
 
   // Return ptr[0].
   LLVMBuildRet(c->builder, result);
@@ -269,7 +287,42 @@ static void pointer_copy_to(compile_t* c, gentype_t* g, gentype_t* elem_g)
   args[2] = elen;
 
   // memcpy(ptr2, ptr, n * sizeof(elem))
-  gencall_runtime(c, "memcpy", args, 3, "");
+  LLVMValueRef call = gencall_runtime(c, "memcpy", args, 3, "");
+  mem_nocapture(call);
+
+  // Every element copied is a store into the destination, which needs a write
+  // barrier if the elements are traced.
+  if(gentrace_needed(elem_g->ast))
+  {
+    LLVMValueRef ctx = codegen_ctx(c);
+    LLVMBasicBlockRef entry_block = LLVMGetInsertBlock(c->builder);
+    LLVMBasicBlockRef cond_block = codegen_block(c, "cond");
+    LLVMBasicBlockRef body_block = codegen_block(c, "body");
+    LLVMBasicBlockRef post_block = codegen_block(c, "post");
+    LLVMBuildBr(c->builder, cond_block);
+
+    // While the index is less than the count, handle an element.
+    LLVMPositionBuilderAtEnd(c->builder, cond_block);
+    LLVMValueRef phi = LLVMBuildPhi(c->builder, c->intptr, "");
+    LLVMValueRef zero = LLVMConstInt(c->intptr, 0, false);
+    LLVMAddIncoming(phi, &zero, &entry_block, 1);
+    LLVMValueRef test = LLVMBuildICmp(c->builder, LLVMIntULT, phi, n, "");
+    LLVMBuildCondBr(c->builder, test, body_block, post_block);
+
+    LLVMPositionBuilderAtEnd(c->builder, body_block);
+    LLVMValueRef elem = LLVMBuildGEP(c->builder, ptr2, &phi, 1, "elem");
+    elem = LLVMBuildLoad(c->builder, elem, "");
+    gentrace_valuebarrier(c, ctx, ptr2, elem, elem_g->ast);
+
+    // Add one to the phi node and branch back to the cond block.
+    LLVMValueRef one = LLVMConstInt(c->intptr, 1, false);
+    LLVMValueRef inc = LLVMBuildAdd(c->builder, phi, one, "");
+    body_block = LLVMGetInsertBlock(c->builder);
+    LLVMAddIncoming(phi, &inc, &body_block, 1);
+    LLVMBuildBr(c->builder, cond_block);
+
+    LLVMPositionBuilderAtEnd(c->builder, post_block);
+  }
 
   LLVMBuildRet(c->builder, ptr);
   codegen_finishfun(c);
@@ -290,6 +343,19 @@ static void pointer_usize(compile_t* c, gentype_t* g)
   codegen_finishfun(c);
 }
 
+static void pointer_unsafe(compile_t* c, gentype_t* g)
+{
+  const char* name = genname_fun(g->type_name, "_unsafe", NULL);
+
+  LLVMTypeRef ftype = LLVMFunctionType(g->use_type, &g->use_type, 1, false);
+  LLVMValueRef fun = codegen_addfun(c, name, ftype);
+  codegen_startfun(c, fun, false);
+
+  // Only the capability changes, so the pointer is returned as it is.
+  LLVMBuildRet(c->builder, LLVMGetParam(fun, 0));
+  codegen_finishfun(c);
+}
+
 bool genprim_pointer(compile_t* c, gentype_t* g, bool prelim)
 {
   // No trace function is generated, so the "contents" of a pointer are never
@@ -338,6 +404,7 @@ bool genprim_pointer(compile_t* c, gentype_t* g, bool prelim)
   pointer_delete(c, g, &elem_g);
   pointer_copy_to(c, g, &elem_g);
   pointer_usize(c, g);
+  pointer_unsafe(c, g);
 
   ok = genfun_methods(c, g);
 
@@ -480,15 +547,9 @@ void genprim_array_trace(compile_t* c, gentype_t* g)
   LLVMValueRef ctx = LLVMGetParam(trace_fn, 0);
   LLVMValueRef arg = LLVMGetParam(trace_fn, 1);
 
-  LLVMBasicBlockRef cond_block = codegen_block(c, "cond");
-  LLVMBasicBlockRef body_block = codegen_block(c, "body");
-  LLVMBasicBlockRef post_block = codegen_block(c, "post");
-
-  // Read the count and the base pointer.
+  // Read the base pointer.
   LLVMValueRef object = LLVMBuildBitCast(c->builder, arg, g->use_type,
     "array");
-  LLVMValueRef count_ptr = LLVMBuildStructGEP(c->builder, object, 1, "");
-  LLVMValueRef count = LLVMBuildLoad(c->builder, count_ptr, "count");
   LLVMValueRef pointer_ptr = LLVMBuildStructGEP(c->builder, object, 3, "");
   LLVMValueRef pointer = LLVMBuildLoad(c->builder, pointer_ptr, "pointer");
 
@@ -497,6 +558,24 @@ void genprim_array_trace(compile_t* c, gentype_t* g)
   args[0] = ctx;
   args[1] = LLVMBuildBitCast(c->builder, pointer, c->void_ptr, "");
   gencall_runtime(c, "pony_trace", args, 2, "");
+
+  // If the elements never need tracing, such as for Array[U8], the base
+  // pointer is all there is to trace. Skip the per-element loop so sending
+  // a large pointer-free array costs the same as sending an empty one.
+  if(!gentrace_needed(typearg))
+  {
+    LLVMBuildRetVoid(c->builder);
+    codegen_finishfun(c);
+    return;
+  }
+
+  LLVMBasicBlockRef cond_block = codegen_block(c, "cond");
+  LLVMBasicBlockRef body_block = codegen_block(c, "body");
+  LLVMBasicBlockRef post_block = codegen_block(c, "post");
+
+  // Read the count.
+  LLVMValueRef count_ptr = LLVMBuildStructGEP(c->builder, object, 1, "");
+  LLVMValueRef count = LLVMBuildLoad(c->builder, count_ptr, "count");
   LLVMBuildBr(c->builder, cond_block);
 
   // While the index is less than the count, trace an element. The initial
@@ -532,114 +611,161 @@ typedef struct num_conv_t
 {
   const char* type_name;
   const char* fun_name;
-  LLVMTypeRef type;
   int size;
   bool is_signed;
   bool is_float;
 } num_conv_t;
 
-static void number_conversions(compile_t* c)
+static const num_conv_t conv[] =
 {
-  num_conv_t conv[] =
-  {
-    {"I8", "i8", c->i8, 8, true, false},
-    {"I16", "i16", c->i16, 16, true, false},
-    {"I32", "i32", c->i32, 32, true, false},
-    {"I64", "i64", c->i64, 64, true, false},
-
-    {"U8", "u8", c->i8, 8, false, false},
-    {"U16", "u16", c->i16, 16, false, false},
-    {"U32", "u32", c->i32, 32, false, false},
-    {"U64", "u64", c->i64, 64, false, false},
-    {"I128", "i128", c->i128, 128, true, false},
-    {"U128", "u128", c->i128, 128, false, false},
+  {"I8", "i8", 8, true, false},
+  {"I16", "i16", 16, true, false},
+  {"I32", "i32", 32, true, false},
+  {"I64", "i64", 64, true, false},
+
+  {"U8", "u8", 8, false, false},
+  {"U16", "u16", 16, false, false},
+  {"U32", "u32", 32, false, false},
+  {"U64", "u64", 64, false, false},
+  {"I128", "i128", 128, true, false},
+  {"U128", "u128", 128, false, false},
 
 #if defined(PLATFORM_IS_ILP32)
-    {"ILong", "ilong", c->i32, 32, true, false},
-    {"ULong", "ulong", c->i32, 32, false, false},
-    {"ISize", "isize", c->i32, 32, true, false},
-    {"USize", "usize", c->i32, 32, false, false},
+  {"ILong", "ilong", 32, true, false},
+  {"ULong", "ulong", 32, false, false},
+  {"ISize", "isize", 32, true, false},
+  {"USize", "usize", 32, false, false},
 #elif defined(PLATFORM_IS_LP64)
-    {"ILong", "ilong", c->i64, 64, true, false},
-    {"ULong", "ulong", c->i64, 64, false, false},
-    {"ISize", "isize", c->i64, 64, true, false},
-    {"USize", "usize", c->i64, 64, false, false},
+  {"ILong", "ilong", 64, true, false},
+  {"ULong", "ulong", 64, false, false},
+  {"ISize", "isize", 64, true, false},
+  {"USize", "usize", 64, false, false},
 #elif defined(PLATFORM_IS_LLP64)
-    {"ILong", "ilong", c->i32, 32, true, false},
-    {"ULong", "ulong", c->i32, 32, false, false},
-    {"ISize", "isize", c->i64, 64, true, false},
-    {"USize", "usize", c->i64, 64, false, false},
+  {"ILong", "ilong", 32, true, false},
+  {"ULong", "ulong", 32, false, false},
+  {"ISize", "isize", 64, true, false},
+  {"USize", "usize", 64, false, false},
 #endif
 
-    {"F32", "f32", c->f32, 32, false, true},
-    {"F64", "f64", c->f64, 64, false, true},
+  {"F32", "f32", 32, false, true},
+  {"F64", "f64", 64, false, true},
+
+  {NULL, NULL, 0, false, false}
+};
+
+static LLVMTypeRef conv_type(compile_t* c, const num_conv_t* n)
+{
+  if(n->is_float)
+    return (n->size == 32) ? c->f32 : c->f64;
+
+  return LLVMIntTypeInContext(c->context, (unsigned)n->size);
+}
+
+static bool conv_native(compile_t* c, const num_conv_t* from,
+  const num_conv_t* to)
+{
+  // Without native 128 bit maths, conversions between 128 bit integers and
+  // floats are written in Pony.
+  if((from->is_float && (to->size > 64)) || (to->is_float && (from->size > 64)))
+  {
+    bool native128;
+    os_is_target(OS_NATIVE128_NAME, c->opt->release, &native128);
+    return native128;
+  }
 
-    {NULL, NULL, NULL, false, false, false}
-  };
+  return true;
+}
 
-  bool native128;
-  os_is_target(OS_NATIVE128_NAME, c->opt->release, &native128);
+static LLVMValueRef convert_number(compile_t* c, LLVMValueRef arg,
+  const num_conv_t* from, const num_conv_t* to)
+{
+  LLVMTypeRef type = conv_type(c, to);
 
-  for(num_conv_t* from = conv; from->type_name != NULL; from++)
+  if(from->is_float)
   {
-    for(num_conv_t* to = conv; to->type_name != NULL; to++)
+    if(to->is_float)
     {
-      if(to->fun_name == NULL)
+      if(from->size < to->size)
+        return LLVMBuildFPExt(c->builder, arg, type, "");
+      else if(from->size > to->size)
+        return LLVMBuildFPTrunc(c->builder, arg, type, "");
+      else
+        return arg;
+    } else if(to->is_signed) {
+      return LLVMBuildFPToSI(c->builder, arg, type, "");
+    } else {
+      return LLVMBuildFPToUI(c->builder, arg, type, "");
+    }
+  } else if(to->is_float) {
+    if(from->is_signed)
+      return LLVMBuildSIToFP(c->builder, arg, type, "");
+    else
+      return LLVMBuildUIToFP(c->builder, arg, type, "");
+  } else if(from->size > to->size) {
+    return LLVMBuildTrunc(c->builder, arg, type, "");
+  } else if(from->size < to->size) {
+    if(from->is_signed)
+      return LLVMBuildSExt(c->builder, arg, type, "");
+    else
+      return LLVMBuildZExt(c->builder, arg, type, "");
+  }
+
+  return arg;
+}
+
+static void number_conversions(compile_t* c)
+{
+  for(const num_conv_t* from = conv; from->type_name != NULL; from++)
+  {
+    for(const num_conv_t* to = conv; to->type_name != NULL; to++)
+    {
+      if(!conv_native(c, from, to))
         continue;
 
       const char* name = genname_fun(from->type_name, to->fun_name, NULL);
-      LLVMTypeRef f_type = LLVMFunctionType(to->type, &from->type, 1, false);
+      LLVMTypeRef from_type = conv_type(c, from);
+      LLVMTypeRef f_type = LLVMFunctionType(conv_type(c, to), &from_type, 1,
+        false);
       LLVMValueRef fun = codegen_addfun(c, name, f_type);
 
       codegen_startfun(c, fun, false);
       LLVMValueRef arg = LLVMGetParam(fun, 0);
-      LLVMValueRef result;
-
-      if(from->is_float)
-      {
-        if(to->is_float)
-        {
-          if(from->size < to->size)
-            result = LLVMBuildFPExt(c->builder, arg, to->type, "");
-          else if(from->size > to->size)
-            result = LLVMBuildFPTrunc(c->builder, arg, to->type, "");
-          else
-            result = arg;
-        } else if(to->is_signed) {
-          result = LLVMBuildFPToSI(c->builder, arg, to->type, "");
-        } else {
-          result = LLVMBuildFPToUI(c->builder, arg, to->type, "");
-        }
-      } else if(to->is_float) {
-        if(from->is_signed)
-          result = LLVMBuildSIToFP(c->builder, arg, to->type, "");
-        else
-          result = LLVMBuildUIToFP(c->builder, arg, to->type, "");
-      } else if(from->size > to->size) {
-          result = LLVMBuildTrunc(c->builder, arg, to->type, "");
-      } else if(from->size < to->size) {
-        if(from->is_signed)
-          result = LLVMBuildSExt(c->builder, arg, to->type, "");
-        else
-          result = LLVMBuildZExt(c->builder, arg, to->type, "");
-      } else {
-        result = arg;
-      }
-
-      LLVMBuildRet(c->builder, result);
+      LLVMBuildRet(c->builder, convert_number(c, arg, from, to));
       codegen_finishfun(c);
-
-      if(!native128 &&
-        ((from->is_float && (to->size > 64)) ||
-        (to->is_float && (from->size > 64)))
-        )
-      {
-        LLVMDeleteFunction(fun);
-      }
     }
   }
 }
 
+static const num_conv_t* find_conv(const char* name, bool fun)
+{
+  for(const num_conv_t* n = conv; n->type_name != NULL; n++)
+  {
+    if(!strcmp(fun ? n->fun_name : n->type_name, name))
+      return n;
+  }
+
+  return NULL;
+}
+
+bool genprim_is_conversion(compile_t* c, const char* type_name,
+  const char* fun_name)
+{
+  const num_conv_t* from = find_conv(type_name, false);
+  const num_conv_t* to = find_conv(fun_name, true);
+
+  return (from != NULL) && (to != NULL) && conv_native(c, from, to);
+}
+
+LLVMValueRef genprim_convert(compile_t* c, const char* type_name,
+  const char* fun_name, LLVMValueRef value)
+{
+  const num_conv_t* from = find_conv(type_name, false);
+  const num_conv_t* to = find_conv(fun_name, true);
+
+  assert((from != NULL) && (to != NULL));
+  return convert_number(c, value, from, to);
+}
+
 static void fp_as_bits(compile_t* c)
 {
   const char* name;
@@ -737,10 +863,288 @@ static void make_rdtscp(compile_t* c)
 #endif
 }
 
+typedef struct simd_t
+{
+  const char* type_name;
+  int elem_size;
+  unsigned int lanes;
+  bool is_signed;
+  bool is_float;
+} simd_t;
+
+// Every vector type is 128 bits. LLVM splits or scalarises them on targets
+// without vector registers of that size.
+static const simd_t simd[] =
+{
+  {"F32x4", 32, 4, false, true},
+  {"F64x2", 64, 2, false, true},
+  {"I32x4", 32, 4, true, false},
+  {"U32x4", 32, 4, false, false},
+  {"U8x16", 8, 16, false, false},
+
+  {NULL, 0, 0, false, false}
+};
+
+static LLVMTypeRef simd_elem(compile_t* c, const simd_t* s)
+{
+  if(s->is_float)
+    return (s->elem_size == 32) ? c->f32 : c->f64;
+
+  return LLVMIntTypeInContext(c->context, (unsigned)s->elem_size);
+}
+
+static LLVMValueRef simd_fun(compile_t* c, const simd_t* s, const char* name,
+  LLVMTypeRef ret, LLVMTypeRef* params, unsigned int count)
+{
+  const char* fun_name = genname_fun(s->type_name, name, NULL);
+  LLVMTypeRef f_type = LLVMFunctionType(ret, params, count, false);
+  LLVMValueRef fun = codegen_addfun(c, fun_name, f_type);
+  codegen_startfun(c, fun, false);
+  return fun;
+}
+
+static LLVMValueRef simd_lane(compile_t* c, const simd_t* s, LLVMValueRef i)
+{
+  // The lane count is a power of 2, so an index wraps around the vector.
+  LLVMValueRef mask = LLVMConstInt(c->intptr, s->lanes - 1, false);
+  i = LLVMBuildAnd(c->builder, i, mask, "");
+  return LLVMBuildTrunc(c->builder, i, c->i32, "");
+}
+
+static LLVMValueRef simd_array_ptr(compile_t* c, const simd_t* s,
+  LLVMValueRef array, LLVMValueRef offset)
+{
+  // Raise an error unless offset + lanes <= size. The array is laid out as
+  // its descriptor, size, space and base pointer.
+  LLVMTypeRef elem = simd_elem(c, s);
+  LLVMTypeRef fields[4];
+  fields[0] = c->descriptor_ptr;
+  fields[1] = c->intptr;
+  fields[2] = c->intptr;
+  fields[3] = LLVMPointerType(elem, 0);
+
+  LLVMTypeRef array_type = LLVMStructTypeInContext(c->context, fields, 4,
+    false);
+  array = LLVMBuildBitCast(c->builder, array,
+    LLVMPointerType(array_type, 0), "");
+
+  LLVMValueRef size = LLVMBuildLoad(c->builder,
+    LLVMBuildStructGEP(c->builder, array, 1, ""), "");
+  LLVMValueRef lanes = LLVMConstInt(c->intptr, s->lanes, false);
+  LLVMValueRef in_range = LLVMBuildICmp(c->builder, LLVMIntULE, offset, size,
+    "");
+  LLVMValueRef space = LLVMBuildSub(c->builder, size, offset, "");
+  LLVMValueRef fits = LLVMBuildICmp(c->builder, LLVMIntUGE, space, lanes, "");
+  LLVMValueRef test = LLVMBuildAnd(c->builder, in_range, fits, "");
+
+  LLVMBasicBlockRef error_block = codegen_block(c, "error");
+  LLVMBasicBlockRef post_block = codegen_block(c, "post");
+  LLVMBuildCondBr(c->builder, test, post_block, error_block);
+
+  LLVMPositionBuilderAtEnd(c->builder, error_block);
+  gencall_throw(c);
+
+  LLVMPositionBuilderAtEnd(c->builder, post_block);
+  LLVMValueRef base = LLVMBuildLoad(c->builder,
+    LLVMBuildStructGEP(c->builder, array, 3, ""), "");
+  LLVMValueRef ptr = LLVMBuildGEP(c->builder, base, &offset, 1, "");
+  return LLVMBuildBitCast(c->builder, ptr,
+    LLVMPointerType(LLVMVectorType(elem, s->lanes), 0), "");
+}
+
+static void simd_access(compile_t* c, const simd_t* s, LLVMTypeRef type)
+{
+  LLVMTypeRef elem = simd_elem(c, s);
+  LLVMTypeRef params[3];
+  LLVMValueRef fun, result;
+
+  // new create(value: E = 0), which sets every lane.
+  params[0] = type;
+  params[1] = elem;
+  fun = simd_fun(c, s, "create", type, params, 2);
+  result = LLVMBuildInsertElement(c->builder, LLVMGetUndef(type),
+    LLVMGetParam(fun, 1), LLVMConstInt(c->i32, 0, false), "");
+  result = LLVMBuildShuffleVector(c->builder, result, LLVMGetUndef(type),
+    LLVMConstNull(LLVMVectorType(c->i32, s->lanes)), "");
+  LLVMBuildRet(c->builder, result);
+  codegen_finishfun(c);
+
+  // fun apply(i: USize): E
+  params[1] = c->intptr;
+  fun = simd_fun(c, s, "apply", elem, params, 2);
+  result = LLVMBuildExtractElement(c->builder, LLVMGetParam(fun, 0),
+    simd_lane(c, s, LLVMGetParam(fun, 1)), "");
+  LLVMBuildRet(c->builder, result);
+  codegen_finishfun(c);
+
+  // fun insert(i: USize, value: E): T
+  params[2] = elem;
+  fun = simd_fun(c, s, "insert", type, params, 3);
+  result = LLVMBuildInsertElement(c->builder, LLVMGetParam(fun, 0),
+    LLVMGetParam(fun, 2), simd_lane(c, s, LLVMGetParam(fun, 1)), "");
+  LLVMBuildRet(c->builder, result);
+  codegen_finishfun(c);
+
+  // new load(from: Array[E] box, offset: USize = 0) ?
+  params[1] = c->object_ptr;
+  params[2] = c->intptr;
+  fun = simd_fun(c, s, "load", type, params, 3);
+  LLVMValueRef ptr = simd_array_ptr(c, s, LLVMGetParam(fun, 1),
+    LLVMGetParam(fun, 2));
+  result = LLVMBuildLoad(c->builder, ptr, "");
+  LLVMSetAlignment(result, (unsigned)s->elem_size / 8);
+  LLVMBuildRet(c->builder, result);
+  codegen_finishfun(c);
+
+  // fun store(to: Array[E], offset: USize = 0): T ?
+  fun = simd_fun(c, s, "store", type, params, 3);
+  ptr = simd_array_ptr(c, s, LLVMGetParam(fun, 1), LLVMGetParam(fun, 2));
+  result = LLVMBuildStore(c->builder, LLVMGetParam(fun, 0), ptr);
+  LLVMSetAlignment(result, (unsigned)s->elem_size / 8);
+  LLVMBuildRet(c->builder, LLVMGetParam(fun, 0));
+  codegen_finishfun(c);
+}
+
+static void simd_arithmetic(compile_t* c, const simd_t* s, LLVMTypeRef type)
+{
+  LLVMTypeRef params[2];
+  params[0] = type;
+  params[1] = type;
+
+  LLVMValueRef fun, l, r, result;
+
+#define SIMD_BINOP(name, build_int, build_float) \
+  fun = simd_fun(c, s, name, type, params, 2); \
+  l = LLVMGetParam(fun, 0); \
+  r = LLVMGetParam(fun, 1); \
+  result = s->is_float ? build_float(c->builder, l, r, "") : \
+    build_int(c->builder, l, r, ""); \
+  LLVMBuildRet(c->builder, result); \
+  codegen_finishfun(c);
+
+  SIMD_BINOP("add", LLVMBuildAdd, LLVMBuildFAdd);
+  SIMD_BINOP("sub", LLVMBuildSub, LLVMBuildFSub);
+  SIMD_BINOP("mul", LLVMBuildMul, LLVMBuildFMul);
+
+  if(s->is_float)
+  {
+    SIMD_BINOP("div", LLVMBuildFDiv, LLVMBuildFDiv);
+  } else {
+    SIMD_BINOP("op_and", LLVMBuildAnd, LLVMBuildAnd);
+    SIMD_BINOP("op_or", LLVMBuildOr, LLVMBuildOr);
+    SIMD_BINOP("op_xor", LLVMBuildXor, LLVMBuildXor);
+  }
+
+#undef SIMD_BINOP
+
+  // fun neg(): T
+  fun = simd_fun(c, s, "neg", type, params, 1);
+  l = LLVMGetParam(fun, 0);
+  result = s->is_float ? LLVMBuildFNeg(c->builder, l, "") :
+    LLVMBuildNeg(c->builder, l, "");
+  LLVMBuildRet(c->builder, result);
+  codegen_finishfun(c);
+
+  // fun min(y: T): T and fun max(y: T): T
+  LLVMIntPredicate ilt = s->is_signed ? LLVMIntSLT : LLVMIntULT;
+  LLVMIntPredicate igt = s->is_signed ? LLVMIntSGT : LLVMIntUGT;
+
+  fun = simd_fun(c, s, "min", type, params, 2);
+  l = LLVMGetParam(fun, 0);
+  r = LLVMGetParam(fun, 1);
+  result = s->is_float ? LLVMBuildFCmp(c->builder, LLVMRealOLT, l, r, "") :
+    LLVMBuildICmp(c->builder, ilt, l, r, "");
+  LLVMBuildRet(c->builder, LLVMBuildSelect(c->builder, result, l, r, ""));
+  codegen_finishfun(c);
+
+  fun = simd_fun(c, s, "max", type, params, 2);
+  l = LLVMGetParam(fun, 0);
+  r = LLVMGetParam(fun, 1);
+  result = s->is_float ? LLVMBuildFCmp(c->builder, LLVMRealOGT, l, r, "") :
+    LLVMBuildICmp(c->builder, igt, l, r, "");
+  LLVMBuildRet(c->builder, LLVMBuildSelect(c->builder, result, l, r, ""));
+  codegen_finishfun(c);
+}
+
+static void simd_compare(compile_t* c, const simd_t* s, LLVMTypeRef type)
+{
+  // A comparison returns a U32 with bit i set if lane i compares true.
+  LLVMTypeRef bits = LLVMIntTypeInContext(c->context, s->lanes);
+  LLVMTypeRef params[3];
+  params[0] = type;
+  params[1] = type;
+
+  static const char* names[] =
+    {"lanes_eq", "lanes_ne", "lanes_lt", "lanes_le", "lanes_gt", "lanes_ge"};
+  LLVMRealPredicate fp[] =
+    {LLVMRealOEQ, LLVMRealUNE, LLVMRealOLT, LLVMRealOLE, LLVMRealOGT,
+      LLVMRealOGE};
+  LLVMIntPredicate ip[] =
+    {LLVMIntEQ, LLVMIntNE, LLVMIntULT, LLVMIntULE, LLVMIntUGT, LLVMIntUGE};
+  LLVMIntPredicate sp[] =
+    {LLVMIntEQ, LLVMIntNE, LLVMIntSLT, LLVMIntSLE, LLVMIntSGT, LLVMIntSGE};
+
+  for(size_t i = 0; i < (sizeof(names) / sizeof(names[0])); i++)
+  {
+    LLVMValueRef fun = simd_fun(c, s, names[i], c->i32, params, 2);
+    LLVMValueRef l = LLVMGetParam(fun, 0);
+    LLVMValueRef r = LLVMGetParam(fun, 1);
+    LLVMValueRef result;
+
+    if(s->is_float)
+      result = LLVMBuildFCmp(c->builder, fp[i], l, r, "");
+    else if(s->is_signed)
+      result = LLVMBuildICmp(c->builder, sp[i], l, r, "");
+    else
+      result = LLVMBuildICmp(c->builder, ip[i], l, r, "");
+
+    result = LLVMBuildBitCast(c->builder, result, bits, "");
+    result = LLVMBuildZExt(c->builder, result, c->i32, "");
+    LLVMBuildRet(c->builder, result);
+    codegen_finishfun(c);
+  }
+
+  // fun select(mask: U32, that: T): T, taking lane i from this if bit i of
+  // the mask is set and from that otherwise.
+  params[1] = c->i32;
+  params[2] = type;
+  LLVMValueRef fun = simd_fun(c, s, "select", type, params, 3);
+  LLVMValueRef mask = LLVMBuildTrunc(c->builder, LLVMGetParam(fun, 1), bits,
+    "");
+  mask = LLVMBuildBitCast(c->builder, mask,
+    LLVMVectorType(c->i1, s->lanes), "");
+  LLVMBuildRet(c->builder, LLVMBuildSelect(c->builder, mask,
+    LLVMGetParam(fun, 0), LLVMGetParam(fun, 2), ""));
+  codegen_finishfun(c);
+}
+
+static void simd_types(compile_t* c)
+{
+  for(const simd_t* s = simd; s->type_name != NULL; s++)
+  {
+    LLVMTypeRef type = LLVMVectorType(simd_elem(c, s), s->lanes);
+    simd_access(c, s, type);
+    simd_arithmetic(c, s, type);
+    simd_compare(c, s, type);
+  }
+}
+
+LLVMTypeRef genprim_simd_type(compile_t* c, const char* name)
+{
+  for(const simd_t* s = simd; s->type_name != NULL; s++)
+  {
+    if(!strcmp(s->type_name, name))
+      return LLVMVectorType(simd_elem(c, s), s->lanes);
+  }
+
+  return NULL;
+}
+
 void genprim_builtins(compile_t* c)
 {
   number_conversions(c);
   fp_as_bits(c);
+  simd_types(c);
   make_cpuid(c);
   make_rdtscp(c);
 }
@@ -13,6 +13,26 @@ bool genprim_maybe(compile_t* c, gentype_t* g, bool prelim);
 
 void genprim_array_trace(compile_t* c, gentype_t* g);
 
+/**
+ * Returns true if fun_name is a numeric conversion, such as u32, on the
+ * builtin numeric type type_name that is a single instruction.
+ */
+bool genprim_is_conversion(compile_t* c, const char* type_name,
+  const char* fun_name);
+
+/**
+ * Builds a numeric conversion inline. If value is a constant, so is the
+ * result.
+ */
+LLVMValueRef genprim_convert(compile_t* c, const char* type_name,
+  const char* fun_name, LLVMValueRef value);
+
+/**
+ * Returns the LLVM vector type for a builtin SIMD type, such as F32x4, or
+ * NULL if name isn't one.
+ */
+LLVMTypeRef genprim_simd_type(compile_t* c, const char* name);
+
 void genprim_builtins(compile_t* c);
 
 void genprim_reachable_init(compile_t* c, ast_t* program);
@@ -5,6 +5,7 @@
 #include "gencall.h"
 #include "../expr/literal.h"
 #include "../debug/dwarf.h"
+#include "../../libponyrt/mem/pool.h"
 #include <string.h>
 #include <assert.h>
 
@@ -75,6 +76,12 @@ LLVMValueRef gen_fieldptr(compile_t* c, ast_t* ast)
   return make_fieldptr(c, l_value, l_type, right);
 }
 
+LLVMValueRef gen_fieldptr_of(compile_t* c, LLVMValueRef l_value, ast_t* l_type,
+  ast_t* right)
+{
+  return make_fieldptr(c, l_value, l_type, right);
+}
+
 LLVMValueRef gen_fieldload(compile_t* c, ast_t* ast)
 {
   AST_GET_CHILDREN(ast, left, right);
@@ -249,6 +256,13 @@ static LLVMValueRef gen_identity_from_value(compile_t* c, LLVMValueRef value)
       return value;
     }
 
+    case LLVMVectorTypeKind:
+    {
+      // All the vector types are 128 bits.
+      value = LLVMBuildBitCast(c->builder, value, c->i128, "");
+      return gen_identity_from_value(c, value);
+    }
+
     case LLVMStructTypeKind:
     {
       uint32_t count = LLVMCountStructElementTypes(type);
@@ -324,6 +338,13 @@ LLVMValueRef gen_string(compile_t* c, ast_t* ast)
   const char* name = ast_name(ast);
   size_t len = ast_name_len(ast);
 
+  // Literal names are interned, so every use of the same literal shares one
+  // constant String.
+  LLVMValueRef g_inst = codegen_getstring(c, name);
+
+  if(g_inst != NULL)
+    return g_inst;
+
   LLVMValueRef args[4];
   args[0] = LLVMConstInt(c->i32, 0, false);
   args[1] = LLVMConstInt(c->i32, 0, false);
@@ -341,16 +362,30 @@ LLVMValueRef gen_string(compile_t* c, ast_t* ast)
   if(!gentype(c, type, &g))
     return NULL;
 
-  args[0] = g.desc;
-  args[1] = LLVMConstInt(c->intptr, len, false);
-  args[2] = LLVMConstInt(c->intptr, len + 1, false);
-  args[3] = str_ptr;
-
-  LLVMValueRef inst = LLVMConstNamedStruct(g.structure, args, 4);
-  LLVMValueRef g_inst = LLVMAddGlobal(c->module, g.structure, "$string");
+  // Fields after the first four hold the inline data of short strings, which
+  // a literal doesn't use.
+  unsigned count = LLVMCountStructElementTypes(g.structure);
+  size_t buf_size = count * sizeof(void*);
+  LLVMTypeRef* elems = (LLVMTypeRef*)pool_alloc_size(buf_size);
+  LLVMValueRef* fields = (LLVMValueRef*)pool_alloc_size(buf_size);
+  LLVMGetStructElementTypes(g.structure, elems);
+
+  fields[0] = g.desc;
+  fields[1] = LLVMConstInt(c->intptr, len, false);
+  fields[2] = LLVMConstInt(c->intptr, len + 1, false);
+  fields[3] = str_ptr;
+
+  for(unsigned i = 4; i < count; i++)
+    fields[i] = LLVMConstNull(elems[i]);
+
+  LLVMValueRef inst = LLVMConstNamedStruct(g.structure, fields, count);
+  pool_free_size(buf_size, elems);
+  pool_free_size(buf_size, fields);
+  g_inst = LLVMAddGlobal(c->module, g.structure, "$string");
   LLVMSetInitializer(g_inst, inst);
   LLVMSetGlobalConstant(g_inst, true);
   LLVMSetLinkage(g_inst, LLVMInternalLinkage);
 
+  codegen_setstring(c, name, g_inst);
   return g_inst;
 }
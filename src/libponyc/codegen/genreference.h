@@ -12,6 +12,9 @@ LLVMValueRef gen_param(compile_t* c, ast_t* ast);
 
 LLVMValueRef gen_fieldptr(compile_t* c, ast_t* ast);
 
+LLVMValueRef gen_fieldptr_of(compile_t* c, LLVMValueRef l_value, ast_t* l_type,
+  ast_t* right);
+
 LLVMValueRef gen_fieldload(compile_t* c, ast_t* ast);
 
 LLVMValueRef gen_tuple(compile_t* c, ast_t* ast);
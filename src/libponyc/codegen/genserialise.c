@@ -0,0 +1,478 @@
+#include "genserialise.h"
+#include "gencall.h"
+#include "genname.h"
+#include "gentrace.h"
+#include "../pkg/package.h"
+#include "../type/subtype.h"
+#include "../../libponyrt/mem/pool.h"
+#include <string.h>
+#include <assert.h>
+
+static bool is_builtin(compile_t* c, gentype_t* g, const char* name)
+{
+  if(g->underlying != TK_CLASS)
+    return false;
+
+  AST_GET_CHILDREN(g->ast, pkg, id);
+  return (ast_name(pkg) == c->str_builtin) && (ast_name(id) == name);
+}
+
+static LLVMValueRef field_ptr(compile_t* c, gentype_t* g, LLVMValueRef object,
+  int index)
+{
+  // A boxed tuple holds the tuple after its descriptor.
+  if(g->underlying == TK_TUPLETYPE)
+  {
+    LLVMValueRef tuple = LLVMBuildStructGEP(c->builder, object, 1, "");
+    return LLVMBuildStructGEP(c->builder, tuple, index, "");
+  }
+
+  return LLVMBuildStructGEP(c->builder, object, index + 1, "");
+}
+
+static LLVMValueRef copy_offset(compile_t* c, LLVMValueRef base,
+  LLVMValueRef offset, LLVMValueRef ptr)
+{
+  // The copy of ptr is as far into the image from offset as ptr is from base.
+  LLVMValueRef from = LLVMBuildPtrToInt(c->builder, base, c->intptr, "");
+  LLVMValueRef to = LLVMBuildPtrToInt(c->builder, ptr, c->intptr, "");
+  LLVMValueRef delta = LLVMBuildSub(c->builder, to, from, "");
+  return LLVMBuildAdd(c->builder, offset, delta, "");
+}
+
+static bool not_serialisable(compile_t* c, LLVMValueRef ctx)
+{
+  gencall_runtime(c, "pony_serialise_fail", &ctx, 1, "");
+  return true;
+}
+
+static bool is_struct(ast_t* type)
+{
+  ast_t* def = (ast_t*)ast_data(type);
+  return ast_id(def) == TK_STRUCT;
+}
+
+static bool serialise_value(compile_t* c, LLVMValueRef ctx, LLVMValueRef base,
+  LLVMValueRef offset, LLVMValueRef ptr, ast_t* type, token_id key)
+{
+  LLVMValueRef args[3];
+
+  switch(ast_id(type))
+  {
+    case TK_TUPLETYPE:
+    {
+      bool need = false;
+      int i = 0;
+
+      for(ast_t* child = ast_child(type); child != NULL;
+        child = ast_sibling(child))
+      {
+        LLVMValueRef elem = LLVMBuildStructGEP(c->builder, ptr, i++, "");
+        need |= serialise_value(c, ctx, base, offset, elem, child, TK_NONE);
+      }
+
+      return need;
+    }
+
+    case TK_NOMINAL:
+    {
+      if(is_machine_word(type))
+        return false;
+
+      // Raw pointers and structs have no descriptor to copy them with.
+      if(is_pointer(type) || is_maybe(type) || is_struct(type))
+        return not_serialisable(c, ctx);
+
+      if(key == TK_EMBED)
+      {
+        args[0] = ctx;
+        args[1] = LLVMBuildBitCast(c->builder, ptr, c->void_ptr, "");
+        args[2] = copy_offset(c, base, offset, ptr);
+        gencall_runtime(c, "pony_serialise_embed", args, 3, "");
+        return true;
+      }
+      break;
+    }
+
+    default: {}
+  }
+
+  // Replace the pointer in the copy with the offset of the object.
+  LLVMValueRef value = LLVMBuildLoad(c->builder, ptr, "");
+
+  args[0] = ctx;
+  args[1] = LLVMBuildBitCast(c->builder, value, c->void_ptr, "");
+  LLVMValueRef object_offset = gencall_runtime(c, "pony_serialise_offset",
+    args, 2, "");
+
+  args[1] = copy_offset(c, base, offset, ptr);
+  LLVMValueRef copy = gencall_runtime(c, "pony_serialise_addr", args, 2, "");
+  copy = LLVMBuildBitCast(c->builder, copy, LLVMPointerType(c->intptr, 0),
+    "");
+  LLVMBuildStore(c->builder, object_offset, copy);
+  return true;
+}
+
+static bool deserialise_value(compile_t* c, LLVMValueRef ctx, LLVMValueRef ptr,
+  ast_t* type, token_id key)
+{
+  LLVMValueRef args[3];
+
+  switch(ast_id(type))
+  {
+    case TK_TUPLETYPE:
+    {
+      bool need = false;
+      int i = 0;
+
+      for(ast_t* child = ast_child(type); child != NULL;
+        child = ast_sibling(child))
+      {
+        LLVMValueRef elem = LLVMBuildStructGEP(c->builder, ptr, i++, "");
+        need |= deserialise_value(c, ctx, elem, child, TK_NONE);
+      }
+
+      return need;
+    }
+
+    case TK_NOMINAL:
+    {
+      if(is_machine_word(type))
+        return false;
+
+      // Such a value was never serialised, so the image is corrupt.
+      if(is_pointer(type) || is_maybe(type) || is_struct(type))
+        return not_serialisable(c, ctx);
+
+      if(key == TK_EMBED)
+      {
+        gentype_t g;
+
+        if(!gentype(c, type, &g))
+          return false;
+
+        args[0] = ctx;
+        args[1] = LLVMBuildBitCast(c->builder, ptr, c->void_ptr, "");
+        args[2] = LLVMConstBitCast(g.desc, c->descriptor_ptr);
+        gencall_runtime(c, "pony_deserialise_embed", args, 3, "");
+        return true;
+      }
+      break;
+    }
+
+    default: {}
+  }
+
+  // Replace the offset with a pointer to the object.
+  LLVMValueRef slot = LLVMBuildBitCast(c->builder, ptr,
+    LLVMPointerType(c->intptr, 0), "");
+
+  args[0] = ctx;
+  args[1] = LLVMBuildLoad(c->builder, slot, "");
+  LLVMValueRef object = gencall_runtime(c, "pony_deserialise_offset", args, 2,
+    "");
+
+  slot = LLVMBuildBitCast(c->builder, ptr, LLVMPointerType(c->void_ptr, 0),
+    "");
+  LLVMBuildStore(c->builder, object, slot);
+  return true;
+}
+
+static LLVMValueRef loop_start(compile_t* c, LLVMValueRef count,
+  LLVMBasicBlockRef* post_block)
+{
+  LLVMBasicBlockRef entry_block = LLVMGetInsertBlock(c->builder);
+  LLVMBasicBlockRef cond_block = codegen_block(c, "cond");
+  LLVMBasicBlockRef body_block = codegen_block(c, "body");
+  *post_block = codegen_block(c, "post");
+  LLVMBuildBr(c->builder, cond_block);
+
+  // While the index is less than the count, run the body.
+  LLVMPositionBuilderAtEnd(c->builder, cond_block);
+  LLVMValueRef phi = LLVMBuildPhi(c->builder, c->intptr, "");
+  LLVMValueRef zero = LLVMConstInt(c->intptr, 0, false);
+  LLVMAddIncoming(phi, &zero, &entry_block, 1);
+  LLVMValueRef test = LLVMBuildICmp(c->builder, LLVMIntULT, phi, count, "");
+  LLVMBuildCondBr(c->builder, test, body_block, *post_block);
+
+  LLVMPositionBuilderAtEnd(c->builder, body_block);
+  return phi;
+}
+
+static void loop_end(compile_t* c, LLVMValueRef phi,
+  LLVMBasicBlockRef post_block)
+{
+  // Add one to the index and branch back to the cond block.
+  LLVMValueRef one = LLVMConstInt(c->intptr, 1, false);
+  LLVMValueRef inc = LLVMBuildAdd(c->builder, phi, one, "");
+  LLVMBasicBlockRef body_block = LLVMGetInsertBlock(c->builder);
+  LLVMAddIncoming(phi, &inc, &body_block, 1);
+  LLVMBuildBr(c->builder, LLVMGetInstructionParent(phi));
+
+  LLVMPositionBuilderAtEnd(c->builder, post_block);
+}
+
+static void serialise_array(compile_t* c, gentype_t* elem_g, ast_t* elem,
+  LLVMValueRef ctx, LLVMValueRef object, LLVMValueRef offset)
+{
+  size_t size = (size_t)LLVMABISizeOfType(c->target_data, elem_g->use_type);
+
+  // The runtime copies the elements in use.
+  LLVMValueRef args[4];
+  args[0] = ctx;
+  args[1] = LLVMBuildBitCast(c->builder, object, c->void_ptr, "");
+  args[2] = offset;
+  args[3] = LLVMConstInt(c->intptr, size, false);
+  LLVMValueRef block = gencall_runtime(c, "pony_serialise_array", args, 4,
+    "");
+
+  if(!gentrace_needed(elem))
+    return;
+
+  // Then each element that points to anything is fixed up.
+  LLVMValueRef ptr = LLVMBuildStructGEP(c->builder, object, 3, "");
+  ptr = LLVMBuildLoad(c->builder, ptr, "pointer");
+  LLVMValueRef count = LLVMBuildStructGEP(c->builder, object, 1, "");
+  count = LLVMBuildLoad(c->builder, count, "count");
+
+  LLVMBasicBlockRef post_block;
+  LLVMValueRef phi = loop_start(c, count, &post_block);
+  LLVMValueRef elem_ptr = LLVMBuildGEP(c->builder, ptr, &phi, 1, "elem");
+  serialise_value(c, ctx, ptr, block, elem_ptr, elem, TK_NONE);
+  loop_end(c, phi, post_block);
+}
+
+static void deserialise_array(compile_t* c, gentype_t* elem_g, ast_t* elem,
+  LLVMValueRef ctx, LLVMValueRef object)
+{
+  size_t size = (size_t)LLVMABISizeOfType(c->target_data, elem_g->use_type);
+
+  LLVMValueRef args[3];
+  args[0] = ctx;
+  args[1] = LLVMBuildBitCast(c->builder, object, c->void_ptr, "");
+  args[2] = LLVMConstInt(c->intptr, size, false);
+  LLVMValueRef ptr = gencall_runtime(c, "pony_deserialise_array", args, 3,
+    "");
+
+  if(!gentrace_needed(elem))
+    return;
+
+  // The count is read after the runtime has checked it.
+  ptr = LLVMBuildBitCast(c->builder, ptr,
+    LLVMPointerType(elem_g->use_type, 0), "pointer");
+  LLVMValueRef count = LLVMBuildStructGEP(c->builder, object, 1, "");
+  count = LLVMBuildLoad(c->builder, count, "count");
+
+  LLVMBasicBlockRef post_block;
+  LLVMValueRef phi = loop_start(c, count, &post_block);
+  LLVMValueRef elem_ptr = LLVMBuildGEP(c->builder, ptr, &phi, 1, "elem");
+  deserialise_value(c, ctx, elem_ptr, elem, TK_NONE);
+  loop_end(c, phi, post_block);
+}
+
+static void make_serialise(compile_t* c, gentype_t* g, gentype_t* elem_g,
+  ast_t* elem)
+{
+  const char* name = genname_serialise(g->type_name);
+  LLVMValueRef fun = codegen_addfun(c, name, c->serialise_type);
+
+  codegen_startfun(c, fun, false);
+  LLVMSetFunctionCallConv(fun, LLVMCCallConv);
+
+  LLVMValueRef ctx = LLVMGetParam(fun, 0);
+  LLVMValueRef arg = LLVMGetParam(fun, 1);
+  LLVMValueRef offset = LLVMGetParam(fun, 2);
+  LLVMValueRef object = LLVMBuildBitCast(c->builder, arg, g->structure_ptr,
+    "object");
+
+  bool need = true;
+
+  if(elem != NULL)
+  {
+    serialise_array(c, elem_g, elem, ctx, object, offset);
+  } else if(is_builtin(c, g, c->str_String)) {
+    LLVMValueRef args[3];
+    args[0] = ctx;
+    args[1] = LLVMBuildBitCast(c->builder, object, c->void_ptr, "");
+    args[2] = offset;
+    gencall_runtime(c, "pony_serialise_string", args, 3, "");
+  } else {
+    need = false;
+
+    for(int i = 0; i < g->field_count; i++)
+    {
+      LLVMValueRef ptr = field_ptr(c, g, object, i);
+      token_id key = (g->field_keys != NULL) ? g->field_keys[i] : TK_NONE;
+      need |= serialise_value(c, ctx, object, offset, ptr, g->fields[i], key);
+    }
+  }
+
+  LLVMBuildRetVoid(c->builder);
+  codegen_finishfun(c);
+
+  // If there is nothing to fix up, the copy is enough.
+  if(!need)
+    LLVMDeleteFunction(fun);
+}
+
+static void make_deserialise(compile_t* c, gentype_t* g, gentype_t* elem_g,
+  ast_t* elem)
+{
+  const char* name = genname_deserialise(g->type_name);
+  LLVMValueRef fun = codegen_addfun(c, name, c->trace_type);
+
+  codegen_startfun(c, fun, false);
+  LLVMSetFunctionCallConv(fun, LLVMCCallConv);
+
+  LLVMValueRef ctx = LLVMGetParam(fun, 0);
+  LLVMValueRef arg = LLVMGetParam(fun, 1);
+  LLVMValueRef object = LLVMBuildBitCast(c->builder, arg, g->structure_ptr,
+    "object");
+
+  bool need = true;
+
+  if(elem != NULL)
+  {
+    deserialise_array(c, elem_g, elem, ctx, object);
+  } else if(is_builtin(c, g, c->str_String)) {
+    LLVMValueRef args[2];
+    args[0] = ctx;
+    args[1] = LLVMBuildBitCast(c->builder, object, c->void_ptr, "");
+    gencall_runtime(c, "pony_deserialise_string", args, 2, "");
+  } else {
+    need = false;
+
+    for(int i = 0; i < g->field_count; i++)
+    {
+      LLVMValueRef ptr = field_ptr(c, g, object, i);
+      token_id key = (g->field_keys != NULL) ? g->field_keys[i] : TK_NONE;
+      need |= deserialise_value(c, ctx, ptr, g->fields[i], key);
+    }
+  }
+
+  LLVMBuildRetVoid(c->builder);
+  codegen_finishfun(c);
+
+  if(!need)
+    LLVMDeleteFunction(fun);
+}
+
+void genserialise_init(compile_t* c)
+{
+  size_t i = HASHMAP_BEGIN;
+  reachable_type_t* t;
+
+  c->serialise = false;
+
+  while((t = reachable_types_next(c->reachable, &i)) != NULL)
+  {
+    if(ast_id(t->type) == TK_TUPLETYPE)
+      continue;
+
+    ast_t* def = (ast_t*)ast_data(t->type);
+    ast_t* package = ast_nearest(def, TK_PACKAGE);
+
+    if(!strcmp(package_qualified_name(package), "serialise"))
+    {
+      c->serialise = true;
+      return;
+    }
+  }
+}
+
+bool genserialise(compile_t* c, gentype_t* g)
+{
+  if(!c->serialise || (g->field_count == 0))
+    return true;
+
+  switch(g->underlying)
+  {
+    case TK_CLASS:
+    case TK_TUPLETYPE:
+      break;
+
+    default:
+      // Actors, primitives and structs are never copied into an image.
+      return true;
+  }
+
+  gentype_t elem_g;
+  ast_t* elem = NULL;
+
+  // An Array is the only type whose raw pointer can be followed, since it
+  // knows how many elements are behind it.
+  if(is_builtin(c, g, c->str_Array))
+  {
+    elem = ast_child(ast_childidx(g->ast, 2));
+
+    if(!gentype(c, elem, &elem_g))
+      return false;
+  }
+
+  make_serialise(c, g, &elem_g, elem);
+  make_deserialise(c, g, &elem_g, elem);
+  return true;
+}
+
+void genserialise_types(compile_t* c)
+{
+  if(!c->serialise)
+    return;
+
+  uint32_t count = c->next_type_id;
+  size_t buf_size = count * sizeof(LLVMValueRef);
+  LLVMValueRef* types = (LLVMValueRef*)pool_alloc_size(buf_size);
+  LLVMValueRef* instances = (LLVMValueRef*)pool_alloc_size(buf_size);
+
+  for(uint32_t i = 0; i < count; i++)
+  {
+    types[i] = LLVMConstNull(c->descriptor_ptr);
+    instances[i] = LLVMConstNull(c->object_ptr);
+  }
+
+  size_t i = HASHMAP_BEGIN;
+  reachable_type_t* t;
+
+  // Traits and interfaces have no descriptor, and structs aren't generated
+  // with one.
+  while((t = reachable_types_next(c->reachable, &i)) != NULL)
+  {
+    LLVMValueRef desc = LLVMGetNamedGlobal(c->module,
+      genname_descriptor(t->name));
+
+    if((desc == NULL) || (t->type_id >= count))
+      continue;
+
+    types[t->type_id] = LLVMConstBitCast(desc, c->descriptor_ptr);
+
+    LLVMValueRef inst = LLVMGetNamedGlobal(c->module,
+      genname_instance(t->name));
+
+    if(inst != NULL)
+      instances[t->type_id] = LLVMConstBitCast(inst, c->object_ptr);
+  }
+
+  LLVMValueRef type_table = LLVMConstArray(c->descriptor_ptr, types, count);
+  LLVMValueRef type_global = LLVMAddGlobal(c->module,
+    LLVMTypeOf(type_table), "__SerialiseTypes");
+  LLVMSetInitializer(type_global, type_table);
+  LLVMSetGlobalConstant(type_global, true);
+  LLVMSetLinkage(type_global, LLVMInternalLinkage);
+
+  LLVMValueRef inst_table = LLVMConstArray(c->object_ptr, instances, count);
+  LLVMValueRef inst_global = LLVMAddGlobal(c->module,
+    LLVMTypeOf(inst_table), "__SerialiseInstances");
+  LLVMSetInitializer(inst_global, inst_table);
+  LLVMSetGlobalConstant(inst_global, true);
+  LLVMSetLinkage(inst_global, LLVMInternalLinkage);
+
+  pool_free_size(buf_size, types);
+  pool_free_size(buf_size, instances);
+
+  LLVMValueRef args[3];
+  args[0] = LLVMConstBitCast(type_global,
+    LLVMPointerType(c->descriptor_ptr, 0));
+  args[1] = LLVMConstBitCast(inst_global, LLVMPointerType(c->object_ptr, 0));
+  args[2] = LLVMConstInt(c->i32, count, false);
+  gencall_runtime(c, "pony_serialise_types", args, 3, "");
+}
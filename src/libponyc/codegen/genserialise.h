@@ -0,0 +1,31 @@
+#ifndef CODEGEN_GENSERIALISE_H
+#define CODEGEN_GENSERIALISE_H
+
+#include <platform.h>
+#include "codegen.h"
+#include "gentype.h"
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * Notes whether the program uses the serialise package. Call this once
+ * reachability is known and before any types are generated.
+ */
+void genserialise_init(compile_t* c);
+
+/**
+ * Generates the functions that turn the pointers in a serialised copy of an
+ * object of type g into offsets and back again. Nothing is generated unless
+ * the program uses the serialise package, or if there is nothing to fix up.
+ */
+bool genserialise(compile_t* c, gentype_t* g);
+
+/**
+ * Emits a call that gives the runtime the descriptor for each type ID and the
+ * instance of each primitive, if the program uses the serialise package.
+ */
+void genserialise_types(compile_t* c);
+
+PONY_EXTERN_C_END
+
+#endif
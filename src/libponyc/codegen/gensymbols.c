@@ -0,0 +1,213 @@
+#include "gensymbols.h"
+#include "../ast/printbuf.h"
+#include "../ast/stringtab.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+typedef struct symbol_name_t
+{
+  char* mangled;
+  char* readable;
+} symbol_name_t;
+
+static void print_typeargs(printbuf_t* buf, ast_t* typeargs)
+{
+  if((typeargs == NULL) || (ast_id(typeargs) == TK_NONE))
+    return;
+
+  printbuf(buf, "[");
+  ast_t* typearg = ast_child(typeargs);
+
+  while(typearg != NULL)
+  {
+    printbuf(buf, "%s", ast_print_type(typearg));
+    typearg = ast_sibling(typearg);
+
+    if(typearg != NULL)
+      printbuf(buf, ", ");
+  }
+
+  printbuf(buf, "]");
+}
+
+static void print_name(printbuf_t* buf, gentype_t* g, const char* name,
+  ast_t* typeargs)
+{
+  // The capability of the receiver is left out, as it is the same for every
+  // method of a type.
+  if(ast_id(g->ast) == TK_NOMINAL)
+  {
+    AST_GET_CHILDREN(g->ast, pkg, id, type_typeargs);
+    printbuf(buf, "%s", ast_nice_name(id));
+    print_typeargs(buf, type_typeargs);
+  } else {
+    printbuf(buf, "%s", ast_print_type(g->ast));
+  }
+
+  if(name != NULL)
+  {
+    printbuf(buf, ".%s", name);
+    print_typeargs(buf, typeargs);
+  }
+}
+
+void gensymbols_fun(compile_t* c, const char* mangled, gentype_t* g,
+  const char* name, ast_t* typeargs, const char* suffix)
+{
+  printbuf_t* buf = c->symbols;
+
+  if(buf == NULL)
+    return;
+
+  printbuf(buf, "%s\t", mangled);
+  print_name(buf, g, name, typeargs);
+
+  if(suffix != NULL)
+    printbuf(buf, " %s", suffix);
+
+  printbuf(buf, "\n");
+}
+
+const char* gensymbols_name(gentype_t* g, const char* name,
+  ast_t* typeargs)
+{
+  printbuf_t* buf = printbuf_new();
+  print_name(buf, g, name, typeargs);
+  const char* r = stringtab(buf->m);
+  printbuf_free(buf);
+  return r;
+}
+
+bool gensymbols_write(compile_t* c)
+{
+  if(c->symbols == NULL)
+    return true;
+
+  const char* file_sym = suffix_filename(c->opt->output, "", c->filename,
+    ".symbols");
+  FILE* fp = fopen(file_sym, "wb");
+
+  if(fp == NULL)
+  {
+    errorf(NULL, "couldn't write to %s", file_sym);
+    return false;
+  }
+
+  printf("Writing %s\n", file_sym);
+  fwrite(c->symbols->m, 1, c->symbols->offset, fp);
+  fclose(fp);
+  return true;
+}
+
+static int symbol_name_cmp(const void* a, const void* b)
+{
+  return strcmp(((const symbol_name_t*)a)->mangled,
+    ((const symbol_name_t*)b)->mangled);
+}
+
+static symbol_name_t* load_symbols(const char* file, size_t* count)
+{
+  FILE* fp = fopen(file, "rb");
+
+  if(fp == NULL)
+    return NULL;
+
+  size_t size = 64;
+  size_t n = 0;
+  symbol_name_t* symbols = (symbol_name_t*)malloc(size * sizeof(symbol_name_t));
+  char line[4096];
+
+  while(fgets(line, sizeof(line), fp) != NULL)
+  {
+    char* tab = strchr(line, '\t');
+
+    if(tab == NULL)
+      continue;
+
+    *tab = '\0';
+    tab[1 + strcspn(tab + 1, "\r\n")] = '\0';
+
+    if(n == size)
+    {
+      size *= 2;
+      symbols = (symbol_name_t*)realloc(symbols, size * sizeof(symbol_name_t));
+    }
+
+    symbols[n].mangled = strdup(line);
+    symbols[n].readable = strdup(tab + 1);
+    n++;
+  }
+
+  fclose(fp);
+  qsort(symbols, n, sizeof(symbol_name_t), symbol_name_cmp);
+  *count = n;
+  return symbols;
+}
+
+static bool is_symbol_char(int ch)
+{
+  return isalnum(ch) || (ch == '_') || (ch == '$');
+}
+
+bool gensymbols_demangle(const char* file, FILE* in, FILE* out)
+{
+  size_t count = 0;
+  symbol_name_t* symbols = load_symbols(file, &count);
+
+  if(symbols == NULL)
+  {
+    errorf(NULL, "couldn't read %s", file);
+    return false;
+  }
+
+  // Each run of identifier characters is looked up as a whole, so a name is
+  // never replaced in the middle of a longer one.
+  size_t size = 256;
+  char* word = (char*)malloc(size);
+  size_t len = 0;
+  int ch;
+
+  do
+  {
+    ch = fgetc(in);
+
+    if((ch != EOF) && is_symbol_char(ch))
+    {
+      if(len + 1 == size)
+      {
+        size *= 2;
+        word = (char*)realloc(word, size);
+      }
+
+      word[len++] = (char)ch;
+      continue;
+    }
+
+    if(len > 0)
+    {
+      word[len] = '\0';
+
+      symbol_name_t key;
+      key.mangled = word;
+      symbol_name_t* found = (symbol_name_t*)bsearch(&key, symbols, count,
+        sizeof(symbol_name_t), symbol_name_cmp);
+
+      fputs((found != NULL) ? found->readable : word, out);
+      len = 0;
+    }
+
+    if(ch != EOF)
+      fputc(ch, out);
+  } while(ch != EOF);
+
+  for(size_t i = 0; i < count; i++)
+  {
+    free(symbols[i].mangled);
+    free(symbols[i].readable);
+  }
+
+  free(word);
+  free(symbols);
+  return true;
+}
@@ -0,0 +1,37 @@
+#ifndef CODEGEN_GENSYMBOLS_H
+#define CODEGEN_GENSYMBOLS_H
+
+#include <platform.h>
+#include "codegen.h"
+#include "gentype.h"
+#include <stdio.h>
+
+PONY_EXTERN_C_BEGIN
+
+/** Records the readable name of a generated function, as Type[Args].method,
+ * if --symbols was given. The suffix marks a function that isn't the method
+ * body itself, such as the sender of a behaviour. A function that belongs to
+ * the type rather than a method, such as its dispatch, has a NULL name.
+ */
+void gensymbols_fun(compile_t* c, const char* mangled, gentype_t* g,
+  const char* name, ast_t* typeargs, const char* suffix);
+
+/** Returns the readable name of a type, as Type[Args], or of one of its
+ * methods, as Type[Args].method, whether or not --symbols was given.
+ */
+const char* gensymbols_name(gentype_t* g, const char* name,
+  ast_t* typeargs);
+
+/** Writes the recorded names to <output>/<program>.symbols, one line per
+ * function, with the mangled name and the readable name separated by a tab.
+ */
+bool gensymbols_write(compile_t* c);
+
+/** Copies in to out, replacing each mangled name found in the symbols file
+ * with its readable name. Used to filter the output of perf and similar.
+ */
+bool gensymbols_demangle(const char* file, FILE* in, FILE* out);
+
+PONY_EXTERN_C_END
+
+#endif
@@ -3,6 +3,7 @@
 #include "gendesc.h"
 #include "genname.h"
 #include "genprim.h"
+#include "../type/assemble.h"
 #include "../type/cap.h"
 #include "../type/matchtype.h"
 #include "../type/subtype.h"
@@ -359,8 +360,13 @@ static void trace_known(compile_t* c, LLVMValueRef ctx, LLVMValueRef object,
     return;
   }
 
-  // Get the trace function statically.
+  // Get the trace function statically. A pointer-free array uses the runtime
+  // function, which the GC traces without queueing the array.
   const char* fun = genname_trace(g.type_name);
+
+  if(gentrace_leaf_array(c, &g))
+    fun = "pony_trace_leaf_array";
+
   LLVMValueRef trace_fn = LLVMGetNamedFunction(c->module, fun);
 
   // If this type has no trace function, don't try to recurse in the runtime.
@@ -372,7 +378,11 @@ static void trace_known(compile_t* c, LLVMValueRef ctx, LLVMValueRef object,
     args[1] = LLVMBuildBitCast(c->builder, object, c->object_ptr, "");
     args[2] = trace_fn;
 
-    gencall_runtime(c, "pony_traceobject", args, 3, "");
+    // A val is traced without its contents when it is sent or received.
+    if(cap_single(type) == TK_VAL)
+      gencall_runtime(c, "pony_traceimmutable", args, 3, "");
+    else
+      gencall_runtime(c, "pony_traceobject", args, 3, "");
   } else {
     // Cast the object to a void pointer.
     LLVMValueRef args[2];
@@ -382,14 +392,63 @@ static void trace_known(compile_t* c, LLVMValueRef ctx, LLVMValueRef object,
   }
 }
 
-static void trace_unknown(compile_t* c, LLVMValueRef ctx, LLVMValueRef object)
+static void trace_unknown(compile_t* c, LLVMValueRef ctx, LLVMValueRef object,
+  ast_t* type)
 {
   // We're an object.
   LLVMValueRef args[2];
   args[0] = ctx;
   args[1] = object;
 
-  gencall_runtime(c, "pony_traceunknown", args, 2, "");
+  if(cap_single(type) == TK_VAL)
+    gencall_runtime(c, "pony_traceunknownimmutable", args, 2, "");
+  else
+    gencall_runtime(c, "pony_traceunknown", args, 2, "");
+}
+
+// If only one reachable class or actor provides the trait or interface, every
+// object of this type is of that class or actor, and it can be traced without
+// looking up its descriptor in the runtime. Returns false if the object must
+// be traced as unknown.
+static bool trace_sole_subtype(compile_t* c, LLVMValueRef ctx,
+  LLVMValueRef object, ast_t* type)
+{
+  if(ast_id(type) != TK_NOMINAL)
+    return false;
+
+  reachable_type_t* sub = reach_sole_subtype(c->reachable,
+    genname_type(type));
+
+  if(sub == NULL)
+    return false;
+
+  token_id cap = cap_single(type);
+
+  switch(ast_id((ast_t*)ast_data(sub->type)))
+  {
+    case TK_ACTOR:
+      trace_actor(c, ctx, object);
+      return true;
+
+    case TK_CLASS:
+    {
+      if(cap == TK_TAG)
+      {
+        trace_tag(c, ctx, object);
+        return true;
+      }
+
+      // Trace as the class, with the capability of the original type.
+      ast_t* known = set_cap_and_ephemeral(sub->type, cap, TK_NONE);
+      trace_known(c, ctx, object, known);
+      ast_free_unattached(known);
+      return true;
+    }
+
+    default: {}
+  }
+
+  return false;
 }
 
 static bool trace_tuple(compile_t* c, LLVMValueRef ctx, LLVMValueRef value,
@@ -633,6 +692,51 @@ static void trace_dynamic(compile_t* c, LLVMValueRef ctx, LLVMValueRef object,
   }
 }
 
+bool gentrace_needed(ast_t* type)
+{
+  switch(trace_type(type))
+  {
+    case TRACE_NONE:
+      assert(0);
+      return false;
+
+    case TRACE_PRIMITIVE:
+      return false;
+
+    case TRACE_TUPLE:
+    {
+      ast_t* child = ast_child(type);
+
+      while(child != NULL)
+      {
+        if(gentrace_needed(child))
+          return true;
+
+        child = ast_sibling(child);
+      }
+
+      return false;
+    }
+
+    default: {}
+  }
+
+  return true;
+}
+
+bool gentrace_leaf_array(compile_t* c, gentype_t* g)
+{
+  if(g->underlying != TK_CLASS)
+    return false;
+
+  AST_GET_CHILDREN(g->ast, pkg, id, typeargs);
+
+  if((ast_name(pkg) != c->str_builtin) || (ast_name(id) != c->str_Array))
+    return false;
+
+  return !gentrace_needed(ast_child(typeargs));
+}
+
 bool gentrace(compile_t* c, LLVMValueRef ctx, LLVMValueRef value, ast_t* type)
 {
   switch(trace_type(type))
@@ -657,7 +761,8 @@ bool gentrace(compile_t* c, LLVMValueRef ctx, LLVMValueRef value, ast_t* type)
       return true;
 
     case TRACE_UNKNOWN:
-      trace_unknown(c, ctx, value);
+      if(!trace_sole_subtype(c, ctx, value, type))
+        trace_unknown(c, ctx, value, type);
       return true;
 
     case TRACE_TAG:
@@ -665,7 +770,8 @@ bool gentrace(compile_t* c, LLVMValueRef ctx, LLVMValueRef value, ast_t* type)
       return true;
 
     case TRACE_TAG_OR_ACTOR:
-      trace_tag_or_actor(c, ctx, value);
+      if(!trace_sole_subtype(c, ctx, value, type))
+        trace_tag_or_actor(c, ctx, value);
       return true;
 
     case TRACE_DYNAMIC:
@@ -684,3 +790,120 @@ bool gentrace(compile_t* c, LLVMValueRef ctx, LLVMValueRef value, ast_t* type)
   assert(0);
   return false;
 }
+
+void gentrace_writebarrier(compile_t* c, LLVMValueRef ctx, LLVMValueRef object,
+  ast_t* type)
+{
+  if(ast_id(type) == TK_ARROW)
+    type = ast_childidx(type, 1);
+
+  assert(ast_id(type) == TK_NOMINAL);
+
+  // An actor is traced by every gc pass.
+  if(ast_id((ast_t*)ast_data(type)) == TK_ACTOR)
+    return;
+
+  gentype_t g;
+
+  if(!gentype(c, type, &g))
+  {
+    assert(0);
+    return;
+  }
+
+  // If this type has no trace function, none of its fields are traced.
+  const char* fun = genname_trace(g.type_name);
+  LLVMValueRef trace_fn = LLVMGetNamedFunction(c->module, fun);
+
+  if(trace_fn == NULL)
+    return;
+
+  LLVMValueRef args[3];
+  args[0] = ctx;
+  args[1] = LLVMBuildBitCast(c->builder, object, c->object_ptr, "");
+  args[2] = trace_fn;
+  gencall_runtime(c, "pony_writebarrier", args, 3, "");
+}
+
+void gentrace_valuebarrier(compile_t* c, LLVMValueRef ctx, LLVMValueRef ptr,
+  LLVMValueRef value, ast_t* type)
+{
+  LLVMValueRef args[4];
+  args[0] = ctx;
+  args[1] = LLVMBuildBitCast(c->builder, ptr, c->void_ptr, "");
+
+  switch(trace_type(type))
+  {
+    case TRACE_NONE:
+      assert(0);
+      return;
+
+    case TRACE_PRIMITIVE:
+    case TRACE_ACTOR:
+      // Neither is collected by a minor gc pass.
+      return;
+
+    case TRACE_MAYBE:
+    {
+      // The runtime ignores a NULL value.
+      ast_t* type_args = ast_childidx(type, 2);
+      gentrace_valuebarrier(c, ctx, ptr, value, ast_child(type_args));
+      return;
+    }
+
+    case TRACE_KNOWN:
+    {
+      gentype_t g;
+
+      if(!gentype(c, type, &g))
+      {
+        assert(0);
+        return;
+      }
+
+      const char* fun = genname_trace(g.type_name);
+      LLVMValueRef trace_fn = LLVMGetNamedFunction(c->module, fun);
+
+      if(trace_fn == NULL)
+        trace_fn = LLVMConstNull(c->trace_fn);
+
+      args[2] = LLVMBuildBitCast(c->builder, value, c->void_ptr, "");
+      args[3] = trace_fn;
+      gencall_runtime(c, "pony_writebarrier_value", args, 4, "");
+      return;
+    }
+
+    case TRACE_TAG:
+    case TRACE_TAG_OR_ACTOR:
+      // Keep the object without tracing its contents.
+      args[2] = LLVMBuildBitCast(c->builder, value, c->void_ptr, "");
+      args[3] = LLVMConstNull(c->trace_fn);
+      gencall_runtime(c, "pony_writebarrier_value", args, 4, "");
+      return;
+
+    case TRACE_UNKNOWN:
+    case TRACE_DYNAMIC:
+      // Trace the object with the trace function from its descriptor.
+      args[2] = LLVMBuildBitCast(c->builder, value, c->void_ptr, "");
+      gencall_runtime(c, "pony_writebarrier_unknown", args, 3, "");
+      return;
+
+    case TRACE_TUPLE:
+    {
+      int i = 0;
+
+      for(ast_t* child = ast_child(type);
+        child != NULL;
+        child = ast_sibling(child))
+      {
+        LLVMValueRef elem = LLVMBuildExtractValue(c->builder, value, i, "");
+        gentrace_valuebarrier(c, ctx, ptr, elem, child);
+        i++;
+      }
+
+      return;
+    }
+  }
+
+  assert(0);
+}
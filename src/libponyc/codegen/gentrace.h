@@ -7,8 +7,30 @@
 
 PONY_EXTERN_C_BEGIN
 
+bool gentrace_needed(ast_t* type);
+
+/**
+ * Returns true if g is an Array whose elements are never traced. The runtime
+ * traces such an array with pony_trace_leaf_array.
+ */
+bool gentrace_leaf_array(compile_t* c, gentype_t* g);
+
 bool gentrace(compile_t* c, LLVMValueRef ctx, LLVMValueRef value, ast_t* type);
 
+/**
+ * Emits a write barrier after a field of object, which has the given type, has
+ * been written to.
+ */
+void gentrace_writebarrier(compile_t* c, LLVMValueRef ctx, LLVMValueRef object,
+  ast_t* type);
+
+/**
+ * Emits a write barrier after value, which has the given type, has been
+ * stored at ptr, which isn't traced from an object of its own.
+ */
+void gentrace_valuebarrier(compile_t* c, LLVMValueRef ctx, LLVMValueRef ptr,
+  LLVMValueRef value, ast_t* type);
+
 PONY_EXTERN_C_END
 
 #endif
@@ -3,7 +3,9 @@
 #include "gendesc.h"
 #include "genprim.h"
 #include "gentrace.h"
+#include "genserialise.h"
 #include "genfun.h"
+#include "gensymbols.h"
 #include "../pkg/package.h"
 #include "../type/reify.h"
 #include "../type/subtype.h"
@@ -165,6 +167,8 @@ static bool setup_name(compile_t* c, ast_t* ast, gentype_t* g, bool prelim)
         return genprim_maybe(c, g, prelim);
       else if(name == c->str_Platform)
         return true;
+      else
+        g->primitive = genprim_simd_type(c, name);
     }
   } else {
     g->underlying = TK_TUPLETYPE;
@@ -321,6 +325,7 @@ static void make_dispatch(compile_t* c, gentype_t* g)
   // Create a dispatch function.
   const char* dispatch_name = genname_dispatch(g->type_name);
   g->dispatch_fn = codegen_addfun(c, dispatch_name, c->dispatch_type);
+  gensymbols_fun(c, dispatch_name, g, NULL, NULL, "(dispatch)");
   LLVMSetFunctionCallConv(g->dispatch_fn, LLVMCCallConv);
   codegen_startfun(c, g->dispatch_fn, false);
 
@@ -332,8 +337,12 @@ static void make_dispatch(compile_t* c, gentype_t* g)
   LLVMValueRef id = LLVMBuildLoad(c->builder, id_ptr, "id");
 
   // Store a reference to the dispatch switch. When we build behaviours, we
-  // will add cases to this switch statement based on message ID.
-  g->dispatch_switch = LLVMBuildSwitch(c->builder, id, unreachable, 0);
+  // will add cases to this switch statement based on message ID. The IDs run
+  // from 0 for each actor, and any other ID is unreachable, so the switch
+  // becomes a single jump through a table.
+  reachable_type_t* t = reach_type(c->reachable, g->type_name);
+  unsigned count = (t != NULL) ? t->msg_count : 0;
+  g->dispatch_switch = LLVMBuildSwitch(c->builder, id, unreachable, count);
 
   // Mark the default case as unreachable.
   LLVMPositionBuilderAtEnd(c->builder, unreachable);
@@ -398,6 +407,7 @@ static bool make_trace(compile_t* c, gentype_t* g)
   // Create a trace function.
   const char* trace_name = genname_trace(g->type_name);
   LLVMValueRef trace_fn = codegen_addfun(c, trace_name, c->trace_type);
+  gensymbols_fun(c, trace_name, g, NULL, NULL, "(trace)");
 
   codegen_startfun(c, trace_fn, false);
   LLVMSetFunctionCallConv(trace_fn, LLVMCCallConv);
@@ -552,7 +562,8 @@ static bool make_nominal(compile_t* c, ast_t* ast, gentype_t* g, bool prelim)
     bool ok = make_struct(c, g);
 
     if(!g->done)
-      ok = ok && make_trace(c, g) && make_components(c, g);
+      ok = ok && make_trace(c, g) && make_components(c, g) &&
+        genserialise(c, g);
 
     if(!ok)
     {
@@ -615,7 +626,8 @@ static bool make_tuple(compile_t* c, ast_t* ast, gentype_t* g)
 
   dwarf_forward(&c->dwarf, g);
 
-  bool ok = make_struct(c, g) && make_components(c, g);
+  bool ok = make_struct(c, g) && make_components(c, g) &&
+    genserialise(c, g);
 
   // Finalise debug symbols for tuple type.
   dwarf_composite(&c->dwarf, g);
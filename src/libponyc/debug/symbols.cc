@@ -71,6 +71,11 @@ struct symbols_t
   IRBuilderBase* ir;
   DICompileUnit unit;
 
+  // Source file names are interned, and consecutive symbols nearly always
+  // come from the same file, so the last file made is kept.
+  const char* last_path;
+  DIFile last_file;
+
   bool release;
 
   debug_frame_t* frame;
@@ -115,10 +120,15 @@ static debug_sym_t* get_entry(symbols_t* symbols, const char* name)
 
 static DIFile get_file(symbols_t* symbols, const char* fullpath)
 {
+  if(fullpath == symbols->last_path)
+    return symbols->last_file;
+
   StringRef name = sys::path::filename(fullpath);
   StringRef path = sys::path::parent_path(fullpath);
 
-  return symbols->builder->createFile(name, path);
+  symbols->last_path = fullpath;
+  symbols->last_file = symbols->builder->createFile(name, path);
+  return symbols->last_file;
 }
 
 void symbols_init(symbols_t** symbols, LLVMBuilderRef builder,
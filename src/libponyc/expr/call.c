@@ -739,6 +739,186 @@ static bool partial_application(pass_opt_t* opt, ast_t** astp)
   return ast_passes_subtree(astp, opt, PASS_EXPR);
 }
 
+static bool is_string_operand(ast_t* ast, ast_t* string_val)
+{
+  ast_t* type = ast_type(ast);
+
+  if(is_typecheck_error(type))
+    return false;
+
+  // Only val operands are chained. A String ref operand could be changed by
+  // a later operand before it is copied into the result.
+  ast_t* a_type = alias(type);
+  bool ok = is_subtype(a_type, string_val, NULL);
+  ast_free_unattached(a_type);
+  return ok;
+}
+
+static bool is_string_add(ast_t* ast, ast_t* string_val)
+{
+  if(ast_id(ast) != TK_CALL)
+    return false;
+
+  AST_GET_CHILDREN(ast, positional, namedargs, lhs);
+
+  if((ast_id(lhs) != TK_FUNREF) || (ast_id(namedargs) != TK_NONE) ||
+    (ast_childcount(positional) != 1))
+    return false;
+
+  AST_GET_CHILDREN(lhs, receiver, method);
+
+  return (ast_name(method) == stringtab("add")) &&
+    is_string_operand(receiver, string_val) &&
+    is_string_operand(ast_child(positional), string_val);
+}
+
+static void string_chain_operand(typecheck_t* t, ast_t* operand, ast_t* seq,
+  ast_t** sizes, ast_t** result)
+{
+  // `let $1: String val = operand`
+  const char* name = package_hygienic_id(t);
+
+  BUILD(local, operand,
+    NODE(TK_ASSIGN, AST_NODEBUG
+      TREE(operand)
+      NODE(TK_LET, ID(name)
+        NODE(TK_NOMINAL, NONE ID("String") NONE NODE(TK_VAL) NONE))));
+
+  ast_append(seq, local);
+
+  // `$1.size()`
+  BUILD(size, operand,
+    NODE(TK_CALL,
+      NONE
+      NONE
+      NODE(TK_DOT, NODE(TK_REFERENCE, ID(name)) ID("size"))));
+
+  if(*sizes == NULL)
+  {
+    *sizes = size;
+  } else {
+    BUILD(sum, operand, NODE(TK_PLUS, TREE(*sizes) TREE(size)));
+    *sizes = sum;
+  }
+
+  // `result.concat($1)`
+  BUILD(concat, operand,
+    NODE(TK_CALL,
+      NODE(TK_POSITIONALARGS, NODE(TK_SEQ, NODE(TK_REFERENCE, ID(name))))
+      NONE
+      NODE(TK_DOT, TREE(*result) ID("concat"))));
+
+  *result = concat;
+}
+
+static void string_chain_operands(typecheck_t* t, ast_t* ast,
+  ast_t* string_val, ast_t* seq, ast_t** sizes, ast_t** result)
+{
+  AST_GET_CHILDREN(ast, positional, namedargs, lhs);
+  AST_GET_CHILDREN(lhs, receiver, method);
+
+  if(is_string_add(receiver, string_val))
+    string_chain_operands(t, receiver, string_val, seq, sizes, result);
+  else
+    string_chain_operand(t, receiver, seq, sizes, result);
+
+  string_chain_operand(t, ast_child(positional), seq, sizes, result);
+}
+
+static bool string_chain(pass_opt_t* opt, ast_t** astp)
+{
+  /* A chain of String.add, such as `a + ": " + b`, would copy the string
+   * built so far at each step. It is converted to:
+   * ```pony
+   * let $1: String val = a
+   * let $2: String val = ": "
+   * let $3: String val = b
+   * let $4 = $1.size() + $2.size() + $3.size()
+   * let $5: String = (recover String.create($4) end)
+   *   .concat($1).concat($2).concat($3)
+   * $5
+   * ```
+   * Every operand must be val, so that evaluating one operand can't change
+   * another that has already been evaluated.
+   */
+  ast_t* ast = *astp;
+  typecheck_t* t = &opt->check;
+  AST_GET_CHILDREN(ast, positional, namedargs, lhs);
+  AST_GET_CHILDREN(lhs, receiver, method);
+
+  // Look no further at calls that can't end a chain.
+  if((ast_name(method) != stringtab("add")) || (ast_id(receiver) != TK_CALL))
+    return true;
+
+  // Locals can't be declared in a default argument or a pattern.
+  if((t->frame->method_body == NULL) || (t->frame->def_arg != NULL) ||
+    (t->frame->pattern != NULL))
+    return true;
+
+  // A longer chain is converted at its last call.
+  ast_t* parent = ast_parent(ast);
+
+  if((ast_id(parent) == TK_DOT) &&
+    (ast_name(ast_sibling(ast)) == stringtab("add")))
+    return true;
+
+  ast_t* string_type = type_builtin(opt, ast, "String");
+  ast_t* string_val = set_cap_and_ephemeral(string_type, TK_VAL, TK_NONE);
+  ast_free_unattached(string_type);
+
+  // A single add already allocates only once.
+  size_t count = 0;
+
+  for(ast_t* p = ast; is_string_add(p, string_val);
+    p = ast_child(ast_childidx(p, 2)))
+    count++;
+
+  if(count < 2)
+  {
+    ast_free_unattached(string_val);
+    return true;
+  }
+
+  const char* len_name = package_hygienic_id(t);
+  const char* result_name = package_hygienic_id(t);
+  ast_t* sizes = NULL;
+
+  BUILD(result, ast,
+    NODE(TK_RECOVER,
+      NONE
+      NODE(TK_SEQ, AST_SCOPE
+        NODE(TK_CALL,
+          NODE(TK_POSITIONALARGS,
+            NODE(TK_SEQ, NODE(TK_REFERENCE, ID(len_name))))
+          NONE
+          NODE(TK_DOT, NODE(TK_REFERENCE, ID("String")) ID("create"))))));
+
+  BUILD(replace, ast, NODE(TK_SEQ, AST_SCOPE));
+  string_chain_operands(t, ast, string_val, replace, &sizes, &result);
+  ast_free_unattached(string_val);
+
+  BUILD(len, ast,
+    NODE(TK_ASSIGN, AST_NODEBUG
+      TREE(sizes)
+      NODE(TK_LET, ID(len_name) NONE)));
+
+  BUILD(assign, ast,
+    NODE(TK_ASSIGN, AST_NODEBUG
+      TREE(result)
+      NODE(TK_LET, ID(result_name)
+        NODE(TK_NOMINAL, NONE ID("String") NONE NONE NONE))));
+
+  BUILD(value, ast, NODE(TK_REFERENCE, ID(result_name)));
+
+  ast_append(replace, len);
+  ast_append(replace, assign);
+  ast_append(replace, value);
+  ast_replace(astp, replace);
+
+  // Catch up to this pass.
+  return ast_passes_subtree(astp, opt, PASS_EXPR);
+}
+
 bool expr_call(pass_opt_t* opt, ast_t** astp)
 {
   ast_t* ast = *astp;
@@ -760,9 +940,14 @@ bool expr_call(pass_opt_t* opt, ast_t** astp)
     case TK_NEWREF:
     case TK_NEWBEREF:
     case TK_BEREF:
-    case TK_FUNREF:
       return method_call(opt, ast);
 
+    case TK_FUNREF:
+      if(!method_call(opt, ast))
+        return false;
+
+      return string_chain(opt, astp);
+
     case TK_NEWAPP:
     case TK_BEAPP:
     case TK_FUNAPP:
@@ -11,13 +11,21 @@
 #include "expr.h"
 #include "finalisers.h"
 #include "docgen.h"
+#include "../pkg/cache.h"
+#include "../type/intern.h"
+#include "../type/subtype.h"
 #include "../codegen/codegen.h"
 #include "../../libponyrt/mem/pool.h"
+#include "../../libponyrt/lang/clock.h"
 
 #include <string.h>
 #include <stdbool.h>
 #include <assert.h>
 
+#ifndef PLATFORM_IS_WINDOWS
+#  include <sys/resource.h>
+#endif
+
 
 bool limit_passes(pass_opt_t* opt, const char* pass)
 {
@@ -87,10 +95,71 @@ void pass_opt_init(pass_opt_t* options)
   // Start with an empty typechecker frame.
   memset(options, 0, sizeof(pass_opt_t));
   options->limit = PASS_ALL;
+  options->stats_current = PASS_ALL;
   frame_push(&options->check, NULL);
 }
 
 
+static const char* stats_name(int phase)
+{
+  switch(phase)
+  {
+    case STATS_REACH: return "reach";
+    case STATS_PAINT: return "paint";
+    case STATS_OPT: return "opt";
+    case STATS_LINK: return "link";
+    default: return pass_name((pass_id)phase);
+  }
+}
+
+
+// The peak resident set size of the process so far, in bytes, or 0 where it
+// isn't available.
+static size_t stats_peak_memory()
+{
+#ifdef PLATFORM_IS_WINDOWS
+  return 0;
+#else
+  struct rusage usage;
+
+  if(getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+
+#  ifdef PLATFORM_IS_MACOSX
+  return (size_t)usage.ru_maxrss;
+#  else
+  return (size_t)usage.ru_maxrss * 1024;
+#  endif
+#endif
+}
+
+
+int stats_phase(pass_opt_t* options, int phase)
+{
+  int prev = options->stats_current;
+
+  if(!options->print_stats || (phase == prev))
+    return prev;
+
+  uint64_t now = os_clock_nanos();
+
+  if(prev != PASS_ALL)
+  {
+    options->stats_time[prev] += now - options->stats_mark;
+    options->stats_peak[prev] = stats_peak_memory();
+  }
+
+  size_t nodes = ast_count();
+
+  if(nodes > options->check.stats.ast_peak)
+    options->check.stats.ast_peak = nodes;
+
+  options->stats_current = phase;
+  options->stats_mark = now;
+  return prev;
+}
+
+
 void pass_opt_done(pass_opt_t* options)
 {
   // Pop all the typechecker frames.
@@ -99,18 +168,59 @@ void pass_opt_done(pass_opt_t* options)
 
   if(options->print_stats)
   {
+    stats_phase(options, PASS_ALL);
+
     printf(
       "\nStats:"
       "\n  Names: " __zu
       "\n  Default caps: " __zu
       "\n  Heap alloc: " __zu
       "\n  Stack alloc: " __zu
+      "\n  Region alloc: " __zu
+      "\n  Local errors: " __zu
+      "\n  Subtype memo hits: " __zu
+      "\n  Subtype memo misses: " __zu
+      "\n  Subtype checks in expr: " __zu
+      "\n  Peak AST nodes: " __zu
+      "\n  Reachable types: " __zu
+      "\n  Reachable methods: " __zu
       "\n",
       options->check.stats.names_count,
       options->check.stats.default_caps_count,
       options->check.stats.heap_alloc,
-      options->check.stats.stack_alloc
+      options->check.stats.stack_alloc,
+      options->check.stats.region_alloc,
+      options->check.stats.local_error,
+      options->check.stats.subtype_hits,
+      options->check.stats.subtype_misses,
+      options->check.stats.subtype_checks,
+      options->check.stats.ast_peak,
+      options->check.stats.reach_types,
+      options->check.stats.reach_methods
       );
+
+    // Phases are listed in the order they run, skipping any that didn't.
+    static const int order[] =
+    {
+      PASS_PARSE, PASS_SUGAR, PASS_SCOPE, PASS_IMPORT, PASS_NAME_RESOLUTION,
+      PASS_FLATTEN, PASS_TRAITS, PASS_EXPR, PASS_FINALISER, STATS_REACH,
+      STATS_PAINT, PASS_LLVM_IR, STATS_OPT, PASS_OBJ, STATS_LINK
+    };
+
+    printf("\nPhases (ms, peak MB):\n");
+
+    for(size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++)
+    {
+      int phase = order[i];
+
+      if((options->stats_time[phase] == 0) &&
+        (options->stats_peak[phase] == 0))
+        continue;
+
+      printf("  %-8s %10.2f %10.1f\n", stats_name(phase),
+        (double)options->stats_time[phase] / 1e6,
+        (double)options->stats_peak[phase] / (1024.0 * 1024.0));
+    }
   }
 }
 
@@ -153,7 +263,11 @@ static bool visit_pass(ast_t** astp, pass_opt_t* options, pass_id last_pass,
   //printf("Pass %s (last %s) on %s\n", pass_name(pass), pass_name(last_pass),
   //  ast_get_print(*astp));
 
-  if(ast_visit(astp, pre_fn, post_fn, options, pass) != AST_OK)
+  int prev = stats_phase(options, pass);
+  bool ok = ast_visit(astp, pre_fn, post_fn, options, pass) == AST_OK;
+  stats_phase(options, prev);
+
+  if(!ok)
   {
     *out_r = false;
     return false;
@@ -198,6 +312,16 @@ static bool ast_passes(ast_t** astp, pass_opt_t* options, pass_id last)
   if(!visit_pass(astp, options, last, &r, PASS_IMPORT, pass_import, NULL))
     return r;
 
+  // Every package has been loaded, so an executable that is already in the
+  // cache only needs linking.
+  if((ast_id(*astp) == TK_PROGRAM) && (options->cache_dir != NULL) &&
+    !options->library && !options->docs && (options->limit == PASS_ALL) &&
+    cache_lookup(*astp, options))
+  {
+    options->cache_hit = true;
+    return true;
+  }
+
   if(!visit_pass(astp, options, last, &r, PASS_NAME_RESOLUTION, NULL,
     pass_names))
     return r;
@@ -214,13 +338,37 @@ static bool ast_passes(ast_t** astp, pass_opt_t* options, pass_id last)
   if(options->docs && ast_id(*astp) == TK_PROGRAM)
     generate_docs(*astp, options);
 
-  if(!visit_pass(astp, options, last, &r, PASS_EXPR, pass_pre_expr, pass_expr))
+  // Every entity has been through the traits pass, so types can be interned
+  // and subtype checks on the whole program remembered until the expr pass
+  // is over.
+  bool program = ast_id(*astp) == TK_PROGRAM;
+
+  if(program)
+  {
+    type_intern_start();
+    subtype_memo_start();
+  }
+
+  bool expr = visit_pass(astp, options, last, &r, PASS_EXPR, pass_pre_expr,
+    pass_expr);
+
+  if(program)
+  {
+    subtype_memo_stop(&options->check.stats);
+    type_intern_stop();
+  }
+
+  if(!expr)
     return r;
 
   if(!check_limit(astp, options, PASS_FINALISER, last))
     return true;
 
-  if(!pass_finalisers(*astp))
+  int prev = stats_phase(options, PASS_FINALISER);
+  bool ok = pass_finalisers(*astp);
+  stats_phase(options, prev);
+
+  if(!ok)
     return false;
 
   check_tree(*astp);
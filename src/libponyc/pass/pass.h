@@ -165,6 +165,18 @@ typedef enum pass_id
   PASS_ALL
 } pass_id;
 
+/** Phases timed by --stats that aren't passes. The passes are timed as
+ * themselves, and PASS_ALL means nothing is being timed.
+ */
+typedef enum
+{
+  STATS_REACH = PASS_ALL + 1,
+  STATS_PAINT,
+  STATS_OPT,
+  STATS_LINK,
+  STATS_PHASES
+} stats_phase_t;
+
 /** Pass options.
  */
 typedef struct pass_opt_t
@@ -177,9 +189,23 @@ typedef struct pass_opt_t
   bool print_stats;
   bool verify;
   bool strip_debug;
+  bool runtime_bc;
+  bool frame_pointers;
+  bool symbol_map;
   bool print_filenames;
   bool docs;
+  int jobs;
   const char* output;
+  const char* pgo_use;
+  const char* dispatch;
+  const char* cache_dir;
+  const char* cache_file;
+  bool cache_hit;
+
+  int stats_current;
+  uint64_t stats_mark;
+  uint64_t stats_time[STATS_PHASES];
+  size_t stats_peak[STATS_PHASES];
 
   char* triple;
   char* cpu;
@@ -215,6 +241,13 @@ void pass_opt_init(pass_opt_t* options);
  */
 void pass_opt_done(pass_opt_t* options);
 
+/** Charge the time since the last switch to the current phase and start
+ * timing the given one, which is a pass_id or a stats_phase_t. Returns the
+ * phase that was being timed, so that a nested phase can switch back. Does
+ * nothing unless stats are being printed.
+ */
+int stats_phase(pass_opt_t* options, int phase);
+
 /** Apply the per module passes to the given source.
  * Returns true on success, false on failure.
  * The given source is attached to the resulting AST on success and closed on
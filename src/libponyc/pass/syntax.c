@@ -245,6 +245,27 @@ static bool check_method(ast_t* ast, int method_def_index)
     }
   }
 
+  // The only annotation is coalesce, which lets the runtime drop a send while
+  // the same behaviour is still waiting. A dropped message is never received,
+  // so the behaviour can't take parameters.
+  ast_t* annotation = ast_childidx(ast, 9);
+
+  if((annotation != NULL) && (ast_id(annotation) == TK_ID))
+  {
+    if(ast_name(annotation) != stringtab("coalesce"))
+    {
+      ast_error(annotation,
+        "unknown method annotation, only coalesce is allowed");
+      r = false;
+    } else if(ast_id(ast) != TK_BE) {
+      ast_error(annotation, "only behaviours can coalesce");
+      r = false;
+    } else if(ast_id(params) != TK_NONE) {
+      ast_error(annotation, "a coalescing behaviour can't take parameters");
+      r = false;
+    }
+  }
+
   return r;
 }
 
@@ -490,6 +511,20 @@ static ast_result_t syntax_ffi(ast_t* ast, bool return_optional)
     r = AST_ERROR;
   }
 
+  if(ast_id(ast) == TK_FFIDECL)
+  {
+    // The only annotation is blocking, which lets the scheduler thread hand
+    // over its queue for the duration of the call.
+    ast_t* annotation = ast_childidx(ast, 5);
+
+    if((annotation != NULL) &&
+      (ast_name(annotation) != stringtab("blocking")))
+    {
+      ast_error(annotation, "unknown FFI annotation, only blocking is allowed");
+      r = AST_ERROR;
+    }
+  }
+
   return r;
 }
 
@@ -539,3 +539,22 @@ bool is_build_flag_defined(const char* name)
 
   return f2 != NULL;
 }
+
+
+uint64_t build_flags_hash()
+{
+  uint64_t h = 0;
+
+  if(_user_flags == NULL)
+    return h;
+
+  size_t i = HASHMAP_BEGIN;
+  flag_t* flag;
+
+  // Flags are combined with xor, so the order they were defined in doesn't
+  // matter.
+  while((flag = flagtab_next(_user_flags, &i)) != NULL)
+    h ^= hash_block_fast(flag->name, strlen(flag->name));
+
+  return h;
+}
@@ -86,6 +86,9 @@ bool define_build_flag(const char* name);
 // Report whether the given user build flag is defined.
 bool is_build_flag_defined(const char* name);
 
+// Hash the set of defined user build flags.
+uint64_t build_flags_hash();
+
 PONY_EXTERN_C_END
 
 #endif
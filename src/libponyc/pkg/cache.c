@@ -0,0 +1,135 @@
+#include "cache.h"
+#include "buildflagset.h"
+#include "package.h"
+#include "../ast/source.h"
+#include "../ast/stringtab.h"
+#include "../../libponyrt/ds/hash.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef PONY_VERSION
+#  define PONY_VERSION "unknown"
+#endif
+
+static uint64_t hash_add(uint64_t h, const void* p, size_t len)
+{
+  uint64_t parts[2] = {h, hash_block_fast(p, len)};
+  return hash_block_fast(parts, sizeof(parts));
+}
+
+static uint64_t hash_add_str(uint64_t h, const char* s)
+{
+  if(s == NULL)
+    s = "";
+
+  // Include the terminator, so that adjacent strings can't run together.
+  return hash_add(h, s, strlen(s) + 1);
+}
+
+static uint64_t hash_options(pass_opt_t* opt)
+{
+  // The build time stands in for the compiler's own source, so a rebuilt
+  // compiler never uses an object made by an older one.
+  uint64_t h = hash_add_str(0, PONY_VERSION " " __DATE__ " " __TIME__);
+
+  uint8_t flags[7] =
+  {
+    opt->release, opt->library, opt->ieee_math, opt->strip_debug,
+    opt->runtime_bc, opt->frame_pointers, opt->symbol_map
+  };
+
+  h = hash_add(h, flags, sizeof(flags));
+  h = hash_add_str(h, opt->triple);
+  h = hash_add_str(h, opt->cpu);
+  h = hash_add_str(h, opt->features);
+  h = hash_add_str(h, opt->pgo_use);
+  h = hash_add_str(h, opt->dispatch);
+
+  uint64_t user_flags = build_flags_hash();
+  return hash_add(h, &user_flags, sizeof(user_flags));
+}
+
+static uint64_t hash_sources(uint64_t h, ast_t* program)
+{
+  ast_t* package = ast_child(program);
+
+  while(package != NULL)
+  {
+    h = hash_add_str(h, package_path(package));
+    ast_t* module = ast_child(package);
+
+    while(module != NULL)
+    {
+      source_t* source = (source_t*)ast_data(module);
+      h = hash_add_str(h, source->file);
+      h = hash_add(h, source->m, source->len);
+      module = ast_sibling(module);
+    }
+
+    package = ast_sibling(package);
+  }
+
+  return h;
+}
+
+bool cache_lookup(ast_t* program, pass_opt_t* opt)
+{
+  uint64_t h = hash_sources(hash_options(opt), program);
+
+  char name[FILENAME_MAX];
+  snprintf(name, sizeof(name), "%s/%016" PRIx64 ".o", opt->cache_dir, h);
+  opt->cache_file = stringtab(name);
+
+  FILE* fp = fopen(opt->cache_file, "rb");
+
+  if(fp == NULL)
+    return false;
+
+  fclose(fp);
+  printf("Using cached %s\n", opt->cache_file);
+  return true;
+}
+
+void cache_store(pass_opt_t* opt, const char* file_o)
+{
+  FILE* in = fopen(file_o, "rb");
+
+  if(in == NULL)
+    return;
+
+  pony_mkdir(opt->cache_dir);
+
+  // Write to a temporary name and rename it into place, so a compiler
+  // running at the same time never links half an object file.
+  char tmp[FILENAME_MAX];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", opt->cache_file);
+  FILE* out = fopen(tmp, "wb");
+
+  if(out == NULL)
+  {
+    fclose(in);
+    return;
+  }
+
+  char buf[65536];
+  size_t n;
+  bool ok = true;
+
+  while((n = fread(buf, 1, sizeof(buf), in)) > 0)
+  {
+    if(fwrite(buf, 1, n, out) != n)
+    {
+      ok = false;
+      break;
+    }
+  }
+
+  fclose(in);
+
+  if(fclose(out) != 0)
+    ok = false;
+
+  if(!ok || (rename(tmp, opt->cache_file) != 0))
+    remove(tmp);
+}
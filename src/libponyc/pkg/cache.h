@@ -0,0 +1,23 @@
+#ifndef PKG_CACHE_H
+#define PKG_CACHE_H
+
+#include <platform.h>
+#include "../ast/ast.h"
+#include "../pass/pass.h"
+
+PONY_EXTERN_C_BEGIN
+
+/** Work out where the object file for this program would be in the cache
+ * directory, from the compiler version, the options that change code
+ * generation, the user build flags and the contents of every source file.
+ * Must be called once every package has been loaded.
+ * Returns true if the object file is already there.
+ */
+bool cache_lookup(ast_t* program, pass_opt_t* opt);
+
+/// Copy a freshly generated object file into the cache.
+void cache_store(pass_opt_t* opt, const char* file_o);
+
+PONY_EXTERN_C_END
+
+#endif
@@ -6,6 +6,7 @@
 #include "../ast/parser.h"
 #include "../ast/ast.h"
 #include "../ast/token.h"
+#include "../ast/stringtab.h"
 #include "../expr/literal.h"
 #include "../../libponyrt/mem/pool.h"
 #include <stdlib.h>
@@ -167,6 +168,108 @@ static void path_cat(const char* part1, const char* part2,
 }
 
 
+// The files of a package being parsed on several threads. Each thread takes
+// the next file, and parses it into a holder of its own.
+typedef struct parse_batch_t
+{
+  const char** files;
+  ast_t** holders;
+  bool* ok;
+  size_t count;
+  size_t next;
+  pass_opt_t* options;
+} parse_batch_t;
+
+
+static DECLARE_THREAD_FN(parse_worker)
+{
+  parse_batch_t* batch = (parse_batch_t*)arg;
+
+  // The syntax pass pushes type checker frames, so each thread has its own.
+  pass_opt_t options = *batch->options;
+  ast_use_pool(true);
+
+  while(true)
+  {
+    size_t i = _atomic_add(&batch->next, 1);
+
+    if(i >= batch->count)
+      break;
+
+    batch->holders[i] = ast_blank(TK_NONE);
+    batch->ok[i] = parse_source_file(batch->holders[i], batch->files[i],
+      &options);
+  }
+
+  return 0;
+}
+
+
+// Parse the given files on options->jobs threads, and add the modules to the
+// package in the same order as parsing them one at a time would.
+// @return true on success, false on error
+static bool parse_files_parallel(ast_t* package, const char** files,
+  size_t count, pass_opt_t* options)
+{
+  parse_batch_t batch;
+  batch.files = files;
+  batch.holders = (ast_t**)pool_alloc_size(count * sizeof(ast_t*));
+  batch.ok = (bool*)pool_alloc_size(count * sizeof(bool));
+  batch.count = count;
+  batch.next = 0;
+  batch.options = options;
+
+  size_t threads = (size_t)options->jobs;
+
+  if(threads > count)
+    threads = count;
+
+  pony_thread_id_t* tid = (pony_thread_id_t*)pool_alloc_size(
+    threads * sizeof(pony_thread_id_t));
+
+  stringtab_share(true);
+  error_share(true);
+
+  // This thread parses too, so it starts one fewer.
+  size_t started = 0;
+
+  while((started + 1) < threads)
+  {
+    if(!pony_thread_create(&tid[started], parse_worker, (uint32_t)-1, &batch))
+      break;
+
+    started++;
+  }
+
+  parse_worker(&batch);
+  ast_use_pool(false);
+
+  for(size_t i = 0; i < started; i++)
+    pony_thread_join(tid[i]);
+
+  error_share(false);
+  stringtab_share(false);
+
+  bool r = true;
+
+  for(size_t i = 0; i < count; i++)
+  {
+    ast_t* module = ast_pop(batch.holders[i]);
+
+    if(module != NULL)
+      ast_add(package, module);
+
+    ast_free(batch.holders[i]);
+    r &= batch.ok[i];
+  }
+
+  pool_free_size(threads * sizeof(pony_thread_id_t), tid);
+  pool_free_size(count * sizeof(bool), batch.ok);
+  pool_free_size(count * sizeof(ast_t*), batch.holders);
+  return r;
+}
+
+
 // Attempt to parse the source files in the specified directory and add them to
 // the given package AST
 // @return true on success, false on error
@@ -191,7 +294,8 @@ static bool parse_files_in_dir(ast_t* package, const char* dir_path,
 
   PONY_DIRINFO dirent;
   PONY_DIRINFO* d;
-  bool r = true;
+  strlist_t* files = NULL;
+  size_t count = 0;
 
   while(pony_dir_entry_next(dir, &dirent, &d) && (d != NULL))
   {
@@ -208,11 +312,31 @@ static bool parse_files_in_dir(ast_t* package, const char* dir_path,
     {
       char fullpath[FILENAME_MAX];
       path_cat(dir_path, name, fullpath);
-      r &= parse_source_file(package, fullpath, options);
+      files = strlist_append(files, stringtab(fullpath));
+      count++;
     }
   }
 
   pony_closedir(dir);
+  bool r = true;
+
+  if((options->jobs > 1) && (count > 1))
+  {
+    const char** paths = (const char**)pool_alloc_size(
+      count * sizeof(const char*));
+    size_t i = 0;
+
+    for(strlist_t* p = files; p != NULL; p = strlist_next(p))
+      paths[i++] = strlist_data(p);
+
+    r = parse_files_parallel(package, paths, count, options);
+    pool_free_size(count * sizeof(const char*), paths);
+  } else {
+    for(strlist_t* p = files; p != NULL; p = strlist_next(p))
+      r &= parse_source_file(package, strlist_data(p), options);
+  }
+
+  strlist_free(files);
   return r;
 }
 
@@ -849,16 +973,18 @@ ast_t* package_load(ast_t* from, const char* path, pass_opt_t* options)
   if(report_build)
     printf("Building %s -> %s\n", path, full_path);
 
+  int prev = stats_phase(options, PASS_PARSE);
+  bool parsed;
+
   if(magic != NULL)
-  {
-    if(!parse_source_code(package, magic, options))
-      return NULL;
-  }
+    parsed = parse_source_code(package, magic, options);
   else
-  {
-    if(!parse_files_in_dir(package, full_path, options))
-      return NULL;
-  }
+    parsed = parse_files_in_dir(package, full_path, options);
+
+  stats_phase(options, prev);
+
+  if(!parsed)
+    return NULL;
 
   if(ast_child(package) == NULL)
   {
@@ -119,6 +119,26 @@ bool os_is_target(const char* attribute, bool release, bool* out_is_target)
     return true;
   }
 
+  if(!strcmp(attribute, OS_BIGENDIAN_NAME))
+  {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    *out_is_target = true;
+#else
+    *out_is_target = false;
+#endif
+    return true;
+  }
+
+  if(!strcmp(attribute, OS_LITTLEENDIAN_NAME))
+  {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    *out_is_target = false;
+#else
+    *out_is_target = true;
+#endif
+    return true;
+  }
+
   if(!strcmp(attribute, OS_DEBUG_NAME))
   {
     *out_is_target = !release;
@@ -17,6 +17,8 @@ PONY_EXTERN_C_BEGIN
 #define OS_LLP64_NAME "llp64"
 #define OS_ILP32_NAME "ilp32"
 #define OS_NATIVE128_NAME "native128"
+#define OS_BIGENDIAN_NAME "bigendian"
+#define OS_LITTLEENDIAN_NAME "littleendian"
 #define OS_DEBUG_NAME "debug"
 
 /** Report whether the named platform attribute is true
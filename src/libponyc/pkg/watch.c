@@ -0,0 +1,168 @@
+#include "watch.h"
+#include "package.h"
+#include "../ast/stringtab.h"
+#include "../../libponyrt/ds/hash.h"
+#include "../../libponyrt/mem/pool.h"
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef PLATFORM_IS_WINDOWS
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
+
+#define EXTENSION ".pony"
+
+typedef struct watch_dir_t
+{
+  const char* path;
+  uint64_t fingerprint;
+  struct watch_dir_t* next;
+} watch_dir_t;
+
+struct watch_t
+{
+  watch_dir_t* dirs;
+};
+
+static uint64_t fingerprint(const char* path)
+{
+  PONY_ERRNO err = 0;
+  PONY_DIR* dir = pony_opendir(path, &err);
+
+  if(dir == NULL)
+    return 0;
+
+  PONY_DIRINFO dirent;
+  PONY_DIRINFO* d;
+  uint64_t h = 0;
+
+  while(pony_dir_entry_next(dir, &dirent, &d) && (d != NULL))
+  {
+    // The same files as parse_files_in_dir reads.
+    char* name = pony_dir_info_name(d);
+
+    if(name[0] == '.')
+      continue;
+
+    const char* p = strrchr(name, '.');
+
+    if((p == NULL) || (strcmp(p, EXTENSION) != 0))
+      continue;
+
+    char file[FILENAME_MAX];
+    snprintf(file, sizeof(file), "%s/%s", path, name);
+
+    struct stat s;
+    uint64_t entry[3] = {hash_block_fast(name, strlen(name)), 0, 0};
+
+    if(stat(file, &s) == 0)
+    {
+      entry[1] = (uint64_t)s.st_mtime;
+      entry[2] = (uint64_t)s.st_size;
+    }
+
+    // Directory order isn't guaranteed, so the entries are summed rather
+    // than chained.
+    h += hash_block_fast(entry, sizeof(entry));
+  }
+
+  pony_closedir(dir);
+  return h;
+}
+
+static void add_dir(watch_t* watch, const char* path)
+{
+  for(watch_dir_t* d = watch->dirs; d != NULL; d = d->next)
+  {
+    if(d->path == path)
+      return;
+  }
+
+  watch_dir_t* d = POOL_ALLOC(watch_dir_t);
+  d->path = path;
+  d->fingerprint = fingerprint(path);
+  d->next = watch->dirs;
+  watch->dirs = d;
+}
+
+static bool changed(watch_t* watch)
+{
+  bool r = false;
+
+  for(watch_dir_t* d = watch->dirs; d != NULL; d = d->next)
+  {
+    uint64_t f = fingerprint(d->path);
+
+    if(f != d->fingerprint)
+    {
+      d->fingerprint = f;
+      r = true;
+    }
+  }
+
+  return r;
+}
+
+static void sleep_ms(uint32_t ms)
+{
+#ifdef PLATFORM_IS_WINDOWS
+  Sleep(ms);
+#else
+  struct timespec ts = {ms / 1000, (ms % 1000) * 1000000};
+  nanosleep(&ts, NULL);
+#endif
+}
+
+watch_t* watch_create(const char* path, ast_t* program)
+{
+  watch_t* watch = POOL_ALLOC(watch_t);
+  watch->dirs = NULL;
+
+  char full[FILENAME_MAX];
+
+  if(pony_realpath(path, full) != NULL)
+    add_dir(watch, stringtab(full));
+
+  if(program != NULL)
+  {
+    for(ast_t* p = ast_child(program); p != NULL; p = ast_sibling(p))
+      add_dir(watch, package_path(p));
+  }
+
+  return watch;
+}
+
+void watch_wait(watch_t* watch, uint32_t interval)
+{
+  assert(watch != NULL);
+
+  while(!changed(watch))
+    sleep_ms(interval);
+
+  do
+  {
+    sleep_ms(interval);
+  } while(changed(watch));
+}
+
+void watch_free(watch_t* watch)
+{
+  if(watch == NULL)
+    return;
+
+  watch_dir_t* d = watch->dirs;
+
+  while(d != NULL)
+  {
+    watch_dir_t* next = d->next;
+    POOL_FREE(watch_dir_t, d);
+    d = next;
+  }
+
+  POOL_FREE(watch_t, watch);
+}
@@ -0,0 +1,30 @@
+#ifndef PKG_WATCH_H
+#define PKG_WATCH_H
+
+#include <platform.h>
+#include "../ast/ast.h"
+
+PONY_EXTERN_C_BEGIN
+
+/** The source directories of a program, with a fingerprint of the names,
+ * sizes and modification times of the .pony files in each.
+ */
+typedef struct watch_t watch_t;
+
+/** Watch the given directory and, if program is not NULL, the directory of
+ * every package it loaded. The program AST may be freed afterwards.
+ */
+watch_t* watch_create(const char* path, ast_t* program);
+
+/** Block until a .pony file in a watched directory is added, removed or
+ * changed, checking every interval milliseconds. The change is waited out
+ * until a check finds nothing new, so that an editor saving several files
+ * leads to one rebuild.
+ */
+void watch_wait(watch_t* watch, uint32_t interval);
+
+void watch_free(watch_t* watch);
+
+PONY_EXTERN_C_END
+
+#endif
@@ -1,13 +1,13 @@
 #include "paint.h"
 #include "../../libponyrt/ds/hash.h"
 #include "../../libponyrt/mem/pool.h"
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
 
 /** We use a greedy algorithm that gives a reasonable trade-off between
  * computation (at compiletime) and resulting colour density (runtime memory).
- * We also employ various heuristics to improve our results.
  *
  * Main algorithm.
  *
@@ -19,56 +19,36 @@
  *
  * Step 1.
  * First we walk through the given set of reachable types finding all methods.
- * For each unique name we create a name record. In each of these records we
- * note which types use that name. We implement this using a bitmap. Because we
- * know in advance how many types there are we can store this as an array of
- * uints.
+ * Each type is given an index. For each unique name we create a name record,
+ * in which we list the indices of the types that use that name. Most names
+ * are used by only a few types, so a list is far smaller than a bitmap of
+ * all the types.
  *
  * Step 2.
- * Various heuristics (see below).
+ * We sort the names by the number of types that use them, most first, and by
+ * name where that is the same, so that the result doesn't depend on where
+ * the names happen to be in memory. Names used by many types are the hardest
+ * to fit, so they are placed while there are still low colours free.
  *
  * Step 3.
- * We run through our name records. For each one we run through the colours
- * already assigned. If the set of types using the current name has no
- * intersection with the types using the current assigned colour, then that
- * name is also assigned to that colour. The name's type set is unioned into
- * the colour's type set.
- *
- * If a name is not compatible with any assigned colour (or there are no
- * colours assigned yet) then that name is assigned to the first free colour.
+ * Each type keeps a bitmap of the colours already used by its names. For each
+ * name in turn we OR together the bitmaps of its types, a word at a time, and
+ * assign the first colour that none of them use. This is linear in the size
+ * of the name's type list, rather than in the number of types times the
+ * number of colours.
  *
  * Step 4.
- * Various heuristics (see below).
+ * A vtable only has to run to its type's highest colour, since vtables are
+ * not used for correctness checking and do not have to be tolerant of
+ * invalid accesses. So we renumber the colours by the number of types that
+ * use them, most first. Colours that few types use end up at the end, where
+ * only those types' vtables reach.
  *
  * Step 5.
  * For each method name in the set of reachable types we lookup our name record
  * and fill in which colour has been assigned.
  * While doing this we also determine the maximum colour used by each type and
  * hence its vtable size.
- *
- * Heuristics.
- *
- * No heuristics are implemented yet, but there are various planned. Most of
- * these reduce compiletime computation at the expense of vtable size.
- *
- * 1. A name that is used by most of the types is far less likely to be
- * compatible with other names, so checking against them is a waste of time.
- * For any name that is used by more than some proportion of the types,
- * don't try to combine that name with others.
- *
- * 2. Step 3 is O(n^2) on the number of names. To prevent this exploding for
- * large n break the names into multiple groups and combine each group
- * separately. Do not try and combination between these groups. A simple
- * approach is just to put the first n names in one group, the next n in
- * another, etc for some n. More complex approaches may or may not give better
- * results.
- *
- * 3. The resulting vtables are not used for correctness checking and do not
- * have to be tolerant of invalid accesses. Therefore they do not all have to
- * be the same size and each can stop after its last valid entry. This means
- * that the total size of the vtables can be reduced by reordering the colours.
- * As a first attempt simply sort the colours by the number of types that use
- * them.
  */
 
 #define UNASSIGNED_COLOUR ((uint32_t)-1)
@@ -78,8 +58,9 @@ typedef struct name_record_t
 {
   const char* name;       // Name including type params
   uint32_t colour;        // Colour assigned to name
-  size_t typemap_size;    // Size of our type bitmap in uint64_ts
-  uint64_t* type_map;     // Bitmap of types using this name
+  uint32_t type_count;    // Number of types using this name
+  uint32_t type_alloc;    // Space in type list
+  uint32_t* types;        // Indices of types using this name, in order
 } name_record_t;
 
 
@@ -96,7 +77,9 @@ static bool name_record_cmp(name_record_t* a, name_record_t* b)
 
 static void name_record_free(name_record_t* p)
 {
-  pool_free_size(p->typemap_size * sizeof(uint64_t), p->type_map);
+  if(p->types != NULL)
+    pool_free_size(p->type_alloc * sizeof(uint32_t), p->types);
+
   POOL_FREE(name_record_t, p);
 }
 
@@ -105,49 +88,33 @@ DEFINE_HASHMAP(name_records, name_record_t, name_record_hash, name_record_cmp,
   pool_alloc_size, pool_free_size, name_record_free);
 
 
-typedef struct colour_record_t
+typedef struct type_record_t
 {
-  uint32_t colour;        // Colour index
-  uint64_t* type_map;     // Bitmap of types using this name
-  struct colour_record_t* next;
-} colour_record_t;
+  uint64_t* colours;      // Bitmap of colours used by this type's names
+  size_t size;            // Size of colour bitmap in uint64_ts
+} type_record_t;
 
 
 typedef struct painter_t
 {
   name_records_t names;     // Name records
-  colour_record_t* colours; // Linked list of colour records
-  colour_record_t** colour_next;  // ..
-  size_t typemap_size;      // Size of type bitmaps in uint64_ts
+  name_record_t** order;    // Name records, in the order they are coloured
+  size_t name_count;        // Number of names
+  type_record_t* types;     // Type records, by type index
+  size_t type_count;        // Number of types
+  size_t* colour_uses;      // Number of types using each colour
+  size_t colour_alloc;      // Space in colour_uses
+  uint32_t* remap;          // Final index of each colour
   uint32_t colour_count;    // Number of colours assigned
 } painter_t;
 
 
-// Print out a type map, for debugging only
-static void print_typemap(size_t size, uint64_t* map)
-{
-  assert(map != NULL);
-
-  for(size_t i = 0; i < size; i++)
-  {
-    printf("  ");
-
-    for(uint64_t mask = 1; mask != 0; mask <<= 1)
-      printf("%c", ((map[i] & mask) == 0) ? '.' : 'T');
-
-    printf("\n");
-  }
-}
-
-
 // This is not static so compiler doesn't complain about it not being used
 void painter_print(painter_t* painter)
 {
   assert(painter != NULL);
 
-  printf("Painter typemaps are " __zu " bits\n",
-    painter->typemap_size * sizeof(uint64_t) * 8);
-
+  printf("Painter has " __zu " types\n", painter->type_count);
   printf("Painter names:\n");
 
   size_t i = HASHMAP_BEGIN;
@@ -158,20 +125,22 @@ void painter_print(painter_t* painter)
     printf("\"%s\" colour ", name->name);
 
     if(name->colour == UNASSIGNED_COLOUR)
-      printf("unassigned\n");
+      printf("unassigned");
     else
-      printf("%u\n", name->colour);
+      printf("%u", name->colour);
+
+    printf(", types");
 
-    print_typemap(name->typemap_size, name->type_map);
+    for(uint32_t j = 0; j < name->type_count; j++)
+      printf(" %u", name->types[j]);
+
+    printf("\n");
   }
 
   printf("Painter has %u colours:\n", painter->colour_count);
 
-  for(colour_record_t* c = painter->colours; c != NULL; c = c->next)
-  {
-    printf("  Colour %u\n", c->colour);
-    print_typemap(painter->typemap_size, c->type_map);
-  }
+  for(uint32_t c = 0; c < painter->colour_count; c++)
+    printf("  Colour %u used by " __zu " types\n", c, painter->colour_uses[c]);
 
   printf("Painter end\n");
 }
@@ -183,79 +152,113 @@ static name_record_t* add_name(painter_t* painter, const char* name)
   assert(painter != NULL);
   assert(name != NULL);
 
-  size_t map_byte_count = painter->typemap_size * sizeof(uint64_t);
-
   name_record_t* n = POOL_ALLOC(name_record_t);
   n->name = name;
   n->colour = UNASSIGNED_COLOUR;
-  n->typemap_size = painter->typemap_size;
-  n->type_map = (uint64_t*)pool_alloc_size(map_byte_count);
-  memset(n->type_map, 0, map_byte_count);
+  n->type_count = 0;
+  n->type_alloc = 0;
+  n->types = NULL;
 
   name_records_put(&painter->names, n);
   return n;
 }
 
 
-// Add a colour record
-static colour_record_t* add_colour(painter_t* painter)
+// Find the name record with the specified name
+static name_record_t* find_name(painter_t* painter, const char* name)
 {
-  assert(painter != NULL);
+  name_record_t n = { name, 0, 0, 0, NULL };
+  return name_records_get(&painter->names, &n);
+}
 
-  size_t map_byte_count = painter->typemap_size * sizeof(uint64_t);
 
-  colour_record_t* n = POOL_ALLOC(colour_record_t);
-  n->colour = painter->colour_count;
-  n->type_map = (uint64_t*)pool_alloc_size(map_byte_count);
-  n->next = NULL;
-  memset(n->type_map, 0, map_byte_count);
+// Note that the given type uses the given name
+static void add_name_type(name_record_t* name, uint32_t type_index)
+{
+  assert(name != NULL);
 
-  *painter->colour_next = n;
-  painter->colour_next = &n->next;
-  painter->colour_count++;
-  return n;
-}
+  if(name->type_count == name->type_alloc)
+  {
+    uint32_t alloc = (name->type_alloc == 0) ? 4 : name->type_alloc * 2;
+    uint32_t* types = (uint32_t*)pool_alloc_size(alloc * sizeof(uint32_t));
 
+    if(name->types != NULL)
+    {
+      memcpy(types, name->types, name->type_count * sizeof(uint32_t));
+      pool_free_size(name->type_alloc * sizeof(uint32_t), name->types);
+    }
 
-// Find the name record with the specified name
-static name_record_t* find_name(painter_t* painter, const char* name)
-{
-  name_record_t n = { name, 0, 0, NULL };
-  return name_records_get(&painter->names, &n);
+    name->types = types;
+    name->type_alloc = alloc;
+  }
+
+  name->types[name->type_count++] = type_index;
 }
 
 
-// Check whether the given name can be assigned to the given colour.
-// Assignment can occur as long as the sets of types using the anme and colour
-// are distinct, ie there is no overlap in their bitmaps.
-static bool is_name_compatible(colour_record_t* colour, name_record_t* name)
+// Mark the given colour as used by the given type
+static void use_colour(type_record_t* type, uint32_t colour)
 {
-  assert(colour != NULL);
-  assert(name != NULL);
+  assert(type != NULL);
+
+  size_t index = colour / 64;
 
-  // Check for type bitmap intersection
-  for(size_t i = 0; i < name->typemap_size; i++)
+  if(index >= type->size)
   {
-    if((colour->type_map[i] & name->type_map[i]) != 0)  // Type bitmaps overlap
-      return false;
+    size_t size = (type->size == 0) ? 1 : type->size * 2;
+
+    while(size <= index)
+      size *= 2;
+
+    uint64_t* colours = (uint64_t*)pool_alloc_size(size * sizeof(uint64_t));
+    memset(colours, 0, size * sizeof(uint64_t));
+
+    if(type->colours != NULL)
+    {
+      memcpy(colours, type->colours, type->size * sizeof(uint64_t));
+      pool_free_size(type->size * sizeof(uint64_t), type->colours);
+    }
+
+    type->colours = colours;
+    type->size = size;
   }
 
-  // Type bitmaps are distinct
-  return true;
+  type->colours[index] |= (uint64_t)1 << (colour % 64);
 }
 
 
-// Assign the given name to the given colour
-static void assign_name_to_colour(colour_record_t* colour, name_record_t* name)
+// Record that a colour is used by some number of types
+static void add_colour_uses(painter_t* painter, uint32_t colour, size_t uses)
 {
-  assert(colour != NULL);
-  assert(name != NULL);
+  assert(painter != NULL);
+
+  if(colour >= painter->colour_alloc)
+  {
+    size_t alloc = (painter->colour_alloc == 0) ? 16 :
+      painter->colour_alloc * 2;
+
+    while(alloc <= colour)
+      alloc *= 2;
+
+    size_t* colour_uses = (size_t*)pool_alloc_size(alloc * sizeof(size_t));
+    memset(colour_uses, 0, alloc * sizeof(size_t));
+
+    if(painter->colour_uses != NULL)
+    {
+      memcpy(colour_uses, painter->colour_uses,
+        painter->colour_alloc * sizeof(size_t));
+      pool_free_size(painter->colour_alloc * sizeof(size_t),
+        painter->colour_uses);
+    }
+
+    painter->colour_uses = colour_uses;
+    painter->colour_alloc = alloc;
+  }
 
-  // Union the type bitmaps
-  for(size_t i = 0; i < name->typemap_size; i++)
-    colour->type_map[i] |= name->type_map[i];
+  if(colour >= painter->colour_count)
+    painter->colour_count = colour + 1;
 
-  name->colour = colour->colour;
+  painter->colour_uses[colour] += uses;
 }
 
 
@@ -266,13 +269,12 @@ static void find_names_types_use(painter_t* painter, reachable_types_t* types)
   assert(types != NULL);
 
   size_t i = HASHMAP_BEGIN;
-  size_t typemap_index = 0;
-  uint64_t typemap_mask = 1;
+  uint32_t type_index = 0;
   reachable_type_t* type;
 
   while((type = reachable_types_next(types, &i)) != NULL)
   {
-    assert(typemap_index < painter->typemap_size);
+    assert(type_index < painter->type_count);
     size_t j = HASHMAP_BEGIN;
     reachable_method_name_t* mn;
 
@@ -291,54 +293,132 @@ static void find_names_types_use(painter_t* painter, reachable_types_t* types)
           name_rec = add_name(painter, name);
 
         // Mark this name as using the current type
-        name_rec->type_map[typemap_index] |= typemap_mask;
+        add_name_type(name_rec, type_index);
       }
     }
 
-    // Advance to next type bitmap entry
-    typemap_mask <<= 1;
-
-    if(typemap_mask == 0)
-    {
-      typemap_mask = 1;
-      typemap_index++;
-    }
+    type_index++;
   }
 }
 
 
-// Step 3
-static void assign_colours_to_names(painter_t* painter)
+static int name_order_cmp(const void* a, const void* b)
 {
+  const name_record_t* na = *(const name_record_t**)a;
+  const name_record_t* nb = *(const name_record_t**)b;
+
+  if(na->type_count != nb->type_count)
+    return (na->type_count > nb->type_count) ? -1 : 1;
+
+  return strcmp(na->name, nb->name);
+}
+
+
+// Step 2
+static void order_names(painter_t* painter)
+{
+  assert(painter != NULL);
+
+  painter->name_count = name_records_size(&painter->names);
+
+  if(painter->name_count == 0)
+    return;
+
+  painter->order = (name_record_t**)pool_alloc_size(
+    painter->name_count * sizeof(name_record_t*));
+
   size_t i = HASHMAP_BEGIN;
+  size_t n = 0;
   name_record_t* name;
 
   while((name = name_records_next(&painter->names, &i)) != NULL)
+    painter->order[n++] = name;
+
+  assert(n == painter->name_count);
+  qsort(painter->order, n, sizeof(name_record_t*), name_order_cmp);
+}
+
+
+// Find the lowest colour that none of the types using a name use yet
+static uint32_t first_free_colour(painter_t* painter, name_record_t* name)
+{
+  for(size_t index = 0; ; index++)
   {
-    // We have a name, try to match it with an existing colour
-    colour_record_t* colour = NULL;
+    uint64_t used = 0;
 
-    for(colour_record_t* c = painter->colours; c != NULL; c = c->next)
+    for(uint32_t i = 0; (i < name->type_count) && (used != ~(uint64_t)0);
+      i++)
     {
-      if(is_name_compatible(c, name))
-      {
-        // Name is compatible with colour
-        colour = c;
-        break;
-      }
-    }
+      type_record_t* type = &painter->types[name->types[i]];
 
-    if(colour == NULL)
-    {
-      // Name is not compatible with any existing colour, assign a new one
-      colour = add_colour(painter);
+      if(index < type->size)
+        used |= type->colours[index];
     }
 
-    assign_name_to_colour(colour, name);
+    if(used != ~(uint64_t)0)
+      return (uint32_t)((index * 64) + __pony_ffsl(~used) - 1);
+  }
+}
+
+
+// Step 3
+static void assign_colours_to_names(painter_t* painter)
+{
+  assert(painter != NULL);
+
+  for(size_t i = 0; i < painter->name_count; i++)
+  {
+    name_record_t* name = painter->order[i];
+    uint32_t colour = first_free_colour(painter, name);
+
+    for(uint32_t j = 0; j < name->type_count; j++)
+      use_colour(&painter->types[name->types[j]], colour);
+
+    name->colour = colour;
+    add_colour_uses(painter, colour, name->type_count);
   }
 }
 
 
+// Step 4
+static void order_colours(painter_t* painter)
+{
+  assert(painter != NULL);
+
+  uint32_t count = painter->colour_count;
+
+  if(count == 0)
+    return;
+
+  // Sort the colours by use with a counting sort on the number of uses. No
+  // colour can be used by more types than there are.
+  size_t buckets = painter->type_count + 2;
+  size_t* start = (size_t*)pool_alloc_size(buckets * sizeof(size_t));
+  memset(start, 0, buckets * sizeof(size_t));
+
+  for(uint32_t c = 0; c < count; c++)
+  {
+    size_t uses = painter->colour_uses[c];
+    assert(uses <= painter->type_count);
+    start[painter->type_count - uses + 1]++;
+  }
+
+  for(size_t b = 1; b < buckets; b++)
+    start[b] += start[b - 1];
+
+  painter->remap = (uint32_t*)pool_alloc_size(count * sizeof(uint32_t));
+
+  // Colours used by the same number of types keep their order.
+  for(uint32_t c = 0; c < count; c++)
+  {
+    size_t bucket = painter->type_count - painter->colour_uses[c];
+    painter->remap[c] = (uint32_t)start[bucket]++;
+  }
+
+  pool_free_size(buckets * sizeof(size_t), start);
+}
+
+
 // Step 5
 static void distribute_info(painter_t* painter, reachable_types_t* types)
 {
@@ -372,7 +452,7 @@ static void distribute_info(painter_t* painter, reachable_types_t* types)
         name_record_t* name_rec = find_name(painter, name);
         assert(name_rec != NULL);
 
-        uint32_t colour = name_rec->colour;
+        uint32_t colour = painter->remap[name_rec->colour];
         method->vtable_index = colour;
 
         if(colour > max_colour)
@@ -391,19 +471,35 @@ static void painter_tidy(painter_t* painter)
 {
   assert(painter != NULL);
 
-  size_t map_byte_count = painter->typemap_size * sizeof(uint64_t);
+  for(size_t i = 0; i < painter->type_count; i++)
+  {
+    type_record_t* type = &painter->types[i];
 
-  name_records_destroy(&painter->names);
+    if(type->colours != NULL)
+      pool_free_size(type->size * sizeof(uint64_t), type->colours);
+  }
+
+  pool_free_size(painter->type_count * sizeof(type_record_t), painter->types);
+
+  if(painter->order != NULL)
+  {
+    pool_free_size(painter->name_count * sizeof(name_record_t*),
+      painter->order);
+  }
 
-  colour_record_t* c = painter->colours;
+  if(painter->colour_uses != NULL)
+  {
+    pool_free_size(painter->colour_alloc * sizeof(size_t),
+      painter->colour_uses);
+  }
 
-  while(c != NULL)
+  if(painter->remap != NULL)
   {
-    colour_record_t* next = c->next;
-    pool_free_size(map_byte_count, c->type_map);
-    POOL_FREE(sizeof(colour_record_t), c);
-    c = next;
+    pool_free_size(painter->colour_count * sizeof(uint32_t),
+      painter->remap);
   }
+
+  name_records_destroy(&painter->names);
 }
 
 
@@ -417,20 +513,24 @@ void paint(reachable_types_t* types)
     return;
 
   painter_t painter;
+  memset(&painter, 0, sizeof(painter_t));
   name_records_init(&painter.names, 8);
-  painter.colours = NULL;
-  painter.colour_next = &painter.colours;
-  painter.colour_count = 0;
-
-  // Determine the size needed to contain our type bitmap, round up to next
-  // whole uint64_t
-  painter.typemap_size = ((type_count - 1) / 64) + 1;
+  painter.type_count = type_count;
+  painter.types = (type_record_t*)pool_alloc_size(
+    type_count * sizeof(type_record_t));
+  memset(painter.types, 0, type_count * sizeof(type_record_t));
 
   // Step 1
   find_names_types_use(&painter, types);
 
+  // Step 2
+  order_names(&painter);
+
   // Step 3
   assign_colours_to_names(&painter);
+
+  // Step 4
+  order_colours(&painter);
   // painter_print(&painter);
 
   // Step 5
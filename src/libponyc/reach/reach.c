@@ -89,6 +89,31 @@ DEFINE_HASHMAP(reachable_types, reachable_type_t, reachable_type_hash,
 DEFINE_HASHMAP(reachable_type_cache, reachable_type_t, reachable_type_hash,
   reachable_type_cmp, pool_alloc_size, pool_free_size, NULL);
 
+typedef struct reached_member_t
+{
+  ast_t* def;
+  const char* name;
+} reached_member_t;
+
+static size_t reached_member_hash(reached_member_t* m)
+{
+  return hash_ptr(m->def) ^ hash_ptr(m->name);
+}
+
+static bool reached_member_cmp(reached_member_t* a, reached_member_t* b)
+{
+  return (a->def == b->def) && (a->name == b->name);
+}
+
+static void reached_member_free(reached_member_t* m)
+{
+  POOL_FREE(reached_member_t, m);
+}
+
+DECLARE_HASHMAP(reached_members, reached_member_t);
+DEFINE_HASHMAP(reached_members, reached_member_t, reached_member_hash,
+  reached_member_cmp, pool_alloc_size, pool_free_size, reached_member_free);
+
 static void add_rmethod(reachable_method_stack_t** s,
   reachable_type_t* t, reachable_method_name_t* n, ast_t* typeargs)
 {
@@ -101,6 +126,7 @@ static void add_rmethod(reachable_method_stack_t** s,
     m->name = name;
     m->typeargs = ast_dup(typeargs);
     m->vtable_index = (uint32_t)-1;
+    m->msg_id = (uint32_t)-1;
 
     ast_t* fun = lookup(NULL, NULL, t->type, n->name);
 
@@ -118,6 +144,13 @@ static void add_rmethod(reachable_method_stack_t** s,
     m->r_fun = ast_dup(fun);
     ast_free_unattached(fun);
 
+    // Each behaviour and constructor of an actor gets a message ID, numbered
+    // from 0 for each actor so that its dispatch switch is dense.
+    if(((ast_id(m->r_fun) == TK_BE) || (ast_id(m->r_fun) == TK_NEW)) &&
+      (ast_id(t->type) == TK_NOMINAL) &&
+      (ast_id((ast_t*)ast_data(t->type)) == TK_ACTOR))
+      m->msg_id = t->msg_count++;
+
     reachable_methods_put(&n->r_methods, m);
 
     // Put on a stack of reachable methods to trace.
@@ -694,6 +727,10 @@ static void handle_stack(reachable_method_stack_t* s, reachable_types_t* r,
 
     add_type(&s, r, next_type_id, result);
     reachable_expr(&s, r, next_type_id, body);
+
+    // Code generation looks the method up again, so once the body has been
+    // walked our copy of it is no longer needed.
+    ast_replace(&body, ast_from(body, TK_NONE));
   }
 }
 
@@ -756,6 +793,179 @@ size_t reach_method_count(reachable_type_t* t)
   return count;
 }
 
+reachable_type_t* reach_sole_subtype(reachable_types_t* r, const char* name)
+{
+  reachable_type_t* t = reach_type(r, name);
+
+  if((t == NULL) || (reachable_type_cache_size(&t->subtypes) != 1))
+    return NULL;
+
+  size_t i = HASHMAP_BEGIN;
+  return reachable_type_cache_next(&t->subtypes, &i);
+}
+
+void reach_number_traits(reachable_types_t* r)
+{
+  size_t i = HASHMAP_BEGIN;
+  reachable_type_t* t;
+  uint32_t max_id = 0;
+
+  while((t = reachable_types_next(r, &i)) != NULL)
+  {
+    if(t->type_id > max_id)
+      max_id = t->type_id;
+  }
+
+  // Map each type ID to its index plus one, so that equal interfaces, which
+  // share a type ID, get the same index.
+  size_t map_size = (max_id + 1) * sizeof(uint32_t);
+  uint32_t* map = (uint32_t*)pool_alloc_size(map_size);
+  memset(map, 0, map_size);
+  uint32_t next = 0;
+
+  i = HASHMAP_BEGIN;
+
+  while((t = reachable_types_next(r, &i)) != NULL)
+  {
+    if(ast_id(t->type) == TK_TUPLETYPE)
+      continue;
+
+    ast_t* def = (ast_t*)ast_data(t->type);
+
+    if((ast_id(def) != TK_TRAIT) && (ast_id(def) != TK_INTERFACE))
+      continue;
+
+    if(map[t->type_id] == 0)
+      map[t->type_id] = ++next;
+
+    t->trait_index = map[t->type_id] - 1;
+  }
+
+  pool_free_size(map_size, map);
+}
+
+static void prune_entity(reached_members_t* members, ast_t* entity,
+  bool all)
+{
+  ast_t* member = ast_child(ast_childidx(entity, 4));
+
+  while(member != NULL)
+  {
+    switch(ast_id(member))
+    {
+      case TK_NEW:
+      case TK_BE:
+      case TK_FUN:
+      {
+        AST_GET_CHILDREN(member, cap, id, typeparams, params, result,
+          can_error, body);
+
+        reached_member_t k;
+        k.def = entity;
+        k.name = ast_name(id);
+
+        if((ast_id(body) != TK_NONE) &&
+          (all || (reached_members_get(members, &k) == NULL)))
+          ast_replace(&body, ast_from(body, TK_NONE));
+
+        break;
+      }
+
+      default: {}
+    }
+
+    member = ast_sibling(member);
+  }
+}
+
+void reach_prune(reachable_types_t* r, ast_t* program)
+{
+  reached_members_t members;
+  reached_members_init(&members, 64);
+
+  size_t i = HASHMAP_BEGIN;
+  reachable_type_t* t;
+
+  while((t = reachable_types_next(r, &i)) != NULL)
+  {
+    if(ast_id(t->type) != TK_NOMINAL)
+      continue;
+
+    ast_t* def = (ast_t*)ast_data(t->type);
+    size_t j = HASHMAP_BEGIN;
+    reachable_method_name_t* n;
+
+    while((n = reachable_method_names_next(&t->methods, &j)) != NULL)
+    {
+      reached_member_t k;
+      k.def = def;
+      k.name = n->name;
+
+      if(reached_members_get(&members, &k) == NULL)
+      {
+        reached_member_t* m = POOL_ALLOC(reached_member_t);
+        m->def = def;
+        m->name = n->name;
+        reached_members_put(&members, m);
+      }
+    }
+  }
+
+  ast_t* package = ast_child(program);
+
+  while(package != NULL)
+  {
+    ast_t* module = ast_child(package);
+
+    while(module != NULL)
+    {
+      ast_t* entity = ast_child(module);
+
+      while(entity != NULL)
+      {
+        switch(ast_id(entity))
+        {
+          // Default bodies were copied into each type that uses them, so
+          // those in traits and interfaces are never generated.
+          case TK_INTERFACE:
+          case TK_TRAIT:
+            prune_entity(&members, entity, true);
+            break;
+
+          case TK_PRIMITIVE:
+          case TK_STRUCT:
+          case TK_CLASS:
+          case TK_ACTOR:
+            prune_entity(&members, entity, false);
+            break;
+
+          default: {}
+        }
+
+        entity = ast_sibling(entity);
+      }
+
+      module = ast_sibling(module);
+    }
+
+    package = ast_sibling(package);
+  }
+
+  reached_members_destroy(&members);
+}
+
+void reach_stats(reachable_types_t* r, typecheck_stats_t* stats)
+{
+  size_t i = HASHMAP_BEGIN;
+  reachable_type_t* t;
+
+  while((t = reachable_types_next(r, &i)) != NULL)
+  {
+    stats->reach_types++;
+    stats->reach_methods += reach_method_count(t);
+  }
+}
+
 void reach_dump(reachable_types_t* r)
 {
   printf("REACH\n");
@@ -776,7 +986,8 @@ void reach_dump(reachable_types_t* r)
 
       while((p = reachable_methods_next(&m->r_methods, &k)) != NULL)
       {
-        printf("    %s vtable index %d (%p)\n", p->name, p->vtable_index, p);
+        printf("    %s vtable index %d msg id %d (%p)\n", p->name,
+          p->vtable_index, p->msg_id, p);
       }
     }
   }
@@ -22,6 +22,7 @@ struct reachable_method_t
   ast_t* typeargs;
   ast_t* r_fun;
   uint32_t vtable_index;
+  uint32_t msg_id;
 };
 
 struct reachable_method_name_t
@@ -37,7 +38,9 @@ struct reachable_type_t
   reachable_method_names_t methods;
   reachable_type_cache_t subtypes;
   uint32_t type_id;
+  uint32_t trait_index;
   uint32_t vtable_size;
+  uint32_t msg_count;
 };
 
 /// Allocate a new set of reachable types.
@@ -64,6 +67,25 @@ reachable_method_t* reach_method(reachable_method_name_t* n,
 
 size_t reach_method_count(reachable_type_t* t);
 
+/// If exactly one reachable type provides the named trait or interface,
+/// return it. Otherwise, return NULL.
+reachable_type_t* reach_sole_subtype(reachable_types_t* r, const char* name);
+
+/** Number the reachable traits and interfaces densely from 0, once
+ * reachability is complete. Interfaces that share a type ID share an index.
+ * The index is a trait's bit in the trait set of each type's descriptor.
+ */
+void reach_number_traits(reachable_types_t* r);
+
+/** Free the bodies of every method in the program that won't be generated,
+ * once reachability is complete. Their signatures are kept, since code
+ * generation still checks subtypes against them.
+ */
+void reach_prune(reachable_types_t* r, ast_t* program);
+
+/// Add the number of reachable types and methods to the stats.
+void reach_stats(reachable_types_t* r, typecheck_stats_t* stats);
+
 void reach_dump(reachable_types_t* r);
 
 PONY_EXTERN_C_END
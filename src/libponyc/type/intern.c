@@ -0,0 +1,150 @@
+#include "intern.h"
+#include "../../libponyrt/ds/hash.h"
+#include "../../libponyrt/mem/pool.h"
+#include <assert.h>
+
+typedef struct interned_t
+{
+  ast_t* type;
+  size_t hash;
+} interned_t;
+
+static bool type_eq(ast_t* a, ast_t* b)
+{
+  if(ast_id(a) != ast_id(b))
+    return false;
+
+  if(ast_id(a) == TK_NOMINAL)
+  {
+    AST_GET_CHILDREN(a, a_pkg, a_id, a_typeargs, a_cap, a_eph);
+    AST_GET_CHILDREN(b, b_pkg, b_id, b_typeargs, b_cap, b_eph);
+
+    return (ast_data(a) == ast_data(b)) &&
+      (ast_id(a_cap) == ast_id(b_cap)) &&
+      (ast_id(a_eph) == ast_id(b_eph)) &&
+      type_eq(a_typeargs, b_typeargs);
+  }
+
+  ast_t* a_child = ast_child(a);
+  ast_t* b_child = ast_child(b);
+
+  while((a_child != NULL) && (b_child != NULL))
+  {
+    if(!type_eq(a_child, b_child))
+      return false;
+
+    a_child = ast_sibling(a_child);
+    b_child = ast_sibling(b_child);
+  }
+
+  return a_child == b_child;
+}
+
+static bool type_hash(ast_t* type, size_t* hash)
+{
+  // What a type parameter or a viewpoint means depends on where it is used,
+  // and the definition a reified type parameter points to can be freed, so
+  // types that contain them aren't interned.
+  switch(ast_id(type))
+  {
+    case TK_NOMINAL:
+    {
+      AST_GET_CHILDREN(type, pkg, id, typeargs, cap, eph);
+
+      if(ast_data(type) == NULL)
+        return false;
+
+      *hash = (*hash * 31) ^ hash_ptr(ast_data(type));
+      *hash = (*hash * 31) ^ ((ast_id(cap) << 8) | ast_id(eph));
+      return type_hash(typeargs, hash);
+    }
+
+    case TK_NONE:
+    case TK_TYPEARGS:
+    case TK_UNIONTYPE:
+    case TK_ISECTTYPE:
+    case TK_TUPLETYPE:
+    {
+      *hash = (*hash * 31) ^ ast_id(type);
+      ast_t* child = ast_child(type);
+
+      while(child != NULL)
+      {
+        if(!type_hash(child, hash))
+          return false;
+
+        child = ast_sibling(child);
+      }
+
+      return true;
+    }
+
+    default: {}
+  }
+
+  return false;
+}
+
+static size_t interned_hash(interned_t* t)
+{
+  return t->hash;
+}
+
+static bool interned_cmp(interned_t* a, interned_t* b)
+{
+  return (a->hash == b->hash) && type_eq(a->type, b->type);
+}
+
+static void interned_free(interned_t* t)
+{
+  ast_free(t->type);
+  POOL_FREE(interned_t, t);
+}
+
+DECLARE_HASHMAP(interned_types, interned_t);
+
+DEFINE_HASHMAP(interned_types, interned_t, interned_hash, interned_cmp,
+  pool_alloc_size, pool_free_size, interned_free);
+
+static __pony_thread_local bool intern_on;
+static __pony_thread_local interned_types_t interned;
+
+void type_intern_start()
+{
+  assert(!intern_on);
+  interned_types_init(&interned, 64);
+  intern_on = true;
+}
+
+void type_intern_stop()
+{
+  if(!intern_on)
+    return;
+
+  interned_types_destroy(&interned);
+  intern_on = false;
+}
+
+ast_t* type_intern(ast_t* type)
+{
+  if(!intern_on)
+    return NULL;
+
+  interned_t key;
+  key.type = type;
+  key.hash = 0;
+
+  if(!type_hash(type, &key.hash))
+    return NULL;
+
+  interned_t* t = interned_types_get(&interned, &key);
+
+  if(t != NULL)
+    return t->type;
+
+  t = POOL_ALLOC(interned_t);
+  t->type = ast_dup(type);
+  t->hash = key.hash;
+  interned_types_put(&interned, t);
+  return t->type;
+}
@@ -0,0 +1,24 @@
+#ifndef TYPE_INTERN_H
+#define TYPE_INTERN_H
+
+#include <platform.h>
+#include "../ast/ast.h"
+
+PONY_EXTERN_C_BEGIN
+
+// Start interning types. Only sound once every entity has been through the
+// traits pass, and only while the program is alive.
+void type_intern_start();
+
+// Free every interned type.
+void type_intern_stop();
+
+// Returns the shared copy of a type built from nominal, union, intersection
+// and tuple types, so two such types are equal exactly when their interned
+// copies are the same node. Returns NULL for any other type, or when interning
+// is off. Interned types are read only and live until type_intern_stop.
+ast_t* type_intern(ast_t* type);
+
+PONY_EXTERN_C_END
+
+#endif
@@ -2,6 +2,7 @@
 #include "alias.h"
 #include "assemble.h"
 #include "cap.h"
+#include "intern.h"
 #include "matchtype.h"
 #include "reify.h"
 #include "typeparam.h"
@@ -9,6 +10,8 @@
 #include "../ast/astbuild.h"
 #include "../ast/stringtab.h"
 #include "../expr/literal.h"
+#include "../../libponyrt/ds/hash.h"
+#include "../../libponyrt/mem/pool.h"
 #include <assert.h>
 
 static bool is_eq_typeargs(ast_t* a, ast_t* b, errorframe_t* errors);
@@ -16,6 +19,81 @@ static bool is_isect_sub_x(ast_t* sub, ast_t* super, errorframe_t* errors);
 
 static __pony_thread_local ast_t* subtype_assume;
 
+typedef struct subtype_memo_t
+{
+  ast_t* sub;
+  ast_t* super;
+  bool result;
+} subtype_memo_t;
+
+static size_t memo_hash(subtype_memo_t* m)
+{
+  return hash_ptr(m->sub) ^ (hash_ptr(m->super) * 31);
+}
+
+static bool memo_cmp(subtype_memo_t* a, subtype_memo_t* b)
+{
+  // The types are interned, so they are equal only if they are the same node.
+  return (a->sub == b->sub) && (a->super == b->super);
+}
+
+static void memo_free(subtype_memo_t* m)
+{
+  POOL_FREE(subtype_memo_t, m);
+}
+
+DECLARE_HASHMAP(subtype_memos, subtype_memo_t);
+
+DEFINE_HASHMAP(subtype_memos, subtype_memo_t, memo_hash, memo_cmp,
+  pool_alloc_size, pool_free_size, memo_free);
+
+static __pony_thread_local bool memo_on;
+static __pony_thread_local subtype_memos_t memos;
+static __pony_thread_local size_t memo_hits;
+static __pony_thread_local size_t memo_misses;
+static __pony_thread_local size_t checks;
+
+static bool memo_key(ast_t* sub, ast_t* super, subtype_memo_t* key)
+{
+  if(!memo_on)
+    return false;
+
+  key->sub = type_intern(sub);
+  key->super = type_intern(super);
+
+  return (key->sub != NULL) && (key->super != NULL);
+}
+
+static bool memo_get(subtype_memo_t* key, errorframe_t* errors,
+  bool* result)
+{
+  // A remembered failure has no error frames to report, so a check that wants
+  // them is always made again.
+  if(errors != NULL)
+    return false;
+
+  subtype_memo_t* m = subtype_memos_get(&memos, key);
+
+  if(m == NULL)
+  {
+    memo_misses++;
+    return false;
+  }
+
+  memo_hits++;
+  *result = m->result;
+  return true;
+}
+
+static void memo_put(subtype_memo_t* key, bool result)
+{
+  subtype_memo_t* m = POOL_ALLOC(subtype_memo_t);
+  m->sub = key->sub;
+  m->super = key->super;
+  m->result = result;
+  subtype_memos_put(&memos, m);
+}
+
 static bool exact_nominal(ast_t* a, ast_t* b)
 {
   AST_GET_CHILDREN(a, a_pkg, a_id, a_typeargs, a_cap, a_eph);
@@ -950,6 +1028,33 @@ static bool is_nominal_sub_trait(ast_t* sub, ast_t* super,
   return false;
 }
 
+static bool is_nominal_sub_structural(ast_t* sub, ast_t* super,
+  errorframe_t* errors)
+{
+  // Checking an interface compares every method, and checking a trait walks
+  // the provides list, so the answers are remembered. An answer reached while
+  // an outer check is assumed to hold may depend on that assumption, so only
+  // outermost answers are kept.
+  subtype_memo_t key;
+  bool memo = memo_key(sub, super, &key);
+  bool result;
+
+  if(memo && memo_get(&key, errors, &result))
+    return result;
+
+  bool outermost = subtype_assume == NULL;
+
+  if(ast_id((ast_t*)ast_data(super)) == TK_INTERFACE)
+    result = is_nominal_sub_interface(sub, super, errors);
+  else
+    result = is_nominal_sub_trait(sub, super, errors);
+
+  if(memo && outermost)
+    memo_put(&key, result);
+
+  return result;
+}
+
 static bool is_nominal_sub_nominal(ast_t* sub, ast_t* super,
   errorframe_t* errors)
 {
@@ -965,10 +1070,8 @@ static bool is_nominal_sub_nominal(ast_t* sub, ast_t* super,
       return is_nominal_sub_entity(sub, super, errors);
 
     case TK_INTERFACE:
-      return is_nominal_sub_interface(sub, super, errors);
-
     case TK_TRAIT:
-      return is_nominal_sub_trait(sub, super, errors);
+      return is_nominal_sub_structural(sub, super, errors);
 
     default: {}
   }
@@ -1384,6 +1487,8 @@ bool is_subtype(ast_t* sub, ast_t* super, errorframe_t* errors)
   assert(sub != NULL);
   assert(super != NULL);
 
+  checks++;
+
   if(ast_id(super) == TK_DONTCARE)
     return true;
 
@@ -1429,6 +1534,30 @@ bool is_eqtype(ast_t* a, ast_t* b, errorframe_t* errors)
   return is_subtype(a, b, errors) && is_subtype(b, a, errors);
 }
 
+void subtype_memo_start()
+{
+  assert(!memo_on);
+  checks = 0;
+  subtype_memos_init(&memos, 64);
+  memo_on = true;
+}
+
+void subtype_memo_stop(typecheck_stats_t* stats)
+{
+  if(!memo_on)
+    return;
+
+  stats->subtype_hits += memo_hits;
+  stats->subtype_misses += memo_misses;
+  stats->subtype_checks += checks;
+  memo_hits = 0;
+  memo_misses = 0;
+  checks = 0;
+
+  subtype_memos_destroy(&memos);
+  memo_on = false;
+}
+
 bool is_literal(ast_t* type, const char* name)
 {
   if(type == NULL)
@@ -1490,9 +1619,19 @@ bool is_integer(ast_t* type)
     is_literal(type, "USize");
 }
 
+bool is_simd(ast_t* type)
+{
+  return
+    is_literal(type, "F32x4") ||
+    is_literal(type, "F64x2") ||
+    is_literal(type, "I32x4") ||
+    is_literal(type, "U32x4") ||
+    is_literal(type, "U8x16");
+}
+
 bool is_machine_word(ast_t* type)
 {
-  return is_bool(type) || is_integer(type) || is_float(type);
+  return is_bool(type) || is_integer(type) || is_float(type) || is_simd(type);
 }
 
 bool is_signed(pass_opt_t* opt, ast_t* type)
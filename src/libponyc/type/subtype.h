@@ -16,6 +16,20 @@ bool is_subtype(ast_t* sub, ast_t* super, errorframe_t* errors);
 
 bool is_eqtype(ast_t* a, ast_t* b, errorframe_t* errors);
 
+/**
+ * Remember whether one interned type is a subtype of an interface or trait,
+ * so that asking again is a hash lookup. Types are only remembered while
+ * type interning is on.
+ */
+void subtype_memo_start();
+
+/**
+ * Forget every remembered answer, adding the number of lookups that were and
+ * weren't answered from memory, and the number of subtype checks made since
+ * the memo was started, to the stats.
+ */
+void subtype_memo_stop(typecheck_stats_t* stats);
+
 bool is_pointer(ast_t* type);
 
 bool is_maybe(ast_t* type);
@@ -30,6 +44,8 @@ bool is_float(ast_t* type);
 
 bool is_integer(ast_t* type);
 
+bool is_simd(ast_t* type);
+
 bool is_machine_word(ast_t* type);
 
 bool is_signed(pass_opt_t* opt, ast_t* type);
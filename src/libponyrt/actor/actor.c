@@ -1,13 +1,35 @@
 #include "actor.h"
+#include "registry.h"
 #include "../sched/scheduler.h"
 #include "../sched/cpu.h"
 #include "../mem/pool.h"
+#include "../mem/heapprof.h"
+#include "../gc/census.h"
 #include "../gc/cycle.h"
 #include "../gc/trace.h"
+#include "../ds/fun.h"
+#include <dtrace.h>
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
 
+// The default time slice, in cycles, for running an actor.
+#define ACTOR_SLICE 1000000
+
+// A power of 2. Each context samples the latency of one in this many pushes.
+#define ACTOR_SAMPLE 64
+
+// A power of 2. Destroyed actors are kept for reuse for up to this many types.
+#define SHELF_SLOTS 256
+
+// The most destroyed actors kept for each type.
+#define SHELF_DEPTH 64
+
+// A compiled actor's fields follow the type descriptor and
+// PONY_ACTOR_PAD_SIZE bytes, so the runtime's fields must fit in between.
+pony_static_assert(sizeof(pony_actor_t) <= sizeof(void*) + PONY_ACTOR_PAD_SIZE,
+  "PONY_ACTOR_PAD_SIZE is smaller than pony_actor_t");
+
 enum
 {
   FLAG_BLOCKED = 1 << 0,
@@ -15,8 +37,50 @@ enum
   FLAG_SYSTEM = 1 << 2,
   FLAG_UNSCHEDULED = 1 << 3,
   FLAG_PENDINGDESTROY = 1 << 4,
+  FLAG_INTERACTIVE = 1 << 5,
+  FLAG_GC_ONBLOCK = 1 << 6,
 };
 
+struct pony_reply_t
+{
+  pony_msg_t msg;
+  pony_actor_t* to;
+  pony_fulfil_fn fulfil;
+  pony_reject_fn reject;
+  void* env;
+  void* value;
+  bool rejected;
+};
+
+typedef struct shelf_cmp_t
+{
+  union
+  {
+    struct
+    {
+      uintptr_t aba;
+      pony_actor_t* actor;
+    };
+
+    dw_t dw;
+  };
+} shelf_cmp_t;
+
+/**
+ * Destroyed actors of one type, linked through registry_next. Their queues
+ * keep their stubs, so that the next actor of the type allocates nothing.
+ */
+typedef struct shelf_t
+{
+  dw_t top;
+  pony_type_t* volatile type;
+  uint32_t volatile count;
+} shelf_t;
+
+static uint64_t actor_slice = ACTOR_SLICE;
+
+static shelf_t shelves[SHELF_SLOTS];
+
 static bool has_flag(pony_actor_t* actor, uint8_t flag)
 {
   return (actor->flags & flag) != 0;
@@ -32,9 +96,178 @@ static void unset_flag(pony_actor_t* actor, uint8_t flag)
   actor->flags &= (uint8_t)~flag;
 }
 
+/**
+ * Times the first message of a push, unless the receiver already has a timed
+ * message waiting.
+ */
+static void sample_push(pony_ctx_t* ctx, pony_actor_t* to, pony_msg_t* m)
+{
+  if((++ctx->sample_count & (ACTOR_SAMPLE - 1)) != 0)
+    return;
+
+  pony_msg_t* expect = NULL;
+  uint64_t tsc = cpu_tick();
+
+  // The receiver reads the time only after popping the message, which can't
+  // happen until we push it.
+  if(_atomic_cas(&to->sample, &expect, m))
+    to->sample_tsc = tsc;
+}
+
+static void sample_pop(pony_ctx_t* ctx, pony_actor_t* actor, pony_msg_t* m)
+{
+  if(m != _atomic_load(&actor->sample))
+    return;
+
+  uint64_t cycles = cpu_tick() - actor->sample_tsc;
+
+  if(ctx->scheduler != NULL)
+    latency_record(&ctx->latency, actor->type, cycles);
+
+  _atomic_store(&actor->sample, NULL);
+}
+
+static bool coalesces(uint32_t id)
+{
+  // Only IDs below 32 have a pending bit of their own. System messages use
+  // the top of the ID space and never coalesce.
+  return (id & ~(uint32_t)31) == PONY_MSG_COALESCE;
+}
+
+/**
+ * Block, unblock, acquire, release, conf and ack messages go to the control
+ * queue. Replies and detect messages are ordered with application messages.
+ */
+static bool is_control(uint32_t id)
+{
+  return id >= ACTORMSG_BLOCK;
+}
+
+static uint32_t pending_bit(uint32_t id)
+{
+  return (uint32_t)1 << (id & 31);
+}
+
+bool actor_setpending(pony_actor_t* to, uint32_t id)
+{
+  if(!coalesces(id))
+    return true;
+
+  uint32_t bit = pending_bit(id);
+  uint32_t old = _atomic_load(&to->pending);
+
+  do
+  {
+    if((old & bit) != 0)
+      return false;
+  } while(!_atomic_cas(&to->pending, &old, old | bit));
+
+  return true;
+}
+
+static void clear_pending(pony_actor_t* actor, uint32_t bit)
+{
+  uint32_t old = _atomic_load(&actor->pending);
+
+  while(!_atomic_cas(&actor->pending, &old, old & ~bit));
+}
+
+static void push_chain(pony_ctx_t* ctx, pony_actor_t* to, pony_msg_t* first,
+  pony_msg_t* last, size_t count)
+{
+  messageq_pack(&to->q, &first, &last);
+  sample_push(ctx, to, first);
+
+  if(messageq_pushv(&to->q, first, last, count))
+  {
+    if(!has_flag(to, FLAG_UNSCHEDULED))
+      scheduler_add(ctx, to);
+  }
+
+  // A behaviour that sends to an actor with a full mailbox is muted when it
+  // returns. Only actors run by a scheduler thread can be muted.
+  if(ctx->coalesce && (ctx->scheduler != NULL) && (to != ctx->current) &&
+    actor_overloaded(to))
+    ctx->mute_to = to;
+}
+
+static void push_control(pony_ctx_t* ctx, pony_actor_t* to, pony_msg_t* m)
+{
+  messageq_push(&to->ctrl, m);
+
+  // Either the receiver hasn't marked q empty yet, in which case the nudge
+  // makes that fail and it runs again, or we take the mark and schedule it.
+  if(messageq_nudge(&to->q) && !has_flag(to, FLAG_UNSCHEDULED))
+    scheduler_add(ctx, to);
+}
+
+static void flush_sends(pony_ctx_t* ctx)
+{
+  if(ctx->send_first == NULL)
+    return;
+
+  push_chain(ctx, ctx->send_to, ctx->send_first, ctx->send_last,
+    ctx->send_count);
+  ctx->send_to = NULL;
+  ctx->send_first = NULL;
+  ctx->send_last = NULL;
+  ctx->send_count = 0;
+}
+
+/**
+ * If the last behaviour sent to an overloaded actor, hand this actor to the
+ * scheduler to hold until the receiver has drained.
+ */
+static bool try_mute(pony_ctx_t* ctx, pony_actor_t* actor)
+{
+  pony_actor_t* to = ctx->mute_to;
+
+  if(to == NULL)
+    return false;
+
+  ctx->mute_to = NULL;
+
+  // An actor that is overloaded itself keeps running, so that two actors
+  // sending to each other can't wait on each other.
+  if(has_flag(actor, FLAG_UNSCHEDULED | FLAG_SYSTEM) ||
+    actor_overloaded(actor))
+    return false;
+
+  scheduler_mute(ctx, actor, to);
+  return true;
+}
+
+/**
+ * If the last behaviour asked to yield, end the batch early so that other
+ * actors on this scheduler get a turn.
+ */
+static bool try_yield(pony_ctx_t* ctx)
+{
+  if(!ctx->yield)
+    return false;
+
+  ctx->yield = false;
+  return true;
+}
+
+static void deliver_reply(pony_ctx_t* ctx, pony_actor_t* actor,
+  pony_reply_t* reply)
+{
+  if(reply->rejected)
+  {
+    if(reply->reject != NULL)
+      reply->reject(ctx, actor, reply->env);
+  } else if(reply->fulfil != NULL) {
+    reply->fulfil(ctx, actor, reply->value, reply->env);
+  }
+}
+
 static bool handle_message(pony_ctx_t* ctx, pony_actor_t* actor,
   pony_msg_t* msg)
 {
+  DTRACE3(ACTOR_MSG_RUN, (uintptr_t)ctx->scheduler, (uintptr_t)actor,
+    msg->id);
+
   switch(msg->id)
   {
     case ACTORMSG_ACQUIRE:
@@ -69,7 +302,10 @@ static bool handle_message(pony_ctx_t* ctx, pony_actor_t* actor,
 
     case ACTORMSG_CONF:
     {
-      if(has_flag(actor, FLAG_BLOCKED) && !has_flag(actor, FLAG_RC_CHANGED))
+      // A CONF can overtake application messages that were sent before it.
+      // If any are waiting, we are about to unblock, so don't confirm.
+      if(has_flag(actor, FLAG_BLOCKED) && !has_flag(actor, FLAG_RC_CHANGED) &&
+        (actor->continuation == NULL) && !messageq_pending(&actor->q))
       {
         // We're blocked and our RC hasn't changed since our last block
         // message, send confirm.
@@ -90,7 +326,48 @@ static bool handle_message(pony_ctx_t* ctx, pony_actor_t* actor,
         cycle_unblock(ctx, actor);
       }
 
-      actor->type->dispatch(ctx, actor, msg);
+      ctx->stats.msgs++;
+
+      // Sends made by the behaviour are held back until it sends to a
+      // different receiver or returns, so that a run of messages to one actor
+      // costs a single push.
+      ctx->coalesce = true;
+
+      // Clear the pending bit before dispatch, so that a coalescing message
+      // sent while this one is handled is queued rather than dropped.
+      if(coalesces(msg->id))
+        clear_pending(actor, pending_bit(msg->id));
+
+      if(ctx->eventlog != NULL)
+      {
+        eventlog_record(ctx->eventlog, EVENTLOG_BEHAVIOUR_START, actor, NULL,
+          msg->id);
+      }
+
+      uint64_t tsc = (ctx->profile != NULL) ? cpu_tick() : 0;
+
+      if(msg->id == ACTORMSG_REPLY)
+        deliver_reply(ctx, actor, (pony_reply_t*)msg);
+      else
+        actor->type->dispatch(ctx, actor, msg);
+
+      if(ctx->profile != NULL)
+      {
+        profile_record(ctx->profile, actor->type, msg->id,
+          cpu_tick() - tsc);
+      }
+
+      if(ctx->eventlog != NULL)
+      {
+        eventlog_record(ctx->eventlog, EVENTLOG_BEHAVIOUR_END, actor, NULL,
+          msg->id);
+      }
+
+      flush_sends(ctx);
+      ctx->coalesce = false;
+
+      // Nothing in the region outlives the behaviour, so it isn't traced.
+      region_reset(&ctx->region);
       return true;
     }
   }
@@ -98,64 +375,204 @@ static bool handle_message(pony_ctx_t* ctx, pony_actor_t* actor,
 
 static void try_gc(pony_ctx_t* ctx, pony_actor_t* actor)
 {
-  if(!heap_startgc(&actor->heap))
+  uint64_t tsc;
+
+  // Continue the sweep from an earlier pass before starting another one.
+  if(heap_sweeping(&actor->heap))
+  {
+    tsc = cpu_tick();
+    heap_sweep(&actor->heap, false);
+    ctx->stats.gc_time += cpu_tick() - tsc;
     return;
+  }
+
+  // A census needs a full pass, which is started even if none is due.
+  bool census = census_due(actor);
+  bool minor = false;
+
+  if(!heap_startgc(&actor->heap, census))
+  {
+    if(!heap_startminor(&actor->heap))
+      return;
+
+    minor = true;
+  }
+
+  DTRACE3(GC_START, (uintptr_t)ctx->scheduler, (uintptr_t)actor, minor);
+
+  if(ctx->eventlog != NULL)
+    eventlog_record(ctx->eventlog, EVENTLOG_GC_START, actor, NULL, minor);
+
+  tsc = cpu_tick();
 
 #ifdef USE_TELEMETRY
   ctx->count_gc_passes++;
-  size_t tsc = cpu_tick();
 #endif
 
-  pony_gc_mark(ctx);
+  if(minor)
+  {
+    // Trace from the actor and the remembered set, stopping at old objects.
+    pony_gc_minor(ctx);
 
-  if(actor->type->trace != NULL)
-    actor->type->trace(ctx, actor);
+    if(actor->type->trace != NULL)
+      actor->type->trace(ctx, actor);
 
-  gc_handlestack(ctx);
-  gc_sweep(ctx, &actor->gc);
-  gc_done(&actor->gc);
+    gc_markremembered(ctx, &actor->gc);
+    gc_markimmutable(ctx, &actor->gc);
+    gc_handlestack(ctx);
+    gc_sweepminor(&actor->gc);
+  } else {
+    gc_forget(&actor->gc);
+
+    if(census)
+      census_start(ctx);
+    else
+      pony_gc_mark(ctx);
+
+    if(actor->type->trace != NULL)
+      actor->type->trace(ctx, actor);
+
+    if(census)
+    {
+      census_markimmutable(ctx, &actor->gc);
+      census_handlestack(ctx);
+    } else {
+      gc_markimmutable(ctx, &actor->gc);
+      gc_handlestack(ctx);
+    }
+
+    gc_sendacquire(ctx);
+    gc_sweep(ctx, &actor->gc);
+    gc_done(&actor->gc);
+
+    if(census)
+      census_finish(ctx);
+  }
+
+  heapprof_sweep(&actor->heap);
   heap_endgc(&actor->heap);
 
+  uint64_t now = cpu_tick();
+  uint64_t elapsed = now - tsc;
+  ctx->stats.gc_time += elapsed;
+  heap_pace(&actor->heap, elapsed, now);
+
+  if(ctx->eventlog != NULL)
+    eventlog_record(ctx->eventlog, EVENTLOG_GC_END, actor, NULL, minor);
+
+  DTRACE3(GC_END, (uintptr_t)ctx->scheduler, (uintptr_t)actor, minor);
+
 #ifdef USE_TELEMETRY
-  ctx->time_in_gc += (cpu_tick() - tsc);
+  ctx->time_in_gc += (size_t)elapsed;
 #endif
 }
 
-bool actor_run(pony_ctx_t* ctx, pony_actor_t* actor, size_t batch)
+/**
+ * Sets the number of application messages the actor will handle next time it
+ * runs, so that a run takes about one time slice given the time per message
+ * measured on this run. The estimate is smoothed over successive runs.
+ */
+static void adapt_batch(pony_actor_t* actor, size_t app, uint64_t tsc)
+{
+  if(app == 0)
+    return;
+
+  uint64_t per_msg = ((cpu_tick() - tsc) / app) + 1;
+  uint64_t want = actor_slice / per_msg;
+
+  if(want == 0)
+    want = 1;
+  else if(want > UINT32_MAX)
+    want = UINT32_MAX;
+
+  if(actor->batch == 0)
+    actor->batch = (uint32_t)want;
+  else
+    actor->batch = (uint32_t)((actor->batch + want) / 2);
+}
+
+/**
+ * The next message to handle. Control messages come first, so that a backlog
+ * of application messages doesn't hold up reference counts or cycle
+ * detection for other actors.
+ */
+static pony_msg_t* next_message(pony_actor_t* actor)
+{
+  pony_msg_t* msg = messageq_pop(&actor->ctrl);
+
+  if(msg == NULL)
+    msg = messageq_pop(&actor->q);
+
+  return msg;
+}
+
+static bool run(pony_ctx_t* ctx, pony_actor_t* actor, size_t batch)
 {
   ctx->current = actor;
+  ctx->yield = false;
 
   pony_msg_t* msg;
   size_t app = 0;
+  uint64_t tsc = cpu_tick();
+
+  // Run no more messages than fit in our time slice.
+  if((actor->batch > 0) && (actor->batch < batch))
+    batch = actor->batch;
 
   while(actor->continuation != NULL)
   {
     msg = actor->continuation;
     actor->continuation = NULL;
     bool ret = handle_message(ctx, actor, msg);
-    pool_free(msg->size, msg);
+    scheduler_free_msg(msg);
 
     if(ret)
     {
-      // If we handle an application message, try to gc.
+      // If we handle an application message, try to gc, unless the actor
+      // only collects when its queue is empty.
       app++;
-      try_gc(ctx, actor);
 
-      if(app == batch)
+      if(!has_flag(actor, FLAG_GC_ONBLOCK))
+        try_gc(ctx, actor);
+
+      if(try_mute(ctx, actor))
+      {
+        adapt_batch(actor, app, tsc);
+        return false;
+      }
+
+      if((app == batch) || try_yield(ctx))
+      {
+        adapt_batch(actor, app, tsc);
         return !has_flag(actor, FLAG_UNSCHEDULED);
+      }
     }
   }
 
-  while((msg = messageq_pop(&actor->q)) != NULL)
+  while((msg = next_message(actor)) != NULL)
   {
+    sample_pop(ctx, actor, msg);
+
     if(handle_message(ctx, actor, msg))
     {
-      // If we handle an application message, try to gc.
+      // If we handle an application message, try to gc, unless the actor
+      // only collects when its queue is empty.
       app++;
-      try_gc(ctx, actor);
 
-      if(app == batch)
+      if(!has_flag(actor, FLAG_GC_ONBLOCK))
+        try_gc(ctx, actor);
+
+      if(try_mute(ctx, actor))
+      {
+        adapt_batch(actor, app, tsc);
+        return false;
+      }
+
+      if((app == batch) || try_yield(ctx))
+      {
+        adapt_batch(actor, app, tsc);
         return !has_flag(actor, FLAG_UNSCHEDULED);
+      }
     }
   }
 
@@ -163,6 +580,7 @@ bool actor_run(pony_ctx_t* ctx, pony_actor_t* actor, size_t batch)
   // empty, but we may have received further messages.
   assert(app < batch);
   try_gc(ctx, actor);
+  adapt_batch(actor, app, tsc);
 
   if(has_flag(actor, FLAG_UNSCHEDULED))
   {
@@ -175,21 +593,129 @@ bool actor_run(pony_ctx_t* ctx, pony_actor_t* actor, size_t batch)
   if(app > 0)
     return true;
 
+  // Finish any sweep left before blocking, so an idle actor doesn't hold on to
+  // memory it no longer uses. Send any releases held back, so that the cycle
+  // detector sees the same reference counts we do.
+  heap_sweep(&actor->heap, true);
+  gc_flushrelease(ctx, &actor->gc);
+
   // Tell the cycle detector we are blocking. We may not actually block if a
   // message is received between now and when we try to mark our queue as
-  // empty, but that's ok, we have still logically blocked.
-  if(!has_flag(actor, FLAG_BLOCKED | FLAG_SYSTEM) ||
-    has_flag(actor, FLAG_RC_CHANGED))
+  // empty, but that's ok, we have still logically blocked. With cycle
+  // detection off, we never block, so we never unblock either.
+  if(cycle_blocking() && (!has_flag(actor, FLAG_BLOCKED | FLAG_SYSTEM) ||
+    has_flag(actor, FLAG_RC_CHANGED)))
   {
     set_flag(actor, FLAG_BLOCKED);
     unset_flag(actor, FLAG_RC_CHANGED);
     cycle_block(ctx, actor, &actor->gc);
   }
 
-  // Return true (i.e. reschedule immediately) if our queue isn't empty.
+  // Return true (i.e. reschedule immediately) if our queue isn't empty, or a
+  // control message has arrived since we last looked.
   return !messageq_markempty(&actor->q);
 }
 
+bool actor_run(pony_ctx_t* ctx, pony_actor_t* actor, size_t batch)
+{
+  bool reschedule;
+
+  if(ctx->eventlog == NULL)
+  {
+    reschedule = run(ctx, actor, batch);
+  } else {
+    eventlog_record(ctx->eventlog, EVENTLOG_RUN_START, actor, NULL,
+      (uint32_t)batch);
+    reschedule = run(ctx, actor, batch);
+    eventlog_record(ctx->eventlog, EVENTLOG_RUN_END, actor, NULL, reschedule);
+  }
+
+  if(!reschedule)
+  {
+    DTRACE2(ACTOR_DESCHEDULED, (uintptr_t)ctx->scheduler, (uintptr_t)actor);
+  }
+
+  return reschedule;
+}
+
+void actor_setslice(uint64_t slice)
+{
+  if(slice > 0)
+    actor_slice = slice;
+}
+
+static shelf_t* find_shelf(pony_type_t* type, bool add)
+{
+  size_t mask = SHELF_SLOTS - 1;
+  size_t index = hash_ptr(type) & mask;
+
+  for(size_t i = 0; i < SHELF_SLOTS; i++)
+  {
+    shelf_t* shelf = &shelves[(index + i) & mask];
+    pony_type_t* t = _atomic_load(&shelf->type);
+
+    // If another thread claims the slot first, t is its type.
+    if((t == NULL) && (!add || _atomic_cas(&shelf->type, &t, type)))
+      return add ? shelf : NULL;
+
+    if(t == type)
+      return shelf;
+  }
+
+  return NULL;
+}
+
+static bool shelve(pony_actor_t* actor)
+{
+  shelf_t* shelf = find_shelf(actor->type, true);
+
+  // The count is only a limit, so it doesn't matter if a race overshoots it.
+  if((shelf == NULL) || (_atomic_load(&shelf->count) >= SHELF_DEPTH))
+    return false;
+
+  messageq_reset(&actor->q);
+  messageq_reset(&actor->ctrl);
+
+  shelf_cmp_t cmp, xchg;
+  cmp.dw = shelf->top;
+  xchg.actor = actor;
+
+  do
+  {
+    actor->registry_next = cmp.actor;
+    xchg.aba = cmp.aba + 1;
+  } while(!_atomic_dwcas(&shelf->top, &cmp.dw, xchg.dw));
+
+  _atomic_add(&shelf->count, 1);
+  return true;
+}
+
+static pony_actor_t* unshelve(pony_type_t* type)
+{
+  shelf_t* shelf = find_shelf(type, false);
+
+  if(shelf == NULL)
+    return NULL;
+
+  shelf_cmp_t cmp, xchg;
+  cmp.dw = shelf->top;
+
+  do
+  {
+    // Another thread may have taken this actor already. Pool memory stays
+    // mapped, so reading its link is safe, and the ABA count makes the swap
+    // fail.
+    if(cmp.actor == NULL)
+      return NULL;
+
+    xchg.actor = cmp.actor->registry_next;
+    xchg.aba = cmp.aba + 1;
+  } while(!_atomic_dwcas(&shelf->top, &cmp.dw, xchg.dw));
+
+  _atomic_add(&shelf->count, (uint32_t)-1);
+  return cmp.actor;
+}
+
 void actor_destroy(pony_actor_t* actor)
 {
   assert(has_flag(actor, FLAG_PENDINGDESTROY));
@@ -203,10 +729,17 @@ void actor_destroy(pony_actor_t* actor)
   while(((uintptr_t)head & (uintptr_t)1) != (uintptr_t)1)
     head = _atomic_load(&actor->q.head);
 
-  messageq_destroy(&actor->q);
+  registry_remove(actor);
   gc_destroy(&actor->gc);
   heap_destroy(&actor->heap);
 
+  // Keep the actor for the next pony_create of its type if there is room.
+  if(shelve(actor))
+    return;
+
+  messageq_destroy(&actor->q);
+  messageq_destroy(&actor->ctrl);
+
   // Free variable sized actors correctly.
   pool_free_size(actor->type->size, actor);
 }
@@ -221,6 +754,11 @@ heap_t* actor_heap(pony_actor_t* actor)
   return &actor->heap;
 }
 
+uint32_t actor_node(pony_actor_t* actor)
+{
+  return actor->node;
+}
+
 bool actor_pendingdestroy(pony_actor_t* actor)
 {
   return has_flag(actor, FLAG_PENDINGDESTROY);
@@ -259,6 +797,34 @@ void actor_setsystem(pony_actor_t* actor)
   set_flag(actor, FLAG_SYSTEM);
 }
 
+bool actor_interactive(pony_actor_t* actor)
+{
+  return has_flag(actor, FLAG_INTERACTIVE);
+}
+
+uint32_t actor_pin(pony_actor_t* actor)
+{
+  return actor->pin;
+}
+
+bool actor_overloaded(pony_actor_t* actor)
+{
+  if(_atomic_load(&actor->pressure))
+    return true;
+
+  return (actor->capacity > 0) &&
+    (messageq_depth(&actor->q) > actor->capacity);
+}
+
+bool actor_drained(pony_actor_t* actor)
+{
+  if(_atomic_load(&actor->pressure))
+    return false;
+
+  return (actor->capacity == 0) ||
+    (messageq_depth(&actor->q) <= (actor->capacity / 2));
+}
+
 pony_actor_t* pony_create(pony_ctx_t* ctx, pony_type_t* type)
 {
   assert(type != NULL);
@@ -267,12 +833,33 @@ pony_actor_t* pony_create(pony_ctx_t* ctx, pony_type_t* type)
   ctx->count_alloc_actors++;
 #endif
 
-  // allocate variable sized actors correctly
-  pony_actor_t* actor = (pony_actor_t*)pool_alloc_size(type->size);
-  memset(actor, 0, type->size);
+  pony_actor_t* actor = unshelve(type);
+
+  if(actor != NULL)
+  {
+    // Reuse a destroyed actor of the same type, and the stubs of its queues.
+    messageq_t q = actor->q;
+    messageq_t ctrl = actor->ctrl;
+    memset(actor, 0, type->size);
+    actor->q = q;
+    actor->ctrl = ctrl;
+  } else {
+    // allocate variable sized actors correctly
+    actor = (pony_actor_t*)pool_alloc_size(type->size);
+    memset(actor, 0, type->size);
+    messageq_init(&actor->q);
+    messageq_init(&actor->ctrl);
+
+    // Mailbox bounds and pony_queue_depth() need the depth of q. Application
+    // messages are pushed in batches, so this is one atomic add per batch.
+    messageq_setcounted(&actor->q);
+  }
+
   actor->type = type;
 
-  messageq_init(&actor->q);
+  // Actors live on the NUMA node of the scheduler that created them.
+  actor->node = scheduler_node(ctx);
+
   heap_init(&actor->heap);
   gc_done(&actor->gc);
 
@@ -286,6 +873,7 @@ pony_actor_t* pony_create(pony_ctx_t* ctx, pony_type_t* type)
     actor->gc.rc = 0;
   }
 
+  registry_add(actor);
   return actor;
 }
 
@@ -300,7 +888,7 @@ void pony_destroy(pony_actor_t* actor)
 pony_msg_t* pony_alloc_msg(uint32_t size, uint32_t id)
 {
   pony_msg_t* msg = (pony_msg_t*)pool_alloc(size);
-  msg->size = size;
+  msg->size = size | (scheduler_tag() << MSG_OWNER_SHIFT);
   msg->id = id;
 
   return msg;
@@ -321,11 +909,70 @@ void pony_sendv(pony_ctx_t* ctx, pony_actor_t* to, pony_msg_t* m)
   }
 #endif
 
-  if(messageq_push(&to->q, m))
+  DTRACE4(ACTOR_MSG_SEND, (uintptr_t)ctx->scheduler, m->id,
+    (uintptr_t)ctx->current, (uintptr_t)to);
+
+  if(ctx->eventlog != NULL)
+    eventlog_record(ctx->eventlog, EVENTLOG_SEND, ctx->current, to, m->id);
+
+  // Control messages skip the held sends. Nothing held can depend on them
+  // arriving later: an acquire only adds references, and releases are sent
+  // outside behaviours.
+  if(is_control(m->id))
   {
-    if(!has_flag(to, FLAG_UNSCHEDULED))
-      scheduler_add(ctx, to);
+    push_control(ctx, to, m);
+    return;
+  }
+
+  if(!actor_setpending(to, m->id))
+  {
+    // The receiver hasn't handled the last one yet, so this one is redundant.
+    scheduler_free_msg(m);
+    return;
   }
+
+  if(ctx->coalesce)
+  {
+    // Sending to a different actor delivers everything held so far first, so
+    // causal order is the same as if each message had been pushed directly.
+    if(ctx->send_to != to)
+      flush_sends(ctx);
+
+    m->next = NULL;
+
+    if(ctx->send_first == NULL)
+    {
+      ctx->send_to = to;
+      ctx->send_first = m;
+    } else {
+      ctx->send_last->next = m;
+    }
+
+    ctx->send_last = m;
+    ctx->send_count++;
+    return;
+  }
+
+  push_chain(ctx, to, m, m, 1);
+}
+
+void pony_sendv_batch(pony_ctx_t* ctx, pony_actor_t* to, pony_msg_t* first,
+  pony_msg_t* last)
+{
+  // Anything held from this behaviour was sent before the chain, so it has
+  // to arrive first.
+  flush_sends(ctx);
+
+  size_t count = 1;
+
+  for(pony_msg_t* m = first; m != last; m = m->next)
+  {
+    assert(!is_control(m->id) && !coalesces(m->id));
+    count++;
+  }
+
+  assert(!is_control(last->id) && !coalesces(last->id));
+  push_chain(ctx, to, first, last, count);
 }
 
 void pony_send(pony_ctx_t* ctx, pony_actor_t* to, uint32_t id)
@@ -352,6 +999,40 @@ void pony_sendi(pony_ctx_t* ctx, pony_actor_t* to, uint32_t id, intptr_t i)
   pony_sendv(ctx, to, &m->msg);
 }
 
+pony_reply_t* pony_reply(pony_ctx_t* ctx, pony_fulfil_fn fulfil,
+  pony_reject_fn reject, void* env)
+{
+  assert(ctx->current != NULL);
+
+  pony_reply_t* reply = (pony_reply_t*)pony_alloc_msg(
+    POOL_INDEX(sizeof(pony_reply_t)), ACTORMSG_REPLY);
+  reply->to = ctx->current;
+  reply->fulfil = fulfil;
+  reply->reject = reject;
+  reply->env = env;
+  reply->value = NULL;
+  reply->rejected = false;
+
+  return reply;
+}
+
+void pony_reply_fulfil(pony_ctx_t* ctx, pony_reply_t* reply, void* value)
+{
+  reply->value = value;
+  pony_sendv(ctx, reply->to, &reply->msg);
+}
+
+void pony_reply_reject(pony_ctx_t* ctx, pony_reply_t* reply)
+{
+  reply->rejected = true;
+  pony_sendv(ctx, reply->to, &reply->msg);
+}
+
+void pony_tracereply(pony_ctx_t* ctx, pony_reply_t* reply)
+{
+  pony_traceactor(ctx, reply->to);
+}
+
 void pony_continuation(pony_actor_t* to, pony_msg_t* m)
 {
   assert(to->continuation == NULL);
@@ -359,6 +1040,16 @@ void pony_continuation(pony_actor_t* to, pony_msg_t* m)
   to->continuation = m;
 }
 
+static void* sample_alloc(pony_ctx_t* ctx, void* p, size_t size)
+{
+  if(ctx->heapprof > size)
+    ctx->heapprof -= size;
+  else
+    ctx->heapprof = heapprof_sample(&ctx->current->heap, p, size);
+
+  return p;
+}
+
 void* pony_alloc(pony_ctx_t* ctx, size_t size)
 {
 #ifdef USE_TELEMETRY
@@ -366,17 +1057,20 @@ void* pony_alloc(pony_ctx_t* ctx, size_t size)
   ctx->count_alloc_size += size;
 #endif
 
-  return heap_alloc(ctx->current, &ctx->current->heap, size);
+  return sample_alloc(ctx,
+    heap_alloc(ctx->current, &ctx->current->heap, size), size);
 }
 
 void* pony_alloc_small(pony_ctx_t* ctx, uint32_t sizeclass)
 {
 #ifdef USE_TELEMETRY
   ctx->count_alloc++;
-  ctx->count_alloc_size += HEAP_MIN << sizeclass;
+  ctx->count_alloc_size += HEAP_SIZECLASS_SIZE(sizeclass);
 #endif
 
-  return heap_alloc_small(ctx->current, &ctx->current->heap, sizeclass);
+  return sample_alloc(ctx,
+    heap_alloc_small(ctx->current, &ctx->current->heap, sizeclass),
+    HEAP_SIZECLASS_SIZE(sizeclass));
 }
 
 void* pony_alloc_large(pony_ctx_t* ctx, size_t size)
@@ -386,7 +1080,35 @@ void* pony_alloc_large(pony_ctx_t* ctx, size_t size)
   ctx->count_alloc_size += size;
 #endif
 
-  return heap_alloc_large(ctx->current, &ctx->current->heap, size);
+  return sample_alloc(ctx,
+    heap_alloc_large(ctx->current, &ctx->current->heap, size), size);
+}
+
+void* pony_alloc_frozen(pony_ctx_t* ctx, size_t size)
+{
+#ifdef USE_TELEMETRY
+  ctx->count_alloc++;
+  ctx->count_alloc_size += size;
+#else
+  (void)ctx;
+#endif
+
+  return heap_alloc_frozen(size);
+}
+
+void* pony_alloc_region(pony_ctx_t* ctx, size_t size)
+{
+#ifdef USE_TELEMETRY
+  ctx->count_alloc++;
+  ctx->count_alloc_size += size;
+#endif
+
+  return region_alloc(&ctx->region, size);
+}
+
+size_t pony_region_used(pony_ctx_t* ctx)
+{
+  return ctx->region.used;
 }
 
 void* pony_realloc(pony_ctx_t* ctx, void* p, size_t size)
@@ -396,7 +1118,13 @@ void* pony_realloc(pony_ctx_t* ctx, void* p, size_t size)
   ctx->count_alloc_size += size;
 #endif
 
-  return heap_realloc(ctx->current, &ctx->current->heap, p, size);
+  void* q = heap_realloc(ctx->current, &ctx->current->heap, p, size);
+
+  // Only a move is a new allocation.
+  if(q != p)
+    sample_alloc(ctx, q, size);
+
+  return q;
 }
 
 void* pony_alloc_final(pony_ctx_t* ctx, size_t size, pony_final_fn final)
@@ -406,8 +1134,23 @@ void* pony_alloc_final(pony_ctx_t* ctx, size_t size, pony_final_fn final)
   ctx->count_alloc_size += size;
 #endif
 
-  void* p = heap_alloc(ctx->current, &ctx->current->heap, size);
-  gc_register_final(ctx, p, final);
+  void* p = sample_alloc(ctx,
+    heap_alloc(ctx->current, &ctx->current->heap, size), size);
+  gc_register_final(ctx, p, final, false);
+  return p;
+}
+
+void* pony_alloc_final_deferred(pony_ctx_t* ctx, size_t size,
+  pony_final_fn final)
+{
+#ifdef USE_TELEMETRY
+  ctx->count_alloc++;
+  ctx->count_alloc_size += size;
+#endif
+
+  void* p = sample_alloc(ctx,
+    heap_alloc(ctx->current, &ctx->current->heap, size), size);
+  gc_register_final(ctx, p, final, true);
   return p;
 }
 
@@ -436,6 +1179,73 @@ void pony_unschedule(pony_ctx_t* ctx, pony_actor_t* actor)
   set_flag(actor, FLAG_UNSCHEDULED);
 }
 
+void pony_setclass(pony_actor_t* actor, pony_sched_class_t sched_class)
+{
+  if(sched_class == PONY_SCHED_INTERACTIVE)
+    set_flag(actor, FLAG_INTERACTIVE);
+  else
+    unset_flag(actor, FLAG_INTERACTIVE);
+}
+
+void pony_pin(pony_actor_t* actor, uint32_t index)
+{
+  uint32_t count = pony_scheduler_count();
+
+  if((count == 0) || (count > MSG_OWNER_MAX))
+    return;
+
+  actor->pin = (uint16_t)((index % count) + 1);
+}
+
+void pony_sticky(pony_actor_t* actor)
+{
+  uint32_t tag = scheduler_tag();
+
+  if(tag != 0)
+    actor->pin = (uint16_t)tag;
+}
+
+void pony_unpin(pony_actor_t* actor)
+{
+  actor->pin = 0;
+}
+
+void pony_setgc(pony_actor_t* actor, size_t initial, double factor,
+  bool onblock)
+{
+  heap_setpolicy(&actor->heap, initial, factor);
+
+  if(onblock)
+    set_flag(actor, FLAG_GC_ONBLOCK);
+  else
+    unset_flag(actor, FLAG_GC_ONBLOCK);
+}
+
+void pony_setcapacity(pony_actor_t* actor, uint32_t capacity)
+{
+  actor->capacity = capacity;
+}
+
+void pony_setpressure(pony_actor_t* actor, bool pressure)
+{
+  _atomic_store(&actor->pressure, pressure);
+}
+
+void pony_yield()
+{
+  pony_ctx()->yield = true;
+}
+
+void pony_setsegment(pony_actor_t* actor)
+{
+  messageq_setsegment(&actor->q);
+}
+
+size_t pony_queue_depth(pony_actor_t* actor)
+{
+  return messageq_depth(&actor->q) + messageq_depth(&actor->ctrl);
+}
+
 void pony_become(pony_ctx_t* ctx, pony_actor_t* actor)
 {
   ctx->current = actor;
@@ -11,6 +11,8 @@
 
 PONY_EXTERN_C_BEGIN
 
+#define ACTORMSG_DETECT (UINT32_MAX - 8)
+#define ACTORMSG_REPLY (UINT32_MAX - 7)
 #define ACTORMSG_BLOCK (UINT32_MAX - 6)
 #define ACTORMSG_UNBLOCK (UINT32_MAX - 5)
 #define ACTORMSG_ACQUIRE (UINT32_MAX - 4)
@@ -22,22 +24,55 @@ typedef struct pony_actor_t
 {
   pony_type_t* type;
   messageq_t q;
+
+  // Garbage collection and cycle detection messages, handled before anything
+  // in q. Only q is ever marked empty, so it alone decides whether the actor
+  // is scheduled.
+  messageq_t ctrl;
+
   pony_msg_t* continuation;
+  uint32_t batch;
   uint8_t flags;
+  uint16_t pin;
 
   // keep things accessed by other actors on a separate cache line
-  __pony_spec_align__(heap_t heap, 64); // 52/104 bytes
-  gc_t gc; // 44/80 bytes
+  __pony_spec_align__(heap_t heap, 64); // 164/304 bytes
+  gc_t gc; // 72/136 bytes
+
+  // Read by actors that send to this one.
+  uint32_t node;
+  uint32_t capacity;
+
+  // Set by the actor itself, read by actors that send to it.
+  bool volatile pressure;
+
+  // One message at a time is timed from being pushed to being dispatched.
+  uint64_t sample_tsc;
+  pony_msg_t* volatile sample;
+
+  // Bits for coalescing messages that have been sent but not yet handled.
+  uint32_t volatile pending;
+
+  // Set by other threads to ask for a heap census at the next gc pass.
+  uint32_t volatile census;
+
+  // Links in the registry of live actors.
+  struct pony_actor_t* registry_next;
+  struct pony_actor_t* registry_prev;
 } pony_actor_t;
 
 bool actor_run(pony_ctx_t* ctx, pony_actor_t* actor, size_t batch);
 
+void actor_setslice(uint64_t slice);
+
 void actor_destroy(pony_actor_t* actor);
 
 gc_t* actor_gc(pony_actor_t* actor);
 
 heap_t* actor_heap(pony_actor_t* actor);
 
+uint32_t actor_node(pony_actor_t* actor);
+
 bool actor_pendingdestroy(pony_actor_t* actor);
 
 void actor_setpendingdestroy(pony_actor_t* actor);
@@ -48,6 +83,34 @@ void actor_sendrelease(pony_ctx_t* ctx, pony_actor_t* actor);
 
 void actor_setsystem(pony_actor_t* actor);
 
+bool actor_interactive(pony_actor_t* actor);
+
+/**
+ * The scheduler tag (see scheduler_tag()) of the scheduler thread the actor is
+ * pinned to, or 0 if it isn't pinned.
+ */
+uint32_t actor_pin(pony_actor_t* actor);
+
+/**
+ * Returns true if the actor is under pressure, or has a bounded mailbox with
+ * more messages queued than its capacity.
+ */
+bool actor_overloaded(pony_actor_t* actor);
+
+/**
+ * Returns true if a sender muted on this actor can run again, i.e. the actor
+ * is no longer under pressure and the queue is at or below half of its
+ * capacity.
+ */
+bool actor_drained(pony_actor_t* actor);
+
+/**
+ * Marks a coalescing message as pending on the receiver. Returns false if one
+ * with the same ID is already pending, in which case the new message should
+ * be dropped. Messages that don't coalesce always return true.
+ */
+bool actor_setpending(pony_actor_t* to, uint32_t id);
+
 pony_actor_t* actor_next(pony_actor_t* actor);
 
 void actor_setnext(pony_actor_t* actor, pony_actor_t* next);
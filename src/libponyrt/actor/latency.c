@@ -0,0 +1,111 @@
+#include "latency.h"
+#include "../ds/fun.h"
+#include "../mem/pool.h"
+#include <string.h>
+
+// A power of 2. Types beyond this many aren't recorded.
+#define LATENCY_SLOTS 256
+
+typedef struct latency_slot_t
+{
+  pony_type_t* volatile type;
+  pony_latency_t hist;
+} latency_slot_t;
+
+struct latency_t
+{
+  latency_slot_t slot[LATENCY_SLOTS];
+};
+
+static latency_slot_t* find(latency_t* table, pony_type_t* type, bool add)
+{
+  size_t mask = LATENCY_SLOTS - 1;
+  size_t index = hash_ptr(type) & mask;
+
+  for(size_t i = 0; i < LATENCY_SLOTS; i++)
+  {
+    latency_slot_t* slot = &table->slot[(index + i) & mask];
+    pony_type_t* t = _atomic_load(&slot->type);
+
+    if(t == type)
+      return slot;
+
+    if(t == NULL)
+    {
+      if(!add)
+        return NULL;
+
+      // The histogram is zeroed, so publishing the type is enough.
+      _atomic_store(&slot->type, type);
+      return slot;
+    }
+  }
+
+  return NULL;
+}
+
+void latency_record(latency_t** table, pony_type_t* type, uint64_t cycles)
+{
+  latency_t* t = *table;
+
+  if(t == NULL)
+  {
+    t = (latency_t*)pool_alloc_size(sizeof(latency_t));
+    memset(t, 0, sizeof(latency_t));
+    _atomic_store(table, t);
+  }
+
+  latency_slot_t* slot = find(t, type, true);
+
+  if(slot == NULL)
+    return;
+
+  // Bucket i holds latencies in [2^i, 2^(i + 1)) cycles, and the last bucket
+  // holds everything longer.
+  uint32_t bucket = 0;
+
+  while((cycles > 1) && (bucket < (PONY_LATENCY_BUCKETS - 1)))
+  {
+    cycles >>= 1;
+    bucket++;
+  }
+
+  slot->hist.buckets[bucket]++;
+  slot->hist.count++;
+}
+
+bool latency_sum(latency_t* table, pony_type_t* type, pony_latency_t* hist)
+{
+  if(table == NULL)
+    return false;
+
+  latency_slot_t* slot = find(table, type, false);
+
+  if(slot == NULL)
+    return false;
+
+  for(uint32_t i = 0; i < PONY_LATENCY_BUCKETS; i++)
+    hist->buckets[i] += slot->hist.buckets[i];
+
+  hist->count += slot->hist.count;
+  return true;
+}
+
+pony_type_t* latency_type(latency_t* table, size_t slot)
+{
+  if((table == NULL) || (slot >= LATENCY_SLOTS))
+    return NULL;
+
+  return _atomic_load(&table->slot[slot].type);
+}
+
+size_t latency_slots()
+{
+  return LATENCY_SLOTS;
+}
+
+void latency_free(latency_t* table)
+{
+  if(table != NULL)
+    pool_free_size(sizeof(latency_t), table);
+}
@@ -0,0 +1,42 @@
+#ifndef actor_latency_h
+#define actor_latency_h
+
+#include <pony.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <platform.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * A table of message latency histograms, keyed by actor type. Each scheduler
+ * thread has its own table, and only that thread records in it. Other threads
+ * may read it at any time.
+ */
+typedef struct latency_t latency_t;
+
+/**
+ * Records the time between a message being pushed and being dispatched. The
+ * table is allocated on first use.
+ */
+void latency_record(latency_t** table, pony_type_t* type, uint64_t cycles);
+
+/**
+ * Adds the histogram for a type to hist. Returns false if the table has no
+ * samples for that type.
+ */
+bool latency_sum(latency_t* table, pony_type_t* type, pony_latency_t* hist);
+
+/**
+ * Returns the type in a slot of the table, or NULL if the slot is empty. Slot
+ * indices run from 0 to latency_slots() - 1.
+ */
+pony_type_t* latency_type(latency_t* table, size_t slot);
+
+size_t latency_slots();
+
+void latency_free(latency_t* table);
+
+PONY_EXTERN_C_END
+
+#endif
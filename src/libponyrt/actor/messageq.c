@@ -1,8 +1,74 @@
 #include "messageq.h"
+#include "../sched/scheduler.h"
 #include "../mem/pool.h"
 #include <string.h>
 #include <assert.h>
 
+// A segment is 2k bytes: one cache line for the claim counter, and the rest
+// for slots.
+#define MSGSEG_SLOTS 31
+#define MSGSEG_SLOT_SIZE 64
+
+// Messages up to this pool index fit in a slot.
+#define MSGSEG_INDEX POOL_INDEX(MSGSEG_SLOT_SIZE)
+
+// The size field of a slot message is MSGSEG_FLAG plus the slot index, or
+// MSGSEG_FREE when the slot is free.
+#define MSGSEG_FLAG 0x80000000
+#define MSGSEG_FREE 0xFFFFFFFF
+
+typedef struct msgslot_t
+{
+  union
+  {
+    uint32_t volatile state;
+    char data[MSGSEG_SLOT_SIZE];
+  };
+} msgslot_t;
+
+typedef struct msgseg_t
+{
+  uint32_t volatile next;
+  char pad[MSGSEG_SLOT_SIZE - sizeof(uint32_t)];
+  msgslot_t slot[MSGSEG_SLOTS];
+} msgseg_t;
+
+static void msg_free(messageq_t* q, pony_msg_t* m)
+{
+  if((m->size & MSGSEG_FLAG) != 0)
+  {
+    msgslot_t* slot = &q->segment->slot[m->size & ~MSGSEG_FLAG];
+    _atomic_store(&slot->state, MSGSEG_FREE);
+    return;
+  }
+
+  scheduler_free_msg(m);
+}
+
+static pony_msg_t* msg_pack(msgseg_t* seg, pony_msg_t* m)
+{
+  uint32_t size = MSG_INDEX(m->size);
+
+  if(size > MSGSEG_INDEX)
+    return m;
+
+  // Claim the next slot. If its message hasn't been freed yet, don't wait for
+  // it, just push the original.
+  uint32_t index = _atomic_add(&seg->next, 1) % MSGSEG_SLOTS;
+  msgslot_t* slot = &seg->slot[index];
+  uint32_t expect = MSGSEG_FREE;
+
+  if(!_atomic_cas(&slot->state, &expect, MSGSEG_FLAG | index))
+    return m;
+
+  pony_msg_t* copy = (pony_msg_t*)slot->data;
+  memcpy(copy, m, (size_t)1 << (POOL_MIN_BITS + size));
+  copy->size = MSGSEG_FLAG | index;
+  pool_free(size, m);
+
+  return copy;
+}
+
 #ifndef NDEBUG
 
 size_t messageq_size_debug(messageq_t* q)
@@ -29,6 +95,10 @@ void messageq_init(messageq_t* q)
 
   q->head = (pony_msg_t*)((uintptr_t)stub | 1);
   q->tail = stub;
+  q->pushed = 0;
+  q->popped = 0;
+  q->segment = NULL;
+  q->counted = false;
 
 #ifndef NDEBUG
   messageq_size_debug(q);
@@ -38,27 +108,76 @@ void messageq_init(messageq_t* q)
 void messageq_destroy(messageq_t* q)
 {
   pony_msg_t* tail = q->tail;
-  assert(((uintptr_t)q->head & ~(uintptr_t)1) == (uintptr_t)tail);
+  assert(((uintptr_t)q->head & ~(uintptr_t)3) == (uintptr_t)tail);
+
+  msg_free(q, tail);
+
+  if(q->segment != NULL)
+  {
+    POOL_FREE(msgseg_t, q->segment);
+    q->segment = NULL;
+  }
 
-  pool_free(tail->size, tail);
   q->head = NULL;
   q->tail = NULL;
 }
 
+void messageq_reset(messageq_t* q)
+{
+  // The stub may be one of the segment's slots.
+  if(q->segment != NULL)
+  {
+    bool counted = q->counted;
+    messageq_destroy(q);
+    messageq_init(q);
+    q->counted = counted;
+    return;
+  }
+
+  pony_msg_t* tail = q->tail;
+  assert(((uintptr_t)q->head & ~(uintptr_t)3) == (uintptr_t)tail);
+  assert(tail->next == NULL);
+
+  q->head = (pony_msg_t*)((uintptr_t)tail | 1);
+  q->pushed = 0;
+  q->popped = 0;
+}
+
 bool messageq_push(messageq_t* q, pony_msg_t* m)
 {
   m->next = NULL;
 
+  if(q->counted)
+    _atomic_add(&q->pushed, 1);
+
   pony_msg_t* prev = (pony_msg_t*)_atomic_exchange(&q->head, m);
 
   bool was_empty = ((uintptr_t)prev & 1) != 0;
-  prev = (pony_msg_t*)((uintptr_t)prev & ~(uintptr_t)1);
+  prev = (pony_msg_t*)((uintptr_t)prev & ~(uintptr_t)3);
 
   _atomic_store(&prev->next, m);
 
   return was_empty;
 }
 
+bool messageq_pushv(messageq_t* q, pony_msg_t* first, pony_msg_t* last,
+  size_t count)
+{
+  last->next = NULL;
+
+  if(q->counted)
+    _atomic_add(&q->pushed, (uint32_t)count);
+
+  pony_msg_t* prev = (pony_msg_t*)_atomic_exchange(&q->head, last);
+
+  bool was_empty = ((uintptr_t)prev & 1) != 0;
+  prev = (pony_msg_t*)((uintptr_t)prev & ~(uintptr_t)3);
+
+  _atomic_store(&prev->next, first);
+
+  return was_empty;
+}
+
 pony_msg_t* messageq_pop(messageq_t* q)
 {
   pony_msg_t* tail = q->tail;
@@ -67,12 +186,66 @@ pony_msg_t* messageq_pop(messageq_t* q)
   if(next != NULL)
   {
     q->tail = next;
-    pool_free(tail->size, tail);
+
+    if(q->counted)
+      _atomic_store(&q->popped, q->popped + 1);
+    msg_free(q, tail);
   }
 
   return next;
 }
 
+void messageq_setcounted(messageq_t* q)
+{
+  q->counted = true;
+}
+
+void messageq_setsegment(messageq_t* q)
+{
+  if(q->segment != NULL)
+    return;
+
+  msgseg_t* seg = POOL_ALLOC(msgseg_t);
+  seg->next = 0;
+
+  for(uint32_t i = 0; i < MSGSEG_SLOTS; i++)
+    seg->slot[i].state = MSGSEG_FREE;
+
+  q->segment = seg;
+}
+
+void messageq_pack(messageq_t* q, pony_msg_t** first, pony_msg_t** last)
+{
+  msgseg_t* seg = q->segment;
+
+  if(seg == NULL)
+    return;
+
+  pony_msg_t* prev = NULL;
+  pony_msg_t* m = *first;
+
+  while(true)
+  {
+    pony_msg_t* next = m->next;
+    bool end = m == *last;
+    pony_msg_t* p = msg_pack(seg, m);
+
+    if(prev == NULL)
+      *first = p;
+    else
+      prev->next = p;
+
+    prev = p;
+
+    if(end)
+      break;
+
+    m = next;
+  }
+
+  *last = prev;
+}
+
 bool messageq_markempty(messageq_t* q)
 {
   pony_msg_t* tail = q->tail;
@@ -81,6 +254,14 @@ bool messageq_markempty(messageq_t* q)
   if(((uintptr_t)head & 1) != 0)
     return true;
 
+  // A nudge means something else the consumer reads has changed. Clear it and
+  // report the queue as not empty, so that the consumer looks again.
+  if(head == (pony_msg_t*)((uintptr_t)tail | 2))
+  {
+    _atomic_cas(&q->head, &head, tail);
+    return false;
+  }
+
   if(head != tail)
     return false;
 
@@ -88,3 +269,41 @@ bool messageq_markempty(messageq_t* q)
 
   return _atomic_cas(&q->head, &tail, head);
 }
+
+bool messageq_nudge(messageq_t* q)
+{
+  pony_msg_t* head = _atomic_load(&q->head);
+
+  while(true)
+  {
+    uintptr_t bits = (uintptr_t)head & 3;
+    pony_msg_t* next;
+
+    if(bits == 2)
+      return false;
+
+    if(bits == 1)
+      next = (pony_msg_t*)((uintptr_t)head & ~(uintptr_t)1);
+    else
+      next = (pony_msg_t*)((uintptr_t)head | 2);
+
+    if(_atomic_cas(&q->head, &head, next))
+      return bits == 1;
+  }
+}
+
+bool messageq_pending(messageq_t* q)
+{
+  pony_msg_t* head = _atomic_load(&q->head);
+  return ((uintptr_t)head & ~(uintptr_t)3) != (uintptr_t)q->tail;
+}
+
+size_t messageq_depth(messageq_t* q)
+{
+  // Read popped first. A message is counted as pushed before it can be
+  // popped, so the result can't underflow. The counters wrap, but the
+  // difference is still right.
+  uint32_t popped = _atomic_load(&q->popped);
+  uint32_t pushed = _atomic_load(&q->pushed);
+  return (uint32_t)(pushed - popped);
+}
@@ -6,22 +6,94 @@
 
 PONY_EXTERN_C_BEGIN
 
+// A message's size field holds its pool index in the low bits. The high bits
+// record which scheduler thread allocated it, so that it can be returned
+// there when it is freed.
+#define MSG_INDEX(SIZE) ((SIZE) & 0xFFFF)
+#define MSG_OWNER_SHIFT 16
+#define MSG_OWNER_MAX 0x7FFF
+
 typedef struct messageq_t
 {
   pony_msg_t* volatile head;
   pony_msg_t* tail;
+
+  // The depth is pushed - popped. Only the consumer changes popped. Neither
+  // is kept unless the queue is counted.
+  uint32_t volatile pushed;
+  uint32_t volatile popped;
+
+  // Optional inline slots for small messages.
+  struct msgseg_t* segment;
+
+  bool counted;
 } messageq_t;
 
 void messageq_init(messageq_t* q);
 
 void messageq_destroy(messageq_t* q);
 
+/**
+ * Makes an empty queue that is no longer shared as good as new, keeping its
+ * stub rather than allocating another.
+ */
+void messageq_reset(messageq_t* q);
+
 bool messageq_push(messageq_t* q, pony_msg_t* m);
 
+/**
+ * Pushes a chain of messages, already linked through their next fields, with
+ * a single exchange on the head. Returns true if the queue was empty.
+ */
+bool messageq_pushv(messageq_t* q, pony_msg_t* first, pony_msg_t* last,
+  size_t count);
+
 pony_msg_t* messageq_pop(messageq_t* q);
 
+/**
+ * Gives the queue a segment of cache line sized slots. Small messages pushed
+ * after messageq_pack() are copied into free slots, so that the consumer reads
+ * them from contiguous memory and the sender's pool gets the original back at
+ * once. Messages that are too big, or that find their slot still in use, are
+ * pushed as they are. This must be done before the queue is shared.
+ */
+void messageq_setsegment(messageq_t* q);
+
+/**
+ * Makes the queue count the messages pushed and popped, so that
+ * messageq_depth() can report them. Queues that nobody asks the depth of skip
+ * the atomic add on each push. This must be done before the queue is shared.
+ */
+void messageq_setcounted(messageq_t* q);
+
+/**
+ * Moves the small messages in a chain into segment slots, relinking the chain
+ * and updating first and last. Does nothing if the queue has no segment.
+ */
+void messageq_pack(messageq_t* q, pony_msg_t** first, pony_msg_t** last);
+
 bool messageq_markempty(messageq_t* q);
 
+/**
+ * Tells the consumer to look again before it marks the queue empty, without
+ * pushing a message. If the queue is already marked empty, the mark is taken
+ * instead, and this returns true: the caller must then schedule the consumer.
+ */
+bool messageq_nudge(messageq_t* q);
+
+/**
+ * Returns true if a message has been pushed that hasn't been popped, even if
+ * the push hasn't finished linking it yet. Only the consumer can call this.
+ */
+bool messageq_pending(messageq_t* q);
+
+/**
+ * The number of messages pushed but not yet popped, or zero if the queue isn't
+ * counted. This can be called from any thread, and is exact only when no
+ * other thread is using the queue.
+ */
+size_t messageq_depth(messageq_t* q);
+
 PONY_EXTERN_C_END
 
 #endif
@@ -0,0 +1,277 @@
+#include "profile.h"
+#include "actor.h"
+#include "../sched/cpu.h"
+#include "../ds/fun.h"
+#include "../lang/clock.h"
+#include "../mem/pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+// A power of 2. Behaviours beyond this many on a scheduler aren't recorded.
+#define PROFILE_SLOTS 1024
+
+typedef struct profile_slot_t
+{
+  pony_type_t* volatile type;
+  uint32_t id;
+  uint64_t count;
+  uint64_t cycles;
+} profile_slot_t;
+
+struct profile_t
+{
+  profile_slot_t slot[PROFILE_SLOTS];
+  struct profile_t* link;
+};
+
+typedef struct profile_entry_t
+{
+  pony_type_t* type;
+  uint32_t id;
+  uint64_t count;
+  uint64_t cycles;
+} profile_entry_t;
+
+static size_t profile_count;
+static uint64_t start_tsc;
+static uint64_t start_nanos;
+static profile_t* profiles;
+
+static profile_slot_t* find(profile_t* prof, pony_type_t* type, uint32_t id)
+{
+  size_t mask = PROFILE_SLOTS - 1;
+  size_t index = (hash_ptr(type) ^ hash_int32(id)) & mask;
+
+  for(size_t i = 0; i < PROFILE_SLOTS; i++)
+  {
+    profile_slot_t* slot = &prof->slot[(index + i) & mask];
+    pony_type_t* t = _atomic_load(&slot->type);
+
+    if(t == NULL)
+    {
+      // The counts are zeroed, so publishing the type after the ID is enough.
+      slot->id = id;
+      _atomic_store(&slot->type, type);
+      return slot;
+    }
+
+    if((t == type) && (slot->id == id))
+      return slot;
+  }
+
+  return NULL;
+}
+
+void profile_setcount(size_t count)
+{
+  profile_count = count;
+}
+
+profile_t* profile_create()
+{
+  if(profile_count == 0)
+    return NULL;
+
+  if(profiles == NULL)
+  {
+    start_tsc = cpu_tick();
+    start_nanos = os_clock_nanos();
+  }
+
+  profile_t* prof = (profile_t*)pool_alloc_size(sizeof(profile_t));
+  memset(prof, 0, sizeof(profile_t));
+
+  // Every table is created by scheduler_init(), on one thread.
+  prof->link = profiles;
+  profiles = prof;
+  return prof;
+}
+
+void profile_record(profile_t* prof, pony_type_t* type, uint32_t id,
+  uint64_t cycles)
+{
+  profile_slot_t* slot = find(prof, type, id);
+
+  if(slot == NULL)
+    return;
+
+  slot->count++;
+  slot->cycles += cycles;
+}
+
+static int cmp_key(const void* a, const void* b)
+{
+  const profile_entry_t* x = (const profile_entry_t*)a;
+  const profile_entry_t* y = (const profile_entry_t*)b;
+
+  if(x->type != y->type)
+    return ((uintptr_t)x->type < (uintptr_t)y->type) ? -1 : 1;
+
+  if(x->id != y->id)
+    return (x->id < y->id) ? -1 : 1;
+
+  return 0;
+}
+
+static int cmp_cycles(const void* a, const void* b)
+{
+  const profile_entry_t* x = (const profile_entry_t*)a;
+  const profile_entry_t* y = (const profile_entry_t*)b;
+
+  if(x->cycles != y->cycles)
+    return (x->cycles > y->cycles) ? -1 : 1;
+
+  return cmp_key(a, b);
+}
+
+static void print_name(FILE* fp, pony_type_t* type, uint32_t id)
+{
+  id &= ~(uint32_t)PONY_MSG_COALESCE;
+
+  if((type->msg_names != NULL) && (id < type->msg_count) &&
+    (type->msg_names[id] != NULL))
+  {
+    fprintf(fp, "%s", type->msg_names[id]);
+    return;
+  }
+
+  if(type->name != NULL)
+    fprintf(fp, "%s", type->name);
+  else
+    fprintf(fp, "type %u", type->id);
+
+  if(id == ACTORMSG_REPLY)
+    fprintf(fp, " (reply)");
+  else
+    fprintf(fp, " (message %u)", id);
+}
+
+/**
+ * Sums the tables of every scheduler thread into one entry per behaviour,
+ * with the most CPU time first. The array holds size entries, of which the
+ * first count are used.
+ */
+static profile_entry_t* gather(size_t* size, size_t* count)
+{
+  *size = 0;
+
+  for(profile_t* prof = profiles; prof != NULL; prof = prof->link)
+    *size += PROFILE_SLOTS;
+
+  profile_entry_t* entries = (profile_entry_t*)pool_alloc_size(
+    *size * sizeof(profile_entry_t));
+  size_t n = 0;
+
+  for(profile_t* prof = profiles; prof != NULL; prof = prof->link)
+  {
+    for(size_t i = 0; i < PROFILE_SLOTS; i++)
+    {
+      profile_slot_t* slot = &prof->slot[i];
+      pony_type_t* type = _atomic_load(&slot->type);
+
+      if(type == NULL)
+        continue;
+
+      entries[n].type = type;
+      entries[n].id = slot->id;
+      entries[n].count = slot->count;
+      entries[n].cycles = slot->cycles;
+      n++;
+    }
+  }
+
+  qsort(entries, n, sizeof(profile_entry_t), cmp_key);
+  size_t merged = 0;
+
+  for(size_t i = 0; i < n; i++)
+  {
+    if((merged > 0) && (cmp_key(&entries[merged - 1], &entries[i]) == 0))
+    {
+      entries[merged - 1].count += entries[i].count;
+      entries[merged - 1].cycles += entries[i].cycles;
+    } else {
+      entries[merged++] = entries[i];
+    }
+  }
+
+  qsort(entries, merged, sizeof(profile_entry_t), cmp_cycles);
+  *count = merged;
+  return entries;
+}
+
+bool profile_dump(FILE* fp, size_t count)
+{
+  if(profiles == NULL)
+    return false;
+
+  size_t size;
+  size_t n;
+  profile_entry_t* entries = gather(&size, &n);
+  uint64_t total = 0;
+
+  for(size_t i = 0; i < n; i++)
+    total += entries[i].cycles;
+
+  uint64_t ticks = cpu_tick() - start_tsc;
+  uint64_t nanos = os_clock_nanos() - start_nanos;
+  double ns_per_tick = (ticks > 0) ? ((double)nanos / (double)ticks) : 1.0;
+
+  if((count == 0) || (count > n))
+    count = n;
+
+  fprintf(fp, "Behaviour profile: " __zu " of " __zu " behaviours, %.3f ms "
+    "in all behaviours\n", count, n, (double)total * ns_per_tick / 1e6);
+  fprintf(fp, "%7s %12s %12s %10s  %s\n", "%time", "ms", "count", "mean ns",
+    "behaviour");
+
+  for(size_t i = 0; i < count; i++)
+  {
+    profile_entry_t* e = &entries[i];
+    double ns = (double)e->cycles * ns_per_tick;
+
+    fprintf(fp, "%6.2f%% %12.3f %12" PRIu64 " %10.0f  ",
+      (total > 0) ? (100.0 * (double)e->cycles / (double)total) : 0.0,
+      ns / 1e6, e->count, (e->count > 0) ? (ns / (double)e->count) : 0.0);
+    print_name(fp, e->type, e->id);
+    fprintf(fp, "\n");
+  }
+
+  pool_free_size(size * sizeof(profile_entry_t), entries);
+  return true;
+}
+
+void profile_stop()
+{
+  if(profiles == NULL)
+    return;
+
+  if(profile_count > 0)
+    profile_dump(stderr, profile_count);
+
+  profile_t* prof = profiles;
+
+  while(prof != NULL)
+  {
+    profile_t* next = prof->link;
+    pool_free_size(sizeof(profile_t), prof);
+    prof = next;
+  }
+
+  profiles = NULL;
+}
+
+bool pony_profile_dump(const char* path, size_t count)
+{
+  if(profiles == NULL)
+    return false;
+
+  FILE* fp = fopen(path, "w");
+
+  if(fp == NULL)
+    return false;
+
+  profile_dump(fp, count);
+  fclose(fp);
+  return true;
+}
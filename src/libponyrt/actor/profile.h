@@ -0,0 +1,51 @@
+#ifndef actor_profile_h
+#define actor_profile_h
+
+#include <pony.h>
+#include <platform.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * CPU time spent in behaviours, keyed by actor type and message ID. Each
+ * scheduler thread has its own table, and only that thread records in it.
+ * Other threads may read it at any time.
+ */
+typedef struct profile_t profile_t;
+
+/**
+ * Turns the profile on, writing the count behaviours with the most CPU time
+ * to stderr when the runtime stops. Zero, the default, leaves it off. Must be
+ * called before scheduler_init().
+ */
+void profile_setcount(size_t count);
+
+/**
+ * Returns a new table for a scheduler thread, or NULL if the profile is off.
+ */
+profile_t* profile_create();
+
+/**
+ * Adds the cycles taken to handle one message to its behaviour.
+ */
+void profile_record(profile_t* prof, pony_type_t* type, uint32_t id,
+  uint64_t cycles);
+
+/**
+ * Writes up to count behaviours, or all of them if count is 0, with the most
+ * CPU time first. Returns false if the profile is off.
+ */
+bool profile_dump(FILE* fp, size_t count);
+
+/**
+ * Writes the profile to stderr, unless it has since been turned off, and frees
+ * every table. Called once the scheduler threads have stopped.
+ */
+void profile_stop();
+
+PONY_EXTERN_C_END
+
+#endif
@@ -0,0 +1,270 @@
+#include "registry.h"
+#include "actor.h"
+#include "../ds/fun.h"
+#include "../mem/pool.h"
+#include <string.h>
+#include <stdio.h>
+
+// Live actors are kept in lists sharded by address, so that actors created
+// and destroyed on different threads rarely wait for the same lock.
+#define REGISTRY_SHARDS 64
+
+// The most actors and types written by pony_memory_dump().
+#define REGISTRY_DUMP 20
+
+typedef struct shard_t
+{
+  uint32_t volatile lock;
+  pony_actor_t* head;
+} shard_t;
+
+static shard_t shards[REGISTRY_SHARDS];
+
+static shard_t* shard_of(pony_actor_t* actor)
+{
+  return &shards[hash_ptr(actor) & (REGISTRY_SHARDS - 1)];
+}
+
+static void lock(shard_t* shard)
+{
+  while(_atomic_exchange(&shard->lock, 1) != 0)
+    ;
+}
+
+static void unlock(shard_t* shard)
+{
+  _atomic_store(&shard->lock, 0);
+}
+
+void registry_add(pony_actor_t* actor)
+{
+  shard_t* shard = shard_of(actor);
+  lock(shard);
+
+  actor->registry_prev = NULL;
+  actor->registry_next = shard->head;
+
+  if(shard->head != NULL)
+    shard->head->registry_prev = actor;
+
+  shard->head = actor;
+  unlock(shard);
+}
+
+void registry_remove(pony_actor_t* actor)
+{
+  shard_t* shard = shard_of(actor);
+  lock(shard);
+
+  if(actor->registry_prev != NULL)
+    actor->registry_prev->registry_next = actor->registry_next;
+  else
+    shard->head = actor->registry_next;
+
+  if(actor->registry_next != NULL)
+    actor->registry_next->registry_prev = actor->registry_prev;
+
+  unlock(shard);
+}
+
+void registry_census()
+{
+  for(size_t i = 0; i < REGISTRY_SHARDS; i++)
+  {
+    shard_t* shard = &shards[i];
+    lock(shard);
+
+    for(pony_actor_t* a = shard->head; a != NULL; a = a->registry_next)
+      _atomic_store(&a->census, 1);
+
+    unlock(shard);
+  }
+}
+
+static void read_actor(pony_actor_t* actor, pony_actor_memory_t* stats)
+{
+  // The owning actor may be running, so these are read without
+  // synchronisation and are only approximate.
+  stats->actor = actor;
+  stats->type_id = actor->type->id;
+  stats->heap_used = actor->heap.used;
+  stats->heap_next_gc = actor->heap.next_gc;
+  stats->queue = messageq_depth(&actor->q);
+}
+
+static size_t actor_key(pony_actor_memory_t* stats, bool by_queue)
+{
+  return by_queue ? stats->queue : stats->heap_used;
+}
+
+size_t pony_actor_memory(pony_actor_memory_t* top, size_t count,
+  bool by_queue)
+{
+  size_t n = 0;
+  pony_actor_memory_t stats;
+
+  if(count == 0)
+    return 0;
+
+  for(size_t i = 0; i < REGISTRY_SHARDS; i++)
+  {
+    shard_t* shard = &shards[i];
+    lock(shard);
+
+    for(pony_actor_t* a = shard->head; a != NULL; a = a->registry_next)
+    {
+      read_actor(a, &stats);
+      size_t key = actor_key(&stats, by_queue);
+
+      if((n == count) && (key <= actor_key(&top[n - 1], by_queue)))
+        continue;
+
+      // Keep the largest first, dropping the smallest when full.
+      size_t j = (n < count) ? n++ : n - 1;
+
+      while((j > 0) && (actor_key(&top[j - 1], by_queue) < key))
+      {
+        top[j] = top[j - 1];
+        j--;
+      }
+
+      top[j] = stats;
+    }
+
+    unlock(shard);
+  }
+
+  return n;
+}
+
+bool pony_actor_memory_rank(size_t rank, bool by_queue,
+  pony_actor_memory_t* stats)
+{
+  size_t size = (rank + 1) * sizeof(pony_actor_memory_t);
+  pony_actor_memory_t* top = (pony_actor_memory_t*)pool_alloc_size(size);
+  bool found = pony_actor_memory(top, rank + 1, by_queue) > rank;
+
+  if(found)
+    *stats = top[rank];
+
+  pool_free_size(size, top);
+  return found;
+}
+
+size_t pony_type_memory(pony_type_memory_t* top, size_t count)
+{
+  // Type ids are small and dense, so the totals are indexed by them.
+  pony_type_memory_t* types = NULL;
+  size_t size = 0;
+  pony_actor_memory_t stats;
+
+  for(size_t i = 0; i < REGISTRY_SHARDS; i++)
+  {
+    shard_t* shard = &shards[i];
+    lock(shard);
+
+    for(pony_actor_t* a = shard->head; a != NULL; a = a->registry_next)
+    {
+      read_actor(a, &stats);
+
+      if(stats.type_id >= size)
+      {
+        size_t new_size = (size == 0) ? 64 : size;
+
+        while(stats.type_id >= new_size)
+          new_size <<= 1;
+
+        pony_type_memory_t* grown = (pony_type_memory_t*)pool_alloc_size(
+          new_size * sizeof(pony_type_memory_t));
+        memset(grown, 0, new_size * sizeof(pony_type_memory_t));
+
+        if(types != NULL)
+        {
+          memcpy(grown, types, size * sizeof(pony_type_memory_t));
+          pool_free_size(size * sizeof(pony_type_memory_t), types);
+        }
+
+        types = grown;
+        size = new_size;
+      }
+
+      pony_type_memory_t* t = &types[stats.type_id];
+      t->type_id = stats.type_id;
+      t->actors++;
+      t->heap_used += stats.heap_used;
+      t->queue += stats.queue;
+    }
+
+    unlock(shard);
+  }
+
+  size_t n = 0;
+
+  for(size_t i = 0; (i < size) && (count > 0); i++)
+  {
+    pony_type_memory_t* t = &types[i];
+
+    if(t->actors == 0)
+      continue;
+
+    if((n == count) && (t->heap_used <= top[n - 1].heap_used))
+      continue;
+
+    size_t j = (n < count) ? n++ : n - 1;
+
+    while((j > 0) && (top[j - 1].heap_used < t->heap_used))
+    {
+      top[j] = top[j - 1];
+      j--;
+    }
+
+    top[j] = *t;
+  }
+
+  if(types != NULL)
+    pool_free_size(size * sizeof(pony_type_memory_t), types);
+
+  return n;
+}
+
+bool pony_type_memory_rank(size_t rank, pony_type_memory_t* stats)
+{
+  size_t size = (rank + 1) * sizeof(pony_type_memory_t);
+  pony_type_memory_t* top = (pony_type_memory_t*)pool_alloc_size(size);
+  bool found = pony_type_memory(top, rank + 1) > rank;
+
+  if(found)
+    *stats = top[rank];
+
+  pool_free_size(size, top);
+  return found;
+}
+
+void pony_memory_dump()
+{
+  pony_actor_memory_t actors[REGISTRY_DUMP];
+  pony_type_memory_t types[REGISTRY_DUMP];
+
+  size_t n = pony_type_memory(types, REGISTRY_DUMP);
+  fprintf(stderr, "types by heap:\n");
+
+  for(size_t i = 0; i < n; i++)
+  {
+    fprintf(stderr, "  type %u: " __zu " actors, heap " __zu ", queue " __zu
+      "\n", types[i].type_id, types[i].actors, types[i].heap_used,
+      types[i].queue);
+  }
+
+  for(int by_queue = 0; by_queue < 2; by_queue++)
+  {
+    n = pony_actor_memory(actors, REGISTRY_DUMP, by_queue != 0);
+    fprintf(stderr, "actors by %s:\n", by_queue ? "queue" : "heap");
+
+    for(size_t i = 0; i < n; i++)
+    {
+      fprintf(stderr, "  actor %p: type %u, heap " __zu ", next gc " __zu
+        ", queue " __zu "\n", (void*)actors[i].actor, actors[i].type_id,
+        actors[i].heap_used, actors[i].heap_next_gc, actors[i].queue);
+    }
+  }
+}
@@ -0,0 +1,28 @@
+#ifndef actor_registry_h
+#define actor_registry_h
+
+#include <pony.h>
+#include <platform.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * Adds a new actor to the list of live actors read by the memory
+ * introspection functions in pony.h.
+ */
+void registry_add(pony_actor_t* actor);
+
+/**
+ * Removes an actor that is being destroyed. Once this returns, no other
+ * thread reads the actor through the registry.
+ */
+void registry_remove(pony_actor_t* actor);
+
+/**
+ * Asks every live actor for a heap census at its next gc pass.
+ */
+void registry_census();
+
+PONY_EXTERN_C_END
+
+#endif
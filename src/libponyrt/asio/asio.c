@@ -4,16 +4,40 @@
 #include <stdio.h>
 
 #include "asio.h"
+#include "wheel.h"
+#include "../ds/fun.h"
 #include "../mem/pool.h"
+#include "../sched/cpu.h"
+
+enum
+{
+  BASE_IDLE,
+  BASE_STARTING,
+  BASE_RUNNING
+};
 
 struct asio_base_t
 {
   pony_thread_id_t tid;
   asio_backend_t* backend;
-  uint64_t volatile noisy_count;
+  uint32_t volatile state;
+  bool threaded;
 };
 
-static asio_base_t running_base;
+// Each base has a backend and a thread of its own. Events are spread over
+// them by owning actor. A base's backend and thread are only started when an
+// event first needs them, so a program that does no I/O never pays for them.
+static asio_base_t* running_base;
+static uint32_t base_count = 1;
+static uint32_t batch_size = MAX_EVENTS;
+static uint64_t volatile noisy_count;
+static bool volatile started;
+
+// Zero when no scheduler thread is polling, and POLL_CLOSED once the bases
+// are being stopped.
+#define POLL_CLOSED 2
+static uint32_t volatile poller;
+static uint32_t next_poll;
 
 /** Start an asynchronous I/O event mechanism.
  *
@@ -21,52 +45,154 @@ static asio_base_t running_base;
  *  never handled within the runtime system.
  *
  *  In any case (independent of the underlying backend) only one I/O dispatcher
- *  thread will be started. Since I/O events are subscribed by actors, we do
- *  not need to maintain a thread pool. Instead, I/O is processed in the
+ *  thread will be started per base. Since I/O events are subscribed by actors,
+ *  we do not need to maintain a thread pool. Instead, I/O is processed in the
  *  context of the owning actor.
  */
+static asio_backend_t* base_backend(asio_base_t* base)
+{
+  if(_atomic_load(&base->state) == BASE_RUNNING)
+    return base->backend;
+
+  uint32_t expect = BASE_IDLE;
+
+  if(_atomic_cas(&base->state, &expect, BASE_STARTING))
+  {
+    base->backend = asio_backend_init();
+
+    // Before asio_start(), or if it is never called, the backend gets no
+    // thread and its events are never delivered.
+    base->threaded = _atomic_load(&started) && (base->backend != NULL) &&
+      pony_thread_create(&base->tid, asio_backend_dispatch, cpu_asio(),
+        base->backend);
+
+    _atomic_store(&base->state, BASE_RUNNING);
+  } else {
+    // Another thread is starting it.
+    while(_atomic_load(&base->state) != BASE_RUNNING)
+      ;
+  }
+
+  return base->backend;
+}
+
 asio_backend_t* asio_get_backend()
 {
-  return running_base.backend;
+  if(running_base == NULL)
+    return NULL;
+
+  return base_backend(&running_base[0]);
+}
+
+asio_backend_t* asio_backend_of(pony_actor_t* owner)
+{
+  if(running_base == NULL)
+    return NULL;
+
+  if(base_count == 1)
+    return base_backend(&running_base[0]);
+
+  return base_backend(&running_base[hash_ptr(owner) % base_count]);
+}
+
+void asio_setthreads(uint32_t threads, uint32_t batch)
+{
+#ifdef ASIO_USE_IOCP
+  // Completion ports are already serviced by any number of threads.
+  threads = 1;
+#endif
+
+  base_count = (threads > 0) ? threads : 1;
+  batch_size = (batch > 0) ? batch : MAX_EVENTS;
+}
+
+uint32_t asio_batch_size()
+{
+  return batch_size;
 }
 
 void asio_init()
 {
-  running_base.backend = asio_backend_init();
+  poller = 0;
+  next_poll = 0;
+  _atomic_store(&started, false);
+  running_base = (asio_base_t*)pool_alloc_size(
+    base_count * sizeof(asio_base_t));
+  memset(running_base, 0, base_count * sizeof(asio_base_t));
+
+  asio_wheel_init();
 }
 
 bool asio_start()
 {
-  if(!pony_thread_create(&running_base.tid, asio_backend_dispatch, -1,
-    running_base.backend))
-    return false;
-
-  return true;
+  _atomic_store(&started, true);
+  return asio_wheel_start();
 }
 
 bool asio_stop()
 {
-  if(_atomic_load(&running_base.noisy_count) > 0)
+  if(_atomic_load(&noisy_count) > 0)
     return false;
 
-  if(running_base.backend != NULL)
+  if(running_base != NULL)
   {
-    asio_backend_terminate(running_base.backend);
-    pony_thread_join(running_base.tid);
+    // Wait for a scheduler thread that is polling, and keep any others out.
+    uint32_t expect = 0;
+
+    while(!_atomic_cas(&poller, &expect, POLL_CLOSED))
+      expect = 0;
+
+    for(uint32_t i = 0; i < base_count; i++)
+    {
+      if(running_base[i].backend != NULL)
+        asio_backend_terminate(running_base[i].backend);
+    }
 
-    running_base.backend = NULL;
-    running_base.tid = 0;
+    for(uint32_t i = 0; i < base_count; i++)
+    {
+      if(running_base[i].backend == NULL)
+        continue;
+
+      // A backend that was never given a thread is torn down on this one. It
+      // has been told to terminate, so it stops before it waits for events.
+      if(running_base[i].threaded)
+        pony_thread_join(running_base[i].tid);
+      else
+        asio_backend_dispatch(running_base[i].backend);
+    }
+
+    pool_free_size(base_count * sizeof(asio_base_t), running_base);
+    running_base = NULL;
   }
 
+  asio_wheel_stop();
+
   return true;
 }
 
+bool asio_poll()
+{
+  uint32_t expect = 0;
+
+  if((_atomic_load(&poller) != 0) || !_atomic_cas(&poller, &expect, 1))
+    return false;
+
+  // A base that hasn't started has no events to poll.
+  asio_base_t* base = &running_base[next_poll++ % base_count];
+  asio_backend_t* b = (_atomic_load(&base->state) == BASE_RUNNING) ?
+    base->backend : NULL;
+  bool woken = (b != NULL) && asio_backend_poll(b);
+
+  _atomic_store(&poller, 0);
+  return woken;
+}
+
 void asio_noisy_add()
 {
-  _atomic_add(&running_base.noisy_count, 1);
+  _atomic_add(&noisy_count, 1);
 }
 
 void asio_noisy_remove()
 {
-  _atomic_add(&running_base.noisy_count, -1);
+  _atomic_add(&noisy_count, -1);
 }
@@ -5,7 +5,9 @@
 #include <platform.h>
 #include <stdbool.h>
 
-#if defined(PLATFORM_IS_LINUX)
+#if defined(PLATFORM_IS_LINUX) && defined(USE_IOURING)
+#  define ASIO_USE_IOURING
+#elif defined(PLATFORM_IS_LINUX)
 #  define ASIO_USE_EPOLL
 #elif defined(PLATFORM_IS_MACOSX) || defined(PLATFORM_IS_FREEBSD)
 #  define ASIO_USE_KQUEUE
@@ -15,6 +17,7 @@
 #  error PLATFORM NOT SUPPORTED!
 #endif
 
+/// The default for the most events an ASIO thread handles in one go.
 #define MAX_EVENTS 64
 
 PONY_EXTERN_C_BEGIN
@@ -49,24 +52,50 @@ typedef struct asio_base_t asio_base_t;
  */
 asio_backend_t* asio_backend_init();
 
+/** Sets the number of ASIO threads, each with a backend of its own, and the
+ * most events each thread handles in one go.
+ *
+ * Call this before asio_init(). Zero keeps the default of one thread and
+ * MAX_EVENTS events.
+ */
+void asio_setthreads(uint32_t threads, uint32_t batch);
+
+/// The most events an ASIO thread handles in one go.
+uint32_t asio_batch_size();
+
 /// Call this when the scheduler is initialised.
 void asio_init();
 
-/// Call this when the scheduler runs its threads.
+/** Call this when the scheduler runs its threads.
+ *
+ * Each backend and its thread are only started when an event first needs
+ * them, and each timer thread when a timer first needs it. An embedded runtime
+ * may leave ASIO unstarted. Its events are then never delivered, and
+ * asio_stop() tears the backends down on the calling thread.
+ */
 bool asio_start();
 
 /** Returns the underlying mechanism for I/O event notification of the running
  * ASIO base.
  *
  * The concrete mechanism is platform specific:
- *   Linux: epoll
+ *   Linux: epoll, or io_uring when built with use=iouring
  *   MacOSX/BSD: kqueue
  *   Windows: I/O completion ports - to be implemented.
  *
  * If there is no current running backend, one will be started.
+ *
+ * With more than one ASIO thread, this is the backend of the first.
  */
 asio_backend_t* asio_get_backend();
 
+/** Returns the backend that handles the events of an actor.
+ *
+ * All of an actor's events are handled by the same ASIO thread, so that they
+ * are subscribed and unsubscribed on the same backend.
+ */
+asio_backend_t* asio_backend_of(pony_actor_t* owner);
+
 /** Attempts to stop an asynchronous event mechanism.
  *
  * Stopping an event mechanism is only possible if there are no pending "noisy"
@@ -94,6 +123,21 @@ void asio_noisy_remove();
  */
 void asio_backend_terminate(asio_backend_t* backend);
 
+/** Handles the events that are ready on a backend without waiting for them.
+ *
+ * This is called from scheduler threads, so that actors woken by an event go
+ * on the local queue of the thread that polled it. Returns true if any actor
+ * was sent an event. Backends that can't be polled this way return false.
+ */
+bool asio_backend_poll(asio_backend_t* backend);
+
+/** Polls the next ASIO backend from an idle scheduler thread.
+ *
+ * Only one thread polls at a time. Others, and every caller once asio_stop()
+ * has begun, return false straight away.
+ */
+bool asio_poll();
+
 /** Entry point for the ASIO thread.
  *
  * Errors are not handled within this function but are delegated to the actor
@@ -1,12 +1,13 @@
 #include "asio.h"
 #include "event.h"
+#include "wheel.h"
 #ifdef ASIO_USE_EPOLL
 
 #include "../actor/messageq.h"
 #include "../mem/pool.h"
+#include "../sched/scheduler.h"
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
-#include <sys/timerfd.h>
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
@@ -14,19 +15,27 @@
 
 #define MAX_SIGNAL 128
 
+// The most events an idle scheduler thread takes in one poll.
+#define POLL_EVENTS 16
+
 struct asio_backend_t
 {
   int epfd;
   int wakeup;    /* eventfd to break epoll loop */
-  struct epoll_event events[MAX_EVENTS];
-  asio_event_t* sighandlers[MAX_SIGNAL];
+  uint32_t batch;
+  struct epoll_event* events;
+  bool volatile polling;
   bool terminate;
   messageq_t q;
 };
 
+// Signals are process wide, so their events are kept here rather than in the
+// backend that handles them.
+static asio_event_t* sighandlers[MAX_SIGNAL];
+
 static void send_request(asio_event_t* ev, int req)
 {
-  asio_backend_t* b = asio_get_backend();
+  asio_backend_t* b = asio_backend_of(ev->owner);
 
   asio_msg_t* msg = (asio_msg_t*)pony_alloc_msg(
     POOL_INDEX(sizeof(asio_msg_t)), 0);
@@ -44,8 +53,7 @@ static void signal_handler(int sig)
 
   // Reset the signal handler.
   signal(sig, signal_handler);
-  asio_backend_t* b = asio_get_backend();
-  asio_event_t* ev = b->sighandlers[sig];
+  asio_event_t* ev = sighandlers[sig];
 
   if(ev == NULL)
     return;
@@ -61,6 +69,13 @@ static void handle_queue(asio_backend_t* b)
   {
     asio_event_t* ev = msg->event;
 
+    // A scheduler thread may still be handling an event it polled before the
+    // event was removed. Let it finish before the event can be destroyed.
+    _atomic_fence();
+
+    while(_atomic_load(&b->polling))
+      ;
+
     switch(msg->flags)
     {
       case ASIO_DISPOSABLE:
@@ -87,6 +102,10 @@ asio_backend_t* asio_backend_init()
     return NULL;
   }
 
+  b->batch = asio_batch_size();
+  b->events = (struct epoll_event*)pool_alloc_size(
+    b->batch * sizeof(struct epoll_event));
+
   struct epoll_event ep;
   ep.data.ptr = b;
   ep.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
@@ -102,87 +121,102 @@ void asio_backend_terminate(asio_backend_t* b)
   eventfd_write(b->wakeup, 1);
 }
 
+static void handle_event(asio_backend_t* b, struct epoll_event* ep)
+{
+  if(ep->data.ptr == b)
+    return;
+
+  asio_event_t* ev = ep->data.ptr;
+  uint32_t flags = 0;
+  uint32_t count = 0;
+
+  if(ev->flags & ASIO_READ)
+  {
+    if(ep->events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+      flags |= ASIO_READ;
+  }
+
+  if(ev->flags & ASIO_WRITE)
+  {
+    if(ep->events & EPOLLOUT)
+      flags |= ASIO_WRITE;
+  }
+
+  if(ev->flags & ASIO_SIGNAL)
+  {
+    if(ep->events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+    {
+      uint64_t missed;
+      ssize_t rc = read(ev->fd, &missed, sizeof(uint64_t));
+      (void)rc;
+      flags |= ASIO_SIGNAL;
+      count = (uint32_t)missed;
+    }
+  }
+
+  if(flags != 0)
+    asio_event_send(ev, flags, count);
+}
+
+bool asio_backend_poll(asio_backend_t* b)
+{
+  struct epoll_event events[POLL_EVENTS];
+
+  _atomic_store(&b->polling, true);
+  _atomic_fence();
+
+  int event_cnt = epoll_wait(b->epfd, events, POLL_EVENTS, 0);
+  bool woken = false;
+
+  for(int i = 0; i < event_cnt; i++)
+  {
+    // Edge triggered events go to only one waiter. If we took the wakeup, the
+    // ASIO thread needs another one.
+    if(events[i].data.ptr == b)
+    {
+      eventfd_write(b->wakeup, 1);
+      continue;
+    }
+
+    handle_event(b, &events[i]);
+    woken = true;
+  }
+
+  _atomic_store(&b->polling, false);
+  return woken;
+}
+
 DECLARE_THREAD_FN(asio_backend_dispatch)
 {
   pony_register_thread();
+  pony_ctx_t* ctx = pony_ctx();
   asio_backend_t* b = arg;
+  pony_actor_t** woken = (pony_actor_t**)pool_alloc_size(
+    b->batch * sizeof(pony_actor_t*));
 
   while(!b->terminate)
   {
-    int event_cnt = epoll_wait(b->epfd, b->events, MAX_EVENTS, -1);
+    int event_cnt = epoll_wait(b->epfd, b->events, (int)b->batch, -1);
+
+    // Schedule every actor woken by this wait in one go.
+    scheduler_batch_start(ctx, woken, b->batch);
 
     for(int i = 0; i < event_cnt; i++)
-    {
-      struct epoll_event* ep = &(b->events[i]);
-
-      if(ep->data.ptr == b)
-        continue;
-
-      asio_event_t* ev = ep->data.ptr;
-      uint32_t flags = 0;
-      uint32_t count = 0;
-
-      if(ev->flags & ASIO_READ)
-      {
-        if(ep->events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
-          flags |= ASIO_READ;
-      }
-
-      if(ev->flags & ASIO_WRITE)
-      {
-        if(ep->events & EPOLLOUT)
-          flags |= ASIO_WRITE;
-      }
-
-      if(ev->flags & ASIO_TIMER)
-      {
-        if(ep->events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
-        {
-          uint64_t missed;
-          ssize_t rc = read(ev->fd, &missed, sizeof(uint64_t));
-          (void)rc;
-          flags |= ASIO_TIMER;
-        }
-      }
-
-      if(ev->flags & ASIO_SIGNAL)
-      {
-        if(ep->events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
-        {
-          uint64_t missed;
-          ssize_t rc = read(ev->fd, &missed, sizeof(uint64_t));
-          (void)rc;
-          flags |= ASIO_SIGNAL;
-          count = (uint32_t)missed;
-        }
-      }
-
-      if(flags != 0)
-        asio_event_send(ev, flags, count);
-    }
+      handle_event(b, &(b->events[i]));
 
+    scheduler_batch_end(ctx);
     handle_queue(b);
   }
 
   close(b->epfd);
   close(b->wakeup);
+  pool_free_size(b->batch * sizeof(pony_actor_t*), woken);
+  pool_free_size(b->batch * sizeof(struct epoll_event), b->events);
   messageq_destroy(&b->q);
   POOL_FREE(asio_backend_t, b);
   return NULL;
 }
 
-static void timer_set_nsec(int fd, uint64_t nsec)
-{
-  struct itimerspec ts;
-
-  ts.it_interval.tv_sec = 0;
-  ts.it_interval.tv_nsec = 0;
-  ts.it_value.tv_sec = (time_t)(nsec / 1000000000);
-  ts.it_value.tv_nsec = (long)(nsec - (ts.it_value.tv_sec * 1000000000));
-
-  timerfd_settime(fd, 0, &ts, NULL);
-}
-
 void asio_event_subscribe(asio_event_t* ev)
 {
   if((ev == NULL) ||
@@ -190,7 +224,14 @@ void asio_event_subscribe(asio_event_t* ev)
     (ev->flags == ASIO_DESTROYED))
     return;
 
-  asio_backend_t* b = asio_get_backend();
+  // Timers go on the runtime's timer wheels rather than each having a timerfd.
+  if(ev->flags == ASIO_TIMER)
+  {
+    asio_timer_attach(ev, ev->nsec, 0);
+    return;
+  }
+
+  asio_backend_t* b = asio_backend_of(ev->owner);
 
   if(ev->noisy)
     asio_noisy_add();
@@ -205,19 +246,12 @@ void asio_event_subscribe(asio_event_t* ev)
   if(ev->flags & ASIO_WRITE)
     ep.events |= EPOLLOUT;
 
-  if(ev->flags & ASIO_TIMER)
-  {
-    ev->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-    timer_set_nsec(ev->fd, ev->nsec);
-    ep.events |= EPOLLIN;
-  }
-
   if(ev->flags & ASIO_SIGNAL)
   {
     int sig = (int)ev->nsec;
     asio_event_t* prev = NULL;
 
-    if((sig < MAX_SIGNAL) && _atomic_cas(&b->sighandlers[sig], &prev, ev))
+    if((sig < MAX_SIGNAL) && _atomic_cas(&sighandlers[sig], &prev, ev))
     {
       signal(sig, signal_handler);
       ev->fd = eventfd(0, EFD_NONBLOCK);
@@ -237,11 +271,32 @@ void asio_event_setnsec(asio_event_t* ev, uint64_t nsec)
     (ev->flags == ASIO_DESTROYED))
     return;
 
-  if(ev->flags & ASIO_TIMER)
-  {
-    ev->nsec = nsec;
-    timer_set_nsec(ev->fd, nsec);
-  }
+  asio_timer_set(ev, nsec, 0);
+}
+
+void asio_event_setflags(asio_event_t* ev, uint32_t flags)
+{
+  if((ev == NULL) ||
+    (ev->flags == ASIO_DISPOSABLE) ||
+    (ev->flags == ASIO_DESTROYED))
+    return;
+
+  asio_backend_t* b = asio_backend_of(ev->owner);
+  uint32_t io = ASIO_READ | ASIO_WRITE;
+  ev->flags = (ev->flags & ~io) | (flags & io);
+
+  struct epoll_event ep;
+  ep.data.ptr = ev;
+  ep.events = EPOLLRDHUP | EPOLLET;
+
+  if(ev->flags & ASIO_READ)
+    ep.events |= EPOLLIN;
+
+  if(ev->flags & ASIO_WRITE)
+    ep.events |= EPOLLOUT;
+
+  // Modifying an edge triggered event checks its readiness again.
+  epoll_ctl(b->epfd, EPOLL_CTL_MOD, ev->fd, &ep);
 }
 
 void asio_event_unsubscribe(asio_event_t* ev)
@@ -251,7 +306,15 @@ void asio_event_unsubscribe(asio_event_t* ev)
     (ev->flags == ASIO_DESTROYED))
     return;
 
-  asio_backend_t* b = asio_get_backend();
+  // The wheel sends the disposable event, and drops the noisy count, once it
+  // has taken the timer off.
+  if(ev->flags == ASIO_TIMER)
+  {
+    asio_timer_cancel(ev);
+    return;
+  }
+
+  asio_backend_t* b = asio_backend_of(ev->owner);
 
   if(ev->noisy)
   {
@@ -261,21 +324,12 @@ void asio_event_unsubscribe(asio_event_t* ev)
 
   epoll_ctl(b->epfd, EPOLL_CTL_DEL, ev->fd, NULL);
 
-  if(ev->flags & ASIO_TIMER)
-  {
-    if(ev->fd != -1)
-    {
-      close(ev->fd);
-      ev->fd = -1;
-    }
-  }
-
   if(ev->flags & ASIO_SIGNAL)
   {
     int sig = (int)ev->nsec;
     asio_event_t* prev = ev;
 
-    if((sig < MAX_SIGNAL) && _atomic_cas(&b->sighandlers[sig], &prev, NULL))
+    if((sig < MAX_SIGNAL) && _atomic_cas(&sighandlers[sig], &prev, NULL))
     {
       signal(sig, SIG_DFL);
       close(ev->fd);
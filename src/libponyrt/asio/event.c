@@ -2,10 +2,11 @@
 #include "asio.h"
 #include "../actor/actor.h"
 #include "../mem/pool.h"
+#include <dtrace.h>
 #include <string.h>
 #include <assert.h>
 
-asio_event_t* asio_event_create(pony_actor_t* owner, int fd, uint32_t flags,
+asio_event_t* asio_event_alloc(pony_actor_t* owner, int fd, uint32_t flags,
   uint64_t nsec, bool noisy)
 {
   if((flags == ASIO_DISPOSABLE) || (flags == ASIO_DESTROYED))
@@ -27,13 +28,35 @@ asio_event_t* asio_event_create(pony_actor_t* owner, int fd, uint32_t flags,
   ev->noisy = noisy;
   ev->nsec = nsec;
 
+#ifdef PLATFORM_IS_WINDOWS
+  ev->accepts = 0;
+#endif
+
+#ifdef ASIO_USE_IOURING
+  ev->armed = false;
+  ev->disposing = false;
+#endif
+
+  // Actors driven by ASIO events are latency sensitive.
+  pony_setclass(owner, PONY_SCHED_INTERACTIVE);
+
   // The event is effectively being sent to another thread, so mark it here.
   pony_ctx_t* ctx = pony_ctx();
   pony_gc_send(ctx);
   pony_traceactor(ctx, owner);
   pony_send_done(ctx);
 
-  asio_event_subscribe(ev);
+  return ev;
+}
+
+asio_event_t* asio_event_create(pony_actor_t* owner, int fd, uint32_t flags,
+  uint64_t nsec, bool noisy)
+{
+  asio_event_t* ev = asio_event_alloc(owner, fd, flags, nsec, noisy);
+
+  if(ev != NULL)
+    asio_event_subscribe(ev);
+
   return ev;
 }
 
@@ -81,6 +104,8 @@ void asio_event_send(asio_event_t* ev, uint32_t flags, uint32_t arg)
   m->flags = flags;
   m->arg = arg;
 
+  DTRACE3(ASIO_EVENT, (uintptr_t)ev, (uintptr_t)ev->owner, flags);
+
 #ifdef PLATFORM_IS_WINDOWS
   // On Windows, this can be called from an IOCP callback thread, which may
   // not have a pony_ctx() associated with it yet.
@@ -23,9 +23,21 @@ typedef struct asio_event_t
   uint64_t nsec;        /* nanoseconds for timers */
 #ifdef PLATFORM_IS_WINDOWS
   HANDLE timer;         /* timer handle */
+  uint64_t volatile accepts; /* AcceptEx calls in flight */
+#endif
+#ifdef USE_IOURING
+  bool armed;           /* poll in flight, ASIO thread only */
+  bool disposing;       /* waiting for the poll to end */
 #endif
 } asio_event_t;
 
+#ifdef PLATFORM_IS_WINDOWS
+/** Added to the accepts in flight when an event is unsubscribed. The last of
+ * them to complete then sends the event back as disposable.
+ */
+#define ASIO_ACCEPTS_CLOSED ((uint64_t)1 << 32)
+#endif
+
 /// Message that carries an event and event flags.
 typedef struct asio_msg_t
 {
@@ -43,6 +55,15 @@ typedef struct asio_msg_t
 asio_event_t* asio_event_create(pony_actor_t* owner, int fd, uint32_t flags,
   uint64_t nsec, bool noisy);
 
+/** Create a new event without subscribing it.
+ *
+ *  Runtime threads that do work on behalf of the owner use this, and send the
+ *  event with asio_event_send() when the work is done. They set the flags to
+ *  ASIO_DISPOSABLE before sending it, and keep the noisy count themselves.
+ */
+asio_event_t* asio_event_alloc(pony_actor_t* owner, int fd, uint32_t flags,
+  uint64_t nsec, bool noisy);
+
 /** Deallocates an ASIO event.
  */
 void asio_event_destroy(asio_event_t* ev);
@@ -71,6 +92,15 @@ void asio_event_subscribe(asio_event_t* ev);
  */
 void asio_event_setnsec(asio_event_t* ev, uint64_t nsec);
 
+/** Change the I/O interest of an event.
+ *
+ *  Only ASIO_READ and ASIO_WRITE are taken from flags, any other flags of the
+ *  event are kept. An actor that only asks for writeable events while it has
+ *  pending writes is not woken each time its socket drains. Becoming
+ *  interested in a condition that already holds reports it straight away.
+ */
+void asio_event_setflags(asio_event_t* ev, uint32_t flags);
+
 /** Unsubscribe an event.
  *
  *  After a call to unsubscribe, the caller will not receive any further event
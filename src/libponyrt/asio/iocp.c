@@ -97,6 +97,13 @@ void asio_backend_terminate(asio_backend_t* b)
 }
 
 
+bool asio_backend_poll(asio_backend_t* b)
+{
+  // Completions are run on the thread pool that IOCP already has.
+  (void)b;
+  return false;
+}
+
 DECLARE_THREAD_FN(asio_backend_dispatch)
 {
   pony_register_thread();
@@ -285,6 +292,19 @@ void asio_event_setnsec(asio_event_t* ev, uint64_t nsec)
   }
 }
 
+void asio_event_setflags(asio_event_t* ev, uint32_t flags)
+{
+  if((ev == NULL) ||
+    (ev->flags == ASIO_DISPOSABLE) ||
+    (ev->flags == ASIO_DESTROYED))
+    return;
+
+  // IOCP reports completions rather than readiness, so there is nothing to
+  // change in the backend.
+  uint32_t io = ASIO_READ | ASIO_WRITE;
+  ev->flags = (ev->flags & ~io) | (flags & io);
+}
+
 
 void asio_event_unsubscribe(asio_event_t* ev)
 {
@@ -322,7 +342,11 @@ void asio_event_unsubscribe(asio_event_t* ev)
       send_request(NULL, ASIO_STDIN_NOTIFY);
 
     ev->flags = ASIO_DISPOSABLE;
-    asio_event_send(ev, ASIO_DISPOSABLE, 0);
+
+    // Accepts still in flight refer to the event, so if there are any, the
+    // last of them to complete sends it back.
+    if(_atomic_add(&ev->accepts, ASIO_ACCEPTS_CLOSED) == 0)
+      asio_event_send(ev, ASIO_DISPOSABLE, 0);
   }
 }
 
@@ -0,0 +1,628 @@
+#include "asio.h"
+#include "event.h"
+#include "wheel.h"
+#ifdef ASIO_USE_IOURING
+
+#include "../actor/messageq.h"
+#include "../mem/pool.h"
+#include "../sched/scheduler.h"
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+
+#ifndef POLLRDHUP
+#  define POLLRDHUP 0x2000
+#endif
+
+#define MAX_SIGNAL 128
+
+// The completion ring is much larger than the submission ring, since every
+// armed poll can complete more than once between two waits.
+#define SQ_ENTRIES 256
+#define CQ_ENTRIES 4096
+
+enum
+{
+  REQ_SUBSCRIBE = 1,
+  REQ_REARM,
+  REQ_UNSUBSCRIBE
+};
+
+typedef struct sq_ring_t
+{
+  unsigned volatile* head;
+  unsigned volatile* tail;
+  unsigned* mask;
+  unsigned* entries;
+  unsigned* array;
+  struct io_uring_sqe* sqes;
+} sq_ring_t;
+
+typedef struct cq_ring_t
+{
+  unsigned volatile* head;
+  unsigned volatile* tail;
+  unsigned* mask;
+  struct io_uring_cqe* cqes;
+} cq_ring_t;
+
+struct asio_backend_t
+{
+  int ring;
+  int wakeup;    /* eventfd to break io_uring_enter */
+  bool wakeup_armed;
+  bool volatile wake_pending;
+  sq_ring_t sq;
+  cq_ring_t cq;
+  unsigned sq_tail;
+  void* sq_map;
+  size_t sq_map_size;
+  void* cq_map;
+  size_t cq_map_size;
+  size_t sqes_size;
+  pony_ctx_t* ctx;
+  uint32_t batch;
+  pony_actor_t** woken;
+  bool terminate;
+  messageq_t q;
+};
+
+// Signals are process wide, so their events are kept here rather than in the
+// backend that handles them.
+static asio_event_t* sighandlers[MAX_SIGNAL];
+
+static void send_request(asio_event_t* ev, int req)
+{
+  asio_backend_t* b = asio_backend_of(ev->owner);
+
+  asio_msg_t* msg = (asio_msg_t*)pony_alloc_msg(
+    POOL_INDEX(sizeof(asio_msg_t)), 0);
+  msg->event = ev;
+  msg->flags = req;
+  messageq_push(&b->q, (pony_msg_t*)msg);
+  _atomic_fence();
+
+  // Only the first request since the ASIO thread last drained the queue needs
+  // to wake it.
+  if(!_atomic_exchange(&b->wake_pending, true))
+    eventfd_write(b->wakeup, 1);
+}
+
+static void signal_handler(int sig)
+{
+  if(sig >= MAX_SIGNAL)
+    return;
+
+  // Reset the signal handler.
+  signal(sig, signal_handler);
+  asio_event_t* ev = sighandlers[sig];
+
+  if(ev == NULL)
+    return;
+
+  eventfd_write(ev->fd, 1);
+}
+
+static int ring_enter(asio_backend_t* b, unsigned wait)
+{
+  unsigned submit = b->sq_tail - _atomic_load(b->sq.head);
+
+  if((submit == 0) && (wait == 0))
+    return 0;
+
+  _atomic_store(b->sq.tail, b->sq_tail);
+
+  return (int)syscall(__NR_io_uring_enter, b->ring, submit, wait,
+    (wait > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+static unsigned sq_space(asio_backend_t* b)
+{
+  return *b->sq.entries - (b->sq_tail - _atomic_load(b->sq.head));
+}
+
+static struct io_uring_sqe* get_sqe(asio_backend_t* b)
+{
+  // Submit what is queued so far when the ring is full.
+  if(sq_space(b) == 0)
+  {
+    ring_enter(b, 0);
+
+    if(sq_space(b) == 0)
+      return NULL;
+  }
+
+  struct io_uring_sqe* sqe = &b->sq.sqes[b->sq_tail & *b->sq.mask];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  b->sq_tail++;
+  return sqe;
+}
+
+static void poll_add(struct io_uring_sqe* sqe, int fd, uint32_t events,
+  void* data)
+{
+  // A multishot poll stays armed after each completion, which gives the same
+  // edge triggered behaviour as EPOLLET without a syscall per event.
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->poll32_events = events;
+  sqe->user_data = (uintptr_t)data;
+}
+
+static void arm_wakeup(asio_backend_t* b)
+{
+  struct io_uring_sqe* sqe = get_sqe(b);
+
+  if(sqe == NULL)
+    return;
+
+  poll_add(sqe, b->wakeup, POLLIN, b);
+  b->wakeup_armed = true;
+}
+
+static void arm(asio_backend_t* b, asio_event_t* ev)
+{
+  if(ev->armed || ev->disposing || (ev->flags == ASIO_DISPOSABLE))
+    return;
+
+  struct io_uring_sqe* sqe = get_sqe(b);
+
+  if(sqe == NULL)
+  {
+    // Try again once the ring has been submitted.
+    send_request(ev, REQ_SUBSCRIBE);
+    return;
+  }
+
+  uint32_t events = POLLRDHUP;
+
+  if(ev->flags & (ASIO_READ | ASIO_SIGNAL))
+    events |= POLLIN;
+
+  if(ev->flags & ASIO_WRITE)
+    events |= POLLOUT;
+
+  poll_add(sqe, ev->fd, events, ev);
+  ev->armed = true;
+}
+
+static void disarm(asio_backend_t* b, asio_event_t* ev)
+{
+  ev->disposing = true;
+
+  if(!ev->armed)
+  {
+    asio_event_send(ev, ASIO_DISPOSABLE, 0);
+    return;
+  }
+
+  // The event is disposed of when its poll ends, which may be before this
+  // removal is seen.
+  struct io_uring_sqe* sqe = get_sqe(b);
+
+  if(sqe == NULL)
+    return;
+
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = (uintptr_t)ev;
+  sqe->user_data = 0;
+}
+
+static void rearm(asio_backend_t* b, asio_event_t* ev)
+{
+  if(ev->disposing)
+    return;
+
+  if(!ev->armed)
+  {
+    arm(b, ev);
+    return;
+  }
+
+  // Cancel the poll. It is armed again with the new flags when it ends.
+  struct io_uring_sqe* sqe = get_sqe(b);
+
+  if(sqe == NULL)
+  {
+    send_request(ev, REQ_REARM);
+    return;
+  }
+
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = (uintptr_t)ev;
+  sqe->user_data = 0;
+}
+
+static bool handle_queue(asio_backend_t* b)
+{
+  asio_msg_t* msg;
+
+  // Leave requests queued while there is no room to submit them.
+  while(sq_space(b) > 0)
+  {
+    if((msg = (asio_msg_t*)messageq_pop(&b->q)) == NULL)
+      return false;
+
+    asio_event_t* ev = msg->event;
+
+    switch(msg->flags)
+    {
+      case REQ_SUBSCRIBE:
+        arm(b, ev);
+        break;
+
+      case REQ_REARM:
+        rearm(b, ev);
+        break;
+
+      case REQ_UNSUBSCRIBE:
+        disarm(b, ev);
+        break;
+
+      default: {}
+    }
+  }
+
+  return true;
+}
+
+static void handle_cqe(asio_backend_t* b, struct io_uring_cqe* cqe)
+{
+  if(cqe->user_data == 0)
+    return;
+
+  if(cqe->user_data == (uintptr_t)b)
+  {
+    eventfd_t missed;
+    eventfd_read(b->wakeup, &missed);
+
+    if(!(cqe->flags & IORING_CQE_F_MORE))
+      b->wakeup_armed = false;
+
+    return;
+  }
+
+  asio_event_t* ev = (asio_event_t*)(uintptr_t)cqe->user_data;
+
+  if(!(cqe->flags & IORING_CQE_F_MORE))
+  {
+    ev->armed = false;
+
+    if(ev->disposing)
+    {
+      asio_event_send(ev, ASIO_DISPOSABLE, 0);
+      return;
+    }
+
+    // A multishot poll can end early, for example when the completion ring
+    // overflows. Re-arm it unless the descriptor itself was rejected.
+    if((cqe->res >= 0) || (cqe->res == -ECANCELED))
+      arm(b, ev);
+  }
+
+  if(ev->disposing || (cqe->res <= 0))
+    return;
+
+  uint32_t events = (uint32_t)cqe->res;
+  uint32_t flags = 0;
+  uint32_t count = 0;
+
+  if(ev->flags & ASIO_READ)
+  {
+    if(events & (POLLIN | POLLRDHUP | POLLHUP | POLLERR))
+      flags |= ASIO_READ;
+  }
+
+  if(ev->flags & ASIO_WRITE)
+  {
+    if(events & POLLOUT)
+      flags |= ASIO_WRITE;
+  }
+
+  if(ev->flags & ASIO_SIGNAL)
+  {
+    if(events & (POLLIN | POLLRDHUP | POLLHUP | POLLERR))
+    {
+      uint64_t missed;
+      ssize_t rc = read(ev->fd, &missed, sizeof(uint64_t));
+      (void)rc;
+      flags |= ASIO_SIGNAL;
+      count = (uint32_t)missed;
+    }
+  }
+
+  if(flags != 0)
+    asio_event_send(ev, flags, count);
+}
+
+static void reap(asio_backend_t* b)
+{
+  unsigned head = *b->cq.head;
+  unsigned tail = _atomic_load(b->cq.tail);
+
+  while(head != tail)
+  {
+    // Schedule every actor woken by a batch of completions in one go.
+    scheduler_batch_start(b->ctx, b->woken, b->batch);
+
+    for(uint32_t i = 0; (i < b->batch) && (head != tail); i++)
+    {
+      // Copy the entry and release its slot first, so that re-arming a poll
+      // never waits on a full completion ring.
+      struct io_uring_cqe cqe = b->cq.cqes[head & *b->cq.mask];
+      _atomic_store(b->cq.head, ++head);
+      handle_cqe(b, &cqe);
+    }
+
+    scheduler_batch_end(b->ctx);
+    tail = _atomic_load(b->cq.tail);
+  }
+}
+
+static void unmap(asio_backend_t* b)
+{
+  if(b->sq.sqes != NULL && b->sq.sqes != MAP_FAILED)
+    munmap(b->sq.sqes, b->sqes_size);
+
+  if(b->cq_map != NULL && b->cq_map != MAP_FAILED && b->cq_map != b->sq_map)
+    munmap(b->cq_map, b->cq_map_size);
+
+  if(b->sq_map != NULL && b->sq_map != MAP_FAILED)
+    munmap(b->sq_map, b->sq_map_size);
+}
+
+static bool map_rings(asio_backend_t* b, struct io_uring_params* p)
+{
+  b->sq_map_size = p->sq_off.array + (p->sq_entries * sizeof(unsigned));
+  b->cq_map_size = p->cq_off.cqes +
+    (p->cq_entries * sizeof(struct io_uring_cqe));
+  b->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+
+  // Newer kernels map both rings in one region.
+  if(p->features & IORING_FEAT_SINGLE_MMAP)
+  {
+    if(b->cq_map_size > b->sq_map_size)
+      b->sq_map_size = b->cq_map_size;
+
+    b->cq_map_size = b->sq_map_size;
+  }
+
+  b->sq_map = mmap(NULL, b->sq_map_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, b->ring, IORING_OFF_SQ_RING);
+
+  if(b->sq_map == MAP_FAILED)
+    return false;
+
+  if(p->features & IORING_FEAT_SINGLE_MMAP)
+  {
+    b->cq_map = b->sq_map;
+  } else {
+    b->cq_map = mmap(NULL, b->cq_map_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, b->ring, IORING_OFF_CQ_RING);
+
+    if(b->cq_map == MAP_FAILED)
+      return false;
+  }
+
+  b->sq.sqes = (struct io_uring_sqe*)mmap(NULL, b->sqes_size,
+    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, b->ring,
+    IORING_OFF_SQES);
+
+  if(b->sq.sqes == MAP_FAILED)
+    return false;
+
+  char* sq = (char*)b->sq_map;
+  b->sq.head = (unsigned*)(sq + p->sq_off.head);
+  b->sq.tail = (unsigned*)(sq + p->sq_off.tail);
+  b->sq.mask = (unsigned*)(sq + p->sq_off.ring_mask);
+  b->sq.entries = (unsigned*)(sq + p->sq_off.ring_entries);
+  b->sq.array = (unsigned*)(sq + p->sq_off.array);
+  b->sq_tail = *b->sq.tail;
+
+  // Submission slots are always used in order, so the indirection array is
+  // filled in once.
+  for(unsigned i = 0; i < p->sq_entries; i++)
+    b->sq.array[i] = i;
+
+  char* cq = (char*)b->cq_map;
+  b->cq.head = (unsigned*)(cq + p->cq_off.head);
+  b->cq.tail = (unsigned*)(cq + p->cq_off.tail);
+  b->cq.mask = (unsigned*)(cq + p->cq_off.ring_mask);
+  b->cq.cqes = (struct io_uring_cqe*)(cq + p->cq_off.cqes);
+  return true;
+}
+
+asio_backend_t* asio_backend_init()
+{
+  asio_backend_t* b = POOL_ALLOC(asio_backend_t);
+  memset(b, 0, sizeof(asio_backend_t));
+  messageq_init(&b->q);
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(struct io_uring_params));
+  p.flags = IORING_SETUP_CQSIZE;
+  p.cq_entries = CQ_ENTRIES;
+
+  b->ring = (int)syscall(__NR_io_uring_setup, SQ_ENTRIES, &p);
+  b->wakeup = eventfd(0, EFD_NONBLOCK);
+
+  if(b->ring < 0 || b->wakeup < 0 || !map_rings(b, &p))
+  {
+    unmap(b);
+
+    if(b->ring >= 0)
+      close(b->ring);
+
+    if(b->wakeup >= 0)
+      close(b->wakeup);
+
+    messageq_destroy(&b->q);
+    POOL_FREE(asio_backend_t, b);
+    return NULL;
+  }
+
+  b->batch = asio_batch_size();
+  b->woken = (pony_actor_t**)pool_alloc_size(
+    b->batch * sizeof(pony_actor_t*));
+
+  arm_wakeup(b);
+  return b;
+}
+
+void asio_backend_terminate(asio_backend_t* b)
+{
+  b->terminate = true;
+  eventfd_write(b->wakeup, 1);
+}
+
+bool asio_backend_poll(asio_backend_t* b)
+{
+  // The completion ring has a single consumer, which is the ASIO thread.
+  (void)b;
+  return false;
+}
+
+DECLARE_THREAD_FN(asio_backend_dispatch)
+{
+  pony_register_thread();
+  asio_backend_t* b = arg;
+  b->ctx = pony_ctx();
+
+  while(!b->terminate)
+  {
+    if(!b->wakeup_armed)
+      arm_wakeup(b);
+
+    // Requests that arrive from here on wake the ring again.
+    _atomic_store(&b->wake_pending, false);
+    _atomic_fence();
+    bool backlog = handle_queue(b);
+
+    // Every subscription queued since the last wait is submitted with the
+    // wait itself. With a backlog, only submit and carry on.
+    int rc = ring_enter(b, backlog ? 0 : 1);
+    (void)rc;
+
+    reap(b);
+  }
+
+  unmap(b);
+  close(b->ring);
+  close(b->wakeup);
+  pool_free_size(b->batch * sizeof(pony_actor_t*), b->woken);
+  messageq_destroy(&b->q);
+  POOL_FREE(asio_backend_t, b);
+  return NULL;
+}
+
+void asio_event_subscribe(asio_event_t* ev)
+{
+  if((ev == NULL) ||
+    (ev->flags == ASIO_DISPOSABLE) ||
+    (ev->flags == ASIO_DESTROYED))
+    return;
+
+  // Timers go on the runtime's timer wheels rather than each having a timerfd.
+  if(ev->flags == ASIO_TIMER)
+  {
+    asio_timer_attach(ev, ev->nsec, 0);
+    return;
+  }
+
+  if(ev->noisy)
+    asio_noisy_add();
+
+  if(ev->flags & ASIO_SIGNAL)
+  {
+    int sig = (int)ev->nsec;
+    asio_event_t* prev = NULL;
+
+    if((sig < MAX_SIGNAL) && _atomic_cas(&sighandlers[sig], &prev, ev))
+    {
+      signal(sig, signal_handler);
+      ev->fd = eventfd(0, EFD_NONBLOCK);
+    } else {
+      return;
+    }
+  }
+
+  // Only the ASIO thread touches the submission ring.
+  send_request(ev, REQ_SUBSCRIBE);
+}
+
+void asio_event_setnsec(asio_event_t* ev, uint64_t nsec)
+{
+  if((ev == NULL) ||
+    (ev->flags == ASIO_DISPOSABLE) ||
+    (ev->flags == ASIO_DESTROYED))
+    return;
+
+  asio_timer_set(ev, nsec, 0);
+}
+
+void asio_event_setflags(asio_event_t* ev, uint32_t flags)
+{
+  if((ev == NULL) ||
+    (ev->flags == ASIO_DISPOSABLE) ||
+    (ev->flags == ASIO_DESTROYED))
+    return;
+
+  uint32_t io = ASIO_READ | ASIO_WRITE;
+  ev->flags = (ev->flags & ~io) | (flags & io);
+
+  // The poll mask is fixed when it is armed, so it is armed again.
+  send_request(ev, REQ_REARM);
+}
+
+void asio_event_unsubscribe(asio_event_t* ev)
+{
+  if((ev == NULL) ||
+    (ev->flags == ASIO_DISPOSABLE) ||
+    (ev->flags == ASIO_DESTROYED))
+    return;
+
+  // The wheel sends the disposable event, and drops the noisy count, once it
+  // has taken the timer off.
+  if(ev->flags == ASIO_TIMER)
+  {
+    asio_timer_cancel(ev);
+    return;
+  }
+
+  if(ev->noisy)
+  {
+    asio_noisy_remove();
+    ev->noisy = false;
+  }
+
+  // A pending poll holds its own reference to the file, so the descriptor can
+  // be closed before the poll is removed.
+
+  if(ev->flags & ASIO_SIGNAL)
+  {
+    int sig = (int)ev->nsec;
+    asio_event_t* prev = ev;
+
+    if((sig < MAX_SIGNAL) && _atomic_cas(&sighandlers[sig], &prev, NULL))
+    {
+      signal(sig, SIG_DFL);
+      close(ev->fd);
+      ev->fd = -1;
+    }
+  }
+
+  ev->flags = ASIO_DISPOSABLE;
+  send_request(ev, REQ_UNSUBSCRIBE);
+}
+
+#endif
@@ -4,6 +4,7 @@
 
 #include "../actor/messageq.h"
 #include "../mem/pool.h"
+#include "../sched/scheduler.h"
 #include <sys/event.h>
 #include <string.h>
 #include <stdbool.h>
@@ -12,13 +13,97 @@
 #include <signal.h>
 #include <assert.h>
 
+// The most filters one request changes.
+#define MAX_CHANGES 4
+
+enum
+{
+  REQ_CHANGE,
+  REQ_UNSUBSCRIBE
+};
+
+/**
+ * Filter changes are queued for the ASIO thread, which hands them to the
+ * kernel along with its next wait, rather than each costing a kevent() call
+ * of its own. An unsubscribe is sent back as disposable once its changes have
+ * been made.
+ */
+typedef struct kqueue_msg_t
+{
+  pony_msg_t msg;
+  asio_event_t* event;
+  uint32_t count;
+  struct kevent change[MAX_CHANGES];
+} kqueue_msg_t;
+
 struct asio_backend_t
 {
   int kq;
-  int wakeup[2];
+  bool volatile waiting;
+  bool volatile terminate;
   messageq_t q;
+
+  // Only touched by the ASIO thread. The same list carries the changes in and
+  // the events out, with room for an error for each change as well as the
+  // batch of events.
+  struct kevent* list;
+  uint32_t list_size;
+  asio_event_t** disposed;
+  uint32_t disposed_size;
 };
 
+static void wake(asio_backend_t* b)
+{
+  struct kevent ev;
+  EV_SET(&ev, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, NULL);
+  kevent(b->kq, &ev, 1, NULL, 0, NULL);
+}
+
+static void send_request(asio_backend_t* b, kqueue_msg_t* m)
+{
+  messageq_push(&b->q, &m->msg);
+
+  // Only the first request after the ASIO thread has gone to wait wakes it.
+  // It looks at the queue after it says it is waiting, and we look at whether
+  // it is waiting after we queue, so one of us sees the other.
+  _atomic_fence();
+  bool expect = true;
+
+  if(_atomic_load(&b->waiting) && _atomic_cas(&b->waiting, &expect, false))
+    wake(b);
+}
+
+static kqueue_msg_t* new_request(asio_event_t* ev, uint32_t id)
+{
+  kqueue_msg_t* m = (kqueue_msg_t*)pony_alloc_msg(
+    POOL_INDEX(sizeof(kqueue_msg_t)), id);
+  m->event = ev;
+  m->count = 0;
+  return m;
+}
+
+static void grow(void** p, uint32_t* size, uint32_t need, size_t elem)
+{
+  if(need <= *size)
+    return;
+
+  uint32_t grown = (*size > 0) ? *size : 16;
+
+  while(grown < need)
+    grown *= 2;
+
+  void* q = pool_alloc_size(grown * elem);
+
+  if(*p != NULL)
+  {
+    memcpy(q, *p, *size * elem);
+    pool_free_size(*size * elem, *p);
+  }
+
+  *p = q;
+  *size = grown;
+}
+
 asio_backend_t* asio_backend_init()
 {
   asio_backend_t* b = POOL_ALLOC(asio_backend_t);
@@ -29,104 +114,149 @@ asio_backend_t* asio_backend_init()
 
   if(b->kq == -1)
   {
+    messageq_destroy(&b->q);
     POOL_FREE(asio_backend_t, b);
     return NULL;
   }
 
-  pipe(b->wakeup);
-
-  struct kevent new_event;
-  EV_SET(&new_event, b->wakeup[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
-
-  struct timespec t = {0, 0};
-  kevent(b->kq, &new_event, 1, NULL, 0, &t);
+  struct kevent ev;
+  EV_SET(&ev, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, NULL);
+  kevent(b->kq, &ev, 1, NULL, 0, NULL);
 
   return b;
 }
 
 void asio_backend_terminate(asio_backend_t* b)
 {
-  char c = 1;
-  write(b->wakeup[1], &c, 1);
+  _atomic_store(&b->terminate, true);
+  wake(b);
 }
 
-static void handle_queue(asio_backend_t* b)
+/**
+ * Moves the queued changes into the list, and returns how many there are.
+ * Unsubscribed events are kept to be sent back once the changes are made.
+ */
+static uint32_t take_changes(asio_backend_t* b, uint32_t batch,
+  uint32_t* disposed)
 {
-  asio_msg_t* msg;
+  uint32_t count = 0;
+  *disposed = 0;
+  kqueue_msg_t* m;
+
+  while((m = (kqueue_msg_t*)messageq_pop(&b->q)) != NULL)
+  {
+    grow((void**)&b->list, &b->list_size, count + m->count + batch,
+      sizeof(struct kevent));
 
-  while((msg = (asio_msg_t*)messageq_pop(&b->q)) != NULL)
-    asio_event_send(msg->event, ASIO_DISPOSABLE, 0);
+    memcpy(&b->list[count], m->change, m->count * sizeof(struct kevent));
+    count += m->count;
+
+    if(m->msg.id == REQ_UNSUBSCRIBE)
+    {
+      grow((void**)&b->disposed, &b->disposed_size, *disposed + 1,
+        sizeof(asio_event_t*));
+      b->disposed[(*disposed)++] = m->event;
+    }
+  }
+
+  return count;
 }
 
-static void retry_loop(asio_backend_t* b)
+bool asio_backend_poll(asio_backend_t* b)
 {
-  char c = 0;
-  write(b->wakeup[1], &c, 1);
+  // Events are only taken by the ASIO thread.
+  (void)b;
+  return false;
+}
+
+static void handle_event(struct kevent* ep)
+{
+  asio_event_t* ev = ep->udata;
+
+  // A change that failed, such as deleting the filters of a descriptor that
+  // has already been closed, is reported as an error.
+  if((ep->flags & EV_ERROR) || (ep->filter == EVFILT_USER))
+    return;
+
+  switch(ep->filter)
+  {
+    case EVFILT_READ:
+      asio_event_send(ev, ASIO_READ, 0);
+      break;
+
+    case EVFILT_WRITE:
+      if(ep->flags & EV_EOF)
+      {
+        asio_event_send(ev, ASIO_READ | ASIO_WRITE, 0);
+      } else {
+        asio_event_send(ev, ASIO_WRITE, 0);
+      }
+      break;
+
+    case EVFILT_TIMER:
+      asio_event_send(ev, ASIO_TIMER, 0);
+      break;
+
+    case EVFILT_SIGNAL:
+      asio_event_send(ev, ASIO_SIGNAL, (uint32_t)ep->data);
+      break;
+
+    default: {}
+  }
 }
 
 DECLARE_THREAD_FN(asio_backend_dispatch)
 {
   pony_register_thread();
+  pony_ctx_t* ctx = pony_ctx();
   asio_backend_t* b = arg;
-  struct kevent fired[MAX_EVENTS];
+  uint32_t batch = asio_batch_size();
+  pony_actor_t** woken = (pony_actor_t**)pool_alloc_size(
+    batch * sizeof(pony_actor_t*));
+  uint32_t disposed = 0;
 
-  while(b->kq != -1)
+  grow((void**)&b->list, &b->list_size, batch, sizeof(struct kevent));
+
+  while(true)
   {
-    int count = kevent(b->kq, NULL, 0, fired, MAX_EVENTS, NULL);
+    _atomic_store(&b->waiting, true);
+    _atomic_fence();
+
+    uint32_t changes = take_changes(b, batch, &disposed);
+
+    if(_atomic_load(&b->terminate))
+      break;
+
+    int count = kevent(b->kq, b->list, (int)changes, b->list,
+      (int)(changes + batch), NULL);
+    _atomic_store(&b->waiting, false);
+
+    // Schedule every actor woken by this wait in one go.
+    scheduler_batch_start(ctx, woken, batch);
 
     for(int i = 0; i < count; i++)
-    {
-      struct kevent* ep = &fired[i];
+      handle_event(&b->list[i]);
 
-      if((ep->ident == (uintptr_t)b->wakeup[0]) && (ep->filter == EVFILT_READ))
-      {
-        char terminate;
-        read(b->wakeup[0], &terminate, 1);
-
-        if(terminate == 1)
-        {
-          close(b->kq);
-          close(b->wakeup[0]);
-          close(b->wakeup[1]);
-          b->kq = -1;
-        }
-      } else {
-        asio_event_t* ev = ep->udata;
-
-        if(ep->flags & EV_ERROR)
-          continue;
-
-        switch(ep->filter)
-        {
-          case EVFILT_READ:
-            asio_event_send(ev, ASIO_READ, 0);
-            break;
-
-          case EVFILT_WRITE:
-            if(ep->flags & EV_EOF)
-            {
-              asio_event_send(ev, ASIO_READ | ASIO_WRITE, 0);
-            } else {
-              asio_event_send(ev, ASIO_WRITE, 0);
-            }
-            break;
-
-          case EVFILT_TIMER:
-            asio_event_send(ev, ASIO_TIMER, 0);
-            break;
-
-          case EVFILT_SIGNAL:
-            asio_event_send(ev, ASIO_SIGNAL, (uint32_t)ep->data);
-            break;
-
-          default: {}
-        }
-      }
-    }
+    scheduler_batch_end(ctx);
 
-    handle_queue(b);
+    for(uint32_t i = 0; i < disposed; i++)
+      asio_event_send(b->disposed[i], ASIO_DISPOSABLE, 0);
   }
 
+  // Nothing waits for the changes queued last, but unsubscribed events are
+  // still sent back.
+  for(uint32_t i = 0; i < disposed; i++)
+    asio_event_send(b->disposed[i], ASIO_DISPOSABLE, 0);
+
+  close(b->kq);
+
+  if(b->list != NULL)
+    pool_free_size(b->list_size * sizeof(struct kevent), b->list);
+
+  if(b->disposed != NULL)
+    pool_free_size(b->disposed_size * sizeof(asio_event_t*), b->disposed);
+
+  pool_free_size(batch * sizeof(pony_actor_t*), woken);
   messageq_destroy(&b->q);
   POOL_FREE(asio_backend_t, b);
   return NULL;
@@ -143,15 +273,18 @@ void asio_event_subscribe(asio_event_t* ev)
     return;
   }
 
-  asio_backend_t* b = asio_get_backend();
+  asio_backend_t* b = asio_backend_of(ev->owner);
 
   if(ev->noisy)
     asio_noisy_add();
 
-  struct kevent event[4];
-  int i = 0;
+  kqueue_msg_t* m = new_request(ev, REQ_CHANGE);
+  struct kevent* event = m->change;
+  uint32_t i = 0;
 
-  // EV_CLEAR enforces edge triggered behaviour.
+  // EV_CLEAR enforces edge triggered behaviour. Adding a filter reports a
+  // condition that already holds, so nothing is missed while the change is
+  // queued.
   if(ev->flags & ASIO_READ)
   {
     EV_SET(&event[i], ev->fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, ev);
@@ -183,10 +316,8 @@ void asio_event_subscribe(asio_event_t* ev)
     i++;
   }
 
-  kevent(b->kq, event, i, NULL, 0, NULL);
-
-  if(ev->fd == STDIN_FILENO)
-    retry_loop(b);
+  m->count = i;
+  send_request(b, m);
 }
 
 void asio_event_setnsec(asio_event_t* ev, uint64_t nsec)
@@ -200,26 +331,69 @@ void asio_event_setnsec(asio_event_t* ev, uint64_t nsec)
     return;
   }
 
-  asio_backend_t* b = asio_get_backend();
+  if((ev->flags & ASIO_TIMER) == 0)
+    return;
 
-  struct kevent event[1];
-  int i = 0;
-
-  if(ev->flags & ASIO_TIMER)
-  {
-    ev->nsec = nsec;
+  asio_backend_t* b = asio_backend_of(ev->owner);
+  kqueue_msg_t* m = new_request(ev, REQ_CHANGE);
+  ev->nsec = nsec;
 
 #ifdef PLATFORM_IS_FREEBSD
-    EV_SET(&event[i], (uintptr_t)ev, EVFILT_TIMER, EV_ADD | EV_ONESHOT,
-      0, ev->nsec / 1000000, ev);
+  EV_SET(&m->change[0], (uintptr_t)ev, EVFILT_TIMER, EV_ADD | EV_ONESHOT,
+    0, ev->nsec / 1000000, ev);
 #else
-    EV_SET(&event[i], (uintptr_t)ev, EVFILT_TIMER, EV_ADD | EV_ONESHOT,
-      NOTE_NSECONDS, ev->nsec, ev);
+  EV_SET(&m->change[0], (uintptr_t)ev, EVFILT_TIMER, EV_ADD | EV_ONESHOT,
+    NOTE_NSECONDS, ev->nsec, ev);
 #endif
+
+  m->count = 1;
+  send_request(b, m);
+}
+
+void asio_event_setflags(asio_event_t* ev, uint32_t flags)
+{
+  // An event that is being disposed of may still be asked to change flags by
+  // its owner, which hasn't seen the disposal yet.
+  if((ev == NULL) ||
+    (ev->flags == ASIO_DISPOSABLE) ||
+    (ev->flags == ASIO_DESTROYED))
+    return;
+
+  if(ev->magic != ev)
+  {
+    assert(0);
+    return;
+  }
+
+  asio_backend_t* b = asio_backend_of(ev->owner);
+  uint32_t io = ASIO_READ | ASIO_WRITE;
+  uint32_t changed = (ev->flags ^ flags) & io;
+  ev->flags = (ev->flags & ~io) | (flags & io);
+
+  if(changed == 0)
+    return;
+
+  kqueue_msg_t* m = new_request(ev, REQ_CHANGE);
+  struct kevent* event = m->change;
+  uint32_t i = 0;
+
+  // Adding a filter reports a condition that already holds.
+  if(changed & ASIO_READ)
+  {
+    EV_SET(&event[i], ev->fd, EVFILT_READ,
+      (flags & ASIO_READ) ? (EV_ADD | EV_CLEAR) : EV_DELETE, 0, 0, ev);
+    i++;
+  }
+
+  if(changed & ASIO_WRITE)
+  {
+    EV_SET(&event[i], ev->fd, EVFILT_WRITE,
+      (flags & ASIO_WRITE) ? (EV_ADD | EV_CLEAR) : EV_DELETE, 0, 0, ev);
     i++;
   }
 
-  kevent(b->kq, event, i, NULL, 0, NULL);
+  m->count = i;
+  send_request(b, m);
 }
 
 void asio_event_unsubscribe(asio_event_t* ev)
@@ -233,7 +407,7 @@ void asio_event_unsubscribe(asio_event_t* ev)
     return;
   }
 
-  asio_backend_t* b = asio_get_backend();
+  asio_backend_t* b = asio_backend_of(ev->owner);
 
   if(ev->noisy)
   {
@@ -241,8 +415,9 @@ void asio_event_unsubscribe(asio_event_t* ev)
     ev->noisy = false;
   }
 
-  struct kevent event[3];
-  int i = 0;
+  kqueue_msg_t* m = new_request(ev, REQ_UNSUBSCRIBE);
+  struct kevent* event = m->change;
+  uint32_t i = 0;
 
   if(ev->flags & ASIO_READ)
   {
@@ -269,17 +444,9 @@ void asio_event_unsubscribe(asio_event_t* ev)
     i++;
   }
 
-  kevent(b->kq, event, i, NULL, 0, NULL);
-
+  m->count = i;
   ev->flags = ASIO_DISPOSABLE;
-
-  asio_msg_t* msg = (asio_msg_t*)pony_alloc_msg(
-    POOL_INDEX(sizeof(asio_msg_t)), 0);
-  msg->event = ev;
-  msg->flags = ASIO_DISPOSABLE;
-  messageq_push(&b->q, (pony_msg_t*)msg);
-
-  retry_loop(b);
+  send_request(b, m);
 }
 
 #endif
@@ -0,0 +1,530 @@
+#include "wheel.h"
+#include "asio.h"
+#include "../actor/messageq.h"
+#include "../ds/fun.h"
+#include "../lang/clock.h"
+#include "../mem/pool.h"
+#include <string.h>
+#include <assert.h>
+
+// A tick is 2^WHEEL_SLOP nanoseconds, about a millisecond. Each level of the
+// wheel has 2^WHEEL_BITS slots, and each slot of a level covers as many ticks
+// as the whole of the level below it. Timers further out than the top level
+// covers wait in its furthest slot until they come into range.
+#define WHEEL_SLOP 20
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 6
+
+// A timer thread wakes at least this often, so that requests that didn't wake
+// it, and waits measured against a wall clock that has changed, are caught up.
+#define WHEEL_MAX_SLEEP 1000000000
+
+// The level of a timer that is on no list, and of one on the idle list.
+#define WHEEL_NONE (WHEEL_LEVELS + 1)
+#define WHEEL_IDLE WHEEL_LEVELS
+
+enum
+{
+  WHEEL_SET,
+  WHEEL_CANCEL
+};
+
+typedef struct wheel_timer_t
+{
+  asio_event_t* event;
+  struct wheel_timer_t* prev;
+  struct wheel_timer_t* next;
+  uint64_t deadline;
+  uint64_t interval;
+  uint32_t level;
+  uint32_t slot;
+} wheel_timer_t;
+
+typedef struct wheel_msg_t
+{
+  pony_msg_t msg;
+  wheel_timer_t* timer;
+  uint64_t deadline;
+  uint64_t interval;
+} wheel_msg_t;
+
+// Everything but the queue, the park and the wake time is only touched by the
+// wheel's own thread.
+typedef struct wheel_t
+{
+  pony_thread_id_t tid;
+  uint32_t volatile started;
+  pony_park_t park;
+  messageq_t q;
+  uint64_t volatile wake_at;
+  bool volatile terminate;
+  uint64_t now;
+  uint64_t pending[WHEEL_LEVELS];
+  wheel_timer_t* slot[WHEEL_LEVELS][WHEEL_SLOTS];
+  wheel_timer_t* idle;
+} wheel_t;
+
+static wheel_t* running_wheel;
+static uint32_t wheel_count = 1;
+static bool volatile wheel_enabled;
+
+static wheel_t* wheel_of(pony_actor_t* owner)
+{
+  if(wheel_count == 1)
+    return &running_wheel[0];
+
+  return &running_wheel[hash_ptr(owner) % wheel_count];
+}
+
+static uint64_t rotr(uint64_t x, uint64_t n)
+{
+  n &= 63;
+
+  if(n == 0)
+    return x;
+
+  return (x >> n) | (x << (64 - n));
+}
+
+static void push_list(wheel_timer_t** list, wheel_timer_t* t)
+{
+  t->prev = NULL;
+  t->next = *list;
+
+  if(*list != NULL)
+    (*list)->prev = t;
+
+  *list = t;
+}
+
+static void unlink_timer(wheel_t* w, wheel_timer_t* t)
+{
+  if(t->level == WHEEL_NONE)
+    return;
+
+  wheel_timer_t** list;
+
+  if(t->level == WHEEL_IDLE)
+    list = &w->idle;
+  else
+    list = &w->slot[t->level][t->slot];
+
+  if(t->prev != NULL)
+    t->prev->next = t->next;
+  else
+    *list = t->next;
+
+  if(t->next != NULL)
+    t->next->prev = t->prev;
+
+  if((t->level < WHEEL_LEVELS) && (*list == NULL))
+    w->pending[t->level] &= ~((uint64_t)1 << t->slot);
+
+  t->level = WHEEL_NONE;
+}
+
+static void schedule(wheel_t* w, wheel_timer_t* t);
+
+/**
+ * Tells the owner a timer has expired. Expirations up to the end of the
+ * current tick are counted, and a timer with an interval is put back on the
+ * wheel for the next expiration after that.
+ */
+static void fire(wheel_t* w, wheel_timer_t* t)
+{
+  uint64_t count = 1;
+
+  if(t->interval > 0)
+  {
+    uint64_t last = ((w->now + 1) << WHEEL_SLOP) - 1;
+
+    if(last > t->deadline)
+      count += (last - t->deadline) / t->interval;
+
+    t->deadline += count * t->interval;
+    schedule(w, t);
+  } else {
+    t->level = WHEEL_IDLE;
+    push_list(&w->idle, t);
+  }
+
+  asio_event_send(t->event, ASIO_TIMER,
+    (count > UINT32_MAX) ? UINT32_MAX : (uint32_t)count);
+}
+
+/**
+ * Puts a timer on the level whose slots are the right size for how far off it
+ * is, or fires it if it is due.
+ */
+static void schedule(wheel_t* w, wheel_timer_t* t)
+{
+  uint64_t tick = t->deadline >> WHEEL_SLOP;
+
+  if(tick <= w->now)
+  {
+    fire(w, t);
+    return;
+  }
+
+  uint64_t delta = tick - w->now;
+  uint32_t level = 0;
+
+  while((level < (WHEEL_LEVELS - 1)) &&
+    ((delta >> ((level + 1) * WHEEL_BITS)) != 0))
+    level++;
+
+  if((delta >> (WHEEL_LEVELS * WHEEL_BITS)) != 0)
+    tick = w->now + ((uint64_t)1 << (WHEEL_LEVELS * WHEEL_BITS)) - 1;
+
+  uint32_t slot = (uint32_t)((tick >> (level * WHEEL_BITS)) & WHEEL_MASK);
+  t->level = level;
+  t->slot = slot;
+  push_list(&w->slot[level][slot], t);
+  w->pending[level] |= (uint64_t)1 << slot;
+}
+
+/**
+ * The next tick at which a slot with timers in it is reached, or UINT64_MAX if
+ * the wheel is empty. On a level above the bottom one, a slot is reached when
+ * the level below it comes round to the start of the slot, and its timers are
+ * then moved down.
+ */
+static uint64_t next_tick(wheel_t* w)
+{
+  uint64_t next = UINT64_MAX;
+
+  for(uint32_t i = 0; i < WHEEL_LEVELS; i++)
+  {
+    uint64_t pending = w->pending[i];
+
+    if(pending == 0)
+      continue;
+
+    uint32_t shift = i * WHEEL_BITS;
+    uint64_t base = (w->now >> shift) + 1;
+    uint64_t skip = (uint64_t)__pony_ffsl(rotr(pending, base)) - 1;
+    uint64_t tick = (base + skip) << shift;
+
+    if(tick < next)
+      next = tick;
+  }
+
+  return next;
+}
+
+/**
+ * Moves the wheel on to the given tick, moving timers down a level as their
+ * slots are reached and firing those that are due.
+ */
+static void advance(wheel_t* w, uint64_t target)
+{
+  while(true)
+  {
+    uint64_t tick = next_tick(w);
+
+    if(tick > target)
+      break;
+
+    w->now = tick;
+
+    for(uint32_t i = WHEEL_LEVELS; i > 0; i--)
+    {
+      uint32_t level = i - 1;
+      uint32_t shift = level * WHEEL_BITS;
+
+      if((tick & (((uint64_t)1 << shift) - 1)) != 0)
+        continue;
+
+      uint32_t slot = (uint32_t)((tick >> shift) & WHEEL_MASK);
+
+      if((w->pending[level] & ((uint64_t)1 << slot)) == 0)
+        continue;
+
+      wheel_timer_t* t = w->slot[level][slot];
+      w->slot[level][slot] = NULL;
+      w->pending[level] &= ~((uint64_t)1 << slot);
+
+      while(t != NULL)
+      {
+        wheel_timer_t* next = t->next;
+        t->level = WHEEL_NONE;
+        schedule(w, t);
+        t = next;
+      }
+    }
+  }
+
+  if(target > w->now)
+    w->now = target;
+}
+
+static void handle_msg(wheel_t* w, wheel_msg_t* m)
+{
+  wheel_timer_t* t = m->timer;
+  unlink_timer(w, t);
+
+  switch(m->msg.id)
+  {
+    case WHEEL_SET:
+      t->deadline = m->deadline;
+      t->interval = m->interval;
+      schedule(w, t);
+      break;
+
+    case WHEEL_CANCEL:
+    {
+      asio_event_t* ev = t->event;
+      bool noisy = ev->noisy;
+      POOL_FREE(wheel_timer_t, t);
+
+      asio_event_send(ev, ASIO_DISPOSABLE, 0);
+
+      if(noisy)
+        asio_noisy_remove();
+      break;
+    }
+
+    default: {}
+  }
+}
+
+static void free_list(wheel_timer_t* t)
+{
+  while(t != NULL)
+  {
+    wheel_timer_t* next = t->next;
+    POOL_FREE(wheel_timer_t, t);
+    t = next;
+  }
+}
+
+static DECLARE_THREAD_FN(run_thread)
+{
+  wheel_t* w = (wheel_t*)arg;
+  pony_register_thread();
+  w->now = os_clock_nanos() >> WHEEL_SLOP;
+
+  while(!_atomic_load(&w->terminate))
+  {
+    // Requests go first, so that a timer reset before it was due doesn't
+    // fire at the old time.
+    wheel_msg_t* m;
+
+    while((m = (wheel_msg_t*)messageq_pop(&w->q)) != NULL)
+      handle_msg(w, m);
+
+    uint64_t now = os_clock_nanos();
+    advance(w, now >> WHEEL_SLOP);
+
+    uint64_t sleep = WHEEL_MAX_SLEEP;
+    uint64_t tick = next_tick(w);
+
+    if(tick != UINT64_MAX)
+    {
+      uint64_t at = tick << WHEEL_SLOP;
+
+      if(at <= now)
+        continue;
+
+      if((at - now) < sleep)
+        sleep = at - now;
+    }
+
+    // Senders look at the wake time after they queue a request, and we look
+    // at the queue after we set it, so one of us sees the other.
+    pony_park_lock(&w->park);
+    _atomic_store(&w->wake_at, now + sleep);
+    _atomic_fence();
+
+    m = (wheel_msg_t*)messageq_pop(&w->q);
+
+    if(m == NULL)
+    {
+      if(!_atomic_load(&w->terminate))
+        pony_park_wait_timed(&w->park, sleep);
+    }
+
+    _atomic_store(&w->wake_at, 0);
+    pony_park_unlock(&w->park);
+
+    if(m != NULL)
+      handle_msg(w, m);
+  }
+
+  return 0;
+}
+
+static void send_request(wheel_t* w, uint32_t id, wheel_timer_t* t,
+  uint64_t nsec, uint64_t interval)
+{
+  uint64_t now = os_clock_nanos();
+  uint64_t deadline = (nsec > (UINT64_MAX - now)) ? UINT64_MAX : now + nsec;
+
+  wheel_msg_t* m = (wheel_msg_t*)pony_alloc_msg(
+    POOL_INDEX(sizeof(wheel_msg_t)), id);
+  m->timer = t;
+  m->deadline = deadline;
+  m->interval = interval;
+  messageq_push(&w->q, &m->msg);
+
+  // Only wake the thread if it would otherwise sleep past the new deadline.
+  // Cancelling can wait until it next wakes.
+  if(id != WHEEL_SET)
+    return;
+
+  _atomic_fence();
+
+  if(deadline < _atomic_load(&w->wake_at))
+  {
+    pony_park_lock(&w->park);
+    pony_park_signal(&w->park);
+    pony_park_unlock(&w->park);
+  }
+}
+
+void asio_wheel_setthreads(uint32_t threads)
+{
+  wheel_count = (threads > 0) ? threads : 1;
+}
+
+void asio_wheel_init()
+{
+  _atomic_store(&wheel_enabled, false);
+  running_wheel = (wheel_t*)pool_alloc_size(wheel_count * sizeof(wheel_t));
+  memset(running_wheel, 0, wheel_count * sizeof(wheel_t));
+
+  for(uint32_t i = 0; i < wheel_count; i++)
+  {
+    wheel_t* w = &running_wheel[i];
+    pony_park_init(&w->park);
+    messageq_init(&w->q);
+  }
+}
+
+bool asio_wheel_start()
+{
+  // Each wheel's thread is started when the first timer is put on it.
+  _atomic_store(&wheel_enabled, true);
+  return true;
+}
+
+void asio_wheel_stop()
+{
+  if(running_wheel == NULL)
+    return;
+
+  for(uint32_t i = 0; i < wheel_count; i++)
+  {
+    wheel_t* w = &running_wheel[i];
+    pony_park_lock(&w->park);
+    _atomic_store(&w->terminate, true);
+    pony_park_signal(&w->park);
+    pony_park_unlock(&w->park);
+  }
+
+  for(uint32_t i = 0; i < wheel_count; i++)
+  {
+    wheel_t* w = &running_wheel[i];
+
+    if(_atomic_load(&w->started) != 0)
+      pony_thread_join(w->tid);
+
+    // Nobody is told about requests still queued. Timers being set are put
+    // on the idle list so that they are freed with the rest.
+    wheel_msg_t* m;
+
+    while((m = (wheel_msg_t*)messageq_pop(&w->q)) != NULL)
+    {
+      wheel_timer_t* t = m->timer;
+      unlink_timer(w, t);
+
+      if(m->msg.id == WHEEL_SET)
+      {
+        t->level = WHEEL_IDLE;
+        push_list(&w->idle, t);
+      } else {
+        POOL_FREE(wheel_timer_t, t);
+      }
+    }
+
+    for(uint32_t level = 0; level < WHEEL_LEVELS; level++)
+    {
+      for(uint32_t slot = 0; slot < WHEEL_SLOTS; slot++)
+        free_list(w->slot[level][slot]);
+    }
+
+    free_list(w->idle);
+    messageq_destroy(&w->q);
+    pony_park_destroy(&w->park);
+  }
+
+  pool_free_size(wheel_count * sizeof(wheel_t), running_wheel);
+  running_wheel = NULL;
+}
+
+asio_event_t* asio_timer_create(pony_actor_t* owner, uint64_t nsec,
+  uint64_t interval, bool noisy)
+{
+  if(running_wheel == NULL)
+    return NULL;
+
+  asio_event_t* ev = asio_event_alloc(owner, -1, ASIO_TIMER, 0, noisy);
+
+  if(ev != NULL)
+    asio_timer_attach(ev, nsec, interval);
+
+  return ev;
+}
+
+void asio_timer_attach(asio_event_t* ev, uint64_t nsec, uint64_t interval)
+{
+  if((ev == NULL) || (ev->flags != ASIO_TIMER) || (running_wheel == NULL))
+    return;
+
+  wheel_timer_t* t = POOL_ALLOC(wheel_timer_t);
+  memset(t, 0, sizeof(wheel_timer_t));
+  t->event = ev;
+  t->level = WHEEL_NONE;
+
+  // As signals keep their number there, a timer keeps its place on the wheel
+  // in nsec. It has no file descriptor.
+  ev->fd = -1;
+  ev->nsec = (uint64_t)(uintptr_t)t;
+
+  if(ev->noisy)
+    asio_noisy_add();
+
+  wheel_t* w = wheel_of(ev->owner);
+  send_request(w, WHEEL_SET, t, nsec, interval);
+
+  // The request waits on the queue until the thread gets to it.
+  uint32_t expect = 0;
+
+  if(_atomic_load(&wheel_enabled) && (_atomic_load(&w->started) == 0) &&
+    _atomic_cas(&w->started, &expect, 1) &&
+    !pony_thread_create(&w->tid, run_thread, -1, w))
+    _atomic_store(&w->started, 0);
+}
+
+void asio_timer_set(asio_event_t* ev, uint64_t nsec, uint64_t interval)
+{
+  if((ev == NULL) || (ev->flags != ASIO_TIMER) || (ev->fd != -1))
+    return;
+
+  wheel_timer_t* t = (wheel_timer_t*)(uintptr_t)ev->nsec;
+  send_request(wheel_of(ev->owner), WHEEL_SET, t, nsec, interval);
+}
+
+void asio_timer_cancel(asio_event_t* ev)
+{
+  if((ev == NULL) || (ev->flags != ASIO_TIMER) || (ev->fd != -1))
+    return;
+
+  // Any expiry already sent still arrives, but nothing after the disposable
+  // event.
+  ev->flags = ASIO_DISPOSABLE;
+  wheel_timer_t* t = (wheel_timer_t*)(uintptr_t)ev->nsec;
+  send_request(wheel_of(ev->owner), WHEEL_CANCEL, t, 0, 0);
+}
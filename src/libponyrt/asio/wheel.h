@@ -0,0 +1,64 @@
+#ifndef asio_wheel_h
+#define asio_wheel_h
+
+#include "event.h"
+#include <pony.h>
+#include <platform.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+PONY_EXTERN_C_BEGIN
+
+/** Sets the number of timer threads, each with a hierarchical timing wheel of
+ * its own. Timers are spread over them by owning actor.
+ *
+ * Call this before asio_init(). Zero keeps the default of one thread.
+ */
+void asio_wheel_setthreads(uint32_t threads);
+
+/// Called by asio_init().
+void asio_wheel_init();
+
+/// Called by asio_start().
+bool asio_wheel_start();
+
+/** Stops and joins the timer threads.
+ *
+ * Called by asio_stop() once no noisy event is left. Timers that are still
+ * set are dropped without their owners hearing about it.
+ */
+void asio_wheel_stop();
+
+/** Creates a timer that fires nsec nanoseconds from now, and then every
+ * interval nanoseconds if the interval isn't zero.
+ *
+ * Each time it fires, the owner is sent the timer's event with ASIO_TIMER and
+ * the number of times it has expired since it last fired as the argument.
+ * Timers are kept to about a millisecond. Setting, resetting and cancelling a
+ * timer takes constant time on the calling thread, and doesn't send any actor
+ * a message.
+ */
+asio_event_t* asio_timer_create(pony_actor_t* owner, uint64_t nsec,
+  uint64_t interval, bool noisy);
+
+/** Puts an event made by asio_event_alloc() with ASIO_TIMER on a wheel, as
+ * asio_timer_create() does. The backends use this for timer events that are
+ * subscribed, rather than giving each one a kernel timer of its own.
+ */
+void asio_timer_attach(asio_event_t* ev, uint64_t nsec, uint64_t interval);
+
+/** Resets a timer to fire nsec nanoseconds from now, and then every interval
+ * nanoseconds. Only the owner may do this. A timer that has fired and has no
+ * interval can be set again this way.
+ */
+void asio_timer_set(asio_event_t* ev, uint64_t nsec, uint64_t interval);
+
+/** Cancels a timer. It doesn't fire again, and the owner is later sent the
+ * event with ASIO_DISPOSABLE, after which it can be destroyed. Only the owner
+ * may do this.
+ */
+void asio_timer_cancel(asio_event_t* ev);
+
+PONY_EXTERN_C_END
+
+#endif
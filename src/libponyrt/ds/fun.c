@@ -70,6 +70,118 @@ uint64_t hash_block(const void* p, size_t len)
   return siphash24(the_key, (const char*)p, len);
 }
 
+static const uint64_t fast_p[4] =
+{
+  0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL,
+  0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL
+};
+
+static uint64_t fast_mix(uint64_t a, uint64_t b)
+{
+  // Fold the 128 bit product of a and b into 64 bits.
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+  uint64_t ha = a >> 32;
+  uint64_t la = (uint32_t)a;
+  uint64_t hb = b >> 32;
+  uint64_t lb = (uint32_t)b;
+  uint64_t hh = ha * hb;
+  uint64_t hl = ha * lb;
+  uint64_t lh = la * hb;
+  uint64_t ll = la * lb;
+  uint64_t mid = (ll >> 32) + (uint32_t)hl + (uint32_t)lh;
+  uint64_t lo = (mid << 32) | (uint32_t)ll;
+  uint64_t hi = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+  return lo ^ hi;
+#endif
+}
+
+static uint64_t fast_read64(const unsigned char* p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t fast_read32(const unsigned char* p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/**
+ * A wyhash-style hash: each 16 byte block costs one 64x64->128 bit multiply,
+ * and inputs up to 16 bytes take no loop at all. It is well distributed, but
+ * with a fixed key anybody can construct colliding inputs, so it is only for
+ * tables whose keys don't come from outside the program.
+ */
+static uint64_t fasthash(const unsigned char* key, const unsigned char* p,
+  size_t len)
+{
+  uint64_t seed = fast_read64(key) ^ fast_mix(fast_read64(key + 8) ^
+    fast_p[0], fast_p[1]);
+  uint64_t a;
+  uint64_t b;
+
+  if(len <= 16)
+  {
+    if(len >= 4)
+    {
+      size_t mid = (len >> 3) << 2;
+      a = (fast_read32(p) << 32) | fast_read32(p + mid);
+      b = (fast_read32(p + len - 4) << 32) | fast_read32(p + len - 4 - mid);
+    } else if(len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = 0;
+      b = 0;
+    }
+  } else {
+    size_t i = len;
+
+    if(i > 48)
+    {
+      uint64_t see1 = seed;
+      uint64_t see2 = seed;
+
+      do
+      {
+        seed = fast_mix(fast_read64(p) ^ fast_p[1], fast_read64(p + 8) ^ seed);
+        see1 = fast_mix(fast_read64(p + 16) ^ fast_p[2],
+          fast_read64(p + 24) ^ see1);
+        see2 = fast_mix(fast_read64(p + 32) ^ fast_p[3],
+          fast_read64(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while(i > 48);
+
+      seed ^= see1 ^ see2;
+    }
+
+    while(i > 16)
+    {
+      seed = fast_mix(fast_read64(p) ^ fast_p[1], fast_read64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+
+    // The last 16 bytes, which may overlap the block before.
+    a = fast_read64(p + i - 16);
+    b = fast_read64(p + i - 8);
+  }
+
+  return fast_mix(fast_p[1] ^ len, fast_mix(a ^ fast_p[1], b ^ seed));
+}
+
+uint64_t hash_block_fast(const void* p, size_t len)
+{
+  return fasthash(the_key, (const unsigned char*)p, len);
+}
+
 uint64_t hash_str(const char* str)
 {
   return siphash24(the_key, str, strlen(str));
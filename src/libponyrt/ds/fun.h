@@ -20,8 +20,18 @@ typedef void (*free_fn)(void* data);
 
 typedef void (*free_size_fn)(size_t size, void* data);
 
+/**
+ * SipHash-2-4. Use this for keys that may come from outside the program, as
+ * it resists inputs chosen to collide.
+ */
 uint64_t hash_block(const void* p, size_t len);
 
+/**
+ * A much faster hash with no such resistance, for the runtime's and the
+ * compiler's own tables.
+ */
+uint64_t hash_block_fast(const void* p, size_t len);
+
 uint64_t hash_str(const char* str);
 
 size_t hash_ptr(const void* p);
@@ -3,7 +3,7 @@
 #include <string.h>
 #include <assert.h>
 
-#define DELETED ((void*)1)
+#define DELETED HASHMAP_DELETED
 
 static bool valid(void* entry)
 {
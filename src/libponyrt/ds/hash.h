@@ -11,6 +11,7 @@
 PONY_EXTERN_C_BEGIN
 
 #define HASHMAP_BEGIN ((size_t)-1)
+#define HASHMAP_DELETED ((void*)1)
 
 /** Definition of a quadratic probing hash map.
  *
@@ -40,6 +41,40 @@ void hashmap_destroy(hashmap_t* map, free_size_fn fr, free_fn free_elem);
  */
 void* hashmap_get(hashmap_t* map, void* key, hash_fn hash, cmp_fn cmp);
 
+/** Retrieve an element from a hash map, with the hash and compare functions
+ *  visible to the compiler so that a lookup through DEFINE_HASHMAP calls them
+ *  directly rather than through a pointer on every probe.
+ *
+ *  This probes the same buckets as hashmap_get(). Returns a pointer to the
+ *  element, or NULL.
+ */
+static inline void* hashmap_get_inline(hashmap_t* map, void* key,
+  hash_fn hash, cmp_fn cmp)
+{
+  if(map->count == 0)
+    return NULL;
+
+  size_t mask = map->size - 1;
+  size_t h = hash(key);
+  size_t index = h & mask;
+  void* elem;
+
+  for(size_t i = 0; i <= mask; i++)
+  {
+    elem = map->buckets[index];
+
+    if(elem == NULL)
+      return NULL;
+
+    if((elem != HASHMAP_DELETED) && cmp(key, elem))
+      return elem;
+
+    index = (h + ((i + (i * i)) >> 1)) & mask;
+  }
+
+  return NULL;
+}
+
 /** Put a new element in a hash map.
  *
  *  If the element (according to cmp_fn) is already in the hash map, the old
@@ -103,8 +138,8 @@ void* hashmap_next(hashmap_t* map, size_t* i);
   { \
     name##_hash_fn hashf = hash; \
     name##_cmp_fn cmpf = cmp; \
-    return (type*)hashmap_get((hashmap_t*)map, (void*)key, (hash_fn)hashf, \
-      (cmp_fn)cmpf); \
+    return (type*)hashmap_get_inline((hashmap_t*)map, (void*)key, \
+      (hash_fn)hashf, (cmp_fn)cmpf); \
   } \
   type* name##_put(name##_t* map, type* entry) \
   { \
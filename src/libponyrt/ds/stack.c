@@ -2,9 +2,17 @@
 #include "../mem/pool.h"
 #include <assert.h>
 
-static Stack* stack_new(Stack* prev, void* data)
+static __pony_thread_local Stack* stack_spare;
+
+Stack* stack_grow(Stack* prev, void* data)
 {
-  Stack* stack = (Stack*)POOL_ALLOC(Stack);
+  Stack* stack = stack_spare;
+
+  if(stack != NULL)
+    stack_spare = NULL;
+  else
+    stack = (Stack*)POOL_ALLOC(Stack);
+
   stack->index = 1;
   stack->data[0] = data;
   stack->prev = prev;
@@ -12,33 +20,15 @@ static Stack* stack_new(Stack* prev, void* data)
   return stack;
 }
 
-Stack* stack_pop(Stack* stack, void** data)
+Stack* stack_shrink(Stack* stack)
 {
-  assert(stack != NULL);
-  assert(data != NULL);
+  assert(stack->index == 0);
+  Stack* prev = stack->prev;
 
-  stack->index--;
-  *data = stack->data[stack->index];
-
-  if(stack->index == 0)
-  {
-    Stack* prev = stack->prev;
+  if(stack_spare == NULL)
+    stack_spare = stack;
+  else
     POOL_FREE(Stack, stack);
-    return prev;
-  }
-
-  return stack;
-}
 
-Stack* stack_push(Stack* stack, void* data)
-{
-  if((stack != NULL) && (stack->index < STACK_COUNT))
-  {
-    stack->data[stack->index] = data;
-    stack->index++;
-  } else {
-    stack = stack_new(stack, data);
-  }
-
-  return stack;
+  return prev;
 }
@@ -14,14 +14,62 @@ typedef struct Stack
   struct Stack* prev;
 } Stack;
 
-Stack* stack_pop(Stack* stack, void** data);
+/** Pushes onto a new chunk, when the top one is full.
+ */
+Stack* stack_grow(Stack* stack, void* data);
 
-Stack* stack_push(Stack* list, void* data);
+/** Drops the top chunk once it is empty. Each thread keeps one empty chunk
+ *  for the next stack_grow(), so a stack that goes back and forth across a
+ *  chunk boundary, or is emptied and refilled, doesn't go to the pool.
+ */
+Stack* stack_shrink(Stack* stack);
+
+static inline Stack* stack_push(Stack* stack, void* data)
+{
+  if((stack != NULL) && (stack->index < STACK_COUNT))
+  {
+    stack->data[stack->index++] = data;
+    return stack;
+  }
+
+  return stack_grow(stack, data);
+}
+
+static inline Stack* stack_pop(Stack* stack, void** data)
+{
+  stack->index--;
+  *data = stack->data[stack->index];
+
+  if(stack->index == 0)
+    return stack_shrink(stack);
+
+  return stack;
+}
+
+/** Returns the entry depth entries below the top, without popping anything,
+ *  or NULL if there aren't that many. Chunks below the top one are full.
+ */
+static inline void* stack_peek(Stack* stack, int depth)
+{
+  if(stack == NULL)
+    return NULL;
+
+  if(depth < stack->index)
+    return stack->data[stack->index - 1 - depth];
+
+  depth -= stack->index;
+
+  if((stack->prev == NULL) || (depth >= STACK_COUNT))
+    return NULL;
+
+  return stack->prev->data[STACK_COUNT - 1 - depth];
+}
 
 #define DECLARE_STACK(name, elem) \
   typedef struct name##_t name##_t; \
   name##_t* name##_pop(name##_t* stack, elem** data); \
   name##_t* name##_push(name##_t* stack, elem* data); \
+  elem* name##_peek(name##_t* stack, int depth); \
 
 #define DEFINE_STACK(name, elem) \
   struct name##_t {}; \
@@ -34,6 +82,10 @@ Stack* stack_push(Stack* list, void* data);
   { \
     return (name##_t*)stack_push((Stack*)stack, data); \
   } \
+  elem* name##_peek(name##_t* stack, int depth) \
+  { \
+    return (elem*)stack_peek((Stack*)stack, depth); \
+  } \
 
 PONY_EXTERN_C_END
 
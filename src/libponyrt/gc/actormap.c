@@ -74,6 +74,11 @@ void actorref_inc_more(actorref_t* aref)
   aref->rc = GC_INC_MORE;
 }
 
+void actorref_inc_some(actorref_t* aref, size_t rc)
+{
+  aref->rc += rc;
+}
+
 bool actorref_dec(actorref_t* aref)
 {
   assert(aref->rc > 0);
@@ -147,6 +152,37 @@ static void send_release(pony_ctx_t* ctx, actorref_t* aref)
   pony_sendp(ctx, aref->actor, ACTORMSG_RELEASE, aref);
 }
 
+static size_t defer_release(actormap_t* release, actorref_t* aref)
+{
+  if(aref == NULL)
+    return 0;
+
+  size_t count = objectmap_size(&aref->map);
+  actorref_t* prev = actormap_getactor(release, aref->actor);
+
+  if(prev == NULL)
+  {
+    actormap_put(release, aref);
+    return count;
+  }
+
+  // Fold this release into the one already waiting for the same actor.
+  prev->rc += aref->rc;
+
+  size_t i = HASHMAP_BEGIN;
+  object_t* obj;
+
+  while((obj = objectmap_next(&aref->map, &i)) != NULL)
+  {
+    object_t* obj_prev = objectmap_getorput(&prev->map, object_address(obj),
+      0);
+    object_inc_some(obj_prev, object_rc(obj));
+  }
+
+  actorref_free(aref);
+  return count;
+}
+
 actorref_t* actormap_getactor(actormap_t* map, pony_actor_t* actor)
 {
   actorref_t key;
@@ -168,8 +204,8 @@ actorref_t* actormap_getorput(actormap_t* map, pony_actor_t* actor,
   return aref;
 }
 
-deltamap_t* actormap_sweep(pony_ctx_t* ctx, actormap_t* map, uint32_t mark,
-  deltamap_t* delta)
+deltamap_t* actormap_sweep(actormap_t* map, uint32_t mark, deltamap_t* delta,
+  actormap_t* release, size_t* count)
 {
   size_t i = HASHMAP_BEGIN;
   actorref_t* aref;
@@ -184,8 +220,23 @@ deltamap_t* actormap_sweep(pony_ctx_t* ctx, actormap_t* map, uint32_t mark,
       delta = deltamap_update(delta, aref->actor, 0);
     }
 
-    send_release(ctx, aref);
+    *count += defer_release(release, aref);
   }
 
   return delta;
 }
+
+void actormap_sendrelease(pony_ctx_t* ctx, actormap_t* release)
+{
+  size_t i = HASHMAP_BEGIN;
+  actorref_t* aref;
+
+  while((aref = actormap_next(release, &i)) != NULL)
+  {
+    actormap_removeindex(release, i);
+    send_release(ctx, aref);
+  }
+
+  actormap_destroy(release);
+  memset(release, 0, sizeof(actormap_t));
+}
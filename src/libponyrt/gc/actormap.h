@@ -25,6 +25,8 @@ void actorref_inc(actorref_t* aref);
 
 void actorref_inc_more(actorref_t* aref);
 
+void actorref_inc_some(actorref_t* aref, size_t rc);
+
 bool actorref_dec(actorref_t* aref);
 
 object_t* actorref_getobject(actorref_t* aref, void* address);
@@ -40,8 +42,10 @@ actorref_t* actormap_getactor(actormap_t* map, pony_actor_t* actor);
 actorref_t* actormap_getorput(actormap_t* map, pony_actor_t* actor,
   uint32_t mark);
 
-deltamap_t* actormap_sweep(pony_ctx_t* ctx, actormap_t* map, uint32_t mark,
-  deltamap_t* delta);
+deltamap_t* actormap_sweep(actormap_t* map, uint32_t mark, deltamap_t* delta,
+  actormap_t* release, size_t* count);
+
+void actormap_sendrelease(pony_ctx_t* ctx, actormap_t* release);
 
 PONY_EXTERN_C_END
 
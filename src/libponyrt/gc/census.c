@@ -0,0 +1,440 @@
+#include "census.h"
+#include "trace.h"
+#include "../actor/actor.h"
+#include "../actor/registry.h"
+#include "../sched/scheduler.h"
+#include "../ds/fun.h"
+#include "../ds/hash.h"
+#include "../mem/pagemap.h"
+#include "../mem/pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct census_type_t
+{
+  pony_type_t* type;
+  size_t objects;
+  size_t bytes;
+  size_t buffers;
+  size_t buffer_bytes;
+} census_type_t;
+
+typedef struct census_edge_t
+{
+  pony_type_t* from;
+  pony_type_t* to;
+  size_t count;
+} census_edge_t;
+
+static size_t type_hash(census_type_t* t)
+{
+  return hash_ptr(t->type);
+}
+
+static bool type_cmp(census_type_t* a, census_type_t* b)
+{
+  return a->type == b->type;
+}
+
+static void type_free(census_type_t* t)
+{
+  POOL_FREE(census_type_t, t);
+}
+
+static size_t edge_hash(census_edge_t* e)
+{
+  return hash_ptr(e->from) ^ (hash_ptr(e->to) * 31);
+}
+
+static bool edge_cmp(census_edge_t* a, census_edge_t* b)
+{
+  return (a->from == b->from) && (a->to == b->to);
+}
+
+static void edge_free(census_edge_t* e)
+{
+  POOL_FREE(census_edge_t, e);
+}
+
+DECLARE_HASHMAP(census_types, census_type_t);
+DEFINE_HASHMAP(census_types, census_type_t, type_hash, type_cmp,
+  pool_alloc_size, pool_free_size, type_free);
+
+DECLARE_HASHMAP(census_edges, census_edge_t);
+DEFINE_HASHMAP(census_edges, census_edge_t, edge_hash, edge_cmp,
+  pool_alloc_size, pool_free_size, edge_free);
+
+typedef struct census_t
+{
+  // The object being traced, or NULL for one that other actors keep alive.
+  void* parent;
+  pony_type_t* parent_type;
+
+  census_types_t types;
+  census_edges_t edges;
+  FILE* graph;
+} census_t;
+
+static __pony_thread_local census_t* this_census;
+
+// The latest request for an object graph, which the actor takes when it runs
+// its census.
+static pony_actor_t* graph_actor;
+static char* graph_path;
+static size_t graph_len;
+static uint32_t volatile census_lock;
+
+static void lock()
+{
+  while(_atomic_exchange(&census_lock, 1) != 0)
+    ;
+}
+
+static void unlock()
+{
+  _atomic_store(&census_lock, 0);
+}
+
+static census_type_t* get_type(census_t* c, pony_type_t* type)
+{
+  census_type_t key;
+  key.type = type;
+  census_type_t* t = census_types_get(&c->types, &key);
+
+  if(t == NULL)
+  {
+    t = (census_type_t*)POOL_ALLOC(census_type_t);
+    memset(t, 0, sizeof(census_type_t));
+    t->type = type;
+    census_types_put(&c->types, t);
+  }
+
+  return t;
+}
+
+static void count_edge(census_t* c, pony_type_t* to)
+{
+  if(c->parent_type == NULL)
+    return;
+
+  census_edge_t key;
+  key.from = c->parent_type;
+  key.to = to;
+  census_edge_t* e = census_edges_get(&c->edges, &key);
+
+  if(e == NULL)
+  {
+    e = (census_edge_t*)POOL_ALLOC(census_edge_t);
+    *e = key;
+    e->count = 0;
+    census_edges_put(&c->edges, e);
+  }
+
+  e->count++;
+}
+
+static void write_ref(census_t* c, void* p)
+{
+  if(c->parent != NULL)
+    fprintf(c->graph, "ref %p %p\n", c->parent, p);
+  else
+    fprintf(c->graph, "held %p\n", p);
+}
+
+static void recurse(census_t* c, pony_ctx_t* ctx, void* p, pony_trace_fn f)
+{
+  if(f == pony_trace_leaf_array)
+  {
+    // A pointer-free array is traced now rather than pushed on the stack.
+    // Its buffer is counted against the array, not the object holding it.
+    void* parent = c->parent;
+    pony_type_t* parent_type = c->parent_type;
+    c->parent = p;
+    c->parent_type = *(pony_type_t**)p;
+    pony_trace_leaf_array(ctx, p);
+    c->parent = parent;
+    c->parent_type = parent_type;
+  } else {
+    ctx->stack = gcstack_push(ctx->stack, p);
+    ctx->stack = gcstack_push(ctx->stack, f);
+  }
+}
+
+static void census_object(pony_ctx_t* ctx, void* p, pony_trace_fn f,
+  bool immutable)
+{
+  census_t* c = this_census;
+  chunk_t* chunk = (chunk_t*)pagemap_get(p);
+
+  // Only the actor's own heap is counted. Anything else is marked as usual,
+  // and traced through where the actor holds references to its contents.
+  if((chunk == NULL) || (heap_owner(chunk) != ctx->current))
+  {
+    gc_markobject(ctx, p, f, immutable);
+    return;
+  }
+
+  if(c->graph != NULL)
+    write_ref(c, p);
+
+  if(f == NULL)
+  {
+    // Memory with no trace function, such as an array's buffer, has no type
+    // descriptor. It is counted against the type that points to it.
+    void* base = heap_base(chunk, p);
+
+    if(heap_ismarked(chunk, base))
+      return;
+
+    heap_mark_shallow(chunk, p);
+    size_t size = heap_size(chunk);
+
+    if(c->parent_type != NULL)
+    {
+      census_type_t* t = get_type(c, c->parent_type);
+      t->buffers++;
+      t->buffer_bytes += size;
+    }
+
+    if(c->graph != NULL)
+      fprintf(c->graph, "buffer %p " __zu "\n", base, size);
+
+    return;
+  }
+
+  pony_type_t* type = *(pony_type_t**)p;
+  count_edge(c, type);
+
+  if(heap_mark(chunk, p))
+    return;
+
+  // An embedded field is counted as part of the object around it.
+  if(heap_base(chunk, p) == p)
+  {
+    size_t size = heap_size(chunk);
+    census_type_t* t = get_type(c, type);
+    t->objects++;
+    t->bytes += size;
+
+    if(c->graph != NULL)
+      fprintf(c->graph, "object %p %u " __zu "\n", p, type->id, size);
+  }
+
+  recurse(c, ctx, p, f);
+}
+
+bool census_due(pony_actor_t* actor)
+{
+  // Checked on every gc attempt, so only pay for the exchange when set.
+  if(_atomic_load(&actor->census) == 0)
+    return false;
+
+  return _atomic_exchange(&actor->census, 0) != 0;
+}
+
+void census_start(pony_ctx_t* ctx)
+{
+  pony_actor_t* actor = ctx->current;
+  census_t* c = (census_t*)POOL_ALLOC(census_t);
+  memset(c, 0, sizeof(census_t));
+  c->parent = actor;
+  c->parent_type = actor->type;
+  census_types_init(&c->types, 64);
+  census_edges_init(&c->edges, 64);
+
+  lock();
+
+  if(graph_actor == actor)
+  {
+    c->graph = fopen(graph_path, "w");
+    pool_free_size(graph_len, graph_path);
+    graph_actor = NULL;
+    graph_path = NULL;
+  }
+
+  unlock();
+
+  if(c->graph != NULL)
+    fprintf(c->graph, "actor %p %u\n", (void*)actor, actor->type->id);
+
+  this_census = c;
+  pony_gc_mark(ctx);
+  ctx->trace_object = census_object;
+}
+
+void census_markimmutable(pony_ctx_t* ctx, gc_t* gc)
+{
+  census_t* c = this_census;
+  size_t i = HASHMAP_BEGIN;
+  object_t* obj;
+
+  c->parent = NULL;
+  c->parent_type = NULL;
+
+  while((obj = objectmap_next(&gc->local, &i)) != NULL)
+  {
+    if(object_immutable(obj) && (object_rc(obj) > 0))
+      census_object(ctx, object_address(obj), object_trace(obj), true);
+  }
+}
+
+void census_handlestack(pony_ctx_t* ctx)
+{
+  census_t* c = this_census;
+  pony_trace_fn f;
+  void *p;
+
+  while(ctx->stack != NULL)
+  {
+    ctx->stack = gcstack_pop(ctx->stack, (void**)&f);
+    ctx->stack = gcstack_pop(ctx->stack, &p);
+
+    // Everything on the stack has a trace function, so it is an object with
+    // a type descriptor.
+    c->parent = p;
+    c->parent_type = *(pony_type_t**)p;
+    f(ctx, p);
+  }
+}
+
+static int cmp_bytes(const void* a, const void* b)
+{
+  const census_type_t* x = (const census_type_t*)a;
+  const census_type_t* y = (const census_type_t*)b;
+  size_t xb = x->bytes + x->buffer_bytes;
+  size_t yb = y->bytes + y->buffer_bytes;
+
+  return (xb < yb) - (xb > yb);
+}
+
+static int cmp_count(const void* a, const void* b)
+{
+  const census_edge_t* x = (const census_edge_t*)a;
+  const census_edge_t* y = (const census_edge_t*)b;
+
+  return (x->count < y->count) - (x->count > y->count);
+}
+
+static void print_type(pony_type_t* type)
+{
+  fprintf(stderr, "type %u", type->id);
+
+  if(type->name != NULL)
+    fprintf(stderr, " (%s)", type->name);
+}
+
+void census_finish(pony_ctx_t* ctx)
+{
+  census_t* c = this_census;
+  pony_actor_t* actor = ctx->current;
+
+  size_t live;
+  size_t live_bytes;
+  heap_live(&actor->heap, &live, &live_bytes);
+
+  size_t n_types = census_types_size(&c->types);
+  size_t n_edges = census_edges_size(&c->edges);
+  census_type_t* types = (census_type_t*)pool_alloc_size(
+    (n_types + 1) * sizeof(census_type_t));
+  census_edge_t* edges = (census_edge_t*)pool_alloc_size(
+    (n_edges + 1) * sizeof(census_edge_t));
+
+  size_t i = HASHMAP_BEGIN;
+  size_t n = 0;
+  census_type_t* t;
+  census_edge_t* e;
+  size_t found = 0;
+  size_t found_bytes = 0;
+
+  while((t = census_types_next(&c->types, &i)) != NULL)
+  {
+    types[n++] = *t;
+    found += t->objects + t->buffers;
+    found_bytes += t->bytes + t->buffer_bytes;
+  }
+
+  i = HASHMAP_BEGIN;
+  n = 0;
+
+  while((e = census_edges_next(&c->edges, &i)) != NULL)
+    edges[n++] = *e;
+
+  qsort(types, n_types, sizeof(census_type_t), cmp_bytes);
+  qsort(edges, n_edges, sizeof(census_edge_t), cmp_count);
+
+  // Reports from actors on different threads are kept apart.
+  lock();
+  fprintf(stderr, "heap census of actor %p, ", (void*)actor);
+  print_type(actor->type);
+  fprintf(stderr, ": " __zu " live allocations, " __zu " bytes\n", live,
+    live_bytes);
+
+  for(i = 0; i < n_types; i++)
+  {
+    fprintf(stderr, "  ");
+    print_type(types[i].type);
+    fprintf(stderr, ": " __zu " objects, " __zu " bytes, " __zu " buffers, "
+      __zu " buffer bytes\n", types[i].objects, types[i].bytes,
+      types[i].buffers, types[i].buffer_bytes);
+  }
+
+  // What was marked but not reached from the actor is kept alive by other
+  // actors holding mutable objects, or was only reached as a tag.
+  fprintf(stderr, "  other: " __zu " allocations, " __zu " bytes\n",
+    (live > found) ? (live - found) : 0,
+    (live_bytes > found_bytes) ? (live_bytes - found_bytes) : 0);
+
+  for(i = 0; i < n_edges; i++)
+  {
+    fprintf(stderr, "  ");
+    print_type(edges[i].from);
+    fprintf(stderr, " -> ");
+    print_type(edges[i].to);
+    fprintf(stderr, ": " __zu " references\n", edges[i].count);
+  }
+
+  unlock();
+
+  pool_free_size((n_types + 1) * sizeof(census_type_t), types);
+  pool_free_size((n_edges + 1) * sizeof(census_edge_t), edges);
+
+  if(c->graph != NULL)
+    fclose(c->graph);
+
+  census_types_destroy(&c->types);
+  census_edges_destroy(&c->edges);
+  POOL_FREE(census_t, c);
+  this_census = NULL;
+}
+
+bool pony_heap_census(pony_actor_t* actor, const char* graph)
+{
+  if(actor->type->dispatch == NULL)
+    return false;
+
+  if((graph != NULL) && (graph[0] != '\0'))
+  {
+    size_t len = strlen(graph) + 1;
+    char* path = (char*)pool_alloc_size(len);
+    memcpy(path, graph, len);
+
+    lock();
+
+    if(graph_path != NULL)
+      pool_free_size(graph_len, graph_path);
+
+    graph_actor = actor;
+    graph_path = path;
+    graph_len = len;
+    unlock();
+  }
+
+  _atomic_store(&actor->census, 1);
+  return true;
+}
+
+void pony_heap_census_all()
+{
+  registry_census();
+}
@@ -0,0 +1,41 @@
+#ifndef gc_census_h
+#define gc_census_h
+
+#include "gc.h"
+#include <pony.h>
+#include <platform.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * Returns true, and clears the request, if a census of the actor's heap has
+ * been asked for. The next gc pass is then a full one that takes the census.
+ */
+bool census_due(pony_actor_t* actor);
+
+/**
+ * Sets up a full gc pass that also counts the objects it marks in the current
+ * actor's heap. Used in place of pony_gc_mark().
+ */
+void census_start(pony_ctx_t* ctx);
+
+/**
+ * Like gc_markimmutable(), counting what is marked.
+ */
+void census_markimmutable(pony_ctx_t* ctx, gc_t* gc);
+
+/**
+ * Like gc_handlestack(), keeping track of the object being traced so that
+ * references can be counted by the type they come from.
+ */
+void census_handlestack(pony_ctx_t* ctx);
+
+/**
+ * Writes the census to stderr, and finishes the object graph if one was asked
+ * for. Must be called after marking, before the heap is swept.
+ */
+void census_finish(pony_ctx_t* ctx);
+
+PONY_EXTERN_C_END
+
+#endif
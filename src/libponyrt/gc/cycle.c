@@ -10,6 +10,14 @@
 #include <inttypes.h>
 #include <assert.h>
 
+// The most CONF messages in flight for one perceived cycle, unless
+// --ponycdconf asks for more to start with.
+#define CONF_GROUP_MAX 4096
+
+// Off a scheduler thread, actors woken by CONF messages are pushed to the
+// inject queue this many at a time.
+#define CONF_BATCH 64
+
 typedef struct init_msg_t
 {
   pony_msg_t msg;
@@ -114,6 +122,8 @@ struct perceived_t
 {
   size_t token;
   size_t ack;
+  size_t sent;
+  size_t group;
   size_t last_conf;
   viewmap_t map;
 };
@@ -146,8 +156,10 @@ typedef struct detector_t
   size_t min_deferred;
   size_t max_deferred;
   size_t conf_group;
+  size_t max_conf;
   size_t next_deferred;
   size_t since_deferred;
+  size_t scanned;
 
   viewmap_t views;
   viewmap_t deferred;
@@ -162,6 +174,7 @@ typedef struct detector_t
 } detector_t;
 
 static pony_actor_t* cycle_detector;
+static pony_cdmode_t volatile cycle_mode;
 
 static view_t* get_view(detector_t* d, pony_actor_t* actor, bool create)
 {
@@ -262,6 +275,7 @@ static bool mark_grey(detector_t* d, view_t* view, size_t rc)
 
   assert(view->color == COLOR_BLACK);
   view->color = COLOR_GREY;
+  d->scanned++;
   return true;
 }
 
@@ -417,25 +431,47 @@ static int collect_white(perceived_t* per, view_t* view, size_t rc)
   return count;
 }
 
-static void send_conf(pony_ctx_t* ctx, detector_t* d, perceived_t* per)
+static void send_conf(pony_ctx_t* ctx, perceived_t* per)
 {
+  // The actors in a perceived cycle are blocked, so nearly every CONF wakes
+  // one. On the cycle detector thread, which has no scheduler of its own,
+  // each would be pushed to the inject queue and wake a scheduler by itself,
+  // so collect them and push them in batches instead.
+  pony_actor_t* woken[CONF_BATCH];
+  bool batch = ctx->scheduler == NULL;
   size_t i = per->last_conf;
   size_t count = 0;
   view_t* view;
 
+  if(batch)
+    scheduler_batch_start(ctx, woken, CONF_BATCH);
+
   while((view = viewmap_next(&per->map, &i)) != NULL)
   {
     pony_sendi(ctx, view->actor, ACTORMSG_CONF, per->token);
     count++;
 
-    if(count == d->conf_group)
+    if(count == per->group)
       break;
+
+    if(batch && ((count % CONF_BATCH) == 0))
+    {
+      scheduler_batch_end(ctx);
+      scheduler_batch_start(ctx, woken, CONF_BATCH);
+    }
   }
 
+  if(batch)
+    scheduler_batch_end(ctx);
+
   per->last_conf = i;
+  per->sent += count;
 }
 
-static bool detect(pony_ctx_t* ctx, detector_t* d, view_t* view)
+/**
+ * Returns the number of actors in the cycle found from the view, if any.
+ */
+static size_t detect(pony_ctx_t* ctx, detector_t* d, view_t* view)
 {
   assert(view->perceived == NULL);
 
@@ -444,13 +480,15 @@ static bool detect(pony_ctx_t* ctx, detector_t* d, view_t* view)
   assert(count >= 0);
 
   if(count == 0)
-    return false;
+    return 0;
 
   d->detected++;
 
   perceived_t* per = (perceived_t*)POOL_ALLOC(perceived_t);
   per->token = d->next_token++;
   per->ack = 0;
+  per->sent = 0;
+  per->group = d->conf_group;
   per->last_conf = HASHMAP_BEGIN;
   viewmap_init(&per->map, count);
   perceivedmap_put(&d->perceived, per);
@@ -461,8 +499,8 @@ static bool detect(pony_ctx_t* ctx, detector_t* d, view_t* view)
   assert(count2 == count);
   assert(viewmap_size(&per->map) == (size_t)count);
 
-  send_conf(ctx, d, per);
-  return true;
+  send_conf(ctx, per);
+  return (size_t)count;
 }
 
 static void deferred(pony_ctx_t* ctx, detector_t* d)
@@ -472,9 +510,18 @@ static void deferred(pony_ctx_t* ctx, detector_t* d)
   if(d->since_deferred < d->next_deferred)
     return;
 
+  // While more block and unblock messages are waiting than we defer for,
+  // many of the views a pass would scan are about to change, so wait for the
+  // backlog to drain. Never wait past the longest deferral, so that garbage
+  // doesn't pile up behind a detector that is always busy.
+  if((d->since_deferred < d->max_deferred) &&
+    (pony_queue_depth(cycle_detector) > d->next_deferred))
+    return;
+
   d->attempted++;
 
-  bool found = false;
+  size_t scanned = d->scanned;
+  size_t found = 0;
   size_t i = HASHMAP_BEGIN;
   view_t* view;
 
@@ -484,20 +531,29 @@ static void deferred(pony_ctx_t* ctx, detector_t* d)
     viewmap_removeindex(&d->deferred, i);
     view->deferred = false;
 
-    if(!detect(ctx, d, view))
+    size_t count = detect(ctx, d, view);
+
+    if(count == 0)
       break;
 
-    found = true;
+    found += count;
   }
 
-  if(found)
+  scanned = d->scanned - scanned;
+
+  // Adapt to the share of the actors scanned that turned out to be garbage.
+  // If none were, back off. If most were, look again sooner, starting with
+  // the next block. Otherwise wait as long as before.
+  if(found == 0)
   {
-    if(d->next_deferred > d->min_deferred)
-      d->next_deferred >>= 1;
-  } else {
     if(d->next_deferred < d->max_deferred)
       d->next_deferred <<= 1;
 
+    d->since_deferred = 0;
+  } else if((found * 2) >= scanned) {
+    if(d->next_deferred > d->min_deferred)
+      d->next_deferred >>= 1;
+  } else {
     d->since_deferred = 0;
   }
 }
@@ -604,9 +660,30 @@ static void block(pony_ctx_t* ctx, detector_t* d, pony_actor_t* actor,
       view->deferred = true;
     }
 
-    // look for cycles
-    deferred(ctx, d);
+    // look for cycles, unless we only do that when asked
+    if(_atomic_load(&cycle_mode) == PONY_CD_AUTO)
+      deferred(ctx, d);
+  }
+}
+
+static void detect_all(pony_ctx_t* ctx, detector_t* d)
+{
+  d->attempted++;
+
+  size_t i = HASHMAP_BEGIN;
+  view_t* view;
+
+  // Unlike a deferred pass, keep going after a view that isn't in a cycle.
+  while((view = viewmap_next(&d->deferred, &i)) != NULL)
+  {
+    assert(view->deferred == true);
+    viewmap_removeindex(&d->deferred, i);
+    view->deferred = false;
+
+    detect(ctx, d, view);
   }
+
+  d->since_deferred = 0;
 }
 
 static void unblock(detector_t* d, pony_actor_t* actor)
@@ -650,8 +727,21 @@ static void ack(pony_ctx_t* ctx, detector_t* d, size_t token)
     return;
   }
 
-  if((per->ack & (d->conf_group - 1)) == 0)
-    send_conf(ctx, d, per);
+  if(per->ack < per->sent)
+    return;
+
+  // Every CONF sent so far has been acknowledged. If fewer messages are
+  // waiting for us than were in the group, the acks are keeping up, so send
+  // a larger group next. Otherwise send a smaller one.
+  if(pony_queue_depth(cycle_detector) < per->group)
+  {
+    if(per->group < d->max_conf)
+      per->group <<= 1;
+  } else if(per->group > d->conf_group) {
+    per->group >>= 1;
+  }
+
+  send_conf(ctx, per);
 }
 
 static void final(pony_ctx_t* ctx, pony_actor_t* self)
@@ -659,7 +749,8 @@ static void final(pony_ctx_t* ctx, pony_actor_t* self)
   // Find block messages and invoke finalisers for those actors
   pony_msg_t* msg;
 
-  while((msg = messageq_pop(&self->q)) != NULL)
+  while(((msg = messageq_pop(&self->ctrl)) != NULL) ||
+    ((msg = messageq_pop(&self->q)) != NULL))
   {
     if(msg->id == ACTORMSG_BLOCK)
     {
@@ -807,6 +898,12 @@ static void cycle_dispatch(pony_ctx_t* ctx, pony_actor_t* self,
       break;
     }
 
+    case ACTORMSG_DETECT:
+    {
+      detect_all(ctx, d);
+      break;
+    }
+
 #ifndef NDEBUG
     default:
     {
@@ -831,8 +928,12 @@ static pony_type_t cycle_type =
   cycle_dispatch,
   NULL,
   0,
+  0,
   NULL,
   NULL,
+  "(cycle detector)",
+  NULL,
+  0,
   NULL
 };
 
@@ -854,11 +955,19 @@ void cycle_create(pony_ctx_t* ctx, uint32_t min_deferred,
   cycle_detector = pony_create(ctx, &cycle_type);
   actor_setsystem(cycle_detector);
 
+  // Block and unblock messages arrive on the control queue, and the detector
+  // paces itself on how many are waiting.
+  messageq_setcounted(&cycle_detector->ctrl);
+
   detector_t* d = (detector_t*)cycle_detector;
   d->min_deferred = (size_t)1 << (size_t)min_deferred;
   d->max_deferred = (size_t)1 << (size_t)max_deferred;
   d->conf_group = (size_t)1 << (size_t)conf_group;
-  d->next_deferred = min_deferred;
+  d->max_conf = d->conf_group;
+  d->next_deferred = d->min_deferred;
+
+  if(d->max_conf < CONF_GROUP_MAX)
+    d->max_conf = CONF_GROUP_MAX;
 }
 
 void cycle_block(pony_ctx_t* ctx, pony_actor_t* actor, gc_t* gc)
@@ -897,3 +1006,18 @@ bool is_cycle(pony_actor_t* actor)
 {
   return actor == cycle_detector;
 }
+
+bool cycle_blocking()
+{
+  return _atomic_load(&cycle_mode) != PONY_CD_OFF;
+}
+
+void pony_cycle_setmode(pony_cdmode_t mode)
+{
+  _atomic_store(&cycle_mode, mode);
+}
+
+void pony_cycle_detect(pony_ctx_t* ctx)
+{
+  pony_send(ctx, cycle_detector, ACTORMSG_DETECT);
+}
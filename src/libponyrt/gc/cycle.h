@@ -22,6 +22,12 @@ void cycle_terminate(pony_ctx_t* ctx);
 
 bool is_cycle(pony_actor_t* actor);
 
+/**
+ * Returns false if cycle detection is off, in which case actors don't tell
+ * the cycle detector when they block.
+ */
+bool cycle_blocking();
+
 PONY_EXTERN_C_END
 
 #endif
@@ -0,0 +1,239 @@
+#include "finaliser.h"
+#include "gc.h"
+#include "../actor/actor.h"
+#include "../sched/scheduler.h"
+#include "../sched/mpmcq.h"
+#include "../mem/heap.h"
+#include "../mem/pool.h"
+#include <string.h>
+#include <assert.h>
+
+#if defined(PLATFORM_IS_LINUX)
+#  include <sys/resource.h>
+#endif
+
+// The most finalisers handed over at once, and the nice value of the thread
+// that runs them where it can be set per thread.
+#define FINAL_BATCH 256
+#define FINAL_NICE 10
+
+typedef struct finalentry_t
+{
+  pony_final_fn final;
+  void* copy;
+  size_t size;
+} finalentry_t;
+
+typedef struct finalbatch_t
+{
+  uint32_t count;
+  finalentry_t entry[FINAL_BATCH];
+} finalbatch_t;
+
+static mpmcq_t queue;
+static pony_park_t park;
+static pony_thread_id_t tid;
+static bool volatile running;
+static bool volatile stopping;
+static bool volatile asleep;
+
+static __pony_thread_local finalbatch_t* this_batch;
+
+// Finalisers may allocate. They do it in the heap of an actor that is never
+// scheduled or traced, which is emptied after each batch.
+static pony_type_t final_type =
+{
+  0,
+  sizeof(pony_actor_t),
+  0,
+  0,
+  0,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  0,
+  0,
+  NULL,
+  NULL,
+  "(finaliser)",
+  NULL,
+  0,
+  NULL
+};
+
+static void wake_thread()
+{
+  if(!_atomic_load(&asleep))
+    return;
+
+  pony_park_lock(&park);
+
+  if(asleep)
+  {
+    _atomic_store(&asleep, false);
+    pony_park_signal(&park);
+  }
+
+  pony_park_unlock(&park);
+}
+
+static void park_thread()
+{
+  pony_park_lock(&park);
+  _atomic_store(&asleep, true);
+  _atomic_fence();
+
+  if(!mpmcq_empty(&queue) || _atomic_load(&stopping))
+  {
+    _atomic_store(&asleep, false);
+  } else {
+    while(_atomic_load(&asleep))
+      pony_park_wait(&park);
+  }
+
+  pony_park_unlock(&park);
+}
+
+static void run_batch(pony_ctx_t* ctx, finalbatch_t* batch)
+{
+  pony_final_fn f;
+  void* p;
+
+  for(uint32_t i = 0; i < batch->count; i++)
+  {
+    finalentry_t* e = &batch->entry[i];
+    e->final(e->copy);
+
+    // Finalise any objects that were created during finalisation.
+    while(ctx->stack != NULL)
+    {
+      ctx->stack = gcstack_pop(ctx->stack, (void**)&f);
+      ctx->stack = gcstack_pop(ctx->stack, &p);
+      f(p);
+    }
+
+    pool_free_size(e->size, e->copy);
+  }
+
+  POOL_FREE(finalbatch_t, batch);
+
+  heap_t* heap = actor_heap(ctx->current);
+
+  if(heap->used > 0)
+  {
+    heap_destroy(heap);
+    heap_init(heap);
+  }
+}
+
+static DECLARE_THREAD_FN(run_thread)
+{
+  (void)arg;
+  pony_register_thread();
+  pony_ctx_t* ctx = pony_ctx();
+
+#if defined(PLATFORM_IS_LINUX)
+  // The nice value is kept per thread, so this only affects this thread.
+  setpriority(PRIO_PROCESS, 0, FINAL_NICE);
+#endif
+
+  pony_actor_t* actor = pony_create(ctx, &final_type);
+  pony_become(ctx, actor);
+  ctx->finalising = true;
+
+  while(true)
+  {
+    finalbatch_t* batch = (finalbatch_t*)mpmcq_pop(&queue);
+
+    if(batch != NULL)
+    {
+      run_batch(ctx, batch);
+      continue;
+    }
+
+    // Nothing is queued after stopping, so an empty queue means we are done.
+    if(_atomic_load(&stopping))
+      break;
+
+    park_thread();
+  }
+
+  ctx->finalising = false;
+  pony_become(ctx, NULL);
+  pony_destroy(actor);
+  return 0;
+}
+
+bool finaliser_start()
+{
+  mpmcq_init(&queue);
+  pony_park_init(&park);
+  stopping = false;
+  asleep = false;
+
+  if(!pony_thread_create(&tid, run_thread, -1, NULL))
+    return false;
+
+  _atomic_store(&running, true);
+  return true;
+}
+
+void finaliser_stop()
+{
+  if(!_atomic_load(&running))
+    return;
+
+  // Finalisers from actors destroyed at shutdown are still queued here.
+  finaliser_flush();
+  _atomic_store(&stopping, true);
+  _atomic_fence();
+  wake_thread();
+
+  pony_thread_join(tid);
+  _atomic_store(&running, false);
+  mpmcq_destroy(&queue);
+  pony_park_destroy(&park);
+}
+
+void finaliser_defer(void* p, size_t size, pony_final_fn final)
+{
+  if(!_atomic_load(&running))
+  {
+    final(p);
+    return;
+  }
+
+  finalbatch_t* batch = this_batch;
+
+  if(batch == NULL)
+  {
+    batch = (finalbatch_t*)POOL_ALLOC(finalbatch_t);
+    batch->count = 0;
+    this_batch = batch;
+  }
+
+  // The object is freed when the sweep finishes, so the finaliser gets a copy.
+  finalentry_t* e = &batch->entry[batch->count++];
+  e->final = final;
+  e->copy = pool_alloc_size(size);
+  e->size = size;
+  memcpy(e->copy, p, size);
+
+  if(batch->count == FINAL_BATCH)
+    finaliser_flush();
+}
+
+void finaliser_flush()
+{
+  finalbatch_t* batch = this_batch;
+
+  if(batch == NULL)
+    return;
+
+  this_batch = NULL;
+  mpmcq_push(&queue, batch);
+  _atomic_fence();
+  wake_thread();
+}
@@ -0,0 +1,35 @@
+#ifndef gc_finaliser_h
+#define gc_finaliser_h
+
+#include <pony.h>
+#include <platform.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * Starts the thread that runs deferred finalisers.
+ */
+bool finaliser_start();
+
+/**
+ * Runs every deferred finaliser still queued, then stops the thread. Must only
+ * be called once no scheduler thread can queue any more.
+ */
+void finaliser_stop();
+
+/**
+ * Queues the finaliser for an unreachable object of the given size. The
+ * finaliser is later run on a copy of the object on the finaliser thread, so
+ * it must only use fields held in the object itself. If the thread isn't
+ * running, the finaliser is run now.
+ */
+void finaliser_defer(void* p, size_t size, pony_final_fn final);
+
+/**
+ * Hands the finalisers queued by this thread to the finaliser thread.
+ */
+void finaliser_flush();
+
+PONY_EXTERN_C_END
+
+#endif
@@ -6,20 +6,39 @@
 #include <assert.h>
 
 #define GC_ACTOR_HEAP_EQUIV 1024
+#define GC_IMMUTABLE_HEAP_EQUIV 1024
 
 DEFINE_STACK(gcstack, void);
 
+static void recurse(pony_ctx_t* ctx, void* p, pony_trace_fn f)
+{
+  // A pointer-free array only points to its buffer, which points to nothing,
+  // so trace it now rather than pushing it on the stack.
+  if(f == pony_trace_leaf_array)
+  {
+    pony_trace_leaf_array(ctx, p);
+  } else if(f != NULL) {
+    ctx->stack = gcstack_push(ctx->stack, p);
+    ctx->stack = gcstack_push(ctx->stack, f);
+  }
+}
+
 static void acquire_actor(pony_ctx_t* ctx, pony_actor_t* actor)
 {
   actorref_t* aref = actormap_getorput(&ctx->acquire, actor, 0);
-  actorref_inc_more(aref);
+  actorref_inc_some(aref, GC_INC_MORE);
 }
 
-static void acquire_object(pony_ctx_t* ctx, pony_actor_t* actor, void* address)
+static void acquire_object(pony_ctx_t* ctx, pony_actor_t* actor, void* address,
+  pony_trace_fn f, bool immutable)
 {
   actorref_t* aref = actormap_getorput(&ctx->acquire, actor, 0);
   object_t* obj = actorref_getorput(aref, address, 0);
   object_inc_more(obj);
+
+  // Tell the owner to keep everything reachable from the object alive.
+  if(immutable)
+    object_markimmutable(obj, f);
 }
 
 static void current_actor_inc(gc_t* gc)
@@ -41,23 +60,70 @@ static void current_actor_dec(gc_t* gc)
   }
 }
 
-void gc_sendobject(pony_ctx_t* ctx, void* p, pony_trace_fn f)
+static size_t foreign_size(chunk_t* chunk, object_t* obj)
+{
+  // We don't see the contents of an immutable object, so count it as more
+  // than its own size to collect often enough to release it.
+  if(object_immutable(obj))
+    return heap_size(chunk) + GC_IMMUTABLE_HEAP_EQUIV;
+
+  return heap_size(chunk);
+}
+
+static void send_remote_actor(pony_ctx_t* ctx, gc_t* gc, actorref_t* aref)
+{
+  if(actorref_marked(aref, gc->mark))
+    return;
+
+  // dec. if we can't, we need to build an acquire message. we may have no
+  // references at all to an actor reached through an immutable object.
+  if(actorref_rc(aref) <= 1)
+  {
+    actorref_inc_some(aref, GC_INC_MORE - 1);
+    acquire_actor(ctx, actorref_actor(aref));
+  } else {
+    actorref_dec(aref);
+  }
+
+  actorref_mark(aref, gc->mark);
+  gc->delta = deltamap_update(gc->delta,
+    actorref_actor(aref), actorref_rc(aref));
+}
+
+static void mark_remote_actor(pony_ctx_t* ctx, gc_t* gc, actorref_t* aref)
+{
+  if(actorref_marked(aref, gc->mark))
+    return;
+
+  actorref_mark(aref, gc->mark);
+
+  // if we have no references, we've reached this through an immutable object
+  // that someone else keeps alive. invent some references and acquire it.
+  if(actorref_rc(aref) == 0)
+  {
+    actorref_inc_more(aref);
+    acquire_actor(ctx, actorref_actor(aref));
+    gc->delta = deltamap_update(gc->delta,
+      actorref_actor(aref), actorref_rc(aref));
+  }
+}
+
+void gc_sendobject(pony_ctx_t* ctx, void* p, pony_trace_fn f, bool immutable)
 {
   chunk_t* chunk = (chunk_t*)pagemap_get(p);
 
   // Don't gc memory that wasn't pony_allocated, but do recurse.
   if(chunk == NULL)
   {
-    if(f != NULL)
-    {
-      ctx->stack = gcstack_push(ctx->stack, p);
-      ctx->stack = gcstack_push(ctx->stack, f);
-    }
-
+    recurse(ctx, p, f);
     return;
   }
 
   pony_actor_t* actor = heap_owner(chunk);
+
+  // Frozen memory is never collected and only points to frozen memory.
+  if(actor == NULL)
+    return;
   gc_t* gc = actor_gc(ctx->current);
 
   if(actor == ctx->current)
@@ -69,84 +135,78 @@ void gc_sendobject(pony_ctx_t* ctx, void* p, pony_trace_fn f)
 
     if(!object_marked(obj, gc->mark))
     {
-      // inc, mark and recurse
+      // inc, mark and recurse. don't recurse into an immutable object: we
+      // trace everything reachable from it ourselves while it's shared.
       object_inc(obj);
       object_mark(obj, gc->mark);
 
-      if(f != NULL)
-      {
-        ctx->stack = gcstack_push(ctx->stack, p);
-        ctx->stack = gcstack_push(ctx->stack, f);
-      }
+      if(immutable && (f != NULL))
+        object_markimmutable(obj, f);
+      else
+        recurse(ctx, p, f);
     }
 
     return;
   }
 
-  // get the actor
-  actorref_t* aref = actormap_getactor(&gc->foreign, actor);
-
-  // we've reached this by tracing a tag through a union
-  if(aref == NULL)
-    return;
+  // get the actor and the object
+  actorref_t* aref = actormap_getorput(&gc->foreign, actor, gc->mark);
+  object_t* obj = actorref_getorput(aref, p, gc->mark);
 
-  // get the object
-  object_t* obj = actorref_getobject(aref, p);
+  send_remote_actor(ctx, gc, aref);
 
-  // we've reached this by tracing a tag through a union
-  if(obj == NULL)
+  if(object_marked(obj, gc->mark))
     return;
 
-  if(!actorref_marked(aref, gc->mark))
+  object_mark(obj, gc->mark);
+
+  if(immutable && (f != NULL))
   {
-    // dec. if we can't, we need to build an acquire message
-    if(!actorref_dec(aref))
+    if((object_rc(obj) > 0) && !object_immutable(obj))
     {
-      actorref_inc_more(aref);
-      acquire_actor(ctx, actor);
+      // We received this object as mutable, and are now sending it as
+      // immutable, so acquire it to tell the owner. We still recurse, since we
+      // hold references to its contents that must outlive the acquire.
+      object_markimmutable(obj, f);
+      object_inc_some(obj, GC_INC_MORE - 1);
+      acquire_object(ctx, actor, p, f, true);
+      recurse(ctx, p, f);
+      return;
     }
 
-    actorref_mark(aref, gc->mark);
-    gc->delta = deltamap_update(gc->delta,
-      actorref_actor(aref), actorref_rc(aref));
+    object_markimmutable(obj, f);
   }
 
-  if(!object_marked(obj, gc->mark))
+  // dec. if we can't, we need to build an acquire message. we may have no
+  // references at all to an object reached through an immutable object.
+  if(object_rc(obj) <= 1)
   {
-    // dec. if we can't, we need to build an acquire message
-    if(!object_dec(obj))
-    {
-      object_inc_more(obj);
-      acquire_object(ctx, actor, p);
-    }
-
-    object_mark(obj, gc->mark);
-
-    if(f != NULL)
-    {
-      ctx->stack = gcstack_push(ctx->stack, p);
-      ctx->stack = gcstack_push(ctx->stack, f);
-    }
+    object_inc_some(obj, GC_INC_MORE - 1);
+    acquire_object(ctx, actor, p, f, object_immutable(obj));
+  } else {
+    object_dec(obj);
   }
+
+  if(!immutable)
+    recurse(ctx, p, f);
 }
 
-void gc_recvobject(pony_ctx_t* ctx, void* p, pony_trace_fn f)
+void gc_recvobject(pony_ctx_t* ctx, void* p, pony_trace_fn f, bool immutable)
 {
   chunk_t* chunk = (chunk_t*)pagemap_get(p);
 
   // Don't gc memory that wasn't pony_allocated, but do recurse.
   if(chunk == NULL)
   {
-    if(f != NULL)
-    {
-      ctx->stack = gcstack_push(ctx->stack, p);
-      ctx->stack = gcstack_push(ctx->stack, f);
-    }
-
+    recurse(ctx, p, f);
     return;
   }
 
   pony_actor_t* actor = heap_owner(chunk);
+
+  // Frozen memory is never collected and only points to frozen memory.
+  if(actor == NULL)
+    return;
   gc_t* gc = actor_gc(ctx->current);
 
   if(actor == ctx->current)
@@ -159,17 +219,20 @@ void gc_recvobject(pony_ctx_t* ctx, void* p, pony_trace_fn f)
 
     if(!object_marked(obj, gc->mark))
     {
-      // Dec, mark and recurse. Mark as reachable from the actor, since a
-      // release message for this object could arrive before a gc pass.
+      // dec, mark and recurse, unless the sender didn't
       object_dec(obj);
       object_mark(obj, gc->mark);
-      object_markreachable(obj);
 
-      if(f != NULL)
-      {
-        ctx->stack = gcstack_push(ctx->stack, p);
-        ctx->stack = gcstack_push(ctx->stack, f);
-      }
+      // A young object may now only be reachable from other actors' objects,
+      // which a minor pass doesn't trace.
+      if(heap_nurseryon() && heap_isyoung(chunk, p) &&
+        heap_remember(chunk, p))
+        gc_remember(gc, p, f);
+
+      if(immutable && (f != NULL))
+        object_markimmutable(obj, f);
+      else
+        recurse(ctx, p, f);
     }
 
     return;
@@ -192,50 +255,45 @@ void gc_recvobject(pony_ctx_t* ctx, void* p, pony_trace_fn f)
 
   if(!object_marked(obj, gc->mark))
   {
-    // if this is our first reference, add to our heap used size
-    if(object_rc(obj) == 0)
-      heap_used(actor_heap(ctx->current), heap_size(chunk));
-
-    // inc, mark and recurse
+    // inc, mark and recurse, unless the sender didn't
     object_inc(obj);
     object_mark(obj, gc->mark);
 
-    if(f != NULL)
-    {
-      ctx->stack = gcstack_push(ctx->stack, p);
-      ctx->stack = gcstack_push(ctx->stack, f);
-    }
+    if(immutable && (f != NULL))
+      object_markimmutable(obj, f);
+    else
+      recurse(ctx, p, f);
+
+    // if this is our first reference, add to our heap used size
+    if(object_rc(obj) == 1)
+      heap_used(actor_heap(ctx->current), foreign_size(chunk, obj));
   }
 }
 
-void gc_markobject(pony_ctx_t* ctx, void* p, pony_trace_fn f)
+void gc_markobject(pony_ctx_t* ctx, void* p, pony_trace_fn f, bool immutable)
 {
   chunk_t* chunk = (chunk_t*)pagemap_get(p);
 
   // Don't gc memory that wasn't pony_allocated, but do recurse.
   if(chunk == NULL)
   {
-    if(f != NULL)
-    {
-      ctx->stack = gcstack_push(ctx->stack, p);
-      ctx->stack = gcstack_push(ctx->stack, f);
-    }
-
+    recurse(ctx, p, f);
     return;
   }
 
   pony_actor_t* actor = heap_owner(chunk);
 
+  // Frozen memory is never collected and only points to frozen memory.
+  if(actor == NULL)
+    return;
+
   if(actor == ctx->current)
   {
     if(f != NULL)
     {
       // mark in our heap and recurse if it wasn't already marked
       if(!heap_mark(chunk, p))
-      {
-        ctx->stack = gcstack_push(ctx->stack, p);
-        ctx->stack = gcstack_push(ctx->stack, f);
-      }
+        recurse(ctx, p, f);
     } else {
       // no recurse function, so do a shallow mark. if the same address is
       // later marked with a recurse function, it will recurse.
@@ -247,34 +305,60 @@ void gc_markobject(pony_ctx_t* ctx, void* p, pony_trace_fn f)
 
   // mark the owner
   gc_t* gc = actor_gc(ctx->current);
-  actorref_t* aref = actormap_getactor(&gc->foreign, actor);
+  actorref_t* aref = actormap_getorput(&gc->foreign, actor, gc->mark);
+  object_t* obj = actorref_getorput(aref, p, gc->mark);
 
-  // we've reached this by tracing a tag through a union
-  if(aref == NULL)
+  mark_remote_actor(ctx, gc, aref);
+
+  if(object_marked(obj, gc->mark))
     return;
 
-  // get the object
-  object_t* obj = actorref_getobject(aref, p);
+  object_mark(obj, gc->mark);
 
-  // we've reached this by tracing a tag through a union
-  if(obj == NULL)
-    return;
+  if(object_rc(obj) == 0)
+  {
+    // We've reached this through an immutable object that someone else keeps
+    // alive. Invent some references and acquire it.
+    if(immutable && (f != NULL))
+      object_markimmutable(obj, f);
 
-  actorref_mark(aref, gc->mark);
+    object_inc_more(obj);
+    acquire_object(ctx, actor, p, f, object_immutable(obj));
+  }
 
-  if(!object_marked(obj, gc->mark))
+  // add to heap used size
+  heap_used(actor_heap(ctx->current), foreign_size(chunk, obj));
+
+  // We only skip the contents if the owner keeps them alive. Otherwise we hold
+  // references to them, even if we see the object as immutable here.
+  if(!immutable || !object_immutable(obj))
+    recurse(ctx, p, f);
+}
+
+void gc_minorobject(pony_ctx_t* ctx, void* p, pony_trace_fn f, bool immutable)
+{
+  (void)immutable;
+  chunk_t* chunk = (chunk_t*)pagemap_get(p);
+
+  // Don't gc memory that wasn't pony_allocated, but do recurse.
+  if(chunk == NULL)
   {
-    // add to heap used size
-    heap_used(actor_heap(ctx->current), heap_size(chunk));
+    recurse(ctx, p, f);
+    return;
+  }
 
-    // mark and recurse
-    object_mark(obj, gc->mark);
+  // A minor pass sends no releases, so other actors' objects stay alive
+  // without being traced. Frozen memory is never collected.
+  if(heap_owner(chunk) != ctx->current)
+    return;
 
-    if(f != NULL)
-    {
-      ctx->stack = gcstack_push(ctx->stack, p);
-      ctx->stack = gcstack_push(ctx->stack, f);
-    }
+  // Old objects are still marked, so we stop at them.
+  if(f != NULL)
+  {
+    if(!heap_mark(chunk, p))
+      recurse(ctx, p, f);
+  } else {
+    heap_mark_shallow(chunk, p);
   }
 }
 
@@ -287,20 +371,7 @@ void gc_sendactor(pony_ctx_t* ctx, pony_actor_t* actor)
     current_actor_inc(gc);
   } else {
     actorref_t* aref = actormap_getorput(&gc->foreign, actor, gc->mark);
-
-    if(!actorref_marked(aref, gc->mark))
-    {
-      // dec. if we can't, we need to build an acquire message
-      if(!actorref_dec(aref))
-      {
-        actorref_inc_more(aref);
-        acquire_actor(ctx, actor);
-      }
-
-      actorref_mark(aref, gc->mark);
-      gc->delta = deltamap_update(gc->delta,
-        actorref_actor(aref), actorref_rc(aref));
-    }
+    send_remote_actor(ctx, gc, aref);
   }
 }
 
@@ -331,19 +402,83 @@ void gc_markactor(pony_ctx_t* ctx, pony_actor_t* actor)
     return;
 
   gc_t* gc = actor_gc(ctx->current);
-  actorref_t* aref = actormap_getactor(&gc->foreign, actor);
-
-  // we've reached this by tracing a tag through a union
-  if(aref == NULL)
-    return;
+  actorref_t* aref = actormap_getorput(&gc->foreign, actor, gc->mark);
 
   if(actorref_marked(aref, gc->mark))
     return;
 
-  actorref_mark(aref, gc->mark);
+  mark_remote_actor(ctx, gc, aref);
   heap_used(actor_heap(ctx->current), GC_ACTOR_HEAP_EQUIV);
 }
 
+void gc_minoractor(pony_ctx_t* ctx, pony_actor_t* actor)
+{
+  // Actor references are only counted by a full pass.
+  (void)ctx;
+  (void)actor;
+}
+
+void gc_remember(gc_t* gc, void* p, pony_trace_fn f)
+{
+  gc->remember = gcstack_push(gc->remember, p);
+  gc->remember = gcstack_push(gc->remember, f);
+  gc->remember_last = p;
+}
+
+void gc_markremembered(pony_ctx_t* ctx, gc_t* gc)
+{
+  pony_trace_fn f;
+  void *p;
+
+  // Trace from every object a write barrier kept. An old object is traced
+  // through even though it is marked, and a young one is marked as well.
+  while(gc->remember != NULL)
+  {
+    gc->remember = gcstack_pop(gc->remember, (void**)&f);
+    gc->remember = gcstack_pop(gc->remember, &p);
+
+    chunk_t* chunk = (chunk_t*)pagemap_get(p);
+
+    if((chunk != NULL) && (heap_owner(chunk) == ctx->current))
+      heap_mark(chunk, p);
+
+    recurse(ctx, p, f);
+  }
+
+  gc->remember_last = NULL;
+}
+
+void gc_forget(gc_t* gc)
+{
+  void* p;
+
+  // A full pass traces everything, so the remembered set isn't needed.
+  while(gc->remember != NULL)
+    gc->remember = gcstack_pop(gc->remember, &p);
+
+  gc->remember_last = NULL;
+}
+
+void gc_markimmutable(pony_ctx_t* ctx, gc_t* gc)
+{
+  size_t i = HASHMAP_BEGIN;
+  object_t* obj;
+
+  // Other actors don't trace the contents of immutable objects they hold, so
+  // trace everything reachable from one while it has a reference count.
+  while((obj = objectmap_next(&gc->local, &i)) != NULL)
+  {
+    if(object_immutable(obj) && (object_rc(obj) > 0))
+    {
+      void* p = object_address(obj);
+      chunk_t* chunk = (chunk_t*)pagemap_get(p);
+
+      if(!heap_mark(chunk, p))
+        recurse(ctx, p, object_trace(obj));
+    }
+  }
+}
+
 void gc_createactor(pony_actor_t* current, pony_actor_t* actor)
 {
   gc_t* gc = actor_gc(current);
@@ -363,6 +498,13 @@ void gc_handlestack(pony_ctx_t* ctx)
   {
     ctx->stack = gcstack_pop(ctx->stack, (void**)&f);
     ctx->stack = gcstack_pop(ctx->stack, &p);
+
+    // Start loading the next object to be traced while this one is traced.
+    void* next = gcstack_peek(ctx->stack, 1);
+
+    if(next != NULL)
+      __pony_prefetch(next);
+
     f(ctx, p);
   }
 }
@@ -370,7 +512,25 @@ void gc_handlestack(pony_ctx_t* ctx)
 void gc_sweep(pony_ctx_t* ctx, gc_t* gc)
 {
   gc->finalisers -= objectmap_sweep(&gc->local);
-  gc->delta = actormap_sweep(ctx, &gc->foreign, gc->mark, gc->delta);
+  gc->delta = actormap_sweep(&gc->foreign, gc->mark, gc->delta, &gc->release,
+    &gc->release_count);
+
+  // Holding a release back only keeps objects alive for longer. Acquires
+  // can't be held back, since they must arrive before the messages that
+  // depend on them.
+  if(actormap_size(&gc->release) == 0)
+    return;
+
+  if((++gc->release_passes >= GC_RELEASE_PASSES) ||
+    (gc->release_count >= GC_RELEASE_OBJECTS))
+    gc_flushrelease(ctx, gc);
+}
+
+void gc_sweepminor(gc_t* gc)
+{
+  // Only local objects are swept. Foreign references and releases wait for
+  // the next full pass.
+  gc->finalisers -= objectmap_sweep(&gc->local);
 }
 
 bool gc_acquire(gc_t* gc, actorref_t* aref)
@@ -384,8 +544,13 @@ bool gc_acquire(gc_t* gc, actorref_t* aref)
 
   while((obj = objectmap_next(map, &i)) != NULL)
   {
-    object_t* obj_local = objectmap_getobject(&gc->local, object_address(obj));
+    // An object reached through an immutable object may be new to us.
+    object_t* obj_local = objectmap_getorput(&gc->local, object_address(obj),
+      gc->mark);
     object_inc_some(obj_local, object_rc(obj));
+
+    if(object_immutable(obj))
+      object_markimmutable(obj_local, object_trace(obj));
   }
 
   actorref_free(aref);
@@ -404,21 +569,12 @@ bool gc_release(gc_t* gc, actorref_t* aref)
 
   while((obj = objectmap_next(map, &i)) != NULL)
   {
-    void* p = object_address(obj);
-    object_t* obj_local = objectmap_getobject(&gc->local, p);
-
-    if(object_dec_some(obj_local, object_rc(obj)))
-    {
-      // The local rc for this object has dropped to zero. We keep track of
-      // whether or not the object was reachable. If we go to 0 rc and it
-      // wasn't reachable, we free it. If we receive the object in a message,
-      // mark it as reachable again.
-      if(!object_reachable(obj_local))
-      {
-        chunk_t* chunk = (chunk_t*)pagemap_get(p);
-        heap_free(chunk, p);
-      }
-    }
+    // An object whose rc drops to zero is freed by our next gc pass, if we
+    // can't reach it. It can't be freed here, since it may be reachable from
+    // an immutable object we received without tracing its contents.
+    object_t* obj_local = objectmap_getobject(&gc->local, object_address(obj));
+    assert(obj_local != NULL);
+    object_dec_some(obj_local, object_rc(obj));
   }
 
   actorref_free(aref);
@@ -454,16 +610,26 @@ void gc_sendacquire(pony_ctx_t* ctx)
 
 void gc_sendrelease(pony_ctx_t* ctx, gc_t* gc)
 {
-  gc->delta = actormap_sweep(ctx, &gc->foreign, gc->mark, gc->delta);
+  gc->delta = actormap_sweep(&gc->foreign, gc->mark, gc->delta, &gc->release,
+    &gc->release_count);
+  gc_flushrelease(ctx, gc);
+}
+
+void gc_flushrelease(pony_ctx_t* ctx, gc_t* gc)
+{
+  actormap_sendrelease(ctx, &gc->release);
+  gc->release_count = 0;
+  gc->release_passes = 0;
 }
 
-void gc_register_final(pony_ctx_t* ctx, void* p, pony_final_fn final)
+void gc_register_final(pony_ctx_t* ctx, void* p, pony_final_fn final,
+  bool deferred)
 {
   if(!ctx->finalising)
   {
     // If we aren't finalising an actor, register the finaliser.
     gc_t* gc = actor_gc(ctx->current);
-    objectmap_register_final(&gc->local, p, final, gc->mark);
+    objectmap_register_final(&gc->local, p, final, deferred, gc->mark);
     gc->finalisers++;
   } else {
     // Otherwise, put the finaliser on the gc stack.
@@ -506,6 +672,8 @@ void gc_destroy(gc_t* gc)
 {
   objectmap_destroy(&gc->local);
   actormap_destroy(&gc->foreign);
+  actormap_destroy(&gc->release);
+  gc_forget(gc);
 
   if(gc->delta != NULL)
   {
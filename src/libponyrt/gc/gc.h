@@ -11,8 +11,16 @@
 
 #define GC_INC_MORE 256
 
+// Releases are held back for up to this many gc passes, or until this many
+// objects are waiting to be released, so an actor sends one release message
+// to each owner for several passes.
+#define GC_RELEASE_PASSES 4
+#define GC_RELEASE_OBJECTS 1024
+
 PONY_EXTERN_C_BEGIN
 
+DECLARE_STACK(gcstack, void);
+
 typedef struct gc_t
 {
   uint32_t mark;
@@ -21,16 +29,25 @@ typedef struct gc_t
   size_t finalisers;
   objectmap_t local;
   actormap_t foreign;
+  actormap_t release;
+  size_t release_count;
+  uint32_t release_passes;
   deltamap_t* delta;
+  gcstack_t* remember;
+  void* remember_last;
 } gc_t;
 
-DECLARE_STACK(gcstack, void);
+void gc_sendobject(pony_ctx_t* ctx, void* p, pony_trace_fn f,
+  bool immutable);
 
-void gc_sendobject(pony_ctx_t* ctx, void* p, pony_trace_fn f);
+void gc_recvobject(pony_ctx_t* ctx, void* p, pony_trace_fn f,
+  bool immutable);
 
-void gc_recvobject(pony_ctx_t* ctx, void* p, pony_trace_fn f);
+void gc_markobject(pony_ctx_t* ctx, void* p, pony_trace_fn f,
+  bool immutable);
 
-void gc_markobject(pony_ctx_t* ctx, void* p, pony_trace_fn f);
+void gc_minorobject(pony_ctx_t* ctx, void* p, pony_trace_fn f,
+  bool immutable);
 
 void gc_sendactor(pony_ctx_t* ctx, pony_actor_t* actor);
 
@@ -38,16 +55,30 @@ void gc_recvactor(pony_ctx_t* ctx, pony_actor_t* actor);
 
 void gc_markactor(pony_ctx_t* ctx, pony_actor_t* actor);
 
+void gc_minoractor(pony_ctx_t* ctx, pony_actor_t* actor);
+
+void gc_remember(gc_t* gc, void* p, pony_trace_fn f);
+
+void gc_markremembered(pony_ctx_t* ctx, gc_t* gc);
+
+void gc_forget(gc_t* gc);
+
+void gc_markimmutable(pony_ctx_t* ctx, gc_t* gc);
+
 void gc_createactor(pony_actor_t* current, pony_actor_t* actor);
 
 void gc_handlestack(pony_ctx_t* ctx);
 
 void gc_sweep(pony_ctx_t* ctx, gc_t* gc);
 
+void gc_sweepminor(gc_t* gc);
+
 void gc_sendacquire(pony_ctx_t* ctx);
 
 void gc_sendrelease(pony_ctx_t* ctx, gc_t* gc);
 
+void gc_flushrelease(pony_ctx_t* ctx, gc_t* gc);
+
 bool gc_acquire(gc_t* gc, actorref_t* aref);
 
 bool gc_release(gc_t* gc, actorref_t* aref);
@@ -56,7 +87,8 @@ size_t gc_rc(gc_t* gc);
 
 deltamap_t* gc_delta(gc_t* gc);
 
-void gc_register_final(pony_ctx_t* ctx, void* p, pony_final_fn final);
+void gc_register_final(pony_ctx_t* ctx, void* p, pony_final_fn final,
+  bool deferred);
 
 void gc_final(pony_ctx_t* ctx, gc_t* gc);
 
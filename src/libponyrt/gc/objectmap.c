@@ -1,5 +1,6 @@
 #include "objectmap.h"
 #include "gc.h"
+#include "finaliser.h"
 #include "../ds/hash.h"
 #include "../ds/fun.h"
 #include "../mem/pool.h"
@@ -10,9 +11,11 @@ typedef struct object_t
 {
   void* address;
   pony_final_fn final;
+  pony_trace_fn trace;
   size_t rc;
   uint32_t mark;
-  bool reachable;
+  bool immutable;
+  bool deferred;
 } object_t;
 
 static size_t object_hash(object_t* obj)
@@ -30,8 +33,10 @@ static object_t* object_alloc(void* address, uint32_t mark)
   object_t* obj = (object_t*)POOL_ALLOC(object_t);
   obj->address = address;
   obj->final = NULL;
+  obj->trace = NULL;
   obj->rc = 0;
-  obj->reachable = true;
+  obj->immutable = false;
+  obj->deferred = false;
 
   // a new object is unmarked
   obj->mark = mark - 1;
@@ -95,14 +100,20 @@ bool object_dec_some(object_t* obj, size_t rc)
   return obj->rc == 0;
 }
 
-bool object_reachable(object_t* obj)
+bool object_immutable(object_t* obj)
 {
-  return obj->reachable;
+  return obj->immutable;
 }
 
-void object_markreachable(object_t* obj)
+pony_trace_fn object_trace(object_t* obj)
 {
-  obj->reachable = true;
+  return obj->trace;
+}
+
+void object_markimmutable(object_t* obj, pony_trace_fn f)
+{
+  obj->immutable = true;
+  obj->trace = f;
 }
 
 DEFINE_HASHMAP(objectmap, object_t, object_hash, object_cmp, pool_alloc_size,
@@ -129,13 +140,22 @@ object_t* objectmap_getorput(objectmap_t* map, void* address, uint32_t mark)
 }
 
 object_t* objectmap_register_final(objectmap_t* map, void* address,
-  pony_final_fn final, uint32_t mark)
+  pony_final_fn final, bool deferred, uint32_t mark)
 {
   object_t* obj = objectmap_getorput(map, address, mark);
   obj->final = final;
+  obj->deferred = deferred;
   return obj;
 }
 
+static void run_final(object_t* obj, chunk_t* chunk)
+{
+  if(obj->deferred)
+    finaliser_defer(obj->address, heap_size(chunk), obj->final);
+  else
+    obj->final(obj->address);
+}
+
 void objectmap_final(objectmap_t* map)
 {
   size_t i = HASHMAP_BEGIN;
@@ -144,8 +164,10 @@ void objectmap_final(objectmap_t* map)
   while((obj = objectmap_next(map, &i)) != NULL)
   {
     if(obj->final != NULL)
-      obj->final(obj->address);
+      run_final(obj, (chunk_t*)pagemap_get(obj->address));
   }
+
+  finaliser_flush();
 }
 
 size_t objectmap_sweep(objectmap_t* map)
@@ -160,11 +182,10 @@ size_t objectmap_sweep(objectmap_t* map)
 
     if(obj->rc > 0)
     {
-      // Keep track of whether or not the object was reachable.
+      // Keep an object that other actors hold alive.
       chunk_t* chunk = (chunk_t*)pagemap_get(p);
-      obj->reachable = heap_ismarked(chunk, p);
 
-      if(!obj->reachable)
+      if(!heap_ismarked(chunk, p))
         heap_mark_shallow(chunk, p);
     } else {
       if(obj->final != NULL)
@@ -176,7 +197,7 @@ size_t objectmap_sweep(objectmap_t* map)
         if(heap_ismarked(chunk, p))
           continue;
 
-        obj->final(p);
+        run_final(obj, chunk);
         count++;
       }
 
@@ -185,5 +206,8 @@ size_t objectmap_sweep(objectmap_t* map)
     }
   }
 
+  if(count > 0)
+    finaliser_flush();
+
   return count;
 }
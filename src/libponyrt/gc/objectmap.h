@@ -26,9 +26,11 @@ bool object_dec(object_t* obj);
 
 bool object_dec_some(object_t* obj, size_t rc);
 
-bool object_reachable(object_t* obj);
+bool object_immutable(object_t* obj);
 
-void object_markreachable(object_t* obj);
+pony_trace_fn object_trace(object_t* obj);
+
+void object_markimmutable(object_t* obj, pony_trace_fn f);
 
 DECLARE_HASHMAP(objectmap, object_t);
 
@@ -37,7 +39,7 @@ object_t* objectmap_getobject(objectmap_t* map, void* address);
 object_t* objectmap_getorput(objectmap_t* map, void* address, uint32_t mark);
 
 object_t* objectmap_register_final(objectmap_t* map, void* address,
-  pony_final_fn final, uint32_t mark);
+  pony_final_fn final, bool deferred, uint32_t mark);
 
 void objectmap_final(objectmap_t* map);
 
@@ -0,0 +1,443 @@
+#include "serialise.h"
+#include "trace.h"
+#include "../sched/scheduler.h"
+#include "../ds/hash.h"
+#include "../ds/stack.h"
+#include "../lang/lang.h"
+#include "../mem/pool.h"
+#include <string.h>
+#include <assert.h>
+
+// An image starts with a header, followed by the objects and buffers it holds,
+// each aligned as the heap aligns them. A pointer in the image is the offset of
+// what it points to. With the low bit set, it is instead the type ID of a
+// primitive, shifted past the alignment bits, since primitives aren't copied.
+#define SERIALISE_MAGIC 0x31726553796E6F50 // "PonySer1"
+#define SERIALISE_ALIGN_BITS 4
+#define SERIALISE_ALIGN ((size_t)1 << SERIALISE_ALIGN_BITS)
+#define SERIALISE_PRIMITIVE 1
+
+PONY_EXTERN_C_BEGIN
+
+typedef struct image_header_t
+{
+  uint64_t magic;
+  uint32_t type_count;
+  uint32_t pad;
+  uint64_t root;
+  uint64_t reserved;
+} image_header_t;
+
+// While deserialising, each aligned slot of the image is marked as it is
+// claimed, so that objects and buffers can't overlap.
+enum
+{
+  SLOT_FREE = 0,
+  SLOT_OBJECT,
+  SLOT_USED
+};
+
+typedef struct serial_t
+{
+  void* key;
+  size_t offset;
+} serial_t;
+
+static size_t serial_hash(serial_t* e)
+{
+  return hash_ptr(e->key);
+}
+
+static bool serial_cmp(serial_t* a, serial_t* b)
+{
+  return a->key == b->key;
+}
+
+static void serial_free(serial_t* e)
+{
+  POOL_FREE(serial_t, e);
+}
+
+DECLARE_HASHMAP(serialmap, serial_t);
+DEFINE_HASHMAP(serialmap, serial_t, serial_hash, serial_cmp, pool_alloc_size,
+  pool_free_size, serial_free);
+
+DECLARE_STACK(serialstack, void);
+DEFINE_STACK(serialstack, void);
+
+struct serialise_t
+{
+  serialmap_t map;
+  serialstack_t* stack;
+  char* buf;
+  size_t size;
+  size_t alloc;
+  uint8_t* slots;
+  bool failed;
+};
+
+static pony_type_t** types;
+static void** instances;
+static uint32_t type_count;
+
+static size_t reserve(pony_ctx_t* ctx, serialise_t* s, size_t size)
+{
+  size_t offset = s->size;
+  size_t next = (offset + size + SERIALISE_ALIGN - 1) &
+    ~(SERIALISE_ALIGN - 1);
+
+  if(next > s->alloc)
+  {
+    size_t alloc = (s->alloc == 0) ? 256 : s->alloc;
+
+    while(alloc < next)
+      alloc <<= 1;
+
+    s->buf = (char*)pony_realloc(ctx, s->buf, alloc);
+    s->alloc = alloc;
+  }
+
+  // Padding is zeroed so that the same graph always gives the same image.
+  memset(s->buf + offset, 0, next - offset);
+  s->size = next;
+  return offset;
+}
+
+static bool claim(serialise_t* s, size_t offset, size_t size)
+{
+  if(((offset & (SERIALISE_ALIGN - 1)) != 0) || (offset >= s->size) ||
+    (size == 0) || (size > (s->size - offset)))
+    return false;
+
+  size_t first = offset >> SERIALISE_ALIGN_BITS;
+  size_t last = (offset + size - 1) >> SERIALISE_ALIGN_BITS;
+
+  for(size_t i = first; i <= last; i++)
+  {
+    if(s->slots[i] != SLOT_FREE)
+      return false;
+  }
+
+  memset(s->slots + first, SLOT_USED, last - first + 1);
+  return true;
+}
+
+void pony_serialise_types(pony_type_t** t, void** i, uint32_t count)
+{
+  types = t;
+  instances = i;
+  type_count = count;
+}
+
+void* pony_serialise(pony_ctx_t* ctx, void* p, size_t* size)
+{
+  if(types == NULL)
+    pony_throw();
+
+  serialise_t s;
+  memset(&s, 0, sizeof(serialise_t));
+  serialmap_init(&s.map, 32);
+  ctx->serialise = &s;
+
+  reserve(ctx, &s, sizeof(image_header_t));
+  size_t root = pony_serialise_offset(ctx, p);
+
+  // Objects are copied as they come off the stack, and their serialise
+  // functions push anything they point to that hasn't been reached yet.
+  while(s.stack != NULL)
+  {
+    void* object;
+    void* offset;
+    s.stack = serialstack_pop(s.stack, &offset);
+    s.stack = serialstack_pop(s.stack, &object);
+
+    if(s.failed)
+      continue;
+
+    pony_type_t* t = *(pony_type_t**)object;
+    char* copy = s.buf + (size_t)offset;
+    memcpy(copy, object, t->size);
+    *(uintptr_t*)copy = t->id;
+
+    if(t->serialise != NULL)
+      t->serialise(ctx, object, (size_t)offset);
+  }
+
+  ctx->serialise = NULL;
+  serialmap_destroy(&s.map);
+
+  if(s.failed)
+    pony_throw();
+
+  image_header_t* header = (image_header_t*)s.buf;
+  header->magic = SERIALISE_MAGIC;
+  header->type_count = type_count;
+  header->root = root;
+
+  *size = s.size;
+  return s.buf;
+}
+
+void* pony_deserialise(pony_ctx_t* ctx, const void* image, size_t size)
+{
+  image_header_t header;
+
+  if((types == NULL) || (size < sizeof(image_header_t)) ||
+    ((size & (SERIALISE_ALIGN - 1)) != 0))
+    pony_throw();
+
+  memcpy(&header, image, sizeof(image_header_t));
+
+  if((header.magic != SERIALISE_MAGIC) || (header.type_count != type_count) ||
+    ((uintptr_t)header.root != header.root))
+    pony_throw();
+
+  serialise_t s;
+  memset(&s, 0, sizeof(serialise_t));
+  s.buf = (char*)pony_alloc(ctx, size);
+  s.size = size;
+  memcpy(s.buf, image, size);
+
+  size_t slot_count = size >> SERIALISE_ALIGN_BITS;
+  s.slots = (uint8_t*)pool_alloc_size(slot_count);
+  memset(s.slots, SLOT_FREE, slot_count);
+  memset(s.slots, SLOT_USED, sizeof(image_header_t) >> SERIALISE_ALIGN_BITS);
+  ctx->serialise = &s;
+
+  // The image is fixed up in place, so everything in it shares the one
+  // allocation, which the heap keeps alive while any part of it is reachable.
+  void* root = pony_deserialise_offset(ctx, (uintptr_t)header.root);
+
+  while(s.stack != NULL)
+  {
+    void* object;
+    s.stack = serialstack_pop(s.stack, &object);
+
+    if(s.failed)
+      continue;
+
+    pony_type_t* t = *(pony_type_t**)object;
+
+    if(t->deserialise != NULL)
+      t->deserialise(ctx, object);
+  }
+
+  ctx->serialise = NULL;
+  pool_free_size(slot_count, s.slots);
+
+  if(s.failed)
+    pony_throw();
+
+  return root;
+}
+
+size_t pony_serialise_offset(pony_ctx_t* ctx, void* p)
+{
+  serialise_t* s = ctx->serialise;
+  pony_type_t* t = *(pony_type_t**)p;
+
+  if(t->id >= type_count)
+  {
+    s->failed = true;
+    return 0;
+  }
+
+  if(instances[t->id] == p)
+    return ((size_t)t->id << SERIALISE_ALIGN_BITS) | SERIALISE_PRIMITIVE;
+
+  serial_t key;
+  key.key = p;
+  serial_t* e = serialmap_get(&s->map, &key);
+
+  if(e != NULL)
+    return e->offset;
+
+  if((t->dispatch != NULL) || (t->final != NULL))
+  {
+    s->failed = true;
+    return 0;
+  }
+
+  e = (serial_t*)POOL_ALLOC(serial_t);
+  e->key = p;
+  e->offset = reserve(ctx, s, t->size);
+  serialmap_put(&s->map, e);
+
+  s->stack = serialstack_push(s->stack, p);
+  s->stack = serialstack_push(s->stack, (void*)e->offset);
+  return e->offset;
+}
+
+void* pony_serialise_addr(pony_ctx_t* ctx, size_t offset)
+{
+  return ctx->serialise->buf + offset;
+}
+
+void pony_serialise_embed(pony_ctx_t* ctx, void* p, size_t offset)
+{
+  pony_type_t* t = *(pony_type_t**)p;
+  *(uintptr_t*)(ctx->serialise->buf + offset) = t->id;
+
+  if(t->serialise != NULL)
+    t->serialise(ctx, p, offset);
+}
+
+size_t pony_serialise_array(pony_ctx_t* ctx, void* p, size_t offset,
+  size_t elem_size)
+{
+  serialise_t* s = ctx->serialise;
+  array_t* a = (array_t*)p;
+  size_t bytes = a->size * elem_size;
+  size_t block = 0;
+
+  // Only the elements in use are copied, and an empty array has no buffer.
+  if(bytes > 0)
+  {
+    block = reserve(ctx, s, bytes);
+    memcpy(s->buf + block, a->ptr, bytes);
+  }
+
+  array_t* copy = (array_t*)(s->buf + offset);
+  copy->alloc = a->size;
+  copy->ptr = (void*)block;
+  return block;
+}
+
+void pony_serialise_string(pony_ctx_t* ctx, void* p, size_t offset)
+{
+  serialise_t* s = ctx->serialise;
+  array_t* a = (array_t*)p;
+  pony_type_t* t = *(pony_type_t**)p;
+  char* ptr = (char*)a->ptr;
+
+  // A short string keeps its bytes inside the object, which is copied already.
+  if((ptr >= (char*)p) && (ptr < ((char*)p + t->size)))
+  {
+    array_t* copy = (array_t*)(s->buf + offset);
+    copy->ptr = (void*)(offset + (size_t)(ptr - (char*)p));
+    return;
+  }
+
+  // Reserving zeroes the null terminator, which a view might not have.
+  size_t block = reserve(ctx, s, a->size + 1);
+  memcpy(s->buf + block, ptr, a->size);
+
+  array_t* copy = (array_t*)(s->buf + offset);
+  copy->alloc = a->size + 1;
+  copy->ptr = (void*)block;
+}
+
+void pony_serialise_fail(pony_ctx_t* ctx)
+{
+  ctx->serialise->failed = true;
+}
+
+void* pony_deserialise_offset(pony_ctx_t* ctx, uintptr_t offset)
+{
+  serialise_t* s = ctx->serialise;
+
+  if((offset & SERIALISE_PRIMITIVE) != 0)
+  {
+    uintptr_t id = offset >> SERIALISE_ALIGN_BITS;
+
+    if(((offset & (SERIALISE_ALIGN - 1)) == SERIALISE_PRIMITIVE) &&
+      (id < type_count) && (instances[id] != NULL))
+      return instances[id];
+
+    s->failed = true;
+    return NULL;
+  }
+
+  if(((offset & (SERIALISE_ALIGN - 1)) == 0) && (offset < s->size))
+  {
+    size_t slot = offset >> SERIALISE_ALIGN_BITS;
+
+    if(s->slots[slot] == SLOT_OBJECT)
+      return s->buf + offset;
+
+    uintptr_t id = *(uintptr_t*)(s->buf + offset);
+    pony_type_t* t = (id < type_count) ? types[id] : NULL;
+
+    if((t != NULL) && (instances[id] == NULL) && (t->dispatch == NULL) &&
+      (t->final == NULL) && claim(s, offset, t->size))
+    {
+      s->slots[slot] = SLOT_OBJECT;
+
+      void* p = s->buf + offset;
+      *(pony_type_t**)p = t;
+      s->stack = serialstack_push(s->stack, p);
+      return p;
+    }
+  }
+
+  s->failed = true;
+  return NULL;
+}
+
+void pony_deserialise_embed(pony_ctx_t* ctx, void* p, pony_type_t* type)
+{
+  if(*(uintptr_t*)p != type->id)
+  {
+    ctx->serialise->failed = true;
+    return;
+  }
+
+  *(pony_type_t**)p = type;
+
+  if(type->deserialise != NULL)
+    type->deserialise(ctx, p);
+}
+
+void* pony_deserialise_array(pony_ctx_t* ctx, void* p, size_t elem_size)
+{
+  serialise_t* s = ctx->serialise;
+  array_t* a = (array_t*)p;
+  uintptr_t offset = (uintptr_t)a->ptr;
+
+  if((offset == 0) && (a->size == 0) && (a->alloc == 0))
+    return NULL;
+
+  if((a->size <= a->alloc) && (a->alloc <= (s->size / elem_size)) &&
+    claim(s, offset, a->alloc * elem_size))
+  {
+    a->ptr = s->buf + offset;
+    return a->ptr;
+  }
+
+  // Leave an empty array, so that no elements are fixed up.
+  s->failed = true;
+  a->size = 0;
+  a->alloc = 0;
+  a->ptr = NULL;
+  return NULL;
+}
+
+void pony_deserialise_string(pony_ctx_t* ctx, void* p)
+{
+  serialise_t* s = ctx->serialise;
+  array_t* a = (array_t*)p;
+  pony_type_t* t = *(pony_type_t**)p;
+  uintptr_t offset = (uintptr_t)a->ptr;
+  size_t start = (size_t)((char*)p - s->buf);
+  size_t end = start + t->size;
+
+  if(a->size < a->alloc)
+  {
+    // A short string's bytes follow its header fields in the object.
+    bool inside = (offset >= (start + sizeof(array_t))) && (offset < end) &&
+      (a->alloc <= (end - offset));
+
+    if((inside || claim(s, offset, a->alloc)) &&
+      (s->buf[offset + a->size] == 0))
+    {
+      a->ptr = s->buf + offset;
+      return;
+    }
+  }
+
+  s->failed = true;
+  a->size = 0;
+  a->ptr = NULL;
+}
+
+PONY_EXTERN_C_END
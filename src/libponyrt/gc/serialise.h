@@ -0,0 +1,17 @@
+#ifndef gc_serialise_h
+#define gc_serialise_h
+
+#include <pony.h>
+#include <platform.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * The state of a pony_serialise() or pony_deserialise() call, kept in the
+ * context so that the functions generated for each type can reach it.
+ */
+typedef struct serialise_t serialise_t;
+
+PONY_EXTERN_C_END
+
+#endif
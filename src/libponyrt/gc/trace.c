@@ -3,6 +3,7 @@
 #include "../sched/scheduler.h"
 #include "../sched/cpu.h"
 #include "../actor/actor.h"
+#include "../mem/pagemap.h"
 #include <assert.h>
 
 void pony_gc_send(pony_ctx_t* ctx)
@@ -34,6 +35,13 @@ void pony_gc_mark(pony_ctx_t* ctx)
   ctx->trace_actor = gc_markactor;
 }
 
+void pony_gc_minor(pony_ctx_t* ctx)
+{
+  assert(ctx->stack == NULL);
+  ctx->trace_object = gc_minorobject;
+  ctx->trace_actor = gc_minoractor;
+}
+
 void pony_send_done(pony_ctx_t* ctx)
 {
   gc_handlestack(ctx);
@@ -57,7 +65,7 @@ void pony_recv_done(pony_ctx_t* ctx)
 
 void pony_trace(pony_ctx_t* ctx, void* p)
 {
-  ctx->trace_object(ctx, p, NULL);
+  ctx->trace_object(ctx, p, NULL, false);
 }
 
 void pony_traceactor(pony_ctx_t* ctx, pony_actor_t* p)
@@ -67,7 +75,25 @@ void pony_traceactor(pony_ctx_t* ctx, pony_actor_t* p)
 
 void pony_traceobject(pony_ctx_t* ctx, void* p, pony_trace_fn f)
 {
-  ctx->trace_object(ctx, p, f);
+  ctx->trace_object(ctx, p, f, false);
+}
+
+void pony_traceimmutable(pony_ctx_t* ctx, void* p, pony_trace_fn f)
+{
+  ctx->trace_object(ctx, p, f, true);
+}
+
+void pony_trace_leaf_array(pony_ctx_t* ctx, void* p)
+{
+  ctx->trace_object(ctx, ((array_t*)p)->ptr, NULL, false);
+}
+
+static pony_trace_fn unknown_trace(pony_type_t* type)
+{
+  if((type->flags & PONY_TYPE_LEAF_ARRAY) != 0)
+    return pony_trace_leaf_array;
+
+  return type->trace;
 }
 
 void pony_traceunknown(pony_ctx_t* ctx, void* p)
@@ -78,7 +104,19 @@ void pony_traceunknown(pony_ctx_t* ctx, void* p)
   {
     ctx->trace_actor(ctx, (pony_actor_t*)p);
   } else {
-    ctx->trace_object(ctx, p, type->trace);
+    ctx->trace_object(ctx, p, unknown_trace(type), false);
+  }
+}
+
+void pony_traceunknownimmutable(pony_ctx_t* ctx, void* p)
+{
+  pony_type_t* type = *(pony_type_t**)p;
+
+  if(type->dispatch != NULL)
+  {
+    ctx->trace_actor(ctx, (pony_actor_t*)p);
+  } else {
+    ctx->trace_object(ctx, p, unknown_trace(type), true);
   }
 }
 
@@ -90,6 +128,77 @@ void pony_trace_tag_or_actor(pony_ctx_t* ctx, void* p)
   {
     ctx->trace_actor(ctx, (pony_actor_t*)p);
   } else {
-    ctx->trace_object(ctx, p, NULL);
+    ctx->trace_object(ctx, p, NULL, false);
   }
 }
+
+/**
+ * Returns true if p is in the current actor's heap and was allocated since
+ * the last gc pass, in which case a minor pass traces it anyway.
+ */
+static bool young_local(pony_ctx_t* ctx, chunk_t* chunk, void* p)
+{
+  return (chunk != NULL) && (heap_owner(chunk) == ctx->current) &&
+    heap_isyoung(chunk, p);
+}
+
+void pony_writebarrier(pony_ctx_t* ctx, void* p, pony_trace_fn f)
+{
+  if(!heap_nurseryon())
+    return;
+
+  chunk_t* chunk = (chunk_t*)pagemap_get(p);
+
+  // Memory that wasn't pony_allocated, such as an actor, is traced by every
+  // pass. Frozen memory is never written to.
+  if((chunk == NULL) || (heap_owner(chunk) == NULL))
+    return;
+
+  gc_t* gc = actor_gc(ctx->current);
+
+  if(heap_owner(chunk) == ctx->current)
+  {
+    // An old object in our own heap is only remembered once.
+    if(heap_isyoung(chunk, p) || !heap_remember(chunk, p))
+      return;
+  } else if(p == gc->remember_last) {
+    // We can't keep bits in another actor's heap, but the same object is often
+    // written to several times in a row.
+    return;
+  }
+
+  gc_remember(gc, p, f);
+}
+
+void pony_writebarrier_value(pony_ctx_t* ctx, void* p, void* value,
+  pony_trace_fn f)
+{
+  if(!heap_nurseryon())
+    return;
+
+  chunk_t* chunk = (chunk_t*)pagemap_get(value);
+
+  // Only our own young objects are collected by a minor pass, and they are
+  // found anyway if the memory written to is young as well.
+  if(!young_local(ctx, chunk, value) ||
+    young_local(ctx, (chunk_t*)pagemap_get(p), p) ||
+    !heap_remember(chunk, value))
+    return;
+
+  gc_remember(actor_gc(ctx->current), value, f);
+}
+
+void pony_writebarrier_unknown(pony_ctx_t* ctx, void* p, void* value)
+{
+  if(!heap_nurseryon())
+    return;
+
+  // Only read the descriptor of an object that might need remembering.
+  chunk_t* chunk = (chunk_t*)pagemap_get(value);
+
+  if(!young_local(ctx, chunk, value))
+    return;
+
+  pony_type_t* type = *(pony_type_t**)value;
+  pony_writebarrier_value(ctx, p, value, type->trace);
+}
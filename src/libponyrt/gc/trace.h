@@ -6,8 +6,19 @@
 
 PONY_EXTERN_C_BEGIN
 
+// The layout of a builtin Array, which a String starts with as well.
+typedef struct array_t
+{
+  pony_type_t* type;
+  size_t size;
+  size_t alloc;
+  void* ptr;
+} array_t;
+
 void pony_gc_mark(pony_ctx_t* ctx);
 
+void pony_gc_minor(pony_ctx_t* ctx);
+
 PONY_EXTERN_C_END
 
 #endif
@@ -0,0 +1,236 @@
+#include "base64.h"
+#include <pony.h>
+#include <string.h>
+
+#if defined(PLATFORM_IS_X86) && defined(PLATFORM_IS_CLANG_OR_GCC)
+#  define USE_X86_SIMD
+#  include <immintrin.h>
+#endif
+
+PONY_EXTERN_C_BEGIN
+
+typedef size_t (*encode_fn)(char* dst, const uint8_t* src, size_t len,
+  char at62, char at63);
+
+typedef size_t (*decode_fn)(uint8_t* dst, size_t space, const char* src,
+  size_t len, char at62, char at63);
+
+static const char alphabet[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+static size_t encode_generic(char* dst, const uint8_t* src, size_t len,
+  char at62, char at63)
+{
+  char table[64];
+  memcpy(table, alphabet, 62);
+  table[62] = at62;
+  table[63] = at63;
+
+  char* p = dst;
+
+  for(size_t i = 0; (i + 3) <= len; i += 3)
+  {
+    uint32_t v = ((uint32_t)src[i] << 16) | ((uint32_t)src[i + 1] << 8) |
+      src[i + 2];
+
+    p[0] = table[(v >> 18) & 0x3F];
+    p[1] = table[(v >> 12) & 0x3F];
+    p[2] = table[(v >> 6) & 0x3F];
+    p[3] = table[v & 0x3F];
+    p += 4;
+  }
+
+  return (size_t)(p - dst);
+}
+
+static size_t decode_generic(uint8_t* dst, size_t space, const char* src,
+  size_t len, char at62, char at63)
+{
+  // 0xFF marks a character that isn't part of the alphabet.
+  uint8_t table[256];
+  memset(table, 0xFF, sizeof(table));
+
+  for(uint8_t i = 0; i < 62; i++)
+    table[(uint8_t)alphabet[i]] = i;
+
+  table[(uint8_t)at62] = 62;
+  table[(uint8_t)at63] = 63;
+
+  size_t n = 0;
+
+  for(size_t i = 0; ((i + 4) <= len) && ((n + 3) <= space); i += 4)
+  {
+    uint8_t a = table[(uint8_t)src[i]];
+    uint8_t b = table[(uint8_t)src[i + 1]];
+    uint8_t c = table[(uint8_t)src[i + 2]];
+    uint8_t d = table[(uint8_t)src[i + 3]];
+
+    if((a | b | c | d) == 0xFF)
+      break;
+
+    uint32_t v = ((uint32_t)a << 18) | ((uint32_t)b << 12) |
+      ((uint32_t)c << 6) | d;
+
+    dst[n] = (uint8_t)(v >> 16);
+    dst[n + 1] = (uint8_t)(v >> 8);
+    dst[n + 2] = (uint8_t)v;
+    n += 3;
+  }
+
+  return n;
+}
+
+#ifdef USE_X86_SIMD
+
+// The SSSE3 versions handle 12 bytes to 16 characters at a time, moving the
+// 6 bit fields with multiplies and shuffles, and leave whatever is left to the
+// generic versions. See Wojciech Mula's notes on SIMD base64.
+
+__attribute__((target("ssse3")))
+static size_t encode_ssse3(char* dst, const uint8_t* src, size_t len,
+  char at62, char at63)
+{
+  // Offsets from a 6 bit value to its character, picked by a shuffle on a
+  // small index worked out from the value's range.
+  const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, (char)(at62 - 62), (char)(at63 - 63), 'A', 0, 0);
+  const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7,
+    10, 9, 11, 10);
+  size_t i = 0;
+  size_t n = 0;
+
+  // Each block loads 16 bytes but only uses 12.
+  for(; (i + 16) <= len; i += 12)
+  {
+    __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+    in = _mm_shuffle_epi8(in, spread);
+
+    __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    __m128i values = _mm_or_si128(t1, t3);
+
+    __m128i index = _mm_subs_epu8(values, _mm_set1_epi8(51));
+    __m128i low = _mm_cmpgt_epi8(_mm_set1_epi8(26), values);
+    index = _mm_or_si128(index, _mm_and_si128(low, _mm_set1_epi8(13)));
+
+    __m128i out = _mm_add_epi8(values, _mm_shuffle_epi8(offsets, index));
+    _mm_storeu_si128((__m128i*)(dst + n), out);
+    n += 16;
+  }
+
+  return n + encode_generic(dst + n, src + i, len - i, at62, at63);
+}
+
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(uint8_t* dst, size_t space, const char* src,
+  size_t len, char at62, char at63)
+{
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+    -1, -1, -1, -1);
+  size_t i = 0;
+  size_t n = 0;
+
+  // Each block stores 16 bytes but only 12 of them are output.
+  for(; ((i + 16) <= len) && ((n + 16) <= space); i += 16)
+  {
+    __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+
+    // Characters outside every range are left out of the valid mask. Bytes of
+    // 0x80 and up compare as negative, so they fall outside all of them.
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)),
+      _mm_cmplt_epi8(in, _mm_set1_epi8('Z' + 1)));
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)),
+      _mm_cmplt_epi8(in, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)),
+      _mm_cmplt_epi8(in, _mm_set1_epi8('9' + 1)));
+    __m128i is62 = _mm_cmpeq_epi8(in, _mm_set1_epi8(at62));
+    __m128i is63 = _mm_cmpeq_epi8(in, _mm_set1_epi8(at63));
+
+    __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+      _mm_or_si128(digit, _mm_or_si128(is62, is63)));
+
+    if(_mm_movemask_epi8(valid) != 0xFFFF)
+      break;
+
+    __m128i values = _mm_or_si128(
+      _mm_or_si128(
+        _mm_and_si128(upper, _mm_sub_epi8(in, _mm_set1_epi8('A'))),
+        _mm_and_si128(lower, _mm_sub_epi8(in, _mm_set1_epi8('a' - 26)))),
+      _mm_or_si128(
+        _mm_and_si128(digit, _mm_add_epi8(in, _mm_set1_epi8(52 - '0'))),
+        _mm_or_si128(_mm_and_si128(is62, _mm_set1_epi8(62)),
+          _mm_and_si128(is63, _mm_set1_epi8(63)))));
+
+    // Join pairs of 6 bit values into 12 bits, then pairs of those into 24,
+    // and pack the three bytes of each group together.
+    __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i groups = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128((__m128i*)(dst + n), _mm_shuffle_epi8(groups, pack));
+    n += 12;
+  }
+
+  return n + decode_generic(dst + n, space - n, src + i, len - i, at62, at63);
+}
+
+#endif
+
+static size_t encode_resolve(char* dst, const uint8_t* src, size_t len,
+  char at62, char at63);
+
+static size_t decode_resolve(uint8_t* dst, size_t space, const char* src,
+  size_t len, char at62, char at63);
+
+static encode_fn encode_impl = encode_resolve;
+static decode_fn decode_impl = decode_resolve;
+
+static void resolve()
+{
+  encode_fn encode = encode_generic;
+  decode_fn decode = decode_generic;
+
+#ifdef USE_X86_SIMD
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("ssse3"))
+  {
+    encode = encode_ssse3;
+    decode = decode_ssse3;
+  }
+#endif
+
+  // Every thread that gets here picks the same functions, so the race is
+  // harmless.
+  _atomic_store(&encode_impl, encode);
+  _atomic_store(&decode_impl, decode);
+}
+
+static size_t encode_resolve(char* dst, const uint8_t* src, size_t len,
+  char at62, char at63)
+{
+  resolve();
+  return encode_impl(dst, src, len, at62, at63);
+}
+
+static size_t decode_resolve(uint8_t* dst, size_t space, const char* src,
+  size_t len, char at62, char at63)
+{
+  resolve();
+  return decode_impl(dst, space, src, len, at62, at63);
+}
+
+size_t pony_base64_encode(char* dst, const uint8_t* src, size_t len,
+  char at62, char at63)
+{
+  return _atomic_load(&encode_impl)(dst, src, len, at62, at63);
+}
+
+size_t pony_base64_decode(uint8_t* dst, size_t space, const char* src,
+  size_t len, char at62, char at63)
+{
+  return _atomic_load(&decode_impl)(dst, space, src, len, at62, at63);
+}
+
+PONY_EXTERN_C_END
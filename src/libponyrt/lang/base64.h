@@ -0,0 +1,30 @@
+#ifndef lang_base64_h
+#define lang_base64_h
+
+#include <platform.h>
+#include <stddef.h>
+#include <stdint.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * Encodes the whole 3 byte groups at the start of src, using at62 and at63 for
+ * the last two characters of the alphabet. Returns the number of characters
+ * written to dst, which is 4 for each group. Any 1 or 2 bytes left over are
+ * not encoded.
+ */
+size_t pony_base64_encode(char* dst, const uint8_t* src, size_t len,
+  char at62, char at63);
+
+/**
+ * Decodes the groups of 4 base64 characters at the start of src, stopping at
+ * the first group that holds anything else, such as padding or whitespace, or
+ * once dst would need more than space bytes. Returns the number of bytes
+ * written to dst, which is 3 for each group decoded.
+ */
+size_t pony_base64_decode(uint8_t* dst, size_t space, const char* src,
+  size_t len, char at62, char at63);
+
+PONY_EXTERN_C_END
+
+#endif
@@ -0,0 +1,26 @@
+#include <platform.h>
+
+PONY_EXTERN_C_BEGIN
+
+/** Called by DoNotOptimise in the ponybench package.
+ *
+ * The compiler can't see into this, so a value passed to it has to be
+ * computed, and memory it could reach has to be written, even if nothing
+ * else uses them. It's called without a prototype, with any arguments, and
+ * it never reads them.
+ */
+#if defined(PLATFORM_IS_VISUAL_STUDIO)
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+void pony_keep(void* p, ...)
+{
+  (void)p;
+
+#if defined(PLATFORM_IS_CLANG_OR_GCC)
+  __asm__ __volatile__("" : : : "memory");
+#endif
+}
+
+PONY_EXTERN_C_END
@@ -0,0 +1,91 @@
+#include "blocking.h"
+#include <pony.h>
+#include "../mem/pool.h"
+#include <string.h>
+
+static DECLARE_THREAD_FN(run_thread)
+{
+  blocking_pool_t* pool = (blocking_pool_t*)arg;
+  pony_register_thread();
+
+  // The queue and thread counts are only touched with the park locked. Jobs
+  // are slow enough that a lock costs nothing next to them.
+  pony_park_lock(&pool->park);
+
+  while(true)
+  {
+    blocking_job_t* job = pool->head;
+
+    if(job != NULL)
+    {
+      pool->head = job->next;
+
+      if(pool->head == NULL)
+        pool->tail = NULL;
+
+      pony_park_unlock(&pool->park);
+      job->fn(job);
+      pony_park_lock(&pool->park);
+      continue;
+    }
+
+    if(pool->stopping)
+      break;
+
+    pool->idle++;
+    pony_park_wait(&pool->park);
+    pool->idle--;
+  }
+
+  // Pass the wakeup on to the next thread that is stopping.
+  pony_park_signal(&pool->park);
+  pony_park_unlock(&pool->park);
+  return 0;
+}
+
+void blocking_init(blocking_pool_t* pool, uint32_t threads)
+{
+  memset(pool, 0, sizeof(blocking_pool_t));
+  pony_park_init(&pool->park);
+  pool->max = (threads > 0) ? threads : 1;
+  pool->tid = (pony_thread_id_t*)pool_alloc_size(
+    pool->max * sizeof(pony_thread_id_t));
+}
+
+void blocking_run(blocking_pool_t* pool, blocking_job_t* job)
+{
+  job->next = NULL;
+  pony_park_lock(&pool->park);
+
+  if(pool->tail != NULL)
+    pool->tail->next = job;
+  else
+    pool->head = job;
+
+  pool->tail = job;
+
+  if(pool->idle > 0)
+  {
+    pony_park_signal(&pool->park);
+  } else if(pool->started < pool->max) {
+    if(pony_thread_create(&pool->tid[pool->started], run_thread, -1, pool))
+      pool->started++;
+  }
+
+  pony_park_unlock(&pool->park);
+}
+
+void blocking_shutdown(blocking_pool_t* pool)
+{
+  pony_park_lock(&pool->park);
+  pool->stopping = true;
+  pony_park_signal(&pool->park);
+  pony_park_unlock(&pool->park);
+
+  for(uint32_t i = 0; i < pool->started; i++)
+    pony_thread_join(pool->tid[i]);
+
+  pool_free_size(pool->max * sizeof(pony_thread_id_t), pool->tid);
+  pony_park_destroy(&pool->park);
+  memset(pool, 0, sizeof(blocking_pool_t));
+}
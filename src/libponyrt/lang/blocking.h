@@ -0,0 +1,57 @@
+#ifndef lang_blocking_h
+#define lang_blocking_h
+
+#include <platform.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+PONY_EXTERN_C_BEGIN
+
+typedef struct blocking_job_t blocking_job_t;
+
+typedef void (*blocking_fn)(blocking_job_t* job);
+
+/**
+ * A piece of work that blocks, such as a name lookup or a file read. Embed
+ * this at the start of a larger struct that holds the job's arguments.
+ */
+struct blocking_job_t
+{
+  blocking_job_t* next;
+  blocking_fn fn;
+};
+
+/**
+ * A pool of threads that run blocking jobs, so that scheduler threads don't
+ * have to. Threads are started as jobs are queued, up to the pool's limit. A
+ * slow job only holds up the jobs queued behind it once every thread is busy.
+ */
+typedef struct blocking_pool_t
+{
+  pony_park_t park;
+  blocking_job_t* head;
+  blocking_job_t* tail;
+  pony_thread_id_t* tid;
+  uint32_t max;
+  uint32_t started;
+  uint32_t idle;
+  bool stopping;
+} blocking_pool_t;
+
+void blocking_init(blocking_pool_t* pool, uint32_t threads);
+
+/**
+ * Queues a job to be run on one of the pool's threads. The job runs once, and
+ * is responsible for freeing itself.
+ */
+void blocking_run(blocking_pool_t* pool, blocking_job_t* job);
+
+/**
+ * Stops and joins the pool's threads. Must only be called once no job is
+ * queued or running.
+ */
+void blocking_shutdown(blocking_pool_t* pool);
+
+PONY_EXTERN_C_END
+
+#endif
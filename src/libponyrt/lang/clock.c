@@ -0,0 +1,131 @@
+#include "clock.h"
+#include <pony.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#if defined(PLATFORM_IS_MACOSX)
+#include <mach/mach_time.h>
+#endif
+
+// About a millisecond on a 3 GHz processor.
+#define CLOCK_TICKS 3000000
+
+#define HTTP_DATE_SIZE 32
+
+// Only written when a scheduler thread finds the clock stale, so it is read
+// far more often than written. It has a cache line of its own so that the
+// writes don't slow down anything else.
+typedef struct coarse_clock_t
+{
+  __pony_spec_align__(uint64_t volatile nanos, 64);
+  int64_t volatile seconds;
+
+  // The date for the current second is in one buffer while the date for the
+  // next is written to the other.
+  uint32_t volatile date;
+  char http_date[2][HTTP_DATE_SIZE];
+} coarse_clock_t;
+
+static coarse_clock_t coarse;
+
+static const char* const day_name[] =
+  {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+
+static const char* const month_name[] =
+  {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+static void format_date(char* buf, int64_t sec)
+{
+  time_t t = (time_t)sec;
+  struct tm tm;
+
+#ifdef PLATFORM_IS_WINDOWS
+  gmtime_s(&tm, &t);
+#else
+  gmtime_r(&t, &tm);
+#endif
+
+  // The names are always in English, whatever the locale, so strftime won't
+  // do.
+  snprintf(buf, HTTP_DATE_SIZE, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+    day_name[tm.tm_wday], tm.tm_mday, month_name[tm.tm_mon],
+    tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+static void refresh()
+{
+  int64_t sec = (int64_t)time(NULL);
+  int64_t old = _atomic_load(&coarse.seconds);
+
+  // Only the thread that moves the seconds on formats the date.
+  if((sec > old) && _atomic_cas(&coarse.seconds, &old, sec))
+  {
+    uint32_t next = _atomic_load(&coarse.date) ^ 1;
+    format_date(coarse.http_date[next], sec);
+    _atomic_store(&coarse.date, next);
+  }
+
+  uint64_t now = os_clock_nanos();
+  uint64_t last = _atomic_load(&coarse.nanos);
+
+  // Another thread may have read the clock at about the same time. Keep
+  // whichever time is later, so that the clock never goes backwards.
+  while(now > last)
+  {
+    if(_atomic_cas(&coarse.nanos, &last, now))
+      break;
+  }
+}
+
+uint64_t os_clock_nanos()
+{
+#if defined(PLATFORM_IS_MACOSX)
+  static mach_timebase_info_data_t tb;
+
+  if(tb.denom == 0)
+    mach_timebase_info(&tb);
+
+  return (mach_absolute_time() * tb.numer) / tb.denom;
+#elif defined(PLATFORM_IS_WINDOWS)
+  LARGE_INTEGER t, f;
+  QueryPerformanceCounter(&t);
+  QueryPerformanceFrequency(&f);
+  return (uint64_t)((t.QuadPart / f.QuadPart) * 1000000000) +
+    (uint64_t)(((t.QuadPart % f.QuadPart) * 1000000000) / f.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void os_clock_init()
+{
+  refresh();
+}
+
+uint64_t os_clock_update(uint64_t tsc, uint64_t last)
+{
+  if((tsc - last) < CLOCK_TICKS)
+    return last;
+
+  refresh();
+  return tsc;
+}
+
+uint64_t os_coarse_nanos()
+{
+  return _atomic_load(&coarse.nanos);
+}
+
+int64_t os_coarse_seconds()
+{
+  return _atomic_load(&coarse.seconds);
+}
+
+const char* os_http_date()
+{
+  return coarse.http_date[_atomic_load(&coarse.date)];
+}
@@ -0,0 +1,48 @@
+#ifndef lang_clock_h
+#define lang_clock_h
+
+#include <platform.h>
+#include <stdint.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * Monotonic unadjusted nanoseconds, read from the system clock.
+ */
+uint64_t os_clock_nanos();
+
+/**
+ * Sets the coarse clock. Called by scheduler_init(), before any actor runs.
+ */
+void os_clock_init();
+
+/**
+ * Refreshes the coarse clock if it is more than about a millisecond old, as
+ * measured with the given cpu_tick(). Scheduler threads call this before they
+ * run an actor, with the tick at which they last refreshed it, and keep the
+ * tick they are given back.
+ */
+uint64_t os_clock_update(uint64_t tsc, uint64_t last);
+
+/**
+ * Monotonic nanoseconds as of the last time the coarse clock was refreshed.
+ * Never goes backwards, and is never more than about a millisecond behind the
+ * time at which the running actor was scheduled.
+ */
+uint64_t os_coarse_nanos();
+
+/**
+ * Wall-clock seconds since the epoch as of the last refresh.
+ */
+int64_t os_coarse_seconds();
+
+/**
+ * The wall-clock time as of the last refresh, formatted as an HTTP date, such
+ * as "Sun, 06 Nov 1994 08:49:37 GMT". It is formatted once a second and must
+ * be copied rather than kept.
+ */
+const char* os_http_date();
+
+PONY_EXTERN_C_END
+
+#endif
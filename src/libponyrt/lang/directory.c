@@ -1,6 +1,7 @@
 #include <platform.h>
 #include <pony.h>
 #include "lang.h"
+#include "../mem/pool.h"
 #include <string.h>
 
 #if defined(PLATFORM_IS_WINDOWS)
@@ -11,6 +12,50 @@
 #include <stdio.h>
 #endif
 
+#if defined(PLATFORM_IS_LINUX)
+#include <sys/syscall.h>
+
+// The buffer getdents64 is asked to fill. Each call returns as many entries as
+// fit, which is hundreds for typical names.
+#define DIR_BUF_SIZE (32 * 1024)
+
+struct linux_dirent64
+{
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+#endif
+
+// The kinds of entry os_dir_next() reports, which DirEntry turns into flags.
+enum
+{
+  DIR_ENTRY_OTHER,
+  DIR_ENTRY_FILE,
+  DIR_ENTRY_DIRECTORY,
+  DIR_ENTRY_SYMLINK
+};
+
+typedef struct dir_reader_t
+{
+#if defined(PLATFORM_IS_WINDOWS)
+  HANDLE h;
+  WIN32_FIND_DATA find;
+  bool first;
+#elif defined(PLATFORM_IS_LINUX)
+  int fd;
+  size_t pos;
+  size_t len;
+  char* buf;
+#elif defined(PLATFORM_IS_POSIX_BASED)
+  DIR* dir;
+  char* path;
+  size_t path_size;
+#endif
+} dir_reader_t;
+
 PONY_EXTERN_C_BEGIN
 
 const char* cwd;
@@ -150,4 +195,224 @@ const char* unix_readdir(DIR* dir)
 
 #endif
 
+static char* copy_name(const char* name, size_t len)
+{
+  char* cstring = (char*)pony_alloc(pony_ctx(), len + 1);
+  memcpy(cstring, name, len);
+  cstring[len] = '\0';
+  return cstring;
+}
+
+#if defined(PLATFORM_IS_POSIX_BASED)
+static uint8_t stat_kind(struct stat* st)
+{
+  if(S_ISREG(st->st_mode))
+    return DIR_ENTRY_FILE;
+
+  if(S_ISDIR(st->st_mode))
+    return DIR_ENTRY_DIRECTORY;
+
+  if(S_ISLNK(st->st_mode))
+    return DIR_ENTRY_SYMLINK;
+
+  return DIR_ENTRY_OTHER;
+}
+
+static uint8_t dirent_kind(unsigned char type)
+{
+  switch(type)
+  {
+    case DT_REG: return DIR_ENTRY_FILE;
+    case DT_DIR: return DIR_ENTRY_DIRECTORY;
+    case DT_LNK: return DIR_ENTRY_SYMLINK;
+    default: return DIR_ENTRY_OTHER;
+  }
+}
+#endif
+
+/**
+ * Starts reading the entries of a directory, given its file descriptor and
+ * path. The reader has its own position, so a directory can be read more than
+ * once. Returns NULL if the directory can't be read.
+ */
+dir_reader_t* os_dir_open(int fd, const char* path)
+{
+#if defined(PLATFORM_IS_WINDOWS)
+  (void)fd;
+  size_t len = strlen(path);
+  char* search = (char*)pool_alloc_size(len + 3);
+  memcpy(search, path, len);
+  memcpy(search + len, "\\*", 3);
+
+  dir_reader_t* r = POOL_ALLOC(dir_reader_t);
+  r->h = FindFirstFileA(search, &r->find);
+  r->first = true;
+  pool_free_size(len + 3, search);
+
+  if(r->h == INVALID_HANDLE_VALUE)
+  {
+    POOL_FREE(dir_reader_t, r);
+    return NULL;
+  }
+
+  return r;
+#elif defined(PLATFORM_IS_LINUX)
+  (void)path;
+  int dfd = openat(fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if(dfd == -1)
+    return NULL;
+
+  dir_reader_t* r = POOL_ALLOC(dir_reader_t);
+  r->fd = dfd;
+  r->pos = 0;
+  r->len = 0;
+  r->buf = (char*)pool_alloc_size(DIR_BUF_SIZE);
+  return r;
+#elif defined(PLATFORM_IS_POSIX_BASED)
+#if defined(PLATFORM_IS_FREEBSD)
+  (void)path;
+  DIR* dir = fdopendir(openat(fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+#else
+  (void)fd;
+  DIR* dir = opendir(path);
+#endif
+
+  if(dir == NULL)
+    return NULL;
+
+  dir_reader_t* r = POOL_ALLOC(dir_reader_t);
+  r->dir = dir;
+  r->path_size = strlen(path) + 1;
+  r->path = (char*)pool_alloc_size(r->path_size);
+  memcpy(r->path, path, r->path_size);
+  return r;
+#endif
+}
+
+/**
+ * Returns the name of the next entry, skipping "." and "..", or NULL once
+ * there are no more. The kind of entry is taken from the directory itself
+ * where the file system reports it, so that nothing needs to be statted.
+ * Otherwise the entry is statted without following a symlink.
+ */
+char* os_dir_next(dir_reader_t* r, uint8_t* kind)
+{
+#if defined(PLATFORM_IS_WINDOWS)
+  while(true)
+  {
+    if(!r->first && !FindNextFileA(r->h, &r->find))
+      return NULL;
+
+    r->first = false;
+    const char* name = r->find.cFileName;
+    size_t len = strlen(name);
+
+    if(skip_entry(name, len))
+      continue;
+
+    DWORD attrs = r->find.dwFileAttributes;
+
+    if((attrs & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+      *kind = DIR_ENTRY_SYMLINK;
+    else if((attrs & FILE_ATTRIBUTE_DIRECTORY) != 0)
+      *kind = DIR_ENTRY_DIRECTORY;
+    else
+      *kind = DIR_ENTRY_FILE;
+
+    return copy_name(name, len);
+  }
+#elif defined(PLATFORM_IS_LINUX)
+  while(true)
+  {
+    if(r->pos >= r->len)
+    {
+      long n = syscall(SYS_getdents64, r->fd, r->buf, DIR_BUF_SIZE);
+
+      if(n <= 0)
+        return NULL;
+
+      r->pos = 0;
+      r->len = (size_t)n;
+    }
+
+    struct linux_dirent64* d = (struct linux_dirent64*)(r->buf + r->pos);
+    r->pos += d->d_reclen;
+
+    size_t len = strlen(d->d_name);
+
+    if(skip_entry(d->d_name, len))
+      continue;
+
+    if(d->d_type == DT_UNKNOWN)
+    {
+      struct stat st;
+
+      if(fstatat(r->fd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+        *kind = stat_kind(&st);
+      else
+        *kind = DIR_ENTRY_OTHER;
+    } else {
+      *kind = dirent_kind(d->d_type);
+    }
+
+    return copy_name(d->d_name, len);
+  }
+#elif defined(PLATFORM_IS_POSIX_BASED)
+  struct dirent de;
+  struct dirent* d;
+
+  while(true)
+  {
+    if((readdir_r(r->dir, &de, &d) != 0) || (d == NULL))
+      return NULL;
+
+    size_t len = d->d_namlen;
+
+    if(skip_entry(d->d_name, len))
+      continue;
+
+    if(d->d_type == DT_UNKNOWN)
+    {
+      size_t size = r->path_size + len + 1;
+      char* full = (char*)pool_alloc_size(size);
+      memcpy(full, r->path, r->path_size - 1);
+      full[r->path_size - 1] = '/';
+      memcpy(full + r->path_size, d->d_name, len + 1);
+
+      struct stat st;
+
+      if(lstat(full, &st) == 0)
+        *kind = stat_kind(&st);
+      else
+        *kind = DIR_ENTRY_OTHER;
+
+      pool_free_size(size, full);
+    } else {
+      *kind = dirent_kind(d->d_type);
+    }
+
+    return copy_name(d->d_name, len);
+  }
+#endif
+}
+
+void os_dir_close(dir_reader_t* r)
+{
+  if(r == NULL)
+    return;
+
+#if defined(PLATFORM_IS_WINDOWS)
+  FindClose(r->h);
+#elif defined(PLATFORM_IS_LINUX)
+  close(r->fd);
+  pool_free_size(DIR_BUF_SIZE, r->buf);
+#elif defined(PLATFORM_IS_POSIX_BASED)
+  closedir(r->dir);
+  pool_free_size(r->path_size, r->path);
+#endif
+
+  POOL_FREE(dir_reader_t, r);
+}
+
 PONY_EXTERN_C_END
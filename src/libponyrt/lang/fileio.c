@@ -0,0 +1,290 @@
+#include <platform.h>
+#include <pony.h>
+
+#include "fileio.h"
+#include "blocking.h"
+#include "../asio/asio.h"
+#include "../asio/event.h"
+#include "../mem/pool.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef PLATFORM_IS_WINDOWS
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+// The most threads doing file operations at once. A file only ever has one
+// operation pending, so this is how many files can be blocked on at once
+// before the rest have to wait.
+#define FILE_THREADS 4
+
+enum
+{
+  FILE_OPEN,
+  FILE_READ,
+  FILE_WRITE,
+  FILE_SYNC,
+  FILE_CLOSE
+};
+
+typedef struct file_op_t
+{
+  blocking_job_t job;
+  asio_event_t* event;
+  uint32_t op;
+  int fd;
+  int flags;
+  char* buf;
+  uint64_t offset;
+  size_t len;
+  size_t path_size;
+} file_op_t;
+
+static blocking_pool_t pool;
+
+static int64_t file_open(const char* path, int flags)
+{
+#ifdef PLATFORM_IS_WINDOWS
+  return _open(path, flags | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+  return open(path, flags, 0666);
+#endif
+}
+
+static int64_t file_read(int fd, char* buf, uint64_t offset, size_t len)
+{
+  size_t done = 0;
+
+#ifdef PLATFORM_IS_WINDOWS
+  // A file has only one operation at a time, so seeking first is safe.
+  if(_lseeki64(fd, (int64_t)offset, SEEK_SET) < 0)
+    return -1;
+#endif
+
+  while(done < len)
+  {
+#ifdef PLATFORM_IS_WINDOWS
+    int n = _read(fd, buf + done, (unsigned int)(len - done));
+#else
+    ssize_t n = pread(fd, buf + done, len - done, (off_t)(offset + done));
+#endif
+
+    if(n == 0)
+      break;
+
+    if(n < 0)
+    {
+      if(errno == EINTR)
+        continue;
+
+      return -1;
+    }
+
+    done += (size_t)n;
+  }
+
+  return (int64_t)done;
+}
+
+static int64_t file_write(int fd, const char* buf, uint64_t offset,
+  size_t len)
+{
+  size_t done = 0;
+
+#ifdef PLATFORM_IS_WINDOWS
+  if(_lseeki64(fd, (int64_t)offset, SEEK_SET) < 0)
+    return -1;
+#endif
+
+  while(done < len)
+  {
+#ifdef PLATFORM_IS_WINDOWS
+    int n = _write(fd, buf + done, (unsigned int)(len - done));
+#else
+    ssize_t n = pwrite(fd, buf + done, len - done, (off_t)(offset + done));
+#endif
+
+    if(n < 0)
+    {
+      if(errno == EINTR)
+        continue;
+
+      return -1;
+    }
+
+    done += (size_t)n;
+  }
+
+  return (int64_t)done;
+}
+
+static void run_op(blocking_job_t* job)
+{
+  file_op_t* f = (file_op_t*)job;
+  int64_t result;
+
+  switch(f->op)
+  {
+    case FILE_OPEN:
+      result = file_open(f->buf, f->flags);
+      pool_free_size(f->path_size, f->buf);
+      break;
+
+    case FILE_READ:
+      result = file_read(f->fd, f->buf, f->offset, f->len);
+      break;
+
+    case FILE_WRITE:
+      result = file_write(f->fd, f->buf, f->offset, f->len);
+      break;
+
+    case FILE_SYNC:
+#ifdef PLATFORM_IS_WINDOWS
+      result = _commit(f->fd);
+#else
+      result = fsync(f->fd);
+#endif
+      break;
+
+    case FILE_CLOSE:
+#ifdef PLATFORM_IS_WINDOWS
+      result = _close(f->fd);
+#else
+      result = close(f->fd);
+#endif
+      break;
+
+    default:
+      result = -1;
+  }
+
+  // As a lookup keeps its answer there, an operation keeps its result in
+  // nsec: a file descriptor, a byte count, or -1 on an error.
+  asio_event_t* ev = f->event;
+  ev->nsec = (uint64_t)result;
+  ev->flags = ASIO_DISPOSABLE;
+  ev->noisy = false;
+  POOL_FREE(file_op_t, f);
+
+  asio_event_send(ev, ASIO_READ, 0);
+  asio_noisy_remove();
+}
+
+static file_op_t* make_op(uint32_t op, int fd, char* buf, uint64_t offset,
+  size_t len)
+{
+  file_op_t* f = POOL_ALLOC(file_op_t);
+  memset(f, 0, sizeof(file_op_t));
+  f->job.fn = run_op;
+  f->op = op;
+  f->fd = fd;
+  f->buf = buf;
+  f->offset = offset;
+  f->len = len;
+  return f;
+}
+
+static asio_event_t* submit(pony_actor_t* owner, file_op_t* f)
+{
+  asio_event_t* ev = asio_event_alloc(owner, -1, ASIO_READ, 0, true);
+
+  if(ev == NULL)
+  {
+    if(f->op == FILE_OPEN)
+      pool_free_size(f->path_size, f->buf);
+
+    POOL_FREE(file_op_t, f);
+    return NULL;
+  }
+
+  f->event = ev;
+
+  // A pending operation keeps the program running until its owner hears
+  // back.
+  asio_noisy_add();
+  blocking_run(&pool, &f->job);
+  return ev;
+}
+
+/**
+ * Opens a file for reading, or for reading and writing, creating it if it
+ * doesn't exist and create is set. The result is the file descriptor.
+ */
+asio_event_t* os_file_open(pony_actor_t* owner, const char* path,
+  bool writeable, bool create)
+{
+  size_t size = strlen(path) + 1;
+  char* copy = (char*)pool_alloc_size(size);
+  memcpy(copy, path, size);
+
+  file_op_t* f = make_op(FILE_OPEN, -1, copy, 0, 0);
+  f->path_size = size;
+  f->flags = writeable ? O_RDWR : O_RDONLY;
+
+  if(writeable && create)
+    f->flags |= O_CREAT;
+
+  return submit(owner, f);
+}
+
+/**
+ * Reads up to len bytes at offset into buf, which the owner must keep alive
+ * and leave alone until it hears back. The result is the number of bytes
+ * read, which is short at the end of the file.
+ */
+asio_event_t* os_file_read(pony_actor_t* owner, int fd, char* buf,
+  uint64_t offset, size_t len)
+{
+  return submit(owner, make_op(FILE_READ, fd, buf, offset, len));
+}
+
+/**
+ * Writes len bytes from buf at offset, which the owner must keep alive until
+ * it hears back. The result is the number of bytes written.
+ */
+asio_event_t* os_file_write(pony_actor_t* owner, int fd, const char* buf,
+  uint64_t offset, size_t len)
+{
+  return submit(owner, make_op(FILE_WRITE, fd, (char*)buf, offset, len));
+}
+
+/**
+ * Waits for everything written to the file to reach the disk.
+ */
+asio_event_t* os_file_sync(pony_actor_t* owner, int fd)
+{
+  return submit(owner, make_op(FILE_SYNC, fd, NULL, 0, 0));
+}
+
+/**
+ * Closes the file.
+ */
+asio_event_t* os_file_close(pony_actor_t* owner, int fd)
+{
+  return submit(owner, make_op(FILE_CLOSE, fd, NULL, 0, 0));
+}
+
+/**
+ * The result of an operation, once the owner has been sent its event.
+ */
+int64_t os_file_result(asio_event_t* ev)
+{
+  if((ev == NULL) || (ev->flags != ASIO_DISPOSABLE))
+    return -1;
+
+  return (int64_t)ev->nsec;
+}
+
+void os_file_init()
+{
+  blocking_init(&pool, FILE_THREADS);
+}
+
+void os_file_shutdown()
+{
+  blocking_shutdown(&pool);
+}
@@ -0,0 +1,22 @@
+#ifndef lang_fileio_h
+#define lang_fileio_h
+
+#include <platform.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * Gets ready to take file operations. The threads that do them are only
+ * started once operations are queued.
+ */
+void os_file_init();
+
+/**
+ * Stops and joins the file threads. Must only be called once no operation is
+ * pending, which quiescence ensures, since pending operations are noisy.
+ */
+void os_file_shutdown();
+
+PONY_EXTERN_C_END
+
+#endif
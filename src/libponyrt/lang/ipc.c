@@ -0,0 +1,562 @@
+#include <platform.h>
+#include <pony.h>
+
+#include "../mem/pool.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef PLATFORM_IS_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+PONY_EXTERN_C_BEGIN
+
+#define IPC_MAGIC 0x3163704979666F50 // "PonyIpc1"
+#define IPC_NAME_MAX 64
+#define IPC_PATH_MAX 96
+#define IPC_MIN_SIZE 4096
+#define IPC_MAX_SIZE ((size_t)1 << 30)
+
+// A record in the ring is a length followed by the message, padded to 8
+// bytes. A record never wraps: if it doesn't fit before the end of the ring,
+// a skip marker fills the rest and the record starts at the beginning.
+#define IPC_SKIP UINT32_MAX
+
+// The header of a channel's shared memory. The consumer's and the producer's
+// positions are on separate cache lines, so that each side only writes to its
+// own.
+typedef struct ipc_header_t
+{
+  uint64_t magic;
+  uint64_t size;
+  char pad1[48];
+
+  uint64_t volatile head;
+  uint32_t volatile reader_waiting;
+  uint32_t volatile closed;
+  char pad2[48];
+
+  uint64_t volatile tail;
+  uint32_t volatile writer_waiting;
+  char pad3[52];
+} ipc_header_t;
+
+typedef struct pony_ipc_t
+{
+  ipc_header_t* header;
+  char* data;
+  size_t map_size;
+
+  // The doorbells are FIFOs. A side that waits is told it can carry on by a
+  // byte written to its own FIFO, which it has subscribed an ASIO event to.
+  // The bell of the other side is rung only if it said it was waiting.
+  int wait_fd;
+  int ring_fd;
+
+  bool reader;
+  char name[IPC_NAME_MAX + 1];
+} pony_ipc_t;
+
+void pony_ipc_close(pony_ipc_t* ipc);
+
+#ifndef PLATFORM_IS_WINDOWS
+
+static bool valid_name(const char* name)
+{
+  size_t len = strlen(name);
+
+  if((len == 0) || (len > IPC_NAME_MAX) || (name[0] == '.'))
+    return false;
+
+  for(size_t i = 0; i < len; i++)
+  {
+    char c = name[i];
+
+    if(!(((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+      ((c >= '0') && (c <= '9')) || (c == '-') || (c == '_') || (c == '.')))
+      return false;
+  }
+
+  return true;
+}
+
+static void shm_path(char* buf, const char* name)
+{
+  snprintf(buf, IPC_PATH_MAX, "/pony-ipc-%s", name);
+}
+
+static void bell_path(char* buf, const char* name, bool reader)
+{
+  snprintf(buf, IPC_PATH_MAX, "/tmp/pony-ipc-%s.%c", name,
+    reader ? 'r' : 'w');
+}
+
+static int open_bell(const char* name, bool reader, bool own)
+{
+  char path[IPC_PATH_MAX];
+  bell_path(path, name, reader);
+
+  // A FIFO opened for both reading and writing never sees its end when the
+  // other side goes away, and can be opened before the other side has.
+  int fd = open(path, (own ? O_RDWR : O_WRONLY) | O_NONBLOCK | O_CLOEXEC);
+
+  if(fd == -1)
+    return -1;
+
+  return fd;
+}
+
+static void ring_bell(int fd)
+{
+  char c = 0;
+
+  // A full FIFO already holds a wake up, so a failed write is fine.
+  ssize_t r = write(fd, &c, 1);
+  (void)r;
+}
+
+static void drain_bell(int fd)
+{
+  char buf[64];
+
+  while(read(fd, buf, sizeof(buf)) > 0) {}
+}
+
+static void unlink_all(const char* name)
+{
+  char path[IPC_PATH_MAX];
+
+  shm_path(path, name);
+  shm_unlink(path);
+
+  bell_path(path, name, true);
+  unlink(path);
+
+  bell_path(path, name, false);
+  unlink(path);
+}
+
+static pony_ipc_t* ipc_map(const char* name, int fd, size_t map_size,
+  bool reader)
+{
+  void* p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(p == MAP_FAILED)
+    return NULL;
+
+  pony_ipc_t* ipc = POOL_ALLOC(pony_ipc_t);
+  memset(ipc, 0, sizeof(pony_ipc_t));
+  ipc->header = (ipc_header_t*)p;
+  ipc->data = (char*)p + sizeof(ipc_header_t);
+  ipc->map_size = map_size;
+  ipc->wait_fd = -1;
+  ipc->ring_fd = -1;
+  ipc->reader = reader;
+  strcpy(ipc->name, name);
+  return ipc;
+}
+
+static size_t record_size(size_t len)
+{
+  return (sizeof(uint64_t) + len + 7) & ~(size_t)7;
+}
+
+/**
+ * Creates a channel that one other process can write messages into, with
+ * room for size bytes of messages, rounded up to a power of 2. A stale
+ * channel of the same name, left by a process that died, is replaced. Returns
+ * NULL if the channel can't be created.
+ */
+pony_ipc_t* pony_ipc_create(const char* name, size_t size)
+{
+  if(!valid_name(name) || (size > IPC_MAX_SIZE))
+    return NULL;
+
+  size_t ring = IPC_MIN_SIZE;
+
+  while(ring < size)
+    ring <<= 1;
+
+  unlink_all(name);
+
+  char path[IPC_PATH_MAX];
+  shm_path(path, name);
+  int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+  if(fd == -1)
+    return NULL;
+
+  size_t map_size = sizeof(ipc_header_t) + ring;
+
+  if(ftruncate(fd, (off_t)map_size) != 0)
+  {
+    close(fd);
+    shm_unlink(path);
+    return NULL;
+  }
+
+  pony_ipc_t* ipc = ipc_map(name, fd, map_size, true);
+
+  if(ipc == NULL)
+  {
+    shm_unlink(path);
+    return NULL;
+  }
+
+  bell_path(path, name, true);
+  bool ok = mkfifo(path, 0600) == 0;
+  bell_path(path, name, false);
+  ok = ok && (mkfifo(path, 0600) == 0);
+
+  if(ok)
+  {
+    ipc->wait_fd = open_bell(name, true, true);
+    ipc->ring_fd = open_bell(name, false, true);
+  }
+
+  if((ipc->wait_fd == -1) || (ipc->ring_fd == -1))
+  {
+    pony_ipc_close(ipc);
+    return NULL;
+  }
+
+  // The magic is written last, so that a writer never sees a channel that
+  // isn't ready.
+  ipc->header->size = ring;
+  _atomic_store(&ipc->header->magic, IPC_MAGIC);
+  return ipc;
+}
+
+/**
+ * Opens a channel created by another process, to write messages into it.
+ * Only one writer may use a channel at a time. Returns NULL if there is no
+ * such channel.
+ */
+pony_ipc_t* pony_ipc_open(const char* name)
+{
+  if(!valid_name(name))
+    return NULL;
+
+  char path[IPC_PATH_MAX];
+  shm_path(path, name);
+  int fd = shm_open(path, O_RDWR, 0600);
+
+  if(fd == -1)
+    return NULL;
+
+  struct stat st;
+
+  if((fstat(fd, &st) != 0) ||
+    ((size_t)st.st_size < (sizeof(ipc_header_t) + IPC_MIN_SIZE)))
+  {
+    close(fd);
+    return NULL;
+  }
+
+  size_t map_size = (size_t)st.st_size;
+  pony_ipc_t* ipc = ipc_map(name, fd, map_size, false);
+
+  if(ipc == NULL)
+    return NULL;
+
+  if((_atomic_load(&ipc->header->magic) != IPC_MAGIC) ||
+    ((ipc->header->size + sizeof(ipc_header_t)) != map_size))
+  {
+    pony_ipc_close(ipc);
+    return NULL;
+  }
+
+  ipc->wait_fd = open_bell(name, false, true);
+  ipc->ring_fd = open_bell(name, true, false);
+
+  if((ipc->wait_fd == -1) || (ipc->ring_fd == -1))
+  {
+    pony_ipc_close(ipc);
+    return NULL;
+  }
+
+  return ipc;
+}
+
+/**
+ * The FIFO to subscribe an ASIO read event to, which is readable when the
+ * other side has rung after pony_ipc_wait() returned true.
+ */
+int pony_ipc_fd(pony_ipc_t* ipc)
+{
+  return ipc->wait_fd;
+}
+
+/**
+ * The largest message that fits in the channel.
+ */
+size_t pony_ipc_max(pony_ipc_t* ipc)
+{
+  return (size_t)(ipc->header->size / 2) - sizeof(uint64_t);
+}
+
+/**
+ * Writes a message. Returns false if there isn't room for it yet, in which
+ * case the writer should call pony_ipc_wait() and try again when woken.
+ */
+bool pony_ipc_write(pony_ipc_t* ipc, const void* data, size_t len)
+{
+  ipc_header_t* h = ipc->header;
+
+  if(len > pony_ipc_max(ipc))
+    return false;
+
+  size_t size = (size_t)h->size;
+  uint64_t head = h->head;
+  uint64_t tail = _atomic_load(&h->tail);
+  size_t pos = (size_t)(head & (size - 1));
+  size_t need = record_size(len);
+  size_t skip = ((size - pos) < need) ? (size - pos) : 0;
+
+  if((need + skip) > (size - (size_t)(head - tail)))
+    return false;
+
+  if(skip > 0)
+  {
+    *(uint64_t*)(ipc->data + pos) = IPC_SKIP;
+    pos = 0;
+  }
+
+  *(uint64_t*)(ipc->data + pos) = len;
+  memcpy(ipc->data + pos + sizeof(uint64_t), data, len);
+
+  // Publishes the record, and is seen by a reader that says it is waiting
+  // and then checks the ring again.
+  _atomic_store(&h->head, head + skip + need);
+  _atomic_fence();
+
+  uint32_t waiting = 1;
+
+  if((_atomic_load(&h->reader_waiting) == 1) &&
+    _atomic_cas(&h->reader_waiting, &waiting, 0))
+    ring_bell(ipc->ring_fd);
+
+  return true;
+}
+
+static char* next_record(pony_ipc_t* ipc)
+{
+  ipc_header_t* h = ipc->header;
+  size_t size = (size_t)h->size;
+  uint64_t head = _atomic_load(&h->head);
+  uint64_t tail = h->tail;
+
+  if(head == tail)
+    return NULL;
+
+  size_t pos = (size_t)(tail & (size - 1));
+  uint64_t len = *(uint64_t*)(ipc->data + pos);
+
+  if(len == IPC_SKIP)
+  {
+    tail += size - pos;
+    _atomic_store(&h->tail, tail);
+
+    if(head == tail)
+      return NULL;
+
+    pos = 0;
+  }
+
+  return ipc->data + pos;
+}
+
+/**
+ * The length of the next message, or SIZE_MAX if there isn't one.
+ */
+size_t pony_ipc_next(pony_ipc_t* ipc)
+{
+  char* record = next_record(ipc);
+
+  if(record == NULL)
+    return SIZE_MAX;
+
+  uint64_t len = *(uint64_t*)record;
+  size_t room = (size_t)ipc->header->size - (size_t)(record - ipc->data);
+
+  // A length that runs past the end of the ring can only come from a
+  // misbehaving writer, so the channel is treated as closed.
+  if(len > (room - sizeof(uint64_t)))
+  {
+    _atomic_store(&ipc->header->closed, 1);
+    return SIZE_MAX;
+  }
+
+  return (size_t)len;
+}
+
+/**
+ * Copies the next message, whose length pony_ipc_next() returned, into buf
+ * and makes room for the writer.
+ */
+void pony_ipc_read(pony_ipc_t* ipc, void* buf)
+{
+  ipc_header_t* h = ipc->header;
+  char* record = next_record(ipc);
+  size_t len = (size_t)*(uint64_t*)record;
+  memcpy(buf, record + sizeof(uint64_t), len);
+
+  // Any skip marker before the record has been stepped over already.
+  uint64_t tail = h->tail + record_size(len);
+
+  // As with a write, wake a writer that is waiting for room.
+  _atomic_store(&h->tail, tail);
+  _atomic_fence();
+
+  uint32_t waiting = 1;
+
+  if((_atomic_load(&h->writer_waiting) == 1) &&
+    _atomic_cas(&h->writer_waiting, &waiting, 0))
+    ring_bell(ipc->ring_fd);
+}
+
+/**
+ * Asks to be woken when the other side has done something: for a reader,
+ * written a message or closed the channel, and for a writer, made room.
+ * Returns false if that happened already, in which case the caller should
+ * carry on rather than wait.
+ */
+bool pony_ipc_wait(pony_ipc_t* ipc)
+{
+  ipc_header_t* h = ipc->header;
+  uint32_t volatile* waiting = ipc->reader ?
+    &h->reader_waiting : &h->writer_waiting;
+
+  drain_bell(ipc->wait_fd);
+  _atomic_store(waiting, 1);
+
+  // Seen by the other side, which moves its position and then checks
+  // whether this side is waiting.
+  _atomic_fence();
+
+  bool ready;
+
+  if(ipc->reader)
+    ready = (_atomic_load(&h->head) != h->tail) ||
+      (_atomic_load(&h->closed) != 0);
+  else
+    ready = (_atomic_load(&h->tail) != h->head);
+
+  if(!ready)
+    return true;
+
+  // If the other side got to it first, the bell has been rung.
+  uint32_t expect = 1;
+  return !_atomic_cas(waiting, &expect, 0);
+}
+
+/**
+ * Whether the writer has closed the channel. Messages it wrote before closing
+ * can still be read.
+ */
+bool pony_ipc_closed(pony_ipc_t* ipc)
+{
+  return _atomic_load(&ipc->header->closed) != 0;
+}
+
+/**
+ * Closes one side of the channel. The reader removes the channel, and a
+ * writer tells the reader it has gone.
+ */
+void pony_ipc_close(pony_ipc_t* ipc)
+{
+  if(ipc == NULL)
+    return;
+
+  if(!ipc->reader && (ipc->ring_fd != -1))
+  {
+    _atomic_store(&ipc->header->closed, 1);
+    _atomic_fence();
+    ring_bell(ipc->ring_fd);
+  }
+
+  if(ipc->wait_fd != -1)
+    close(ipc->wait_fd);
+
+  if(ipc->ring_fd != -1)
+    close(ipc->ring_fd);
+
+  munmap(ipc->header, ipc->map_size);
+
+  if(ipc->reader)
+    unlink_all(ipc->name);
+
+  POOL_FREE(pony_ipc_t, ipc);
+}
+
+#else
+
+pony_ipc_t* pony_ipc_create(const char* name, size_t size)
+{
+  (void)name;
+  (void)size;
+  return NULL;
+}
+
+pony_ipc_t* pony_ipc_open(const char* name)
+{
+  (void)name;
+  return NULL;
+}
+
+int pony_ipc_fd(pony_ipc_t* ipc)
+{
+  (void)ipc;
+  return -1;
+}
+
+size_t pony_ipc_max(pony_ipc_t* ipc)
+{
+  (void)ipc;
+  return 0;
+}
+
+bool pony_ipc_write(pony_ipc_t* ipc, const void* data, size_t len)
+{
+  (void)ipc;
+  (void)data;
+  (void)len;
+  return false;
+}
+
+size_t pony_ipc_next(pony_ipc_t* ipc)
+{
+  (void)ipc;
+  return SIZE_MAX;
+}
+
+void pony_ipc_read(pony_ipc_t* ipc, void* buf)
+{
+  (void)ipc;
+  (void)buf;
+}
+
+bool pony_ipc_wait(pony_ipc_t* ipc)
+{
+  (void)ipc;
+  return true;
+}
+
+bool pony_ipc_closed(pony_ipc_t* ipc)
+{
+  (void)ipc;
+  return true;
+}
+
+void pony_ipc_close(pony_ipc_t* ipc)
+{
+  (void)ipc;
+}
+
+#endif
+
+PONY_EXTERN_C_END
@@ -0,0 +1,67 @@
+#include <platform.h>
+#include <pony.h>
+#include <stdio.h>
+#include <string.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * Fills a block for FileLines. The part of the last block from offset to size
+ * holds the start of a line that didn't fit, so it is copied to the start of
+ * the new block, and the rest of the space is read from the file. Returns the
+ * number of bytes in the new block.
+ */
+size_t os_line_fill(FILE* fp, char* to, size_t space, const char* from,
+  size_t offset, size_t size)
+{
+  size_t carry = size - offset;
+
+  if(carry > 0)
+    memcpy(to, from + offset, carry);
+
+#if defined(PLATFORM_IS_LINUX)
+  return carry + fread_unlocked(to + carry, 1, space - carry, fp);
+#else
+  return carry + fread(to + carry, 1, space - carry, fp);
+#endif
+}
+
+/**
+ * Finds the line that starts at offset in a block of size bytes. The newline,
+ * or the carriage return before it, is overwritten with a NUL, so that the
+ * line can be used as a string where it is. Returns the line, with its length
+ * in len and the offset of the next line in offset. At the end of the file, a
+ * last line without a newline is terminated in the spare byte after the
+ * block. Otherwise, returns NULL if there is no complete line.
+ */
+char* os_line(char* block, size_t* offset, size_t size, bool eof, size_t* len)
+{
+  size_t start = *offset;
+
+  if(start >= size)
+    return NULL;
+
+  char* line = block + start;
+  char* nl = (char*)memchr(line, '\n', size - start);
+  size_t n;
+
+  if(nl != NULL)
+  {
+    n = (size_t)(nl - line);
+    *offset = start + n + 1;
+  } else if(eof) {
+    n = size - start;
+    *offset = size;
+  } else {
+    return NULL;
+  }
+
+  if((n > 0) && (line[n - 1] == '\r'))
+    n--;
+
+  line[n] = '\0';
+  *len = n;
+  return line;
+}
+
+PONY_EXTERN_C_END
@@ -0,0 +1,144 @@
+#include <platform.h>
+#include <pony.h>
+#include <stdint.h>
+
+#ifdef PLATFORM_IS_WINDOWS
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+PONY_EXTERN_C_BEGIN
+
+// The advice MappedFile passes to os_madvise().
+enum
+{
+  MAP_ADVICE_NORMAL,
+  MAP_ADVICE_SEQUENTIAL,
+  MAP_ADVICE_RANDOM,
+  MAP_ADVICE_WILLNEED,
+  MAP_ADVICE_DONTNEED
+};
+
+static size_t page_size()
+{
+#ifdef PLATFORM_IS_WINDOWS
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwPageSize;
+#else
+  return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+/**
+ * Maps len bytes of an open file. A shared mapping writes changes back to the
+ * file. A private one can also be written to, but the changes are copied and
+ * never reach the file, so that a mapping opened for reading can't fault on a
+ * write. Returns NULL if the file can't be mapped.
+ */
+void* os_mmap(int fd, size_t len, bool shared)
+{
+  if(len == 0)
+    return NULL;
+
+#ifdef PLATFORM_IS_WINDOWS
+  HANDLE file = (HANDLE)_get_osfhandle(fd);
+
+  if(file == INVALID_HANDLE_VALUE)
+    return NULL;
+
+  uint64_t size = (uint64_t)len;
+  HANDLE mapping = CreateFileMapping(file, NULL,
+    shared ? PAGE_READWRITE : PAGE_WRITECOPY, (DWORD)(size >> 32),
+    (DWORD)size, NULL);
+
+  if(mapping == NULL)
+    return NULL;
+
+  // The view keeps the mapping open once its handle is closed.
+  void* p = MapViewOfFile(mapping, shared ? FILE_MAP_WRITE : FILE_MAP_COPY,
+    0, 0, len);
+  CloseHandle(mapping);
+  return p;
+#else
+  void* p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+    shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+
+  if(p == MAP_FAILED)
+    return NULL;
+
+  return p;
+#endif
+}
+
+bool os_munmap(void* p, size_t len)
+{
+  if(p == NULL)
+    return true;
+
+#ifdef PLATFORM_IS_WINDOWS
+  (void)len;
+  return UnmapViewOfFile(p) != 0;
+#else
+  return munmap(p, len) == 0;
+#endif
+}
+
+/**
+ * Writes changes in a shared mapping back to the file, and waits for them to
+ * reach it.
+ */
+bool os_msync(void* p, size_t len)
+{
+  if(p == NULL)
+    return true;
+
+#ifdef PLATFORM_IS_WINDOWS
+  return FlushViewOfFile(p, len) != 0;
+#else
+  return msync(p, len, MS_SYNC) == 0;
+#endif
+}
+
+/**
+ * Tells the OS how a range of a mapping will be used. The range is widened to
+ * whole pages. Only a hint: returns false if the OS doesn't take it.
+ */
+bool os_madvise(void* p, size_t size, size_t offset, size_t len,
+  uint32_t advice)
+{
+  if((p == NULL) || (offset >= size))
+    return false;
+
+  if(len > (size - offset))
+    len = size - offset;
+
+  size_t mask = page_size() - 1;
+  uintptr_t start = ((uintptr_t)p + offset) & ~(uintptr_t)mask;
+  len += ((uintptr_t)p + offset) - start;
+
+#ifdef PLATFORM_IS_WINDOWS
+  (void)start;
+  (void)len;
+  (void)advice;
+  return false;
+#else
+  int flag;
+
+  switch(advice)
+  {
+    case MAP_ADVICE_NORMAL: flag = MADV_NORMAL; break;
+    case MAP_ADVICE_SEQUENTIAL: flag = MADV_SEQUENTIAL; break;
+    case MAP_ADVICE_RANDOM: flag = MADV_RANDOM; break;
+    case MAP_ADVICE_WILLNEED: flag = MADV_WILLNEED; break;
+    case MAP_ADVICE_DONTNEED: flag = MADV_DONTNEED; break;
+    default: return false;
+  }
+
+  return madvise((void*)start, len, flag) == 0;
+#endif
+}
+
+PONY_EXTERN_C_END
@@ -0,0 +1,129 @@
+#include <platform.h>
+
+#include "socket.h"
+#include "blocking.h"
+#include "../asio/asio.h"
+#include "../asio/event.h"
+#include "../mem/pool.h"
+#include <string.h>
+
+#ifdef PLATFORM_IS_WINDOWS
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#endif
+
+// The most threads doing lookups at once.
+#define RESOLVE_THREADS 4
+
+typedef struct resolve_t
+{
+  blocking_job_t job;
+  asio_event_t* event;
+  int family;
+  int socktype;
+  int proto;
+  char* host;
+  char* service;
+  size_t host_size;
+  size_t service_size;
+} resolve_t;
+
+static blocking_pool_t pool;
+
+static char* copy_string(const char* s, size_t* size)
+{
+  *size = strlen(s) + 1;
+  char* copy = (char*)pool_alloc_size(*size);
+  memcpy(copy, s, *size);
+  return copy;
+}
+
+static void run_query(blocking_job_t* job)
+{
+  resolve_t* r = (resolve_t*)job;
+
+  // Plain lookups are passive, as they are for os_addrinfo().
+  struct addrinfo* result = os_addrinfo_intern(r->family, r->socktype,
+    r->proto, r->host, r->service, r->socktype == 0);
+
+  // As signals keep their number there, a lookup keeps its result in nsec.
+  asio_event_t* ev = r->event;
+  ev->nsec = (uint64_t)(uintptr_t)result;
+  ev->flags = ASIO_DISPOSABLE;
+  ev->noisy = false;
+
+  pool_free_size(r->host_size, r->host);
+  pool_free_size(r->service_size, r->service);
+  POOL_FREE(resolve_t, r);
+
+  asio_event_send(ev, ASIO_READ, 0);
+  asio_noisy_remove();
+}
+
+static asio_event_t* resolve(pony_actor_t* owner, int family, int socktype,
+  int proto, const char* host, const char* service)
+{
+  switch(family)
+  {
+    case 0: family = AF_UNSPEC; break;
+    case 1: family = AF_INET; break;
+    case 2: family = AF_INET6; break;
+    default: return NULL;
+  }
+
+  asio_event_t* ev = asio_event_alloc(owner, -1, ASIO_READ, 0, true);
+
+  if(ev == NULL)
+    return NULL;
+
+  resolve_t* r = POOL_ALLOC(resolve_t);
+  r->job.fn = run_query;
+  r->event = ev;
+  r->family = family;
+  r->socktype = socktype;
+  r->proto = proto;
+  r->host = copy_string(host, &r->host_size);
+  r->service = copy_string(service, &r->service_size);
+
+  // A pending lookup keeps the program running until its owner hears back.
+  asio_noisy_add();
+  blocking_run(&pool, &r->job);
+  return ev;
+}
+
+asio_event_t* os_resolve(pony_actor_t* owner, int family,
+  const char* host, const char* service)
+{
+  return resolve(owner, family, 0, 0, host, service);
+}
+
+asio_event_t* os_resolve_tcp(pony_actor_t* owner, int family,
+  const char* host, const char* service)
+{
+  return resolve(owner, family, SOCK_STREAM, IPPROTO_TCP, host, service);
+}
+
+struct addrinfo* os_resolved(asio_event_t* ev)
+{
+  if((ev == NULL) || (ev->flags != ASIO_DISPOSABLE))
+    return NULL;
+
+  struct addrinfo* result = (struct addrinfo*)(uintptr_t)ev->nsec;
+  ev->nsec = 0;
+  return result;
+}
+
+void os_resolve_init()
+{
+  blocking_init(&pool, RESOLVE_THREADS);
+}
+
+void os_resolve_shutdown()
+{
+  blocking_shutdown(&pool);
+}
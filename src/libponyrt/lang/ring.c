@@ -0,0 +1,197 @@
+#include <platform.h>
+#include <pony.h>
+
+#include "../sched/ringq.h"
+#include "../asio/asio.h"
+#include "../asio/event.h"
+#include "../mem/pool.h"
+#include <string.h>
+
+PONY_EXTERN_C_BEGIN
+
+// Whether the owner needs to be told about new words. Only one producer gets
+// to tell it, by moving from armed to sending, and closing waits for a send in
+// progress, so the owner is never sent a message once it has let go of the
+// ring.
+enum
+{
+  RING_IDLE,
+  RING_ARMED,
+  RING_SENDING,
+  RING_CLOSED
+};
+
+struct pony_ring_t
+{
+  ringq_t q;
+  pony_actor_t* owner;
+  uint32_t msg_id;
+  uint32_t volatile state;
+  uint32_t volatile refs;
+  bool noisy;
+};
+
+static void ring_release(pony_ring_t* ring)
+{
+  // The consumer and the producers each hold the ring until they let go.
+  if(_atomic_add(&ring->refs, (uint32_t)-1) != 1)
+    return;
+
+  _atomic_fence();
+  ringq_destroy(&ring->q);
+  POOL_FREE(pony_ring_t, ring);
+}
+
+static void ring_notify(pony_ring_t* ring)
+{
+  // Seen by a consumer that arms the ring and then checks it for words.
+  _atomic_fence();
+
+  uint32_t state = RING_ARMED;
+
+  if((_atomic_load(&ring->state) != RING_ARMED) ||
+    !_atomic_cas(&ring->state, &state, RING_SENDING))
+    return;
+
+  // A foreign thread needs a context to send with.
+  pony_register_thread();
+
+  asio_msg_t* m = (asio_msg_t*)pony_alloc_msg(
+    POOL_INDEX(sizeof(asio_msg_t)), ring->msg_id);
+  m->event = NULL;
+  m->flags = ASIO_READ;
+  m->arg = 0;
+  pony_sendv(pony_ctx(), ring->owner, &m->msg);
+
+  _atomic_store(&ring->state, RING_IDLE);
+}
+
+/**
+ * Creates a ring with room for size words, rounded up to a power of 2. If
+ * multi is false, only one foreign thread may push at a time.
+ */
+pony_ring_t* pony_ring_create(size_t size, bool multi)
+{
+  pony_ring_t* ring = POOL_ALLOC(pony_ring_t);
+  memset(ring, 0, sizeof(pony_ring_t));
+  ringq_init(&ring->q, size, multi);
+  ring->state = RING_IDLE;
+  ring->refs = 2;
+  return ring;
+}
+
+/**
+ * Makes an actor the consumer. Its _event_notify behaviour is sent a message
+ * when words arrive while it is waiting for them. If noisy is set, the
+ * program keeps running until the ring is closed.
+ */
+bool pony_ring_start(pony_ring_t* ring, pony_actor_t* owner, bool noisy)
+{
+  pony_type_t* type = *(pony_type_t**)owner;
+
+  if((ring->owner != NULL) || (type->event_notify == (uint32_t)-1))
+    return false;
+
+  ring->owner = owner;
+  ring->msg_id = type->event_notify;
+  ring->noisy = noisy;
+
+  // As with an event, the owner is effectively sent to other threads.
+  pony_ctx_t* ctx = pony_ctx();
+  pony_gc_send(ctx);
+  pony_traceactor(ctx, owner);
+  pony_send_done(ctx);
+
+  if(noisy)
+    asio_noisy_add();
+
+  return true;
+}
+
+/**
+ * Pops up to max words into buf, returning how many were popped. Only the
+ * owner may call this.
+ */
+size_t pony_ring_pop(pony_ring_t* ring, uintptr_t* buf, size_t max)
+{
+  return ringq_pop_batch(&ring->q, buf, max);
+}
+
+/**
+ * Asks for a message when words arrive. Returns false if words arrived
+ * already, in which case the owner should pop them rather than wait.
+ */
+bool pony_ring_wait(pony_ring_t* ring)
+{
+  uint32_t state = RING_IDLE;
+
+  // Already armed, or a message is on the way.
+  if(!_atomic_cas(&ring->state, &state, RING_ARMED))
+    return true;
+
+  // Seen by a producer that pushes and then checks whether the ring is armed.
+  _atomic_fence();
+
+  if(ringq_empty(&ring->q))
+    return true;
+
+  // If a producer got to it first, its message is on the way.
+  state = RING_ARMED;
+  return !_atomic_cas(&ring->state, &state, RING_IDLE);
+}
+
+/**
+ * Stops the owner hearing about the ring, and lets go of it. Words still in
+ * the ring are dropped. Pushes fail from then on.
+ */
+void pony_ring_close(pony_ring_t* ring)
+{
+  uint32_t state = _atomic_load(&ring->state);
+
+  for(;;)
+  {
+    if(state == RING_SENDING)
+      state = _atomic_load(&ring->state);
+    else if(_atomic_cas(&ring->state, &state, RING_CLOSED))
+      break;
+  }
+
+  if(ring->owner != NULL)
+  {
+    pony_ctx_t* ctx = pony_ctx();
+    pony_gc_recv(ctx);
+    pony_traceactor(ctx, ring->owner);
+    pony_recv_done(ctx);
+
+    if(ring->noisy)
+      asio_noisy_remove();
+  }
+
+  ring_release(ring);
+}
+
+bool pony_ring_push(pony_ring_t* ring, uintptr_t data)
+{
+  return pony_ring_push_batch(ring, &data, 1) == 1;
+}
+
+size_t pony_ring_push_batch(pony_ring_t* ring, const uintptr_t* data,
+  size_t count)
+{
+  if(_atomic_load(&ring->state) == RING_CLOSED)
+    return 0;
+
+  size_t n = ringq_push_batch(&ring->q, data, count);
+
+  if(n > 0)
+    ring_notify(ring);
+
+  return n;
+}
+
+void pony_ring_release(pony_ring_t* ring)
+{
+  ring_release(ring);
+}
+
+PONY_EXTERN_C_END
@@ -4,6 +4,7 @@
 #include <platform.h>
 
 #include "lang.h"
+#include "socket.h"
 #include "../asio/asio.h"
 #include "../asio/event.h"
 #include <stdbool.h>
@@ -19,9 +20,12 @@
 #include <ws2tcpip.h>
 #include <mstcpip.h>
 #include <mswsock.h>
+#include <io.h>
 #else
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -31,10 +35,40 @@
 typedef int SOCKET;
 #endif
 
+#if defined(PLATFORM_IS_LINUX)
+#include <sys/sendfile.h>
+#  if defined(__has_include)
+#    if __has_include(<linux/tls.h>)
+#      include <linux/tls.h>
+#    endif
+#  endif
+#endif
+
+#if defined(TLS_TX) && !defined(SOL_TLS)
+#define SOL_TLS 282
+#endif
+
+#if defined(TLS_TX) && !defined(TCP_ULP)
+#define TCP_ULP 31
+#endif
+
 #if !defined(PLATFORM_IS_LINUX) && !defined(PLATFORM_IS_FREEBSD)
 #define MSG_NOSIGNAL 0
 #endif
 
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// The most datagrams read or written by one call to os_recvmmsg() or
+// os_sendmmsg().
+#define UDP_BATCH 64
+
+// The default number of accepts each TCP listener keeps posted on Windows.
+#define ACCEPT_POSTED 8
+
+static uint32_t accept_posted = ACCEPT_POSTED;
+
 PONY_EXTERN_C_BEGIN
 
 void os_closesocket(int fd);
@@ -95,8 +129,13 @@ static bool map_any_to_loopback(struct sockaddr* addr)
   return false;
 }
 
-static struct addrinfo* os_addrinfo_intern(int family, int socktype,
-  int proto, const char* host, const char* service, bool passive)
+void os_socket_setaccepts(uint32_t count)
+{
+  accept_posted = (count > 0) ? count : ACCEPT_POSTED;
+}
+
+struct addrinfo* os_addrinfo_intern(int family, int socktype, int proto,
+  const char* host, const char* service, bool passive)
 {
   struct addrinfo hints;
   memset(&hints, 0, sizeof(struct addrinfo));
@@ -222,14 +261,26 @@ static void CALLBACK iocp_callback(DWORD err, DWORD bytes, OVERLAPPED* ov)
         setsockopt(acc->ns, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT,
           (char*)&s, sizeof(SOCKET));
       } else {
-        // Close the new socket.
+        // Close the new socket. A connection that was reset before it was
+        // accepted leaves the listener as it was, so it only replaces the
+        // accept.
         closesocket(acc->ns);
-        acc->ns = INVALID_SOCKET;
+
+        if((err == ERROR_NETNAME_DELETED) || (err == WSAECONNRESET))
+          acc->ns = 0;
+        else
+          acc->ns = INVALID_SOCKET;
       }
 
-      // Dispatch a read event with the new socket as the argument.
-      asio_event_send(iocp->ev, ASIO_READ, (int)acc->ns);
+      // Dispatch a read event with the new socket as the argument. Once the
+      // listener is unsubscribed, the last accept to complete sends the event
+      // back.
+      asio_event_t* ev = iocp->ev;
+      asio_event_send(ev, ASIO_READ, (int)acc->ns);
       iocp_accept_destroy(acc);
+
+      if(_atomic_add(&ev->accepts, (uint64_t)-1) == (ASIO_ACCEPTS_CLOSED + 1))
+        asio_event_send(ev, ASIO_DISPOSABLE, 0);
       break;
     }
 
@@ -289,6 +340,10 @@ static bool iocp_connect(asio_event_t* ev, struct addrinfo *p)
 
 static bool iocp_accept(asio_event_t* ev)
 {
+  // Only the listener's owner posts accepts or unsubscribes it.
+  if(ev->flags == ASIO_DISPOSABLE)
+    return false;
+
   SOCKET s = (SOCKET)ev->fd;
   WSAPROTOCOL_INFO proto;
 
@@ -298,20 +353,26 @@ static bool iocp_accept(asio_event_t* ev)
   SOCKET ns = WSASocket(proto.iAddressFamily, proto.iSocketType,
     proto.iProtocol, NULL, 0, WSA_FLAG_OVERLAPPED);
 
-  if((ns == INVALID_SOCKET) ||
-    !BindIoCompletionCallback((HANDLE)ns, iocp_callback, 0))
+  if(ns == INVALID_SOCKET)
+    return false;
+
+  if(!BindIoCompletionCallback((HANDLE)ns, iocp_callback, 0))
   {
+    closesocket(ns);
     return false;
   }
 
   iocp_accept_t* iocp = iocp_accept_create(ns, ev);
   DWORD bytes;
+  _atomic_add(&ev->accepts, 1);
 
   if(!g_AcceptEx(s, ns, iocp->buf, 0, IOCP_ACCEPT_ADDR_LEN,
     IOCP_ACCEPT_ADDR_LEN, &bytes, &iocp->iocp.ov))
   {
     if(GetLastError() != ERROR_IO_PENDING)
     {
+      _atomic_add(&ev->accepts, (uint64_t)-1);
+      closesocket(ns);
       iocp_accept_destroy(iocp);
       return false;
     }
@@ -342,6 +403,64 @@ static bool iocp_send(asio_event_t* ev, const char* data, size_t len)
   return true;
 }
 
+static bool iocp_sendv(asio_event_t* ev, const size_t* iov, size_t count)
+{
+  SOCKET s = (SOCKET)ev->fd;
+  iocp_t* iocp = iocp_create(IOCP_SEND, ev);
+  DWORD sent;
+
+  // WSABUF has its fields the other way round from the (pointer, length)
+  // pairs we are given. The array is only read during the call.
+  size_t size = count * sizeof(WSABUF);
+  WSABUF* buf = (WSABUF*)pool_alloc_size(size);
+
+  for(size_t i = 0; i < count; i++)
+  {
+    buf[i].buf = (char*)iov[i * 2];
+    buf[i].len = (u_long)iov[(i * 2) + 1];
+  }
+
+  int r = WSASend(s, buf, (DWORD)count, &sent, 0, &iocp->ov, NULL);
+  pool_free_size(size, buf);
+
+  if(r != 0)
+  {
+    if(GetLastError() != WSA_IO_PENDING)
+    {
+      iocp_destroy(iocp);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool iocp_sendfile(asio_event_t* ev, int fd, size_t offset,
+  size_t len)
+{
+  SOCKET s = (SOCKET)ev->fd;
+  HANDLE file = (HANDLE)_get_osfhandle(fd);
+
+  if(file == INVALID_HANDLE_VALUE)
+    return false;
+
+  // TransmitFile reads from the offset in the OVERLAPPED structure.
+  iocp_t* iocp = iocp_create(IOCP_SEND, ev);
+  iocp->ov.Offset = (DWORD)offset;
+  iocp->ov.OffsetHigh = (DWORD)((uint64_t)offset >> 32);
+
+  if(!TransmitFile(s, file, (DWORD)len, 0, &iocp->ov, NULL, 0))
+  {
+    if(WSAGetLastError() != WSA_IO_PENDING)
+    {
+      iocp_destroy(iocp);
+      return false;
+    }
+  }
+
+  return true;
+}
+
 static bool iocp_recv(asio_event_t* ev, char* data, size_t len)
 {
   SOCKET s = (SOCKET)ev->fd;
@@ -420,7 +539,8 @@ static bool iocp_recvfrom(asio_event_t* ev, char* data, size_t len,
 
 #endif
 
-static int socket_from_addrinfo(struct addrinfo* p, bool reuse)
+static int socket_from_addrinfo(struct addrinfo* p, bool reuse,
+  bool reuseport)
 {
 #if defined(PLATFORM_IS_LINUX)
   int fd = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK,
@@ -446,6 +566,19 @@ static int socket_from_addrinfo(struct addrinfo* p, bool reuse)
       (const char*)&reuseaddr, sizeof(int));
   }
 
+#ifdef SO_REUSEPORT
+  // Sockets bound to the same address with SO_REUSEPORT each get a share of
+  // the incoming connections.
+  if(reuseport)
+  {
+    int share = 1;
+    r |= setsockopt((SOCKET)fd, SOL_SOCKET, SO_REUSEPORT,
+      (const char*)&share, sizeof(int));
+  }
+#else
+  (void)reuseport;
+#endif
+
 #if defined(PLATFORM_IS_MACOSX) || defined(PLATFORM_IS_FREEBSD)
   int nosigpipe = 1;
   r |= setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &nosigpipe, sizeof(int));
@@ -486,10 +619,17 @@ static asio_event_t* os_listen(pony_actor_t* owner, int fd,
   asio_event_t* ev = asio_event_create(owner, fd, ASIO_READ, 0, true);
 
 #ifdef PLATFORM_IS_WINDOWS
-  // Start accept for TCP connections, but not for UDP.
+  // Post accepts for TCP connections, but not for UDP. Each one that
+  // completes is replaced by the listener, so that several connections can be
+  // accepted while it handles the last.
   if(proto == IPPROTO_TCP)
   {
-    if(!iocp_accept(ev))
+    uint32_t posted = 0;
+
+    while((posted < accept_posted) && iocp_accept(ev))
+      posted++;
+
+    if(posted == 0)
     {
       asio_event_unsubscribe(ev);
       os_closesocket(fd);
@@ -582,7 +722,7 @@ static bool os_connect(pony_actor_t* owner, int fd, struct addrinfo *p,
  * null.
  */
 static asio_event_t* os_socket_listen(pony_actor_t* owner, const char* host,
-  const char* service, int family, int socktype, int proto)
+  const char* service, int family, int socktype, int proto, bool reuseport)
 {
   struct addrinfo* result = os_addrinfo_intern(family, socktype, proto, host,
     service, true);
@@ -591,7 +731,7 @@ static asio_event_t* os_socket_listen(pony_actor_t* owner, const char* host,
 
   while(p != NULL)
   {
-    int fd = socket_from_addrinfo(p, true);
+    int fd = socket_from_addrinfo(p, true, reuseport);
 
     if(fd != -1)
     {
@@ -608,23 +748,20 @@ static asio_event_t* os_socket_listen(pony_actor_t* owner, const char* host,
 }
 
 /**
- * This starts Happy Eyeballs and returns * the number of connection attempts
- * in-flight, which may be 0.
+ * This starts Happy Eyeballs on addresses from os_resolve_tcp() and returns
+ * the number of connection attempts in-flight, which may be 0. The addresses
+ * are freed.
  */
-static int os_socket_connect(pony_actor_t* owner, const char* host,
-  const char* service, const char* from, int family, int socktype, int proto)
+int os_connect_resolved(pony_actor_t* owner, struct addrinfo* result,
+  const char* from)
 {
   bool reuse = (from == NULL) || (from[0] != '\0');
-
-  struct addrinfo* result = os_addrinfo_intern(family, socktype, proto, host,
-    service, false);
-
   struct addrinfo* p = result;
   int count = 0;
 
   while(p != NULL)
   {
-    int fd = socket_from_addrinfo(p, reuse);
+    int fd = socket_from_addrinfo(p, reuse, false);
 
     if(fd != -1)
     {
@@ -639,46 +776,59 @@ static int os_socket_connect(pony_actor_t* owner, const char* host,
   return count;
 }
 
+/**
+ * This starts Happy Eyeballs and returns * the number of connection attempts
+ * in-flight, which may be 0.
+ */
+static int os_socket_connect(pony_actor_t* owner, const char* host,
+  const char* service, const char* from, int family, int socktype, int proto)
+{
+  struct addrinfo* result = os_addrinfo_intern(family, socktype, proto, host,
+    service, false);
+
+  return os_connect_resolved(owner, result, from);
+}
+
 asio_event_t* os_listen_tcp(pony_actor_t* owner, const char* host,
-  const char* service)
+  const char* service, bool reuseport)
 {
   return os_socket_listen(owner, host, service, AF_UNSPEC, SOCK_STREAM,
-    IPPROTO_TCP);
+    IPPROTO_TCP, reuseport);
 }
 
 asio_event_t* os_listen_tcp4(pony_actor_t* owner, const char* host,
-  const char* service)
+  const char* service, bool reuseport)
 {
   return os_socket_listen(owner, host, service, AF_INET, SOCK_STREAM,
-    IPPROTO_TCP);
+    IPPROTO_TCP, reuseport);
 }
 
 asio_event_t* os_listen_tcp6(pony_actor_t* owner, const char* host,
-  const char* service)
+  const char* service, bool reuseport)
 {
   return os_socket_listen(owner, host, service, AF_INET6, SOCK_STREAM,
-    IPPROTO_TCP);
+    IPPROTO_TCP, reuseport);
 }
 
 asio_event_t* os_listen_udp(pony_actor_t* owner, const char* host,
   const char* service)
 {
   return os_socket_listen(owner, host, service, AF_UNSPEC, SOCK_DGRAM,
-    IPPROTO_UDP);
+    IPPROTO_UDP, false);
 }
 
 asio_event_t* os_listen_udp4(pony_actor_t* owner, const char* host,
   const char* service)
 {
   return os_socket_listen(owner, host, service, AF_INET, SOCK_DGRAM,
-    IPPROTO_UDP);
+    IPPROTO_UDP, false);
 }
 
 asio_event_t* os_listen_udp6(pony_actor_t* owner, const char* host,
   const char* service)
 {
   return os_socket_listen(owner, host, service, AF_INET6, SOCK_DGRAM,
-    IPPROTO_UDP);
+    IPPROTO_UDP, false);
 }
 
 int os_connect_tcp(pony_actor_t* owner, const char* host,
@@ -705,9 +855,13 @@ int os_connect_tcp6(pony_actor_t* owner, const char* host,
 int os_accept(asio_event_t* ev)
 {
 #if defined(PLATFORM_IS_WINDOWS)
-  // Queue an IOCP accept and return an INVALID_SOCKET.
+  // Bring the accepts posted back up to the pool size, and return an
+  // INVALID_SOCKET. Accepts that were not replaced while the listener was at
+  // its limit are made up here.
   SOCKET ns = INVALID_SOCKET;
-  iocp_accept(ev);
+
+  while((_atomic_load(&ev->accepts) < accept_posted) && iocp_accept(ev))
+    ;
 #elif defined(PLATFORM_IS_LINUX)
   int ns = accept4(ev->fd, NULL, NULL, SOCK_NONBLOCK);
 
@@ -897,6 +1051,88 @@ size_t os_send(asio_event_t* ev, const char* buf, size_t len)
 #endif
 }
 
+/**
+ * Sends count buffers in one call. Each buffer is a pair of words in iov, its
+ * pointer and then its length, which is the layout of struct iovec. Returns
+ * the number of bytes sent, which may end part way through a buffer.
+ */
+size_t os_writev(asio_event_t* ev, const size_t* iov, size_t count)
+{
+#ifdef PLATFORM_IS_WINDOWS
+  if(!iocp_sendv(ev, iov, count))
+    pony_throw();
+
+  return 0;
+#else
+  if(count > IOV_MAX)
+    count = IOV_MAX;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(struct msghdr));
+  msg.msg_iov = (struct iovec*)iov;
+  msg.msg_iovlen = count;
+
+  ssize_t sent = sendmsg(ev->fd, &msg, MSG_NOSIGNAL);
+
+  if(sent < 0)
+  {
+    if(errno == EWOULDBLOCK)
+      return 0;
+
+    pony_throw();
+  }
+
+  return (size_t)sent;
+#endif
+}
+
+/**
+ * Sends len bytes of the file fd, starting at offset, without copying them
+ * through user space. The file's own position is not changed. Returns the
+ * number of bytes sent, which may be less than len. On Windows the whole
+ * range is queued and the count arrives on completion, as with os_send.
+ */
+size_t os_sendfile(asio_event_t* ev, int fd, size_t offset, size_t len)
+{
+#if defined(PLATFORM_IS_WINDOWS)
+  if(!iocp_sendfile(ev, fd, offset, len))
+    pony_throw();
+
+  return 0;
+#else
+#if defined(PLATFORM_IS_LINUX)
+  off_t off = (off_t)offset;
+  ssize_t r = sendfile(ev->fd, fd, &off, len);
+  size_t sent = (r < 0) ? 0 : (size_t)r;
+#elif defined(PLATFORM_IS_MACOSX)
+  // A length of zero means the whole file, so it is never passed in.
+  off_t count = (off_t)len;
+  int r = sendfile(fd, ev->fd, (off_t)offset, &count, NULL, 0);
+  size_t sent = (size_t)count;
+#elif defined(PLATFORM_IS_FREEBSD)
+  off_t count = 0;
+  int r = sendfile(fd, ev->fd, (off_t)offset, len, NULL, &count, 0);
+  size_t sent = (size_t)count;
+#endif
+
+  if(r < 0)
+  {
+    // BSD sendfile reports a partial send as EAGAIN with a count.
+    if((errno == EWOULDBLOCK) || (errno == EAGAIN) || (errno == EBUSY))
+      return sent;
+
+    pony_throw();
+  }
+
+  // The range has been checked against the file's size, so running out of
+  // file means it was truncated while being sent.
+  if((sent == 0) && (len > 0))
+    pony_throw();
+
+  return sent;
+#endif
+}
+
 size_t os_recv(asio_event_t* ev, char* buf, size_t len)
 {
 #ifdef PLATFORM_IS_WINDOWS
@@ -977,6 +1213,209 @@ size_t os_recvfrom(asio_event_t* ev, char* buf, size_t len,
 #endif
 }
 
+/**
+ * Sends count datagrams to the same address. The datagrams are given as
+ * (pointer, length) pairs, as for os_writev(). Returns the number sent, which
+ * is less than count if the socket would block. At most UDP_BATCH are sent.
+ */
+size_t os_sendmmsg(int fd, const size_t* iov, size_t count,
+  ipaddress_t* ipaddr)
+{
+  if(count > UDP_BATCH)
+    count = UDP_BATCH;
+
+#if defined(PLATFORM_IS_WINDOWS)
+  for(size_t i = 0; i < count; i++)
+  {
+    if(!iocp_sendto(fd, (const char*)iov[i * 2], iov[(i * 2) + 1], ipaddr))
+      pony_throw();
+  }
+
+  return count;
+#else
+  socklen_t addrlen = address_length(ipaddr);
+
+  if(addrlen == (socklen_t)-1)
+    pony_throw();
+
+#if defined(PLATFORM_IS_LINUX)
+  struct mmsghdr msg[UDP_BATCH];
+  memset(msg, 0, count * sizeof(struct mmsghdr));
+
+  for(size_t i = 0; i < count; i++)
+  {
+    msg[i].msg_hdr.msg_name = &ipaddr->addr;
+    msg[i].msg_hdr.msg_namelen = addrlen;
+    msg[i].msg_hdr.msg_iov = (struct iovec*)&iov[i * 2];
+    msg[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int sent = sendmmsg(fd, msg, (unsigned int)count, MSG_NOSIGNAL);
+
+  if(sent < 0)
+  {
+    if(errno == EWOULDBLOCK)
+      return 0;
+
+    pony_throw();
+  }
+
+  return (size_t)sent;
+#else
+  size_t n = 0;
+
+  while(n < count)
+  {
+    ssize_t sent = sendto(fd, (const char*)iov[n * 2], iov[(n * 2) + 1],
+      MSG_NOSIGNAL, (struct sockaddr*)&ipaddr->addr, addrlen);
+
+    if(sent < 0)
+    {
+      if(errno == EWOULDBLOCK)
+        break;
+
+      pony_throw();
+    }
+
+    n++;
+  }
+
+  return n;
+#endif
+#endif
+}
+
+#ifndef PLATFORM_IS_WINDOWS
+/**
+ * Reads up to count datagrams into the (pointer, length) pairs in iov. The
+ * length of each one goes in lens and where it came from goes in from.
+ * Returns the number read, or 0 if none are waiting. At most UDP_BATCH are
+ * read. This is not used with IOCP.
+ */
+size_t os_recvmmsg(asio_event_t* ev, const size_t* iov, ipaddress_t** from,
+  size_t* lens, size_t count)
+{
+  if(count > UDP_BATCH)
+    count = UDP_BATCH;
+
+#if defined(PLATFORM_IS_LINUX)
+  struct mmsghdr msg[UDP_BATCH];
+  memset(msg, 0, count * sizeof(struct mmsghdr));
+
+  for(size_t i = 0; i < count; i++)
+  {
+    msg[i].msg_hdr.msg_name = &from[i]->addr;
+    msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    msg[i].msg_hdr.msg_iov = (struct iovec*)&iov[i * 2];
+    msg[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int recvd = recvmmsg(ev->fd, msg, (unsigned int)count, MSG_DONTWAIT, NULL);
+
+  if(recvd < 0)
+  {
+    if(errno == EWOULDBLOCK)
+      return 0;
+
+    pony_throw();
+  }
+
+  for(int i = 0; i < recvd; i++)
+    lens[i] = msg[i].msg_len;
+
+  return (size_t)recvd;
+#else
+  size_t n = 0;
+
+  while(n < count)
+  {
+    socklen_t addrlen = sizeof(struct sockaddr_storage);
+    ssize_t recvd = recvfrom(ev->fd, (char*)iov[n * 2], iov[(n * 2) + 1], 0,
+      (struct sockaddr*)&from[n]->addr, &addrlen);
+
+    if(recvd < 0)
+    {
+      // Hand back what has been read. Any error will be seen again next time.
+      if((errno == EWOULDBLOCK) || (n > 0))
+        break;
+
+      pony_throw();
+    }
+
+    lens[n++] = (size_t)recvd;
+  }
+
+  return n;
+#endif
+}
+#endif
+
+/**
+ * Hands encryption of everything sent on a connected TCP socket to the
+ * kernel's TLS layer. The session must be TLS 1.2 with AES-GCM, which is
+ * chosen by the length of the write key. The salt is the 4 byte implicit
+ * part of the nonce, and seq is the sequence number of the next record.
+ * Returns false if the kernel can't do this, in which case the socket is
+ * unchanged.
+ */
+bool os_ktls_tx(int fd, const uint8_t* key, size_t key_len,
+  const uint8_t* salt, uint64_t seq)
+{
+#if defined(TLS_TX)
+  // The explicit part of each nonce starts at the sequence number, so it is
+  // never reused with these keys.
+  uint8_t rec_seq[8];
+
+  for(int i = 0; i < 8; i++)
+    rec_seq[i] = (uint8_t)(seq >> (56 - (i * 8)));
+
+  if(key_len == TLS_CIPHER_AES_GCM_128_KEY_SIZE)
+  {
+    struct tls12_crypto_info_aes_gcm_128 info;
+    memset(&info, 0, sizeof(info));
+    info.info.version = TLS_1_2_VERSION;
+    info.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+    memcpy(info.key, key, key_len);
+    memcpy(info.salt, salt, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+    memcpy(info.iv, rec_seq, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+    memcpy(info.rec_seq, rec_seq, TLS_CIPHER_AES_GCM_128_REC_SEQ_SIZE);
+
+    if(setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+      return false;
+
+    return setsockopt(fd, SOL_TLS, TLS_TX, &info, sizeof(info)) == 0;
+  }
+
+#if defined(TLS_CIPHER_AES_GCM_256)
+  if(key_len == TLS_CIPHER_AES_GCM_256_KEY_SIZE)
+  {
+    struct tls12_crypto_info_aes_gcm_256 info;
+    memset(&info, 0, sizeof(info));
+    info.info.version = TLS_1_2_VERSION;
+    info.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+    memcpy(info.key, key, key_len);
+    memcpy(info.salt, salt, TLS_CIPHER_AES_GCM_256_SALT_SIZE);
+    memcpy(info.iv, rec_seq, TLS_CIPHER_AES_GCM_256_IV_SIZE);
+    memcpy(info.rec_seq, rec_seq, TLS_CIPHER_AES_GCM_256_REC_SEQ_SIZE);
+
+    if(setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+      return false;
+
+    return setsockopt(fd, SOL_TLS, TLS_TX, &info, sizeof(info)) == 0;
+  }
+#endif
+
+  return false;
+#else
+  (void)fd;
+  (void)key;
+  (void)key_len;
+  (void)salt;
+  (void)seq;
+  return false;
+#endif
+}
+
 void os_keepalive(int fd, int secs)
 {
   SOCKET s = (SOCKET)fd;
@@ -1086,11 +1525,14 @@ bool os_socket_init()
   closesocket(s);
 #endif
 
+  os_resolve_init();
   return true;
 }
 
 void os_socket_shutdown()
 {
+  os_resolve_shutdown();
+
 #ifdef PLATFORM_IS_WINDOWS
   WSACleanup();
 #endif
@@ -1,5 +1,11 @@
-#ifndef LANG_H
-#define LANG_H
+#ifndef lang_socket_h
+#define lang_socket_h
+
+#include <platform.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct addrinfo;
 
 PONY_EXTERN_C_BEGIN
 
@@ -7,6 +13,32 @@ bool os_socket_init();
 
 void os_socket_shutdown();
 
+/**
+ * Sets how many accepts each TCP listener keeps posted on Windows. Zero keeps
+ * the default of 8. Elsewhere, listeners accept as many connections as are
+ * ready each time they are readable, and this does nothing.
+ */
+void os_socket_setaccepts(uint32_t count);
+
+/**
+ * Looks up a host and service with getaddrinfo(), blocking the calling thread.
+ * An empty host is treated as no host. Returns NULL if the lookup fails.
+ */
+struct addrinfo* os_addrinfo_intern(int family, int socktype, int proto,
+  const char* host, const char* service, bool passive);
+
+/**
+ * Gets ready to take lookups for os_resolve(). The threads that do them are
+ * only started once lookups are queued.
+ */
+void os_resolve_init();
+
+/**
+ * Stops and joins the resolver threads. Must only be called once no lookup is
+ * pending, which quiescence ensures, since pending lookups are noisy.
+ */
+void os_resolve_shutdown();
+
 PONY_EXTERN_C_END
 
 #endif
@@ -1,5 +1,12 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
 #include <platform.h>
 
+#if defined(PLATFORM_IS_POSIX_BASED)
+#include <dlfcn.h>
+#endif
+
 #if defined(PLATFORM_IS_WINDOWS)
 static HANDLE* locks;
 #else
@@ -12,6 +19,9 @@ PONY_EXTERN_C_BEGIN
 // Forward declaration to avoid C++ name mangling
 void* os_ssl_multithreading(uint32_t count);
 
+size_t os_ssl_kernel_secrets(void* ssl, void* session, uint8_t* master,
+  size_t master_len, uint8_t* client_random, uint8_t* server_random);
+
 PONY_EXTERN_C_END
 
 
@@ -52,3 +62,43 @@ void* os_ssl_multithreading(uint32_t count)
 
   return locking_callback;
 }
+
+typedef size_t (*ssl_get_master_key_fn)(void*, uint8_t*, size_t);
+typedef size_t (*ssl_get_random_fn)(void*, uint8_t*, size_t);
+
+/** Copies the master key and both 32 byte randoms of a session and returns
+ *  the length of the master key, or 0 if the OpenSSL in use lacks the
+ *  accessors. These only exist in OpenSSL 1.1 and LibreSSL 2.7, so they are
+ *  looked up at runtime rather than linked, leaving programs that use older
+ *  versions able to link.
+ */
+size_t os_ssl_kernel_secrets(void* ssl, void* session, uint8_t* master,
+  size_t master_len, uint8_t* client_random, uint8_t* server_random)
+{
+#if defined(PLATFORM_IS_POSIX_BASED)
+  ssl_get_master_key_fn get_master_key = (ssl_get_master_key_fn)dlsym(
+    RTLD_DEFAULT, "SSL_SESSION_get_master_key");
+  ssl_get_random_fn get_client_random = (ssl_get_random_fn)dlsym(
+    RTLD_DEFAULT, "SSL_get_client_random");
+  ssl_get_random_fn get_server_random = (ssl_get_random_fn)dlsym(
+    RTLD_DEFAULT, "SSL_get_server_random");
+
+  if((get_master_key == NULL) || (get_client_random == NULL) ||
+    (get_server_random == NULL))
+    return 0;
+
+  if((get_client_random(ssl, client_random, 32) != 32) ||
+    (get_server_random(ssl, server_random, 32) != 32))
+    return 0;
+
+  return get_master_key(session, master, master_len);
+#else
+  (void)ssl;
+  (void)session;
+  (void)master;
+  (void)master_len;
+  (void)client_random;
+  (void)server_random;
+  return 0;
+#endif
+}
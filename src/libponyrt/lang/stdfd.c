@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <strings.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #endif
 
 PONY_EXTERN_C_BEGIN
@@ -507,6 +508,18 @@ size_t os_stdin_read(char* buffer, size_t space, bool* out_again)
 #endif
 }
 
+void os_stdin_pipe_size(size_t size)
+{
+#if defined(PLATFORM_IS_LINUX) && defined(F_SETPIPE_SZ)
+  // Fewer, larger reads from a pipe need a pipe buffer that can hold them.
+  // This fails harmlessly if the size is over the system limit.
+  if(fd_type(STDIN_FILENO) == FD_TYPE_PIPE)
+    fcntl(STDIN_FILENO, F_SETPIPE_SZ, (int)size);
+#else
+  (void)size;
+#endif
+}
+
 bool os_fp_tty(FILE* fp)
 {
   return
@@ -778,6 +791,11 @@ void os_std_write(FILE* fp, char* buffer, size_t len)
 #endif
 }
 
+void os_std_flush(FILE* fp)
+{
+  fflush(fp);
+}
+
 #ifdef PLATFORM_IS_WINDOWS
 // Unsurprisingly Windows uses a different order for colors. Map them here.
 // We use the bright versions here, hence the additional 8 on each value.
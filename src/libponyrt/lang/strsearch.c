@@ -0,0 +1,283 @@
+#include "strsearch.h"
+#include <pony.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(PLATFORM_IS_X86) && defined(PLATFORM_IS_CLANG_OR_GCC)
+#  define USE_X86_SIMD
+#  include <immintrin.h>
+#endif
+
+PONY_EXTERN_C_BEGIN
+
+#define NOT_FOUND ((size_t)-1)
+
+typedef size_t (*find_fn)(const char* s, size_t len, const char* sub,
+  size_t sublen);
+
+typedef size_t (*delim_fn)(const char* s, size_t len, const char* delim,
+  size_t count);
+
+static size_t find_generic(const char* s, size_t len, const char* sub,
+  size_t sublen)
+{
+  const char* p = s;
+  const char* end = s + len - sublen + 1;
+
+  while(p < end)
+  {
+    p = (const char*)memchr(p, sub[0], (size_t)(end - p));
+
+    if(p == NULL)
+      return NOT_FOUND;
+
+    if(memcmp(p + 1, sub + 1, sublen - 1) == 0)
+      return (size_t)(p - s);
+
+    p++;
+  }
+
+  return NOT_FOUND;
+}
+
+static size_t delim_generic(const char* s, size_t len, const char* delim,
+  size_t count)
+{
+  if(count == 1)
+  {
+    const char* p = (const char*)memchr(s, delim[0], len);
+    return (p == NULL) ? len : (size_t)(p - s);
+  }
+
+  bool set[256];
+  memset(set, 0, sizeof(set));
+
+  for(size_t i = 0; i < count; i++)
+    set[(uint8_t)delim[i]] = true;
+
+  for(size_t i = 0; i < len; i++)
+  {
+    if(set[(uint8_t)s[i]])
+      return i;
+  }
+
+  return len;
+}
+
+#ifdef USE_X86_SIMD
+
+// The first and last bytes of the substring are compared at 16 or 32
+// positions at once, and only the positions where both match are compared in
+// full. Positions too close to the end for a whole block are left to the
+// generic search.
+
+__attribute__((target("sse2")))
+static size_t find_sse2(const char* s, size_t len, const char* sub,
+  size_t sublen)
+{
+  const __m128i first = _mm_set1_epi8(sub[0]);
+  const __m128i last = _mm_set1_epi8(sub[sublen - 1]);
+  size_t positions = len - sublen + 1;
+  size_t i = 0;
+
+  for(; (i + 16) <= positions; i += 16)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)(s + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(s + i + sublen - 1));
+    __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(a, first),
+      _mm_cmpeq_epi8(b, last));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(eq);
+
+    while(mask != 0)
+    {
+      size_t bit = (size_t)__builtin_ctz(mask);
+
+      if(memcmp(s + i + bit + 1, sub + 1, sublen - 1) == 0)
+        return i + bit;
+
+      mask &= mask - 1;
+    }
+  }
+
+  size_t r = find_generic(s + i, len - i, sub, sublen);
+  return (r == NOT_FOUND) ? r : i + r;
+}
+
+__attribute__((target("avx2")))
+static size_t find_avx2(const char* s, size_t len, const char* sub,
+  size_t sublen)
+{
+  const __m256i first = _mm256_set1_epi8(sub[0]);
+  const __m256i last = _mm256_set1_epi8(sub[sublen - 1]);
+  size_t positions = len - sublen + 1;
+  size_t i = 0;
+
+  for(; (i + 32) <= positions; i += 32)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(s + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(s + i + sublen - 1));
+    __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+      _mm256_cmpeq_epi8(b, last));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(eq);
+
+    while(mask != 0)
+    {
+      size_t bit = (size_t)__builtin_ctz(mask);
+
+      if(memcmp(s + i + bit + 1, sub + 1, sublen - 1) == 0)
+        return i + bit;
+
+      mask &= mask - 1;
+    }
+  }
+
+  size_t r = find_generic(s + i, len - i, sub, sublen);
+  return (r == NOT_FOUND) ? r : i + r;
+}
+
+// Each block is compared against every delimiter, which for the handful of
+// delimiters a split is usually given is much cheaper than a table lookup
+// per byte.
+#define SIMD_DELIMS 16
+
+__attribute__((target("sse2")))
+static size_t delim_sse2(const char* s, size_t len, const char* delim,
+  size_t count)
+{
+  if(count > SIMD_DELIMS)
+    return delim_generic(s, len, delim, count);
+
+  __m128i d[SIMD_DELIMS];
+
+  for(size_t k = 0; k < count; k++)
+    d[k] = _mm_set1_epi8(delim[k]);
+
+  size_t i = 0;
+
+  for(; (i + 16) <= len; i += 16)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)(s + i));
+    __m128i eq = _mm_cmpeq_epi8(a, d[0]);
+
+    for(size_t k = 1; k < count; k++)
+      eq = _mm_or_si128(eq, _mm_cmpeq_epi8(a, d[k]));
+
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(eq);
+
+    if(mask != 0)
+      return i + (size_t)__builtin_ctz(mask);
+  }
+
+  return i + delim_generic(s + i, len - i, delim, count);
+}
+
+__attribute__((target("avx2")))
+static size_t delim_avx2(const char* s, size_t len, const char* delim,
+  size_t count)
+{
+  if(count > SIMD_DELIMS)
+    return delim_generic(s, len, delim, count);
+
+  __m256i d[SIMD_DELIMS];
+
+  for(size_t k = 0; k < count; k++)
+    d[k] = _mm256_set1_epi8(delim[k]);
+
+  size_t i = 0;
+
+  for(; (i + 32) <= len; i += 32)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(s + i));
+    __m256i eq = _mm256_cmpeq_epi8(a, d[0]);
+
+    for(size_t k = 1; k < count; k++)
+      eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(a, d[k]));
+
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(eq);
+
+    if(mask != 0)
+      return i + (size_t)__builtin_ctz(mask);
+  }
+
+  return i + delim_generic(s + i, len - i, delim, count);
+}
+
+#endif
+
+static size_t find_resolve(const char* s, size_t len, const char* sub,
+  size_t sublen);
+
+static size_t delim_resolve(const char* s, size_t len, const char* delim,
+  size_t count);
+
+static find_fn find_impl = find_resolve;
+static delim_fn delim_impl = delim_resolve;
+
+static void resolve()
+{
+  find_fn find = find_generic;
+  delim_fn delim = delim_generic;
+
+#ifdef USE_X86_SIMD
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("avx2"))
+  {
+    find = find_avx2;
+    delim = delim_avx2;
+  } else if(__builtin_cpu_supports("sse2")) {
+    find = find_sse2;
+    delim = delim_sse2;
+  }
+#endif
+
+  // Every thread that gets here picks the same functions, so the race is
+  // harmless.
+  _atomic_store(&find_impl, find);
+  _atomic_store(&delim_impl, delim);
+}
+
+static size_t find_resolve(const char* s, size_t len, const char* sub,
+  size_t sublen)
+{
+  resolve();
+  return find_impl(s, len, sub, sublen);
+}
+
+static size_t delim_resolve(const char* s, size_t len, const char* delim,
+  size_t count)
+{
+  resolve();
+  return delim_impl(s, len, delim, count);
+}
+
+size_t pony_memfind(const char* s, size_t len, const char* sub,
+  size_t sublen)
+{
+  if((sublen == 0) || (sublen > len))
+    return NOT_FOUND;
+
+  if(sublen == 1)
+  {
+    const char* p = (const char*)memchr(s, sub[0], len);
+    return (p == NULL) ? NOT_FOUND : (size_t)(p - s);
+  }
+
+  return _atomic_load(&find_impl)(s, len, sub, sublen);
+}
+
+size_t pony_memdelim(const char* s, size_t len, const char* delim,
+  size_t count)
+{
+  if((len == 0) || (count == 0))
+    return len;
+
+  return _atomic_load(&delim_impl)(s, len, delim, count);
+}
+
+char* pony_string_inline(void* buf)
+{
+  return (char*)buf;
+}
+
+PONY_EXTERN_C_END
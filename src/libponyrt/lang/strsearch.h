@@ -0,0 +1,33 @@
+#ifndef lang_strsearch_h
+#define lang_strsearch_h
+
+#include <platform.h>
+#include <stddef.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * Returns the index of the first occurrence of sub in s, or -1 if there is
+ * none or sub is empty. The search uses the widest vectors the CPU has, which
+ * is checked on the first call.
+ */
+size_t pony_memfind(const char* s, size_t len, const char* sub,
+  size_t sublen);
+
+/**
+ * Returns the index of the first byte in s that is one of the count bytes in
+ * delim, or len if there is none.
+ */
+size_t pony_memdelim(const char* s, size_t len, const char* delim,
+  size_t count);
+
+/**
+ * Returns buf. A short String keeps its data in fields of its own, and Pony
+ * can only take a field's address as an argument to a C function, so this is
+ * how the String gets a pointer to them.
+ */
+char* pony_string_inline(void* buf);
+
+PONY_EXTERN_C_END
+
+#endif
@@ -2,6 +2,8 @@
 #define _GNU_SOURCE
 #endif
 #include <platform.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -13,6 +15,90 @@
 #include <mach/vm_statistics.h>
 #endif
 
+#if defined(PLATFORM_IS_LINUX)
+/// Huge page arenas are aligned on this size.
+#define HUGE_PAGE (2 * 1024 * 1024)
+
+static bool use_hugepages;
+
+/**
+ * Maps a whole number of huge pages on a huge page boundary, and asks for
+ * transparent huge pages to back it.
+ */
+static void* huge_alloc(size_t size)
+{
+  char* p = (char*)mmap(0, size + HUGE_PAGE, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+  if(p == MAP_FAILED)
+    return p;
+
+  // Trim the mapping so that it starts and ends on a huge page boundary.
+  char* start = (char*)(((uintptr_t)p + HUGE_PAGE - 1) &
+    ~(uintptr_t)(HUGE_PAGE - 1));
+  char* end = start + size;
+
+  if(start > p)
+    munmap(p, (size_t)(start - p));
+
+  if((p + size + HUGE_PAGE) > end)
+    munmap(end, (size_t)((p + size + HUGE_PAGE) - end));
+
+  madvise(start, size, MADV_HUGEPAGE);
+  return start;
+}
+#endif
+
+void virtual_sethugepages(bool enable)
+{
+#if defined(PLATFORM_IS_LINUX)
+  use_hugepages = enable;
+#else
+  // Mappings are already superpage aligned where the OS supports it.
+  (void)enable;
+#endif
+}
+
+size_t virtual_limit()
+{
+#if defined(PLATFORM_IS_LINUX)
+  // The cgroup v2 memory.max, or v1 memory.limit_in_bytes, of the cgroup
+  // mounted at /sys/fs/cgroup, which is the process's own inside a
+  // container. An unlimited v2 cgroup reads "max", and an unlimited v1 cgroup
+  // reads a huge number.
+  unsigned long long limit = 0;
+  FILE* fp = fopen("/sys/fs/cgroup/memory.max", "r");
+
+  if(fp == NULL)
+    fp = fopen("/sys/fs/cgroup/memory/memory.limit_in_bytes", "r");
+
+  if(fp != NULL)
+  {
+    if(fscanf(fp, "%llu", &limit) != 1)
+      limit = 0;
+
+    fclose(fp);
+  }
+
+  if(limit >= ((unsigned long long)1 << 60))
+    limit = 0;
+
+  return (size_t)limit;
+#else
+  return 0;
+#endif
+}
+
+size_t virtual_pagesize()
+{
+#if defined(PLATFORM_IS_LINUX)
+  if(use_hugepages)
+    return HUGE_PAGE;
+#endif
+
+  return 4096;
+}
+
 void* virtual_alloc(size_t bytes)
 {
   void* p;
@@ -21,8 +107,11 @@ void* virtual_alloc(size_t bytes)
   p = VirtualAlloc(NULL, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
 #elif defined(PLATFORM_IS_POSIX_BASED)
 #if defined(PLATFORM_IS_LINUX)
-  p = mmap(0, bytes, PROT_READ | PROT_WRITE,
-    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if(use_hugepages && ((bytes & (HUGE_PAGE - 1)) == 0))
+    p = huge_alloc(bytes);
+  else
+    p = mmap(0, bytes, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
 #elif defined(PLATFORM_IS_MACOSX)
   p = mmap(0, bytes, PROT_READ | PROT_WRITE,
     MAP_PRIVATE | MAP_ANON | VM_FLAGS_SUPERPAGE_SIZE_ANY, -1, 0);
@@ -49,3 +138,52 @@ void virtual_free(void* p, size_t bytes)
   munmap(p, bytes);
 #endif
 }
+
+void virtual_decommit(void* p, size_t bytes)
+{
+#if defined(PLATFORM_IS_WINDOWS)
+  VirtualAlloc(p, bytes, MEM_RESET, PAGE_READWRITE);
+#elif defined(PLATFORM_IS_LINUX)
+  madvise(p, bytes, MADV_DONTNEED);
+#elif defined(PLATFORM_IS_POSIX_BASED)
+  madvise(p, bytes, MADV_FREE);
+#endif
+}
+
+bool virtual_prefault(void* p, size_t bytes, bool lock)
+{
+  if(lock)
+  {
+    // Locking faults every page in.
+#if defined(PLATFORM_IS_WINDOWS)
+    if(VirtualLock(p, bytes))
+      return true;
+#elif defined(PLATFORM_IS_POSIX_BASED)
+    if(mlock(p, bytes) == 0)
+      return true;
+#endif
+  }
+
+  volatile char* c = (volatile char*)p;
+
+  for(size_t i = 0; i < bytes; i += 4096)
+    c[i] = 0;
+
+  return !lock;
+}
+
+void* virtual_remap(void* p, size_t old_bytes, size_t bytes)
+{
+#if defined(PLATFORM_IS_LINUX)
+  void* q = mremap(p, old_bytes, bytes, MREMAP_MAYMOVE);
+
+  if(q != MAP_FAILED)
+    return q;
+#else
+  (void)p;
+  (void)old_bytes;
+  (void)bytes;
+#endif
+
+  return NULL;
+}
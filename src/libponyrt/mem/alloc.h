@@ -1,6 +1,28 @@
 #ifndef PLATFORM_ALLOC_H
 #define PLATFORM_ALLOC_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Maps allocations that are a multiple of the huge page size, such as the
+ * pool's arenas, on huge page boundaries backed by transparent huge pages,
+ * where the OS supports it.
+ */
+void virtual_sethugepages(bool enable);
+
+/**
+ * The memory the process may use, from its cgroup's memory limit, or 0 if it
+ * isn't limited. Linux only.
+ */
+size_t virtual_limit();
+
+/**
+ * The granularity at which memory should be decommitted, so that huge pages
+ * aren't split.
+ */
+size_t virtual_pagesize();
+
 /**
  * Allocates memory in the virtual address space.
  */
@@ -12,4 +34,25 @@ void* virtual_alloc(size_t bytes);
  */
 void virtual_free(void* p, size_t bytes);
 
+/**
+ * Returns the physical pages backing a range of virtual memory to the OS. The
+ * range stays mapped and reads as zero, or as its old contents, until it is
+ * written again.
+ */
+void virtual_decommit(void* p, size_t bytes);
+
+/**
+ * Backs a range of virtual memory with physical pages now, rather than when
+ * each page is first written, and if lock is true keeps them in RAM. Returns
+ * false if they couldn't be locked, in which case they are still faulted in.
+ */
+bool virtual_prefault(void* p, size_t bytes, bool lock);
+
+/**
+ * Grows a page aligned range of virtual memory by remapping its pages, which
+ * may move them but never copies them. The old range is no longer mapped.
+ * Returns NULL, leaving the range as it was, where the OS can't do this.
+ */
+void* virtual_remap(void* p, size_t old_bytes, size_t bytes);
+
 #endif
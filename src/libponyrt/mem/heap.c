@@ -1,6 +1,8 @@
 #include "heap.h"
+#include "heapprof.h"
 #include "pagemap.h"
 #include "../ds/fun.h"
+#include "../sched/cpu.h"
 #include <string.h>
 #include <assert.h>
 
@@ -17,23 +19,53 @@ typedef struct chunk_t
   uint32_t slots;
   uint32_t shallow;
 
+  // The slots that were free when the chunk was last swept, which are the
+  // ones a minor pass collects, and the old objects already remembered by a
+  // write barrier since the last pass.
+  uint32_t young;
+  uint32_t remembered;
+
   struct chunk_t* next;
 } chunk_t;
 
+// The most the pacing mode stretches an actor's gc factor by.
+#define HEAP_PACEMAX 64.0
+
+// How many chunks an incremental sweep handles between reads of the clock.
+#define HEAP_SWEEPCHECK 64
+
 typedef char block_t[POOL_ALIGN];
 typedef void (*chunk_fn)(chunk_t* chunk);
 
-#define SIZECLASS_SIZE(sizeclass) (HEAP_MIN << (sizeclass))
+#define SIZECLASS_SIZE(sizeclass) HEAP_SIZECLASS_SIZE(sizeclass)
 #define SIZECLASS_MASK(sizeclass) (~(SIZECLASS_SIZE(sizeclass) - 1))
 
-#define EXTERNAL_PTR(p, sizeclass) \
-  ((void*)((uintptr_t)p & SIZECLASS_MASK(sizeclass)))
+// Small chunks have a slot bit for every HEAP_MIN bytes, medium chunks for
+// every POOL_ALIGN bytes.
+#define SIZECLASS_SHIFT(sizeclass) \
+  (((sizeclass) < HEAP_SIZECLASSES) ? HEAP_MINBITS : HEAP_MEDIUMMINBITS)
+
+#define SIZECLASS_CHUNK(sizeclass) \
+  (((sizeclass) < HEAP_SIZECLASSES) ? sizeof(block_t) : HEAP_SLAB)
 
-#define FIND_SLOT(ext, base) \
-  (1 << ((uintptr_t)((char*)(ext) - (char*)(base)) >> HEAP_MINBITS))
+// Small chunks are aligned on their size, but medium chunks are only aligned
+// on POOL_ALIGN, so the external pointer is found relative to the chunk.
+#define EXTERNAL_PTR(p, base, sizeclass) \
+  ((void*)((char*)(base) + \
+    ((uintptr_t)((char*)(p) - (char*)(base)) & SIZECLASS_MASK(sizeclass))))
 
-static const uint32_t sizeclass_empty[HEAP_SIZECLASSES] =
+#define FIND_SLOT(ext, base, sizeclass) \
+  (1 << ((uintptr_t)((char*)(ext) - (char*)(base)) >> \
+    SIZECLASS_SHIFT(sizeclass)))
+
+static const uint32_t sizeclass_empty[HEAP_SLABCLASSES] =
 {
+  0xFFFFFFFF,
+  0x55555555,
+  0x11111111,
+  0x01010101,
+  0x00010001,
+
   0xFFFFFFFF,
   0x55555555,
   0x11111111,
@@ -41,8 +73,14 @@ static const uint32_t sizeclass_empty[HEAP_SIZECLASSES] =
   0x00010001
 };
 
-static const uint32_t sizeclass_init[HEAP_SIZECLASSES] =
+static const uint32_t sizeclass_init[HEAP_SLABCLASSES] =
 {
+  0xFFFFFFFE,
+  0x55555554,
+  0x11111110,
+  0x01010100,
+  0x00010000,
+
   0xFFFFFFFE,
   0x55555554,
   0x11111110,
@@ -56,8 +94,18 @@ static const uint8_t sizeclass_table[HEAP_MAX / HEAP_MIN] =
   4, 4, 4, 4, 4, 4, 4, 4
 };
 
+// Every page of the frozen region maps to this chunk, which has no owner.
+static chunk_t frozen_chunk;
+static char* frozen_next;
+static char* frozen_end;
+static uint32_t volatile frozen_lock;
+
 static size_t heap_initialgc = 1 << 14;
 static double heap_nextgc_factor = 2.0;
+static uint64_t heap_gcslice = 0;
+static double heap_gcpace = 0.0;
+static size_t heap_gcmax = 0;
+static size_t heap_nursery = 0;
 
 static void large_pagemap(char* m, size_t size, chunk_t* chunk)
 {
@@ -74,18 +122,41 @@ static void clear_small(chunk_t* chunk)
 {
   chunk->slots = sizeclass_empty[chunk->size];
   chunk->shallow = chunk->slots;
+  chunk->young = 0;
+  chunk->remembered = 0;
 }
 
 static void clear_large(chunk_t* chunk)
 {
   chunk->slots = 1;
   chunk->shallow = 1;
+  chunk->young = 0;
+  chunk->remembered = 0;
+}
+
+/**
+ * Clears the marks on young slots only. Old objects stay marked, so a minor
+ * pass doesn't trace through them or free them.
+ */
+static void clear_young(chunk_t* chunk)
+{
+  chunk->slots |= chunk->young;
+  chunk->shallow = chunk->slots;
+  chunk->young = 0;
+  chunk->remembered = 0;
 }
 
 static void destroy_small(chunk_t* chunk)
 {
-  pagemap_set(chunk->m, NULL);
-  POOL_FREE(block_t, chunk->m);
+  if(chunk->size < HEAP_SIZECLASSES)
+  {
+    pagemap_set(chunk->m, NULL);
+    POOL_FREE(block_t, chunk->m);
+  } else {
+    large_pagemap(chunk->m, HEAP_SLAB, NULL);
+    pool_free_size(HEAP_SLAB, chunk->m);
+  }
+
   POOL_FREE(chunk_t, chunk);
 }
 
@@ -99,60 +170,107 @@ static void destroy_large(chunk_t* chunk)
   POOL_FREE(chunk_t, chunk);
 }
 
-static size_t sweep_small(chunk_t* chunk, chunk_t** avail, chunk_t** full,
-  uint32_t empty)
+static size_t sweep_chunk(heap_t* heap, chunk_t* chunk)
+{
+  chunk->slots &= chunk->shallow;
+
+  // Everything that survives is old. Anything allocated in a free slot before
+  // the next pass is young.
+  chunk->young = chunk->slots;
+
+  if(chunk->size >= HEAP_SLABCLASSES)
+  {
+    if(chunk->slots != 0)
+    {
+      destroy_large(chunk);
+      return 0;
+    }
+
+    chunk->next = heap->large;
+    heap->large = chunk;
+    return chunk->size;
+  }
+
+  uint32_t sizeclass = (uint32_t)chunk->size;
+
+  if(chunk->slots == 0)
+  {
+    chunk->next = heap->small_full[sizeclass];
+    heap->small_full[sizeclass] = chunk;
+    return SIZECLASS_CHUNK(sizeclass);
+  }
+
+  if(chunk->slots == sizeclass_empty[sizeclass])
+  {
+    destroy_small(chunk);
+    return 0;
+  }
+
+  chunk->next = heap->small_free[sizeclass];
+  heap->small_free[sizeclass] = chunk;
+
+  return SIZECLASS_CHUNK(sizeclass) -
+    (__pony_popcount(chunk->slots) * SIZECLASS_SIZE(sizeclass));
+}
+
+/**
+ * Orders a free list so that the fullest chunks are allocated from first.
+ * Sparse chunks then tend to empty out and be freed by a later sweep, rather
+ * than each holding on to memory for a few long lived objects.
+ */
+static chunk_t* order_free(chunk_t* chunk, uint32_t empty)
 {
-  size_t used = 0;
+  uint32_t half = __pony_popcount(empty) / 2;
+  chunk_t* dense = NULL;
+  chunk_t* sparse = NULL;
+  chunk_t** dense_tail = &dense;
+  chunk_t** sparse_tail = &sparse;
   chunk_t* next;
 
   while(chunk != NULL)
   {
     next = chunk->next;
-    chunk->slots &= chunk->shallow;
 
-    if(chunk->slots == 0)
+    if((uint32_t)__pony_popcount(chunk->slots) <= half)
     {
-      used += sizeof(block_t);
-      chunk->next = *full;
-      *full = chunk;
-    } else if(chunk->slots == empty) {
-      destroy_small(chunk);
+      *dense_tail = chunk;
+      dense_tail = &chunk->next;
     } else {
-      used += sizeof(block_t) -
-        (__pony_popcount(chunk->slots) * SIZECLASS_SIZE(chunk->size));
-      chunk->next = *avail;
-      *avail = chunk;
+      *sparse_tail = chunk;
+      sparse_tail = &chunk->next;
     }
 
     chunk = next;
   }
 
-  return used;
+  *sparse_tail = NULL;
+  *dense_tail = sparse;
+  return dense;
 }
 
-static chunk_t* sweep_large(chunk_t* chunk, size_t* used)
+/**
+ * Clears the marks on every chunk in a list and moves it to the unswept list.
+ * A minor pass only clears the marks on young slots.
+ */
+static void unsweep_list(heap_t* heap, chunk_t* chunk, bool minor)
 {
-  chunk_t* list = NULL;
   chunk_t* next;
 
   while(chunk != NULL)
   {
     next = chunk->next;
-    chunk->slots &= chunk->shallow;
 
-    if(chunk->slots == 0)
-    {
-      chunk->next = list;
-      list = chunk;
-      *used += chunk->size;
-    } else {
-      destroy_large(chunk);
-    }
+    if(minor)
+      clear_young(chunk);
+    else if(chunk->size >= HEAP_SLABCLASSES)
+      clear_large(chunk);
+    else
+      clear_small(chunk);
 
+    chunk->next = heap->unswept;
+    heap->unswept = chunk;
     chunk = next;
   }
-
-  return list;
 }
 
 static void chunk_list(chunk_fn f, chunk_t* current)
@@ -167,11 +285,28 @@ static void chunk_list(chunk_fn f, chunk_t* current)
   }
 }
 
+static void set_nextgc(heap_t* heap)
+{
+  heap->next_gc = (size_t)((double)heap->used * heap->gc_factor *
+    heap->gc_pace);
+
+  if((heap_gcmax > 0) && (heap->next_gc > heap_gcmax))
+    heap->next_gc = heap_gcmax;
+
+  if(heap->next_gc < heap->initial_gc)
+    heap->next_gc = heap->initial_gc;
+}
+
 uint32_t heap_index(size_t size)
 {
   // size is in range 1..HEAP_MAX
   // change to 0..((HEAP_MAX / HEAP_MIN) - 1) and look up in table
-  return sizeclass_table[(size - 1) >> HEAP_MINBITS];
+  if(size <= HEAP_MAX)
+    return sizeclass_table[(size - 1) >> HEAP_MINBITS];
+
+  // size is in range (HEAP_MAX + 1)..HEAP_MEDIUMMAX, one class per power of 2
+  uint32_t bits = (uint32_t)__pony_ffsl(next_pow2(size)) - 1;
+  return HEAP_SIZECLASSES + bits - HEAP_MEDIUMMINBITS;
 }
 
 void heap_setinitialgc(size_t size)
@@ -187,17 +322,106 @@ void heap_setnextgcfactor(double factor)
   heap_nextgc_factor = factor;
 }
 
+void heap_setgcslice(uint64_t slice)
+{
+  heap_gcslice = slice;
+}
+
+void heap_setgcpace(double share)
+{
+  heap_gcpace = share;
+}
+
+void heap_setgcmax(size_t size)
+{
+  heap_gcmax = size;
+}
+
+void heap_setnursery(size_t size)
+{
+  heap_nursery = (size > 0) ? ((size_t)1 << size) : 0;
+}
+
+bool heap_nurseryon()
+{
+  return heap_nursery > 0;
+}
+
 void heap_init(heap_t* heap)
 {
   memset(heap, 0, sizeof(heap_t));
+  heap->initial_gc = heap_initialgc;
+  heap->gc_factor = heap_nextgc_factor;
+  heap->gc_pace = 1.0;
   heap->next_gc = heap_initialgc;
+  heap->next_minor = heap_nursery;
+}
+
+void heap_setpolicy(heap_t* heap, size_t initial, double factor)
+{
+  if(initial > 0)
+    heap->initial_gc = initial;
+
+  if(factor > 0.0)
+    heap->gc_factor = (factor < 1.0) ? 1.0 : factor;
+
+  set_nextgc(heap);
+}
+
+void heap_pace(heap_t* heap, uint64_t gc, uint64_t now)
+{
+  if(heap_gcpace <= 0.0)
+    return;
+
+  uint64_t last = heap->gc_tsc;
+  heap->gc_tsc = now;
+
+  // Nothing to measure against on the first pass.
+  if((last == 0) || (now <= last))
+    return;
+
+  double share = (double)gc / (double)(now - last);
+
+  if(share > heap_gcpace)
+  {
+    heap->gc_pace *= 2.0;
+
+    if(heap->gc_pace > HEAP_PACEMAX)
+      heap->gc_pace = HEAP_PACEMAX;
+  } else if(share < (heap_gcpace / 2.0)) {
+    heap->gc_pace /= 2.0;
+
+    if(heap->gc_pace < 1.0)
+      heap->gc_pace = 1.0;
+  }
+
+  // If the sweep is done, next_gc was set without the new pace.
+  if(heap->unswept == NULL)
+    set_nextgc(heap);
 }
 
 void heap_destroy(heap_t* heap)
 {
+  heapprof_free(heap);
   chunk_list(destroy_large, heap->large);
 
-  for(int i = 0; i < HEAP_SIZECLASSES; i++)
+  // The unswept list holds chunks of every size.
+  chunk_t* chunk = heap->unswept;
+  chunk_t* next;
+
+  while(chunk != NULL)
+  {
+    next = chunk->next;
+
+    if(chunk->size >= HEAP_SLABCLASSES)
+      destroy_large(chunk);
+    else
+      destroy_small(chunk);
+
+    chunk = next;
+  }
+
+  for(int i = 0; i < HEAP_SLABCLASSES; i++)
   {
     chunk_list(destroy_small, heap->small_free[i]);
     chunk_list(destroy_small, heap->small_full[i]);
@@ -209,7 +433,7 @@ void* heap_alloc(pony_actor_t* actor, heap_t* heap, size_t size)
   if(size == 0)
   {
     return NULL;
-  } else if(size <= HEAP_MAX) {
+  } else if(size <= HEAP_MEDIUMMAX) {
     return heap_alloc_small(actor, heap, heap_index(size));
   } else {
     return heap_alloc_large(actor, heap, size);
@@ -219,9 +443,30 @@ void* heap_alloc(pony_actor_t* actor, heap_t* heap, size_t size)
 void* heap_alloc_small(pony_actor_t* actor, heap_t* heap,
   uint32_t sizeclass)
 {
-  chunk_t* chunk = heap->small_free[sizeclass];
   void* m;
 
+  // A small chunk made since the last gc pass is handed out in address order
+  // without touching its slot bits. It sits on the full list, and the gc pass
+  // rebuilds its slot bits when it marks the heap.
+  if(sizeclass < HEAP_SIZECLASSES)
+  {
+    char* bump = heap->bump[sizeclass];
+
+    if(bump != NULL)
+    {
+      char* next = bump + SIZECLASS_SIZE(sizeclass);
+
+      if(((uintptr_t)next & (POOL_ALIGN - 1)) == 0)
+        next = NULL;
+
+      heap->bump[sizeclass] = next;
+      heap->used += SIZECLASS_SIZE(sizeclass);
+      return bump;
+    }
+  }
+
+  chunk_t* chunk = heap->small_free[sizeclass];
+
   // If there are none in this size class, get a new one.
   if(chunk != NULL)
   {
@@ -230,7 +475,7 @@ void* heap_alloc_small(pony_actor_t* actor, heap_t* heap,
     uint32_t bit = __pony_ffs(slots) - 1;
     slots &= ~(1 << bit);
 
-    m = chunk->m + (bit << HEAP_MINBITS);
+    m = chunk->m + (bit << SIZECLASS_SHIFT(sizeclass));
     chunk->slots = slots;
 
     if(slots == 0)
@@ -242,20 +487,31 @@ void* heap_alloc_small(pony_actor_t* actor, heap_t* heap,
   } else {
     chunk_t* n = (chunk_t*) POOL_ALLOC(chunk_t);
     n->actor = actor;
-    n->m = (char*) POOL_ALLOC(block_t);
     n->size = sizeclass;
 
     // Clear the first bit.
     n->shallow = n->slots = sizeclass_init[sizeclass];
+    n->young = sizeclass_empty[sizeclass];
+    n->remembered = 0;
     n->next = NULL;
 
-    pagemap_set(n->m, n);
+    if(sizeclass < HEAP_SIZECLASSES)
+    {
+      n->m = (char*) POOL_ALLOC(block_t);
+      pagemap_set(n->m, n);
 
-    heap->small_free[sizeclass] = n;
-    chunk = n;
+      // Bump allocate the rest of the chunk.
+      n->next = heap->small_full[sizeclass];
+      heap->small_full[sizeclass] = n;
+      heap->bump[sizeclass] = n->m + SIZECLASS_SIZE(sizeclass);
+    } else {
+      n->m = (char*) pool_alloc_size(HEAP_SLAB);
+      large_pagemap(n->m, HEAP_SLAB, n);
+      heap->small_free[sizeclass] = n;
+    }
 
     // Use the first slot.
-    m = chunk->m;
+    m = n->m;
   }
 
   heap->used += SIZECLASS_SIZE(sizeclass);
@@ -272,6 +528,8 @@ void* heap_alloc_large(pony_actor_t* actor, heap_t* heap, size_t size)
   chunk->m = (char*) pool_alloc_size(size);
   chunk->slots = 0;
   chunk->shallow = 0;
+  chunk->young = 1;
+  chunk->remembered = 0;
 
   large_pagemap(chunk->m, size, chunk);
 
@@ -282,6 +540,38 @@ void* heap_alloc_large(pony_actor_t* actor, heap_t* heap, size_t size)
   return chunk->m;
 }
 
+void* heap_alloc_frozen(size_t size)
+{
+  size = (size + HEAP_MIN - 1) & ~(HEAP_MIN - 1);
+  char* m;
+
+  // Large allocations get memory of their own, rather than wasting the rest of
+  // a slab.
+  if(size > (HEAP_SLAB >> 2))
+  {
+    size = pool_adjust_size(size);
+    m = (char*)pool_alloc_size(size);
+    large_pagemap(m, size, &frozen_chunk);
+    return m;
+  }
+
+  while(_atomic_exchange(&frozen_lock, 1) != 0)
+    ;
+
+  if((frozen_next == NULL) || ((size_t)(frozen_end - frozen_next) < size))
+  {
+    // The rest of the last slab is never used.
+    frozen_next = (char*)pool_alloc_size(HEAP_SLAB);
+    frozen_end = frozen_next + HEAP_SLAB;
+    large_pagemap(frozen_next, HEAP_SLAB, &frozen_chunk);
+  }
+
+  m = frozen_next;
+  frozen_next += size;
+  _atomic_store(&frozen_lock, 0);
+  return m;
+}
+
 void* heap_realloc(pony_actor_t* actor, heap_t* heap, void* p, size_t size)
 {
   if(p == NULL)
@@ -289,7 +579,7 @@ void* heap_realloc(pony_actor_t* actor, heap_t* heap, void* p, size_t size)
 
   chunk_t* chunk = (chunk_t*)pagemap_get(p);
 
-  if(chunk == NULL)
+  if((chunk == NULL) || (chunk == &frozen_chunk))
   {
     // Get new memory and copy from the old memory.
     void* q = heap_alloc(actor, heap, size);
@@ -297,10 +587,10 @@ void* heap_realloc(pony_actor_t* actor, heap_t* heap, void* p, size_t size)
     return q;
   }
 
-  if(chunk->size < HEAP_SIZECLASSES)
+  if(chunk->size < HEAP_SLABCLASSES)
   {
     // Previous allocation was a heap_alloc_small.
-    if(size <= HEAP_MAX)
+    if(size <= HEAP_MEDIUMMAX)
     {
       uint32_t sizeclass = heap_index(size);
 
@@ -319,6 +609,30 @@ void* heap_realloc(pony_actor_t* actor, heap_t* heap, void* p, size_t size)
   if(size <= chunk->size)
     return p;
 
+  // Try to grow the allocation into the free pages after it or, if it is huge,
+  // by remapping its pages, before falling back to a copy.
+  if(p == chunk->m)
+  {
+    size = pool_adjust_size(size);
+    char* q = (char*)pool_grow_size(chunk->size, size, chunk->m);
+
+    if(q != NULL)
+    {
+      if(q != chunk->m)
+      {
+        large_pagemap(chunk->m, chunk->size, NULL);
+        large_pagemap(q, size, chunk);
+      } else {
+        large_pagemap(q + chunk->size, size - chunk->size, chunk);
+      }
+
+      heap->used += size - chunk->size;
+      chunk->m = q;
+      chunk->size = size;
+      return q;
+    }
+  }
+
   // Get new memory and copy from the old memory.
   void* q = heap_alloc(actor, heap, size);
   memcpy(q, p, chunk->size);
@@ -328,23 +642,98 @@ void* heap_realloc(pony_actor_t* actor, heap_t* heap, void* p, size_t size)
 void heap_used(heap_t* heap, size_t size)
 {
   heap->used += size;
+  heap->foreign += size;
 }
 
-bool heap_startgc(heap_t* heap)
+/**
+ * Moves every chunk to the unswept list, clearing all marks or, for a minor
+ * pass, only those on young slots.
+ */
+static void unsweep_all(heap_t* heap, bool minor)
 {
-  if(heap->used <= heap->next_gc)
-    return false;
-
-  for(int i = 0; i < HEAP_SIZECLASSES; i++)
+  for(int i = 0; i < HEAP_SLABCLASSES; i++)
   {
-    chunk_list(clear_small, heap->small_free[i]);
-    chunk_list(clear_small, heap->small_full[i]);
+    unsweep_list(heap, heap->small_free[i], minor);
+    unsweep_list(heap, heap->small_full[i], minor);
+    heap->small_free[i] = NULL;
+    heap->small_full[i] = NULL;
   }
 
-  chunk_list(clear_large, heap->large);
+  unsweep_list(heap, heap->large, minor);
+  heap->large = NULL;
+
+  // Marking rebuilds the slot bits of chunks that were bump allocated.
+  memset(heap->bump, 0, sizeof(heap->bump));
+  heap->swept = 0;
+}
+
+bool heap_startgc(heap_t* heap, bool force)
+{
+  // Finish the sweep from the last pass first, since it sets next_gc.
+  heap_sweep(heap, true);
+
+  if(!force && (heap->used <= heap->next_gc))
+    return false;
+
+  // Clear the marks on every chunk and move them all to the unswept list.
+  // Chunks allocated from here on are not part of this pass.
+  unsweep_all(heap, false);
 
   // reset used to zero
   heap->used = 0;
+  heap->foreign = 0;
+  heap->minor = false;
+  return true;
+}
+
+bool heap_startminor(heap_t* heap)
+{
+  if((heap_nursery == 0) || heap_sweeping(heap) ||
+    (heap->used <= heap->next_minor))
+    return false;
+
+  unsweep_all(heap, true);
+
+  // Foreign objects aren't traced again, so keep the figure from the last
+  // full pass. The sweep adds the local objects that are still live.
+  heap->used = heap->foreign;
+  heap->minor = true;
+  return true;
+}
+
+bool heap_isyoung(chunk_t* chunk, void* p)
+{
+  if(chunk->size >= HEAP_SLABCLASSES)
+    return chunk->young != 0;
+
+  void* ext = EXTERNAL_PTR(p, chunk->m, chunk->size);
+  uint32_t slot = FIND_SLOT(ext, chunk->m, chunk->size);
+  return (chunk->young & slot) != 0;
+}
+
+bool heap_remember(chunk_t* chunk, void* p)
+{
+  uint32_t slot = 1;
+
+  // An internal pointer, such as an embedded field, is traced with a different
+  // function than the object around it, so it is always remembered.
+  if(chunk->size >= HEAP_SLABCLASSES)
+  {
+    if(p != chunk->m)
+      return true;
+  } else {
+    void* ext = EXTERNAL_PTR(p, chunk->m, chunk->size);
+
+    if(p != ext)
+      return true;
+
+    slot = FIND_SLOT(ext, chunk->m, chunk->size);
+  }
+
+  if((chunk->remembered & slot) != 0)
+    return false;
+
+  chunk->remembered |= slot;
   return true;
 }
 
@@ -355,7 +744,7 @@ bool heap_mark(chunk_t* chunk, void* p)
   // external pointer in the same pass.
   bool marked;
 
-  if(chunk->size >= HEAP_SIZECLASSES)
+  if(chunk->size >= HEAP_SLABCLASSES)
   {
     marked = chunk->slots == 0;
 
@@ -365,10 +754,10 @@ bool heap_mark(chunk_t* chunk, void* p)
       chunk->shallow = 0;
   } else {
     // Calculate the external pointer.
-    void* ext = EXTERNAL_PTR(p, chunk->size);
+    void* ext = EXTERNAL_PTR(p, chunk->m, chunk->size);
 
     // Shift to account for smallest allocation size.
-    uint32_t slot = FIND_SLOT(ext, chunk->m);
+    uint32_t slot = FIND_SLOT(ext, chunk->m, chunk->size);
 
     // Check if it was already marked.
     marked = (chunk->slots & slot) == 0;
@@ -385,15 +774,15 @@ bool heap_mark(chunk_t* chunk, void* p)
 
 void heap_mark_shallow(chunk_t* chunk, void* p)
 {
-  if(chunk->size >= HEAP_SIZECLASSES)
+  if(chunk->size >= HEAP_SLABCLASSES)
   {
     chunk->shallow = 0;
   } else {
     // Calculate the external pointer.
-    void* ext = EXTERNAL_PTR(p, chunk->size);
+    void* ext = EXTERNAL_PTR(p, chunk->m, chunk->size);
 
     // Shift to account for smallest allocation size.
-    uint32_t slot = FIND_SLOT(ext, chunk->m);
+    uint32_t slot = FIND_SLOT(ext, chunk->m, chunk->size);
 
     // A clear bit is in-use, a set bit is available.
     chunk->shallow &= ~slot;
@@ -402,19 +791,53 @@ void heap_mark_shallow(chunk_t* chunk, void* p)
 
 bool heap_ismarked(chunk_t* chunk, void* p)
 {
-  if(chunk->size >= HEAP_SIZECLASSES)
+  if(chunk->size >= HEAP_SLABCLASSES)
     return (chunk->slots & chunk->shallow) == 0;
 
   // Shift to account for smallest allocation size.
-  uint32_t slot = FIND_SLOT(p, chunk->m);
+  uint32_t slot = FIND_SLOT(p, chunk->m, chunk->size);
 
   // Check if the slot is marked or shallow marked.
   return (chunk->slots & chunk->shallow & slot) == 0;
 }
 
+void* heap_base(chunk_t* chunk, void* p)
+{
+  if(chunk->size >= HEAP_SLABCLASSES)
+    return chunk->m;
+
+  return EXTERNAL_PTR(p, chunk->m, chunk->size);
+}
+
+void heap_live(heap_t* heap, size_t* count, size_t* bytes)
+{
+  *count = 0;
+  *bytes = 0;
+
+  // Every chunk is waiting to be swept, and a clear bit in either set of marks
+  // is a live allocation.
+  for(chunk_t* chunk = heap->unswept; chunk != NULL; chunk = chunk->next)
+  {
+    if(chunk->size >= HEAP_SLABCLASSES)
+    {
+      if((chunk->m != NULL) && ((chunk->slots & chunk->shallow) == 0))
+      {
+        (*count)++;
+        *bytes += chunk->size;
+      }
+    } else {
+      uint32_t live = sizeclass_empty[chunk->size] &
+        ~(chunk->slots & chunk->shallow);
+      size_t n = __pony_popcount(live);
+      *count += n;
+      *bytes += n * SIZECLASS_SIZE(chunk->size);
+    }
+  }
+}
+
 void heap_free(chunk_t* chunk, void* p)
 {
-  if(chunk->size >= HEAP_SIZECLASSES)
+  if(chunk->size >= HEAP_SLABCLASSES)
   {
     if(p == chunk->m)
     {
@@ -426,12 +849,12 @@ void heap_free(chunk_t* chunk, void* p)
   }
 
   // Calculate the external pointer.
-  void* ext = EXTERNAL_PTR(p, chunk->size);
+  void* ext = EXTERNAL_PTR(p, chunk->m, chunk->size);
 
   if(p == ext)
   {
     // Shift to account for smallest allocation size.
-    uint32_t slot = FIND_SLOT(ext, chunk->m);
+    uint32_t slot = FIND_SLOT(ext, chunk->m, chunk->size);
 
     chunk->slots |= slot;
   }
@@ -439,33 +862,55 @@ void heap_free(chunk_t* chunk, void* p)
 
 void heap_endgc(heap_t* heap)
 {
-  size_t used = 0;
+  heap_sweep(heap, heap_gcslice == 0);
+}
 
-  for(int i = 0; i < HEAP_SIZECLASSES; i++)
-  {
-    chunk_t* list1 = heap->small_free[i];
-    chunk_t* list2 = heap->small_full[i];
+bool heap_sweeping(heap_t* heap)
+{
+  return heap->unswept != NULL;
+}
 
-    heap->small_free[i] = NULL;
-    heap->small_full[i] = NULL;
+void heap_sweep(heap_t* heap, bool finish)
+{
+  if(heap->unswept == NULL)
+    return;
+
+  uint64_t end = finish ? 0 : cpu_tick() + heap_gcslice;
+  chunk_t* chunk = heap->unswept;
+  chunk_t* next;
+  size_t count = 0;
 
-    chunk_t** avail = &heap->small_free[i];
-    chunk_t** full = &heap->small_full[i];
+  while(chunk != NULL)
+  {
+    next = chunk->next;
+    heap->swept += sweep_chunk(heap, chunk);
+    chunk = next;
 
-    used += sweep_small(list1, avail, full, sizeclass_empty[i]);
-    used += sweep_small(list2, avail, full, sizeclass_empty[i]);
+    // Only read the clock every so often, sweeping a chunk is cheap.
+    if(!finish && ((++count % HEAP_SWEEPCHECK) == 0) && (cpu_tick() >= end))
+      break;
   }
 
-  heap->large = sweep_large(heap->large, &used);
+  heap->unswept = chunk;
+
+  if(chunk != NULL)
+    return;
 
   // Foreign object sizes will have been added to heap->used already. Here we
   // add local object sizes as well and set the next gc point for when memory
   // usage has increased.
-  heap->used += used;
-  heap->next_gc = (size_t)((double)heap->used * heap_nextgc_factor);
+  for(int i = 0; i < HEAP_SLABCLASSES; i++)
+    heap->small_free[i] = order_free(heap->small_free[i], sizeclass_empty[i]);
+
+  heap->used += heap->swept;
+  heap->swept = 0;
+
+  // A minor pass leaves the full gc point where it was.
+  if(!heap->minor)
+    set_nextgc(heap);
 
-  if(heap->next_gc < heap_initialgc)
-    heap->next_gc = heap_initialgc;
+  heap->minor = false;
+  heap->next_minor = heap->used + heap_nursery;
 }
 
 pony_actor_t* heap_owner(chunk_t* chunk)
@@ -482,7 +927,7 @@ pony_actor_t* heap_owner(chunk_t* chunk)
 
 size_t heap_size(chunk_t* chunk)
 {
-  if(chunk->size >= HEAP_SIZECLASSES)
+  if(chunk->size >= HEAP_SLABCLASSES)
     return chunk->size;
 
   return SIZECLASS_SIZE(chunk->size);
@@ -15,26 +15,115 @@ PONY_EXTERN_C_BEGIN
 #define HEAP_MIN (1 << HEAP_MINBITS)
 #define HEAP_MAX (1 << HEAP_MAXBITS)
 
+// Medium size classes are carved from slabs of HEAP_SLAB bytes, with a slot
+// for every POOL_ALIGN bytes.
+#define HEAP_MEDIUMMINBITS POOL_ALIGN_BITS
+#define HEAP_MEDIUMMAXBITS (POOL_ALIGN_BITS + 4)
+#define HEAP_MEDIUMCLASSES (HEAP_MEDIUMMAXBITS - HEAP_MEDIUMMINBITS + 1)
+#define HEAP_MEDIUMMAX (1 << HEAP_MEDIUMMAXBITS)
+#define HEAP_SLAB (32 << POOL_ALIGN_BITS)
+
+// Small and medium size classes, indexed by heap_index().
+#define HEAP_SLABCLASSES (HEAP_SIZECLASSES + HEAP_MEDIUMCLASSES)
+
+#define HEAP_SIZECLASS_SIZE(sizeclass) \
+  (((sizeclass) < HEAP_SIZECLASSES) ? (HEAP_MIN << (sizeclass)) : \
+    (POOL_ALIGN << ((sizeclass) - HEAP_SIZECLASSES)))
+
 typedef struct chunk_t chunk_t;
 
+typedef struct heapsample_t heapsample_t;
+
 typedef struct heap_t
 {
-  chunk_t* small_free[HEAP_SIZECLASSES];
-  chunk_t* small_full[HEAP_SIZECLASSES];
+  chunk_t* small_free[HEAP_SLABCLASSES];
+  chunk_t* small_full[HEAP_SLABCLASSES];
   chunk_t* large;
 
+  // The next free address in the newest chunk of each small size class, or
+  // NULL once it is used up or a gc pass has started.
+  char* bump[HEAP_SIZECLASSES];
+
+  // Chunks of every size left to sweep after the last gc pass.
+  chunk_t* unswept;
+
   size_t used;
   size_t next_gc;
+  size_t swept;
+
+  // The actor's gc policy, and the pacing mode's stretch of its factor.
+  size_t initial_gc;
+  double gc_factor;
+  double gc_pace;
+  uint64_t gc_tsc;
+
+  // Allocations picked by the heap profiler that are still live.
+  heapsample_t* sampled;
+
+  // The foreign memory counted by the last full pass, which a minor pass
+  // keeps, and the used figure that starts the next minor pass.
+  size_t foreign;
+  size_t next_minor;
+  bool minor;
 } heap_t;
 
+/**
+ * The size class for an allocation of 1 to HEAP_MEDIUMMAX bytes.
+ */
 uint32_t heap_index(size_t size);
 
 void heap_setinitialgc(size_t size);
 
 void heap_setnextgcfactor(double factor);
 
+/**
+ * Sets the most cycles a sweep takes before the actor goes back to handling
+ * messages. The rest of the sweep is done after later behaviours. Zero, the
+ * default, sweeps the whole heap at the end of each gc pass.
+ */
+void heap_setgcslice(uint64_t slice);
+
+/**
+ * Sets the share of an actor's time, from 0 to 1, that the pacing mode aims
+ * to spend in gc. An actor that spends more lets its heap grow further before
+ * the next pass, and one that spends much less returns towards its own gc
+ * factor. Zero, the default, turns pacing off.
+ */
+void heap_setgcpace(double share);
+
+/**
+ * Sets the most an actor's heap may grow to before its next gc pass, however
+ * far its gc factor and pacing would let it grow. Zero, the default, sets no
+ * cap.
+ */
+void heap_setgcmax(size_t size);
+
+/**
+ * Sets the nursery to 2^size bytes. Once that much has been allocated since
+ * the last pass, a minor pass collects the objects allocated since then
+ * without tracing older ones. Zero, the default, turns minor passes off.
+ */
+void heap_setnursery(size_t size);
+
+/**
+ * Returns true if minor passes are on, and write barriers must be kept.
+ */
+bool heap_nurseryon();
+
 void heap_init(heap_t* heap);
 
+/**
+ * Overrides the initial gc threshold and the next gc factor for one heap. A
+ * zero leaves that setting at the runtime default.
+ */
+void heap_setpolicy(heap_t* heap, size_t initial, double factor);
+
+/**
+ * Tells the pacing mode that a gc pass finished at now, having taken gc
+ * cycles.
+ */
+void heap_pace(heap_t* heap, uint64_t gc, uint64_t now);
+
 void heap_destroy(heap_t* heap);
 
 __pony_spec_malloc__(
@@ -50,6 +139,14 @@ __pony_spec_malloc__(
 void* heap_alloc_large(pony_actor_t* actor, heap_t* heap, size_t size)
   );
 
+/**
+ * Allocates memory in the frozen region, which is shared by every actor and
+ * never collected. Its chunk has no owner.
+ */
+__pony_spec_malloc__(
+void* heap_alloc_frozen(size_t size)
+  );
+
 void* heap_realloc(pony_actor_t* actor, heap_t* heap, void* p, size_t size);
 
 /**
@@ -58,7 +155,28 @@ void* heap_realloc(pony_actor_t* actor, heap_t* heap, void* p, size_t size);
  */
 void heap_used(heap_t* heap, size_t size);
 
-bool heap_startgc(heap_t* heap);
+/**
+ * Starts a full pass if one is due, or regardless if force is true. The marks
+ * on every chunk are cleared.
+ */
+bool heap_startgc(heap_t* heap, bool force);
+
+/**
+ * Starts a minor pass if one is due. Only the marks on young objects are
+ * cleared, so old objects are kept and are not traced through.
+ */
+bool heap_startminor(heap_t* heap);
+
+/**
+ * Returns true if the address was allocated since the chunk was last swept.
+ */
+bool heap_isyoung(chunk_t* chunk, void* p);
+
+/**
+ * Notes that an object has been added to the remembered set. Returns false if
+ * it was already there.
+ */
+bool heap_remember(chunk_t* chunk, void* p);
 
 /**
  * Mark an address in a chunk. Returns true if it was already marked, or false
@@ -77,13 +195,40 @@ void heap_mark_shallow(chunk_t* chunk, void* p);
  */
 bool heap_ismarked(chunk_t* chunk, void* p);
 
+/**
+ * Returns the start of the allocation that contains an address.
+ */
+void* heap_base(chunk_t* chunk, void* p);
+
+/**
+ * Adds up the allocations a full gc pass has marked, and the bytes in them.
+ * Must be called after marking, before the heap is swept.
+ */
+void heap_live(heap_t* heap, size_t* count, size_t* bytes);
+
 /**
  * Forcibly free this address.
  */
 void heap_free(chunk_t* chunk, void* p);
 
+/**
+ * Starts sweeping after a gc pass has marked the heap. With a gc slice set,
+ * the sweep may be left unfinished.
+ */
 void heap_endgc(heap_t* heap);
 
+/**
+ * Returns true if a sweep is still in progress.
+ */
+bool heap_sweeping(heap_t* heap);
+
+/**
+ * Continues a sweep for one gc slice, or until it is done if finish is true.
+ * Chunks allocated since the gc pass are not swept and remain usable
+ * throughout.
+ */
+void heap_sweep(heap_t* heap, bool finish);
+
 pony_actor_t* heap_owner(chunk_t* chunk);
 
 size_t heap_size(chunk_t* chunk);
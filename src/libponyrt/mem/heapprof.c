@@ -0,0 +1,301 @@
+#include "heapprof.h"
+#include "pagemap.h"
+#include "pool.h"
+#include <string.h>
+#include <stdint.h>
+
+#if defined(PLATFORM_IS_POSIX_BASED)
+#  include <execinfo.h>
+#  include <signal.h>
+#  include <unistd.h>
+#elif defined(PLATFORM_IS_WINDOWS)
+#  include <windows.h>
+#endif
+
+// The most frames kept for a sample. The frame for heapprof_sample() itself is
+// left off, so a backtrace starts at the pony_alloc function that sampled.
+#define HEAPPROF_DEPTH 32
+#define HEAPPROF_SKIP 1
+#define HEAPPROF_BUCKETS 4096
+
+typedef struct bucket_t
+{
+  struct bucket_t* next;
+  size_t hash;
+  size_t alloc_objects;
+  size_t alloc_bytes;
+  size_t live_objects;
+  size_t live_bytes;
+  uint32_t depth;
+  void* pc[HEAPPROF_DEPTH];
+} bucket_t;
+
+struct heapsample_t
+{
+  struct heapsample_t* next;
+  void* p;
+  size_t size;
+  bucket_t* bucket;
+};
+
+static size_t heapprof_rate = 0;
+static bucket_t* buckets[HEAPPROF_BUCKETS];
+static uint32_t volatile heapprof_lock;
+
+#if defined(PLATFORM_IS_POSIX_BASED)
+static int volatile heapprof_request;
+static uint32_t heapprof_seq;
+
+static void signal_handler(int sig)
+{
+  (void)sig;
+  heapprof_request = 1;
+}
+#endif
+
+static void lock()
+{
+  while(_atomic_exchange(&heapprof_lock, 1) != 0)
+    ;
+}
+
+static void unlock()
+{
+  _atomic_store(&heapprof_lock, 0);
+}
+
+static size_t hash_pc(void** pc, uint32_t depth)
+{
+  size_t h = 0;
+
+  for(uint32_t i = 0; i < depth; i++)
+  {
+    h += (uintptr_t)pc[i];
+    h += h << 10;
+    h ^= h >> 6;
+  }
+
+  return h;
+}
+
+static bucket_t* get_bucket(void** pc, uint32_t depth)
+{
+  size_t hash = hash_pc(pc, depth);
+  bucket_t** slot = &buckets[hash & (HEAPPROF_BUCKETS - 1)];
+
+  for(bucket_t* b = *slot; b != NULL; b = b->next)
+  {
+    if((b->hash == hash) && (b->depth == depth) &&
+      (memcmp(b->pc, pc, depth * sizeof(void*)) == 0))
+      return b;
+  }
+
+  bucket_t* b = (bucket_t*)POOL_ALLOC(bucket_t);
+  memset(b, 0, sizeof(bucket_t));
+  b->hash = hash;
+  b->depth = depth;
+  memcpy(b->pc, pc, depth * sizeof(void*));
+  b->next = *slot;
+  *slot = b;
+  return b;
+}
+
+void heapprof_setrate(size_t rate)
+{
+  heapprof_rate = rate;
+
+#if defined(PLATFORM_IS_POSIX_BASED)
+  if(rate > 0)
+    signal(SIGUSR2, signal_handler);
+#endif
+}
+
+size_t heapprof_sample(heap_t* heap, void* p, size_t size)
+{
+  if(heapprof_rate == 0)
+    return SIZE_MAX;
+
+  if(p == NULL)
+    return heapprof_rate;
+
+  // Take the backtrace here rather than in a helper, so that the number of
+  // frames to skip doesn't depend on inlining.
+  void* frames[HEAPPROF_DEPTH + HEAPPROF_SKIP];
+  int count = 0;
+
+#if defined(PLATFORM_IS_POSIX_BASED)
+  count = backtrace(frames, HEAPPROF_DEPTH + HEAPPROF_SKIP);
+#elif defined(PLATFORM_IS_WINDOWS)
+  count = CaptureStackBackTrace(0, HEAPPROF_DEPTH + HEAPPROF_SKIP, frames,
+    NULL);
+#endif
+
+  void** pc = &frames[HEAPPROF_SKIP];
+  uint32_t depth = (count > HEAPPROF_SKIP) ? (uint32_t)(count - HEAPPROF_SKIP)
+    : 0;
+
+  lock();
+  bucket_t* b = get_bucket(pc, depth);
+  b->alloc_objects++;
+  b->alloc_bytes += size;
+  b->live_objects++;
+  b->live_bytes += size;
+  unlock();
+
+  heapsample_t* s = (heapsample_t*)POOL_ALLOC(heapsample_t);
+  s->p = p;
+  s->size = size;
+  s->bucket = b;
+  s->next = heap->sampled;
+  heap->sampled = s;
+
+  return heapprof_rate;
+}
+
+static void drop(heapsample_t* s)
+{
+  lock();
+  s->bucket->live_objects--;
+  s->bucket->live_bytes -= s->size;
+  unlock();
+
+  POOL_FREE(heapsample_t, s);
+}
+
+void heapprof_sweep(heap_t* heap)
+{
+  heapsample_t** prev = &heap->sampled;
+  heapsample_t* s = heap->sampled;
+  heapsample_t* next;
+
+  while(s != NULL)
+  {
+    next = s->next;
+    chunk_t* chunk = (chunk_t*)pagemap_get(s->p);
+
+    if((chunk == NULL) || !heap_ismarked(chunk, s->p))
+    {
+      *prev = next;
+      drop(s);
+    } else {
+      prev = &s->next;
+    }
+
+    s = next;
+  }
+}
+
+void heapprof_free(heap_t* heap)
+{
+  heapsample_t* s = heap->sampled;
+  heapsample_t* next;
+
+  while(s != NULL)
+  {
+    next = s->next;
+    drop(s);
+    s = next;
+  }
+
+  heap->sampled = NULL;
+}
+
+static void dump_maps(FILE* fp)
+{
+  fprintf(fp, "\nMAPPED_LIBRARIES:\n");
+
+#if defined(PLATFORM_IS_LINUX)
+  FILE* maps = fopen("/proc/self/maps", "r");
+
+  if(maps == NULL)
+    return;
+
+  char buf[4096];
+  size_t len;
+
+  while((len = fread(buf, 1, sizeof(buf), maps)) > 0)
+    fwrite(buf, 1, len, fp);
+
+  fclose(maps);
+#endif
+}
+
+bool heapprof_dump(FILE* fp)
+{
+  if(heapprof_rate == 0)
+    return false;
+
+  lock();
+
+  size_t live_objects = 0;
+  size_t live_bytes = 0;
+  size_t alloc_objects = 0;
+  size_t alloc_bytes = 0;
+
+  for(size_t i = 0; i < HEAPPROF_BUCKETS; i++)
+  {
+    for(bucket_t* b = buckets[i]; b != NULL; b = b->next)
+    {
+      live_objects += b->live_objects;
+      live_bytes += b->live_bytes;
+      alloc_objects += b->alloc_objects;
+      alloc_bytes += b->alloc_bytes;
+    }
+  }
+
+  fprintf(fp, "heap profile: " __zu ": " __zu " [" __zu ": " __zu "] @ "
+    "heap_v2/" __zu "\n",
+    live_objects, live_bytes, alloc_objects, alloc_bytes, heapprof_rate);
+
+  for(size_t i = 0; i < HEAPPROF_BUCKETS; i++)
+  {
+    for(bucket_t* b = buckets[i]; b != NULL; b = b->next)
+    {
+      fprintf(fp, __zu ": " __zu " [" __zu ": " __zu "] @", b->live_objects,
+        b->live_bytes, b->alloc_objects, b->alloc_bytes);
+
+      for(uint32_t j = 0; j < b->depth; j++)
+        fprintf(fp, " 0x" __zx, (size_t)b->pc[j]);
+
+      fprintf(fp, "\n");
+    }
+  }
+
+  unlock();
+
+  dump_maps(fp);
+  return true;
+}
+
+void heapprof_poll()
+{
+#if defined(PLATFORM_IS_POSIX_BASED)
+  if(heapprof_request == 0)
+    return;
+
+  // Only one thread writes the profile for each signal.
+  if(_atomic_exchange(&heapprof_request, 0) == 0)
+    return;
+
+  char name[64];
+  snprintf(name, sizeof(name), "pony.%d.%04u.heap", (int)getpid(),
+    heapprof_seq++);
+
+  pony_heapprofile_dump(name);
+#endif
+}
+
+bool pony_heapprofile_dump(const char* path)
+{
+  if(heapprof_rate == 0)
+    return false;
+
+  FILE* fp = fopen(path, "w");
+
+  if(fp == NULL)
+    return false;
+
+  heapprof_dump(fp);
+  fclose(fp);
+  return true;
+}
@@ -0,0 +1,49 @@
+#ifndef mem_heapprof_h
+#define mem_heapprof_h
+
+#include "heap.h"
+#include <platform.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * Samples an allocation for about every rate bytes allocated on each thread,
+ * recording a backtrace for it. Zero, the default, turns the profiler off.
+ * When on, SIGUSR2 writes a profile to pony.<pid>.<n>.heap where the signal
+ * is available.
+ */
+void heapprof_setrate(size_t rate);
+
+/**
+ * Records an allocation of size bytes at p in the given heap. Returns the
+ * number of bytes to allocate on this thread before the next sample.
+ */
+size_t heapprof_sample(heap_t* heap, void* p, size_t size);
+
+/**
+ * Drops the samples for objects that a gc pass has left unmarked. Must be
+ * called after marking, before the heap is swept.
+ */
+void heapprof_sweep(heap_t* heap);
+
+/**
+ * Drops every sample in a heap that is being destroyed.
+ */
+void heapprof_free(heap_t* heap);
+
+/**
+ * Writes live and total sampled allocations by backtrace, in the heap profile
+ * format read by pprof. Returns false if the profiler is off.
+ */
+bool heapprof_dump(FILE* fp);
+
+/**
+ * Writes a profile if one was asked for by a signal.
+ */
+void heapprof_poll();
+
+PONY_EXTERN_C_END
+
+#endif
@@ -13,6 +13,43 @@
 # define PAGEMAP_LEVELS 3
 #endif
 
+#if defined(USE_FLAT_PAGEMAP) && !defined(PLATFORM_IS_ILP32) && \
+  defined(PLATFORM_IS_POSIX_BASED)
+
+/* A single level pagemap: one entry for every POOL_ALIGN bytes of the 48 bit
+ * address space, in one virtual reservation. The OS only backs the parts of
+ * it where entries have been set, so a lookup is a single dependent load.
+ */
+#define PAGEMAP_ENTRIES ((size_t)1 << (PAGEMAP_ADDRESSBITS - POOL_ALIGN_BITS))
+
+static void** flat;
+
+void* pagemap_get(const void* m)
+{
+  void** v = flat;
+
+  if(v == NULL)
+    return NULL;
+
+  return v[((uintptr_t)m >> POOL_ALIGN_BITS) & (PAGEMAP_ENTRIES - 1)];
+}
+
+void pagemap_set(const void* m, void* v)
+{
+  if(flat == NULL)
+  {
+    void** p = (void**)virtual_alloc(PAGEMAP_ENTRIES * sizeof(void*));
+    void** prev = NULL;
+
+    if(!_atomic_cas(&flat, &prev, p))
+      virtual_free(p, PAGEMAP_ENTRIES * sizeof(void*));
+  }
+
+  flat[((uintptr_t)m >> POOL_ALIGN_BITS) & (PAGEMAP_ENTRIES - 1)] = v;
+}
+
+#else
+
 #define PAGEMAP_BITS (PAGEMAP_ADDRESSBITS - POOL_ALIGN_BITS) / PAGEMAP_LEVELS
 #define PAGEMAP_EXCESS (PAGEMAP_ADDRESSBITS - POOL_ALIGN_BITS) % PAGEMAP_LEVELS
 
@@ -99,3 +136,5 @@ void pagemap_set(const void* m, void* v)
 
   *pv = (void**)v;
 }
+
+#endif
@@ -9,6 +9,7 @@
 #include <assert.h>
 
 #include <platform.h>
+#include <dtrace.h>
 
 #ifdef USE_VALGRIND
 #include <valgrind/valgrind.h>
@@ -35,6 +36,14 @@
 #define POOL_MMAP (128 * 1024 * 1024) // 128 MB
 #endif
 
+/// By default, free blocks are returned to the OS after this many cycles.
+#define POOL_IDLE 10000000000ULL
+
+/// Size classes from this one up keep this many more free items on the
+/// thread-local list before handing a list to the global list of free lists.
+#define POOL_CACHE_INDEX (16 - POOL_MIN_BITS)
+#define POOL_CACHE 4
+
 /// An item on a per-size thread-local free list.
 typedef struct pool_item_t
 {
@@ -87,14 +96,32 @@ typedef struct pool_block_t
   struct pool_block_t* prev;
   struct pool_block_t* next;
   size_t size;
+  uint64_t idle;
+  bool released;
 } pool_block_t;
 
-/// A thread local list of free blocks header.
+/// Free blocks are binned in this many sub-ranges of each power of two.
+#define POOL_BIN_SUB_BITS 3
+#define POOL_BIN_SUB (1 << POOL_BIN_SUB_BITS)
+#define POOL_BIN_COUNT \
+  (((sizeof(size_t) * 8) - POOL_ALIGN_BITS - POOL_BIN_SUB_BITS + 1) \
+    << POOL_BIN_SUB_BITS)
+#define POOL_BIN_WORD_BITS (sizeof(size_t) * 8)
+#define POOL_BIN_WORDS \
+  ((POOL_BIN_COUNT + POOL_BIN_WORD_BITS - 1) / POOL_BIN_WORD_BITS)
+
+/// How many blocks in a request's own bin are checked for a fit.
+#define POOL_BIN_SCAN 8
+
+/// A thread local index of free blocks header. Each bin is a list of free
+/// blocks, and the map has a bit set for each non-empty bin.
 typedef struct pool_block_header_t
 {
-  pool_block_t* head;
+  pool_block_t* bins[POOL_BIN_COUNT];
+  size_t map[POOL_BIN_WORDS];
   size_t total_size;
-  size_t largest_size;
+  size_t released_size;
+  uint64_t last_scavenge;
 } pool_block_header_t;
 
 static pool_global_t pool_global[POOL_COUNT] =
@@ -120,6 +147,11 @@ static pool_global_t pool_global[POOL_COUNT] =
 static __pony_thread_local pool_local_t pool_local[POOL_COUNT];
 static __pony_thread_local pool_block_header_t pool_block_header;
 
+static uint64_t pool_idle = POOL_IDLE;
+static size_t pool_retain = POOL_MMAP;
+static size_t pool_prealloc_size;
+static bool pool_prealloc_lock;
+
 #ifdef USE_POOLTRACK
 #include "../ds/stack.h"
 #include "../sched/cpu.h"
@@ -363,82 +395,223 @@ static void track_pull(pool_item_t* p, size_t length, size_t size)
 
 #endif
 
+/**
+ * Free blocks are binned by size. Sizes are in units of POOL_ALIGN. Below
+ * POOL_BIN_SUB units each size has its own bin. Above that, each power of two
+ * range is split into POOL_BIN_SUB bins.
+ */
+static size_t pool_bin_floor(size_t size)
+{
+  size_t units = size >> POOL_ALIGN_BITS;
+
+  if(units < POOL_BIN_SUB)
+    return units;
+
+  size_t log = __pony_ffsl(next_pow2(units + 1) >> 1) - 1;
+  size_t sub = (units >> (log - POOL_BIN_SUB_BITS)) - POOL_BIN_SUB;
+  return ((log - POOL_BIN_SUB_BITS + 1) << POOL_BIN_SUB_BITS) + sub;
+}
+
+/**
+ * The first bin in which every block is at least size bytes.
+ */
+static size_t pool_bin_ceil(size_t size)
+{
+  size_t bin = pool_bin_floor(size);
+  size_t units = size >> POOL_ALIGN_BITS;
+
+  if(units < POOL_BIN_SUB)
+    return bin;
+
+  size_t log = __pony_ffsl(next_pow2(units + 1) >> 1) - 1;
+  size_t mask = ((size_t)1 << (log - POOL_BIN_SUB_BITS)) - 1;
+
+  if((units & mask) != 0)
+    bin++;
+
+  return bin;
+}
+
+/**
+ * The first non-empty bin at or after the given one, or POOL_BIN_COUNT.
+ */
+static size_t pool_bin_next(size_t bin)
+{
+  size_t word = bin / POOL_BIN_WORD_BITS;
+
+  if(word >= POOL_BIN_WORDS)
+    return POOL_BIN_COUNT;
+
+  size_t bits = pool_block_header.map[word] &
+    ~(((size_t)1 << (bin % POOL_BIN_WORD_BITS)) - 1);
+
+  while(bits == 0)
+  {
+    if(++word == POOL_BIN_WORDS)
+      return POOL_BIN_COUNT;
+
+    bits = pool_block_header.map[word];
+  }
+
+  return (word * POOL_BIN_WORD_BITS) + __pony_ffsl(bits) - 1;
+}
+
 static void pool_block_remove(pool_block_t* block)
 {
+  size_t bin = pool_bin_floor(block->size);
+
   if(block->prev != NULL)
     block->prev->next = block->next;
   else
-    pool_block_header.head = block->next;
+    pool_block_header.bins[bin] = block->next;
 
   if(block->next != NULL)
     block->next->prev = block->prev;
+
+  if(pool_block_header.bins[bin] == NULL)
+  {
+    pool_block_header.map[bin / POOL_BIN_WORD_BITS] &=
+      ~((size_t)1 << (bin % POOL_BIN_WORD_BITS));
+  }
 }
 
 static void pool_block_insert(pool_block_t* block)
 {
-  pool_block_t* next = pool_block_header.head;
-  pool_block_t* prev = NULL;
+  size_t bin = pool_bin_floor(block->size);
+  pool_block_t* next = pool_block_header.bins[bin];
+
+  block->prev = NULL;
+  block->next = next;
+
+  if(next != NULL)
+    next->prev = block;
+
+  pool_block_header.bins[bin] = block;
+  pool_block_header.map[bin / POOL_BIN_WORD_BITS] |=
+    (size_t)1 << (bin % POOL_BIN_WORD_BITS);
+}
+
+/**
+ * Finds a free block of at least size bytes. The request's own bin is checked
+ * first, so that a freed block of the same size is reused rather than a larger
+ * one split. Otherwise, the head of any later non-empty bin fits.
+ */
+static pool_block_t* pool_block_find(size_t size)
+{
+  pool_block_t* block = pool_block_header.bins[pool_bin_floor(size)];
 
-  while(next != NULL)
+  for(size_t i = 0; (block != NULL) && (i < POOL_BIN_SCAN); i++)
   {
-    if(block->size < next->size)
-      break;
+    if(block->size >= size)
+      return block;
 
-    prev = next;
-    next = next->next;
+    block = block->next;
   }
 
-  block->prev = prev;
-  block->next = next;
+  size_t bin = pool_bin_next(pool_bin_ceil(size));
 
-  if(prev != NULL)
-    prev->next = block;
-  else
-    pool_block_header.head = block;
+  if(bin == POOL_BIN_COUNT)
+    return NULL;
 
-  if(next != NULL)
-    next->prev = block;
+  return pool_block_header.bins[bin];
 }
 
-static void* pool_alloc_pages(size_t size)
+static void pool_block_taken(pool_block_t* block, size_t size)
 {
-  if(pool_block_header.total_size >= size)
+  pool_block_header.total_size -= size;
+
+  if(block->released)
+    pool_block_header.released_size -= size;
+}
+
+/**
+ * Merge sorts count blocks linked through their next fields by address. The
+ * prev fields are left stale.
+ */
+static pool_block_t* pool_block_sort(pool_block_t* list, size_t count)
+{
+  if(count <= 1)
   {
-    pool_block_t* block = pool_block_header.head;
+    if(list != NULL)
+      list->next = NULL;
 
-    while(block != NULL)
+    return list;
+  }
+
+  size_t half = count / 2;
+  pool_block_t* mid = list;
+
+  for(size_t i = 1; i < half; i++)
+    mid = mid->next;
+
+  pool_block_t* right = pool_block_sort(mid->next, count - half);
+  pool_block_t* left = pool_block_sort(list, half);
+  pool_block_t* head = NULL;
+  pool_block_t** tail = &head;
+
+  while((left != NULL) && (right != NULL))
+  {
+    if(left < right)
     {
-      if(block->size > size)
-      {
-        // Use size bytes from the end of the block. This allows us to keep the
-        // block info inside the block instead of using another data structure.
-        size_t rem = block->size - size;
-        block->size = rem;
-        pool_block_header.total_size -= size;
+      *tail = left;
+      left = left->next;
+    } else {
+      *tail = right;
+      right = right->next;
+    }
 
-        // TODO: can track largest size
-        // if we're the last element, it's either our new size or the previous
-        // block size, if that's larger.
+    tail = &(*tail)->next;
+  }
 
-        if((block->prev != NULL) && (block->prev->size > block->size))
-        {
-          // If we are now smaller than the previous block, move us forward in
-          // the list.
-          pool_block_remove(block);
-          pool_block_insert(block);
-        }
+  *tail = (left != NULL) ? left : right;
+  return head;
+}
+
+/**
+ * Returns the whole pages inside a free block, other than the one holding the
+ * block info, to the OS. With huge pages, only whole huge pages are returned.
+ */
+static void pool_block_release(pool_block_t* block)
+{
+  uintptr_t page = virtual_pagesize();
+  uintptr_t start = ((uintptr_t)block + sizeof(pool_block_t) + page - 1) &
+    ~(page - 1);
+  uintptr_t end = ((uintptr_t)block + block->size) & ~(page - 1);
+
+  if(end <= start)
+    return;
+
+  virtual_decommit((void*)start, end - start);
+  block->released = true;
+  pool_block_header.released_size += block->size;
+}
+
+static void* pool_alloc_pages(size_t size)
+{
+  DTRACE1(POOL_ALLOC_PAGES, size);
+
+  if(pool_block_header.total_size >= size)
+  {
+    pool_block_t* block = pool_block_find(size);
 
-        return (char*)block + rem;
-      } else if(block->size == size) {
-        // Remove the block from the list.
-        pool_block_remove(block);
+    if(block != NULL)
+    {
+      pool_block_remove(block);
+      pool_block_taken(block, size);
 
+      if(block->size == size)
+      {
         // Return the block pointer itself.
-        pool_block_header.total_size -= size;
         return block;
       }
 
-      block = block->next;
+      // Use size bytes from the end of the block. This allows us to keep the
+      // block info inside the block instead of using another data structure.
+      size_t rem = block->size - size;
+      block->size = rem;
+      pool_block_insert(block);
+
+      return (char*)block + rem;
     }
   }
 
@@ -450,8 +623,8 @@ static void* pool_alloc_pages(size_t size)
   size_t rem = POOL_MMAP - size;
 
   block->size = rem;
-  block->next = NULL;
-  block->prev = NULL;
+  block->idle = 0;
+  block->released = false;
   pool_block_header.total_size += rem;
   pool_block_insert(block);
 
@@ -460,28 +633,86 @@ static void* pool_alloc_pages(size_t size)
 
 static void pool_free_pages(void* p, size_t size)
 {
-  if(pool_block_header.total_size >= POOL_MMAP)
-  {
-    // TODO: ???
-  }
-
+  // Free blocks are returned to the OS by pool_scavenge() once they have been
+  // idle for long enough.
   pool_block_t* block = (pool_block_t*)p;
-  block->prev = NULL;
-  block->next = NULL;
   block->size = size;
+  block->idle = 0;
+  block->released = false;
 
   pool_block_insert(block);
   pool_block_header.total_size += size;
 }
 
+/**
+ * Grows an allocation into the free block that starts where it ends, if there
+ * is one with room. Free blocks are only binned by size, so this looks at
+ * every block big enough, but there are few of them and the copy it saves is
+ * much larger.
+ */
+static bool pool_extend_pages(void* p, size_t old_size, size_t size)
+{
+  size_t extra = size - old_size;
+
+  if(pool_block_header.total_size < extra)
+    return false;
+
+  pool_block_t* next = (pool_block_t*)((char*)p + old_size);
+  size_t bin = pool_bin_next(pool_bin_floor(extra));
+
+  while(bin < POOL_BIN_COUNT)
+  {
+    for(pool_block_t* block = pool_block_header.bins[bin]; block != NULL;
+      block = block->next)
+    {
+      if((block != next) || (block->size < extra))
+        continue;
+
+      pool_block_remove(block);
+      pool_block_taken(block, extra);
+
+      if(block->size > extra)
+      {
+        // Move the block info to the start of what is left of the block.
+        pool_block_t* rest = (pool_block_t*)((char*)block + extra);
+        rest->size = block->size - extra;
+        rest->idle = block->idle;
+        rest->released = block->released;
+        pool_block_insert(rest);
+      }
+
+      return true;
+    }
+
+    bin = pool_bin_next(bin + 1);
+  }
+
+  return false;
+}
+
 static void pool_push(pool_local_t* thread, pool_global_t* global)
 {
   pool_cmp_t cmp, xchg;
   pool_central_t* p = (pool_central_t*)thread->pool;
-  p->length = thread->length;
 
-  thread->pool = NULL;
-  thread->length = 0;
+  if(thread->length > global->count)
+  {
+    // Only large size classes keep more than a list's worth, so the walk to
+    // split off the first count items is short.
+    pool_item_t* last = thread->pool;
+
+    for(size_t i = 1; i < global->count; i++)
+      last = last->next;
+
+    thread->pool = last->next;
+    thread->length -= global->count;
+    last->next = NULL;
+  } else {
+    thread->pool = NULL;
+    thread->length = 0;
+  }
+
+  p->length = global->count;
 
   assert(p->length == global->count);
   TRACK_PUSH((pool_item_t*)p, p->length, global->size);
@@ -600,8 +831,12 @@ void pool_free(size_t index, void* p)
 
   pool_local_t* thread = &pool_local[index];
   pool_global_t* global = &pool_global[index];
+  size_t limit = global->count;
+
+  if(index >= POOL_CACHE_INDEX)
+    limit += POOL_CACHE;
 
-  if(thread->length >= global->count)
+  if(thread->length >= limit)
     pool_push(thread, global);
 
   pool_item_t* lp = (pool_item_t*)p;
@@ -661,6 +896,44 @@ void pool_free_size(size_t size, void* p)
 #endif
 }
 
+void* pool_grow_size(size_t old_size, size_t size, void* p)
+{
+  if((pool_index(old_size) < POOL_COUNT) || (pool_index(size) < POOL_COUNT))
+    return NULL;
+
+  old_size = pool_adjust_size(old_size);
+  size = pool_adjust_size(size);
+
+  if(size <= old_size)
+    return p;
+
+  void* q = NULL;
+
+  if(pool_extend_pages(p, old_size, size))
+  {
+    q = p;
+  } else if(old_size >= POOL_MMAP) {
+    // Only remap whole pages, so that no other allocation shares them.
+    uintptr_t mask = virtual_pagesize() - 1;
+
+    if((((uintptr_t)p | old_size | size) & mask) == 0)
+      q = virtual_remap(p, old_size, size);
+  }
+
+  if(q == NULL)
+    return NULL;
+
+  TRACK_FREE(p, old_size);
+  TRACK_ALLOC(q, size);
+
+#ifdef USE_VALGRIND
+  VALGRIND_FREELIKE_BLOCK(p, 0);
+  VALGRIND_MALLOCLIKE_BLOCK(q, size, 0, 0);
+#endif
+
+  return q;
+}
+
 size_t pool_index(size_t size)
 {
   if(size <= POOL_MIN)
@@ -685,3 +958,147 @@ size_t pool_adjust_size(size_t size)
 
   return size;
 }
+
+size_t pool_local_bytes()
+{
+  // Free memory held by this thread: its free lists, the unused part of the
+  // block each size is being carved from, and its free blocks that haven't
+  // been returned to the OS.
+  size_t bytes = pool_block_header.total_size -
+    pool_block_header.released_size;
+
+  for(size_t i = 0; i < POOL_COUNT; i++)
+  {
+    pool_local_t* thread = &pool_local[i];
+    bytes += (thread->length * pool_global[i].size) +
+      (size_t)(thread->end - thread->start);
+  }
+
+  return bytes;
+}
+
+void pool_setscavenge(uint64_t idle, size_t retain)
+{
+  pool_idle = idle;
+  pool_retain = retain;
+}
+
+void pool_setprealloc(size_t bytes, bool lock)
+{
+  pool_prealloc_size = pool_adjust_size(bytes);
+  pool_prealloc_lock = lock;
+
+  // Otherwise the scavenger would give the memory back once it was idle.
+  if(pool_retain < pool_prealloc_size)
+    pool_retain = pool_prealloc_size;
+}
+
+void pool_prealloc()
+{
+  size_t size = pool_prealloc_size;
+
+  if(size == 0)
+    return;
+
+  void* p = virtual_alloc(size);
+
+  if(!virtual_prefault(p, size, pool_prealloc_lock))
+    fprintf(stderr, "Couldn't lock " __zu " bytes of pool memory\n", size);
+
+  pool_free_pages(p, size);
+}
+
+void pool_scavenge(uint64_t now)
+{
+  pool_block_header_t* header = &pool_block_header;
+
+  if((pool_idle == 0) || ((now - header->last_scavenge) < (pool_idle / 4)))
+    return;
+
+  header->last_scavenge = now;
+
+  // Large items kept beyond a list's worth become free blocks, so that they
+  // can be coalesced and returned to the OS like any other.
+  for(size_t i = POOL_CACHE_INDEX; i < POOL_COUNT; i++)
+  {
+    pool_local_t* thread = &pool_local[i];
+
+    while(thread->length > pool_global[i].count)
+    {
+      pool_item_t* p = thread->pool;
+      thread->pool = p->next;
+      thread->length--;
+      pool_free_pages(p, pool_global[i].size);
+    }
+  }
+
+  // Take every block out of the bins. Blocks are timed from the first
+  // scavenge that finds them free.
+  pool_block_t* list = NULL;
+  size_t count = 0;
+
+  for(size_t i = 0; i < POOL_BIN_COUNT; i++)
+  {
+    pool_block_t* block = header->bins[i];
+
+    while(block != NULL)
+    {
+      pool_block_t* next = block->next;
+
+      if(block->idle == 0)
+        block->idle = now;
+
+      block->next = list;
+      list = block;
+      count++;
+      block = next;
+    }
+
+    header->bins[i] = NULL;
+  }
+
+  memset(header->map, 0, sizeof(header->map));
+
+  // Coalesce blocks that are adjacent in memory. The merged block is only as
+  // idle as its most recently freed part.
+  list = pool_block_sort(list, count);
+  pool_block_t* block = list;
+
+  while(block != NULL)
+  {
+    pool_block_t* next = block->next;
+
+    if((next != NULL) && (((char*)block + block->size) == (char*)next))
+    {
+      if(block->released != next->released)
+      {
+        header->released_size -= block->released ? block->size : next->size;
+        block->released = false;
+      }
+
+      if(next->idle > block->idle)
+        block->idle = next->idle;
+
+      block->size += next->size;
+      block->next = next->next;
+      continue;
+    }
+
+    block = next;
+  }
+
+  // Release blocks that have been idle for long enough, until no more than
+  // the retained size is resident, and put every block back in its bin.
+  while(list != NULL)
+  {
+    block = list;
+    list = list->next;
+
+    if(!block->released &&
+      ((header->total_size - header->released_size) > pool_retain) &&
+      ((now - block->idle) >= pool_idle))
+      pool_block_release(block);
+
+    pool_block_insert(block);
+  }
+}
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <platform.h>
 
@@ -18,12 +19,50 @@ void pool_free(size_t index, void* p);
 __pony_spec_malloc__(void* pool_alloc_size(size_t size));
 void pool_free_size(size_t size, void* p);
 
+/**
+ * Grows an allocation from pool_alloc_size() without copying it, either into
+ * the free block that follows it or, for allocations of at least the size the
+ * pool maps at once, by remapping its pages. Returns the allocation, which
+ * may have moved if it was remapped, or NULL if it couldn't be grown, in which
+ * case it is unchanged. Both sizes must be above the largest pool size.
+ */
+void* pool_grow_size(size_t old_size, size_t size, void* p);
+
 size_t pool_index(size_t size);
 
 size_t pool_size(size_t index);
 
 size_t pool_adjust_size(size_t size);
 
+size_t pool_local_bytes();
+
+/**
+ * Sets how long, in CPU cycles, a free block must be idle before it is
+ * returned to the OS, and how many bytes of free blocks each thread keeps
+ * resident regardless. An idle time of 0 never returns memory.
+ */
+void pool_setscavenge(uint64_t idle, size_t retain);
+
+/**
+ * Sets how many bytes of memory each scheduler thread maps and faults in for
+ * its free blocks as it starts, and whether that memory is locked in RAM.
+ * Each thread keeps at least that much resident from then on.
+ */
+void pool_setprealloc(size_t bytes, bool lock);
+
+/**
+ * Maps and faults in the memory set by pool_setprealloc() as free blocks of
+ * this thread, so that allocations up to that size don't wait on the OS.
+ */
+void pool_prealloc();
+
+/**
+ * Coalesces this thread's free blocks and returns those that have been idle
+ * long enough to the OS. Cheap to call often: it does nothing until a quarter
+ * of the idle time has passed since it last ran.
+ */
+void pool_scavenge(uint64_t now);
+
 #define POOL_INDEX(SIZE) \
   __pony_choose_expr(SIZE <= (1 << (POOL_MIN_BITS + 0)), 0, \
   __pony_choose_expr(SIZE <= (1 << (POOL_MIN_BITS + 1)), 1, \
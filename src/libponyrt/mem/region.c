@@ -0,0 +1,119 @@
+#include "region.h"
+#include "heap.h"
+#include "pool.h"
+#include <assert.h>
+
+// Scratch memory comes from blocks of this size. A larger allocation gets a
+// block of its own, so that the rest of the current block isn't wasted.
+#define REGION_BLOCK HEAP_SLAB
+#define REGION_LARGE (REGION_BLOCK >> 2)
+#define REGION_ALIGN 16
+
+struct region_block_t
+{
+  region_block_t* next;
+  size_t size;
+};
+
+// Keep allocations after the block header aligned.
+#define REGION_HEADER \
+  ((sizeof(region_block_t) + REGION_ALIGN - 1) & ~(REGION_ALIGN - 1))
+
+static region_block_t* new_block(region_t* region, size_t size)
+{
+  size = pool_adjust_size(size + REGION_HEADER);
+  region_block_t* block = (region_block_t*)pool_alloc_size(size);
+  block->size = size;
+
+  // The first block stays at the end of the list, so a reset can keep it.
+  if(region->blocks == NULL)
+  {
+    block->next = NULL;
+    region->blocks = block;
+  } else {
+    block->next = region->blocks->next;
+    region->blocks->next = block;
+  }
+
+  return block;
+}
+
+static void next_block(region_t* region)
+{
+  // The rest of the current block is never used.
+  region_block_t* block = new_block(region, REGION_BLOCK - REGION_HEADER);
+
+  if(block != region->blocks)
+  {
+    // Make the new block the current one, swapping it to the front.
+    assert(block == region->blocks->next);
+    region->blocks->next = block->next;
+    block->next = region->blocks;
+    region->blocks = block;
+  }
+
+  region->next = (char*)block + REGION_HEADER;
+  region->end = (char*)block + block->size;
+}
+
+void* region_alloc(region_t* region, size_t size)
+{
+  size = (size + REGION_ALIGN - 1) & ~(REGION_ALIGN - 1);
+  region->used += size;
+
+  if(size > REGION_LARGE)
+  {
+    // The first block is always a full size one, as it is kept on reset.
+    if(region->blocks == NULL)
+      next_block(region);
+
+    return (char*)new_block(region, size) + REGION_HEADER;
+  }
+
+  if((size_t)(region->end - region->next) < size)
+    next_block(region);
+
+  void* m = region->next;
+  region->next += size;
+  return m;
+}
+
+void region_reset(region_t* region)
+{
+  if(region->used == 0)
+    return;
+
+  region_block_t* block = region->blocks;
+  region_block_t* next;
+
+  // Keep the first block, which is at the end of the list.
+  while(block->next != NULL)
+  {
+    next = block->next;
+    pool_free_size(block->size, block);
+    block = next;
+  }
+
+  region->blocks = block;
+  region->next = (char*)block + REGION_HEADER;
+  region->end = (char*)block + block->size;
+  region->used = 0;
+}
+
+void region_destroy(region_t* region)
+{
+  region_block_t* block = region->blocks;
+  region_block_t* next;
+
+  while(block != NULL)
+  {
+    next = block->next;
+    pool_free_size(block->size, block);
+    block = next;
+  }
+
+  region->blocks = NULL;
+  region->next = NULL;
+  region->end = NULL;
+  region->used = 0;
+}
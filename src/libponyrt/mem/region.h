@@ -0,0 +1,37 @@
+#ifndef mem_region_h
+#define mem_region_h
+
+#include <platform.h>
+#include <stddef.h>
+
+PONY_EXTERN_C_BEGIN
+
+typedef struct region_block_t region_block_t;
+
+/**
+ * Scratch memory for the behaviour running on a thread. It is bump allocated
+ * and freed in bulk when the behaviour returns, without being traced.
+ */
+typedef struct region_t
+{
+  char* next;
+  char* end;
+  region_block_t* blocks;
+  size_t used;
+} region_t;
+
+__pony_spec_malloc__(
+void* region_alloc(region_t* region, size_t size)
+  );
+
+/**
+ * Frees everything allocated since the last reset. The first block is kept
+ * for the next behaviour.
+ */
+void region_reset(region_t* region);
+
+void region_destroy(region_t* region);
+
+PONY_EXTERN_C_END
+
+#endif
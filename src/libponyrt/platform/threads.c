@@ -3,6 +3,10 @@
 #endif
 #include <platform.h>
 
+#ifdef PLATFORM_IS_POSIX_BASED
+#include <sys/time.h>
+#endif
+
 #if defined(PLATFORM_IS_LINUX) || defined(PLATFORM_IS_FREEBSD)
 #include <sched.h>
 #include <sys/time.h>
@@ -218,3 +222,78 @@ pony_thread_id_t pony_thread_self()
   return pthread_self();
 #endif
 }
+
+void pony_park_init(pony_park_t* park)
+{
+#ifdef PLATFORM_IS_WINDOWS
+  InitializeCriticalSection(&park->mut);
+  InitializeConditionVariable(&park->cond);
+#else
+  pthread_mutex_init(&park->mut, NULL);
+  pthread_cond_init(&park->cond, NULL);
+#endif
+}
+
+void pony_park_destroy(pony_park_t* park)
+{
+#ifdef PLATFORM_IS_WINDOWS
+  DeleteCriticalSection(&park->mut);
+#else
+  pthread_cond_destroy(&park->cond);
+  pthread_mutex_destroy(&park->mut);
+#endif
+}
+
+void pony_park_lock(pony_park_t* park)
+{
+#ifdef PLATFORM_IS_WINDOWS
+  EnterCriticalSection(&park->mut);
+#else
+  pthread_mutex_lock(&park->mut);
+#endif
+}
+
+void pony_park_unlock(pony_park_t* park)
+{
+#ifdef PLATFORM_IS_WINDOWS
+  LeaveCriticalSection(&park->mut);
+#else
+  pthread_mutex_unlock(&park->mut);
+#endif
+}
+
+void pony_park_wait(pony_park_t* park)
+{
+#ifdef PLATFORM_IS_WINDOWS
+  SleepConditionVariableCS(&park->cond, &park->mut, INFINITE);
+#else
+  pthread_cond_wait(&park->cond, &park->mut);
+#endif
+}
+
+void pony_park_wait_timed(pony_park_t* park, uint64_t nsec)
+{
+#ifdef PLATFORM_IS_WINDOWS
+  // Round up, so that a short wait doesn't become a busy loop.
+  DWORD ms = (DWORD)((nsec + 999999) / 1000000);
+  SleepConditionVariableCS(&park->cond, &park->mut, ms);
+#else
+  struct timeval now;
+  gettimeofday(&now, NULL);
+
+  uint64_t ns = ((uint64_t)now.tv_usec * 1000) + nsec;
+  struct timespec ts;
+  ts.tv_sec = now.tv_sec + (time_t)(ns / 1000000000);
+  ts.tv_nsec = (long)(ns % 1000000000);
+  pthread_cond_timedwait(&park->cond, &park->mut, &ts);
+#endif
+}
+
+void pony_park_signal(pony_park_t* park)
+{
+#ifdef PLATFORM_IS_WINDOWS
+  WakeConditionVariable(&park->cond);
+#else
+  pthread_cond_signal(&park->cond);
+#endif
+}
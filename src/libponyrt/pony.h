@@ -61,6 +61,14 @@ typedef struct pony_msgp_t
  */
 typedef void (*pony_trace_fn)(pony_ctx_t* ctx, void* p);
 
+/** Serialise function.
+ *
+ * A type with pointers among its fields supplies a serialise function. It is
+ * invoked with the object being serialised and the offset of its copy in the
+ * image, and replaces each pointer in the copy with an offset.
+ */
+typedef void (*pony_serialise_fn)(pony_ctx_t* ctx, void* p, size_t offset);
+
 /** Dispatch function.
  *
  * Each actor has a dispatch function that is invoked when the actor handles
@@ -76,6 +84,102 @@ typedef void (*pony_dispatch_fn)(pony_ctx_t* ctx, pony_actor_t* actor,
  */
 typedef void (*pony_final_fn)(void* p);
 
+/** Scheduling classes.
+ *
+ * Interactive actors are scheduled ahead of bulk actors and handle a smaller
+ * batch of messages each time they run, so that they aren't kept waiting
+ * behind actors doing heavy computation. Actors are bulk unless they set
+ * another class. Actors that create ASIO events are made interactive.
+ */
+typedef enum
+{
+  PONY_SCHED_BULK = 0,
+  PONY_SCHED_INTERACTIVE
+} pony_sched_class_t;
+
+/** Cycle detection modes.
+ *
+ * By default, actors tell the cycle detector when they block, and it looks for
+ * cycles of blocked actors as they accumulate. On demand, actors that nobody
+ * references are still collected as soon as they block, but cycles are only
+ * looked for when pony_cycle_detect() is called. Off, actors don't tell the
+ * cycle detector when they block, so no actor is collected, and actors that
+ * never blocked while it was on aren't finalised when the program ends.
+ */
+typedef enum
+{
+  PONY_CD_AUTO = 0,
+  PONY_CD_ONDEMAND,
+  PONY_CD_OFF
+} pony_cdmode_t;
+
+/** Scheduler statistics.
+ *
+ * These are always collected. Each scheduler thread updates its own, and they
+ * are read without synchronisation, so a snapshot taken while the program is
+ * running is approximate. Times are in CPU cycles.
+ */
+typedef struct pony_sched_stats_t
+{
+  uint64_t steals;
+  uint64_t steal_failures;
+  uint64_t msgs;
+  uint64_t gc_time;
+  uint64_t pool_bytes;
+  uint64_t blocking_calls;
+} pony_sched_stats_t;
+
+/// The number of buckets in a message latency histogram.
+#define PONY_LATENCY_BUCKETS 32
+
+/** A message latency histogram.
+ *
+ * Bucket i counts sampled messages that waited between 2^i and 2^(i + 1) CPU
+ * cycles from being sent to being dispatched. The last bucket also counts
+ * anything longer.
+ */
+typedef struct pony_latency_t
+{
+  uint64_t count;
+  uint64_t buckets[PONY_LATENCY_BUCKETS];
+} pony_latency_t;
+
+/** Memory used by a live actor.
+ *
+ * The heap figures are the ones the garbage collector works from: heap_used
+ * is what the last gc pass kept plus what has been allocated since, and the
+ * next gc pass starts when it reaches heap_next_gc. The queue is the number
+ * of messages waiting in the actor's mailbox.
+ */
+typedef struct pony_actor_memory_t
+{
+  pony_actor_t* actor;
+  uint32_t type_id;
+  size_t heap_used;
+  size_t heap_next_gc;
+  size_t queue;
+} pony_actor_memory_t;
+
+/// Memory used by all the live actors of one type.
+typedef struct pony_type_memory_t
+{
+  uint32_t type_id;
+  size_t actors;
+  size_t heap_used;
+  size_t queue;
+} pony_type_memory_t;
+
+/** Type descriptor flags.
+ *
+ * PONY_TYPE_LEAF_ARRAY marks an Array whose elements are never traced, such
+ * as Array[U8]. Its buffer is the only thing it points to, so an unknown
+ * reference to one is traced with pony_trace_leaf_array().
+ */
+enum
+{
+  PONY_TYPE_LEAF_ARRAY = 1
+};
+
 /// Describes a type to the runtime.
 typedef const struct _pony_type_t
 {
@@ -85,26 +189,44 @@ typedef const struct _pony_type_t
   uint32_t field_count;
   uint32_t field_offset;
   pony_trace_fn trace;
-  pony_trace_fn serialise;
+  pony_serialise_fn serialise;
   pony_trace_fn deserialise;
   pony_dispatch_fn dispatch;
   pony_final_fn final;
   uint32_t event_notify;
+  uint32_t flags;
   uint32_t** traits;
   void* fields;
+
+  // For an actor type, its name and the Type.behaviour name of each message
+  // ID, or NULL.
+  const char* name;
+  const char** msg_names;
+  uint32_t msg_count;
+
   void* vtable;
 } pony_type_t;
 
 /** Padding for actor types.
  *
- * 56 bytes: initial header, not including the type descriptor
- * 52/104 bytes: heap
- * 44/80 bytes: gc
+ * The size of the runtime's pony_actor_t, less the type descriptor. The heap
+ * starts on a new cache line, so the struct is padded to a multiple of 64
+ * bytes:
+ *
+ * 64/128 bytes: initial header, including the type descriptor
+ * 164/304 bytes: heap
+ * 72/136 bytes: gc
+ * 12/16 bytes: node, mailbox capacity and pressure
+ * 12/16 bytes: latency sample
+ * 4 bytes: pending coalescing messages
+ * 4 bytes: heap census request
+ * 8/16 bytes: registry links
+ * 44/16 bytes: padding
  */
 #if INTPTR_MAX == INT64_MAX
-#  define PONY_ACTOR_PAD_SIZE 240
+#  define PONY_ACTOR_PAD_SIZE 632
 #elif INTPTR_MAX == INT32_MAX
-#  define PONY_ACTOR_PAD_SIZE 156
+#  define PONY_ACTOR_PAD_SIZE 380
 #endif
 
 typedef struct pony_actor_pad_t
@@ -126,12 +248,167 @@ pony_ctx_t* pony_ctx();
 ATTRIBUTE_MALLOC(pony_actor_t* pony_create(pony_ctx_t* ctx,
   pony_type_t* type));
 
+/** Message IDs with this bit set coalesce.
+ *
+ * Sending a coalescing message to an actor that already has one with the same
+ * ID waiting drops the new message, so a burst of them is handled once. The
+ * pending message is dispatched as usual. This suits messages where only the
+ * latest matters, such as a request to refresh. Because a dropped message is
+ * never received, a coalescing message must not carry traced arguments.
+ * Each ID below 32 has its own pending bit. Larger IDs are sent as usual,
+ * whether or not they have this bit set. The compiler sets it for behaviours
+ * annotated with coalesce. Only pony_sendv() and the functions built on it
+ * coalesce.
+ */
+#define PONY_MSG_COALESCE 0x40000000
+
 /// Allocates a message and sets up the header. The size is a POOL_INDEX.
 pony_msg_t* pony_alloc_msg(uint32_t size, uint32_t id);
 
 /// Sends a message to an actor.
 void pony_sendv(pony_ctx_t* ctx, pony_actor_t* to, pony_msg_t* m);
 
+/** Sends a chain of messages to an actor.
+ *
+ * The messages must already be linked through their next fields, from first
+ * to last. The whole chain is added to the receiver's queue at once, in order,
+ * after anything the current behaviour has sent so far. The chain can't hold
+ * control messages or messages with coalescing IDs.
+ */
+void pony_sendv_batch(pony_ctx_t* ctx, pony_actor_t* to, pony_msg_t* first,
+  pony_msg_t* last);
+
+/** Bounds an actor's mailbox.
+ *
+ * A behaviour that sends to an actor with more than capacity messages queued
+ * has its own actor muted when it returns. The muted actor isn't run again
+ * until the receiver has drained to half of its capacity. Actors never mute
+ * themselves. A capacity of 0, the default, means the mailbox is unbounded.
+ */
+void pony_setcapacity(pony_actor_t* actor, uint32_t capacity);
+
+/** Puts an actor under pressure, or takes it off.
+ *
+ * While an actor is under pressure, a behaviour that sends to it has its own
+ * actor muted when it returns, as if the receiver's mailbox were full. Muted
+ * actors run again once the pressure is off and the mailbox has drained. This
+ * lets an actor push back on its producers for reasons other than the length
+ * of its queue, such as bytes waiting to be written to a socket. Only the
+ * actor itself should do this.
+ */
+void pony_setpressure(pony_actor_t* actor, bool pressure);
+
+/** Ends the running actor's batch once the current behaviour returns.
+ *
+ * The actor is put at the back of its scheduler's queue, so that the other
+ * actors there run before it handles any more messages. An actor that sends
+ * itself a message to carry on with some work can use this to share its
+ * scheduler fairly.
+ */
+void pony_yield();
+
+/// A function run once as a task, with the argument it was queued with.
+typedef void (*pony_task_fn)(pony_ctx_t* ctx, void* arg);
+
+/** Runs a function once, on whichever scheduler thread gets to it first.
+ *
+ * A task costs one small pool allocation. It has no mailbox, heap or GC state,
+ * so queueing one is much cheaper than creating an actor to send a message to.
+ * Schedulers run one task after each actor batch, and run tasks in preference
+ * to stealing when they are idle. The task runs with no current actor: it
+ * must not allocate on a Pony heap, and any Pony objects it uses must be kept
+ * alive by something else until it has run. It can send messages that carry
+ * no objects, and queue more tasks. The runtime doesn't terminate while tasks
+ * are queued.
+ */
+void pony_task(pony_ctx_t* ctx, pony_task_fn fn, void* arg);
+
+/** Called before an FFI call that is declared as blocking.
+ *
+ * The scheduler thread hands the actors on its queue to the others and, if a
+ * scheduler thread is suspended, resumes it to take its place, so that the
+ * program keeps running while this thread is held up in the call. Calls nest,
+ * and do nothing on a thread that isn't a scheduler thread.
+ */
+void pony_blocking_enter();
+
+/** Called when an FFI call that is declared as blocking returns.
+ *
+ * If the call raises an error instead, the scheduler thread catches up once
+ * the behaviour returns.
+ */
+void pony_blocking_exit();
+
+/** Sets an actor's GC policy.
+ *
+ * The actor isn't collected until its heap reaches initial bytes, and after
+ * each pass it is next collected once its heap grows by factor. A zero leaves
+ * that setting at the --ponygcinitial or --ponygcfactor default. If onblock is
+ * true, the actor is only collected when its queue is empty, rather than
+ * between behaviours. Calling this from a constructor gives every actor of a
+ * type the same policy. This is not concurrency safe: this should be done on
+ * the current actor or an actor that has never been sent a message.
+ */
+void pony_setgc(pony_actor_t* actor, size_t initial, double factor,
+  bool onblock);
+
+/** Gives an actor's mailbox a segment of inline message slots.
+ *
+ * Small messages sent to the actor are copied into cache line sized slots in
+ * the segment rather than queued as separate allocations. This suits actors
+ * that receive a high rate of tiny messages. It costs about 2k bytes for the
+ * actor. This is not concurrency safe: do it before the actor is sent any
+ * messages.
+ */
+void pony_setsegment(pony_actor_t* actor);
+
+/**
+ * The number of application messages waiting for an actor. Garbage collection
+ * and cycle detection messages are only counted for the cycle detector.
+ */
+size_t pony_queue_depth(pony_actor_t* actor);
+
+/** Called on the actor that made a reply slot, with the value the slot was
+ * fulfilled with.
+ */
+typedef void (*pony_fulfil_fn)(pony_ctx_t* ctx, pony_actor_t* self,
+  void* value, void* env);
+
+/// Called on the actor that made a reply slot when the slot is rejected.
+typedef void (*pony_reject_fn)(pony_ctx_t* ctx, pony_actor_t* self,
+  void* env);
+
+/// A one-shot reply slot. See pony_reply().
+typedef struct pony_reply_t pony_reply_t;
+
+/** Makes a reply slot for the current actor.
+ *
+ * The slot is a pooled message that is delivered straight into the current
+ * actor's queue when another actor fulfils or rejects it. On delivery, the
+ * fulfil or reject function is called on this actor with the env pointer.
+ * Either function may be NULL. This gives request/response without creating
+ * an actor per request.
+ *
+ * The env pointer isn't traced. An actor that sends the slot to another actor
+ * must trace it with pony_tracereply().
+ */
+pony_reply_t* pony_reply(pony_ctx_t* ctx, pony_fulfil_fn fulfil,
+  pony_reject_fn reject, void* env);
+
+/** Fulfils a reply slot with a value.
+ *
+ * The value must have been traced with pony_gc_send() like a message
+ * argument, and the fulfil function should trace it with pony_gc_recv(). The
+ * slot is consumed: it can't be used again.
+ */
+void pony_reply_fulfil(pony_ctx_t* ctx, pony_reply_t* reply, void* value);
+
+/// Rejects a reply slot. The slot is consumed: it can't be used again.
+void pony_reply_reject(pony_ctx_t* ctx, pony_reply_t* reply);
+
+/// Traces the actor a reply slot will be delivered to.
+void pony_tracereply(pony_ctx_t* ctx, pony_reply_t* reply);
+
 /** Convenience function to send a message with no arguments.
  *
  * The dispatch function receives a pony_msg_t.
@@ -167,12 +444,37 @@ void pony_continuation(pony_actor_t* to, pony_msg_t* m);
  */
 ATTRIBUTE_MALLOC(void* pony_alloc(pony_ctx_t* ctx, size_t size));
 
-/// Allocate using a HEAP_INDEX instead of a size in bytes.
+/// Allocate using a size class from heap_index() instead of a size in bytes.
 ATTRIBUTE_MALLOC(void* pony_alloc_small(pony_ctx_t* ctx, uint32_t sizeclass));
 
-/// Allocate when we know it's larger than HEAP_MAX.
+/// Allocate when we know it's larger than HEAP_MEDIUMMAX.
 ATTRIBUTE_MALLOC(void* pony_alloc_large(pony_ctx_t* ctx, size_t size));
 
+/** Allocate memory in the frozen region.
+ *
+ * This memory is shared by every actor and is never collected, so it suits
+ * immutable data that lives as long as the program, such as configuration
+ * snapshots and routing tables. It may only be shared as val. Fill it in
+ * before sharing it, and only point from it to other frozen memory: the
+ * garbage collector doesn't trace frozen memory, and sending or receiving it
+ * costs nothing.
+ */
+ATTRIBUTE_MALLOC(void* pony_alloc_frozen(pony_ctx_t* ctx, size_t size));
+
+/** Allocate scratch memory for the running behaviour.
+ *
+ * The memory is bump allocated and is freed, without being traced, when the
+ * behaviour returns. The compiler uses it for objects that are proven not to
+ * escape the behaviour but are too large or too variable in size for the
+ * stack. Nothing allocated here may be stored in an actor, sent in a message
+ * or otherwise kept past the end of the behaviour.
+ */
+ATTRIBUTE_MALLOC(void* pony_alloc_region(pony_ctx_t* ctx, size_t size));
+
+/** Bytes of scratch memory allocated so far by the running behaviour.
+ */
+size_t pony_region_used(pony_ctx_t* ctx);
+
 /** Reallocate memory on the current actor's heap.
  *
  * Take heap memory and expand it. This is a no-op if there's already enough
@@ -188,9 +490,34 @@ ATTRIBUTE_MALLOC(void* pony_realloc(pony_ctx_t* ctx, void* p, size_t size));
 ATTRIBUTE_MALLOC(void* pony_alloc_final(pony_ctx_t* ctx, size_t size,
   pony_final_fn final));
 
+/** Allocate memory with a deferred finaliser.
+ *
+ * As pony_alloc_final(), but the finaliser doesn't run while the heap is
+ * swept. It is queued, and run later with others in a batch on a low priority
+ * thread, so that finalisers that make system calls don't hold up the actor.
+ * It is passed a copy of the memory, so it may only use what is held in the
+ * memory itself, such as handles and numbers. It must not follow pointers to
+ * other objects, which may already have been collected.
+ */
+ATTRIBUTE_MALLOC(void* pony_alloc_final_deferred(pony_ctx_t* ctx, size_t size,
+  pony_final_fn final));
+
 /// Trigger GC next time the current actor is scheduled
 void pony_triggergc(pony_actor_t* actor);
 
+/**
+ * Sets how the cycle detector finds unreachable actors. This can be changed
+ * while the program runs: actors that have already blocked still unblock as
+ * normal after cycle detection is turned off.
+ */
+void pony_cycle_setmode(pony_cdmode_t mode);
+
+/**
+ * Asks the cycle detector to look for cycles among every blocked actor it
+ * knows about, whatever the mode.
+ */
+void pony_cycle_detect(pony_ctx_t* ctx);
+
 /** Start gc tracing for sending.
  *
  * Call this before sending a message if it has anything in it that can be
@@ -241,6 +568,23 @@ void pony_traceactor(pony_ctx_t* ctx, pony_actor_t* p);
  */
 void pony_traceobject(pony_ctx_t* ctx, void* p, pony_trace_fn f);
 
+/** Trace an immutable object.
+ *
+ * Like pony_traceobject(), but for a pointer to an object that can't change,
+ * such as a val. Everything reachable from it must be immutable too. Sending
+ * or receiving it doesn't trace its contents: the owner keeps them alive for
+ * as long as the object is shared.
+ */
+void pony_traceimmutable(pony_ctx_t* ctx, void* p, pony_trace_fn f);
+
+/** Trace a pointer-free array.
+ *
+ * The trace function for an Array whose elements are never traced. It traces
+ * the array's buffer and nothing else. The GC recognises it and traces the
+ * buffer on the spot rather than queueing the array to be traced later.
+ */
+void pony_trace_leaf_array(pony_ctx_t* ctx, void* p);
+
 /** Trace unknown.
  *
  * This should be called for fields in an object with an unknown type, but
@@ -248,6 +592,12 @@ void pony_traceobject(pony_ctx_t* ctx, void* p, pony_trace_fn f);
  */
 void pony_traceunknown(pony_ctx_t* ctx, void* p);
 
+/** Trace an immutable unknown.
+ *
+ * Like pony_traceunknown(), but for fields that are known to be immutable.
+ */
+void pony_traceunknownimmutable(pony_ctx_t* ctx, void* p);
+
 /** Trace a tag or an actor
  *
  * This should be called for fields in an object that might be an actor or
@@ -255,6 +605,124 @@ void pony_traceunknown(pony_ctx_t* ctx, void* p);
  */
 void pony_trace_tag_or_actor(pony_ctx_t* ctx, void* p);
 
+/** Write barrier for a field.
+ *
+ * Call this after storing a pointer in a field of the object p, which is
+ * traced by f. With a nursery set, a minor gc pass only traces objects
+ * allocated since the last pass, so an older object written to since then
+ * must be remembered and traced again. This does nothing without a nursery.
+ */
+void pony_writebarrier(pony_ctx_t* ctx, void* p, pony_trace_fn f);
+
+/** Write barrier for a value.
+ *
+ * Like pony_writebarrier(), but for storing value into memory that has no
+ * trace function of its own, such as the buffer behind a Pointer. The value is
+ * remembered instead of p, and is traced with f. If f is NULL, the value is
+ * kept without tracing its contents.
+ */
+void pony_writebarrier_value(pony_ctx_t* ctx, void* p, void* value,
+  pony_trace_fn f);
+
+/** Write barrier for a value of unknown type.
+ *
+ * Like pony_writebarrier_value(), but the value is traced with the trace
+ * function from its type descriptor.
+ */
+void pony_writebarrier_unknown(pony_ctx_t* ctx, void* p, void* value);
+
+/** Register the program's types for serialisation.
+ *
+ * types holds the descriptor for each type ID, and instances holds the single
+ * instance of each primitive, or NULL. A program that uses serialisation calls
+ * this before it starts the runtime.
+ */
+void pony_serialise_types(pony_type_t** types, void** instances,
+  uint32_t count);
+
+/** Serialise an object graph.
+ *
+ * Copies everything reachable from p into a single image allocated on the
+ * current actor's heap, and writes its size to size. Pointers in the image are
+ * offsets from its start, so it can be stored or sent to another process
+ * running the same program. Objects reached more than once are copied once.
+ * Raises an error if the graph holds an actor, an object with a finaliser, or
+ * a raw pointer other than the buffer of an Array or a String.
+ */
+void* pony_serialise(pony_ctx_t* ctx, void* p, size_t* size);
+
+/** Deserialise an object graph.
+ *
+ * Copies an image made by pony_serialise() into a single allocation on the
+ * current actor's heap and turns its offsets back into pointers in place,
+ * returning the root object. Raises an error if the image is malformed or was
+ * made by a different program. Offsets are checked to stay inside the image
+ * and objects not to overlap, but the type of each object isn't checked
+ * against the field that refers to it, so only load trusted images.
+ */
+void* pony_deserialise(pony_ctx_t* ctx, const void* image, size_t size);
+
+/**
+ * Used by serialise functions. Returns the offset in the image for the object
+ * p, copying it there later if it hasn't been reached before.
+ */
+size_t pony_serialise_offset(pony_ctx_t* ctx, void* p);
+
+/**
+ * Used by serialise functions. Returns the address of an offset in the image.
+ * Space is added to the image as objects are reached, which may move it, so
+ * this must be called again after pony_serialise_offset().
+ */
+void* pony_serialise_addr(pony_ctx_t* ctx, size_t offset);
+
+/**
+ * Used by serialise functions. Serialises the embedded object p, whose copy
+ * is at offset.
+ */
+void pony_serialise_embed(pony_ctx_t* ctx, void* p, size_t offset);
+
+/**
+ * Used by serialise functions. Copies the elements of the Array p, whose copy
+ * is at offset, and returns the offset of the copied elements.
+ */
+size_t pony_serialise_array(pony_ctx_t* ctx, void* p, size_t offset,
+  size_t elem_size);
+
+/**
+ * Used by serialise functions. Copies the bytes of the String p, whose copy
+ * is at offset, with a null terminator.
+ */
+void pony_serialise_string(pony_ctx_t* ctx, void* p, size_t offset);
+
+/**
+ * Used by serialise and deserialise functions for a type that can't be
+ * serialised, such as one holding a raw pointer.
+ */
+void pony_serialise_fail(pony_ctx_t* ctx);
+
+/**
+ * Used by deserialise functions. Returns the object at an offset in the image.
+ */
+void* pony_deserialise_offset(pony_ctx_t* ctx, uintptr_t offset);
+
+/**
+ * Used by deserialise functions. Deserialises the embedded object p, which
+ * must be of the given type.
+ */
+void pony_deserialise_embed(pony_ctx_t* ctx, void* p, pony_type_t* type);
+
+/**
+ * Used by deserialise functions. Points the Array p at its elements in the
+ * image and returns them, or NULL if it has none.
+ */
+void* pony_deserialise_array(pony_ctx_t* ctx, void* p, size_t elem_size);
+
+/**
+ * Used by deserialise functions. Points the String p at its bytes in the
+ * image.
+ */
+void pony_deserialise_string(pony_ctx_t* ctx, void* p);
+
 /** Initialize the runtime.
  *
  * Call this first. It will strip out command line arguments that you should
@@ -268,6 +736,16 @@ void pony_trace_tag_or_actor(pony_ctx_t* ctx, void* p);
  */
 int pony_init(int argc, char** argv);
 
+/** Reserve memory for each scheduler thread as it starts.
+ *
+ * Each scheduler thread maps this many bytes for its memory pool and faults
+ * them in before it runs any actor, so that the first allocations after
+ * startup don't wait on the OS. If lock is true, the memory is also locked in
+ * RAM. This is the same as --ponyprealloc, in bytes rather than MB, and
+ * --ponypreallocmlock. Call it after pony_init() and before pony_start().
+ */
+void pony_prealloc(size_t bytes, bool lock);
+
 /** Starts the pony runtime.
  *
  * Returns -1 if the scheduler couldn't start, otherwise returns the exit code
@@ -282,6 +760,30 @@ int pony_init(int argc, char** argv);
  */
 int pony_start(bool library);
 
+/** Starts the pony runtime for a program that runs actors on its own threads.
+ *
+ * No scheduler threads are started. Instead, each thread that calls
+ * pony_register_thread() claims one of the --ponythreads schedulers while any
+ * are left, and runs actors by calling pony_run_slice() from its own event
+ * loop or thread pool. The calling thread is registered. If asio is false, no
+ * ASIO or timer threads are started either, and actors get no I/O events or
+ * timers.
+ *
+ * Returns -1 if the runtime couldn't start, otherwise 0. Call pony_stop() to
+ * terminate the runtime, once no other thread is running slices.
+ */
+int pony_start_embedded(bool asio);
+
+/**
+ * Runs actors on the calling thread, which must have claimed a scheduler with
+ * pony_register_thread() after pony_start_embedded(), for about budget_ns
+ * nanoseconds. A batch of messages is never cut short, so a slice can run
+ * over. Returns early, with false, once there is nothing left to run, and
+ * returns false straight away on any other thread. Returns true if the budget
+ * ran out first.
+ */
+bool pony_run_slice(pony_ctx_t* ctx, uint64_t budget_ns);
+
 /**
  * Call this to create a pony_ctx_t for a non-scheduler thread. This has to be
  * done before calling pony_ctx(), and before calling any Pony code from the
@@ -289,14 +791,47 @@ int pony_start(bool library);
  *
  * The thread that calls pony_start() is automatically registered. It's safe,
  * but not necessary, to call this more than once.
+ *
+ * After pony_start_embedded(), this also claims a scheduler for the thread if
+ * one is left, so that the thread can call pony_run_slice().
  */
 void pony_register_thread();
 
+/** A ring that foreign threads push machine words into, for an actor.
+ *
+ * A ring is made by a ForeignRing in the runtime package, and its handle is
+ * passed to native code. Pushing is lock free and never blocks: it fails when
+ * the ring is full. The consuming actor is sent a message only when it is
+ * waiting for words, so a busy ring costs no messages at all.
+ */
+typedef struct pony_ring_t pony_ring_t;
+
+/** Pushes a word. Returns false if the ring is full or has been closed.
+ *
+ * Any thread can push, unless the ring was made for a single producer, in
+ * which case only one thread may push at a time. The thread is registered
+ * with pony_register_thread() if it hasn't been.
+ */
+bool pony_ring_push(pony_ring_t* ring, uintptr_t data);
+
+/** Pushes up to count words, in order, and returns how many there was room
+ * for. The space is claimed all at once, so this is much cheaper than pushing
+ * the words one by one.
+ */
+size_t pony_ring_push_batch(pony_ring_t* ring, const uintptr_t* data,
+  size_t count);
+
+/** Lets go of the ring once nothing on the native side will push to it
+ * again. The ring is freed once the consuming actor has also let go of it.
+ */
+void pony_ring_release(pony_ring_t* ring);
+
 /** Signals that the pony runtime may terminate.
  *
  * This only needs to be called if pony_start() was called with library set to
- * true. This returns the exit code, defaulting to zero. This call won't return
- * until the runtime actually terminates.
+ * true, or after pony_start_embedded(). This returns the exit code, defaulting
+ * to zero. This call won't return until the runtime actually terminates. An
+ * embedded runtime runs what is left of the program on the calling thread.
  */
 int pony_stop();
 
@@ -323,6 +858,149 @@ void pony_schedule(pony_ctx_t* ctx, pony_actor_t* actor);
  */
 void pony_unschedule(pony_ctx_t* ctx, pony_actor_t* actor);
 
+/**
+ * Sets the scheduling class of an actor. This is not concurrency safe: this
+ * should be done on the current actor or an actor that has never been sent a
+ * message.
+ */
+void pony_setclass(pony_actor_t* actor, pony_sched_class_t sched_class);
+
+/**
+ * Pins an actor to a scheduler thread. A pinned actor is only run by that
+ * thread, and is never stolen by another, so it keeps its heap in that core's
+ * caches. The index is taken modulo the number of scheduler threads. This
+ * takes effect the next time the actor is scheduled, so it is safe to do on
+ * the current actor.
+ */
+void pony_pin(pony_actor_t* actor, uint32_t index);
+
+/**
+ * Pins an actor to the calling scheduler thread. Called by an actor on itself,
+ * this makes it stay where it is running. Does nothing on a thread that isn't
+ * a scheduler thread.
+ */
+void pony_sticky(pony_actor_t* actor);
+
+/// Lets any scheduler thread run an actor again.
+void pony_unpin(pony_actor_t* actor);
+
+/// Returns the number of scheduler threads.
+uint32_t pony_scheduler_count();
+
+/**
+ * Copies the statistics for a scheduler thread. Returns false if there is no
+ * scheduler with that index.
+ */
+bool pony_scheduler_stats(uint32_t index, pony_sched_stats_t* stats);
+
+/**
+ * Fills in the message latency histogram for an actor type, summed over all
+ * scheduler threads. Returns false if no messages to that type have been
+ * sampled. Like the scheduler statistics, this is approximate while the
+ * program is running.
+ */
+bool pony_latency(pony_type_t* type, pony_latency_t* hist);
+
+/// Like pony_latency, for the type of the given actor.
+bool pony_latency_of(pony_actor_t* actor, pony_latency_t* hist);
+
+/// Writes the message latency histogram for every sampled type to stderr.
+void pony_latency_dump();
+
+/**
+ * Fills in up to count of the live actors with the most heap memory, or the
+ * most queued messages if by_queue is true, largest first. Returns the number
+ * filled in. Actors keep running while they are read, so this is approximate.
+ */
+size_t pony_actor_memory(pony_actor_memory_t* top, size_t count,
+  bool by_queue);
+
+/**
+ * Fills in the actor at one rank, from 0, of pony_actor_memory(). Returns false
+ * if there are too few live actors.
+ */
+bool pony_actor_memory_rank(size_t rank, bool by_queue,
+  pony_actor_memory_t* stats);
+
+/**
+ * Fills in up to count of the actor types whose live actors have the most heap
+ * memory between them, largest first. Returns the number filled in.
+ */
+size_t pony_type_memory(pony_type_memory_t* top, size_t count);
+
+/**
+ * Fills in the type at one rank, from 0, of pony_type_memory(). Returns false
+ * if too few types have live actors.
+ */
+bool pony_type_memory_rank(size_t rank, pony_type_memory_t* stats);
+
+/// Writes the actor types and actors using the most memory to stderr.
+void pony_memory_dump();
+
+/**
+ * Asks an actor for a census of its heap. At its next gc pass, which is a full
+ * one and happens the next time it runs, the actor writes to stderr the
+ * objects and bytes that are live in its heap by type, the buffers, such as
+ * array contents, that each type points to, and the number of references
+ * between each pair of types. An actor that never runs again never writes
+ * its census.
+ *
+ * If graph isn't NULL or empty, the actor also writes every object in its
+ * heap that it can reach, and the references to them, to a file at that path,
+ * one per line:
+ *
+ *   actor <address> <type id>
+ *   object <address> <type id> <bytes>
+ *   buffer <address> <bytes>
+ *   ref <from address> <to address>
+ *   held <address>
+ *
+ * where held is an object kept alive by other actors. Only the latest request
+ * for a graph is kept. Returns false if the object isn't an actor.
+ */
+bool pony_heap_census(pony_actor_t* actor, const char* graph);
+
+/// Asks every live actor for a census of its heap, as pony_heap_census().
+void pony_heap_census_all();
+
+/**
+ * Writes the allocations sampled by the heap profiler, turned on with
+ * --ponyheapprofile, to a file in the heap profile format read by pprof. Each
+ * backtrace has its live and total sampled objects and bytes. Returns false if
+ * the profiler is off or the file can't be written.
+ */
+bool pony_heapprofile_dump(const char* path);
+
+/**
+ * Writes the behaviours that have used the most CPU time, as measured with
+ * --ponyprofile, to a file. Each has its share of the time spent in all
+ * behaviours, its total time, how many times it ran and its mean time. Up to
+ * count behaviours are written, or all of them if count is 0. Returns false
+ * if the profile is off or the file can't be written.
+ */
+bool pony_profile_dump(const char* path, size_t count);
+
+/** CPU features, as reported by pony_cpu_features().
+ *
+ * Code built with --dispatch picks between versions of a function compiled
+ * for different CPUs by checking these.
+ */
+enum
+{
+  PONY_CPU_SSE42 = 1 << 0,
+  PONY_CPU_AVX = 1 << 1,
+  PONY_CPU_AVX2 = 1 << 2,
+  PONY_CPU_FMA = 1 << 3,
+  PONY_CPU_BMI2 = 1 << 4,
+  PONY_CPU_AVX512F = 1 << 5
+};
+
+/**
+ * Returns the PONY_CPU_ flags for the features this CPU and OS support. This
+ * is 0 on anything other than x86.
+ */
+uint32_t pony_cpu_features();
+
 /**
  * Call this to "become" an actor on a non-scheduler context, i.e. from outside
  * the pony runtime. Following this, pony API calls can be made as if the actor
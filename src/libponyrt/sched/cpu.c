@@ -6,8 +6,15 @@
 #if defined(PLATFORM_IS_LINUX) || defined(PLATFORM_IS_FREEBSD)
   #include <sched.h>
   #include <stdlib.h>
+  #include <string.h>
   #include <unistd.h>
   #include <stdio.h>
+#endif
+
+#if defined(PLATFORM_IS_FREEBSD)
+  #include <sys/param.h>
+  #include <sys/cpuset.h>
+  typedef cpuset_t cpu_set_t;
 #elif defined(PLATFORM_IS_MACOSX)
   #include <unistd.h>
   #include <mach/mach.h>
@@ -33,7 +40,80 @@ static uint32_t property(const char* key)
 }
 #endif
 
+static bool cpu_pin;
+static uint32_t cpu_asio_id = (uint32_t)-1;
+
+#if defined(PLATFORM_IS_LINUX) || defined(PLATFORM_IS_FREEBSD)
+static bool cpu_listed;
+static cpu_set_t cpu_list_set;
+#endif
+
 #if defined(PLATFORM_IS_LINUX)
+static cpu_set_t cpu_allowed;
+
+/**
+ * Whether scheduler threads may use a CPU: it is in the process's affinity
+ * mask, which a cgroup cpuset or taskset restricts, in the --ponycpus list if
+ * there is one, and isn't the CPU the ASIO threads are pinned to.
+ */
+static bool cpu_usable(uint32_t cpu)
+{
+  if(cpu >= CPU_SETSIZE)
+    return false;
+
+  if(cpu_listed && !CPU_ISSET(cpu, &cpu_list_set))
+    return false;
+
+  return CPU_ISSET(cpu, &cpu_allowed) && (cpu != cpu_asio_id);
+}
+
+/**
+ * The number of CPUs' worth of time the process's cgroup may use, rounded up,
+ * or 0 if it isn't limited. This reads the cgroup v2 cpu.max, or the v1 CFS
+ * quota and period, of the cgroup mounted at /sys/fs/cgroup, which is the
+ * process's own inside a container.
+ */
+static uint32_t cpu_quota()
+{
+  long long quota = -1;
+  long long period = 0;
+  FILE* fp = fopen("/sys/fs/cgroup/cpu.max", "r");
+
+  if(fp != NULL)
+  {
+    // Either "max <period>" or "<quota> <period>".
+    if(fscanf(fp, "%lld %lld", &quota, &period) != 2)
+      quota = -1;
+
+    fclose(fp);
+  } else {
+    fp = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");
+
+    if(fp != NULL)
+    {
+      if(fscanf(fp, "%lld", &quota) != 1)
+        quota = -1;
+
+      fclose(fp);
+    }
+
+    fp = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+
+    if(fp != NULL)
+    {
+      if(fscanf(fp, "%lld", &period) != 1)
+        period = 0;
+
+      fclose(fp);
+    }
+  }
+
+  if((quota <= 0) || (period <= 0))
+    return 0;
+
+  return (uint32_t)((quota + period - 1) / period);
+}
+
 static bool cpu_physical(uint32_t cpu)
 {
   char file[FILENAME_MAX];
@@ -57,25 +137,122 @@ static bool cpu_physical(uint32_t cpu)
 }
 #endif
 
-uint32_t cpu_count()
+#if defined(PLATFORM_IS_LINUX) || defined(PLATFORM_IS_FREEBSD)
+/**
+ * Parses a list such as "0-3,8,10-11" into a set.
+ */
+static bool cpu_parse(const char* list, cpu_set_t* set)
+{
+  CPU_ZERO(set);
+
+  while(*list != '\0')
+  {
+    char* end;
+    unsigned long first = strtoul(list, &end, 10);
+    unsigned long last = first;
+
+    if(end == list)
+      return false;
+
+    if(*end == '-')
+    {
+      list = end + 1;
+      last = strtoul(list, &end, 10);
+
+      if((end == list) || (last < first))
+        return false;
+    }
+
+    if(last >= CPU_SETSIZE)
+      return false;
+
+    for(unsigned long i = first; i <= last; i++)
+      CPU_SET(i, set);
+
+    if(*end == ',')
+      end++;
+    else if(*end != '\0')
+      return false;
+
+    list = end;
+  }
+
+  return true;
+}
+#endif
+
+bool cpu_setaffinity(bool pin, const char* cpus, uint32_t asio_cpu)
 {
+  cpu_pin = pin;
+  cpu_asio_id = asio_cpu;
+
 #if defined(PLATFORM_IS_LINUX)
-  uint32_t count = pony_numa_cores();
+  if(sched_getaffinity(0, sizeof(cpu_set_t), &cpu_allowed) != 0)
+  {
+    CPU_ZERO(&cpu_allowed);
+
+    for(uint32_t i = 0; i < CPU_SETSIZE; i++)
+      CPU_SET(i, &cpu_allowed);
+  }
+#endif
 
-  if(count > 0)
-    return count;
+#if defined(PLATFORM_IS_LINUX) || defined(PLATFORM_IS_FREEBSD)
+  cpu_listed = cpus != NULL;
 
-  uint32_t max = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
-  count = 0;
+  if(cpu_listed &&
+    (!cpu_parse(cpus, &cpu_list_set) || (CPU_COUNT(&cpu_list_set) == 0)))
+    return false;
+#else
+  (void)cpus;
+#endif
+
+  return true;
+}
+
+uint32_t cpu_asio()
+{
+  return cpu_asio_id;
+}
+
+uint32_t cpu_count()
+{
+#if defined(PLATFORM_IS_LINUX)
+  // Count the physical cores among the usable CPUs. Every CPU in an explicit
+  // list counts, hyperthread or not, as does every usable CPU if none of them
+  // is the first thread of its core.
+  uint32_t max = (uint32_t)sysconf(_SC_NPROCESSORS_CONF);
+  uint32_t count = 0;
+  uint32_t usable = 0;
 
   for(uint32_t i = 0; i < max; i++)
   {
+    if(!cpu_usable(i))
+      continue;
+
+    usable++;
+
     if(cpu_physical(i))
       count++;
   }
 
-  return count;
+  if(cpu_listed || (count == 0))
+    count = usable;
+
+  // A CPU quota, such as a container's CPU limit, caps the count, so that
+  // the schedulers aren't throttled.
+  uint32_t quota = cpu_quota();
+
+  if((quota > 0) && (quota < count))
+    count = quota;
+
+  return (count > 0) ? count : 1;
 #elif defined(PLATFORM_IS_FREEBSD)
+  if(cpu_listed)
+  {
+    uint32_t count = (uint32_t)CPU_COUNT(&cpu_list_set);
+    return (count > 0) ? count : 1;
+  }
+
   return property("hw.ncpu");
 #elif defined(PLATFORM_IS_MACOSX)
   return property("hw.physicalcpu");
@@ -127,39 +304,69 @@ uint32_t cpu_count()
 void cpu_assign(uint32_t count, scheduler_t* scheduler)
 {
 #if defined(PLATFORM_IS_LINUX)
-  uint32_t cpu_count = pony_numa_cores();
+  uint32_t max = (uint32_t)sysconf(_SC_NPROCESSORS_CONF);
+  size_t size = max * sizeof(uint32_t);
+  uint32_t* list = (uint32_t*)pool_alloc_size(size);
+  uint32_t cpu_count = 0;
 
-  if(cpu_count > 0)
+  if(pony_numa_cores() > 0)
   {
-    uint32_t* list = pool_alloc_size(cpu_count * sizeof(uint32_t));
+    // CPUs are listed node by node. Drop those that can't be used.
+    memset(list, 0xFF, size);
     pony_numa_core_list(list);
 
-    for(uint32_t i = 0; i < count; i++)
+    for(uint32_t i = 0; i < max; i++)
     {
-      uint32_t cpu = list[i % cpu_count];
-      scheduler[i].cpu = cpu;
-      scheduler[i].node = pony_numa_node_of_cpu(cpu);
+      if(cpu_usable(list[i]))
+        list[cpu_count++] = list[i];
+    }
+  } else {
+    // Physical cores come first, then their other hyperthreads.
+    for(uint32_t i = 0; i < max; i++)
+    {
+      if(cpu_usable(i) && cpu_physical(i))
+        list[cpu_count++] = i;
     }
 
-    pool_free_size(cpu_count * sizeof(uint32_t), list);
-    return;
+    for(uint32_t i = 0; i < max; i++)
+    {
+      if(cpu_usable(i) && !cpu_physical(i))
+        list[cpu_count++] = i;
+    }
   }
 
-  // Physical cores come first, so assign in sequence.
-  cpu_count = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
-
   for(uint32_t i = 0; i < count; i++)
   {
-    scheduler[i].cpu = i % cpu_count;
-    scheduler[i].node = 0;
+    if(cpu_count > 0)
+    {
+      uint32_t cpu = list[i % cpu_count];
+      scheduler[i].cpu = cpu;
+      scheduler[i].node = pony_numa_node_of_cpu(cpu);
+    } else {
+      scheduler[i].cpu = (uint32_t)-1;
+      scheduler[i].node = 0;
+    }
   }
+
+  pool_free_size(size, list);
 #elif defined(PLATFORM_IS_FREEBSD)
-  // Spread across available cores.
+  // Spread across available cores, or those listed.
   uint32_t cpu_count = property("hw.ncpu");
+  uint32_t cpu = 0;
 
   for(uint32_t i = 0; i < count; i++)
   {
-    scheduler[i].cpu = i % cpu_count;
+    if(cpu_listed)
+    {
+      while(!CPU_ISSET(cpu, &cpu_list_set))
+        cpu = (cpu + 1) % CPU_SETSIZE;
+
+      scheduler[i].cpu = cpu;
+      cpu = (cpu + 1) % CPU_SETSIZE;
+    } else {
+      scheduler[i].cpu = i % cpu_count;
+    }
+
     scheduler[i].node = 0;
   }
 #else
@@ -172,8 +379,16 @@ void cpu_assign(uint32_t count, scheduler_t* scheduler)
 #endif
 }
 
+uint32_t cpu_pinned(uint32_t cpu)
+{
+  return cpu_pin ? cpu : (uint32_t)-1;
+}
+
 void cpu_affinity(uint32_t cpu)
 {
+  if(!cpu_pin || (cpu == (uint32_t)-1))
+    return;
+
 #if defined(PLATFORM_IS_LINUX) || defined(PLATFORM_IS_FREEBSD)
   // Affinity is handled when spawning the thread.
   (void)cpu;
@@ -278,3 +493,33 @@ uint64_t cpu_tick()
 # endif
 #endif
 }
+
+uint32_t pony_cpu_features()
+{
+  uint32_t features = 0;
+
+#if defined(PLATFORM_IS_X86) && defined(PLATFORM_IS_CLANG_OR_GCC)
+  // These also check that the OS saves the wider registers.
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("sse4.2"))
+    features |= PONY_CPU_SSE42;
+
+  if(__builtin_cpu_supports("avx"))
+    features |= PONY_CPU_AVX;
+
+  if(__builtin_cpu_supports("avx2"))
+    features |= PONY_CPU_AVX2;
+
+  if(__builtin_cpu_supports("fma"))
+    features |= PONY_CPU_FMA;
+
+  if(__builtin_cpu_supports("bmi2"))
+    features |= PONY_CPU_BMI2;
+
+  if(__builtin_cpu_supports("avx512f"))
+    features |= PONY_CPU_AVX512F;
+#endif
+
+  return features;
+}
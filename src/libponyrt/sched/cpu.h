@@ -8,10 +8,29 @@
 
 PONY_EXTERN_C_BEGIN
 
+/**
+ * Sets whether scheduler threads are pinned to their CPUs, the CPUs they may
+ * use as a list such as "0-3,8", or NULL for any in the process's affinity
+ * mask, and the CPU to pin ASIO threads to, or -1 to leave them unpinned.
+ * Returns false if the list can't be parsed. Call before cpu_count().
+ */
+bool cpu_setaffinity(bool pin, const char* cpus, uint32_t asio_cpu);
+
+/**
+ * The CPU to pin ASIO threads to, or -1.
+ */
+uint32_t cpu_asio();
+
 uint32_t cpu_count();
 
 void cpu_assign(uint32_t count, scheduler_t* scheduler);
 
+/**
+ * The CPU to pass to pony_thread_create() for a scheduler thread assigned
+ * to cpu, which is -1 unless scheduler threads are pinned.
+ */
+uint32_t cpu_pinned(uint32_t cpu);
+
 void cpu_affinity(uint32_t cpu);
 
 void cpu_core_pause(uint64_t tsc, uint64_t tsc2, bool yield);
@@ -0,0 +1,138 @@
+#include "eventlog.h"
+#include "cpu.h"
+#include "../actor/actor.h"
+#include "../ds/fun.h"
+#include "../lang/clock.h"
+#include "../mem/pool.h"
+#include <stdio.h>
+#include <string.h>
+
+struct eventlog_t
+{
+  eventlog_event_t* events;
+  uint64_t next;
+  uint32_t index;
+  uint32_t cpu;
+  struct eventlog_t* link;
+};
+
+static const char* eventlog_path;
+static size_t eventlog_size;
+static uint64_t start_tsc;
+static uint64_t start_nanos;
+static eventlog_t* eventlogs;
+
+void eventlog_setfile(const char* path, size_t size)
+{
+  eventlog_path = path;
+  eventlog_size = next_pow2((size < 2) ? 2 : size);
+}
+
+eventlog_t* eventlog_create(uint32_t index, uint32_t cpu)
+{
+  if(eventlog_path == NULL)
+    return NULL;
+
+  if(eventlogs == NULL)
+  {
+    start_tsc = cpu_tick();
+    start_nanos = os_clock_nanos();
+  }
+
+  eventlog_t* log = POOL_ALLOC(eventlog_t);
+  log->events = (eventlog_event_t*)pool_alloc_size(
+    eventlog_size * sizeof(eventlog_event_t));
+  log->next = 0;
+  log->index = index;
+  log->cpu = cpu;
+
+  // Every ring is created by scheduler_init(), on one thread.
+  log->link = eventlogs;
+  eventlogs = log;
+  return log;
+}
+
+void eventlog_record(eventlog_t* log, uint32_t kind, pony_actor_t* actor,
+  pony_actor_t* other, uint32_t arg)
+{
+  eventlog_event_t* e = &log->events[log->next++ & (eventlog_size - 1)];
+
+  e->tsc = cpu_tick();
+  e->actor = (uint64_t)(uintptr_t)actor;
+  e->other = (uint64_t)(uintptr_t)other;
+  e->type = (actor != NULL) ? actor->type->id : 0;
+  e->arg = arg;
+  e->kind = kind;
+  e->pad = 0;
+}
+
+static void write_log(FILE* fp, eventlog_t* log)
+{
+  uint64_t first = 0;
+
+  if(log->next > eventlog_size)
+    first = log->next - eventlog_size;
+
+  eventlog_file_sched_t sched;
+  sched.index = log->index;
+  sched.cpu = log->cpu;
+  sched.count = log->next - first;
+  fwrite(&sched, sizeof(sched), 1, fp);
+
+  // The oldest event is at the write position once the ring has wrapped.
+  size_t mask = eventlog_size - 1;
+  size_t from = (size_t)(first & mask);
+  size_t count = (size_t)sched.count;
+  size_t tail = eventlog_size - from;
+
+  if(tail > count)
+    tail = count;
+
+  fwrite(&log->events[from], sizeof(eventlog_event_t), tail, fp);
+  fwrite(log->events, sizeof(eventlog_event_t), count - tail, fp);
+}
+
+void eventlog_write()
+{
+  if(eventlogs == NULL)
+    return;
+
+  eventlog_file_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, EVENTLOG_MAGIC, sizeof(header.magic));
+  header.event_size = sizeof(eventlog_event_t);
+  header.start_tsc = start_tsc;
+  header.start_nanos = start_nanos;
+  header.end_tsc = cpu_tick();
+  header.end_nanos = os_clock_nanos();
+
+  for(eventlog_t* log = eventlogs; log != NULL; log = log->link)
+    header.schedulers++;
+
+  FILE* fp = fopen(eventlog_path, "wb");
+
+  if(fp == NULL)
+    fprintf(stderr, "Can't write the event log to %s\n", eventlog_path);
+
+  if(fp != NULL)
+    fwrite(&header, sizeof(header), 1, fp);
+
+  eventlog_t* log = eventlogs;
+
+  while(log != NULL)
+  {
+    eventlog_t* next = log->link;
+
+    if(fp != NULL)
+      write_log(fp, log);
+
+    pool_free_size(eventlog_size * sizeof(eventlog_event_t), log->events);
+    POOL_FREE(eventlog_t, log);
+    log = next;
+  }
+
+  eventlogs = NULL;
+
+  if(fp != NULL)
+    fclose(fp);
+}
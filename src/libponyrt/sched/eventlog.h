@@ -0,0 +1,101 @@
+#ifndef sched_eventlog_h
+#define sched_eventlog_h
+
+#include <pony.h>
+#include <platform.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+PONY_EXTERN_C_BEGIN
+
+/**
+ * A ring of scheduling events for one scheduler thread. Only the owning
+ * thread records in it, so recording takes no lock and no atomic operation.
+ * Once the ring is full, each event overwrites the oldest one.
+ */
+typedef struct eventlog_t eventlog_t;
+
+enum
+{
+  EVENTLOG_RUN_START = 1,
+  EVENTLOG_RUN_END,
+  EVENTLOG_BEHAVIOUR_START,
+  EVENTLOG_BEHAVIOUR_END,
+  EVENTLOG_GC_START,
+  EVENTLOG_GC_END,
+  EVENTLOG_STEAL_START,
+  EVENTLOG_STEAL_END,
+  EVENTLOG_SEND
+};
+
+#define EVENTLOG_MAGIC "PONYEVT1"
+
+/**
+ * The file starts with this header, followed by each scheduler's events in
+ * the order they were recorded, as an eventlog_file_sched_t and count
+ * eventlog_event_t. Values are in the byte order of the machine that wrote
+ * them.
+ */
+typedef struct eventlog_file_t
+{
+  char magic[8];
+  uint32_t schedulers;
+  uint32_t event_size;
+
+  // The cpu_tick() and nanosecond clock read together when logging started
+  // and when the file was written, to convert ticks to time.
+  uint64_t start_tsc;
+  uint64_t start_nanos;
+  uint64_t end_tsc;
+  uint64_t end_nanos;
+} eventlog_file_t;
+
+typedef struct eventlog_file_sched_t
+{
+  uint32_t index;
+  uint32_t cpu;
+  uint64_t count;
+} eventlog_file_sched_t;
+
+/**
+ * For a run, the argument is the batch size at the start, and whether the
+ * actor is rescheduled at the end. For a behaviour and a send, it is the
+ * message ID, and for a GC pass, whether it is minor. The other actor is the
+ * receiver of a send, or the actor found by a steal.
+ */
+typedef struct eventlog_event_t
+{
+  uint64_t tsc;
+  uint64_t actor;
+  uint64_t other;
+  uint32_t type;
+  uint32_t arg;
+  uint32_t kind;
+  uint32_t pad;
+} eventlog_event_t;
+
+/**
+ * Turns on logging, keeping the last size events of each scheduler thread, to
+ * be written to path when the runtime stops. A NULL path, the default, leaves
+ * it off. Must be called before scheduler_init().
+ */
+void eventlog_setfile(const char* path, size_t size);
+
+/**
+ * Returns a new ring for the scheduler thread with the given index, running on
+ * the given CPU, or NULL if logging is off.
+ */
+eventlog_t* eventlog_create(uint32_t index, uint32_t cpu);
+
+void eventlog_record(eventlog_t* log, uint32_t kind, pony_actor_t* actor,
+  pony_actor_t* other, uint32_t arg);
+
+/**
+ * Writes every ring to the file and frees them. Called once the scheduler
+ * threads have stopped. Does nothing if logging is off.
+ */
+void eventlog_write();
+
+PONY_EXTERN_C_END
+
+#endif
@@ -48,6 +48,30 @@ void mpmcq_push_single(mpmcq_t* q, void* data)
   prev->next = node;
 }
 
+void mpmcq_push_batch(mpmcq_t* q, void** data, size_t count)
+{
+  if(count == 0)
+    return;
+
+  // Link the nodes privately, then publish the whole chain at once.
+  mpmcq_node_t* first = POOL_ALLOC(mpmcq_node_t);
+  mpmcq_node_t* last = first;
+  first->data = data[0];
+
+  for(size_t i = 1; i < count; i++)
+  {
+    mpmcq_node_t* node = POOL_ALLOC(mpmcq_node_t);
+    node->data = data[i];
+    last->next = node;
+    last = node;
+  }
+
+  last->next = NULL;
+
+  mpmcq_node_t* prev = (mpmcq_node_t*)_atomic_exchange(&q->head, last);
+  _atomic_store(&prev->next, first);
+}
+
 void* mpmcq_pop(mpmcq_t* q)
 {
   mpmcq_dwcas_t cmp, xchg;
@@ -86,3 +110,9 @@ void* mpmcq_pop(mpmcq_t* q)
   POOL_FREE(mpmcq_node_t, cmp.node);
   return data;
 }
+
+bool mpmcq_empty(mpmcq_t* q)
+{
+  mpmcq_node_t* tail = _atomic_load(&q->tail.node);
+  return _atomic_load(&tail->next) == NULL;
+}
@@ -2,6 +2,8 @@
 #define sched_mpmcq_h
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <platform.h>
 
 PONY_EXTERN_C_BEGIN
@@ -40,8 +42,19 @@ void mpmcq_push(mpmcq_t* q, void* data);
 
 void mpmcq_push_single(mpmcq_t* q, void* data);
 
+/**
+ * Pushes count items, in order, with a single atomic operation on the queue.
+ */
+void mpmcq_push_batch(mpmcq_t* q, void** data, size_t count);
+
 void* mpmcq_pop(mpmcq_t* q);
 
+/**
+ * A racy check for an empty queue. It never removes anything, so it is only
+ * suitable as a hint.
+ */
+bool mpmcq_empty(mpmcq_t* q);
+
 PONY_EXTERN_C_END
 
 #endif
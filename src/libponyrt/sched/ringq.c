@@ -0,0 +1,110 @@
+#include "ringq.h"
+#include "../ds/fun.h"
+#include "../mem/pool.h"
+#include <string.h>
+
+struct ringq_slot_t
+{
+  // The position the slot was last written for, plus one. A slot is ready to
+  // read at position p when it holds p + 1, which it never does on an earlier
+  // lap around the ring.
+  size_t volatile seq;
+  uintptr_t data;
+};
+
+void ringq_init(ringq_t* q, size_t size, bool multi)
+{
+  size = next_pow2(size < 2 ? 2 : size);
+
+  q->slots = (ringq_slot_t*)pool_alloc_size(size * sizeof(ringq_slot_t));
+  memset(q->slots, 0, size * sizeof(ringq_slot_t));
+  q->mask = size - 1;
+  q->multi = multi;
+  q->tail = 0;
+  q->head = 0;
+}
+
+void ringq_destroy(ringq_t* q)
+{
+  pool_free_size((q->mask + 1) * sizeof(ringq_slot_t), q->slots);
+  q->slots = NULL;
+}
+
+static size_t claim(ringq_t* q, size_t count, size_t* pos)
+{
+  // A slot is free once the consumer has moved past the position a lap
+  // before, so the free slots run from the tail to the head plus the size.
+  for(;;)
+  {
+    size_t head = _atomic_load(&q->head);
+    size_t tail = _atomic_load(&q->tail);
+    size_t used = tail - head;
+
+    // Other producers and the consumer moved on between the two loads, so
+    // the head is too old to say how much room there is.
+    if(used > (q->mask + 1))
+      continue;
+
+    size_t space = (q->mask + 1) - used;
+    size_t n = count < space ? count : space;
+
+    if(n == 0)
+      return 0;
+
+    if(!q->multi)
+      _atomic_store(&q->tail, tail + n);
+    else if(!_atomic_cas(&q->tail, &tail, tail + n))
+      continue;
+
+    *pos = tail;
+    return n;
+  }
+}
+
+bool ringq_push(ringq_t* q, uintptr_t data)
+{
+  return ringq_push_batch(q, &data, 1) == 1;
+}
+
+size_t ringq_push_batch(ringq_t* q, const uintptr_t* data, size_t count)
+{
+  size_t pos;
+  size_t n = claim(q, count, &pos);
+
+  for(size_t i = 0; i < n; i++)
+  {
+    ringq_slot_t* slot = &q->slots[(pos + i) & q->mask];
+    slot->data = data[i];
+    _atomic_store(&slot->seq, pos + i + 1);
+  }
+
+  return n;
+}
+
+size_t ringq_pop_batch(ringq_t* q, uintptr_t* data, size_t max)
+{
+  size_t pos = q->head;
+  size_t n = 0;
+
+  while(n < max)
+  {
+    ringq_slot_t* slot = &q->slots[pos & q->mask];
+
+    if(_atomic_load(&slot->seq) != (pos + 1))
+      break;
+
+    data[n++] = slot->data;
+    pos++;
+  }
+
+  if(n > 0)
+    _atomic_store(&q->head, pos);
+
+  return n;
+}
+
+bool ringq_empty(ringq_t* q)
+{
+  size_t pos = q->head;
+  return _atomic_load(&q->slots[pos & q->mask].seq) != (pos + 1);
+}
@@ -0,0 +1,66 @@
+#ifndef sched_ringq_h
+#define sched_ringq_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <platform.h>
+
+PONY_EXTERN_C_BEGIN
+
+typedef struct ringq_slot_t ringq_slot_t;
+
+/**
+ * A bounded ring of machine words, for any number of producers and a single
+ * consumer. Producers claim slots by moving the tail, with a compare and swap
+ * when there can be more than one of them, and mark each slot as written. The
+ * consumer reads the written slots in order and publishes its head once per
+ * batch, which is what lets producers reuse the slots.
+ */
+__pony_spec_align__(
+  typedef struct ringq_t
+  {
+    ringq_slot_t* slots;
+    size_t mask;
+    bool multi;
+    char pad1[64 - sizeof(void*) - sizeof(size_t) - sizeof(bool)];
+    size_t volatile tail;
+    char pad2[64 - sizeof(size_t)];
+    size_t volatile head;
+  } ringq_t, 64
+);
+
+/**
+ * Gets the ring ready to hold size words, rounded up to a power of 2. If
+ * multi is false, only one thread may push at a time.
+ */
+void ringq_init(ringq_t* q, size_t size, bool multi);
+
+void ringq_destroy(ringq_t* q);
+
+/**
+ * Returns false if the ring is full.
+ */
+bool ringq_push(ringq_t* q, uintptr_t data);
+
+/**
+ * Pushes up to count words, in order, and returns how many there was room
+ * for. The slots are claimed with a single atomic operation on the ring.
+ */
+size_t ringq_push_batch(ringq_t* q, const uintptr_t* data, size_t count);
+
+/**
+ * Pops up to max words into data, and returns how many were popped. Only the
+ * consumer may call this.
+ */
+size_t ringq_pop_batch(ringq_t* q, uintptr_t* data, size_t max);
+
+/**
+ * Whether the next word is still to be written. Only the consumer may call
+ * this, and for it, a ring that isn't empty stays that way.
+ */
+bool ringq_empty(ringq_t* q);
+
+PONY_EXTERN_C_END
+
+#endif
@@ -1,24 +1,65 @@
 #include "scheduler.h"
 #include "cpu.h"
 #include "mpmcq.h"
+#include "wsdeque.h"
 #include "../actor/actor.h"
 #include "../gc/cycle.h"
+#include "../gc/finaliser.h"
 #include "../asio/asio.h"
+#include "../lang/clock.h"
 #include "../mem/pool.h"
+#include "../mem/heapprof.h"
+#include <dtrace.h>
 #include <string.h>
 #include <stdio.h>
+#include <inttypes.h>
 #include <assert.h>
 
 #define SCHED_BATCH 100
+#define SCHED_BATCH_INTERACTIVE 10
+#define SCHED_QUEUE_SIZE 1024
+
+// Bounds, in cycles, on how long an idle scheduler spins before parking.
+#define SCHED_SPIN_MIN 1000000
+#define SCHED_SPIN_MAX 100000000
+
+// An active scheduler that has found nothing to steal for this many cycles
+// may suspend itself.
+#define SCHED_SUSPEND_IDLE 1000000000
+
+// A scheduler with this many actors queued asks for another active scheduler.
+#define SCHED_SCALE_DEPTH 32
+
+// Until every scheduler has a thread, this many is enough. A short program
+// then never starts more than one thread, but a program that fans out gets a
+// thread for each core about as soon as it would have if they all started
+// together.
+#define SCHED_SPAWN_DEPTH 2
+
+// A busy scheduler refreshes its pool statistics after this many actor runs.
+#define SCHED_STATS_RUNS 64
+
+// The most actors a scheduler takes from the inject queue at once.
+#define SCHED_INJECT_BATCH 16
+
+// The most times in a row the run next slot is used before the scheduler
+// takes from its queue instead, so that two actors messaging each other can't
+// starve everything else.
+#define SCHED_HANDOFF_MAX 16
+
+// Messages freed on behalf of another scheduler are sent back in batches of
+// this many.
+#define SCHED_RETURN_BATCH 64
 
 static DECLARE_THREAD_FN(run_thread);
 
+static void push_pinned(scheduler_t* from, scheduler_t* to,
+  pony_actor_t* actor);
+
+static void unblock();
+
 typedef enum
 {
-  SCHED_BLOCK,
-  SCHED_UNBLOCK,
-  SCHED_CNF,
-  SCHED_ACK,
   SCHED_TERMINATE
 } sched_msg_t;
 
@@ -27,36 +68,458 @@ static uint32_t scheduler_count;
 static scheduler_t* scheduler;
 static bool volatile detect_quiescence;
 static bool use_yield;
-static mpmcq_t inject;
+static bool use_park;
+static bool use_runnext;
+static bool use_cdthread;
+static bool use_embedded;
+static bool volatile threads_running;
+static uint32_t min_active;
+static uint32_t volatile active_count;
+static uint32_t volatile spinning_count;
+static uint32_t volatile sleeping_count;
+
+// Quiescence detection state. Schedulers count themselves in and out of
+// block_count, as does the cycle detector thread if there is one, so that
+// everything is blocked when it reaches block_total. Every unblock advances
+// unblock_epoch. Scheduler 0 starts a
+// confirmation round by advancing cnf_token, and each active scheduler
+// confirms by storing the token in its own acked field.
+static uint32_t volatile block_count;
+static uint32_t block_total;
+static uint32_t volatile unblock_epoch;
+static uint32_t volatile cnf_token;
+static bool volatile finalising;
+static bool use_numa;
+static uint32_t node_count;
+static mpmcq_t* inject;
+static mpmcq_t tasks;
 static __pony_thread_local scheduler_t* this_scheduler;
 
 /**
- * Gets the next actor from the scheduler queue.
+ * Pushes a batch of messages onto the owning scheduler's returned stack. The
+ * owner takes the whole stack at once, so there is no ABA problem.
+ */
+static void return_batch(scheduler_t* owner, msgreturn_t* ret)
+{
+  pony_msg_t* head = _atomic_load(&owner->returned);
+
+  do
+  {
+    ret->tail->next = head;
+  } while(!_atomic_cas(&owner->returned, &head, ret->head));
+
+  ret->head = NULL;
+  ret->tail = NULL;
+  ret->count = 0;
+}
+
+/**
+ * Sends back every partial batch, so that freed messages don't sit here while
+ * we are idle.
+ */
+static void return_all(scheduler_t* sched)
+{
+  if(sched->returns == NULL)
+    return;
+
+  for(uint32_t i = 0; i < scheduler_count; i++)
+  {
+    if(sched->returns[i].count > 0)
+      return_batch(&scheduler[i], &sched->returns[i]);
+  }
+}
+
+/**
+ * Frees the messages other schedulers have sent back to us into our own pool,
+ * where our next allocations will find them.
+ */
+static void reclaim(scheduler_t* sched)
+{
+  if(_atomic_load(&sched->returned) == NULL)
+    return;
+
+  pony_msg_t* m = (pony_msg_t*)_atomic_exchange(&sched->returned, NULL);
+
+  while(m != NULL)
+  {
+    pony_msg_t* next = m->next;
+    pool_free(MSG_INDEX(m->size), m);
+    m = next;
+  }
+}
+
+typedef struct task_t
+{
+  pony_task_fn fn;
+  void* arg;
+} task_t;
+
+/**
+ * Runs the oldest queued task, if there is one. Tasks run with no current
+ * actor. Returns true if a task ran.
+ */
+static bool run_task(scheduler_t* sched)
+{
+  if(mpmcq_empty(&tasks))
+    return false;
+
+  task_t* task = (task_t*)mpmcq_pop(&tasks);
+
+  if(task == NULL)
+    return false;
+
+  pony_task_fn fn = task->fn;
+  void* arg = task->arg;
+  POOL_FREE(task_t, task);
+
+  sched->ctx.current = NULL;
+  fn(&sched->ctx, arg);
+  return true;
+}
+
+/**
+ * Takes an actor pinned to this scheduler, if there is one. Only the owning
+ * thread does this, and no other thread can steal pinned actors.
+ */
+static pony_actor_t* pop_pinned(scheduler_t* sched)
+{
+  if(mpmcq_empty(&sched->pinq))
+    return NULL;
+
+  return (pony_actor_t*)mpmcq_pop(&sched->pinq);
+}
+
+/**
+ * Gets the next actor from the scheduler queues. Only the owning thread pops,
+ * and it pops the most recently scheduled actor. Pinned actors are taken
+ * first, then interactive actors ahead of bulk actors.
  */
 static pony_actor_t* pop(scheduler_t* sched)
 {
-  return (pony_actor_t*)mpmcq_pop(&sched->q);
+  pony_actor_t* actor = pop_pinned(sched);
+
+  if(actor != NULL)
+    return actor;
+
+  actor = (pony_actor_t*)wsdeque_pop(&sched->iq);
+
+  if(actor != NULL)
+    return actor;
+
+  return (pony_actor_t*)wsdeque_pop(&sched->q);
 }
 
 /**
- * Puts an actor on the scheduler queue.
+ * Puts an actor on the scheduler queue for its class. Only the owning thread
+ * pushes. If the local queue is full, the actor spills to the inject queue,
+ * where any scheduler thread can pick it up.
  */
 static void push(scheduler_t* sched, pony_actor_t* actor)
 {
-  mpmcq_push_single(&sched->q, actor);
+  uint32_t pin = actor_pin(actor);
+
+  if(pin != 0)
+  {
+    push_pinned(sched, &scheduler[pin - 1], actor);
+    return;
+  }
+
+  wsdeque_t* q = actor_interactive(actor) ? &sched->iq : &sched->q;
+
+  if(!wsdeque_push(q, actor))
+    mpmcq_push(&inject[sched->node], actor);
 }
 
 /**
- * Handles the global queue and then pops from the local queue
+ * Handles the global queue and then pops from the local queue. Actors on the
+ * global queue are drained in a batch: we run the first, and the rest go on
+ * our local queue, where other schedulers can steal them.
  */
 static pony_actor_t* pop_global(scheduler_t* sched)
 {
-  pony_actor_t* actor = (pony_actor_t*)mpmcq_pop(&inject);
+  pony_actor_t* actor = (pony_actor_t*)mpmcq_pop(&inject[sched->node]);
+
+  if(actor == NULL)
+    return pop(sched);
+
+  for(uint32_t i = 1; i < SCHED_INJECT_BATCH; i++)
+  {
+    pony_actor_t* next = (pony_actor_t*)mpmcq_pop(&inject[sched->node]);
+
+    if(next == NULL)
+      break;
+
+    if(!wsdeque_push(actor_interactive(next) ? &sched->iq : &sched->q, next))
+    {
+      // Our queue is full, leave the rest where they are.
+      mpmcq_push(&inject[sched->node], next);
+      break;
+    }
+  }
+
+  return actor;
+}
+
+/**
+ * Puts muted actors whose receivers have drained back on our queue. A muted
+ * actor that has become overloaded itself is also run again, so that it can
+ * drain its own queue. Returns true if anything was unmuted.
+ */
+static bool unmute(scheduler_t* sched)
+{
+  bool found = false;
+  uint32_t i = 0;
+
+  while(i < sched->muted_count)
+  {
+    muted_t* m = &sched->muted[i];
+
+    if(actor_drained(m->receiver) || actor_overloaded(m->sender))
+    {
+      push(sched, m->sender);
+      *m = sched->muted[--sched->muted_count];
+      found = true;
+    } else {
+      i++;
+    }
+  }
+
+  return found;
+}
+
+/**
+ * Handles the global queue and then takes the oldest actor from the victim's
+ * queues, interactive actors first. This is safe for any thread, including the
+ * victim itself.
+ */
+static pony_actor_t* pop_oldest(scheduler_t* victim)
+{
+  pony_actor_t* actor = (pony_actor_t*)mpmcq_pop(&inject[victim->node]);
+
+  if(actor != NULL)
+    return actor;
+
+  actor = (pony_actor_t*)wsdeque_steal(&victim->iq);
 
   if(actor != NULL)
     return actor;
 
-  return pop(sched);
+  return (pony_actor_t*)wsdeque_steal(&victim->q);
+}
+
+/**
+ * Steals the oldest actor from the victim, and then moves up to half of what
+ * remains in the victim's queue onto our own queue. This evens out load after
+ * a fan out with a single trip through victim selection.
+ */
+static pony_actor_t* steal_batch(scheduler_t* sched, scheduler_t* victim)
+{
+  pony_actor_t* actor = pop_oldest(victim);
+
+  if(victim == sched)
+    return actor;
+
+  if(actor == NULL)
+  {
+    sched->ctx.stats.steal_failures++;
+    return NULL;
+  }
+
+  sched->ctx.stats.steals++;
+  size_t count = wsdeque_size(&victim->q) / 2;
+
+  for(size_t i = 0; i < count; i++)
+  {
+    pony_actor_t* next = (pony_actor_t*)wsdeque_steal(&victim->q);
+
+    if(next == NULL)
+      break;
+
+    push(sched, next);
+  }
+
+  return actor;
+}
+
+/**
+ * Wakes a parked scheduler. Returns false if it wasn't parked. The caller must
+ * have made its work visible, followed by a fence, before calling this.
+ */
+static bool wake(scheduler_t* sched)
+{
+  if(!_atomic_load(&sched->asleep))
+    return false;
+
+  bool woken = false;
+  pony_park_lock(&sched->park);
+
+  if(sched->asleep)
+  {
+    _atomic_store(&sched->asleep, false);
+    _atomic_add(&sleeping_count, (uint32_t)-1);
+    pony_park_signal(&sched->park);
+    woken = true;
+  }
+
+  pony_park_unlock(&sched->park);
+  return woken;
+}
+
+/**
+ * Creates the thread of a scheduler that needs one, unless another thread has
+ * already. Returns false if creating it failed.
+ */
+static bool create_thread(scheduler_t* sched)
+{
+  uint32_t expect = 1;
+
+  if(!_atomic_cas(&sched->started, &expect, 2))
+    return true;
+
+  return pony_thread_create(&sched->tid, run_thread, cpu_pinned(sched->cpu),
+    sched);
+}
+
+/**
+ * Starts the thread of a scheduler that hasn't had one yet. Until now it has
+ * counted as blocked, as it would be if it had a thread with nothing to do.
+ * Returns false if it already had a thread.
+ */
+static bool start_thread(scheduler_t* sched)
+{
+  uint32_t expect = 0;
+
+  if(use_embedded || (_atomic_load(&sched->started) != 0) ||
+    !_atomic_cas(&sched->started, &expect, 1))
+    return false;
+
+  unblock();
+
+  // Before the runtime starts, or while it is starting, scheduler_start()
+  // may be the one to create the thread. It checks after saying it has
+  // started, and we check after saying we need a thread, so one of us does.
+  _atomic_fence();
+
+  if(!_atomic_load(&threads_running))
+    return true;
+
+  if(!create_thread(sched))
+  {
+    // Leave it to be tried again. If it was just made active, it is suspended
+    // again, as in try_suspend().
+    uint32_t index = (uint32_t)(sched - scheduler);
+    uint32_t active = index + 1;
+    _atomic_cas(&active_count, &active, index);
+    _atomic_add(&block_count, 1);
+    _atomic_store(&sched->started, 0);
+  }
+
+  return true;
+}
+
+/**
+ * Puts an actor on the queue of the scheduler it is pinned to, waking that
+ * scheduler if it is parked. from is NULL on a thread that isn't a scheduler.
+ */
+static void push_pinned(scheduler_t* from, scheduler_t* to,
+  pony_actor_t* actor)
+{
+  mpmcq_push(&to->pinq, actor);
+
+  if(start_thread(to))
+    return;
+
+  if(use_park && (to != from))
+  {
+    _atomic_fence();
+    wake(to);
+  }
+}
+
+/**
+ * Called after making an actor runnable. If some active schedulers are parked
+ * and none are looking for work, wake one of them. Returns true if a scheduler
+ * is looking for work.
+ */
+static bool wake_one()
+{
+  _atomic_fence();
+
+  if(_atomic_load(&spinning_count) > 0)
+    return true;
+
+  if(_atomic_load(&sleeping_count) == 0)
+    return false;
+
+  uint32_t active = _atomic_load(&active_count);
+
+  for(uint32_t i = 0; i < active; i++)
+  {
+    if(wake(&scheduler[i]))
+      return true;
+  }
+
+  return false;
+}
+
+/**
+ * Schedulers at or above the active count are suspended. They don't steal,
+ * they aren't woken to look for work, and they don't take part in quiescence
+ * detection.
+ */
+static bool is_suspended(scheduler_t* sched)
+{
+  return (uint32_t)(sched - scheduler) >= _atomic_load(&active_count);
+}
+
+/**
+ * Resume the lowest suspended scheduler, if there is one.
+ */
+static void scale_up()
+{
+  uint32_t active = _atomic_load(&active_count);
+
+  if(active == scheduler_count)
+    return;
+
+  if(_atomic_cas(&active_count, &active, active + 1) &&
+    !start_thread(&scheduler[active]))
+  {
+    _atomic_fence();
+    wake(&scheduler[active]);
+  }
+}
+
+/**
+ * The queue depth at which a scheduler asks for another active scheduler.
+ */
+static size_t scale_depth()
+{
+  uint32_t active = _atomic_load(&active_count);
+
+  if((active < scheduler_count) &&
+    (_atomic_load(&scheduler[active].started) == 0))
+    return SCHED_SPAWN_DEPTH;
+
+  return SCHED_SCALE_DEPTH;
+}
+
+/**
+ * Suspend this scheduler if it has been idle long enough. Only the highest
+ * active scheduler can suspend, so that the active schedulers are always the
+ * first active_count in the array.
+ */
+static void try_suspend(scheduler_t* sched, uint64_t idle)
+{
+  uint32_t index = (uint32_t)(sched - scheduler);
+
+  // A scheduler holding muted actors has to keep polling their receivers.
+  if((idle < SCHED_SUSPEND_IDLE) || (index == 0) || (index < min_active) ||
+    (sched->muted_count > 0))
+    return;
+
+  uint32_t active = index + 1;
+  _atomic_cas(&active_count, &active, index);
 }
 
 /**
@@ -69,6 +532,13 @@ static void send_msg(uint32_t to, sched_msg_t msg, intptr_t arg)
 
   m->i = arg;
   messageq_push(&scheduler[to].mq, &m->msg);
+
+  // A parked scheduler must still take part in quiescence detection.
+  if(use_park)
+  {
+    _atomic_fence();
+    wake(&scheduler[to]);
+  }
 }
 
 static void read_msg(scheduler_t* sched)
@@ -79,58 +549,230 @@ static void read_msg(scheduler_t* sched)
   {
     switch(m->msg.id)
     {
-      case SCHED_BLOCK:
+      case SCHED_TERMINATE:
       {
-        sched->block_count++;
-
-        if(detect_quiescence && (sched->block_count == scheduler_count))
-        {
-          // If we think all threads are blocked, send CNF(token) to everyone.
-          for(uint32_t i = 0; i < scheduler_count; i++)
-            send_msg(i, SCHED_CNF, sched->ack_token);
-        }
+        sched->terminate = true;
         break;
       }
 
-      case SCHED_UNBLOCK:
-      {
-        // Cancel all acks and increment the ack token, so that any pending
-        // acks in the queue will be dropped when they are received.
-        sched->block_count--;
-        sched->ack_token++;
-        sched->ack_count = 0;
-        break;
-      }
+      default: {}
+    }
+  }
+}
 
-      case SCHED_CNF:
-      {
-        // Echo the token back as ACK(token).
-        send_msg(0, SCHED_ACK, m->i);
-        break;
-      }
+/**
+ * Checks whether any actor or task is queued anywhere.
+ */
+static bool queues_empty()
+{
+  if(!mpmcq_empty(&tasks))
+    return false;
 
-      case SCHED_ACK:
-      {
-        // If it's the current token, increment the ack count.
-        if(m->i == sched->ack_token)
-          sched->ack_count++;
-        break;
-      }
+  for(uint32_t i = 0; i < node_count; i++)
+  {
+    if(!mpmcq_empty(&inject[i]))
+      return false;
+  }
 
-      case SCHED_TERMINATE:
-      {
-        sched->terminate = true;
-        break;
-      }
+  for(uint32_t i = 0; i < scheduler_count; i++)
+  {
+    if((wsdeque_size(&scheduler[i].iq) > 0) ||
+      (wsdeque_size(&scheduler[i].q) > 0) ||
+      !mpmcq_empty(&scheduler[i].pinq))
+      return false;
+  }
 
-      default: {}
+  if(use_cdthread && !mpmcq_empty(&scheduler[scheduler_count].pinq))
+    return false;
+
+  return true;
+}
+
+/**
+ * Starts a confirmation round. The epoch is read before checking that every
+ * scheduler is blocked, so that anything that was running when we looked will
+ * have to unblock again after the round starts. Parked schedulers are woken so
+ * that they confirm.
+ */
+static void start_cnf(scheduler_t* sched)
+{
+  sched->cnf_epoch = _atomic_load(&unblock_epoch);
+
+  if(_atomic_load(&block_count) != block_total)
+    return;
+
+  sched->cnf_pending = true;
+  _atomic_store(&cnf_token, _atomic_load(&cnf_token) + 1);
+
+  if(use_park)
+  {
+    _atomic_fence();
+    uint32_t active = _atomic_load(&active_count);
+
+    for(uint32_t i = 1; i < active; i++)
+      wake(&scheduler[i]);
+  }
+}
+
+/**
+ * A round is confirmed when every active scheduler has confirmed the current
+ * token, every scheduler is blocked and nothing is queued. Suspended
+ * schedulers are blocked and can't steal until an active scheduler resumes
+ * them, so they don't need to confirm. They can still hold muted actors,
+ * though, if a pinned actor they ran was muted.
+ */
+static bool cnf_confirmed()
+{
+  uint32_t token = _atomic_load(&cnf_token);
+  uint32_t active = _atomic_load(&active_count);
+
+  for(uint32_t i = 0; i < active; i++)
+  {
+    if(_atomic_load(&scheduler[i].acked) != token)
+      return false;
+  }
+
+  for(uint32_t i = active; i < scheduler_count; i++)
+  {
+    if(_atomic_load(&scheduler[i].muted_count) > 0)
+      return false;
+  }
+
+  return (_atomic_load(&block_count) == block_total) && queues_empty();
+}
+
+/**
+ * True if scheduler 0 has quiescence detection work to do.
+ */
+static bool cnf_work(scheduler_t* sched)
+{
+  if((sched != scheduler) || !_atomic_load(&detect_quiescence))
+    return false;
+
+  if(sched->cnf_pending)
+    return true;
+
+  return (_atomic_load(&block_count) == block_total) &&
+    (_atomic_load(&unblock_epoch) != sched->quiet_epoch);
+}
+
+/**
+ * Run by scheduler 0 when it fails to steal. If all schedulers have blocked
+ * and nobody has unblocked since the last confirmed round, start a new round.
+ */
+static void detect(scheduler_t* sched)
+{
+  if(!cnf_work(sched))
+    return;
+
+  if(!sched->cnf_pending)
+  {
+    start_cnf(sched);
+    return;
+  }
+
+  // Check the epoch last. A scheduler that takes an actor after we have
+  // looked at the queues must unblock before it runs it.
+  bool confirmed = cnf_confirmed();
+  _atomic_fence();
+
+  if(_atomic_load(&unblock_epoch) != sched->cnf_epoch)
+  {
+    // Somebody unblocked, abandon this round.
+    sched->cnf_pending = false;
+    return;
+  }
+
+  if(!confirmed)
+    return;
+
+  sched->cnf_pending = false;
+  sched->quiet_epoch = sched->cnf_epoch;
+
+  if(sched->asio_stopped)
+  {
+    // A scheduler holding the cycle detector may be about to run it. Claim
+    // the cycle detector, and give up if anybody unblocked in the meantime.
+    _atomic_store(&finalising, true);
+    _atomic_fence();
+
+    if(_atomic_load(&unblock_epoch) != sched->cnf_epoch)
+    {
+      _atomic_store(&finalising, false);
+      return;
     }
+
+    cycle_terminate(&sched->ctx);
+  } else if(asio_stop()) {
+    sched->asio_stopped = true;
+
+    // Run another confirmation round.
+    start_cnf(sched);
+  }
+}
+
+/**
+ * Called each time we finish a sweep of every victim without finding anything.
+ * We confirm a token only once a whole sweep that started after we saw it has
+ * failed, so that anything queued when the round started has been seen.
+ */
+static void confirm(scheduler_t* sched)
+{
+  uint32_t token = _atomic_load(&cnf_token);
+  uint32_t seen = sched->sweep_token;
+  sched->sweep_token = token;
+
+  // Muted actors still have work to do once their receivers drain.
+  if((token != seen) || (token == sched->acked) || (sched->muted_count > 0))
+    return;
+
+  _atomic_store(&sched->acked, token);
+
+  if(use_park && (sched != scheduler))
+  {
+    _atomic_fence();
+    wake(&scheduler[0]);
+  }
+}
+
+/**
+ * Counts this scheduler as blocked. The last scheduler to block wakes
+ * scheduler 0, which coordinates quiescence detection.
+ */
+static void block(scheduler_t* sched)
+{
+  // Our victim sweep starts again, so no sweep has completed yet.
+  sched->sweep_token = (uint32_t)-1;
+  uint32_t prev = _atomic_add(&block_count, 1);
+
+  if(use_park && (sched != scheduler) && ((prev + 1) == block_total))
+  {
+    _atomic_fence();
+    wake(&scheduler[0]);
   }
 }
 
+static void unblock()
+{
+  _atomic_add(&block_count, (uint32_t)-1);
+  _atomic_add(&unblock_epoch, 1);
+}
+
+/**
+ * Called by a scheduler holding the cycle detector before it leaves steal() to
+ * run it. Advancing the epoch stops scheduler 0 from finalising the cycle
+ * detector, unless it has already started, in which case we must not run it.
+ */
+static bool can_run_cycle()
+{
+  _atomic_add(&unblock_epoch, 1);
+  _atomic_fence();
+  return !_atomic_load(&finalising);
+}
+
 /**
- * If we can terminate, return true. If all schedulers are waiting, one of
- * them will stop the ASIO back end and tell the cycle detector to try to
+ * If we can terminate, return true. If all schedulers are waiting, scheduler
+ * 0 will stop the ASIO back end and tell the cycle detector to try to
  * terminate.
  */
 static bool quiescent(scheduler_t* sched, uint64_t tsc, uint64_t tsc2)
@@ -140,29 +782,92 @@ static bool quiescent(scheduler_t* sched, uint64_t tsc, uint64_t tsc2)
   if(sched->terminate)
     return true;
 
-  if(sched->ack_count == scheduler_count)
+  detect(sched);
+  cpu_core_pause(tsc, tsc2, use_yield);
+  return false;
+}
+
+/**
+ * Checks, without taking anything, whether a scheduler has anything to do.
+ */
+static bool has_work(scheduler_t* sched)
+{
+  if(_atomic_load(&sched->mq.tail->next) != NULL)
+    return true;
+
+  if(cnf_work(sched))
+    return true;
+
+  // Even a suspended scheduler runs the actors pinned to it.
+  if(!mpmcq_empty(&sched->pinq))
+    return true;
+
+  // We poll for muted actors to be released, so we can't sleep, even when
+  // suspended.
+  if(sched->muted_count > 0)
+    return true;
+
+  // A suspended scheduler doesn't look for actors to run.
+  if(is_suspended(sched))
+    return false;
+
+  // We must confirm the current round before we sleep.
+  if(_atomic_load(&cnf_token) != sched->acked)
+    return true;
+
+  return !queues_empty();
+}
+
+static bool may_park(scheduler_t* sched)
+{
+  return use_park && ((uint32_t)(sched - scheduler) >= min_active);
+}
+
+/**
+ * Parks the scheduler thread until it is woken. The spin budget adapts: if we
+ * are woken before the budget would have expired, we should have kept
+ * spinning, so the budget grows. Otherwise it shrinks.
+ */
+static void park(scheduler_t* sched)
+{
+  pony_park_lock(&sched->park);
+  _atomic_store(&sched->asleep, true);
+  _atomic_add(&sleeping_count, 1);
+  _atomic_add(&spinning_count, (uint32_t)-1);
+  _atomic_fence();
+
+  if(has_work(sched))
   {
-    if(sched->asio_stopped)
-    {
-      // Reset the ACK token in case we are rescheduling ourself.
-      cycle_terminate(&sched->ctx);
-      sched->ack_token++;
-      sched->ack_count = 0;
-    } else if(asio_stop()) {
-      sched->asio_stopped = true;
-      sched->ack_token++;
-      sched->ack_count = 0;
+    // Something arrived before we could go to sleep.
+    _atomic_store(&sched->asleep, false);
+    _atomic_add(&sleeping_count, (uint32_t)-1);
+  } else {
+    uint64_t tsc = cpu_tick();
 
-      // Run another CNF/ACK cycle.
-      for(uint32_t i = 0; i < scheduler_count; i++)
-        send_msg(i, SCHED_CNF, sched->ack_token);
+    while(_atomic_load(&sched->asleep))
+      pony_park_wait(&sched->park);
+
+    uint64_t slept = cpu_tick() - tsc;
+
+    if(slept < sched->spin_budget)
+    {
+      if(sched->spin_budget < SCHED_SPIN_MAX)
+        sched->spin_budget *= 2;
+    } else if(sched->spin_budget > SCHED_SPIN_MIN) {
+      sched->spin_budget /= 2;
     }
   }
 
-  cpu_core_pause(tsc, tsc2, use_yield);
-  return false;
+  _atomic_add(&spinning_count, 1);
+  pony_park_unlock(&sched->park);
 }
 
+/**
+ * Walks the scheduler array backwards from the last victim. A sweep ends when
+ * we get back to our own scheduler. When NUMA aware, the first sweep only
+ * considers victims on our own node and the second only victims on other
+ * nodes, so that local victims are always tried before remote ones.
+ */
 static scheduler_t* choose_victim(scheduler_t* sched)
 {
   scheduler_t* victim = sched->last_victim;
@@ -176,16 +881,24 @@ static scheduler_t* choose_victim(scheduler_t* sched)
     if(victim < scheduler)
       victim = &scheduler[scheduler_count - 1];
 
-    if(victim == sched->last_victim)
+    if(victim == sched)
     {
+      if(use_numa && !sched->steal_remote)
+      {
+        // Local victims are exhausted, sweep the remote ones.
+        sched->steal_remote = true;
+        continue;
+      }
+
       // If we have tried all possible victims, return no victim. Set our last
       // victim to ourself to indicate we've started over.
       sched->last_victim = sched;
+      sched->steal_remote = false;
       break;
     }
 
-    // Don't try to steal from ourself.
-    if(victim == sched)
+    // Skip victims that aren't part of this sweep.
+    if(use_numa && ((victim->node != sched->node) != sched->steal_remote))
       continue;
 
     // Record that this is our victim and return it.
@@ -197,43 +910,152 @@ static scheduler_t* choose_victim(scheduler_t* sched)
 }
 
 /**
- * Use mpmcqs to allow stealing directly from a victim, without waiting for a
- * response.
+ * Use work stealing deques to allow stealing directly from a victim, without
+ * waiting for a response.
  */
-static pony_actor_t* steal(scheduler_t* sched, pony_actor_t* prev)
+static pony_actor_t* steal_actor(scheduler_t* sched, pony_actor_t* prev)
 {
-  send_msg(0, SCHED_BLOCK, 0);
-  uint64_t tsc = cpu_tick();
+  return_all(sched);
+  reclaim(sched);
+  pool_scavenge(cpu_tick());
+  sched->ctx.stats.pool_bytes = pool_local_bytes();
+  heapprof_poll();
+  block(sched);
+  _atomic_add(&spinning_count, 1);
+  uint64_t start = cpu_tick();
+  uint64_t tsc = start;
   pony_actor_t* actor;
 
   while(true)
   {
+    actor = pop_pinned(sched);
+
+    if(actor != NULL)
+      break;
+
+    if((sched->muted_count > 0) && unmute(sched))
+    {
+      actor = pop(sched);
+
+      if(actor != NULL)
+        break;
+    }
+
+    if(is_suspended(sched))
+    {
+      // Handle scheduler messages until we are resumed or told to terminate.
+      if(quiescent(sched, tsc, cpu_tick()))
+      {
+        _atomic_add(&spinning_count, (uint32_t)-1);
+        return NULL;
+      }
+
+      park(sched);
+      tsc = cpu_tick();
+      continue;
+    }
+
+    if(!mpmcq_empty(&tasks))
+    {
+      // A task can send messages, so we aren't blocked while it runs. Any
+      // actor it wakes goes on our own queue.
+      unblock();
+      run_task(sched);
+      block(sched);
+      actor = pop(sched);
+
+      if(actor != NULL)
+        break;
+
+      tsc = cpu_tick();
+      continue;
+    }
+
     scheduler_t* victim = choose_victim(sched);
+    bool swept = false;
 
     if(victim == NULL)
+    {
       victim = sched;
+      swept = true;
+    }
 
-    actor = pop_global(victim);
+    actor = steal_batch(sched, victim);
 
     if(actor != NULL)
+    {
+      DTRACE3(WORK_STEAL_SUCCESSFUL, (uintptr_t)sched, (uintptr_t)victim,
+        (uintptr_t)actor);
       break;
+    }
+
+    DTRACE2(WORK_STEAL_FAILURE, (uintptr_t)sched, (uintptr_t)victim);
+
+    // Handle any I/O events that are ready. The actors they wake go on our
+    // own queue rather than through the ASIO thread and the inject queue.
+    if(asio_poll())
+    {
+      actor = pop(sched);
+
+      if(actor != NULL)
+        break;
+    }
+
+    if(swept)
+      confirm(sched);
 
     uint64_t tsc2 = cpu_tick();
 
     if(quiescent(sched, tsc, tsc2))
+    {
+      _atomic_add(&spinning_count, (uint32_t)-1);
       return NULL;
+    }
 
     // If we have been passed an actor (implicitly, the cycle detector), and
     // enough time has elapsed without stealing or quiescing, return the actor
     // we were passed (allowing the cycle detector to run).
-    if((prev != NULL) && ((tsc2 - tsc) > 10000000000))
+    if((prev != NULL) && ((tsc2 - tsc) > 10000000000) && can_run_cycle())
     {
       actor = prev;
       break;
     }
+
+    if(may_park(sched) && ((tsc2 - tsc) > sched->spin_budget))
+    {
+      // Don't park while holding the cycle detector, run it instead.
+      if(prev != NULL)
+      {
+        if(can_run_cycle())
+        {
+          actor = prev;
+          break;
+        }
+
+        continue;
+      }
+
+      try_suspend(sched, tsc2 - start);
+      park(sched);
+      tsc = cpu_tick();
+    }
   }
 
-  send_msg(0, SCHED_UNBLOCK, 0);
+  _atomic_add(&spinning_count, (uint32_t)-1);
+  unblock();
+  return actor;
+}
+
+static pony_actor_t* steal(scheduler_t* sched, pony_actor_t* prev)
+{
+  eventlog_t* log = sched->ctx.eventlog;
+
+  if(log == NULL)
+    return steal_actor(sched, prev);
+
+  eventlog_record(log, EVENTLOG_STEAL_START, NULL, NULL, 0);
+  pony_actor_t* actor = steal_actor(sched, prev);
+  eventlog_record(log, EVENTLOG_STEAL_END, NULL, actor, 0);
   return actor;
 }
 
@@ -243,6 +1065,8 @@ static pony_actor_t* steal(scheduler_t* sched, pony_actor_t* prev)
 static void run(scheduler_t* sched)
 {
   pony_actor_t* actor = pop_global(sched);
+  uint32_t runs = 0;
+  uint32_t handoffs = 0;
 
   while(true)
   {
@@ -259,12 +1083,69 @@ static void run(scheduler_t* sched)
       }
     }
 
+    // Keep the coarse clock fresh for the actor we are about to run.
+    sched->clock_tsc = os_clock_update(cpu_tick(), sched->clock_tsc);
+
     // Run the current actor and get the next actor.
-    bool reschedule = actor_run(&sched->ctx, actor, SCHED_BATCH);
-    pony_actor_t* next = pop_global(sched);
+    size_t batch = actor_interactive(actor) ?
+      SCHED_BATCH_INTERACTIVE : SCHED_BATCH;
+    bool reschedule = actor_run(&sched->ctx, actor, batch);
+
+    // A blocking FFI call that raised an error didn't say it had returned.
+    sched->blocking = 0;
+
+    // Tasks are interleaved with actors, one after each actor's batch, so
+    // neither can starve the other.
+    run_task(sched);
+
+    if(++runs == SCHED_STATS_RUNS)
+    {
+      reclaim(sched);
+      pool_scavenge(cpu_tick());
+      sched->ctx.stats.pool_bytes = pool_local_bytes();
+      heapprof_poll();
+      runs = 0;
+    }
+
+    if(sched->muted_count > 0)
+      unmute(sched);
+
+    // An actor woken by the one we just ran goes straight after it.
+    pony_actor_t* handoff = sched->runnext;
+
+    if(handoff != NULL)
+    {
+      sched->runnext = NULL;
+
+      if(++handoffs > SCHED_HANDOFF_MAX)
+      {
+        push(sched, handoff);
+        handoff = NULL;
+        handoffs = 0;
+      }
+    } else {
+      handoffs = 0;
+    }
+
+    if(handoff != NULL)
+    {
+      if(reschedule)
+        push(sched, actor);
+
+      actor = handoff;
+      continue;
+    }
 
     if(reschedule)
     {
+      // Take the oldest actor rather than the newest, so that LIFO scheduling
+      // doesn't starve the rest of the queue. Pinned actors can only run here,
+      // so they go first.
+      pony_actor_t* next = pop_pinned(sched);
+
+      if(next == NULL)
+        next = pop_oldest(sched);
+
       if(next != NULL)
       {
         // If we have a next actor, we go on the back of the queue. Otherwise,
@@ -292,7 +1173,7 @@ static void run(scheduler_t* sched)
     } else {
       // We aren't rescheduling, so run the next actor. This may be NULL if our
       // queue was empty.
-      actor = next;
+      actor = pop_global(sched);
     }
   }
 }
@@ -302,22 +1183,305 @@ static DECLARE_THREAD_FN(run_thread)
   scheduler_t* sched = (scheduler_t*) arg;
   this_scheduler = sched;
   cpu_affinity(sched->cpu);
+
+  // After pinning, so that the memory is local to the thread's CPU.
+  pool_prealloc();
   run(sched);
 
-  return 0;
+  return 0;
+}
+
+/**
+ * Puts the cycle detector on the queue of its own thread, waking the thread if
+ * it is parked. That thread parks even if we have been asked never to yield.
+ */
+static void push_cycle(pony_actor_t* actor)
+{
+  scheduler_t* sched = &scheduler[scheduler_count];
+  mpmcq_push(&sched->pinq, actor);
+  _atomic_fence();
+  wake(sched);
+}
+
+/**
+ * Parks the cycle detector thread until the cycle detector or a scheduler
+ * message arrives. Unlike park(), this doesn't count the thread as looking for
+ * work, since it only ever runs the cycle detector.
+ */
+static void park_cycle(scheduler_t* sched)
+{
+  pony_park_lock(&sched->park);
+  _atomic_store(&sched->asleep, true);
+  _atomic_add(&sleeping_count, 1);
+  _atomic_fence();
+
+  if(!mpmcq_empty(&sched->pinq) ||
+    (_atomic_load(&sched->mq.tail->next) != NULL))
+  {
+    _atomic_store(&sched->asleep, false);
+    _atomic_add(&sleeping_count, (uint32_t)-1);
+  } else {
+    while(_atomic_load(&sched->asleep))
+      pony_park_wait(&sched->park);
+  }
+
+  pony_park_unlock(&sched->park);
+}
+
+/**
+ * Runs the cycle detector on a thread of its own, so that block and unblock
+ * messages from every actor don't compete with them for scheduler time. The
+ * thread counts as blocked whenever it isn't running the cycle detector.
+ */
+static DECLARE_THREAD_FN(run_cycle_thread)
+{
+  scheduler_t* sched = (scheduler_t*) arg;
+  this_scheduler = sched;
+
+  while(true)
+  {
+    read_msg(sched);
+
+    if(sched->terminate)
+      break;
+
+    pony_actor_t* actor = pop_pinned(sched);
+
+    if(actor == NULL)
+    {
+      park_cycle(sched);
+      continue;
+    }
+
+    // Scheduler 0 may be finalising the cycle detector, in which case we must
+    // not run it. Unblocking first stops it from starting.
+    unblock();
+    _atomic_fence();
+
+    if(!_atomic_load(&finalising))
+    {
+      while(actor_run(&sched->ctx, actor, SCHED_BATCH))
+        ;
+    }
+
+    block(sched);
+  }
+
+  return 0;
+}
+
+/**
+ * Takes an actor from any scheduler, in one sweep of the victims, or from an
+ * I/O event that is ready. Unlike steal(), this never waits.
+ */
+static pony_actor_t* embedded_steal(scheduler_t* sched)
+{
+  scheduler_t* victim;
+
+  while((victim = choose_victim(sched)) != NULL)
+  {
+    pony_actor_t* actor = steal_batch(sched, victim);
+
+    if(actor != NULL)
+      return actor;
+  }
+
+  if(asio_poll())
+    return pop(sched);
+
+  return NULL;
+}
+
+/**
+ * Runs actors on a scheduler claimed by a thread of the embedding program,
+ * until budget nanoseconds have passed or there is nothing left to run.
+ * Returns true if the budget ran out first. The scheduler counts as blocked
+ * whenever this isn't running, as nothing can be running on it.
+ */
+static bool embedded_run(scheduler_t* sched, uint64_t budget)
+{
+  uint64_t start = os_clock_nanos();
+  pony_actor_t* actor = NULL;
+  pony_actor_t* cycle = NULL;
+  uint32_t runs = 0;
+  bool more = false;
+
+  unblock();
+
+  while(true)
+  {
+    if(sched->muted_count > 0)
+      unmute(sched);
+
+    // The run next slot is only used between batches, so an actor in it goes
+    // on the queue, where another thread can steal it once this one returns.
+    if(sched->runnext != NULL)
+    {
+      push(sched, sched->runnext);
+      sched->runnext = NULL;
+    }
+
+    if(actor == NULL)
+      actor = pop_global(sched);
+
+    if(actor == NULL)
+      actor = embedded_steal(sched);
+
+    if(actor == NULL)
+    {
+      if(!run_task(sched))
+        break;
+
+      if((os_clock_nanos() - start) >= budget)
+      {
+        more = true;
+        break;
+      }
+
+      continue;
+    }
+
+    sched->clock_tsc = os_clock_update(cpu_tick(), sched->clock_tsc);
+
+    size_t batch = actor_interactive(actor) ?
+      SCHED_BATCH_INTERACTIVE : SCHED_BATCH;
+    bool reschedule = actor_run(&sched->ctx, actor, batch);
+    pony_actor_t* next = NULL;
+
+    sched->blocking = 0;
+    run_task(sched);
+
+    if(reschedule)
+    {
+      if(is_cycle(actor))
+      {
+        // The cycle detector always has more to do, so it runs once a slice
+        // rather than keeping the slice busy.
+        cycle = actor;
+      } else {
+        // As in run(), take the oldest actor next so nothing is starved.
+        next = pop_pinned(sched);
+
+        if(next == NULL)
+          next = pop_oldest(sched);
+
+        push(sched, actor);
+      }
+    }
+
+    actor = next;
+
+    if(++runs == SCHED_STATS_RUNS)
+    {
+      reclaim(sched);
+      runs = 0;
+    }
+
+    if((os_clock_nanos() - start) >= budget)
+    {
+      if(actor != NULL)
+        push(sched, actor);
+
+      more = true;
+      break;
+    }
+  }
+
+  if(cycle != NULL)
+    push(sched, cycle);
+
+  return_all(sched);
+  reclaim(sched);
+  pool_scavenge(cpu_tick());
+  sched->ctx.stats.pool_bytes = pool_local_bytes();
+  heapprof_poll();
+  block(sched);
+  return more;
+}
+
+/**
+ * Stops an embedded runtime. The embedding program has stopped running
+ * slices, so this thread runs every scheduler in turn until nothing is left to
+ * run, stops ASIO once no noisy actor is left, and then has the cycle detector
+ * finalise every remaining actor.
+ */
+static void embedded_stop()
+{
+  bool asio_stopped = false;
+
+  while(true)
+  {
+    bool muted = false;
+
+    for(uint32_t i = 0; i < scheduler_count; i++)
+    {
+      this_scheduler = &scheduler[i];
+      embedded_run(this_scheduler, UINT64_MAX);
+      muted |= scheduler[i].muted_count > 0;
+    }
+
+    // Another thread, such as the cycle detector's, may have unblocked since.
+    uint32_t epoch = _atomic_load(&unblock_epoch);
+
+    if(muted || !queues_empty() ||
+      (_atomic_load(&block_count) != block_total))
+      continue;
+
+    if(!asio_stopped)
+    {
+      asio_stopped = asio_stop();
+      continue;
+    }
+
+    // As in detect(), claim the cycle detector before finalising.
+    _atomic_store(&finalising, true);
+    _atomic_fence();
+
+    if(_atomic_load(&unblock_epoch) == epoch)
+      break;
+
+    _atomic_store(&finalising, false);
+  }
+
+  this_scheduler = &scheduler[0];
+  cycle_terminate(&scheduler[0].ctx);
 }
 
 static void scheduler_shutdown()
 {
-  uint32_t start;
+  // An embedding program's threads ran the schedulers, so there are none to
+  // join.
+  if(!use_embedded)
+  {
+    uint32_t start;
 
-  if(scheduler[0].tid == pony_thread_self())
-    start = 1;
-  else
-    start = 0;
+    if(scheduler[0].tid == pony_thread_self())
+      start = 1;
+    else
+      start = 0;
 
-  for(uint32_t i = start; i < scheduler_count; i++)
-    pony_thread_join(scheduler[i].tid);
+    for(uint32_t i = start; i < scheduler_count; i++)
+    {
+      if(_atomic_load(&scheduler[i].started) != 0)
+        pony_thread_join(scheduler[i].tid);
+    }
+  }
+
+  if(use_cdthread)
+  {
+    scheduler_t* sched = &scheduler[scheduler_count];
+    pony_thread_join(sched->tid);
+
+    while(messageq_pop(&sched->mq) != NULL);
+    messageq_destroy(&sched->mq);
+    mpmcq_destroy(&sched->pinq);
+    pony_park_destroy(&sched->park);
+  }
+
+  // Every actor has been finalised by now.
+  finaliser_stop();
+  eventlog_write();
+  profile_stop();
 
 #ifdef USE_TELEMETRY
   printf("\"telemetry\": [\n");
@@ -327,7 +1491,20 @@ static void scheduler_shutdown()
   {
     while(messageq_pop(&scheduler[i].mq) != NULL);
     messageq_destroy(&scheduler[i].mq);
-    mpmcq_destroy(&scheduler[i].q);
+    wsdeque_destroy(&scheduler[i].iq);
+    wsdeque_destroy(&scheduler[i].q);
+    mpmcq_destroy(&scheduler[i].pinq);
+    pony_park_destroy(&scheduler[i].park);
+
+    latency_free(scheduler[i].ctx.latency);
+    region_destroy(&scheduler[i].ctx.region);
+    assert(scheduler[i].muted_count == 0);
+
+    if(scheduler[i].muted != NULL)
+    {
+      pool_free_size(scheduler[i].muted_size * sizeof(muted_t),
+        scheduler[i].muted);
+    }
 
 #ifdef USE_TELEMETRY
     pony_ctx_t* ctx = &scheduler[i].ctx;
@@ -374,38 +1551,130 @@ static void scheduler_shutdown()
   printf("\n]\n");
 #endif
 
-  pool_free_size(scheduler_count * sizeof(scheduler_t), scheduler);
+  // Send back every message freed on another scheduler's behalf, and then
+  // free them all here.
+  for(uint32_t i = 0; i < scheduler_count; i++)
+    return_all(&scheduler[i]);
+
+  for(uint32_t i = 0; i < scheduler_count; i++)
+  {
+    reclaim(&scheduler[i]);
+
+    if(scheduler[i].returns != NULL)
+    {
+      pool_free_size(scheduler_count * sizeof(msgreturn_t),
+        scheduler[i].returns);
+    }
+  }
+
+  pool_free_size((scheduler_count + use_cdthread) * sizeof(scheduler_t),
+    scheduler);
   scheduler = NULL;
   scheduler_count = 0;
 
-  mpmcq_destroy(&inject);
+  for(uint32_t i = 0; i < node_count; i++)
+    mpmcq_destroy(&inject[i]);
+
+  pool_free_size(node_count * sizeof(mpmcq_t), inject);
+  inject = NULL;
+  mpmcq_destroy(&tasks);
+  node_count = 0;
+  use_embedded = false;
+  threads_running = false;
 }
 
-pony_ctx_t* scheduler_init(uint32_t threads, bool noyield)
+pony_ctx_t* scheduler_init(uint32_t threads, uint32_t min_threads,
+  bool noyield)
 {
   use_yield = !noyield;
 
+  // Idle schedulers park unless we have been asked never to yield. The first
+  // min_threads schedulers never park.
+  use_park = !noyield;
+  min_active = min_threads;
+
   // If no thread count is specified, use the available physical core count.
   if(threads == 0)
     threads = cpu_count();
 
+  // When idle schedulers park, only the first min_threads, or at least one,
+  // start out active, and the rest start out suspended with no thread. Busy
+  // schedulers resume them, starting their threads, and idle ones suspend
+  // themselves again, down to min_threads. Otherwise, all start out active.
   scheduler_count = threads;
-  scheduler = (scheduler_t*)pool_alloc_size(
-    scheduler_count * sizeof(scheduler_t));
-  memset(scheduler, 0, scheduler_count * sizeof(scheduler_t));
+  uint32_t initial = threads;
+
+  if(use_park)
+  {
+    initial = (min_threads > 0) ? min_threads : 1;
+
+    if(initial > threads)
+      initial = threads;
+  }
+
+  active_count = initial;
+  unblock_epoch = 0;
+  cnf_token = 0;
+  finalising = false;
+
+  // The cycle detector thread, if there is one, comes after the schedulers.
+  // It starts out blocked, as do the schedulers with no thread yet.
+  block_total = threads + use_cdthread;
+  block_count = use_cdthread + (threads - initial);
+  size_t size = block_total * sizeof(scheduler_t);
+  scheduler = (scheduler_t*)pool_alloc_size(size);
+  memset(scheduler, 0, size);
 
   cpu_assign(scheduler_count, scheduler);
 
+  // Become NUMA aware if the schedulers span more than one node. Each node
+  // gets its own inject queue.
+  node_count = 1;
+
+  for(uint32_t i = 0; i < scheduler_count; i++)
+  {
+    if(scheduler[i].node >= node_count)
+      node_count = scheduler[i].node + 1;
+  }
+
+  use_numa = node_count > 1;
+  inject = (mpmcq_t*)pool_alloc_size(node_count * sizeof(mpmcq_t));
+
+  for(uint32_t i = 0; i < node_count; i++)
+    mpmcq_init(&inject[i]);
+
+  mpmcq_init(&tasks);
+
   for(uint32_t i = 0; i < scheduler_count; i++)
   {
     scheduler[i].ctx.scheduler = &scheduler[i];
+    scheduler[i].tag = (i < MSG_OWNER_MAX) ? (i + 1) : 0;
     scheduler[i].last_victim = &scheduler[i];
     messageq_init(&scheduler[i].mq);
-    mpmcq_init(&scheduler[i].q);
+    wsdeque_init(&scheduler[i].iq, SCHED_QUEUE_SIZE);
+    wsdeque_init(&scheduler[i].q, SCHED_QUEUE_SIZE);
+    mpmcq_init(&scheduler[i].pinq);
+    pony_park_init(&scheduler[i].park);
+    scheduler[i].spin_budget = SCHED_SPIN_MIN;
+    scheduler[i].quiet_epoch = (uint32_t)-1;
+    scheduler[i].started = i < initial;
+    scheduler[i].ctx.eventlog = eventlog_create(i, scheduler[i].cpu);
+    scheduler[i].ctx.profile = profile_create();
+  }
+
+  if(use_cdthread)
+  {
+    // The cycle detector thread has no scheduler of its own, so actors it
+    // wakes go to the inject queue. Like the ASIO thread, it isn't pinned to
+    // a core.
+    scheduler_t* sched = &scheduler[scheduler_count];
+    messageq_init(&sched->mq);
+    mpmcq_init(&sched->pinq);
+    pony_park_init(&sched->park);
   }
 
   this_scheduler = &scheduler[0];
-  mpmcq_init(&inject);
+  os_clock_init();
   asio_init();
 
   return &scheduler[0].ctx;
@@ -418,6 +1687,9 @@ bool scheduler_start(bool library)
   if(!asio_start())
     return false;
 
+  if(!finaliser_start())
+    return false;
+
   detect_quiescence = !library;
 
   uint32_t start;
@@ -431,10 +1703,22 @@ bool scheduler_start(bool library)
     scheduler[0].tid = pony_thread_self();
   }
 
+  // Schedulers that needed a thread before now, including any that actors
+  // sent messages before the runtime started, get one here.
+  _atomic_store(&threads_running, true);
+  _atomic_fence();
+
   for(uint32_t i = start; i < scheduler_count; i++)
   {
-    if(!pony_thread_create(&scheduler[i].tid, run_thread, scheduler[i].cpu,
-      &scheduler[i]))
+    if(!create_thread(&scheduler[i]))
+      return false;
+  }
+
+  if(use_cdthread)
+  {
+    scheduler_t* sched = &scheduler[scheduler_count];
+
+    if(!pony_thread_create(&sched->tid, run_cycle_thread, -1, sched))
       return false;
   }
 
@@ -447,28 +1731,263 @@ bool scheduler_start(bool library)
   return true;
 }
 
+bool scheduler_start_embedded(bool asio)
+{
+  this_scheduler = NULL;
+
+  if(asio && !asio_start())
+    return false;
+
+  if(!finaliser_start())
+    return false;
+
+  // Nothing parks or suspends, as the embedding program decides when each
+  // scheduler runs. Every scheduler counts as blocked until it does.
+  use_embedded = true;
+  use_park = false;
+  detect_quiescence = false;
+  active_count = scheduler_count;
+  block_count = block_total;
+
+  if(use_cdthread)
+  {
+    scheduler_t* sched = &scheduler[scheduler_count];
+
+    if(!pony_thread_create(&sched->tid, run_cycle_thread, -1, sched))
+      return false;
+  }
+
+  pony_register_thread();
+  return true;
+}
+
 void scheduler_stop()
 {
+  if(use_embedded)
+  {
+    embedded_stop();
+    scheduler_shutdown();
+    this_scheduler = NULL;
+    return;
+  }
+
   _atomic_store(&detect_quiescence, true);
+
+  if(use_park)
+  {
+    _atomic_fence();
+    wake(&scheduler[0]);
+  }
+
   scheduler_shutdown();
 }
 
+uint32_t scheduler_tag()
+{
+  if(this_scheduler == NULL)
+    return 0;
+
+  return this_scheduler->tag;
+}
+
+void scheduler_free_msg(pony_msg_t* m)
+{
+  uint32_t size = MSG_INDEX(m->size);
+  uint32_t owner = m->size >> MSG_OWNER_SHIFT;
+  scheduler_t* sched = this_scheduler;
+
+  // Free locally if we allocated it, if it didn't come from a scheduler
+  // thread, or if we aren't a scheduler thread ourselves.
+  if((owner == 0) || (sched == NULL) || (sched->tag == 0) ||
+    (owner == sched->tag) || (owner > scheduler_count))
+  {
+    pool_free(size, m);
+    return;
+  }
+
+  if(sched->returns == NULL)
+  {
+    size_t bytes = scheduler_count * sizeof(msgreturn_t);
+    sched->returns = (msgreturn_t*)pool_alloc_size(bytes);
+    memset(sched->returns, 0, bytes);
+  }
+
+  msgreturn_t* ret = &sched->returns[owner - 1];
+  m->next = NULL;
+
+  if(ret->head == NULL)
+    ret->head = m;
+  else
+    ret->tail->next = m;
+
+  ret->tail = m;
+
+  if(++ret->count == SCHED_RETURN_BATCH)
+    return_batch(&scheduler[owner - 1], ret);
+}
+
+void scheduler_mute(pony_ctx_t* ctx, pony_actor_t* sender,
+  pony_actor_t* receiver)
+{
+  scheduler_t* sched = ctx->scheduler;
+  assert(sched != NULL);
+
+  if(sched->muted_count == sched->muted_size)
+  {
+    uint32_t size = (sched->muted_size > 0) ? sched->muted_size * 2 : 8;
+    muted_t* muted = (muted_t*)pool_alloc_size(size * sizeof(muted_t));
+
+    if(sched->muted != NULL)
+    {
+      memcpy(muted, sched->muted, sched->muted_count * sizeof(muted_t));
+      pool_free_size(sched->muted_size * sizeof(muted_t), sched->muted);
+    }
+
+    sched->muted = muted;
+    sched->muted_size = size;
+  }
+
+  muted_t* m = &sched->muted[sched->muted_count++];
+  m->sender = sender;
+  m->receiver = receiver;
+}
+
+void scheduler_setrunnext(bool runnext)
+{
+  use_runnext = runnext;
+}
+
+void scheduler_setcdthread(bool cdthread)
+{
+  use_cdthread = cdthread;
+}
+
 void scheduler_add(pony_ctx_t* ctx, pony_actor_t* actor)
 {
+  DTRACE2(ACTOR_SCHEDULED, (uintptr_t)ctx->scheduler, (uintptr_t)actor);
+
+  if(use_cdthread && is_cycle(actor))
+  {
+    push_cycle(actor);
+    return;
+  }
+
+  uint32_t pin = actor_pin(actor);
+
+  if(pin != 0)
+  {
+    push_pinned(ctx->scheduler, &scheduler[pin - 1], actor);
+    return;
+  }
+
   if(ctx->scheduler != NULL)
   {
-    // Add to the current scheduler thread.
-    push(ctx->scheduler, actor);
+    uint32_t node = actor_node(actor);
+
+    if(use_numa && (node != ctx->scheduler->node))
+    {
+      // Send the actor back to its home node, so that it keeps running near
+      // its heap.
+      mpmcq_push(&inject[node], actor);
+    } else if(use_runnext && ctx->coalesce) {
+      // We are running an actor, so the one it woke runs next. Anything
+      // already in the slot goes on the queue.
+      pony_actor_t* prev = ctx->scheduler->runnext;
+      ctx->scheduler->runnext = actor;
+
+      if(prev == NULL)
+        return;
+
+      push(ctx->scheduler, prev);
+    } else {
+      // Add to the current scheduler thread.
+      push(ctx->scheduler, actor);
+    }
+
+    // If nobody is looking for work and our queue is getting deep, resume a
+    // suspended scheduler.
+    if(use_park && !wake_one() &&
+      (wsdeque_size(&ctx->scheduler->q) >= scale_depth()))
+      scale_up();
+  } else if(ctx->batch_count < ctx->batch_size) {
+    // Collect the actor, to be pushed at the end of the batch.
+    ctx->batch[ctx->batch_count++] = actor;
   } else {
     // Put on the shared mpmcq.
-    mpmcq_push(&inject, actor);
+    mpmcq_push(&inject[actor_node(actor)], actor);
+
+    if(use_park)
+      wake_one();
+  }
+}
+
+void scheduler_batch_start(pony_ctx_t* ctx, pony_actor_t** buffer,
+  uint32_t size)
+{
+  assert(ctx->scheduler == NULL);
+  assert(ctx->batch_count == 0);
+
+  ctx->batch = buffer;
+  ctx->batch_size = size;
+}
+
+void scheduler_batch_end(pony_ctx_t* ctx)
+{
+  pony_actor_t** batch = ctx->batch;
+  uint32_t count = ctx->batch_count;
+
+  ctx->batch = NULL;
+  ctx->batch_size = 0;
+  ctx->batch_count = 0;
+
+  if(count == 0)
+    return;
+
+  // Push each node's actors to that node's inject queue. The buffer is
+  // partitioned in place, one node at a time.
+  uint32_t start = 0;
+
+  for(uint32_t node = 0; (node < node_count) && (start < count); node++)
+  {
+    uint32_t end = start;
+
+    for(uint32_t i = start; i < count; i++)
+    {
+      if(actor_node(batch[i]) == node)
+      {
+        pony_actor_t* tmp = batch[end];
+        batch[end++] = batch[i];
+        batch[i] = tmp;
+      }
+    }
+
+    mpmcq_push_batch(&inject[node], (void**)&batch[start], end - start);
+    start = end;
   }
+
+  if(use_park)
+    wake_one();
+}
+
+uint32_t scheduler_node(pony_ctx_t* ctx)
+{
+  if(ctx->scheduler != NULL)
+    return ctx->scheduler->node;
+
+  return 0;
 }
 
 void scheduler_terminate()
 {
   for(uint32_t i = 0; i < scheduler_count; i++)
     send_msg(i, SCHED_TERMINATE, 0);
+
+  if(use_cdthread)
+  {
+    send_msg(scheduler_count, SCHED_TERMINATE, 0);
+    _atomic_fence();
+    wake(&scheduler[scheduler_count]);
+  }
 }
 
 uint32_t scheduler_cores()
@@ -476,11 +1995,114 @@ uint32_t scheduler_cores()
   return scheduler_count;
 }
 
+uint32_t scheduler_active()
+{
+  return _atomic_load(&active_count);
+}
+
+uint32_t pony_scheduler_count()
+{
+  return scheduler_count;
+}
+
+bool pony_scheduler_stats(uint32_t index, pony_sched_stats_t* stats)
+{
+  if(index >= scheduler_count)
+    return false;
+
+  memcpy(stats, &scheduler[index].ctx.stats, sizeof(pony_sched_stats_t));
+  return true;
+}
+
+bool pony_latency(pony_type_t* type, pony_latency_t* hist)
+{
+  bool found = false;
+  memset(hist, 0, sizeof(pony_latency_t));
+
+  for(uint32_t i = 0; i < scheduler_count; i++)
+  {
+    latency_t* table = _atomic_load(&scheduler[i].ctx.latency);
+    found |= latency_sum(table, type, hist);
+  }
+
+  return found;
+}
+
+bool pony_latency_of(pony_actor_t* actor, pony_latency_t* hist)
+{
+  return pony_latency(actor->type, hist);
+}
+
+/**
+ * Returns true if an earlier scheduler's table has the type, so that each
+ * type is only dumped once.
+ */
+static bool latency_seen(uint32_t index, pony_type_t* type)
+{
+  pony_latency_t hist;
+
+  for(uint32_t i = 0; i < index; i++)
+  {
+    latency_t* table = _atomic_load(&scheduler[i].ctx.latency);
+
+    if(latency_sum(table, type, &hist))
+      return true;
+  }
+
+  return false;
+}
+
+void pony_latency_dump()
+{
+  pony_latency_t hist;
+
+  for(uint32_t i = 0; i < scheduler_count; i++)
+  {
+    latency_t* table = _atomic_load(&scheduler[i].ctx.latency);
+
+    for(size_t j = 0; j < latency_slots(); j++)
+    {
+      pony_type_t* type = latency_type(table, j);
+
+      if((type == NULL) || latency_seen(i, type))
+        continue;
+
+      pony_latency(type, &hist);
+      fprintf(stderr, "type %u: %" PRIu64 " samples", type->id, hist.count);
+
+      for(uint32_t k = 0; k < PONY_LATENCY_BUCKETS; k++)
+      {
+        if(hist.buckets[k] > 0)
+          fprintf(stderr, " 2^%u:%" PRIu64, k, hist.buckets[k]);
+      }
+
+      fprintf(stderr, "\n");
+    }
+  }
+}
+
 void pony_register_thread()
 {
   if(this_scheduler != NULL)
     return;
 
+  if(use_embedded)
+  {
+    // Claim a scheduler that no other thread has, so that this thread can run
+    // actors with pony_run_slice().
+    for(uint32_t i = 0; i < scheduler_count; i++)
+    {
+      uint32_t expect = 0;
+
+      if(_atomic_cas(&scheduler[i].claimed, &expect, 1))
+      {
+        this_scheduler = &scheduler[i];
+        this_scheduler->tid = pony_thread_self();
+        return;
+      }
+    }
+  }
+
   // Create a scheduler_t, even though we will only use the pony_ctx_t.
   this_scheduler = POOL_ALLOC(scheduler_t);
   memset(this_scheduler, 0, sizeof(scheduler_t));
@@ -491,3 +2113,69 @@ pony_ctx_t* pony_ctx()
 {
   return &this_scheduler->ctx;
 }
+
+bool pony_run_slice(pony_ctx_t* ctx, uint64_t budget_ns)
+{
+  scheduler_t* sched = ctx->scheduler;
+
+  // Only a thread that claimed a scheduler can run actors on it.
+  if(!use_embedded || (sched == NULL) || (sched != this_scheduler))
+    return false;
+
+  return embedded_run(sched, budget_ns);
+}
+
+void pony_blocking_enter()
+{
+  scheduler_t* sched = this_scheduler;
+
+  // A thread that isn't a scheduler thread has no queue to hand over.
+  if((sched == NULL) || (sched < scheduler) ||
+    (sched >= &scheduler[scheduler_count]) || (sched->blocking++ > 0))
+    return;
+
+  sched->ctx.stats.blocking_calls++;
+
+  // Everything we would run next goes where any scheduler can pick it up. We
+  // take from the old end, so the queue keeps its order.
+  if(sched->runnext != NULL)
+  {
+    mpmcq_push(&inject[sched->node], sched->runnext);
+    sched->runnext = NULL;
+  }
+
+  pony_actor_t* actor;
+
+  while((actor = (pony_actor_t*)wsdeque_steal(&sched->iq)) != NULL)
+    mpmcq_push(&inject[sched->node], actor);
+
+  while((actor = (pony_actor_t*)wsdeque_steal(&sched->q)) != NULL)
+    mpmcq_push(&inject[sched->node], actor);
+
+  // Put a suspended scheduler to work in our place. It suspends itself again
+  // once it runs out of work.
+  scale_up();
+
+  if(use_park)
+    wake_one();
+}
+
+void pony_blocking_exit()
+{
+  scheduler_t* sched = this_scheduler;
+
+  if((sched != NULL) && (sched->blocking > 0))
+    sched->blocking--;
+}
+
+void pony_task(pony_ctx_t* ctx, pony_task_fn fn, void* arg)
+{
+  (void)ctx;
+  task_t* task = POOL_ALLOC(task_t);
+  task->fn = fn;
+  task->arg = arg;
+  mpmcq_push(&tasks, task);
+
+  if(use_park)
+    wake_one();
+}
@@ -4,17 +4,37 @@
 #include <pony.h>
 #include <platform.h>
 #include "actor/messageq.h"
+#include "actor/latency.h"
+#include "actor/profile.h"
 #include "gc/gc.h"
+#include "gc/serialise.h"
+#include "mem/region.h"
+#include "eventlog.h"
+#include "wsdeque.h"
 #include "mpmcq.h"
 
 PONY_EXTERN_C_BEGIN
 
-typedef void (*trace_object_fn)(pony_ctx_t* ctx, void* p, pony_trace_fn f);
+typedef void (*trace_object_fn)(pony_ctx_t* ctx, void* p, pony_trace_fn f,
+  bool immutable);
 
 typedef void (*trace_actor_fn)(pony_ctx_t* ctx, pony_actor_t* actor);
 
 typedef struct scheduler_t scheduler_t;
 
+typedef struct msgreturn_t
+{
+  pony_msg_t* head;
+  pony_msg_t* tail;
+  uint32_t count;
+} msgreturn_t;
+
+typedef struct muted_t
+{
+  pony_actor_t* sender;
+  pony_actor_t* receiver;
+} muted_t;
+
 typedef struct pony_ctx_t
 {
   scheduler_t* scheduler;
@@ -24,6 +44,46 @@ typedef struct pony_ctx_t
   gcstack_t* stack;
   actormap_t acquire;
   bool finalising;
+  pony_sched_stats_t stats;
+
+  // A thread that isn't a scheduler thread can collect the actors it
+  // schedules and push them to the inject queue together.
+  pony_actor_t** batch;
+  uint32_t batch_size;
+  uint32_t batch_count;
+
+  // While a behaviour runs, consecutive sends to the same receiver are
+  // chained here and pushed to its queue together.
+  bool coalesce;
+  pony_actor_t* send_to;
+  pony_msg_t* send_first;
+  pony_msg_t* send_last;
+  size_t send_count;
+
+  // Set when a behaviour sends to an actor whose mailbox is over capacity.
+  pony_actor_t* mute_to;
+
+  // Set when a behaviour asks to give up the rest of its actor's batch.
+  bool yield;
+
+  // Message latency sampling.
+  uint32_t sample_count;
+  latency_t* latency;
+
+  // Scheduling events, if --ponytrace was given.
+  eventlog_t* eventlog;
+
+  // CPU time by behaviour, if --ponyprofile was given.
+  profile_t* profile;
+
+  // Bytes left to allocate before the heap profiler's next sample.
+  size_t heapprof;
+
+  // Scratch memory for the running behaviour, freed when it returns.
+  region_t region;
+
+  // Set while an object graph is serialised or deserialised.
+  serialise_t* serialise;
 
 #ifdef USE_TELEMETRY
   size_t tsc;
@@ -51,34 +111,130 @@ struct scheduler_t
 {
   // These are rarely changed.
   pony_thread_id_t tid;
+  uint32_t tag;
   uint32_t cpu;
   uint32_t node;
   bool terminate;
   bool asio_stopped;
 
+  // Set once a thread of an embedding program has claimed this scheduler.
+  uint32_t volatile claimed;
+
+  // 0 until this scheduler needs a thread, 1 once it does, and 2 once the
+  // thread has been created. Threads are started when first needed.
+  uint32_t volatile started;
+
   // These are changed primarily by the owning scheduler thread.
   __pony_spec_align__(struct scheduler_t* last_victim, 64);
+  bool steal_remote;
+  uint64_t spin_budget;
+  uint32_t sweep_token;
+  uint64_t clock_tsc;
+
+  // How deep we are in FFI calls declared as blocking.
+  uint32_t blocking;
+
+  // Messages allocated by other schedulers, batched to be sent back to each.
+  msgreturn_t* returns;
+
+  // An actor woken by the running actor, to be run next.
+  pony_actor_t* runnext;
+
+  // Actors muted by sending to an overloaded actor, waiting for it to drain.
+  // Scheduler 0 reads the count of a suspended scheduler.
+  muted_t* muted;
+  uint32_t volatile muted_count;
+  uint32_t muted_size;
 
   pony_ctx_t ctx;
-  uint32_t block_count;
-  int32_t ack_token;
-  uint32_t ack_count;
 
-  // These are accessed by other scheduler threads. The mpmcq_t is aligned.
-  mpmcq_t q;
+  // Only used by scheduler 0, which coordinates quiescence detection.
+  bool cnf_pending;
+  uint32_t cnf_epoch;
+  uint32_t quiet_epoch;
+
+  // These are accessed by other scheduler threads. The wsdeque_t is aligned.
+  wsdeque_t iq;
+  wsdeque_t q;
+  mpmcq_t pinq;
   messageq_t mq;
+  pony_park_t park;
+  bool volatile asleep;
+  uint32_t volatile acked;
+  pony_msg_t* volatile returned;
 };
 
-pony_ctx_t* scheduler_init(uint32_t threads, bool noyield);
+pony_ctx_t* scheduler_init(uint32_t threads, uint32_t min_threads,
+  bool noyield);
 
 bool scheduler_start(bool library);
 
+/**
+ * Starts the runtime without scheduler threads, for pony_start_embedded().
+ * ASIO is only started if asio is true.
+ */
+bool scheduler_start_embedded(bool asio);
+
 void scheduler_stop();
 
+/**
+ * When enabled, an actor woken by a message from a running actor on the same
+ * scheduler thread is run as soon as the sender's batch ends, ahead of the
+ * scheduler's queue.
+ */
+void scheduler_setrunnext(bool runnext);
+
+/**
+ * When enabled, the cycle detector runs on a thread of its own rather than on
+ * the scheduler threads. Must be set before scheduler_init().
+ */
+void scheduler_setcdthread(bool cdthread);
+
 void scheduler_add(pony_ctx_t* ctx, pony_actor_t* actor);
 
+/**
+ * Holds a sender that isn't being rescheduled until the receiver's queue has
+ * drained. The scheduler then runs the sender again.
+ */
+void scheduler_mute(pony_ctx_t* ctx, pony_actor_t* sender,
+  pony_actor_t* receiver);
+
+/**
+ * On a context that doesn't belong to a scheduler thread, collect actors
+ * passed to scheduler_add() in the buffer, until scheduler_batch_end() pushes
+ * them all to the inject queue. If the buffer fills up, further actors are
+ * pushed one at a time.
+ */
+void scheduler_batch_start(pony_ctx_t* ctx, pony_actor_t** buffer,
+  uint32_t size);
+
+void scheduler_batch_end(pony_ctx_t* ctx);
+
+/**
+ * Identifies the calling thread's scheduler in a message's size field, or
+ * returns 0 if the thread isn't a scheduler thread.
+ */
+uint32_t scheduler_tag();
+
+/**
+ * Frees a message. A message allocated by another scheduler thread is batched
+ * and sent back to that thread's pool, rather than freed into ours.
+ */
+void scheduler_free_msg(pony_msg_t* m);
+
+/**
+ * The NUMA node of the context's scheduler thread, or 0 if the context
+ * doesn't belong to a scheduler thread.
+ */
+uint32_t scheduler_node(pony_ctx_t* ctx);
+
 uint32_t scheduler_cores();
 
+/**
+ * The number of schedulers that are not suspended.
+ */
+uint32_t scheduler_active();
+
 void scheduler_terminate();
 
 PONY_EXTERN_C_END
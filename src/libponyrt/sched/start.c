@@ -1,21 +1,56 @@
 #include "scheduler.h"
+#include "../actor/actor.h"
 #include "../mem/heap.h"
+#include "../mem/pool.h"
+#include "../mem/alloc.h"
+#include "../mem/heapprof.h"
+#include "../actor/profile.h"
 #include "../gc/cycle.h"
 #include "../lang/socket.h"
+#include "../lang/fileio.h"
+#include "../asio/asio.h"
+#include "../asio/wheel.h"
+#include "cpu.h"
 #include "../options/options.h"
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 typedef struct options_t
 {
   // concurrent options
   uint32_t threads;
+  uint32_t min_threads;
   uint32_t cd_min_deferred;
   uint32_t cd_max_deferred;
   uint32_t cd_conf_group;
+  bool cd_thread;
+  bool cd_ondemand;
+  bool cd_off;
   size_t gc_initial;
   double gc_factor;
+  uint64_t gc_slice;
+  double gc_pace;
+  size_t gc_nursery;
+  uint64_t slice;
   bool noyield;
+  bool runnext;
+  uint64_t pool_idle;
+  size_t pool_retain;
+  size_t prealloc;
+  bool prealloc_lock;
+  bool hugepages;
+  size_t heapprof;
+  const char* trace;
+  size_t trace_size;
+  size_t profile;
+  uint32_t asio_threads;
+  uint32_t asio_events;
+  uint32_t timer_threads;
+  bool pin;
+  const char* cpus;
+  uint32_t asio_cpu;
+  uint32_t accepts;
 } options_t;
 
 // global data
@@ -24,23 +59,73 @@ static int volatile exit_code;
 enum
 {
   OPT_THREADS,
+  OPT_MINTHREADS,
   OPT_CDMIN,
   OPT_CDMAX,
   OPT_CDCONF,
+  OPT_CDTHREAD,
+  OPT_CDONDEMAND,
+  OPT_CDOFF,
   OPT_GCINITIAL,
   OPT_GCFACTOR,
-  OPT_NOYIELD
+  OPT_GCSLICE,
+  OPT_GCPACE,
+  OPT_GCNURSERY,
+  OPT_SLICE,
+  OPT_NOYIELD,
+  OPT_RUNNEXT,
+  OPT_POOLIDLE,
+  OPT_POOLRETAIN,
+  OPT_PREALLOC,
+  OPT_PREALLOCLOCK,
+  OPT_HUGEPAGES,
+  OPT_HEAPPROFILE,
+  OPT_TRACE,
+  OPT_TRACESIZE,
+  OPT_PROFILE,
+  OPT_ASIOTHREADS,
+  OPT_ASIOEVENTS,
+  OPT_TIMERTHREADS,
+  OPT_PIN,
+  OPT_CPUS,
+  OPT_ASIOCPU,
+  OPT_ACCEPTS
 };
 
 static opt_arg_t args[] =
 {
   {"ponythreads", 0, OPT_ARG_REQUIRED, OPT_THREADS},
+  {"ponyminthreads", 0, OPT_ARG_REQUIRED, OPT_MINTHREADS},
   {"ponycdmin", 0, OPT_ARG_REQUIRED, OPT_CDMIN},
   {"ponycdmax", 0, OPT_ARG_REQUIRED, OPT_CDMAX},
   {"ponycdconf", 0, OPT_ARG_REQUIRED, OPT_CDCONF},
+  {"ponycdthread", 0, OPT_ARG_NONE, OPT_CDTHREAD},
+  {"ponycdondemand", 0, OPT_ARG_NONE, OPT_CDONDEMAND},
+  {"ponycdoff", 0, OPT_ARG_NONE, OPT_CDOFF},
   {"ponygcinitial", 0, OPT_ARG_REQUIRED, OPT_GCINITIAL},
   {"ponygcfactor", 0, OPT_ARG_REQUIRED, OPT_GCFACTOR},
+  {"ponygcslice", 0, OPT_ARG_REQUIRED, OPT_GCSLICE},
+  {"ponygcpace", 0, OPT_ARG_REQUIRED, OPT_GCPACE},
+  {"ponygcnursery", 0, OPT_ARG_REQUIRED, OPT_GCNURSERY},
+  {"ponyslice", 0, OPT_ARG_REQUIRED, OPT_SLICE},
   {"ponynoyield", 0, OPT_ARG_NONE, OPT_NOYIELD},
+  {"ponyrunnext", 0, OPT_ARG_NONE, OPT_RUNNEXT},
+  {"ponypoolidle", 0, OPT_ARG_REQUIRED, OPT_POOLIDLE},
+  {"ponypoolretain", 0, OPT_ARG_REQUIRED, OPT_POOLRETAIN},
+  {"ponyprealloc", 0, OPT_ARG_REQUIRED, OPT_PREALLOC},
+  {"ponypreallocmlock", 0, OPT_ARG_NONE, OPT_PREALLOCLOCK},
+  {"ponyhugepages", 0, OPT_ARG_NONE, OPT_HUGEPAGES},
+  {"ponyheapprofile", 0, OPT_ARG_REQUIRED, OPT_HEAPPROFILE},
+  {"ponytrace", 0, OPT_ARG_REQUIRED, OPT_TRACE},
+  {"ponytracesize", 0, OPT_ARG_REQUIRED, OPT_TRACESIZE},
+  {"ponyprofile", 0, OPT_ARG_REQUIRED, OPT_PROFILE},
+  {"ponyasiothreads", 0, OPT_ARG_REQUIRED, OPT_ASIOTHREADS},
+  {"ponyasioevents", 0, OPT_ARG_REQUIRED, OPT_ASIOEVENTS},
+  {"ponytimerthreads", 0, OPT_ARG_REQUIRED, OPT_TIMERTHREADS},
+  {"ponypin", 0, OPT_ARG_NONE, OPT_PIN},
+  {"ponycpus", 0, OPT_ARG_REQUIRED, OPT_CPUS},
+  {"ponyasiocpu", 0, OPT_ARG_REQUIRED, OPT_ASIOCPU},
+  {"ponyaccepts", 0, OPT_ARG_REQUIRED, OPT_ACCEPTS},
 
   OPT_ARGS_FINISH
 };
@@ -56,12 +141,47 @@ static int parse_opts(int argc, char** argv, options_t* opt)
     switch(id)
     {
       case OPT_THREADS: opt->threads = atoi(s.arg_val); break;
+      case OPT_MINTHREADS: opt->min_threads = atoi(s.arg_val); break;
       case OPT_CDMIN: opt->cd_min_deferred = atoi(s.arg_val); break;
       case OPT_CDMAX: opt->cd_max_deferred = atoi(s.arg_val); break;
       case OPT_CDCONF: opt->cd_conf_group = atoi(s.arg_val); break;
+      case OPT_CDTHREAD: opt->cd_thread = true; break;
+      case OPT_CDONDEMAND: opt->cd_ondemand = true; break;
+      case OPT_CDOFF: opt->cd_off = true; break;
       case OPT_GCINITIAL: opt->gc_initial = atoi(s.arg_val); break;
       case OPT_GCFACTOR: opt->gc_factor = atof(s.arg_val); break;
+      case OPT_GCSLICE: opt->gc_slice = strtoull(s.arg_val, NULL, 10); break;
+      case OPT_GCPACE: opt->gc_pace = atof(s.arg_val) / 100.0; break;
+      case OPT_GCNURSERY: opt->gc_nursery = atoi(s.arg_val); break;
+      case OPT_SLICE: opt->slice = strtoull(s.arg_val, NULL, 10); break;
       case OPT_NOYIELD: opt->noyield = true; break;
+      case OPT_RUNNEXT: opt->runnext = true; break;
+      case OPT_POOLIDLE:
+        opt->pool_idle = strtoull(s.arg_val, NULL, 10);
+        break;
+      case OPT_POOLRETAIN:
+        opt->pool_retain = (size_t)strtoull(s.arg_val, NULL, 10);
+        break;
+      case OPT_PREALLOC: opt->prealloc = atoi(s.arg_val); break;
+      case OPT_PREALLOCLOCK: opt->prealloc_lock = true; break;
+      case OPT_HUGEPAGES: opt->hugepages = true; break;
+      case OPT_HEAPPROFILE:
+        opt->heapprof = (size_t)strtoull(s.arg_val, NULL, 10);
+        break;
+      case OPT_TRACE: opt->trace = s.arg_val; break;
+      case OPT_TRACESIZE:
+        opt->trace_size = (size_t)strtoull(s.arg_val, NULL, 10);
+        break;
+      case OPT_PROFILE:
+        opt->profile = (size_t)strtoull(s.arg_val, NULL, 10);
+        break;
+      case OPT_ASIOTHREADS: opt->asio_threads = atoi(s.arg_val); break;
+      case OPT_ASIOEVENTS: opt->asio_events = atoi(s.arg_val); break;
+      case OPT_TIMERTHREADS: opt->timer_threads = atoi(s.arg_val); break;
+      case OPT_PIN: opt->pin = true; break;
+      case OPT_CPUS: opt->cpus = s.arg_val; break;
+      case OPT_ASIOCPU: opt->asio_cpu = atoi(s.arg_val); break;
+      case OPT_ACCEPTS: opt->accepts = atoi(s.arg_val); break;
 
       default: exit(-1);
     }
@@ -82,6 +202,10 @@ int pony_init(int argc, char** argv)
   opt.cd_conf_group = 6;
   opt.gc_initial = 14;
   opt.gc_factor = 2.0f;
+  opt.pool_idle = 10000000000ULL;
+  opt.pool_retain = 128;
+  opt.trace_size = 65536;
+  opt.asio_cpu = (uint32_t)-1;
 
   argc = parse_opts(argc, argv, &opt);
 
@@ -89,14 +213,60 @@ int pony_init(int argc, char** argv)
   pony_numa_init();
 #endif
 
+  if(!cpu_setaffinity(opt.pin, opt.cpus, opt.asio_cpu))
+  {
+    fprintf(stderr, "Invalid --ponycpus list: %s\n", opt.cpus);
+    exit(-1);
+  }
+
+  // Under a memory limit, such as a container's, no actor defers gc past an
+  // eighth of the limit, and the free memory each scheduler thread keeps
+  // from the OS shares another eighth.
+  size_t mem_limit = virtual_limit();
+  size_t pool_retain = opt.pool_retain << 20;
+
+  if(mem_limit > 0)
+  {
+    uint32_t threads = (opt.threads > 0) ? opt.threads : cpu_count();
+    size_t share = mem_limit / 8 / threads;
+
+    if(pool_retain > share)
+      pool_retain = share;
+
+    heap_setgcmax(mem_limit / 8);
+  }
+
+  virtual_sethugepages(opt.hugepages);
   heap_setinitialgc(opt.gc_initial);
   heap_setnextgcfactor(opt.gc_factor);
+  heap_setgcslice(opt.gc_slice);
+  heap_setgcpace(opt.gc_pace);
+  heap_setnursery(opt.gc_nursery);
+  actor_setslice(opt.slice);
+  scheduler_setrunnext(opt.runnext);
+  scheduler_setcdthread(opt.cd_thread);
+  pool_setscavenge(opt.pool_idle, pool_retain);
+  pool_setprealloc(opt.prealloc << 20, opt.prealloc_lock);
+  heapprof_setrate(opt.heapprof);
+  eventlog_setfile(opt.trace, opt.trace_size);
+  profile_setcount(opt.profile);
+  asio_setthreads(opt.asio_threads, opt.asio_events);
+  asio_wheel_setthreads(opt.timer_threads);
+  os_socket_setaccepts(opt.accepts);
 
   pony_exitcode(0);
-  pony_ctx_t* ctx = scheduler_init(opt.threads, opt.noyield);
+  pony_ctx_t* ctx = scheduler_init(opt.threads, opt.min_threads,
+    opt.noyield);
   cycle_create(ctx,
     opt.cd_min_deferred, opt.cd_max_deferred, opt.cd_conf_group);
 
+  if(opt.cd_off)
+    pony_cycle_setmode(PONY_CD_OFF);
+  else if(opt.cd_ondemand)
+    pony_cycle_setmode(PONY_CD_ONDEMAND);
+  else
+    pony_cycle_setmode(PONY_CD_AUTO);
+
   return argc;
 }
 
@@ -105,6 +275,8 @@ int pony_start(bool library)
   if(!os_socket_init())
     return -1;
 
+  os_file_init();
+
   if(!scheduler_start(library))
     return -1;
 
@@ -114,14 +286,33 @@ int pony_start(bool library)
   return _atomic_load(&exit_code);
 }
 
+int pony_start_embedded(bool asio)
+{
+  if(!os_socket_init())
+    return -1;
+
+  os_file_init();
+
+  if(!scheduler_start_embedded(asio))
+    return -1;
+
+  return 0;
+}
+
 int pony_stop()
 {
   scheduler_stop();
   os_socket_shutdown();
+  os_file_shutdown();
 
   return _atomic_load(&exit_code);
 }
 
+void pony_prealloc(size_t bytes, bool lock)
+{
+  pool_setprealloc(bytes, lock);
+}
+
 void pony_exitcode(int code)
 {
   _atomic_store(&exit_code, code);
@@ -0,0 +1,99 @@
+#include "wsdeque.h"
+#include "../mem/pool.h"
+#include <assert.h>
+
+void wsdeque_init(wsdeque_t* q, size_t size)
+{
+  assert((size & (size - 1)) == 0);
+
+  q->buffer = (void* volatile*)pool_alloc_size(size * sizeof(void*));
+  q->mask = size - 1;
+  q->top = 0;
+  q->bottom = 0;
+}
+
+void wsdeque_destroy(wsdeque_t* q)
+{
+  assert(wsdeque_size(q) == 0);
+
+  pool_free_size((q->mask + 1) * sizeof(void*), (void*)q->buffer);
+  q->buffer = NULL;
+  q->mask = 0;
+}
+
+bool wsdeque_push(wsdeque_t* q, void* data)
+{
+  size_t b = q->bottom;
+  size_t t = _atomic_load(&q->top);
+
+  if((b - t) > q->mask)
+    return false;
+
+  q->buffer[b & q->mask] = data;
+
+  // Publish the item to thieves.
+  _atomic_store(&q->bottom, b + 1);
+  return true;
+}
+
+void* wsdeque_pop(wsdeque_t* q)
+{
+  size_t b = q->bottom - 1;
+
+  // Reserve the bottom item before looking at the top. The fence orders the
+  // store to bottom before the load of top, so that a concurrent thief will
+  // either see the reservation or we will see the thief.
+  _atomic_store(&q->bottom, b);
+  _atomic_fence();
+  size_t t = _atomic_load(&q->top);
+
+  if((intptr_t)(b - t) < 0)
+  {
+    // The deque was empty.
+    q->bottom = b + 1;
+    return NULL;
+  }
+
+  void* data = q->buffer[b & q->mask];
+
+  if(b != t)
+    return data;
+
+  // This is the last item, race any thieves for it.
+  if(!_atomic_cas(&q->top, &t, t + 1))
+    data = NULL;
+
+  q->bottom = b + 1;
+  return data;
+}
+
+void* wsdeque_steal(wsdeque_t* q)
+{
+  size_t t = _atomic_load(&q->top);
+
+  while(true)
+  {
+    _atomic_fence();
+    size_t b = _atomic_load(&q->bottom);
+
+    if((intptr_t)(b - t) <= 0)
+      return NULL;
+
+    void* data = q->buffer[t & q->mask];
+
+    // If this fails, t is reloaded with the current top and we try again.
+    if(_atomic_cas(&q->top, &t, t + 1))
+      return data;
+  }
+}
+
+size_t wsdeque_size(wsdeque_t* q)
+{
+  size_t t = _atomic_load(&q->top);
+  size_t b = _atomic_load(&q->bottom);
+
+  if((intptr_t)(b - t) <= 0)
+    return 0;
+
+  return b - t;
+}
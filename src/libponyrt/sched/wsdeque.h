@@ -0,0 +1,57 @@
+#ifndef sched_wsdeque_h
+#define sched_wsdeque_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <platform.h>
+
+PONY_EXTERN_C_BEGIN
+
+/** A bounded Chase-Lev work stealing deque.
+ *
+ * The owning thread pushes and pops at the bottom without atomic
+ * read-modify-write operations. Any other thread may steal from the top. The
+ * capacity is fixed at initialisation time and must be a power of 2. A push
+ * onto a full deque fails, and the caller is expected to place the item
+ * somewhere else.
+ */
+__pony_spec_align__(
+  typedef struct wsdeque_t
+  {
+    size_t volatile top;
+    void* volatile* buffer;
+    size_t mask;
+
+    // The bottom is written only by the owner, keep it on its own cache line.
+    __pony_spec_align__(size_t volatile bottom, 64);
+  } wsdeque_t, 64
+);
+
+void wsdeque_init(wsdeque_t* q, size_t size);
+
+void wsdeque_destroy(wsdeque_t* q);
+
+/**
+ * Owner only. Returns false if the deque is full.
+ */
+bool wsdeque_push(wsdeque_t* q, void* data);
+
+/**
+ * Owner only. Returns the most recently pushed item, or NULL.
+ */
+void* wsdeque_pop(wsdeque_t* q);
+
+/**
+ * Any thread. Returns the oldest item, or NULL if the deque is empty.
+ */
+void* wsdeque_steal(wsdeque_t* q);
+
+/**
+ * Any thread. An estimate of the number of items in the deque.
+ */
+size_t wsdeque_size(wsdeque_t* q);
+
+PONY_EXTERN_C_END
+
+#endif
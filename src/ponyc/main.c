@@ -2,9 +2,11 @@
 #include "../libponyc/ast/bnfprint.h"
 #include "../libponyc/pkg/package.h"
 #include "../libponyc/pkg/buildflagset.h"
+#include "../libponyc/pkg/watch.h"
 #include "../libponyc/pass/pass.h"
 #include "../libponyc/ast/stringtab.h"
 #include "../libponyc/ast/treecheck.h"
+#include "../libponyc/codegen/gensymbols.h"
 #include <platform.h>
 #include "../libponyrt/options/options.h"
 
@@ -34,6 +36,15 @@ enum
   OPT_FEATURES,
   OPT_TRIPLE,
   OPT_STATS,
+  OPT_PGOUSE,
+  OPT_DISPATCH,
+  OPT_RUNTIMEBC,
+  OPT_JOBS,
+  OPT_CACHE,
+  OPT_WATCH,
+  OPT_FRAMEPOINTERS,
+  OPT_SYMBOLS,
+  OPT_DEMANGLE,
 
   OPT_PASSES,
   OPT_AST,
@@ -67,6 +78,15 @@ static opt_arg_t args[] =
   {"features", 0, OPT_ARG_REQUIRED, OPT_FEATURES},
   {"triple", 0, OPT_ARG_REQUIRED, OPT_TRIPLE},
   {"stats", 0, OPT_ARG_NONE, OPT_STATS},
+  {"pgo-use", 0, OPT_ARG_REQUIRED, OPT_PGOUSE},
+  {"dispatch", 0, OPT_ARG_REQUIRED, OPT_DISPATCH},
+  {"runtimebc", 0, OPT_ARG_NONE, OPT_RUNTIMEBC},
+  {"jobs", 'j', OPT_ARG_REQUIRED, OPT_JOBS},
+  {"cache", 0, OPT_ARG_REQUIRED, OPT_CACHE},
+  {"watch", 0, OPT_ARG_NONE, OPT_WATCH},
+  {"frame-pointers", 0, OPT_ARG_NONE, OPT_FRAMEPOINTERS},
+  {"symbols", 0, OPT_ARG_NONE, OPT_SYMBOLS},
+  {"demangle", 0, OPT_ARG_REQUIRED, OPT_DEMANGLE},
 
   {"pass", 'r', OPT_ARG_REQUIRED, OPT_PASSES},
   {"ast", 'a', OPT_ARG_NONE, OPT_AST},
@@ -115,7 +135,36 @@ static void usage()
     "    =+this,-that  Use + to enable, - to disable.\n"
     "  --triple        Set the target triple.\n"
     "    =name         Defaults to the host triple.\n"
-    "  --stats         Print some compiler stats.\n"
+    "  --stats         Print some compiler stats, including the time and peak\n"
+    "                  memory of each phase.\n"
+    "  --pgo-use       Optimise using a sample profile.\n"
+    "    =file         Made with perf and create_llvm_prof from a build that\n"
+    "                  isn't stripped.\n"
+    "  --dispatch      Also compile each function with a loop for these CPUs,\n"
+    "    =cpu,cpu      and pick the first one the running CPU can use. Set\n"
+    "                  --cpu to the oldest CPU it must run on. With a\n"
+    "                  profile, only functions it saw running are compiled.\n"
+    "                  Needs LLVM 3.7.\n"
+    "  --runtimebc     Optimise the runtime with the program, using the\n"
+    "                  libponyrt.bc built by 'make libponyrt.bc'.\n"
+    "  --jobs, -j      Parse each package's files on N threads, and generate\n"
+    "    =N            machine code on N threads, writing an object file for\n"
+    "                  each. Generating on threads needs LLVM 3.8.\n"
+    "  --cache         Keep the object file for each program built in this\n"
+    "    =dir          directory, and link it again instead of type checking\n"
+    "                  and generating code when no source file has changed.\n"
+    "  --watch         Stay running after the build, and build again whenever\n"
+    "                  a .pony file in one of the program's packages is\n"
+    "                  added, removed or saved. Only one package directory\n"
+    "                  may be given.\n"
+    "  --frame-pointers Keep the frame pointer in every function, so perf and\n"
+    "                  other profilers can walk the stack. Build the runtime\n"
+    "                  with 'make use=framepointers' to keep them there too.\n"
+    "  --symbols       Also write <name>.symbols, mapping each mangled\n"
+    "                  function name to a readable Type.method name.\n"
+    "  --demangle      Copy standard input to standard output, replacing the\n"
+    "    =file         mangled names in a .symbols file with readable ones,\n"
+    "                  e.g. perf script | ponyc --demangle=prog.symbols.\n"
     "\n"
     "Debugging options:\n"
     "  --pass, -r      Restrict phases.\n"
@@ -149,18 +198,78 @@ static void usage()
     "Runtime options for Pony programs (not for use with ponyc):\n"
     "  --ponythreads   Use N scheduler threads. Defaults to the number of\n"
     "                  cores (not hyperthreads) available.\n"
-    "  --ponycdmin     Defer cycle detection until 2^N actors have blocked.\n"
-    "                  Defaults to 2^4.\n"
+    "  --ponyminthreads Keep at least N scheduler threads awake when no work\n"
+    "                  is available. Defaults to 0.\n"
+    "  --ponycdmin     Defer cycle detection until at least 2^N actors have\n"
+    "                  blocked. Defaults to 2^4.\n"
     "  --ponycdmax     Always cycle detect when 2^N actors have blocked.\n"
     "                  Defaults to 2^18.\n"
-    "  --ponycdconf    Send cycle detection CNF messages in groups of 2^N.\n"
-    "                  Defaults to 2^6.\n"
+    "  --ponycdconf    Send cycle detection CNF messages in groups of at least\n"
+    "                  2^N. Defaults to 2^6.\n"
+    "  --ponycdthread  Run the cycle detector on a thread of its own.\n"
+    "  --ponycdondemand\n"
+    "                  Only look for cycles of actors when the program asks.\n"
+    "  --ponycdoff     Turn cycle detection off. No actor is collected.\n"
     "  --ponygcinitial Defer garbage collection until an actor is using at\n"
     "                  least 2^N bytes. Defaults to 2^14.\n"
     "  --ponygcfactor  After GC, an actor will next be GC'd at a heap memory\n"
     "                  usage N times its current value. This is a floating\n"
     "                  point value. Defaults to 2.0.\n"
+    "  --ponygcslice   Spend at most about N CPU cycles sweeping an actor's\n"
+    "                  heap before it handles its next message, finishing\n"
+    "                  the sweep over later messages. Defaults to 0, which\n"
+    "                  sweeps the whole heap at once.\n"
+    "  --ponygcpace    Aim for actors to spend about N percent of their time\n"
+    "                  in GC, letting the heap of an actor over that grow\n"
+    "                  further between passes. Defaults to 0, which is off.\n"
+    "  --ponygcnursery After 2^N bytes are allocated, collect only the\n"
+    "                  objects allocated since the last GC, keeping older\n"
+    "                  objects without tracing them. Defaults to 0, which is\n"
+    "                  off.\n"
+    "  --ponyslice     Size each batch of messages an actor handles to take\n"
+    "                  about N CPU cycles. Defaults to 1000000.\n"
     "  --ponynoyield   Do not yield the CPU when no work is available.\n"
+    "  --ponyrunnext   Run an actor woken by a message straight after the\n"
+    "                  sender, on the same scheduler thread.\n"
+    "  --ponypoolidle  Return free memory to the OS once it has been unused\n"
+    "                  for N CPU cycles. 0 never returns it. Defaults to\n"
+    "                  10000000000.\n"
+    "  --ponypoolretain Keep up to N MB of free memory per scheduler thread\n"
+    "                  rather than returning it to the OS. Defaults to 128.\n"
+    "  --ponyprealloc  Map and fault in N MB of memory for each scheduler\n"
+    "                  thread as it starts, and keep it resident, so that\n"
+    "                  allocations soon after startup don't wait on the OS.\n"
+    "  --ponypreallocmlock\n"
+    "                  Also lock that memory in RAM.\n"
+    "  --ponyhugepages Back the memory pool with transparent huge pages, in\n"
+    "                  huge page aligned arenas. Linux only.\n"
+    "  --ponyheapprofile\n"
+    "                  Sample an allocation, with its backtrace, for about\n"
+    "                  every N bytes allocated. SIGUSR2 writes a pprof heap\n"
+    "                  profile to pony.<pid>.<n>.heap.\n"
+    "  --ponytrace     Record runs, behaviours, GC passes, steals and sends\n"
+    "                  on each scheduler thread, and write them to file at\n"
+    "                  exit. Convert the file with ponytrace.\n"
+    "  --ponytracesize Keep the last N events of each scheduler thread.\n"
+    "                  Defaults to 65536.\n"
+    "  --ponyprofile   Measure the CPU time of each behaviour, and write the\n"
+    "                  N behaviours with the most to stderr at exit.\n"
+    "  --ponyasiothreads\n"
+    "                  Use N I/O event threads, each handling the events of\n"
+    "                  some of the actors. Defaults to 1.\n"
+    "  --ponyasioevents\n"
+    "                  Handle up to N I/O events per wait. Defaults to 64.\n"
+    "  --ponytimerthreads\n"
+    "                  Use N threads for runtime timers, each handling the\n"
+    "                  timers of some of the actors. Defaults to 1.\n"
+    "  --ponypin       Pin each scheduler thread to a CPU.\n"
+    "  --ponycpus      Only use the listed CPUs for scheduler threads, such\n"
+    "                  as 0-3,8. Defaults to every CPU the process may run\n"
+    "                  on, which a cgroup cpuset or taskset can limit.\n"
+    "  --ponyasiocpu   Pin the I/O event threads to CPU N, and don't use it\n"
+    "                  for scheduler threads.\n"
+    "  --ponyaccepts   Keep N accepts posted for each TCP listener on\n"
+    "                  Windows. Defaults to 8.\n"
     );
 }
 
@@ -196,10 +305,18 @@ static size_t get_width()
 }
 
 static bool compile_package(const char* path, pass_opt_t* opt,
-  bool print_program_ast, bool print_package_ast)
+  bool print_program_ast, bool print_package_ast, watch_t** watch)
 {
+  opt->cache_file = NULL;
+  opt->cache_hit = false;
+
   ast_t* program = program_load(path, opt);
 
+  // Even if the program didn't load, watch its own directory so that a
+  // fix can be picked up.
+  if(watch != NULL)
+    *watch = watch_create(path, program);
+
   if(program == NULL)
     return false;
 
@@ -227,6 +344,7 @@ int main(int argc, char* argv[])
   ast_setwidth(get_width());
   bool print_program_ast = false;
   bool print_package_ast = false;
+  bool watch = false;
 
   opt_state_t s;
   opt_init(args, &s, &argc, argv);
@@ -261,6 +379,22 @@ int main(int argc, char* argv[])
       case OPT_FEATURES: opt.features = s.arg_val; break;
       case OPT_TRIPLE: opt.triple = s.arg_val; break;
       case OPT_STATS: opt.print_stats = true; break;
+      case OPT_PGOUSE: opt.pgo_use = s.arg_val; break;
+      case OPT_DISPATCH: opt.dispatch = s.arg_val; break;
+      case OPT_RUNTIMEBC: opt.runtime_bc = true; break;
+      case OPT_JOBS: opt.jobs = atoi(s.arg_val); break;
+      case OPT_CACHE: opt.cache_dir = s.arg_val; break;
+      case OPT_WATCH: watch = true; break;
+      case OPT_FRAMEPOINTERS: opt.frame_pointers = true; break;
+      case OPT_SYMBOLS: opt.symbol_map = true; break;
+
+      case OPT_DEMANGLE:
+        if(!gensymbols_demangle(s.arg_val, stdin, stdout))
+        {
+          print_errors();
+          return -1;
+        }
+        return 0;
 
       case OPT_AST: print_program_ast = true; break;
       case OPT_ASTPACKAGE: print_package_ast = true; break;
@@ -297,6 +431,12 @@ int main(int argc, char* argv[])
     }
   }
 
+  if(watch && (argc > 2))
+  {
+    printf("Only one package directory may be watched\n");
+    ok = false;
+  }
+
 #ifdef PLATFORM_IS_WINDOWS
   opt.strip_debug = true;
 #endif
@@ -313,13 +453,32 @@ int main(int argc, char* argv[])
 
   if(package_init(&opt))
   {
-    if(argc == 1)
+    if(watch)
     {
-      ok &= compile_package(".", &opt, print_program_ast, print_package_ast);
+      const char* path = (argc == 1) ? "." : argv[1];
+
+      // Each build starts from the source again, but the process, and with
+      // it the LLVM setup and the string table, is kept.
+      while(true)
+      {
+        watch_t* w;
+        compile_package(path, &opt, print_program_ast, print_package_ast,
+          &w);
+        print_errors();
+        free_errors();
+
+        printf("Watching for changes\n");
+        fflush(stdout);
+        watch_wait(w, 250);
+        watch_free(w);
+      }
+    } else if(argc == 1) {
+      ok &= compile_package(".", &opt, print_program_ast, print_package_ast,
+        NULL);
     } else {
       for(int i = 1; i < argc; i++)
         ok &= compile_package(argv[i], &opt, print_program_ast,
-          print_package_ast);
+          print_package_ast, NULL);
     }
   }
 
@@ -0,0 +1,247 @@
+#include <platform.h>
+#include "sched/eventlog.h"
+#include "actor/actor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+/**
+ * Converts an event log written by a program run with --ponytrace to the
+ * Chrome trace event format, which chrome://tracing and Perfetto can show.
+ * Each scheduler thread is a track. Runs of an actor, the behaviours they
+ * handle and GC passes are nested slices, steals are slices between runs, and
+ * sends are instant events.
+ */
+
+typedef struct convert_t
+{
+  FILE* out;
+  eventlog_file_t header;
+  double ns_per_tick;
+  bool first;
+} convert_t;
+
+static void usage()
+{
+  printf(
+    "ponytrace <event log> [output file]\n"
+    "\n"
+    "Converts an event log written by a Pony program run with\n"
+    "--ponytrace=<event log> to JSON in the Chrome trace event format, for\n"
+    "chrome://tracing or https://ui.perfetto.dev. Writes to standard output\n"
+    "if no output file is given.\n"
+    );
+}
+
+static const char* msg_name(uint32_t id, char* buf, size_t len)
+{
+  switch(id)
+  {
+    case ACTORMSG_DETECT: return "detect";
+    case ACTORMSG_REPLY: return "reply";
+    case ACTORMSG_BLOCK: return "block";
+    case ACTORMSG_UNBLOCK: return "unblock";
+    case ACTORMSG_ACQUIRE: return "acquire";
+    case ACTORMSG_RELEASE: return "release";
+    case ACTORMSG_CONF: return "conf";
+    case ACTORMSG_ACK: return "ack";
+    default: {}
+  }
+
+  snprintf(buf, len, "msg %" PRIu32, id);
+  return buf;
+}
+
+static void begin_event(convert_t* c, eventlog_file_sched_t* sched,
+  eventlog_event_t* e, const char* ph, const char* name, const char* cat)
+{
+  double us = (double)(e->tsc - c->header.start_tsc) * c->ns_per_tick /
+    1000.0;
+
+  fprintf(c->out,
+    "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,"
+    "\"pid\":0,\"tid\":%" PRIu32,
+    c->first ? "" : ",", name, cat, ph, us, sched->index);
+
+  c->first = false;
+}
+
+static void write_event(convert_t* c, eventlog_file_sched_t* sched,
+  eventlog_event_t* e, int* depth)
+{
+  char name[64];
+  char msg[32];
+
+  // The ring may have overwritten the start of a slice whose end it kept.
+  bool end = (e->kind == EVENTLOG_RUN_END) ||
+    (e->kind == EVENTLOG_BEHAVIOUR_END) || (e->kind == EVENTLOG_GC_END) ||
+    (e->kind == EVENTLOG_STEAL_END);
+
+  if(end)
+  {
+    if(*depth == 0)
+      return;
+
+    (*depth)--;
+  }
+
+  switch(e->kind)
+  {
+    case EVENTLOG_RUN_START:
+      snprintf(name, sizeof(name), "type %" PRIu32, e->type);
+      begin_event(c, sched, e, "B", name, "run");
+      fprintf(c->out,
+        ",\"args\":{\"actor\":\"0x%" PRIx64 "\",\"batch\":%" PRIu32 "}}",
+        e->actor, e->arg);
+      (*depth)++;
+      break;
+
+    case EVENTLOG_RUN_END:
+      begin_event(c, sched, e, "E", "", "run");
+      fprintf(c->out, ",\"args\":{\"rescheduled\":%s}}",
+        e->arg ? "true" : "false");
+      break;
+
+    case EVENTLOG_BEHAVIOUR_START:
+      begin_event(c, sched, e, "B", msg_name(e->arg, msg, sizeof(msg)),
+        "behaviour");
+      fprintf(c->out, "}");
+      (*depth)++;
+      break;
+
+    case EVENTLOG_GC_START:
+      begin_event(c, sched, e, "B", e->arg ? "minor gc" : "gc", "gc");
+      fprintf(c->out, "}");
+      (*depth)++;
+      break;
+
+    case EVENTLOG_STEAL_START:
+      begin_event(c, sched, e, "B", "steal", "sched");
+      fprintf(c->out, "}");
+      (*depth)++;
+      break;
+
+    case EVENTLOG_BEHAVIOUR_END:
+    case EVENTLOG_GC_END:
+      begin_event(c, sched, e, "E", "", "");
+      fprintf(c->out, "}");
+      break;
+
+    case EVENTLOG_STEAL_END:
+      begin_event(c, sched, e, "E", "", "sched");
+      fprintf(c->out, ",\"args\":{\"found\":\"0x%" PRIx64 "\"}}", e->other);
+      break;
+
+    case EVENTLOG_SEND:
+      begin_event(c, sched, e, "i", msg_name(e->arg, msg, sizeof(msg)),
+        "send");
+      fprintf(c->out,
+        ",\"s\":\"t\",\"args\":{\"from\":\"0x%" PRIx64 "\","
+        "\"to\":\"0x%" PRIx64 "\"}}",
+        e->actor, e->other);
+      break;
+
+    default: {}
+  }
+}
+
+static bool convert(FILE* in, convert_t* c)
+{
+  if((fread(&c->header, sizeof(eventlog_file_t), 1, in) != 1) ||
+    (memcmp(c->header.magic, EVENTLOG_MAGIC, sizeof(c->header.magic)) != 0))
+  {
+    fprintf(stderr, "Not a Pony event log\n");
+    return false;
+  }
+
+  if(c->header.event_size != sizeof(eventlog_event_t))
+  {
+    fprintf(stderr, "The event log was written by a different runtime\n");
+    return false;
+  }
+
+  uint64_t ticks = c->header.end_tsc - c->header.start_tsc;
+  uint64_t nanos = c->header.end_nanos - c->header.start_nanos;
+  c->ns_per_tick = (ticks > 0) ? ((double)nanos / (double)ticks) : 1.0;
+  c->first = true;
+
+  fprintf(c->out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+  for(uint32_t i = 0; i < c->header.schedulers; i++)
+  {
+    eventlog_file_sched_t sched;
+
+    if(fread(&sched, sizeof(sched), 1, in) != 1)
+    {
+      fprintf(stderr, "The event log is truncated\n");
+      return false;
+    }
+
+    fprintf(c->out,
+      "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+      "\"tid\":%" PRIu32 ",\"args\":{\"name\":\"scheduler %" PRIu32
+      " (cpu %" PRIu32 ")\"}}",
+      c->first ? "" : ",", sched.index, sched.index, sched.cpu);
+    c->first = false;
+
+    int depth = 0;
+    eventlog_event_t e;
+
+    for(uint64_t j = 0; j < sched.count; j++)
+    {
+      if(fread(&e, sizeof(e), 1, in) != 1)
+      {
+        fprintf(stderr, "The event log is truncated\n");
+        return false;
+      }
+
+      write_event(c, &sched, &e, &depth);
+    }
+  }
+
+  fprintf(c->out, "\n]}\n");
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  if((argc < 2) || (argc > 3) || (argv[1][0] == '-'))
+  {
+    usage();
+    return 1;
+  }
+
+  FILE* in = fopen(argv[1], "rb");
+
+  if(in == NULL)
+  {
+    fprintf(stderr, "Can't read %s\n", argv[1]);
+    return 1;
+  }
+
+  convert_t c;
+  memset(&c, 0, sizeof(c));
+  c.out = stdout;
+
+  if(argc == 3)
+  {
+    c.out = fopen(argv[2], "wb");
+
+    if(c.out == NULL)
+    {
+      fprintf(stderr, "Can't write %s\n", argv[2]);
+      fclose(in);
+      return 1;
+    }
+  }
+
+  bool ok = convert(in, &c);
+  fclose(in);
+
+  if(c.out != stdout)
+    fclose(c.out);
+
+  return ok ? 0 : 1;
+}
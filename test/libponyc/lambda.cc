@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <platform.h>
+
+#include "util.h"
+
+#define TEST_COMPILE(src) DO(test_compile(src, "expr"))
+#define TEST_ERROR(src) DO(test_error(src, "expr"))
+
+
+class LambdaTest: public PassTest
+{};
+
+
+// A lambda without captures is a primitive, so its value is val.
+TEST_F(LambdaTest, NoCapturesIsVal)
+{
+  const char* src =
+    "class C\n"
+    "  fun f(): {(): U64} val =>\n"
+    "    lambda(): U64 => 2 end";
+
+  TEST_COMPILE(src);
+}
+
+
+// Each capture is a field, so a lambda with captures is a class and its value
+// is ref, even when every capture is a literal.
+TEST_F(LambdaTest, LiteralCaptureIsRef)
+{
+  const char* src =
+    "class C\n"
+    "  fun f(): {(): U64} ref =>\n"
+    "    lambda()(n: U64 = 2): U64 => n end";
+
+  TEST_COMPILE(src);
+}
+
+
+TEST_F(LambdaTest, LiteralCaptureIsNotVal)
+{
+  const char* src =
+    "class C\n"
+    "  fun f(): {(): U64} val =>\n"
+    "    lambda()(n: U64 = 2): U64 => n end";
+
+  TEST_ERROR(src);
+}
+
+
+TEST_F(LambdaTest, LocalCaptureIsRef)
+{
+  const char* src =
+    "class C\n"
+    "  fun f(): {(): U64} ref =>\n"
+    "    let n: U64 = 2\n"
+    "    lambda()(n): U64 => n end";
+
+  TEST_COMPILE(src);
+}
+
+
+TEST_F(LambdaTest, LocalCaptureIsNotVal)
+{
+  const char* src =
+    "class C\n"
+    "  fun f(): {(): U64} val =>\n"
+    "    let n: U64 = 2\n"
+    "    lambda()(n): U64 => n end";
+
+  TEST_ERROR(src);
+}
+
+
+TEST_F(LambdaTest, RefApplyWithCapture)
+{
+  const char* src =
+    "class C\n"
+    "  fun f(): {ref(): U64} ref =>\n"
+    "    lambda ref()(n: U64 = 2): U64 => n end";
+
+  TEST_COMPILE(src);
+}
@@ -99,6 +99,32 @@ TEST_F(LexerTest, Keyword)
 }
 
 
+TEST_F(LexerTest, KeywordsInHashTable)
+{
+  const char* src =
+    "_ compile_intrinsic isnt ifdef elseif __loc #read #any\n"
+    "is if else iso trn _x #";
+
+  expect(1, 1, TK_DONTCARE, "_");
+  expect(1, 3, TK_COMPILE_INTRINSIC, "compile_intrinsic");
+  expect(1, 21, TK_ISNT, "isnt");
+  expect(1, 26, TK_IFDEF, "ifdef");
+  expect(1, 32, TK_ELSEIF, "elseif");
+  expect(1, 39, TK_LOCATION, "__loc");
+  expect(1, 45, TK_CAP_READ, "#read");
+  expect(1, 51, TK_CAP_ANY, "#any");
+  expect(2, 1, TK_IS, "is");
+  expect(2, 4, TK_IF, "if");
+  expect(2, 7, TK_ELSE, "else");
+  expect(2, 12, TK_ISO, "iso");
+  expect(2, 16, TK_TRN, "trn");
+  expect(2, 20, TK_ID, "_x");
+  expect(2, 23, TK_CONSTANT, "#");
+  expect(2, 24, TK_EOF, "EOF");
+  DO(test(src));
+}
+
+
 TEST_F(LexerTest, Symbol1Char)
 {
   const char* src = "+";
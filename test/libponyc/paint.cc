@@ -79,7 +79,7 @@ protected:
 
     while((mn = reachable_method_names_next(&type->methods, &i)) != NULL)
     {
-      reachable_method_t m2 = { mn->name, NULL, NULL, 0 };
+      reachable_method_t m2 = { mn->name, NULL, NULL, 0, 0 };
       reachable_method_t* method = reachable_methods_get(&mn->r_methods, &m2);
 
       assert(method != NULL);
@@ -107,7 +107,7 @@ protected:
 
       if(mn != NULL)
       {
-        reachable_method_t m2 = { stringtab(name), NULL, NULL, 0 };
+        reachable_method_t m2 = { stringtab(name), NULL, NULL, 0, 0 };
         reachable_method_t* method = reachable_methods_get(&mn->r_methods, &m2);
 
         ASSERT_NE((void*)NULL, method);
@@ -398,3 +398,29 @@ TEST_F(PaintTest, MultiComplex)
   ASSERT_NE(m3_colour, m8_colour);
   ASSERT_NE(m7_colour, m8_colour);
 }
+
+TEST_F(PaintTest, MostUsedNameFirst)
+{
+  add_type("T1");
+  add_method("m1");
+  add_method("m2");
+  add_method("m3");
+
+  add_type("T2");
+  add_method("m3");
+
+  add_type("T3");
+  add_method("m3");
+
+  add_type("T4");
+  add_method("m3");
+
+  do_paint();
+
+  DO(check_vtable_size("T1", 3, 3, NULL));
+  DO(check_vtable_size("T2", 1, 1, NULL));
+  DO(check_vtable_size("T3", 1, 1, NULL));
+  DO(check_vtable_size("T4", 1, 1, NULL));
+
+  DO(check_method_colour("m3", 0, NULL));
+}
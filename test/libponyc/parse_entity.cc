@@ -455,6 +455,38 @@ TEST_F(ParseEntityTest, BehaviourCannotBePartial)
 }
 
 
+TEST_F(ParseEntityTest, BehaviourCoalesce)
+{
+  const char* src = "actor Foo be m() coalesce => 3";
+
+  TEST_COMPILE(src);
+}
+
+
+TEST_F(ParseEntityTest, BehaviourCoalesceCannotHaveParameters)
+{
+  const char* src = "actor Foo be m(x:U32) coalesce => 3";
+
+  TEST_ERROR(src);
+}
+
+
+TEST_F(ParseEntityTest, FunctionCannotCoalesce)
+{
+  const char* src = "actor Foo fun m() coalesce => 3";
+
+  TEST_ERROR(src);
+}
+
+
+TEST_F(ParseEntityTest, MethodUnknownAnnotation)
+{
+  const char* src = "actor Foo be m() wombat => 3";
+
+  TEST_ERROR(src);
+}
+
+
 TEST_F(ParseEntityTest, ActorBehaviourMustHaveBody)
 {
   const char* src = "actor Foo be m()";
@@ -801,6 +833,24 @@ TEST_F(ParseEntityTest, UseFfiEllipsisMustBeLast)
 }
 
 
+TEST_F(ParseEntityTest, UseFfiBlocking)
+{
+  const char* src =
+    "use @foo1[U32](a:I32) blocking\n"
+    "use @foo2[U32]() ? blocking if debug";
+
+  TEST_COMPILE(src);
+}
+
+
+TEST_F(ParseEntityTest, UseFfiUnknownAnnotation)
+{
+  const char* src = "use @foo[U32]() wombat";
+
+  TEST_ERROR(src);
+}
+
+
 TEST_F(ParseEntityTest, UseGuardsAreExpressions)
 {
   const char* src = "use \"foo\" if linux and debug";
@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+#include <platform.h>
+
+#include <ast/ast.h>
+#include <ast/stringtab.h>
+
+#include "util.h"
+
+#define TEST_COMPILE(src) DO(test_compile(src, "expr"))
+
+
+static const char* _builtin =
+  "primitive U8\n"
+  "  new create() => 0\n"
+  "primitive I8\n"
+  "  new create() => 0\n"
+  "primitive U16\n"
+  "  new create() => 0\n"
+  "primitive I16\n"
+  "  new create() => 0\n"
+  "primitive U32\n"
+  "  new create() => 0\n"
+  "primitive I32\n"
+  "  new create() => 0\n"
+  "primitive U64\n"
+  "  new create() => 0\n"
+  "primitive I64\n"
+  "  new create() => 0\n"
+  "primitive U128\n"
+  "  new create() => 0\n"
+  "primitive I128\n"
+  "  new create() => 0\n"
+  "primitive ULong\n"
+  "  new create() => 0\n"
+  "primitive ILong\n"
+  "  new create() => 0\n"
+  "primitive USize\n"
+  "  new create() => 0\n"
+  "  fun add(y: USize): USize => this\n"
+  "primitive ISize\n"
+  "  new create() => 0\n"
+  "primitive F32\n"
+  "  new create() => 0\n"
+  "primitive F64\n"
+  "  new create() => 0\n"
+  "primitive None\n"
+  "primitive Bool\n"
+  "class val String\n"
+  "  new create(len: USize = 0) => None\n"
+  "  fun size(): USize => 0\n"
+  "  fun add(that: String box): String => recover String.create() end\n"
+  "  fun iso concat(that: String box): String iso^ =>\n"
+  "    recover String.create() end\n"
+  "class Pointer[A]\n";
+
+
+class StringChainTest: public PassTest
+{
+protected:
+  virtual void SetUp()
+  {
+    PassTest::SetUp();
+    set_builtin(_builtin);
+  }
+
+  // Counts the calls in C.f to methods with the given name on receivers of
+  // the given type.
+  size_t calls(const char* type_name, const char* name)
+  {
+    ast_t* method = lookup_member("C", "f");
+    return count_calls(method, stringtab(type_name), stringtab(name));
+  }
+
+private:
+  size_t count_calls(ast_t* ast, const char* type_name, const char* name)
+  {
+    size_t count = 0;
+
+    if((ast_id(ast) == TK_FUNREF) && (ast_name(ast_childidx(ast, 1)) == name))
+    {
+      ast_t* type = ast_type(ast_child(ast));
+
+      if((type != NULL) && (ast_id(type) == TK_NOMINAL) &&
+        (ast_name(ast_childidx(type, 1)) == type_name))
+        count++;
+    }
+
+    for(ast_t* p = ast_child(ast); p != NULL; p = ast_sibling(p))
+      count += count_calls(p, type_name, name);
+
+    return count;
+  }
+};
+
+
+TEST_F(StringChainTest, ChainOfThree)
+{
+  const char* src =
+    "class C\n"
+    "  fun f(a: String, b: String, c: String): String =>\n"
+    "    a + b + c";
+
+  TEST_COMPILE(src);
+
+  ASSERT_EQ((size_t)0, calls("String", "add"));
+  ASSERT_EQ((size_t)3, calls("String", "concat"));
+  ASSERT_EQ((size_t)3, calls("String", "size"));
+}
+
+
+TEST_F(StringChainTest, ChainOfFour)
+{
+  const char* src =
+    "class C\n"
+    "  fun f(a: String, b: String): String =>\n"
+    "    a + \": \" + b + \"\\n\"";
+
+  TEST_COMPILE(src);
+
+  ASSERT_EQ((size_t)0, calls("String", "add"));
+  ASSERT_EQ((size_t)4, calls("String", "concat"));
+}
+
+
+// A box operand could be a String ref that a later operand changes, so the
+// chain is left as it is.
+TEST_F(StringChainTest, BoxOperand)
+{
+  const char* src =
+    "class C\n"
+    "  fun f(a: String, b: String box): String =>\n"
+    "    a + \": \" + b + \"\\n\"";
+
+  TEST_COMPILE(src);
+
+  ASSERT_EQ((size_t)3, calls("String", "add"));
+  ASSERT_EQ((size_t)0, calls("String", "concat"));
+}
+
+
+TEST_F(StringChainTest, RefOperand)
+{
+  const char* src =
+    "class C\n"
+    "  fun f(a: String ref, b: String, c: String): String =>\n"
+    "    a + b + c";
+
+  TEST_COMPILE(src);
+
+  ASSERT_EQ((size_t)2, calls("String", "add"));
+  ASSERT_EQ((size_t)0, calls("String", "concat"));
+}
+
+
+TEST_F(StringChainTest, SingleAdd)
+{
+  const char* src =
+    "class C\n"
+    "  fun f(a: String, b: String): String =>\n"
+    "    a + b";
+
+  TEST_COMPILE(src);
+
+  ASSERT_EQ((size_t)1, calls("String", "add"));
+  ASSERT_EQ((size_t)0, calls("String", "concat"));
+}
+
+
+TEST_F(StringChainTest, NotString)
+{
+  const char* src =
+    "class D\n"
+    "  fun add(that: D box): D => D\n"
+
+    "class C\n"
+    "  fun f(a: D, b: D, c: D): D =>\n"
+    "    a + b + c";
+
+  TEST_COMPILE(src);
+
+  ASSERT_EQ((size_t)2, calls("D", "add"));
+  ASSERT_EQ((size_t)0, calls("D", "concat"));
+}
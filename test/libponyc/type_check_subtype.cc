@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <platform.h>
+#include <type/intern.h>
 #include <type/subtype.h>
 #include "util.h"
 
@@ -836,3 +837,63 @@ TEST_F(SubTypeTest, IsSubTypeArrow)
 
   ASSERT_TRUE(is_subtype(type_of("val_a"), type_of("box_a"), NULL));
 }
+
+
+TEST_F(SubTypeTest, IsSubTypeMemo)
+{
+  const char* src =
+    "interface I1\n"
+    "  fun f()\n"
+
+    "interface I2\n"
+    "  fun g()\n"
+
+    "class C1\n"
+    "  fun f() => None\n"
+
+    "interface Z\n"
+    "  fun z(c1: C1, i1: I1, i2: I2)";
+
+  TEST_COMPILE(src);
+
+  typecheck_stats_t stats = {};
+  type_intern_start();
+  subtype_memo_start();
+
+  // The second time each question is asked, the answer is remembered.
+  ASSERT_TRUE(is_subtype(type_of("c1"), type_of("i1"), NULL));
+  ASSERT_FALSE(is_subtype(type_of("c1"), type_of("i2"), NULL));
+  ASSERT_TRUE(is_subtype(type_of("c1"), type_of("i1"), NULL));
+  ASSERT_FALSE(is_subtype(type_of("c1"), type_of("i2"), NULL));
+
+  subtype_memo_stop(&stats);
+  type_intern_stop();
+  ASSERT_EQ((size_t)2, stats.subtype_hits);
+  ASSERT_EQ((size_t)2, stats.subtype_misses);
+}
+
+
+TEST_F(SubTypeTest, TypeIntern)
+{
+  const char* src =
+    "class C1\n"
+
+    "interface Z\n"
+    "  fun z(a: C1, b: C1, c: C1 val, d: Array[C1], e: Array[C1])";
+
+  TEST_COMPILE(src);
+
+  // Interning is off outside the expr pass.
+  ASSERT_EQ((void*)NULL, type_intern(type_of("a")));
+
+  type_intern_start();
+
+  ast_t* a = type_intern(type_of("a"));
+  ASSERT_NE((void*)NULL, a);
+  ASSERT_EQ(a, type_intern(type_of("b")));
+  ASSERT_NE(a, type_intern(type_of("c")));
+  ASSERT_EQ(type_intern(type_of("d")), type_intern(type_of("e")));
+  ASSERT_NE(a, type_intern(type_of("d")));
+
+  type_intern_stop();
+}
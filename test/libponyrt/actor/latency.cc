@@ -0,0 +1,48 @@
+#include <platform.h>
+
+#include <actor/latency.h>
+
+#include <gtest/gtest.h>
+
+static pony_type_t type_a = {};
+static pony_type_t type_b = {};
+
+TEST(Latency, RecordsIntoLog2Buckets)
+{
+  latency_t* table = NULL;
+
+  latency_record(&table, &type_a, 0);
+  latency_record(&table, &type_a, 1);
+  latency_record(&table, &type_a, 1000);
+  latency_record(&table, &type_a, UINT64_MAX);
+  latency_record(&table, &type_b, 3);
+  ASSERT_TRUE(table != NULL);
+
+  pony_latency_t hist = {};
+  ASSERT_TRUE(latency_sum(table, &type_a, &hist));
+  ASSERT_EQ(4, hist.count);
+  ASSERT_EQ(2, hist.buckets[0]);
+  ASSERT_EQ(1, hist.buckets[9]);
+  ASSERT_EQ(1, hist.buckets[PONY_LATENCY_BUCKETS - 1]);
+
+  // Sums accumulate, so histograms from several tables can be combined.
+  ASSERT_TRUE(latency_sum(table, &type_b, &hist));
+  ASSERT_EQ(5, hist.count);
+  ASSERT_EQ(1, hist.buckets[1]);
+
+  latency_free(table);
+}
+
+TEST(Latency, UnknownTypeIsNotFound)
+{
+  latency_t* table = NULL;
+  pony_latency_t hist = {};
+
+  ASSERT_FALSE(latency_sum(table, &type_a, &hist));
+
+  latency_record(&table, &type_a, 10);
+  ASSERT_FALSE(latency_sum(table, &type_b, &hist));
+  ASSERT_EQ(0, hist.count);
+
+  latency_free(table);
+}
@@ -0,0 +1,172 @@
+#include <platform.h>
+
+#include <actor/messageq.h>
+#include <mem/pool.h>
+
+#include <gtest/gtest.h>
+
+static pony_msg_t* alloc_msg(uint32_t id)
+{
+  return pony_alloc_msg(POOL_INDEX(sizeof(pony_msg_t)), id);
+}
+
+TEST(MessageQ, PushvKeepsOrder)
+{
+  messageq_t q;
+  messageq_init(&q);
+  messageq_setcounted(&q);
+
+  pony_msg_t* a = alloc_msg(1);
+  pony_msg_t* b = alloc_msg(2);
+  pony_msg_t* c = alloc_msg(3);
+  pony_msg_t* d = alloc_msg(4);
+
+  b->next = c;
+  c->next = d;
+
+  ASSERT_TRUE(messageq_push(&q, a));
+  ASSERT_FALSE(messageq_pushv(&q, b, d, 3));
+  ASSERT_EQ(4, messageq_depth(&q));
+
+  ASSERT_EQ(a, messageq_pop(&q));
+  ASSERT_EQ(b, messageq_pop(&q));
+  ASSERT_EQ(2, messageq_depth(&q));
+  ASSERT_EQ(c, messageq_pop(&q));
+  ASSERT_EQ(d, messageq_pop(&q));
+  ASSERT_EQ(NULL, messageq_pop(&q));
+  ASSERT_EQ(0, messageq_depth(&q));
+  ASSERT_TRUE(messageq_markempty(&q));
+
+  messageq_destroy(&q);
+}
+
+TEST(MessageQ, PushvOnEmptyReportsEmpty)
+{
+  messageq_t q;
+  messageq_init(&q);
+
+  pony_msg_t* a = alloc_msg(1);
+  pony_msg_t* b = alloc_msg(2);
+  a->next = b;
+
+  ASSERT_TRUE(messageq_pushv(&q, a, b, 2));
+  ASSERT_EQ(a, messageq_pop(&q));
+  ASSERT_EQ(b, messageq_pop(&q));
+  ASSERT_TRUE(messageq_markempty(&q));
+
+  messageq_destroy(&q);
+}
+
+TEST(MessageQ, SegmentKeepsOrderAndFallsBack)
+{
+  messageq_t q;
+  messageq_init(&q);
+  messageq_setsegment(&q);
+
+  // Small messages move into the segment, a large one is pushed as it is.
+  pony_msg_t* a = alloc_msg(1);
+  pony_msg_t* b = pony_alloc_msg(POOL_INDEX(256), 2);
+  pony_msg_t* c = alloc_msg(3);
+  a->next = b;
+  b->next = c;
+
+  pony_msg_t* first = a;
+  pony_msg_t* last = c;
+  messageq_pack(&q, &first, &last);
+
+  ASSERT_NE(a, first);
+  ASSERT_EQ(b, (pony_msg_t*)first->next);
+  ASSERT_NE(c, last);
+  ASSERT_TRUE(messageq_pushv(&q, first, last, 3));
+
+  pony_msg_t* m = messageq_pop(&q);
+  ASSERT_EQ(1, m->id);
+  m = messageq_pop(&q);
+  ASSERT_EQ(b, m);
+  m = messageq_pop(&q);
+  ASSERT_EQ(3, m->id);
+  ASSERT_EQ(NULL, messageq_pop(&q));
+
+  // Slots are reused once their messages have been popped.
+  for(uint32_t i = 0; i < 100; i++)
+  {
+    first = last = alloc_msg(i);
+    messageq_pack(&q, &first, &last);
+    messageq_pushv(&q, first, last, 1);
+    ASSERT_EQ(i, messageq_pop(&q)->id);
+  }
+
+  ASSERT_TRUE(messageq_markempty(&q));
+  messageq_destroy(&q);
+}
+
+TEST(MessageQ, UncountedHasNoDepth)
+{
+  messageq_t q;
+  messageq_init(&q);
+
+  pony_msg_t* a = alloc_msg(1);
+  ASSERT_TRUE(messageq_push(&q, a));
+  ASSERT_EQ(0, messageq_depth(&q));
+
+  ASSERT_EQ(a, messageq_pop(&q));
+  ASSERT_EQ(0, messageq_depth(&q));
+  ASSERT_TRUE(messageq_markempty(&q));
+
+  messageq_destroy(&q);
+}
+
+TEST(MessageQ, NudgeTakesMarkOrDefersIt)
+{
+  messageq_t q;
+  messageq_init(&q);
+
+  // A new queue is marked empty, so the first nudge takes the mark.
+  ASSERT_TRUE(messageq_nudge(&q));
+  ASSERT_FALSE(messageq_pending(&q));
+
+  // Otherwise the next attempt to mark the queue empty fails once.
+  ASSERT_FALSE(messageq_nudge(&q));
+  ASSERT_FALSE(messageq_markempty(&q));
+  ASSERT_TRUE(messageq_markempty(&q));
+
+  // A push after a nudge still links the message.
+  ASSERT_TRUE(messageq_nudge(&q));
+  ASSERT_FALSE(messageq_nudge(&q));
+  pony_msg_t* a = alloc_msg(1);
+  ASSERT_FALSE(messageq_push(&q, a));
+  ASSERT_TRUE(messageq_pending(&q));
+  ASSERT_FALSE(messageq_nudge(&q));
+  ASSERT_FALSE(messageq_markempty(&q));
+
+  ASSERT_EQ(a, messageq_pop(&q));
+  ASSERT_FALSE(messageq_pending(&q));
+  ASSERT_FALSE(messageq_markempty(&q));
+  ASSERT_TRUE(messageq_markempty(&q));
+
+  messageq_destroy(&q);
+}
+
+TEST(MessageQ, ResetKeepsStub)
+{
+  messageq_t q;
+  messageq_init(&q);
+
+  ASSERT_TRUE(messageq_nudge(&q));
+  pony_msg_t* a = alloc_msg(1);
+  ASSERT_FALSE(messageq_push(&q, a));
+  ASSERT_EQ(a, messageq_pop(&q));
+  pony_msg_t* stub = q.tail;
+
+  // A reset queue is marked empty again, so the next push schedules.
+  messageq_reset(&q);
+  ASSERT_EQ(stub, q.tail);
+  ASSERT_FALSE(messageq_pending(&q));
+
+  pony_msg_t* b = alloc_msg(2);
+  ASSERT_TRUE(messageq_push(&q, b));
+  ASSERT_EQ(b, messageq_pop(&q));
+  ASSERT_TRUE(messageq_markempty(&q));
+
+  messageq_destroy(&q);
+}
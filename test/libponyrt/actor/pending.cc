@@ -0,0 +1,45 @@
+#include <platform.h>
+
+#include <actor/actor.h>
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+/** A coalescing message is dropped while one with the same ID is pending,
+ * but not while only other IDs are.
+ *
+ */
+TEST(ActorPending, DropsOnlyDuplicates)
+{
+  pony_actor_t actor;
+  memset(&actor, 0, sizeof(pony_actor_t));
+
+  uint32_t a = PONY_MSG_COALESCE | 1;
+  uint32_t b = PONY_MSG_COALESCE | 2;
+
+  ASSERT_TRUE(actor_setpending(&actor, a));
+  ASSERT_FALSE(actor_setpending(&actor, a));
+
+  ASSERT_TRUE(actor_setpending(&actor, b));
+  ASSERT_FALSE(actor_setpending(&actor, b));
+  ASSERT_FALSE(actor_setpending(&actor, a));
+}
+
+/** Messages without the bit, and IDs too large for a pending bit of their
+ * own, are always sent.
+ *
+ */
+TEST(ActorPending, SendsOthers)
+{
+  pony_actor_t actor;
+  memset(&actor, 0, sizeof(pony_actor_t));
+
+  ASSERT_TRUE(actor_setpending(&actor, 1));
+  ASSERT_TRUE(actor_setpending(&actor, 1));
+
+  // 33 would share a bit with 1.
+  ASSERT_TRUE(actor_setpending(&actor, PONY_MSG_COALESCE | 1));
+  ASSERT_TRUE(actor_setpending(&actor, PONY_MSG_COALESCE | 33));
+  ASSERT_TRUE(actor_setpending(&actor, PONY_MSG_COALESCE | 33));
+}
@@ -0,0 +1,31 @@
+#include <platform.h>
+
+#include <actor/actor.h>
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+/** An actor under pressure is overloaded whatever its mailbox holds, and
+ * senders muted on it are only released once the pressure is off.
+ *
+ */
+TEST(ActorPressure, OverloadsUntilReleased)
+{
+  pony_actor_t actor;
+  memset(&actor, 0, sizeof(pony_actor_t));
+  messageq_init(&actor.q);
+
+  ASSERT_FALSE(actor_overloaded(&actor));
+  ASSERT_TRUE(actor_drained(&actor));
+
+  pony_setpressure(&actor, true);
+  ASSERT_TRUE(actor_overloaded(&actor));
+  ASSERT_FALSE(actor_drained(&actor));
+
+  pony_setpressure(&actor, false);
+  ASSERT_FALSE(actor_overloaded(&actor));
+  ASSERT_TRUE(actor_drained(&actor));
+
+  messageq_destroy(&actor.q);
+}
@@ -0,0 +1,90 @@
+#include <platform.h>
+
+#include <actor/profile.h>
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char* names_a[] = {"A.ping", "A.pong"};
+
+static pony_type_t type_a =
+{
+  1, 0, 0, 0, 0, NULL, NULL, NULL, NULL, NULL, 0, 0, NULL, NULL, "A", names_a,
+  2, NULL
+};
+static pony_type_t type_b =
+{
+  2, 0, 0, 0, 0, NULL, NULL, NULL, NULL, NULL, 0, 0, NULL, NULL, NULL, NULL, 0,
+  NULL
+};
+
+class ProfileTest: public testing::Test
+{
+protected:
+  virtual void TearDown()
+  {
+    // Turn the profile off first, so that stopping doesn't write it.
+    profile_setcount(0);
+    profile_stop();
+  }
+
+  static void lines(char out[][128], size_t count)
+  {
+    FILE* fp = tmpfile();
+    ASSERT_TRUE(profile_dump(fp, 0));
+    rewind(fp);
+
+    for(size_t i = 0; i < count; i++)
+    {
+      if(fgets(out[i], 128, fp) == NULL)
+        out[i][0] = '\0';
+    }
+
+    fclose(fp);
+  }
+};
+
+TEST_F(ProfileTest, OffByDefault)
+{
+  ASSERT_EQ(NULL, profile_create());
+  ASSERT_FALSE(profile_dump(stderr, 0));
+}
+
+TEST_F(ProfileTest, SumsSchedulersMostTimeFirst)
+{
+  profile_setcount(10);
+  profile_t* one = profile_create();
+  profile_t* two = profile_create();
+  ASSERT_TRUE(one != NULL);
+  ASSERT_TRUE(two != NULL);
+
+  profile_record(one, &type_a, 0, 100);
+  profile_record(one, &type_a, 1, 400);
+  profile_record(two, &type_a, 0, 600);
+  profile_record(two, &type_b, 3, 50);
+
+  // A header, the column names, then A.ping (700), A.pong (400) and the
+  // unnamed behaviour (50).
+  char out[6][128];
+  lines(out, 6);
+
+  ASSERT_TRUE(strstr(out[0], "3 of 3 behaviours") != NULL);
+  ASSERT_TRUE(strstr(out[2], "A.ping") != NULL);
+  ASSERT_TRUE(strstr(out[2], " 2 ") != NULL);
+  ASSERT_TRUE(strstr(out[3], "A.pong") != NULL);
+  ASSERT_TRUE(strstr(out[4], "type 2 (message 3)") != NULL);
+  ASSERT_EQ('\0', out[5][0]);
+}
+
+TEST_F(ProfileTest, UnknownMessageUsesTypeName)
+{
+  profile_setcount(10);
+  profile_t* prof = profile_create();
+
+  profile_record(prof, &type_a, 7, 10);
+
+  char out[3][128];
+  lines(out, 3);
+  ASSERT_TRUE(strstr(out[2], "A (message 7)") != NULL);
+}
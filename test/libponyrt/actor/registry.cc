@@ -0,0 +1,67 @@
+#include <platform.h>
+
+#include <actor/actor.h>
+#include <actor/registry.h>
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+static pony_type_t type_a =
+{
+  1, 0, 0, 0, 0, NULL, NULL, NULL, NULL, NULL, 0, 0, NULL, NULL, NULL, NULL, 0,
+  NULL
+};
+static pony_type_t type_b =
+{
+  2, 0, 0, 0, 0, NULL, NULL, NULL, NULL, NULL, 0, 0, NULL, NULL, NULL, NULL, 0,
+  NULL
+};
+
+static void make(pony_actor_t* actor, pony_type_t* type, size_t used)
+{
+  memset(actor, 0, sizeof(pony_actor_t));
+  actor->type = type;
+  messageq_init(&actor->q);
+  actor->heap.used = used;
+  registry_add(actor);
+}
+
+TEST(Registry, TopActorsAndTypes)
+{
+  pony_actor_t actors[4];
+  make(&actors[0], &type_a, 100);
+  make(&actors[1], &type_b, 400);
+  make(&actors[2], &type_a, 300);
+  make(&actors[3], &type_a, 200);
+
+  // The largest come first, and only as many as asked for.
+  pony_actor_memory_t top[3];
+  ASSERT_EQ((size_t)3, pony_actor_memory(top, 3, false));
+  ASSERT_EQ(&actors[1], top[0].actor);
+  ASSERT_EQ(&actors[2], top[1].actor);
+  ASSERT_EQ(&actors[3], top[2].actor);
+  ASSERT_EQ((uint32_t)1, top[1].type_id);
+
+  pony_actor_memory_t one;
+  ASSERT_TRUE(pony_actor_memory_rank(3, false, &one));
+  ASSERT_EQ(&actors[0], one.actor);
+  ASSERT_FALSE(pony_actor_memory_rank(4, false, &one));
+
+  // Type a has three actors with more heap between them than type b.
+  pony_type_memory_t types[4];
+  ASSERT_EQ((size_t)2, pony_type_memory(types, 4));
+  ASSERT_EQ((uint32_t)1, types[0].type_id);
+  ASSERT_EQ((size_t)3, types[0].actors);
+  ASSERT_EQ((size_t)600, types[0].heap_used);
+  ASSERT_EQ((uint32_t)2, types[1].type_id);
+
+  // Removed actors are no longer listed.
+  for(int i = 0; i < 4; i++)
+  {
+    registry_remove(&actors[i]);
+    messageq_destroy(&actors[i].q);
+  }
+
+  ASSERT_EQ((size_t)0, pony_actor_memory(top, 3, false));
+}
@@ -2,6 +2,7 @@
 #include <gtest/gtest.h>
 
 #include <ds/fun.h>
+#include <string.h>
 
 /** Hashing the same integer returns the same key.
  *
@@ -29,6 +30,43 @@ TEST(DsFunTest, HashSameStringGivesSameKey)
   ASSERT_EQ(key1, key2);
 }
 
+/** The fast hash gives the same key for the same bytes, wherever they are.
+ *
+ */
+TEST(DsFunTest, HashFastSameBlockGivesSameKey)
+{
+  char a[80];
+  char b[81];
+
+  for(size_t i = 0; i < sizeof(a); i++)
+    a[i] = b[i + 1] = (char)(i * 7);
+
+  for(size_t len = 0; len <= sizeof(a); len++)
+    ASSERT_EQ(hash_block_fast(a, len), hash_block_fast(&b[1], len));
+}
+
+/** Every length, and a change to any byte, gives a different fast hash.
+ *
+ */
+TEST(DsFunTest, HashFastDiffersByLengthAndContent)
+{
+  char a[80];
+  memset(a, 'x', sizeof(a));
+
+  for(size_t len = 1; len <= sizeof(a); len++)
+  {
+    uint64_t key = hash_block_fast(a, len);
+    ASSERT_NE(key, hash_block_fast(a, len - 1));
+
+    for(size_t i = 0; i < len; i++)
+    {
+      a[i] = 'y';
+      ASSERT_NE(key, hash_block_fast(a, len));
+      a[i] = 'x';
+    }
+  }
+}
+
 /** Hashing the same pointer returns the same key.
  *
  */
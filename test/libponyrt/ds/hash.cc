@@ -276,3 +276,36 @@ TEST_F(HashMapTest, RemoveByIndex)
   ASSERT_EQ(n, p);
   ASSERT_EQ(NULL, testmap_get(&_map, p));
 }
+
+/** Lookups probe past removed elements, and find the same elements
+ *  as the out of line lookup.
+ */
+TEST_F(HashMapTest, GetPastRemoved)
+{
+  put_elements(100);
+
+  elem_t key;
+
+  for(size_t i = 0; i < 100; i += 2)
+  {
+    key.key = i;
+    elem_t* n = testmap_remove(&_map, &key);
+    ASSERT_NE((elem_t*)NULL, n);
+    free(n);
+  }
+
+  for(size_t i = 0; i < 100; i++)
+  {
+    key.key = i;
+    elem_t* n = testmap_get(&_map, &key);
+    elem_t* m = (elem_t*)hashmap_get((hashmap_t*)&_map, &key,
+      (hash_fn)HashMapTest::hash_tst, (cmp_fn)HashMapTest::cmp_tst);
+
+    ASSERT_EQ(n, m);
+
+    if((i & 1) == 0)
+      ASSERT_EQ(NULL, n);
+    else
+      ASSERT_EQ(i, n->key);
+  }
+}
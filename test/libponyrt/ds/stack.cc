@@ -0,0 +1,55 @@
+#include <platform.h>
+#include <gtest/gtest.h>
+
+#include <ds/stack.h>
+
+typedef struct elem_t elem_t;
+
+DECLARE_STACK(teststack, elem_t);
+DEFINE_STACK(teststack, elem_t);
+
+struct elem_t
+{
+  size_t val;
+};
+
+TEST(Stack, PushPopAcrossChunks)
+{
+  elem_t e[(STACK_COUNT * 2) + 1];
+  teststack_t* s = NULL;
+
+  for(size_t i = 0; i < (sizeof(e) / sizeof(elem_t)); i++)
+    s = teststack_push(s, &e[i]);
+
+  for(size_t i = sizeof(e) / sizeof(elem_t); i > 0; i--)
+  {
+    elem_t* p;
+    s = teststack_pop(s, &p);
+    ASSERT_EQ(&e[i - 1], p);
+  }
+
+  ASSERT_EQ(NULL, s);
+}
+
+TEST(Stack, Peek)
+{
+  elem_t e[STACK_COUNT + 2];
+  teststack_t* s = NULL;
+
+  ASSERT_EQ(NULL, teststack_peek(s, 0));
+
+  for(size_t i = 0; i < (sizeof(e) / sizeof(elem_t)); i++)
+    s = teststack_push(s, &e[i]);
+
+  // The top two entries are on a chunk of their own.
+  ASSERT_EQ(&e[STACK_COUNT + 1], teststack_peek(s, 0));
+  ASSERT_EQ(&e[STACK_COUNT], teststack_peek(s, 1));
+  ASSERT_EQ(&e[STACK_COUNT - 1], teststack_peek(s, 2));
+  ASSERT_EQ(&e[0], teststack_peek(s, STACK_COUNT + 1));
+  ASSERT_EQ(NULL, teststack_peek(s, STACK_COUNT + 2));
+
+  elem_t* p;
+
+  while(s != NULL)
+    s = teststack_pop(s, &p);
+}
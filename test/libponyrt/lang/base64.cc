@@ -0,0 +1,57 @@
+#include <platform.h>
+#include <gtest/gtest.h>
+
+#include <lang/base64.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/** Encoding matches the RFC 4648 test vectors, and leaves a partial group
+ * alone.
+ *
+ */
+TEST(LangBase64Test, EncodeVectors)
+{
+  char out[16];
+
+  ASSERT_EQ((size_t)8, pony_base64_encode(out, (const uint8_t*)"foobar", 6,
+    '+', '/'));
+  ASSERT_EQ(0, memcmp(out, "Zm9vYmFy", 8));
+
+  ASSERT_EQ((size_t)4, pony_base64_encode(out, (const uint8_t*)"fooba", 5,
+    '+', '/'));
+  ASSERT_EQ(0, memcmp(out, "Zm9v", 4));
+
+  const uint8_t high[3] = {0xFB, 0xFF, 0xBF};
+  ASSERT_EQ((size_t)4, pony_base64_encode(out, high, 3, '-', '_'));
+  ASSERT_EQ(0, memcmp(out, "-_-_", 4));
+}
+
+/** Random data of every length up to a few blocks survives a round trip, and
+ * decoding stops at the first group that isn't base64.
+ *
+ */
+TEST(LangBase64Test, RoundTrip)
+{
+  uint8_t data[200];
+  char text[300];
+  uint8_t back[200];
+  srand(11);
+
+  for(size_t i = 0; i < sizeof(data); i++)
+    data[i] = (uint8_t)rand();
+
+  for(size_t len = 0; len <= sizeof(data); len += 3)
+  {
+    size_t n = pony_base64_encode(text, data, len, '+', '/');
+    ASSERT_EQ(len / 3 * 4, n);
+    ASSERT_EQ(len, pony_base64_decode(back, sizeof(back), text, n, '+', '/'));
+    ASSERT_EQ(0, memcmp(data, back, len));
+  }
+
+  size_t n = pony_base64_encode(text, data, 150, '+', '/');
+  text[70] = '\n';
+  ASSERT_EQ((size_t)51, pony_base64_decode(back, sizeof(back), text, n, '+',
+    '/'));
+  ASSERT_EQ((size_t)30, pony_base64_decode(back, 32, text, n, '+', '/'));
+}
@@ -0,0 +1,41 @@
+#include <platform.h>
+#include <gtest/gtest.h>
+
+#include <lang/clock.h>
+
+#include <string.h>
+
+/** The coarse clock is set once it has been initialised, and doesn't go
+ * backwards when it is refreshed.
+ *
+ */
+TEST(LangClockTest, CoarseClockIsMonotonic)
+{
+  os_clock_init();
+
+  uint64_t first = os_coarse_nanos();
+  ASSERT_NE((uint64_t)0, first);
+  ASSERT_LE(first, os_clock_nanos());
+
+  // A tick count far enough on forces a refresh.
+  uint64_t tsc = os_clock_update(UINT64_MAX / 2, 0);
+  ASSERT_EQ(UINT64_MAX / 2, tsc);
+  ASSERT_LE(first, os_coarse_nanos());
+
+  // One that isn't leaves the clock and the tick alone.
+  ASSERT_EQ(tsc, os_clock_update(tsc + 1, tsc));
+}
+
+/** The HTTP date is formatted as an IMF-fixdate.
+ *
+ */
+TEST(LangClockTest, HttpDateIsFixdate)
+{
+  os_clock_init();
+
+  const char* date = os_http_date();
+  ASSERT_EQ((size_t)29, strlen(date));
+  ASSERT_EQ(',', date[3]);
+  ASSERT_EQ(0, strcmp(date + 25, " GMT"));
+  ASSERT_NE(0, os_coarse_seconds());
+}
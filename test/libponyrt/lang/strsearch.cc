@@ -0,0 +1,92 @@
+#include <platform.h>
+#include <gtest/gtest.h>
+
+#include <lang/strsearch.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static size_t naive_find(const char* s, size_t len, const char* sub,
+  size_t sublen)
+{
+  if((sublen == 0) || (sublen > len))
+    return (size_t)-1;
+
+  for(size_t i = 0; i + sublen <= len; i++)
+  {
+    if(memcmp(s + i, sub, sublen) == 0)
+      return i;
+  }
+
+  return (size_t)-1;
+}
+
+static size_t naive_delim(const char* s, size_t len, const char* delim,
+  size_t count)
+{
+  for(size_t i = 0; i < len; i++)
+  {
+    if(memchr(delim, s[i], count) != NULL)
+      return i;
+  }
+
+  return len;
+}
+
+/** Matches are found at block boundaries and in the bytes left after the last
+ * whole block, and a match can't run past the end.
+ *
+ */
+TEST(LangStrSearchTest, FindAtEveryPosition)
+{
+  char s[100];
+  memset(s, 'a', sizeof(s));
+
+  for(size_t i = 0; i + 3 <= sizeof(s); i++)
+  {
+    memcpy(s + i, "xyz", 3);
+    ASSERT_EQ(i, pony_memfind(s, sizeof(s), "xyz", 3));
+    memset(s + i, 'a', 3);
+  }
+
+  memcpy(s + sizeof(s) - 2, "xy", 2);
+  ASSERT_EQ((size_t)-1, pony_memfind(s, sizeof(s), "xyz", 3));
+  ASSERT_EQ((size_t)-1, pony_memfind(s, sizeof(s), "", 0));
+  ASSERT_EQ((size_t)-1, pony_memfind(s, 2, "aaa", 3));
+  ASSERT_EQ((size_t)98, pony_memfind(s, sizeof(s), "x", 1));
+}
+
+/** Random text over a small alphabet, so partial matches are common, gives the
+ * same answers as a naive search.
+ *
+ */
+TEST(LangStrSearchTest, MatchesNaiveSearch)
+{
+  char s[300];
+  char sub[8];
+  srand(7);
+
+  for(int round = 0; round < 2000; round++)
+  {
+    size_t len = (size_t)rand() % sizeof(s);
+    size_t sublen = 1 + (size_t)rand() % sizeof(sub);
+
+    for(size_t i = 0; i < len; i++)
+      s[i] = (char)('a' + rand() % 3);
+
+    for(size_t i = 0; i < sublen; i++)
+      sub[i] = (char)('a' + rand() % 3);
+
+    ASSERT_EQ(naive_find(s, len, sub, sublen),
+      pony_memfind(s, len, sub, sublen));
+
+    size_t count = (size_t)rand() % 20;
+    char delim[20];
+
+    for(size_t i = 0; i < count; i++)
+      delim[i] = (char)('c' + rand() % 20);
+
+    ASSERT_EQ(naive_delim(s, len, delim, count),
+      pony_memdelim(s, len, delim, count));
+  }
+}
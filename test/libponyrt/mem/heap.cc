@@ -3,8 +3,11 @@
 #include <mem/heap.h>
 #include <mem/pool.h>
 #include <mem/pagemap.h>
+#include <mem/heapprof.h>
 
 #include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
 
 TEST(Heap, Init)
 {
@@ -27,7 +30,7 @@ TEST(Heap, Init)
   ASSERT_EQ((size_t)256, heap.used);
 
   heap.next_gc = 0;
-  heap_startgc(&heap);
+  heap_startgc(&heap, false);
   heap_mark(chunk, p);
   heap_endgc(&heap);
   ASSERT_EQ((size_t)128, heap.used);
@@ -39,7 +42,7 @@ TEST(Heap, Init)
   ASSERT_EQ((size_t)1280, heap.used);
 
   heap.next_gc = 0;
-  heap_startgc(&heap);
+  heap_startgc(&heap, false);
   heap_mark_shallow(chunk, p3);
   heap_endgc(&heap);
   ASSERT_EQ((size_t)128, heap.used);
@@ -59,10 +62,363 @@ TEST(Heap, Init)
   ASSERT_EQ(256 + adjust_size, heap.used);
 
   heap.next_gc = 0;
-  heap_startgc(&heap);
+  heap_startgc(&heap, false);
   heap_mark_shallow(chunk5, p5);
   heap_endgc(&heap);
   ASSERT_EQ(adjust_size, heap.used);
 
   heap_destroy(&heap);
 }
+
+TEST(Heap, Medium)
+{
+  pony_actor_t* actor = (pony_actor_t*)0xDEADBEEF;
+
+  heap_t heap;
+  heap_init(&heap);
+
+  void* p = heap_alloc(actor, &heap, 600);
+  ASSERT_EQ((size_t)1024, heap.used);
+
+  chunk_t* chunk = (chunk_t*)pagemap_get(p);
+  ASSERT_EQ(actor, heap_owner(chunk));
+  ASSERT_EQ((size_t)1024, heap_size(chunk));
+
+  // Objects in the same slab share a chunk.
+  void* p2 = heap_alloc(actor, &heap, 1000);
+  ASSERT_EQ(chunk, pagemap_get(p2));
+  ASSERT_EQ((char*)p + 1024, p2);
+  ASSERT_EQ((size_t)2048, heap.used);
+
+  // Every address inside an object maps to its chunk.
+  void* p3 = heap_alloc(actor, &heap, 5000);
+  chunk_t* chunk3 = (chunk_t*)pagemap_get(p3);
+  ASSERT_EQ((size_t)8192, heap_size(chunk3));
+  ASSERT_EQ(chunk3, pagemap_get((char*)p3 + 8191));
+  ASSERT_EQ((size_t)(2048 + 8192), heap.used);
+
+  // Growing within the size class keeps the object where it is.
+  ASSERT_EQ(p3, heap_realloc(actor, &heap, p3, 8192));
+
+  heap.next_gc = 0;
+  heap_startgc(&heap, false);
+  heap_mark(chunk, p2);
+  heap_mark_shallow(chunk3, (char*)p3 + 100);
+  heap_endgc(&heap);
+  ASSERT_EQ((size_t)(1024 + 8192), heap.used);
+
+  // The unmarked slot is reused.
+  void* p4 = heap_alloc(actor, &heap, 700);
+  ASSERT_EQ(p, p4);
+
+  heap_destroy(&heap);
+}
+
+TEST(Heap, IncrementalSweep)
+{
+  pony_actor_t* actor = (pony_actor_t*)0xDEADBEEF;
+
+  heap_t heap;
+  heap_init(&heap);
+
+  // Fill a few hundred chunks, keeping the first object alive.
+  void* p = heap_alloc(actor, &heap, 32);
+  chunk_t* chunk = (chunk_t*)pagemap_get(p);
+
+  for(int i = 1; i < 32 * 256; i++)
+    heap_alloc(actor, &heap, 32);
+
+  // A one cycle slice stops the sweep at the first check of the clock.
+  heap_setgcslice(1);
+  heap.next_gc = 0;
+  ASSERT_TRUE(heap_startgc(&heap, false));
+  heap_mark(chunk, p);
+  heap_endgc(&heap);
+  ASSERT_TRUE(heap_sweeping(&heap));
+
+  // The heap can be used while the sweep is in progress.
+  void* p2 = heap_alloc(actor, &heap, 32);
+  ASSERT_NE(p, p2);
+
+  heap_sweep(&heap, true);
+  ASSERT_FALSE(heap_sweeping(&heap));
+  ASSERT_EQ((size_t)64, heap.used);
+
+  heap_setgcslice(0);
+  heap_destroy(&heap);
+}
+
+TEST(Heap, Policy)
+{
+  pony_actor_t* actor = (pony_actor_t*)0xDEADBEEF;
+
+  heap_t heap;
+  heap_init(&heap);
+
+  heap_setpolicy(&heap, 1 << 20, 4.0);
+  ASSERT_EQ((size_t)1 << 20, heap.next_gc);
+
+  heap_alloc(actor, &heap, 1 << 21);
+  ASSERT_TRUE(heap_startgc(&heap, false));
+  heap_used(&heap, 1 << 20);
+  heap_endgc(&heap);
+  ASSERT_EQ((size_t)1 << 22, heap.next_gc);
+
+  // A pass that takes half the time since the last one stretches the factor.
+  heap_setgcpace(0.1);
+  heap_pace(&heap, 10, 1000);
+  ASSERT_EQ((size_t)1 << 22, heap.next_gc);
+  heap_pace(&heap, 500, 2000);
+  ASSERT_EQ((size_t)1 << 23, heap.next_gc);
+
+  // A cheap one brings it back.
+  heap_pace(&heap, 1, 100000);
+  ASSERT_EQ((size_t)1 << 22, heap.next_gc);
+
+  // A cap holds the heap below what the factor would allow, but not below
+  // the initial threshold.
+  heap_setgcmax(3 << 20);
+  heap_setpolicy(&heap, 0, 0.0);
+  ASSERT_EQ((size_t)3 << 20, heap.next_gc);
+  heap_setgcmax(1 << 10);
+  heap_setpolicy(&heap, 0, 0.0);
+  ASSERT_EQ((size_t)1 << 20, heap.next_gc);
+
+  heap_setgcmax(0);
+  heap_setgcpace(0.0);
+  heap_destroy(&heap);
+}
+
+TEST(Heap, Bump)
+{
+  pony_actor_t* actor = (pony_actor_t*)0xDEADBEEF;
+
+  heap_t heap;
+  heap_init(&heap);
+
+  // A new chunk is handed out in address order.
+  char* p = (char*)heap_alloc(actor, &heap, 32);
+  chunk_t* chunk = (chunk_t*)pagemap_get(p);
+
+  for(size_t i = 1; i < 32; i++)
+    ASSERT_EQ(p + (i * 32), heap_alloc(actor, &heap, 32));
+
+  ASSERT_EQ((size_t)1024, heap.used);
+
+  // The next object comes from a new chunk.
+  void* q = heap_alloc(actor, &heap, 32);
+  ASSERT_NE(chunk, pagemap_get(q));
+
+  // Marking rebuilds the slot bits, and freed slots are reused.
+  heap.next_gc = 0;
+  heap_startgc(&heap, false);
+  heap_mark(chunk, p);
+  heap_mark(chunk, p + 64);
+  heap_endgc(&heap);
+  ASSERT_EQ((size_t)64, heap.used);
+
+  ASSERT_EQ(p + 32, heap_alloc(actor, &heap, 32));
+  ASSERT_EQ(p + 96, heap_alloc(actor, &heap, 32));
+
+  heap_destroy(&heap);
+}
+
+TEST(Heap, Frozen)
+{
+  // Frozen memory has no owner, and small allocations are packed together.
+  char* p = (char*)heap_alloc_frozen(20);
+  chunk_t* chunk = (chunk_t*)pagemap_get(p);
+  ASSERT_TRUE(chunk != NULL);
+  ASSERT_EQ(NULL, heap_owner(chunk));
+
+  char* q = (char*)heap_alloc_frozen(64);
+  ASSERT_EQ(p + 32, q);
+  ASSERT_EQ(chunk, pagemap_get(q));
+
+  // Large allocations get memory of their own.
+  size_t large_size = HEAP_SLAB;
+  char* r = (char*)heap_alloc_frozen(large_size);
+  ASSERT_EQ(chunk, pagemap_get(r));
+  ASSERT_EQ(chunk, pagemap_get(r + large_size - 1));
+  memset(r, 0xAA, large_size);
+}
+
+TEST(Heap, Nursery)
+{
+  pony_actor_t* actor = (pony_actor_t*)0xDEADBEEF;
+
+  heap_setnursery(10);
+
+  heap_t heap;
+  heap_init(&heap);
+  ASSERT_EQ((size_t)1024, heap.next_minor);
+
+  // A minor pass isn't due until the nursery is used up.
+  char* a = (char*)heap_alloc(actor, &heap, 32);
+  char* b = (char*)heap_alloc(actor, &heap, 32);
+  ASSERT_FALSE(heap_startminor(&heap));
+
+  char* large = (char*)heap_alloc(actor, &heap, HEAP_MEDIUMMAX + 1);
+  chunk_t* chunk = (chunk_t*)pagemap_get(a);
+  chunk_t* large_chunk = (chunk_t*)pagemap_get(large);
+  ASSERT_TRUE(heap_isyoung(chunk, a));
+  ASSERT_TRUE(heap_isyoung(large_chunk, large));
+
+  // Objects that survive a full pass are old.
+  heap.next_gc = 0;
+  heap_startgc(&heap, false);
+  heap_mark(chunk, a);
+  heap_mark(large_chunk, large);
+  heap_endgc(&heap);
+  ASSERT_FALSE(heap_isyoung(chunk, a));
+  ASSERT_FALSE(heap_isyoung(large_chunk, large));
+  ASSERT_EQ(heap.used + 1024, heap.next_minor);
+
+  // Memory freed by the pass is young when it is used again.
+  ASSERT_EQ(b, heap_alloc(actor, &heap, 32));
+  ASSERT_TRUE(heap_isyoung(chunk, b));
+
+  // An old object is only remembered once between passes.
+  ASSERT_TRUE(heap_remember(chunk, a));
+  ASSERT_FALSE(heap_remember(chunk, a));
+
+  // A minor pass keeps old objects without marking them, and leaves the full
+  // gc point where it was.
+  size_t next_gc = heap.next_gc;
+  heap.next_minor = 0;
+  ASSERT_TRUE(heap_startminor(&heap));
+  ASSERT_TRUE(heap_ismarked(chunk, a));
+  ASSERT_FALSE(heap_ismarked(chunk, b));
+  heap_endgc(&heap);
+  ASSERT_EQ(next_gc, heap.next_gc);
+  ASSERT_EQ(32 + heap_size(large_chunk), heap.used);
+  ASSERT_TRUE(heap_remember(chunk, a));
+
+  // The young object was freed.
+  ASSERT_EQ(b, heap_alloc(actor, &heap, 32));
+
+  heap_destroy(&heap);
+  heap_setnursery(0);
+}
+
+static void profile_header(char* buf, size_t len)
+{
+  FILE* fp = tmpfile();
+  ASSERT_TRUE(heapprof_dump(fp));
+  rewind(fp);
+  ASSERT_TRUE(fgets(buf, (int)len, fp) != NULL);
+  fclose(fp);
+}
+
+TEST(Heap, Profile)
+{
+  pony_actor_t* actor = (pony_actor_t*)0xDEADBEEF;
+  char buf[256];
+
+  heap_t heap;
+  heap_init(&heap);
+
+  ASSERT_EQ(SIZE_MAX, heapprof_sample(&heap, NULL, 0));
+  ASSERT_FALSE(heapprof_dump(stdout));
+
+  heapprof_setrate(4096);
+
+  void* p = heap_alloc(actor, &heap, 64);
+  void* p2 = heap_alloc(actor, &heap, 128);
+  ASSERT_EQ((size_t)4096, heapprof_sample(&heap, p, 64));
+  ASSERT_EQ((size_t)4096, heapprof_sample(&heap, p2, 128));
+
+  profile_header(buf, sizeof(buf));
+  ASSERT_STREQ("heap profile: 2: 192 [2: 192] @ heap_v2/4096\n", buf);
+
+  // A gc pass drops the samples of objects it didn't mark.
+  heap.next_gc = 0;
+  heap_startgc(&heap, false);
+  heap_mark((chunk_t*)pagemap_get(p), p);
+  heapprof_sweep(&heap);
+  heap_endgc(&heap);
+
+  profile_header(buf, sizeof(buf));
+  ASSERT_STREQ("heap profile: 1: 64 [2: 192] @ heap_v2/4096\n", buf);
+
+  heap_destroy(&heap);
+
+  profile_header(buf, sizeof(buf));
+  ASSERT_STREQ("heap profile: 0: 0 [2: 192] @ heap_v2/4096\n", buf);
+
+  heapprof_setrate(0);
+}
+
+TEST(Heap, DenseFirst)
+{
+  pony_actor_t* actor = (pony_actor_t*)0xDEADBEEF;
+
+  heap_t heap;
+  heap_init(&heap);
+
+  char* a[32];
+  char* b[32];
+
+  for(int i = 0; i < 32; i++)
+    a[i] = (char*)heap_alloc(actor, &heap, 32);
+
+  for(int i = 0; i < 32; i++)
+    b[i] = (char*)heap_alloc(actor, &heap, 32);
+
+  // Keep most of the first chunk and one object in the second.
+  heap.next_gc = 0;
+  heap_startgc(&heap, false);
+  heap_mark((chunk_t*)pagemap_get(b[0]), b[0]);
+
+  for(int i = 0; i < 30; i++)
+    heap_mark((chunk_t*)pagemap_get(a[i]), a[i]);
+
+  heap_endgc(&heap);
+
+  // The fuller chunk is allocated from first.
+  ASSERT_EQ(a[30], heap_alloc(actor, &heap, 32));
+  ASSERT_EQ(a[31], heap_alloc(actor, &heap, 32));
+  ASSERT_EQ(b[1], heap_alloc(actor, &heap, 32));
+
+  heap_destroy(&heap);
+}
+
+TEST(Heap, Live)
+{
+  pony_actor_t* actor = (pony_actor_t*)0xDEADBEEF;
+
+  heap_t heap;
+  heap_init(&heap);
+
+  char* p = (char*)heap_alloc(actor, &heap, 100);
+  char* p2 = (char*)heap_alloc(actor, &heap, 100);
+  char* p3 = (char*)heap_alloc(actor, &heap, 100);
+  size_t large_size = (1 << 15) - 7;
+  char* p4 = (char*)heap_alloc(actor, &heap, large_size);
+  chunk_t* chunk = (chunk_t*)pagemap_get(p);
+  chunk_t* chunk4 = (chunk_t*)pagemap_get(p4);
+
+  ASSERT_EQ(p, heap_base(chunk, p + 40));
+  ASSERT_EQ(p4, heap_base(chunk4, p4 + 1000));
+
+  // A forced pass starts even though none is due.
+  heap.next_gc = heap.used;
+  ASSERT_FALSE(heap_startgc(&heap, false));
+  ASSERT_TRUE(heap_startgc(&heap, true));
+
+  // Both kinds of mark count as live.
+  heap_mark(chunk, p);
+  heap_mark_shallow(chunk, p3 + 8);
+  heap_mark_shallow(chunk4, p4);
+
+  size_t count;
+  size_t bytes;
+  heap_live(&heap, &count, &bytes);
+  ASSERT_EQ((size_t)3, count);
+  ASSERT_EQ(256 + pool_adjust_size(large_size), bytes);
+
+  heap_endgc(&heap);
+  ASSERT_EQ(p2, heap_alloc(actor, &heap, 100));
+
+  heap_destroy(&heap);
+}
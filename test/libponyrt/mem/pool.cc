@@ -4,6 +4,8 @@
 
 #include <gtest/gtest.h>
 
+#include <string.h>
+
 typedef char block_t[32];
 
 TEST(Pool, Fifo)
@@ -70,3 +72,121 @@ TEST(Pool, LargeAlloc)
   ASSERT_TRUE(p != NULL);
   pool_free_size(1 << 20, p);
 }
+
+TEST(Pool, LocalBytes)
+{
+  void* p = POOL_ALLOC(block_t);
+  size_t before = pool_local_bytes();
+
+  POOL_FREE(block_t, p);
+  ASSERT_EQ(before + sizeof(block_t), pool_local_bytes());
+}
+
+TEST(Pool, LargeCache)
+{
+  size_t size = 1 << 20;
+  void* p = pool_alloc_size(size);
+  void* q = pool_alloc_size(size);
+  void* r = pool_alloc_size(size);
+  size_t before = pool_local_bytes();
+
+  // Large items stay on this thread, and are handed back most recent first.
+  pool_free_size(size, p);
+  pool_free_size(size, q);
+  pool_free_size(size, r);
+  ASSERT_EQ(before + (3 * size), pool_local_bytes());
+
+  ASSERT_EQ(r, pool_alloc_size(size));
+  ASSERT_EQ(q, pool_alloc_size(size));
+  ASSERT_EQ(p, pool_alloc_size(size));
+
+  pool_free_size(size, r);
+  pool_free_size(size, q);
+  pool_free_size(size, p);
+}
+
+TEST(Pool, FreeBlockReuse)
+{
+  size_t small = (1 << 20) + (3 << 10);
+  size_t large = (3 << 20) + (5 << 10);
+
+  void* p = pool_alloc_size(small);
+  void* q = pool_alloc_size(large);
+  void* r = pool_alloc_size(small);
+  pool_free_size(small, p);
+  pool_free_size(large, q);
+
+  // Each size is served from the free block of that size.
+  ASSERT_EQ(q, pool_alloc_size(large));
+  ASSERT_EQ(p, pool_alloc_size(small));
+
+  pool_free_size(small, r);
+  pool_free_size(large, q);
+  pool_free_size(small, p);
+}
+
+TEST(Pool, GrowInPlace)
+{
+  size_t size = (2 << 20) + (6 << 10);
+  char* p = (char*)pool_alloc_size(2 * size);
+
+  // Free the second half, then grow the first half into it in two steps.
+  pool_free_size(size, p + size);
+  size_t before = pool_local_bytes();
+
+  ASSERT_EQ(p, pool_grow_size(size, size + (size / 2), p));
+  ASSERT_EQ(before - (size / 2), pool_local_bytes());
+
+  ASSERT_EQ(p, pool_grow_size(size + (size / 2), 2 * size, p));
+  ASSERT_EQ(before - size, pool_local_bytes());
+  memset(p, 1, 2 * size);
+
+  pool_free_size(2 * size, p);
+}
+
+TEST(Pool, Scavenge)
+{
+  size_t size = 4 << 20;
+  char* p = (char*)pool_alloc_size(2 * size);
+  memset(p, 1, 2 * size);
+
+  // Free the two halves as separate blocks.
+  size_t before = pool_local_bytes();
+  pool_free_size(size, p);
+  pool_free_size(size, p + size);
+  ASSERT_EQ(before + (2 * size), pool_local_bytes());
+
+  // The first scavenge only starts timing the free blocks.
+  pool_setscavenge(100, 0);
+  pool_scavenge(1000);
+  ASSERT_EQ(before + (2 * size), pool_local_bytes());
+
+  pool_scavenge(2000);
+  ASSERT_LT(pool_local_bytes(), size);
+
+  // The halves were coalesced with each other and their neighbours, and the
+  // released memory is still usable.
+  char* r = (char*)pool_alloc_size(2 * size);
+  ASSERT_TRUE(r >= p);
+  memset(r, 2, 2 * size);
+
+  pool_free_size(2 * size, r);
+  pool_setscavenge(0, 0);
+}
+
+TEST(Pool, Prealloc)
+{
+  size_t size = 8 << 20;
+  size_t before = pool_local_bytes();
+
+  // The memory becomes one of this thread's free blocks.
+  pool_setprealloc(size, false);
+  pool_prealloc();
+  ASSERT_EQ(before + size, pool_local_bytes());
+
+  char* p = (char*)pool_alloc_size(size);
+  ASSERT_EQ(before, pool_local_bytes());
+
+  pool_free_size(size, p);
+  pool_setprealloc(0, false);
+}
@@ -0,0 +1,43 @@
+#include <platform.h>
+
+#include <mem/region.h>
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+TEST(Region, Bump)
+{
+  region_t region;
+  memset(&region, 0, sizeof(region_t));
+
+  char* p1 = (char*)region_alloc(&region, 24);
+  char* p2 = (char*)region_alloc(&region, 8);
+  ASSERT_EQ(p1 + 32, p2);
+  ASSERT_EQ((uintptr_t)0, (uintptr_t)p2 & 15);
+  ASSERT_EQ((size_t)48, region.used);
+
+  region_destroy(&region);
+}
+
+TEST(Region, Reset)
+{
+  region_t region;
+  memset(&region, 0, sizeof(region_t));
+
+  void* p1 = region_alloc(&region, 64);
+
+  // Fill more than one block, plus a large allocation.
+  for(int i = 0; i < 4096; i++)
+    memset(region_alloc(&region, 256), i, 256);
+
+  void* large = region_alloc(&region, 1 << 20);
+  memset(large, 0, 1 << 20);
+
+  // The first block is kept and reused.
+  region_reset(&region);
+  ASSERT_EQ((size_t)0, region.used);
+  ASSERT_EQ(p1, region_alloc(&region, 64));
+
+  region_destroy(&region);
+}
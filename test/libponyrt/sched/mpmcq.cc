@@ -0,0 +1,27 @@
+#include <platform.h>
+
+#include <sched/mpmcq.h>
+
+#include <gtest/gtest.h>
+
+TEST(MPMCQ, PushBatchKeepsOrder)
+{
+  mpmcq_t q;
+  mpmcq_init(&q);
+
+  int a, b, c, d;
+  void* batch[] = {&b, &c, &d};
+
+  mpmcq_push(&q, &a);
+  mpmcq_push_batch(&q, batch, 3);
+  ASSERT_FALSE(mpmcq_empty(&q));
+
+  ASSERT_EQ(&a, mpmcq_pop(&q));
+  ASSERT_EQ(&b, mpmcq_pop(&q));
+  ASSERT_EQ(&c, mpmcq_pop(&q));
+  ASSERT_EQ(&d, mpmcq_pop(&q));
+  ASSERT_EQ(NULL, mpmcq_pop(&q));
+  ASSERT_TRUE(mpmcq_empty(&q));
+
+  mpmcq_destroy(&q);
+}
@@ -0,0 +1,119 @@
+#include <platform.h>
+
+#include <sched/ringq.h>
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+TEST(RingQ, PushUntilFull)
+{
+  ringq_t q;
+  ringq_init(&q, 3, false);
+
+  // The size is rounded up to a power of 2.
+  for(uintptr_t i = 0; i < 4; i++)
+    ASSERT_TRUE(ringq_push(&q, i));
+
+  ASSERT_FALSE(ringq_push(&q, 4));
+
+  uintptr_t out[8];
+  ASSERT_EQ(2u, ringq_pop_batch(&q, out, 2));
+  ASSERT_EQ(0u, out[0]);
+  ASSERT_EQ(1u, out[1]);
+
+  // Popping frees the slots for another lap.
+  ASSERT_TRUE(ringq_push(&q, 4));
+  ASSERT_TRUE(ringq_push(&q, 5));
+  ASSERT_FALSE(ringq_push(&q, 6));
+
+  ASSERT_EQ(4u, ringq_pop_batch(&q, out, 8));
+
+  for(uintptr_t i = 0; i < 4; i++)
+    ASSERT_EQ(i + 2, out[i]);
+
+  ASSERT_TRUE(ringq_empty(&q));
+  ringq_destroy(&q);
+}
+
+TEST(RingQ, PushBatchTakesWhatFits)
+{
+  ringq_t q;
+  ringq_init(&q, 8, true);
+
+  uintptr_t in[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  ASSERT_EQ(5u, ringq_push_batch(&q, in, 5));
+  ASSERT_EQ(3u, ringq_push_batch(&q, in + 5, 5));
+  ASSERT_EQ(0u, ringq_push_batch(&q, in + 8, 2));
+  ASSERT_FALSE(ringq_empty(&q));
+
+  uintptr_t out[10];
+  ASSERT_EQ(8u, ringq_pop_batch(&q, out, 10));
+
+  for(uintptr_t i = 0; i < 8; i++)
+    ASSERT_EQ(i, out[i]);
+
+  ASSERT_EQ(0u, ringq_pop_batch(&q, out, 10));
+  ringq_destroy(&q);
+}
+
+TEST(RingQ, ManyProducersKeepTheirOrder)
+{
+  const uintptr_t producers = 4;
+  const uintptr_t count = 20000;
+
+  ringq_t q;
+  ringq_init(&q, 64, true);
+
+  std::vector<std::thread> threads;
+
+  for(uintptr_t p = 0; p < producers; p++)
+  {
+    threads.push_back(std::thread([&q, p, count]()
+    {
+      // Each word is tagged with its producer in the top bits.
+      uintptr_t batch[3];
+
+      for(uintptr_t i = 0; i < count; )
+      {
+        for(uintptr_t j = 0; j < 3; j++)
+          batch[j] = (p << 56) | (i + j);
+
+        size_t n = (count - i) < 3 ? (size_t)(count - i) : 3;
+        n = ringq_push_batch(&q, batch, n);
+
+        if(n == 0)
+          std::this_thread::yield();
+
+        i += n;
+      }
+    }));
+  }
+
+  uintptr_t next[producers] = {0};
+  uintptr_t out[16];
+  uintptr_t total = 0;
+
+  while(total < (producers * count))
+  {
+    size_t n = ringq_pop_batch(&q, out, 16);
+
+    if(n == 0)
+      std::this_thread::yield();
+
+    for(size_t i = 0; i < n; i++)
+    {
+      uintptr_t p = out[i] >> 56;
+      ASSERT_EQ(next[p], out[i] & 0xFFFFFFFF);
+      next[p]++;
+    }
+
+    total += n;
+  }
+
+  for(auto& t : threads)
+    t.join();
+
+  ASSERT_TRUE(ringq_empty(&q));
+  ringq_destroy(&q);
+}
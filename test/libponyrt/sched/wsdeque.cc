@@ -0,0 +1,66 @@
+#include <platform.h>
+
+#include <sched/wsdeque.h>
+
+#include <gtest/gtest.h>
+
+TEST(WSDeque, PopIsLifo)
+{
+  wsdeque_t q;
+  wsdeque_init(&q, 8);
+
+  int a, b;
+  ASSERT_TRUE(wsdeque_push(&q, &a));
+  ASSERT_TRUE(wsdeque_push(&q, &b));
+  ASSERT_EQ((size_t)2, wsdeque_size(&q));
+
+  ASSERT_EQ(&b, wsdeque_pop(&q));
+  ASSERT_EQ(&a, wsdeque_pop(&q));
+  ASSERT_EQ(NULL, wsdeque_pop(&q));
+
+  wsdeque_destroy(&q);
+}
+
+TEST(WSDeque, StealIsFifo)
+{
+  wsdeque_t q;
+  wsdeque_init(&q, 8);
+
+  int a, b;
+  ASSERT_TRUE(wsdeque_push(&q, &a));
+  ASSERT_TRUE(wsdeque_push(&q, &b));
+
+  ASSERT_EQ(&a, wsdeque_steal(&q));
+  ASSERT_EQ(&b, wsdeque_pop(&q));
+  ASSERT_EQ(NULL, wsdeque_steal(&q));
+  ASSERT_EQ(NULL, wsdeque_pop(&q));
+
+  wsdeque_destroy(&q);
+}
+
+TEST(WSDeque, PushFailsWhenFull)
+{
+  wsdeque_t q;
+  wsdeque_init(&q, 4);
+
+  int e[5];
+
+  for(int i = 0; i < 4; i++)
+  {
+    ASSERT_TRUE(wsdeque_push(&q, &e[i]));
+  }
+
+  ASSERT_FALSE(wsdeque_push(&q, &e[4]));
+
+  // Stealing makes room again, and the buffer wraps around.
+  ASSERT_EQ(&e[0], wsdeque_steal(&q));
+  ASSERT_TRUE(wsdeque_push(&q, &e[4]));
+
+  for(int i = 4; i > 0; i--)
+  {
+    ASSERT_EQ(&e[i], wsdeque_pop(&q));
+  }
+
+  ASSERT_EQ((size_t)0, wsdeque_size(&q));
+  wsdeque_destroy(&q);
+}